@@ -2,634 +2,879 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <pwd.h>
+#include <fcntl.h>
 #include <sys/utsname.h>
+#include <pthread.h>
+#include "deb1.h"
+#include "lesson_pack.h"
+#include "console.h"
+#include "batch.h"
+#include "session.h"
+#include "server.h"
+#include "bench.h"
+#include "sim.h"
+#include "vfs.h"
+#include "proc.h"
+#include "apt.h"
+#include "launch.h"
+#include "render.h"
+#include "sysinfo.h"
+#include "prefetch.h"
+#include "journal.h"
+#include "instr.h"
+#include "micro.h"
+#include "logsim.h"
+#include "grep.h"
+#include "locate.h"
+#include "adapt.h"
+#include "pipeline.h"
+#include "systemd.h"
+#include "nss.h"
+#include "perm.h"
+#include "net.h"
+#include "sdjournal.h"
+#include "sysstat.h"
+#include "hostprof.h"
+#include "grade.h"
 
-#define MAX_INPUT 256
-#define CLEAR_SCREEN "\033[2J\033[H"
-#define COLOR_GREEN "\033[32m"
-#define COLOR_BLUE "\033[34m"
-#define COLOR_YELLOW "\033[33m"
-#define COLOR_RED "\033[31m"
-#define COLOR_CYAN "\033[36m"
-#define COLOR_RESET "\033[0m"
-
-// Operating system types
-typedef enum {
-    OS_DEBIAN,
-    OS_UBUNTU,
-    OS_SIMULATE_DEBIAN
-} os_type_t;
-
-// Global system configuration
-typedef struct {
-    os_type_t os_type;
-    char os_name[50];
-    int simulate_mode;
-    char prompt_prefix[20];
-} system_config_t;
-
-system_config_t sys_config;
-
-// Structure to hold lesson information
-typedef struct {
-    char title[100];
-    char description[300];
-    char command[100];
-    char explanation[500];
-    char simulated_output[1000];
-} Lesson;
-
-// Function prototypes
-void detect_and_configure_system(void);
-void display_welcome(void);
-void show_main_menu(void);
-void clear_input_buffer(void);
-int get_user_choice(int max_options);
-void press_enter_to_continue(void);
-void show_system_info_lesson(void);
-void show_file_system_lesson(void);
-void show_process_management_lesson(void);
-void show_package_management_lesson(void);
-void show_user_management_lesson(void);
-void interactive_command_demo(const char* command, const char* description, const char* simulated_output);
-void execute_or_simulate_command(const char* command, const char* simulated_output);
+__thread system_config_t sys_config;
+
+// The curriculum: a compiled lesson pack, mapped at startup
+lesson_pack_t lessons;
+
+// Places a compiled pack is looked for when --pack is not given
+static const char* pack_search_path[] = {
+    "debian.pack",
+    "/usr/local/share/deb1/debian.pack",
+    "/usr/share/deb1/debian.pack",
+};
+#define LESSON_SOURCE "lessons/debian.lessons"
+
+const char* os_release_path = "/etc/os-release";
+
+// How lesson commands are rewritten for this machine in live mode; loaded
+// the first time a live mode is chosen, like the lesson pack
+static adapt_rules_t adapt_rules;
+static int adapt_rules_loaded;
+static const char* adapt_search_path[] = {
+    "adapt.table",
+    "/usr/local/share/deb1/adapt.table",
+    "/usr/share/deb1/adapt.table",
+};
+#define ADAPT_SOURCE "lessons/adapt.rules"
+
+// Limits for real commands in live mode (--timeout, --max-output)
+static int command_timeout = 300;
+static size_t command_max_output = 8 << 20;
+
+// Host information for the system-info commands in live mode
+static sysinfo_t host_info;
+static int host_info_ready;
+
+// The host's profile, loaded or probed at startup in an interactive
+// session (--no-host-profile); the other modes do without
+static hostprof_t host_profile;
+static int host_profile_ready;
+static int host_profile_enabled = 1;
+static char host_profile_path[512];
+
+// Exercise grading, set up when a session first reaches an exercise
+static grade_set_t* exercises;
+static pthread_once_t exercises_once = PTHREAD_ONCE_INIT;
+
+// Start read-only commands while the learner reads the demo (--no-prefetch)
+static int prefetch_enabled = 1;
+
+// The learner's progress journal (--journal, --learner, --no-journal);
+// NULL when progress is not kept
+static journal_t* progress_journal;
+static const char* journal_dir;
+static const char* learner_name;
+static int journal_enabled = 1;
+
+static const struct {
+    const char* name;
+    bench_fn_t run;
+} bench_suites[] = {
+    { "pack", lesson_pack_bench },
+    { "vfs", vfs_bench },
+    { "proc", proc_bench },
+    { "apt", apt_bench },
+    { "launch", launch_bench },
+    { "render", render_bench },
+    { "sysinfo", sysinfo_bench },
+    { "prefetch", prefetch_bench },
+    { "journal", journal_bench },
+    { "instr", instr_bench },
+    { "micro", micro_bench },
+    { "grep", grep_bench },
+    { "locate", locate_bench },
+    { "adapt", adapt_bench },
+    { "pipeline", pipeline_bench },
+    { "systemd", systemd_bench },
+    { "nss", nss_bench },
+    { "perm", perm_bench },
+    { "net", net_bench },
+    { "sdjournal", sdj_bench },
+    { "sysstat", sysstat_bench },
+    { "hostprof", hostprof_bench },
+    { "grade", grade_bench },
+};
+
+static const char* step_colors[] = {
+    "", COLOR_GREEN, COLOR_BLUE, COLOR_YELLOW, COLOR_RED, COLOR_CYAN
+};
+
+// Function prototypes (screens shared with session.c are in deb1.h)
 char* adapt_command_for_system(const char* original_command);
 void show_simulation_notice(void);
+static void report_prefetch(void);
+static int outcome_status(int rc, const launch_result_t* result);
+static int stream_output(void* ctx, const char* data, size_t len);
+void usage(const char* argv0);
+int run_bench(int argc, char** argv);
+static int count_arg(const char* option, const char* value, long max, long* out);
 
-int main(void) {
-    int choice;
-    int running = 1;
-    
-    detect_and_configure_system();
-    display_welcome();
-    
-    while (running) {
-        show_main_menu();
-        choice = get_user_choice(6);
-        
-        switch (choice) {
-            case 1:
-                show_system_info_lesson();
-                break;
-            case 2:
-                show_file_system_lesson();
-                break;
-            case 3:
-                show_process_management_lesson();
-                break;
-            case 4:
-                show_package_management_lesson();
-                break;
-            case 5:
-                show_user_management_lesson();
-                break;
-            case 6:
-                printf(COLOR_GREEN "\nThanks for learning with us! Keep exploring Linux! 🐧\n" COLOR_RESET);
-                running = 0;
-                break;
-            default:
-                printf(COLOR_RED "\nHmm, that's not a valid option. Let's try again!\n" COLOR_RESET);
-                press_enter_to_continue();
+int main(int argc, char** argv) {
+    const char* pack_path = NULL;
+    const char* batch_script = NULL;
+    const char* batch_output = NULL;
+    const char* grade_submissions = NULL;
+    const char* grade_output = NULL;
+    const char* serve_address = NULL;
+    const char* loadtest_address = NULL;
+    const char* report_dir = NULL;
+    const char* metrics_path = NULL;
+    char default_dir[512];
+    int batch_sessions = 1;
+    int threads = 0;
+    int clients = 1000;
+    int rounds = 5;
+    int think_ms = 0;
+    long n;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc) {
+            pack_path = argv[++i];
+        } else if (strcmp(argv[i], "--compile-pack") == 0 && i + 2 < argc) {
+            char err[256];
+            if (lesson_pack_compile_to(argv[i + 1], argv[i + 2], err, sizeof(err)) < 0) {
+                fprintf(stderr, "%s\n", err);
+                return 1;
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--compile-rules") == 0 && i + 2 < argc) {
+            char err[256];
+            if (adapt_compile_to(argv[i + 1], argv[i + 2], err, sizeof(err)) < 0) {
+                fprintf(stderr, "%s\n", err);
+                return 1;
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--gen-logs") == 0 && i + 2 < argc) {
+            uint64_t size = logsim_parse_size(argv[i + 2]);
+            int rc;
+
+            if (!size) {
+                fprintf(stderr, "%s: not a size (e.g. 512M, 4G)\n", argv[i + 2]);
+                return 1;
+            }
+            rc = logsim_generate(argv[i + 1], size, LOGSIM_SEED);
+            if (rc < 0) {
+                fprintf(stderr, "%s: %s\n", argv[i + 1], strerror(-rc));
+                return 1;
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--updatedb") == 0 && i + 2 < argc) {
+            locate_db_t* db = locate_build_dir(argv[i + 1]);
+            int rc;
+
+            if (!db) {
+                fprintf(stderr, "%s: %s\n", argv[i + 1], strerror(errno));
+                return 1;
+            }
+            rc = locate_save(db, argv[i + 2]);
+            locate_free(db);
+            if (rc < 0) {
+                fprintf(stderr, "%s: %s\n", argv[i + 2], strerror(-rc));
+                return 1;
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            return run_bench(argc - i - 1, argv + i + 1);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_script = argv[++i];
+        } else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+            if (count_arg(argv[i], argv[i + 1], INT_MAX, &n) < 0) return 1;
+            batch_sessions = (int)n;
+            i++;
+        } else if (strcmp(argv[i], "--batch-output") == 0 && i + 1 < argc) {
+            batch_output = argv[++i];
+        } else if (strcmp(argv[i], "--grade") == 0 && i + 1 < argc) {
+            grade_submissions = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            if (count_arg(argv[i], argv[i + 1], INT_MAX, &n) < 0) return 1;
+            threads = (int)n;
+            i++;
+        } else if (strcmp(argv[i], "--grade-output") == 0 && i + 1 < argc) {
+            grade_output = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_address = argv[++i];
+        } else if (strcmp(argv[i], "--loadtest") == 0 && i + 1 < argc) {
+            loadtest_address = argv[++i];
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            if (count_arg(argv[i], argv[i + 1], INT_MAX, &n) < 0) return 1;
+            clients = (int)n;
+            i++;
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            if (count_arg(argv[i], argv[i + 1], INT_MAX, &n) < 0) return 1;
+            rounds = (int)n;
+            i++;
+        } else if (strcmp(argv[i], "--think") == 0 && i + 1 < argc) {
+            if (count_arg(argv[i], argv[i + 1], INT_MAX, &n) < 0) return 1;
+            think_ms = (int)n;
+            i++;
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            if (count_arg(argv[i], argv[i + 1], INT_MAX, &n) < 0) return 1;
+            command_timeout = (int)n;
+            i++;
+        } else if (strcmp(argv[i], "--max-output") == 0 && i + 1 < argc) {
+            if (count_arg(argv[i], argv[i + 1], LONG_MAX, &n) < 0) return 1;
+            command_max_output = (size_t)n;
+            i++;
+        } else if (strcmp(argv[i], "--no-prefetch") == 0) {
+            prefetch_enabled = 0;
+        } else if (strcmp(argv[i], "--no-host-profile") == 0) {
+            host_profile_enabled = 0;
+        } else if (strcmp(argv[i], "--journal") == 0 && i + 1 < argc) {
+            journal_dir = argv[++i];
+        } else if (strcmp(argv[i], "--learner") == 0 && i + 1 < argc) {
+            learner_name = argv[++i];
+        } else if (strcmp(argv[i], "--no-journal") == 0) {
+            journal_enabled = 0;
+        } else if (strcmp(argv[i], "--journal-report") == 0 && i + 1 < argc) {
+            report_dir = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
         }
     }
-    
+
+    if (loadtest_address) {
+        return server_loadtest(loadtest_address, batch_script, clients, rounds, think_ms);
+    }
+
+    load_lessons(pack_path);
+    if (metrics_path) instr_enable(metrics_path);
+
+    if (report_dir) {
+        int rc = journal_report(report_dir, stdout);
+        if (rc < 0) fprintf(stderr, "%s: %s\n", report_dir, strerror(-rc));
+        lesson_pack_close(&lessons);
+        return rc < 0 ? 1 : 0;
+    }
+
+    if (serve_address) {
+        int rc = server_run(serve_address, threads);
+        if (metrics_path) instr_export();
+        grade_free(exercises);
+        lesson_pack_close(&lessons);
+        return rc;
+    }
+
+    if (grade_submissions) {
+        int rc = grade_batch(&lessons, grade_submissions, threads, grade_output);
+        lesson_pack_close(&lessons);
+        return rc;
+    }
+
+    if (batch_script) {
+        int rc = batch_run(batch_script, batch_sessions, batch_output);
+        if (metrics_path) instr_export();
+        grade_free(exercises);
+        lesson_pack_close(&lessons);
+        return rc;
+    }
+
+    if (journal_enabled) {
+        const struct passwd* pw = getpwuid(getuid());
+
+        if (!journal_dir) journal_dir = journal_default_dir(default_dir, sizeof(default_dir));
+        if (!learner_name) learner_name = getenv("USER");
+        if (!learner_name && pw) learner_name = pw->pw_name;
+        progress_journal = journal_open(journal_dir, learner_name ? learner_name : "learner");
+        if (!progress_journal) {
+            fprintf(stderr, "%s: %s; progress will not be saved\n", journal_dir, strerror(errno));
+        }
+        journal_append(progress_journal, JOURNAL_SESSION, "", 0, 0);
+    }
+
+    if (host_profile_enabled) {
+        int warm, rc;
+
+        hostprof_default_path(host_profile_path, sizeof(host_profile_path));
+        rc = hostprof_load(&host_profile, host_profile_path, os_release_path, &warm);
+        if (rc < 0) {
+            fprintf(stderr, "%s: %s; the host will be probed again next time\n", host_profile_path, strerror(-rc));
+            host_profile_path[0] = '\0';
+        }
+        host_profile_ready = 1;
+    }
+
+    run_session();
+    con_flush();
+    journal_close(progress_journal);
+    prefetch_shutdown();
+    report_prefetch();
+    if (metrics_path) instr_export();
+    adapt_close(&adapt_rules);
+    grade_free(exercises);
+    lesson_pack_close(&lessons);
+    return 0;
+}
+
+// The value of a numeric option: a whole number from 0 to max
+static int count_arg(const char* option, const char* value, long max, long* out) {
+    char* end;
+
+    errno = 0;
+    *out = strtol(value, &end, 10);
+    if (end == value || *end || errno || *out < 0 || *out > max) {
+        fprintf(stderr, "%s: not a count: '%s'\n", option, value);
+        return -1;
+    }
+    return 0;
+}
+
+void usage(const char* argv0) {
+    printf("Usage: %s [--pack FILE] [--timeout SECONDS] [--max-output BYTES] [--no-prefetch]\n", argv0);
+    printf("       %*s [--journal DIR] [--learner NAME] [--no-journal]\n", (int)strlen(argv0), "");
+    printf("       %*s [--metrics FILE] [--no-host-profile]\n", (int)strlen(argv0), "");
+    printf("       %s --journal-report DIR\n", argv0);
+    printf("       %s --compile-pack SOURCE.lessons OUTPUT.pack\n", argv0);
+    printf("       %s --compile-rules SOURCE.rules OUTPUT.table\n", argv0);
+    printf("       %s --gen-logs DIR SIZE\n", argv0);
+    printf("       %s --updatedb DIR DATABASE\n", argv0);
+    printf("       %s --batch SCRIPT [--sessions N] [--batch-output FILE]\n", argv0);
+    printf("       %s --grade SUBMISSIONS [--threads N] [--grade-output FILE]\n", argv0);
+    printf("       %s --serve unix:PATH|tcp:[HOST:]PORT [--threads N]\n", argv0);
+    printf("       %s --loadtest ADDRESS [--clients N] [--rounds N] [--think MS]\n", argv0);
+    printf("       %*s [--batch SCRIPT]\n", (int)strlen(argv0), "");
+    printf("       %s --bench SUITE [ARGS...]\n", argv0);
+    printf("\nWithout --pack, $DEB1_LESSON_PACK, ./debian.pack and the system\n");
+    printf("share directories are tried, then %s is compiled in memory.\n", LESSON_SOURCE);
+    printf("In live mode each command is stopped after --timeout seconds (default %d)\n", command_timeout);
+    printf("or --max-output bytes of output (default %zu); 0 means no limit.\n", command_max_output);
+    printf("Read-only commands start while their demo is on screen unless --no-prefetch.\n");
+    printf("Live commands are adapted to the detected system with the rules in\n");
+    printf("$DEB1_ADAPT_RULES, ./adapt.table, the system share directories or %s.\n", ADAPT_SOURCE);
+    printf("What the host is (os-release, uname, CPUs, memory, installed tools)\n");
+    printf("and the mode chosen last are kept in $DEB1_HOST_PROFILE or\n");
+    printf("~/.cache/deb1/host-profile and probed again when the host changes.\n");
+    printf("Progress is kept per learner ($USER) in --journal DIR, by default\n");
+    printf("$DEB1_JOURNAL_DIR or ~/.local/share/deb1/progress.\n");
+    printf("--metrics writes timing histograms (JSON if FILE ends in .json, else\n");
+    printf("Prometheus text) on exit and on SIGUSR2.\n");
+    printf("--gen-logs writes a synthetic /var/log of SIZE bytes (512M, 4G) for\n");
+    printf("the simulated grep to search when $DEB1_LOG_CORPUS points at it.\n");
+    printf("--updatedb indexes the paths under DIR for the simulated locate to\n");
+    printf("search when $DEB1_LOCATE_DB points at the DATABASE.\n");
+    printf("--grade checks a file of exercise answers, a line each:\n");
+    printf("[LEARNER<TAB>]EXERCISE<TAB>COMMAND, exercises numbered from 1 in pack\n");
+    printf("order, on --threads threads (default one per CPU); --grade-output gets\n");
+    printf("each line's fields before the command with its verdict.\n");
+}
+
+int run_bench(int argc, char** argv) {
+    size_t i;
+
+    for (i = 0; i < sizeof(bench_suites) / sizeof(bench_suites[0]); i++) {
+        if (strcmp(argv[0], bench_suites[i].name) == 0) {
+            return bench_suites[i].run(argc - 1, argv + 1);
+        }
+    }
+    fprintf(stderr, "Unknown benchmark suite '%s'. Available:", argv[0]);
+    for (i = 0; i < sizeof(bench_suites) / sizeof(bench_suites[0]); i++) {
+        fprintf(stderr, " %s", bench_suites[i].name);
+    }
+    fprintf(stderr, "\n");
+    return 1;
+}
+
+void load_lessons(const char* explicit_path) {
+    char err[256];
+    const char* env_path = getenv("DEB1_LESSON_PACK");
+    size_t i;
+
+    if (!explicit_path && env_path && *env_path) explicit_path = env_path;
+
+    if (explicit_path) {
+        if (lesson_pack_open(&lessons, explicit_path, err, sizeof(err)) == 0) return;
+        fprintf(stderr, "%s\n", err);
+        exit(1);
+    }
+
+    for (i = 0; i < sizeof(pack_search_path) / sizeof(pack_search_path[0]); i++) {
+        if (access(pack_search_path[i], R_OK) == 0 &&
+            lesson_pack_open(&lessons, pack_search_path[i], err, sizeof(err)) == 0) {
+            return;
+        }
+    }
+
+    // No compiled pack installed: build one from the bundled source
+    if (lesson_pack_compile_file(&lessons, LESSON_SOURCE, err, sizeof(err)) == 0) return;
+    fprintf(stderr, "No lesson pack found (%s)\n", err);
+    exit(1);
+}
+
+// Whether the detected system is family or derived from it
+static int os_is(const char* family) {
+    const char* like = sys_config.os_id_like;
+    size_t len = strlen(family);
+
+    if (strcmp(sys_config.os_id, family) == 0) return 1;
+    while (*like) {
+        size_t n = strcspn(like, " ");
+        if (n == len && strncmp(like, family, len) == 0) return 1;
+        like += n;
+        like += strspn(like, " ");
+    }
     return 0;
 }
 
 void detect_and_configure_system(void) {
-    FILE *fp;
-    char buffer[256];
-    int user_choice;
+    static const char* modes[] = { "", "Debian", "Ubuntu", "Simulation", "auto-selection" };
+    static hostprof_t other;
+    const hostprof_t* hp = &host_profile;
+    const char* name;
+    
+    con_clear_screen();
+    con_printf(COLOR_CYAN "🔍 System Detection & Configuration\n");
+    con_printf("════════════════════════════════════\n\n" COLOR_RESET);
+    
+    // Try to detect the system automatically; derivatives name their
+    // parents in ID_LIKE. The profile has it unless there is none or the
+    // benchmarks point at another os-release.
+    if (!host_profile_ready || strcmp(host_profile.os_release, os_release_path) != 0) {
+        hostprof_probe_os(&other, os_release_path);
+        hp = &other;
+    }
+    snprintf(sys_config.os_id, sizeof(sys_config.os_id), "%s", hp->os_id);
+    snprintf(sys_config.os_id_like, sizeof(sys_config.os_id_like), "%s", hp->os_id_like);
+    name = hp->os_name;
+    sys_config.last_mode = host_profile_ready && host_profile.last_mode <= 4 ? (int)host_profile.last_mode : 0;
+    if (strcmp(sys_config.os_id, "debian") == 0) {
+        con_printf(COLOR_GREEN "🎯 Detected: Debian system\n" COLOR_RESET);
+        strcpy(sys_config.os_name, "Debian");
+    } else if (strcmp(sys_config.os_id, "ubuntu") == 0) {
+        con_printf(COLOR_GREEN "🎯 Detected: Ubuntu system\n" COLOR_RESET);
+        strcpy(sys_config.os_name, "Ubuntu");
+    } else if (os_is("ubuntu") || os_is("debian")) {
+        con_printf(COLOR_GREEN "🎯 Detected: %s (%s-based)\n" COLOR_RESET,
+                   name[0] ? name : sys_config.os_id, os_is("ubuntu") ? "Ubuntu" : "Debian");
+        strcpy(sys_config.os_name, name[0] ? name : sys_config.os_id);
+    } else if (name[0]) {
+        con_printf(COLOR_YELLOW "🔎 Detected: %s, which is not Debian-based\n" COLOR_RESET, name);
+        strcpy(sys_config.os_name, name);
+    }
     
-    printf(CLEAR_SCREEN);
-    printf(COLOR_CYAN "🔍 System Detection & Configuration\n");
-    printf("════════════════════════════════════\n\n" COLOR_RESET);
+    con_printf("\nThis tutorial focuses on Debian system administration.\n");
+    con_printf("How would you like to proceed?\n\n");
     
-    // Try to detect the system automatically
-    fp = fopen("/etc/os-release", "r");
-    if (fp != NULL) {
-        while (fgets(buffer, sizeof(buffer), fp)) {
-            if (strncmp(buffer, "ID=", 3) == 0) {
-                if (strstr(buffer, "debian")) {
-                    printf(COLOR_GREEN "🎯 Detected: Debian system\n" COLOR_RESET);
-                    strcpy(sys_config.os_name, "Debian");
-                    break;
-                } else if (strstr(buffer, "ubuntu")) {
-                    printf(COLOR_GREEN "🎯 Detected: Ubuntu system\n" COLOR_RESET);
-                    strcpy(sys_config.os_name, "Ubuntu");
-                    break;
-                }
+    con_printf("1. 🐧 I'm on Debian - use real commands\n");
+    con_printf("2. 🟠 I'm on Ubuntu - adapt commands when possible\n");
+    con_printf("3. 🎭 Simulate Debian environment (safe practice mode)\n");
+    con_printf("4. 🤔 I'm not sure - let me choose based on detection\n");
+    if (sys_config.last_mode) con_printf("\nPress Enter for %s mode, as last time.\n", modes[sys_config.last_mode]);
+    
+    con_printf(COLOR_BLUE "\nChoose your learning mode (1-4): " COLOR_RESET);
+}
+
+// Whether the host profile saw a program on $PATH, -1 if it did not look
+static int profile_has_program(const char* program) {
+    return hostprof_has(&host_profile, program);
+}
+
+// The rules in $DEB1_ADAPT_RULES, an installed table or the bundled
+// source. Without any, commands run as written.
+static void load_adapt_rules(void) {
+    char err[256];
+    const char* env_path = getenv("DEB1_ADAPT_RULES");
+    size_t i;
+
+    if (adapt_rules_loaded) return;
+    adapt_rules_loaded = 1;
+
+    if (env_path && *env_path) {
+        if (adapt_open(&adapt_rules, env_path, err, sizeof(err)) < 0) fprintf(stderr, "%s\n", err);
+    } else {
+        for (i = 0; i < sizeof(adapt_search_path) / sizeof(adapt_search_path[0]); i++) {
+            if (access(adapt_search_path[i], R_OK) == 0 &&
+                adapt_open(&adapt_rules, adapt_search_path[i], err, sizeof(err)) == 0) {
+                break;
             }
         }
-        fclose(fp);
+        if (!adapt_rules.base && access(ADAPT_SOURCE, R_OK) == 0 &&
+            adapt_compile_file(&adapt_rules, ADAPT_SOURCE, err, sizeof(err)) < 0) {
+            fprintf(stderr, "%s\n", err);
+        }
     }
-    
-    printf("\nThis tutorial focuses on Debian system administration.\n");
-    printf("How would you like to proceed?\n\n");
-    
-    printf("1. 🐧 I'm on Debian - use real commands\n");
-    printf("2. 🟠 I'm on Ubuntu - adapt commands when possible\n");
-    printf("3. 🎭 Simulate Debian environment (safe practice mode)\n");
-    printf("4. 🤔 I'm not sure - let me choose based on detection\n");
-    
-    printf(COLOR_BLUE "\nChoose your learning mode (1-4): " COLOR_RESET);
-    user_choice = get_user_choice(4);
-    
+    adapt_check_programs(&adapt_rules, host_profile_ready ? profile_has_program : NULL);
+}
+
+// Rules for the detected system if it is of the chosen family (NULL: of
+// any, else Debian's), otherwise the family's own
+static void select_adapt_rules(const char* family) {
+    load_adapt_rules();
+    if (!family || os_is(family)) {
+        sys_config.adapt_ruleset = adapt_select(&adapt_rules, sys_config.os_id, sys_config.os_id_like,
+                                                  family ? family : "debian");
+    } else {
+        sys_config.adapt_ruleset = adapt_select(&adapt_rules, family, NULL, NULL);
+    }
+    if (sys_config.adapt_ruleset != ADAPT_NO_RULES) {
+        con_printf(COLOR_CYAN "🔁 Commands are adapted with the %s rules\n" COLOR_RESET,
+                   adapt_ruleset_name(&adapt_rules, sys_config.adapt_ruleset));
+    }
+}
+
+void configure_learning_mode(int user_choice) {
     switch (user_choice) {
         case 1:
             sys_config.os_type = OS_DEBIAN;
             sys_config.simulate_mode = 0;
             strcpy(sys_config.prompt_prefix, "debian");
-            printf(COLOR_GREEN "\n✅ Debian mode: Real commands will be executed\n" COLOR_RESET);
+            con_printf(COLOR_GREEN "\n✅ Debian mode: Real commands will be executed\n" COLOR_RESET);
+            select_adapt_rules("debian");
             break;
         case 2:
             sys_config.os_type = OS_UBUNTU;
             sys_config.simulate_mode = 0;
             strcpy(sys_config.prompt_prefix, "ubuntu");
-            printf(COLOR_GREEN "\n✅ Ubuntu mode: Commands adapted where needed\n" COLOR_RESET);
+            con_printf(COLOR_GREEN "\n✅ Ubuntu mode: Commands adapted where needed\n" COLOR_RESET);
+            select_adapt_rules("ubuntu");
             break;
         case 3:
             sys_config.os_type = OS_SIMULATE_DEBIAN;
             sys_config.simulate_mode = 1;
             strcpy(sys_config.prompt_prefix, "sim-debian");
-            printf(COLOR_GREEN "\n✅ Simulation mode: Safe Debian practice environment\n" COLOR_RESET);
+            con_printf(COLOR_GREEN "\n✅ Simulation mode: Safe Debian practice environment\n" COLOR_RESET);
+            sys_config.adapt_ruleset = ADAPT_NO_RULES;
             break;
         case 4:
-            if (strstr(sys_config.os_name, "Ubuntu")) {
+            if (os_is("ubuntu")) {
                 sys_config.os_type = OS_UBUNTU;
                 sys_config.simulate_mode = 0;
                 strcpy(sys_config.prompt_prefix, "ubuntu");
-                printf(COLOR_GREEN "\n✅ Auto-selected Ubuntu mode based on detection\n" COLOR_RESET);
+                con_printf(COLOR_GREEN "\n✅ Auto-selected Ubuntu mode based on detection\n" COLOR_RESET);
             } else {
                 sys_config.os_type = OS_DEBIAN;
                 sys_config.simulate_mode = 0;
                 strcpy(sys_config.prompt_prefix, "debian");
-                printf(COLOR_GREEN "\n✅ Auto-selected Debian mode\n" COLOR_RESET);
+                con_printf(COLOR_GREEN "\n✅ Auto-selected Debian mode\n" COLOR_RESET);
             }
+            select_adapt_rules(NULL);
             break;
     }
     
+    // Offered again next time; a profile that cannot be saved only costs
+    // the next start its probe
+    if (host_profile_ready && host_profile_path[0] && user_choice >= 1 && user_choice <= 4 &&
+        host_profile.last_mode != (uint32_t)user_choice) {
+        host_profile.last_mode = (uint32_t)user_choice;
+        hostprof_save(&host_profile, host_profile_path);
+    }
+
     if (sys_config.simulate_mode) {
-        printf(COLOR_YELLOW "\n🎭 Simulation Mode Active!\n");
-        printf("Commands will show realistic Debian outputs without\n");
-        printf("actually modifying your system. Perfect for safe learning!\n" COLOR_RESET);
+        con_printf(COLOR_YELLOW "\n🎭 Simulation Mode Active!\n");
+        con_printf("Commands will show realistic Debian outputs without\n");
+        con_printf("actually modifying your system. Perfect for safe learning!\n" COLOR_RESET);
     }
-    
-    press_enter_to_continue();
 }
 
 void display_welcome(void) {
-    printf(CLEAR_SCREEN);
-    printf(COLOR_BLUE "╔════════════════════════════════════════════════════════════╗\n");
-    printf("║                                                            ║\n");
-    printf("║        🐧 Debian SysAdmin Academy! 🐧                     ║\n");
-    printf("║                                                            ║\n");
-    printf("║    Learn essential Linux system administration skills      ║\n");
-    printf("║         through hands-on, interactive lessons             ║\n");
-    printf("║                                                            ║\n");
-    printf("╚════════════════════════════════════════════════════════════╝\n" COLOR_RESET);
-    
-    printf(COLOR_GREEN "\nHey there, future sysadmin! 👋\n");
-    printf("Mode: %s%s%s | System: %s\n", COLOR_CYAN, 
+    con_clear_screen();
+    con_printf(COLOR_BLUE "╔════════════════════════════════════════════════════════════╗\n");
+    con_printf("║                                                            ║\n");
+    con_printf("║        🐧 Debian SysAdmin Academy! 🐧                     ║\n");
+    con_printf("║                                                            ║\n");
+    con_printf("║    Learn essential Linux system administration skills      ║\n");
+    con_printf("║         through hands-on, interactive lessons             ║\n");
+    con_printf("║                                                            ║\n");
+    con_printf("╚════════════════════════════════════════════════════════════╝\n" COLOR_RESET);
+    
+    con_printf(COLOR_GREEN "\nHey there, future sysadmin! 👋\n");
+    con_printf("Mode: %s%s%s | System: %s\n", COLOR_CYAN, 
            sys_config.simulate_mode ? "Simulation" : "Live", COLOR_GREEN, sys_config.os_name);
-    printf("Ready to dive into Debian system administration?\n");
-    printf("We'll explore real commands, understand what they do, and\n");
-    printf("build your confidence step by step.\n" COLOR_RESET);
-    
-    press_enter_to_continue();
+    con_printf("Ready to dive into Debian system administration?\n");
+    con_printf("We'll explore real commands, understand what they do, and\n");
+    con_printf("build your confidence step by step.\n" COLOR_RESET);
 }
 
 void show_main_menu(void) {
-    printf(CLEAR_SCREEN);
-    printf(COLOR_YELLOW "🎯 What would you like to explore today?\n");
-    printf("Mode: %s | %s\n\n", sys_config.prompt_prefix, 
+    con_clear_screen();
+    con_printf(COLOR_YELLOW "🎯 What would you like to explore today?\n");
+    con_printf("Mode: %s | %s\n\n", sys_config.prompt_prefix, 
            sys_config.simulate_mode ? "🎭 Simulation" : "🔥 Live");
-    printf(COLOR_RESET);
-    
-    printf("1. 🖥️  System Information & Monitoring\n");
-    printf("2. 📁 File System Navigation & Management\n");
-    printf("3. ⚙️  Process Management\n");
-    printf("4. 📦 Package Management (APT)\n");
-    printf("5. 👥 User & Permission Management\n");
-    printf("6. 🚪 Exit\n");
-    
-    printf(COLOR_BLUE "\nChoose your adventure (1-6): " COLOR_RESET);
-}
-
-void show_system_info_lesson(void) {
-    printf(CLEAR_SCREEN);
-    printf(COLOR_YELLOW "🖥️ System Information & Monitoring\n");
-    printf("══════════════════════════════════════\n\n" COLOR_RESET);
+    con_printf(COLOR_RESET);
     
-    if (sys_config.simulate_mode) show_simulation_notice();
-    
-    printf("Let's start by getting to know your system better!\n");
-    printf("As a sysadmin, you'll often need to check system status,\n");
-    printf("hardware info, and current resource usage.\n\n");
-    
-    printf(COLOR_GREEN "Would you like to:\n");
-    printf("1. See basic system information\n");
-    printf("2. Check system resources (CPU, memory, disk)\n");
-    printf("3. View system uptime and load\n");
-    printf("4. Back to main menu\n" COLOR_RESET);
-    
-    int choice = get_user_choice(4);
-    
-    switch (choice) {
-        case 1:
-            interactive_command_demo("uname -a", 
-                "Shows kernel name, version, architecture, and more!",
-                "Linux debian-server 6.1.0-13-amd64 #1 SMP PREEMPT_DYNAMIC Debian 6.1.55-1 (2023-09-29) x86_64 GNU/Linux");
-            interactive_command_demo("lsb_release -a", 
-                "Get detailed Debian version and distribution info",
-                "Distributor ID: Debian\nDescription: Debian GNU/Linux 12 (bookworm)\nRelease: 12\nCodename: bookworm");
-            interactive_command_demo("hostnamectl", 
-                "Modern way to see hostname and system info",
-                "Static hostname: debian-server\nIcon name: computer-server\nChassis: server\nMachine ID: a1b2c3d4e5f6789\nBoot ID: x1y2z3a4b5c6d7e8\nOperating System: Debian GNU/Linux 12 (bookworm)\nKernel: Linux 6.1.0-13-amd64\nArchitecture: x86-64");
-            break;
-        case 2:
-            interactive_command_demo("free -h", 
-                "Memory usage in human-readable format",
-                "              total        used        free      shared  buff/cache   available\nMem:           15Gi       2.1Gi        10Gi       256Mi       3.2Gi        12Gi\nSwap:         2.0Gi          0B       2.0Gi");
-            interactive_command_demo("df -h", 
-                "Disk space usage for all mounted filesystems",
-                "Filesystem      Size  Used Avail Use% Mounted on\n/dev/sda1        20G  8.5G   10G  46% /\n/dev/sda2       100G   45G   50G  48% /home\ntmpfs           7.8G     0  7.8G   0% /dev/shm");
-            interactive_command_demo("lscpu", 
-                "Detailed CPU architecture information",
-                "Architecture:        x86_64\nCPU op-mode(s):      32-bit, 64-bit\nByte Order:          Little Endian\nCPU(s):              4\nCore(s) per socket:  2\nSocket(s):           2\nModel name:          Intel(R) Core(TM) i7-8565U CPU @ 1.80GHz");
-            break;
-        case 3:
-            interactive_command_demo("uptime", 
-                "System uptime and load averages",
-                " 14:32:15 up 7 days, 12:45,  3 users,  load average: 0.15, 0.23, 0.18");
-            interactive_command_demo("w", 
-                "Who's logged in and what they're doing",
-                " 14:32:16 up 7 days, 12:45,  3 users,  load average: 0.15, 0.23, 0.18\nUSER     TTY      FROM             LOGIN@   IDLE   JCPU   PCPU WHAT\nroot     pts/0    192.168.1.100    13:45    2:00   0.01s  0.01s -bash\nadmin    pts/1    192.168.1.101    14:30    0.00s  0.05s  0.01s w");
-            interactive_command_demo("top -n 1 | head -10", 
-                "Quick snapshot of running processes",
-                "top - 14:32:17 up 7 days, 12:45,  3 users,  load average: 0.15, 0.23, 0.18\nTasks: 127 total,   1 running, 126 sleeping,   0 stopped,   0 zombie\n%Cpu(s):  2.3 us,  1.2 sy,  0.0 ni, 96.2 id,  0.3 wa,  0.0 hi,  0.0 si,  0.0 st\nMiB Mem :  15925.7 total,  10234.5 free,   2156.8 used,   3534.4 buff/cache\nMiB Swap:   2048.0 total,   2048.0 free,      0.0 used.  12987.2 avail Mem\n\n  PID USER      PR  NI    VIRT    RES    SHR S  %CPU  %MEM     TIME+ COMMAND\n    1 root      20   0  167304  13524   8456 S   0.0   0.1   0:03.21 systemd\n    2 root      20   0       0      0      0 S   0.0   0.0   0:00.01 kthreadd");
-            break;
-        case 4:
-            return;
+    uint32_t i;
+    for (i = 0; i < lessons.header->n_topics; i++) {
+        con_printf("%u. %s\n", i + 1, lp_str(&lessons, lp_topic(&lessons, i)->label));
     }
+    con_printf("%u. 💻 Practice shell\n%u. 🚪 Exit\n", i + 1, i + 2);
     
-    printf(COLOR_GREEN "\n💡 Pro tip: Combine commands with pipes!\n");
-    printf("Try: ps aux | grep nginx\n");
-    printf("This finds all processes related to nginx.\n" COLOR_RESET);
-    
-    press_enter_to_continue();
+    con_printf(COLOR_BLUE "\nChoose your adventure (1-%u): " COLOR_RESET, i + 2);
 }
 
-void show_file_system_lesson(void) {
-    printf(CLEAR_SCREEN);
-    printf(COLOR_YELLOW "📁 File System Navigation & Management\n");
-    printf("═══════════════════════════════════════════\n\n" COLOR_RESET);
+void show_lesson(const lp_topic_t* topic) {
+    uint32_t i;
+
+    con_clear_screen();
+    con_printf(COLOR_YELLOW "%s\n" COLOR_RESET, lp_str(&lessons, topic->title));
     
     if (sys_config.simulate_mode) show_simulation_notice();
     
-    printf("File system mastery is crucial for any sysadmin!\n");
-    printf("Let's explore navigation, file operations, and permissions.\n\n");
-    
-    printf(COLOR_GREEN "What interests you most?\n");
-    printf("1. Navigation basics (pwd, ls, cd)\n");
-    printf("2. File operations (cp, mv, rm, mkdir)\n");
-    printf("3. Finding files and content (find, grep, locate)\n");
-    printf("4. File permissions and ownership\n");
-    printf("5. Back to main menu\n" COLOR_RESET);
-    
-    int choice = get_user_choice(5);
-    
-    switch (choice) {
-        case 1:
-            printf("\n🧭 Let's navigate like a pro!\n\n");
-            interactive_command_demo("pwd", 
-                "Print Working Directory - where am I?",
-                "/home/admin");
-            interactive_command_demo("ls -la", 
-                "List all files with detailed info (including hidden ones)",
-                "total 32\ndrwxr-xr-x 4 admin admin 4096 Oct 15 14:30 .\ndrwxr-xr-x 3 root  root  4096 Oct 10 09:15 ..\n-rw------- 1 admin admin  220 Oct 10 09:15 .bash_logout\n-rw------- 1 admin admin 3526 Oct 10 09:15 .bashrc\ndrwx------ 2 admin admin 4096 Oct 15 14:25 .ssh\n-rw-r--r-- 1 admin admin  807 Oct 10 09:15 .profile\ndrwxr-xr-x 2 admin admin 4096 Oct 15 12:30 Documents");
-            interactive_command_demo("ls -lh /etc | head -10", 
-                "Look inside /etc with human-readable file sizes",
-                "total 1.2M\ndrwxr-xr-x   3 root root    4.0K Oct 10 09:20 alternatives\n-rw-r--r--   1 root root    2.9K Oct 10 09:15 bash.bashrc\n-rw-r--r--   1 root root     367 Jan 27  2023 bindresvport.blacklist\ndrwxr-xr-x   2 root root    4.0K Oct 15 10:30 cron.d\ndrwxr-xr-x   2 root root    4.0K Oct 15 10:30 cron.daily\n-rw-r--r--   1 root root    2.9K Jan 26  2023 debconf.conf\ndrwxr-xr-x   2 root root    4.0K Oct 10 09:20 default\n-rw-r--r--   1 root root     604 Jul  2  2023 deluser.conf");
-            break;
-        case 2:
-            printf("\n🔧 File manipulation essentials!\n\n");
-            printf(COLOR_BLUE "Note: In simulation mode, these are examples - be careful with real file operations!\n" COLOR_RESET);
-            interactive_command_demo("mkdir -p ~/test/nested/dir", 
-                "Create nested directories in one command",
-                sys_config.simulate_mode ? "Created directories: /home/admin/test/nested/dir" : "");
-            interactive_command_demo("touch ~/test/example.txt", 
-                "Create an empty file or update timestamp",
-                sys_config.simulate_mode ? "Created file: /home/admin/test/example.txt" : "");
-            interactive_command_demo("ls -la ~/test/", 
-                "Check our created directory",
-                "total 12\ndrwxr-xr-x 3 admin admin 4096 Oct 15 14:35 .\ndrwxr-xr-x 5 admin admin 4096 Oct 15 14:35 ..\n-rw-r--r-- 1 admin admin    0 Oct 15 14:35 example.txt\ndrwxr-xr-x 3 admin admin 4096 Oct 15 14:35 nested");
-            break;
-        case 3:
-            printf("\n🔍 Finding files like a detective!\n\n");
-            interactive_command_demo("find /etc -name '*.conf' | head -5", 
-                "Find first 5 .conf files in /etc directory",
-                "/etc/adduser.conf\n/etc/debconf.conf\n/etc/deluser.conf\n/etc/fuse.conf\n/etc/host.conf");
-            interactive_command_demo("locate sshd_config", 
-                "Quick search using the locate database",
-                "/etc/ssh/sshd_config");
-            interactive_command_demo("grep -r 'error' /var/log/ | head -3", 
-                "Search for 'error' in log files (first 3 results)",
-                "/var/log/syslog:Oct 15 10:30:15 debian kernel: [12345.678] USB disconnect error\n/var/log/auth.log:Oct 15 12:15:30 debian sshd[1234]: Authentication error for user test\n/var/log/daemon.log:Oct 15 13:45:22 debian systemd[1]: Service error: failed to start");
-            break;
-        case 4:
-            printf("\n🔐 Permissions and ownership!\n\n");
-            interactive_command_demo("ls -l /etc/passwd", 
-                "Check permissions on an important system file",
-                "-rw-r--r-- 1 root root 2847 Oct 10 09:20 /etc/passwd");
-            printf(COLOR_BLUE "\nPermission format: rwxrwxrwx (user-group-other)\n");
-            printf("r=read(4), w=write(2), x=execute(1)\n" COLOR_RESET);
-            interactive_command_demo("stat /etc/passwd", 
-                "Detailed file information including permissions",
-                "  File: /etc/passwd\n  Size: 2847      \tBlocks: 8          IO Block: 4096   regular file\nDevice: 801h/2049d\tInode: 131074      Links: 1\nAccess: (0644/-rw-r--r--)  Uid: (    0/    root)   Gid: (    0/    root)\nAccess: 2023-10-15 10:30:15.123456789 +0000\nModify: 2023-10-10 09:20:45.987654321 +0000\nChange: 2023-10-10 09:20:45.987654321 +0000");
-            break;
-        case 5:
-            return;
+    for (i = 0; i < topic->n_intro; i++) {
+        show_lesson_step(lp_step(&lessons, topic->first_intro + i));
     }
     
-    press_enter_to_continue();
+    con_printf(COLOR_GREEN "%s\n", lp_str(&lessons, topic->prompt));
+    for (i = 0; i < topic->n_sections; i++) {
+        con_printf("%u. %s\n", i + 1, lp_str(&lessons, lp_section(&lessons, topic, i)->label));
+    }
+    con_printf("%u. Back to main menu\n" COLOR_RESET, topic->n_sections + 1);
 }
 
-void show_process_management_lesson(void) {
-    printf(CLEAR_SCREEN);
-    printf(COLOR_YELLOW "⚙️ Process Management\n");
-    printf("══════════════════════\n\n" COLOR_RESET);
-    
-    if (sys_config.simulate_mode) show_simulation_notice();
-    
-    printf("Understanding processes is key to system administration!\n");
-    printf("Let's learn to monitor, control, and troubleshoot processes.\n\n");
-    
-    printf(COLOR_GREEN "Choose your focus:\n");
-    printf("1. Viewing processes (ps, top, htop)\n");
-    printf("2. Process control (kill, killall, jobs)\n");
-    printf("3. System services (systemctl)\n");
-    printf("4. Back to main menu\n" COLOR_RESET);
-    
-    int choice = get_user_choice(4);
-    
-    switch (choice) {
-        case 1:
-            printf("\n👀 Let's see what's running!\n\n");
-            interactive_command_demo("ps aux | head -10", 
-                "Show first 10 running processes with detailed info",
-                "USER       PID %CPU %MEM    VSZ   RSS TTY      STAT START   TIME COMMAND\nroot         1  0.0  0.1 167304 13524 ?        Ss   Oct08   0:03 /sbin/init\nroot         2  0.0  0.0      0     0 ?        S    Oct08   0:00 [kthreadd]\nroot         3  0.0  0.0      0     0 ?        I<   Oct08   0:00 [rcu_gp]\nroot         4  0.0  0.0      0     0 ?        I<   Oct08   0:00 [rcu_par_gp]\nroot         6  0.0  0.0      0     0 ?        I<   Oct08   0:00 [kworker/0:0H-events_highpri]\nroot         9  0.0  0.0      0     0 ?        I<   Oct08   0:00 [mm_percpu_wq]\nroot        10  0.0  0.0      0     0 ?        S    Oct08   0:00 [rcu_tasks_rude_]\nsystemd+   123  0.0  0.1  24756 12234 ?        Ss   Oct08   0:15 /lib/systemd/systemd-resolved\nroot       456  0.0  0.2  72456 23456 ?        Ss   Oct08   0:08 /usr/sbin/sshd -D");
-            interactive_command_demo("pgrep -l ssh", 
-                "Find processes by name (ssh in this case)",
-                "456 sshd\n789 ssh-agent");
-            break;
-        case 2:
-            printf("\n🎮 Process control commands!\n\n");
-            printf(COLOR_RED "⚠️  Be very careful with kill commands in live mode!\n" COLOR_RESET);
-            interactive_command_demo("jobs", 
-                "Show active jobs in current shell",
-                sys_config.simulate_mode ? "[1]+  Stopped                 vim /etc/hosts\n[2]-  Running                 tail -f /var/log/syslog &" : "");
-            printf(COLOR_BLUE "\nCommon signals:\n");
-            printf("SIGTERM (15) - Polite shutdown request\n");
-            printf("SIGKILL (9) - Force termination (use sparingly!)\n");
-            printf("SIGHUP (1) - Hang up (often reloads config)\n" COLOR_RESET);
-            if (sys_config.simulate_mode) {
-                printf(COLOR_YELLOW "\nIn simulation: 'kill -15 1234' would send SIGTERM to PID 1234\n" COLOR_RESET);
-            }
-            break;
-        case 3:
-            printf("\n🔧 Managing system services!\n\n");
-            interactive_command_demo("systemctl status ssh", 
-                "Check SSH service status",
-                "● ssh.service - OpenBSD Secure Shell server\n   Loaded: loaded (/lib/systemd/system/ssh.service; enabled; vendor preset: enabled)\n   Active: active (running) since Tue 2023-10-10 09:20:15 UTC; 5 days ago\n     Docs: man:sshd(8)\n           man:sshd_config(5)\n  Process: 456 ExecStartPre=/usr/sbin/sshd -t (code=exited, status=0/SUCCESS)\n Main PID: 456 (sshd)\n    Tasks: 1 (limit: 4915)\n   Memory: 5.2M\n      CPU: 1.234s\n   CGroup: /system.slice/ssh.service\n           └─456 /usr/sbin/sshd -D");
-            interactive_command_demo("systemctl list-units --type=service --state=running | head -10", 
-                "List first 10 running services",
-                "UNIT                               LOAD   ACTIVE SUB     DESCRIPTION\ncron.service                       loaded active running Regular background program processing daemon\ndbus.service                       loaded active running D-Bus System Message Bus\nnetworkd-dispatcher.service        loaded active running Dispatcher daemon for systemd-networkd\nnetworking.service                 loaded active exited  Raise network interfaces\nrsyslog.service                    loaded active running System Logging Service\nssh.service                        loaded active running OpenBSD Secure Shell server\nsystemd-journald.service           loaded active running Journal Service\nsystemd-logind.service             loaded active running User Login Management\nsystemd-networkd.service           loaded active running Network Configuration");
-            printf(COLOR_BLUE "\nCommon systemctl commands:\n");
-            printf("start, stop, restart, enable, disable, status\n" COLOR_RESET);
-            break;
-        case 4:
-            return;
+// Print a text step, or the prompt of a command demo or an exercise.
+// Returns 1 when the step waits for a run/explain/skip choice, 2 when it
+// waits for the learner's command.
+int show_lesson_step(const lp_step_t* step) {
+    if (!step || !step_applies(step)) return 0;
+
+    if (step->kind == LP_STEP_COMMAND) {
+        interactive_command_demo(lp_str(&lessons, step->text), lp_str(&lessons, step->description));
+        return 1;
     }
-    
-    press_enter_to_continue();
+    if (step->kind == LP_STEP_EXERCISE) {
+        con_printf(COLOR_BLUE "\n✏️  Exercise: " COLOR_YELLOW "%s\n" COLOR_RESET, lp_str(&lessons, step->text));
+        con_printf("Type the command (Enter alone shows an answer):\n");
+        return 2;
+    }
+    if (step->color != LP_COLOR_NONE && step->color <= LP_COLOR_CYAN) {
+        con_printf("%s%s\n" COLOR_RESET, step_colors[step->color], lp_str(&lessons, step->text));
+    } else {
+        con_printf("%s\n", lp_str(&lessons, step->text));
+    }
+    return 0;
 }
 
-void show_package_management_lesson(void) {
-    printf(CLEAR_SCREEN);
-    printf(COLOR_YELLOW "📦 Package Management with APT\n");
-    printf("═══════════════════════════════\n\n" COLOR_RESET);
-    
-    if (sys_config.simulate_mode) show_simulation_notice();
-    
-    printf("APT (Advanced Package Tool) is Debian's package manager.\n");
-    printf("It's your gateway to installing, updating, and managing software!\n");
-    
-    if (sys_config.os_type == OS_UBUNTU) {
-        printf(COLOR_CYAN "Note: You're on Ubuntu - APT works the same way! 🎉\n" COLOR_RESET);
-    }
-    printf("\n");
-    
-    printf(COLOR_GREEN "What would you like to learn?\n");
-    printf("1. Package searching and information\n");
-    printf("2. Installing and removing packages\n");
-    printf("3. System updates and upgrades\n");
-    printf("4. Package dependencies and troubleshooting\n");
-    printf("5. Back to main menu\n" COLOR_RESET);
-    
-    int choice = get_user_choice(5);
-    
-    switch (choice) {
-        case 1:
-            printf("\n🔍 Exploring available packages!\n\n");
-            interactive_command_demo("apt search htop", 
-                "Search for packages containing 'htop'",
-                "Sorting... Done\nFull Text Search... Done\nhtop/stable 3.2.1-1 amd64\n  interactive processes viewer\n\nhtop-vim/stable 1.0.2-1 all\n  Vi-style key bindings for htop");
-            interactive_command_demo("apt show htop", 
-                "Detailed information about htop package",
-                "Package: htop\nVersion: 3.2.1-1\nPriority: optional\nSection: utils\nMaintainer: Daniel Lange <DLange@debian.org>\nInstalled-Size: 234 kB\nDepends: libc6 (>= 2.15), libncurses6 (>= 6), libtinfo6 (>= 6)\nHomepage: https://htop.dev/\nDescription: interactive processes viewer\n htop is a ncurses-based process viewer similar to top, but it\n allows one to scroll the list vertically and horizontally to see\n all processes and their full command lines.");
-            interactive_command_demo("dpkg -l | grep vim", 
-                "Check if vim packages are installed",
-                "ii  vim-common    2:9.0.1378-2    all          Vi IMproved - Common files\nii  vim-tiny      2:9.0.1378-2    amd64        Vi IMproved - enhanced vi editor - compact version");
-            break;
-        case 2:
-            printf("\n📥 Installing and removing software!\n\n");
-            if (!sys_config.simulate_mode) {
-                printf(COLOR_RED "⚠️  These commands require root privileges (sudo)!\n" COLOR_RESET);
-            }
-            interactive_command_demo("sudo apt install htop", 
-                "Install htop system monitor",
-                "Reading package lists... Done\nBuilding dependency tree... Done\nReading state information... Done\nThe following NEW packages will be installed:\n  htop\n0 upgraded, 1 newly installed, 0 to remove and 0 not upgraded.\nNeed to get 123 kB of archives.\nAfter this operation, 234 kB of additional disk space will be used.\nGet:1 http://deb.debian.org/debian bookworm/main amd64 htop amd64 3.2.1-1 [123 kB]\nFetched 123 kB in 1s (123 kB/s)\nSelecting previously unselected package htop.\n(Reading database ... 95432 files and directories currently installed.)\nPreparing to unpack .../htop_3.2.1-1_amd64.deb ...\nUnpacking htop (3.2.1-1) ...\nSetting up htop (3.2.1-1) ...\nProcessing triggers for man-db (2.11.2-2) ...");
-            interactive_command_demo("sudo apt remove htop", 
-                "Remove htop (keeps config files)",
-                "Reading package lists... Done\nBuilding dependency tree... Done\nReading state information... Done\nThe following packages will be REMOVED:\n  htop\n0 upgraded, 0 newly installed, 1 to remove and 0 not upgraded.\nAfter this operation, 234 kB disk space will be freed.\nDo you want to continue? [Y/n] Y\n(Reading database ... 95456 files and directories currently installed.)\nRemoving htop (3.2.1-1) ...\nProcessing triggers for man-db (2.11.2-2) ...");
-            interactive_command_demo("sudo apt purge htop", 
-                "Remove htop and its configuration files",
-                "Reading package lists... Done\nBuilding dependency tree... Done\nReading state information... Done\nPackage 'htop' is not installed, so not removed\n0 upgraded, 0 newly installed, 0 to remove and 0 not upgraded.");
-            break;
-        case 3:
-            printf("\n🔄 Keeping your system updated!\n\n");
-            interactive_command_demo("sudo apt update", 
-                "Update package list from repositories",
-                "Hit:1 http://security.debian.org/debian-security bookworm-security InRelease\nHit:2 http://deb.debian.org/debian bookworm InRelease\nHit:3 http://deb.debian.org/debian bookworm-updates InRelease\nReading package lists... Done\nBuilding dependency tree... Done\nReading state information... Done\n15 packages can be upgraded. Run 'apt list --upgradable' to see them.");
-            interactive_command_demo("apt list --upgradable", 
-                "See what packages can be upgraded",
-                "Listing... Done\nbase-files/stable 12.4+deb12u2 amd64 [upgradable from: 12.4+deb12u1]\nlibc6/stable 2.36-9+deb12u3 amd64 [upgradable from: 2.36-9+deb12u2]\nlibc6-dev/stable 2.36-9+deb12u3 amd64 [upgradable from: 2.36-9+deb12u2]\nlinux-image-amd64/stable 6.1.55-1 amd64 [upgradable from: 6.1.52-1]\nvim-common/stable 2:9.0.1378-2 all [upgradable from: 2:9.0.1378-1]");
-            interactive_command_demo("sudo apt upgrade", 
-                "Upgrade installed packages to newer versions",
-                "Reading package lists... Done\nBuilding dependency tree... Done\nReading state information... Done\nCalculating upgrade... Done\nThe following packages will be upgraded:\n  base-files libc6 libc6-dev linux-image-amd64 vim-common\n5 upgraded, 0 newly installed, 0 to remove and 0 not upgraded.\nNeed to get 23.4 MB of archives.\nAfter this operation, 156 kB of additional disk space will be used.\nDo you want to continue? [Y/n] Y");
-            printf(COLOR_GREEN "\n💡 Best practice: Always 'apt update' before 'apt upgrade'!\n" COLOR_RESET);
-            break;
-        case 4:
-            printf("\n🔧 Dependency management!\n\n");
-            interactive_command_demo("apt depends firefox-esr", 
-                "Show what firefox-esr depends on",
-                "firefox-esr\n  Depends: libasound2\n  Depends: libatk-1.0-0\n  Depends: libc6\n  Depends: libcairo-gobject2\n  Depends: libcairo2\n  Depends: libdbus-1-3\n  Depends: libfontconfig1\n  Depends: libfreetype6\n  Depends: libgcc-s1\n  Depends: libgdk-pixbuf-2.0-0\n  Depends: libglib2.0-0\n  Depends: libgtk-3-0\n  Depends: libpango-1.0-0\n  Depends: libstdc++6\n  Depends: libx11-6\n  Depends: libxcomposite1\n  Depends: libxdamage1\n  Depends: libxext6\n  Depends: libxfixes3\n  Depends: libxrandr2\n  Depends: libxrender1\n  Depends: libxtst6");
-            interactive_command_demo("apt rdepends libc6 | head -10", 
-                "Show first 10 packages that depend on libc6",
-                "libc6\nReverse Depends:\n  zutils\n  zstd\n  zsh-common\n  zsh\n  zip\n  zile\n  zenity-common\n  zenity");
-            interactive_command_demo("sudo apt autoremove", 
-                "Remove packages that are no longer needed",
-                "Reading package lists... Done\nBuilding dependency tree... Done\nReading state information... Done\n0 upgraded, 0 newly installed, 0 to remove and 0 not upgraded.");
-            break;
-        case 5:
-            return;
+int step_applies(const lp_step_t* step) {
+    switch (step->when) {
+        case LP_WHEN_SIM:
+            return sys_config.simulate_mode;
+        case LP_WHEN_LIVE:
+            return !sys_config.simulate_mode;
+        case LP_WHEN_UBUNTU:
+            return sys_config.os_type == OS_UBUNTU;
+        case LP_WHEN_DEBIAN:
+            return sys_config.os_type != OS_UBUNTU;
+        default:
+            return 1;
     }
-    
-    press_enter_to_continue();
 }
 
-void show_user_management_lesson(void) {
-    printf(CLEAR_SCREEN);
-    printf(COLOR_YELLOW "👥 User & Permission Management\n");
-    printf("════════════════════════════════\n\n" COLOR_RESET);
-    
-    if (sys_config.simulate_mode) show_simulation_notice();
-    
-    printf("User management is a core sysadmin responsibility!\n");
-    printf("Let's explore users, groups, and permissions.\n\n");
-    
-    printf(COLOR_GREEN "Pick your area of interest:\n");
-    printf("1. Viewing users and groups\n");
-    printf("2. User account management\n");
-    printf("3. File permissions deep dive\n");
-    printf("4. sudo and privilege escalation\n");
-    printf("5. Back to main menu\n" COLOR_RESET);
-    
-    int choice = get_user_choice(5);
-    
-    switch (choice) {
-        case 1:
-            printf("\n👁️ Who's on this system?\n\n");
-            interactive_command_demo("whoami", 
-                "Current username",
-                "admin");
-            interactive_command_demo("id", 
-                "Your user ID and group memberships",
-                "uid=1000(admin) gid=1000(admin) groups=1000(admin),24(cdrom),25(floppy),27(sudo),29(audio),30(dip),44(video),46(plugdev),108(netdev),114(bluetooth),119(lpadmin),134(scanner)");
-            interactive_command_demo("getent passwd | tail -5", 
-                "Last 5 entries in the user database",
-                "systemd-coredump:x:999:999:systemd Core Dumper:/:/usr/sbin/nologin\nsystemd-network:x:998:998:systemd Network Management:/:/usr/sbin/nologin\nsystemd-resolve:x:997:997:systemd Resolver:/:/usr/sbin/nologin\nsystemd-timesync:x:996:996:systemd Time Synchronization:/:/usr/sbin/nologin\nadmin:x:1000:1000:System Administrator,,,:/home/admin:/bin/bash");
-            interactive_command_demo("getent group sudo", 
-                "See who's in the sudo group",
-                "sudo:x:27:admin");
-            break;
-        case 2:
-            printf("\n👤 User account commands!\n\n");
-            if (!sys_config.simulate_mode) {
-                printf(COLOR_RED "⚠️  These require root privileges and affect system security!\n" COLOR_RESET);
-            }
-            interactive_command_demo("sudo adduser newuser", 
-                "Interactive way to add a new user",
-                "Adding user `newuser' ...\nAdding new group `newuser' (1001) ...\nAdding new user `newuser' (1001) with group `newuser' ...\nCreating home directory `/home/newuser' ...\nCopying files from `/etc/skel' ...\nNew password: \nRetype new password: \npasswd: password updated successfully\nChanging the user information for newuser\nEnter the new value, or press ENTER for the default\n\tFull Name []: New User\n\tRoom Number []: \n\tWork Phone []: \n\tHome Phone []: \n\tOther []: \nIs the information correct? [Y/n] Y");
-            interactive_command_demo("sudo usermod -aG sudo newuser", 
-                "Add user to sudo group",
-                sys_config.simulate_mode ? "User 'newuser' added to group 'sudo'" : "");
-            interactive_command_demo("sudo passwd newuser", 
-                "Change a user's password",
-                "New password: \nRetype new password: \npasswd: password updated successfully");
-            break;
-        case 3:
-            printf("\n🔐 Permission mastery!\n\n");
-            interactive_command_demo("ls -la ~/.bashrc", 
-                "Check permissions on your shell config",
-                "-rw-r--r-- 1 admin admin 3526 Oct 10 09:15 /home/admin/.bashrc");
-            printf(COLOR_BLUE "\nPermission notation:\n");
-            printf("4 = read, 2 = write, 1 = execute\n");
-            printf("755 = rwxr-xr-x (owner: rwx, group: r-x, other: r-x)\n");
-            printf("644 = rw-r--r-- (owner: rw-, group: r--, other: r--)\n" COLOR_RESET);
-            interactive_command_demo("umask", 
-                "Default permission mask for new files",
-                "0022");
-            printf(COLOR_GREEN "\n💡 umask 0022 means new files get 644 permissions,\n");
-            printf("new directories get 755 permissions.\n" COLOR_RESET);
-            break;
-        case 4:
-            printf("\n🔑 Understanding sudo!\n\n");
-            interactive_command_demo("sudo -l", 
-                "What can you run with sudo?",
-                "Matching Defaults entries for admin on debian-server:\n    env_reset, mail_badpass, secure_path=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin, use_pty\n\nUser admin may run the following commands on debian-server:\n    (ALL : ALL) ALL");
-            interactive_command_demo("ls -la /etc/sudoers", 
-                "Check sudoers file permissions",
-                "-r--r----- 1 root root 1042 Oct 10 09:20 /etc/sudoers");
-            printf(COLOR_GREEN "\n💡 Sudo tips:\n");
-            printf("- Use 'sudo -i' for a root shell (be careful!)\n");
-            printf("- Use 'sudo visudo' to edit sudoers file safely\n");
-            printf("- Prefer individual sudo commands for better security!\n" COLOR_RESET);
-            break;
-        case 5:
-            return;
+void interactive_command_demo(const char* command, const char* description) {
+    con_printf(COLOR_BLUE "\n📋 Command: " COLOR_YELLOW "%s\n" COLOR_RESET, command);
+    con_printf(COLOR_GREEN "What it does: %s\n" COLOR_RESET, description);
+    
+    con_printf("\nWould you like to:\n");
+    con_printf("1. Run this command now\n");
+    con_printf("2. Just see the explanation\n");
+    con_printf("3. Skip to next\n");
+
+    // Read-only commands get a head start while the learner decides
+    if (!sys_config.simulate_mode && prefetch_enabled && !sysinfo_covers(command)) {
+        char* adapted_command = adapt_command_for_system(command);
+        launch_opts_t limits;
+
+        memset(&limits, 0, sizeof(limits));
+        limits.timeout_ms = command_timeout * 1000;
+        limits.max_output = command_max_output;
+        prefetch_start(adapted_command, &limits);
+        if (adapted_command != command) {
+            free(adapted_command);
+        }
     }
-    
-    press_enter_to_continue();
 }
 
-void interactive_command_demo(const char* command, const char* description, const char* simulated_output) {
-    printf(COLOR_BLUE "\n📋 Command: " COLOR_YELLOW "%s\n" COLOR_RESET, command);
-    printf(COLOR_GREEN "What it does: %s\n" COLOR_RESET, description);
-    
-    printf("\nWould you like to:\n");
-    printf("1. Run this command now\n");
-    printf("2. Just see the explanation\n");
-    printf("3. Skip to next\n");
-    
-    int choice = get_user_choice(3);
-    
+void command_demo_choice(int choice, const char* command, const char* description, const char* simulated_output) {
+    static const journal_kind_t kinds[] = { JOURNAL_RUN, JOURNAL_RUN, JOURNAL_EXPLAIN, JOURNAL_SKIP };
+
+    if (choice != 1) prefetch_cancel();
+    journal_append(progress_journal, kinds[choice >= 1 && choice <= 3 ? choice : 0], command,
+                   sys_config.simulate_mode, choice);
     if (choice == 1) {
         execute_or_simulate_command(command, simulated_output);
     } else if (choice == 2) {
-        printf(COLOR_BLUE "\n📖 More details:\n%s\n" COLOR_RESET, description);
+        con_printf(COLOR_BLUE "\n📖 More details:\n%s\n" COLOR_RESET, description);
     }
     
-    printf("\n");
+    con_printf("\n");
+}
+
+// The pack's exercises, loaded by the first session that reaches one
+static void load_exercises(void) {
+    exercises = grade_load(&lessons);
+}
+
+int exercise_answer(uint32_t step_index, const char* line) {
+    const lp_step_t* step = lp_step(&lessons, step_index);
+    const char* task = lp_str(&lessons, step->text);
+    const char* hint = lp_str(&lessons, step->description);
+    char answer[MAX_INPUT * 2];
+    grade_verdict_t verdict;
+    int exercise;
+
+    pthread_once(&exercises_once, load_exercises);
+    exercise = grade_exercise_of(exercises, step_index);
+    if (exercise < 0 || !grade_answer(exercises, (uint32_t)exercise, 0, answer, sizeof(answer))) return 1;
+
+    if (!line || !*line) {
+        journal_append(progress_journal, JOURNAL_EXPLAIN, task, sys_config.simulate_mode, 0);
+        con_printf(COLOR_GREEN "\n💡 One way to do it: " COLOR_YELLOW "%s\n\n" COLOR_RESET, answer);
+        return 1;
+    }
+
+    verdict = grade_check(exercises, (uint32_t)exercise, line);
+    if (verdict == GRADE_UNREADABLE) {
+        con_printf(COLOR_RED "⚠️  That cannot be read as a command; check its quotes.\n" COLOR_RESET);
+        con_printf("Try again, or press Enter to see an answer:\n");
+        return 0;
+    }
+    journal_append(progress_journal, JOURNAL_OUTCOME, task, sys_config.simulate_mode, verdict == GRADE_WRONG);
+    if (verdict == GRADE_WRONG) {
+        con_printf(COLOR_RED "❌ Not quite.\n" COLOR_RESET);
+        if (*hint) con_printf(COLOR_CYAN "💡 Hint: %s\n" COLOR_RESET, hint);
+        con_printf("Try again, or press Enter to see an answer:\n");
+        return 0;
+    }
+
+    if (verdict == GRADE_SAME_OUTPUT) {
+        con_printf(COLOR_GREEN "✅ Right: not the usual way, but it prints the same. The usual way is: %s\n" COLOR_RESET,
+                   answer);
+    } else {
+        con_printf(COLOR_GREEN "✅ Right!\n" COLOR_RESET);
+    }
+    // What the learner typed runs on the simulated machine; a live run
+    // uses the lesson's own answer
+    execute_or_simulate_command(sys_config.simulate_mode ? line : answer, "");
+    con_printf("\n");
+    return 1;
 }
 
 void execute_or_simulate_command(const char* command, const char* simulated_output) {
-    printf(COLOR_YELLOW "\n🚀 %s: %s\n", 
+    con_printf(COLOR_YELLOW "\n🚀 %s: %s\n", 
            sys_config.simulate_mode ? "Simulating" : "Running", command);
-    printf("───────────────────────────────────────\n" COLOR_RESET);
+    con_printf("───────────────────────────────────────\n" COLOR_RESET);
     
     if (sys_config.simulate_mode) {
-        if (strlen(simulated_output) > 0) {
-            printf("%s\n", simulated_output);
+        // Commands with a simulator run against the session's own
+        // simulated machine; the rest show the lesson's example output
+        instr_span_t span = instr_begin();
+        int status = sim_execute(command);
+
+        instr_end(INSTR_SIMULATION, instr_topic, span);
+
+        if (status < 0) {
+            if (strlen(simulated_output) > 0) {
+                con_printf("%s\n", simulated_output);
+            } else {
+                con_printf(COLOR_CYAN "[Simulated - command would execute safely]\n" COLOR_RESET);
+            }
+        }
+        con_printf("───────────────────────────────────────\n");
+        journal_append(progress_journal, JOURNAL_OUTCOME, command, 1, status > 0 ? status : 0);
+        if (status <= 0) {
+            con_printf(COLOR_GREEN "✅ Simulation completed successfully!\n" COLOR_RESET);
         } else {
-            printf(COLOR_CYAN "[Simulated - command would execute safely]\n" COLOR_RESET);
+            con_printf(COLOR_RED "⚠️  Command had issues (exit code: %d)\n" COLOR_RESET, status);
         }
-        printf("───────────────────────────────────────\n");
-        printf(COLOR_GREEN "✅ Simulation completed successfully!\n" COLOR_RESET);
     } else {
         // Adapt command for current system if needed
         char* adapted_command = adapt_command_for_system(command);
+        launch_opts_t opts;
+        launch_result_t result;
+        const char* source;
+        double saved = 0;
+        instr_span_t span;
+        int rc;
+
+        if (adapted_command != command) {
+            con_printf(COLOR_CYAN "🔁 Adapted for this system: %s\n" COLOR_RESET, adapted_command);
+        }
+
+        // System-info commands are answered from /proc and /sys directly
+        if (!host_info_ready) {
+            sysinfo_init(&host_info);
+            if (host_profile_ready) hostprof_fill_sysinfo(&host_profile, &host_info);
+            host_info_ready = 1;
+        }
+        span = instr_begin();
+        rc = sysinfo_command(&host_info, adapted_command, &source);
+        if (rc >= 0) {
+            instr_end(INSTR_COMMAND, instr_topic, span);
+            journal_append(progress_journal, JOURNAL_OUTCOME, command, 0, rc);
+            con_printf("───────────────────────────────────────\n");
+            con_printf(COLOR_CYAN "📊 Read directly from %s; no process was started\n" COLOR_RESET, source);
+            if (rc == 0) {
+                con_printf(COLOR_GREEN "✅ Command completed successfully!\n" COLOR_RESET);
+            } else {
+                con_printf(COLOR_RED "⚠️  Command had issues (exit code: %d)\n" COLOR_RESET, rc);
+            }
+            if (adapted_command != command) {
+                free(adapted_command);
+            }
+            return;
+        }
+
+        // Run it, passing its output on as it arrives
+        memset(&opts, 0, sizeof(opts));
+        opts.timeout_ms = command_timeout * 1000;
+        opts.max_output = command_max_output;
+        opts.foreground = 1;
+        opts.on_output = stream_output;
+        con_release_screen();
+        if (prefetch_take(adapted_command, &opts, &result, &saved) == 0) {
+            rc = 0;
+        } else {
+            rc = launch_command(adapted_command, &opts, &result);
+        }
+        instr_end(INSTR_COMMAND, instr_topic, span);
         
-        // Execute the command
-        int result = system(adapted_command);
-        
-        printf("───────────────────────────────────────\n");
-        if (result == 0) {
-            printf(COLOR_GREEN "✅ Command completed successfully!\n" COLOR_RESET);
+        con_printf("───────────────────────────────────────\n");
+        if (saved >= 0.05) {
+            con_printf(COLOR_CYAN "⚡ Started while you were reading: %.1f s sooner\n" COLOR_RESET, saved);
+        }
+        journal_append(progress_journal, JOURNAL_OUTCOME, command, 0, outcome_status(rc, &result));
+        if (rc < 0) {
+            con_printf(COLOR_RED "⚠️  Could not run the command: %s\n" COLOR_RESET, strerror(-rc));
+        } else if (result.end == LAUNCH_TIMED_OUT) {
+            con_printf(COLOR_RED "⏱️  Stopped after %d seconds (see --timeout)\n" COLOR_RESET, command_timeout);
+        } else if (result.end == LAUNCH_OUTPUT_LIMIT) {
+            con_printf(COLOR_RED "✂️  Stopped after %zu bytes of output (see --max-output)\n" COLOR_RESET,
+                       result.output_bytes);
+        } else if (result.end == LAUNCH_CANCELLED) {
+            con_printf(COLOR_YELLOW "⏹️  Command cancelled\n" COLOR_RESET);
+        } else if (result.status == 0) {
+            con_printf(COLOR_GREEN "✅ Command completed successfully!\n" COLOR_RESET);
         } else {
-            printf(COLOR_RED "⚠️  Command had issues (exit code: %d)\n" COLOR_RESET, result);
-            printf("This might be normal depending on your system setup.\n");
+            con_printf(COLOR_RED "⚠️  Command had issues (exit code: %d)\n" COLOR_RESET, result.status);
+            con_printf("This might be normal depending on your system setup.\n");
         }
         
         if (adapted_command != command) {
@@ -638,47 +883,62 @@ void execute_or_simulate_command(const char* command, const char* simulated_outp
     }
 }
 
-char* adapt_command_for_system(const char* original_command) {
-    // For now, most commands work the same on Ubuntu and Debian
-    // This function can be extended to handle system-specific adaptations
-    
-    if (sys_config.os_type == OS_UBUNTU) {
-        // Ubuntu-specific adaptations could go here
-        // For example, different package names, paths, etc.
-        
-        // Most APT commands work identically
-        // File system commands are the same
-        // systemctl commands are the same
+// Exit status for the journal, as a shell would report it: 126 could not
+// run, 124 timed out (like timeout(1)), 125 output limit, 130 Ctrl-C
+static int outcome_status(int rc, const launch_result_t* result) {
+    if (rc < 0) return 126;
+    switch (result->end) {
+        case LAUNCH_TIMED_OUT:
+            return 124;
+        case LAUNCH_OUTPUT_LIMIT:
+            return 125;
+        case LAUNCH_CANCELLED:
+            return 130;
+        default:
+            return result->status;
     }
-    
-    // Return the original command (no adaptation needed for most cases)
-    return (char*)original_command;
 }
 
-void show_simulation_notice(void) {
-    printf(COLOR_CYAN "🎭 SIMULATION MODE: Commands will show example outputs without affecting your system\n\n" COLOR_RESET);
+// One line on stderr when the session prefetched anything
+static void report_prefetch(void) {
+    prefetch_stats_t stats;
+
+    prefetch_get_stats(&stats);
+    if (!stats.started) return;
+    fprintf(stderr, "prefetch: %lu started, %lu used (%.0f%%), %lu cancelled, %.1f s saved\n",
+            stats.started, stats.hits, 100.0 * stats.hits / stats.started, stats.cancelled, stats.saved);
+}
+
+static int stream_output(void* ctx, const char* data, size_t len) {
+    (void)ctx;
+    con_write(data, len);
+    con_flush();
+    return 0;
+}
+
+char* adapt_command_for_system(const char* original_command) {
+    // The original itself when no rule applies
+    return adapt_rewrite(&adapt_rules, sys_config.adapt_ruleset, original_command);
 }
 
-void clear_input_buffer(void) {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
+void show_simulation_notice(void) {
+    con_printf(COLOR_CYAN "🎭 SIMULATION MODE: Commands will show example outputs without affecting your system\n\n" COLOR_RESET);
 }
 
-int get_user_choice(int max_options) {
+// Returns the option number, or 0 if the input is not a valid option
+int parse_user_choice(const char* input, int max_options) {
     int choice;
-    char input[MAX_INPUT];
     
-    while (1) {
-        if (fgets(input, sizeof(input), stdin) != NULL) {
-            if (sscanf(input, "%d", &choice) == 1 && choice >= 1 && choice <= max_options) {
-                return choice;
-            }
-        }
-        printf(COLOR_RED "Please enter a number between 1 and %d: " COLOR_RESET, max_options);
+    if (sscanf(input, "%d", &choice) == 1 && choice >= 1 && choice <= max_options) {
+        return choice;
     }
+    return 0;
+}
+
+void show_choice_error(int max_options) {
+    con_printf(COLOR_RED "Please enter a number between 1 and %d: " COLOR_RESET, max_options);
 }
 
 void press_enter_to_continue(void) {
-    printf(COLOR_BLUE "\nPress Enter to continue..." COLOR_RESET);
-    getchar();
+    con_printf(COLOR_BLUE "\nPress Enter to continue..." COLOR_RESET);
 }
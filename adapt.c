@@ -0,0 +1,1121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "adapt.h"
+#include "bench.h"
+#include "util.h"
+
+// Tokens of one command looked at; later ones are copied as they are
+#define MAX_TOKENS 64
+#define MAX_CAPTURES 9
+
+// Word class bit 0: paths, which any command can take
+#define CLASS_PATH 1u
+#define MAX_CLASSES 32
+#define MAX_CONDS 32
+
+// ---------------------------------------------------------------------
+// Loading and access
+// ---------------------------------------------------------------------
+
+static int table_fits(size_t size, uint32_t off, uint32_t count, size_t elem) {
+    return off % 4 == 0 && off <= size && (size - off) / elem >= count;
+}
+
+static int is_power_of_two(uint32_t n) {
+    return n && (n & (n - 1)) == 0;
+}
+
+static int string_fits(const adapt_header_t* h, uint32_t off, uint32_t len) {
+    return off < h->strings_size && len < h->strings_size - off;
+}
+
+// Unlike a lesson pack's, every entry is checked here, once, so that
+// rewriting (on every command) needs no range checks
+static int check_entries(const adapt_rules_t* r) {
+    const adapt_header_t* h = r->header;
+    uint32_t i, empty;
+
+    if (h->n_rulesets == 0 || h->n_conds == 0 || h->n_conds > MAX_CONDS) return -1;
+    for (i = 0; i < h->n_rulesets; i++) {
+        const adapt_ruleset_t* rs = &r->rulesets[i];
+        // Parents come first, so following them always ends at ruleset 0
+        if (rs->name >= h->strings_size || rs->root >= h->n_nodes) return -1;
+        if (i ? rs->parent >= i : rs->parent != ADAPT_NO_RULES) return -1;
+    }
+    for (i = 0; i < h->n_nodes; i++) {
+        if (r->nodes[i].rule != ADAPT_NONE && r->nodes[i].rule >= h->n_rules) return -1;
+        if (r->nodes[i].wild != ADAPT_NONE && r->nodes[i].wild >= h->n_nodes) return -1;
+    }
+    for (i = 0; i < h->n_rules; i++) {
+        if (r->rules[i].replacement >= h->strings_size || r->rules[i].cond >= h->n_conds) return -1;
+    }
+    for (i = 0; i < h->n_conds; i++) {
+        if (r->conds[i] >= h->strings_size) return -1;
+    }
+    for (i = 0, empty = 0; i < h->edge_slots; i++) {
+        const adapt_edge_t* e = &r->edges[i];
+        if (!e->token) {
+            empty++;
+        } else if (!string_fits(h, e->token, e->len) || e->parent >= h->n_nodes || e->child >= h->n_nodes) {
+            return -1;
+        }
+    }
+    if (!empty) return -1;
+    for (i = 0, empty = 0; i < h->word_slots; i++) {
+        const adapt_word_t* w = &r->words[i];
+        if (!w->token) {
+            empty++;
+        } else if (!string_fits(h, w->token, w->len) || w->cond >= h->n_conds ||
+                   (w->owner != ADAPT_NONE && (w->owner >= h->n_rulesets || w->value >= h->strings_size))) {
+            return -1;
+        }
+    }
+    return empty ? 0 : -1;
+}
+
+static int attach(adapt_rules_t* r, const uint8_t* base, size_t size, char* err, size_t err_len) {
+    const adapt_header_t* h = (const adapt_header_t*)base;
+
+    if (size < sizeof(adapt_header_t) || memcmp(h->magic, ADAPT_MAGIC, sizeof(ADAPT_MAGIC)) != 0) {
+        return set_error(err, err_len, "not a compiled rules file");
+    }
+    if (h->byte_order != ADAPT_BYTE_ORDER) {
+        return set_error(err, err_len, "rules compiled for a different byte order");
+    }
+    if (h->version != ADAPT_VERSION) {
+        return set_error(err, err_len, "unsupported rules version %u", h->version);
+    }
+    if (h->total_size != size ||
+        !table_fits(size, h->rulesets_off, h->n_rulesets, sizeof(adapt_ruleset_t)) ||
+        !table_fits(size, h->nodes_off, h->n_nodes, sizeof(adapt_node_t)) ||
+        !table_fits(size, h->rules_off, h->n_rules, sizeof(adapt_rule_t)) ||
+        !table_fits(size, h->conds_off, h->n_conds, sizeof(uint32_t)) ||
+        !is_power_of_two(h->edge_slots) || !table_fits(size, h->edges_off, h->edge_slots, sizeof(adapt_edge_t)) ||
+        !is_power_of_two(h->word_slots) || !table_fits(size, h->words_off, h->word_slots, sizeof(adapt_word_t)) ||
+        h->strings_size == 0 || !table_fits(size, h->strings_off, h->strings_size, 1) ||
+        base[h->strings_off + h->strings_size - 1] != '\0') {
+        return set_error(err, err_len, "rules file is truncated or corrupt");
+    }
+
+    r->base = base;
+    r->size = size;
+    r->header = h;
+    r->rulesets = (const adapt_ruleset_t*)(base + h->rulesets_off);
+    r->nodes = (const adapt_node_t*)(base + h->nodes_off);
+    r->rules = (const adapt_rule_t*)(base + h->rules_off);
+    r->conds = (const uint32_t*)(base + h->conds_off);
+    r->edges = (const adapt_edge_t*)(base + h->edges_off);
+    r->words = (const adapt_word_t*)(base + h->words_off);
+    r->strings = (const char*)(base + h->strings_off);
+    r->active = 1;
+    if (check_entries(r) < 0) {
+        memset(r, 0, sizeof(*r));
+        return set_error(err, err_len, "rules file is truncated or corrupt");
+    }
+    return 0;
+}
+
+int adapt_open(adapt_rules_t* r, const char* path, char* err, size_t err_len) {
+    struct stat st;
+    void* base;
+    int fd;
+
+    memset(r, 0, sizeof(*r));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return set_error(err, err_len, "%s: cannot open", path);
+    }
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return set_error(err, err_len, "%s: empty or unreadable", path);
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return set_error(err, err_len, "%s: mmap failed", path);
+    }
+
+    if (attach(r, base, (size_t)st.st_size, err, err_len) < 0) {
+        munmap(base, (size_t)st.st_size);
+        return -1;
+    }
+    r->mapped = 1;
+    return 0;
+}
+
+void adapt_close(adapt_rules_t* r) {
+    if (r->base) {
+        if (r->mapped) {
+            munmap((void*)r->base, r->size);
+        } else {
+            free((void*)r->base);
+        }
+    }
+    memset(r, 0, sizeof(*r));
+}
+
+static int program_installed(const char* name) {
+    const char* path = getenv("PATH");
+    char candidate[4096];
+
+    if (strchr(name, '/')) return access(name, X_OK) == 0;
+    if (!path || !*path) path = "/usr/local/bin:/usr/bin:/bin";
+    while (*path) {
+        const char* colon = strchr(path, ':');
+        size_t len = colon ? (size_t)(colon - path) : strlen(path);
+
+        if (len && len + strlen(name) + 2 <= sizeof(candidate)) {
+            snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)len, path, name);
+            if (access(candidate, X_OK) == 0) return 1;
+        }
+        path += len;
+        if (*path) path++;
+    }
+    return 0;
+}
+
+void adapt_check_programs(adapt_rules_t* r, int (*installed)(const char* program)) {
+    uint32_t i;
+
+    if (!r->base) return;
+    r->active = 1;
+    for (i = 1; i < r->header->n_conds; i++) {
+        const char* name = r->strings + r->conds[i];
+        int have = installed ? installed(name) : -1;
+
+        if (have < 0) have = program_installed(name);
+        if (!have) r->active |= 1u << i;
+    }
+}
+
+static uint32_t find_ruleset(const adapt_rules_t* r, const char* name, size_t len) {
+    uint32_t i;
+
+    for (i = 1; i < r->header->n_rulesets; i++) {
+        const char* have = r->strings + r->rulesets[i].name;
+        if (strncmp(have, name, len) == 0 && have[len] == '\0') return i;
+    }
+    return ADAPT_NO_RULES;
+}
+
+uint32_t adapt_select(const adapt_rules_t* r, const char* id, const char* id_like, const char* fallback) {
+    uint32_t rs = ADAPT_NO_RULES;
+
+    if (!r->base) return ADAPT_NO_RULES;
+    if (id && *id) rs = find_ruleset(r, id, strlen(id));
+    while (rs == ADAPT_NO_RULES && id_like && *id_like) {
+        size_t len;
+
+        id_like += strspn(id_like, " \t");
+        len = strcspn(id_like, " \t");
+        if (len) rs = find_ruleset(r, id_like, len);
+        id_like += len;
+    }
+    if (rs == ADAPT_NO_RULES && fallback) rs = find_ruleset(r, fallback, strlen(fallback));
+    return rs;
+}
+
+const char* adapt_ruleset_name(const adapt_rules_t* r, uint32_t ruleset) {
+    if (!r->base || ruleset >= r->header->n_rulesets) return "";
+    return r->strings + r->rulesets[ruleset].name;
+}
+
+// ---------------------------------------------------------------------
+// Rewriting
+// ---------------------------------------------------------------------
+
+static uint32_t hash_bytes(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Where a (token, owner) key starts probing; the owner (trie node or
+// ruleset) is mixed in so the same token under different owners spreads
+static uint32_t slot_of(uint32_t hash, uint32_t owner, uint32_t mask) {
+    uint32_t h = hash ^ (owner * 0x9e3779b9u);
+
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h & mask;
+}
+
+typedef struct {
+    const char* s;
+    uint32_t len;
+    uint32_t hash;
+} token_t;
+
+typedef struct {
+    char* buf;              // NULL while measuring
+    size_t len;
+    int changed;
+} out_t;
+
+static void put(out_t* o, const char* s, size_t len) {
+    if (o->buf) memcpy(o->buf + o->len, s, len);
+    o->len += len;
+}
+
+static int cond_holds(const adapt_rules_t* r, uint32_t cond) {
+    return (r->active >> cond) & 1;
+}
+
+static uint32_t find_edge(const adapt_rules_t* r, uint32_t parent, const token_t* t) {
+    uint32_t mask = r->header->edge_slots - 1;
+    uint32_t i;
+
+    for (i = slot_of(t->hash, parent, mask); r->edges[i].token; i = (i + 1) & mask) {
+        const adapt_edge_t* e = &r->edges[i];
+        if (e->hash == t->hash && e->parent == parent && e->len == t->len &&
+            memcmp(r->strings + e->token, t->s, t->len) == 0) {
+            return e->child;
+        }
+    }
+    return ADAPT_NONE;
+}
+
+// owner ADAPT_NONE looks up the classes a command takes
+static const adapt_word_t* find_word(const adapt_rules_t* r, uint32_t owner, uint32_t classes, const token_t* t) {
+    uint32_t mask = r->header->word_slots - 1;
+    uint32_t i;
+
+    for (i = slot_of(t->hash, owner, mask); r->words[i].token; i = (i + 1) & mask) {
+        const adapt_word_t* w = &r->words[i];
+        if (w->hash == t->hash && w->owner == owner && w->len == t->len &&
+            (owner == ADAPT_NONE || ((w->classes & classes) && cond_holds(r, w->cond))) &&
+            memcmp(r->strings + w->token, t->s, t->len) == 0) {
+            return w;
+        }
+    }
+    return NULL;
+}
+
+// An argument, through the word rules of the ruleset and its parents
+static void put_word(const adapt_rules_t* r, uint32_t ruleset, uint32_t classes, const token_t* t, out_t* o) {
+    uint32_t rs;
+
+    for (rs = ruleset; rs != ADAPT_NO_RULES; rs = r->rulesets[rs].parent) {
+        const adapt_word_t* w = find_word(r, rs, classes, t);
+        if (w) {
+            const char* to = r->strings + w->value;
+            size_t len = strlen(to);
+
+            // A derivative can map a word back to itself to undo its parent's rule
+            if (len != t->len || memcmp(to, t->s, len) != 0) o->changed = 1;
+            put(o, to, len);
+            return;
+        }
+    }
+    put(o, t->s, t->len);
+}
+
+// Longest cmd pattern that matches the start of the command; a literal
+// token is followed in preference to "*"
+static uint32_t match_cmd(const adapt_rules_t* r, uint32_t ruleset, const token_t* t, int n,
+                          int* captures, int* n_captures, int* used) {
+    uint32_t node = r->rulesets[ruleset].root;
+    uint32_t best = ADAPT_NONE;
+    int i, k = 0;
+
+    for (i = 0; i < n; i++) {
+        uint32_t child = find_edge(r, node, &t[i]);
+        uint32_t rule;
+
+        if (child == ADAPT_NONE) {
+            child = r->nodes[node].wild;
+            if (child == ADAPT_NONE || k == MAX_CAPTURES) break;
+            captures[k++] = i;
+        }
+        node = child;
+        rule = r->nodes[node].rule;
+        if (rule != ADAPT_NONE && cond_holds(r, r->rules[rule].cond)) {
+            best = rule;
+            *used = i + 1;
+            *n_captures = k;
+        }
+    }
+    return best;
+}
+
+static int token_is(const token_t* t, const char* word) {
+    return t->len == strlen(word) && memcmp(t->s, word, t->len) == 0;
+}
+
+// One command of the line; *pos is how far the line has been copied
+static void rewrite_command(const adapt_rules_t* r, uint32_t ruleset, const token_t* t, int n,
+                            const char** pos, out_t* o) {
+    const adapt_word_t* takes;
+    uint32_t classes = CLASS_PATH;
+    uint32_t rule = ADAPT_NONE;
+    uint32_t rs;
+    int captures[MAX_CAPTURES];
+    int n_captures = 0, used = 0;
+    int first = 0, i;
+
+    if (n > 1 && token_is(&t[0], "sudo") && t[1].s[0] != '-') first = 1;
+    if (first >= n) return;
+    takes = find_word(r, ADAPT_NONE, 0, &t[first]);
+    if (takes) classes |= takes->value;
+
+    for (rs = ruleset; rs != ADAPT_NO_RULES && rule == ADAPT_NONE; rs = r->rulesets[rs].parent) {
+        rule = match_cmd(r, rs, t + first, n - first, captures, &n_captures, &used);
+    }
+
+    if (rule != ADAPT_NONE) {
+        const char* p = r->strings + r->rules[rule].replacement;
+        const token_t* last = &t[first + used - 1];
+
+        put(o, *pos, (size_t)(t[first].s - *pos));
+        for (; *p; p++) {
+            int k = p[0] == '$' && p[1] >= '1' && p[1] <= '9' ? p[1] - '1' : -1;
+
+            if (k >= 0 && k < n_captures) {
+                put_word(r, ruleset, classes, &t[first + captures[k]], o);
+                p++;
+            } else {
+                put(o, p, 1);
+            }
+        }
+        *pos = last->s + last->len;
+        o->changed = 1;
+        first += used;
+    } else {
+        first++;
+    }
+
+    for (i = first; i < n; i++) {
+        put(o, *pos, (size_t)(t[i].s - *pos));
+        put_word(r, ruleset, classes, &t[i], o);
+        *pos = t[i].s + t[i].len;
+    }
+}
+
+static int ends_command(const char* p) {
+    return *p && strchr("|&;()\n", *p) != NULL;
+}
+
+// Tokens up to the end of one command: words split at blanks outside
+// quotes, commands at | & ; ( ) and newlines (but not the & of 2>&1)
+static const char* scan_command(const char* p, token_t* t, int* n) {
+    *n = 0;
+    for (;;) {
+        const char* start;
+
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p || ends_command(p)) return p;
+        start = p;
+        while (*p && *p != ' ' && *p != '\t' && (!ends_command(p) || (*p == '&' && p > start && (p[-1] == '>' || p[-1] == '<')))) {
+            if (*p == '\\' && p[1]) {
+                p += 2;
+            } else if (*p == '\'' || *p == '"') {
+                const char* close = p + 1;
+                while (*close && *close != *p) {
+                    if (*p == '"' && *close == '\\' && close[1]) close++;
+                    close++;
+                }
+                p = *close ? close + 1 : close;
+            } else {
+                p++;
+            }
+        }
+        if (*n < MAX_TOKENS) {
+            t[*n].s = start;
+            t[*n].len = (uint32_t)(p - start);
+            t[*n].hash = hash_bytes(start, t[*n].len);
+            (*n)++;
+        }
+    }
+}
+
+static void rewrite_line(const adapt_rules_t* r, uint32_t ruleset, const char* command, out_t* o) {
+    token_t t[MAX_TOKENS];
+    const char* pos = command;
+    const char* p = command;
+    int n;
+
+    while (*p) {
+        p = scan_command(p, t, &n);
+        if (n) rewrite_command(r, ruleset, t, n, &pos, o);
+        while (*p && ends_command(p)) p++;
+    }
+    put(o, pos, strlen(pos));
+}
+
+char* adapt_rewrite(const adapt_rules_t* r, uint32_t ruleset, const char* command) {
+    out_t o;
+
+    if (!r->base || ruleset == ADAPT_NO_RULES || ruleset >= r->header->n_rulesets) {
+        return (char*)command;
+    }
+
+    // Measure first: only a command that changes costs an allocation
+    memset(&o, 0, sizeof(o));
+    rewrite_line(r, ruleset, command, &o);
+    if (!o.changed) return (char*)command;
+    o.buf = malloc(o.len + 1);
+    if (!o.buf) return (char*)command;
+    o.len = 0;
+    rewrite_line(r, ruleset, command, &o);
+    o.buf[o.len] = '\0';
+    return o.buf;
+}
+
+// ---------------------------------------------------------------------
+// Compiler
+// ---------------------------------------------------------------------
+//
+// Source format: one directive per line, "#" starts a comment.
+//
+//   takes <class> <command>...         arguments of these commands can be
+//                                      <class> words (package, service...)
+//   for <ID> [: <parent ID>]           rules for an os-release ID; the
+//                                      parent's apply where these do not
+//   when always | when missing <program>
+//                                      condition for the rules that follow
+//                                      (until the next when or for)
+//   cmd <token>... => <replacement>    a command starting with the tokens;
+//                                      * matches any one token and $1..$9
+//                                      in the replacement are what they
+//                                      matched. The rest of the command
+//                                      follows the replacement.
+//   path <from> <to>                   any argument of any command
+//   <class> <from> <to>                an argument of a command that takes
+//                                      <class>
+
+typedef struct {
+    char* data;
+    size_t len, cap;
+} grow_t;
+
+typedef struct {
+    grow_t rulesets, nodes, rules, conds, strings;
+    adapt_edge_t* edges;
+    uint32_t edge_slots, n_edges;
+    adapt_word_t* words;
+    uint32_t word_slots, n_words;
+    char classes[MAX_CLASSES][32];      // 0 is "path"
+    int n_classes;
+
+    uint32_t ruleset;       // the for section, ADAPT_NO_RULES before the first
+    uint32_t cond;
+
+    const char* path;
+    int line;
+    char* err;
+    size_t err_len;
+} builder_t;
+
+static void grow_reserve(grow_t* g, size_t extra) {
+    if (g->len + extra <= g->cap) return;
+    while (g->len + extra > g->cap) g->cap = g->cap ? g->cap * 2 : 256;
+    g->data = realloc(g->data, g->cap);
+    if (!g->data) {
+        perror("realloc");
+        exit(1);
+    }
+}
+
+static void grow_append(grow_t* g, const void* data, size_t len) {
+    grow_reserve(g, len);
+    memcpy(g->data + g->len, data, len);
+    g->len += len;
+}
+
+static int build_error(builder_t* b, const char* fmt, const char* arg) {
+    char message[256];
+
+    snprintf(message, sizeof(message), fmt, arg);
+    return set_error(b->err, b->err_len, "%s:%d: %s", b->path, b->line, message);
+}
+
+static uint32_t add_string(builder_t* b, const char* s, size_t len) {
+    uint32_t off = (uint32_t)b->strings.len;
+
+    grow_append(&b->strings, s, len);
+    grow_append(&b->strings, "", 1);
+    return off;
+}
+
+static const char* string_at(const builder_t* b, uint32_t off) {
+    return b->strings.data + off;
+}
+
+#define N_OF(g, type) ((uint32_t)((g).len / sizeof(type)))
+#define AT(g, type, i) (&((type*)(g).data)[i])
+
+static uint32_t add_node(builder_t* b) {
+    adapt_node_t node = { ADAPT_NONE, ADAPT_NONE };
+
+    grow_append(&b->nodes, &node, sizeof(node));
+    return N_OF(b->nodes, adapt_node_t) - 1;
+}
+
+// Both tables are kept at most half full, so probes stay short and there
+// is always an empty slot to stop at
+static void grow_edges(builder_t* b) {
+    adapt_edge_t* old = b->edges;
+    uint32_t old_slots = b->edge_slots;
+    uint32_t i;
+
+    b->edge_slots = old_slots ? old_slots * 2 : 64;
+    b->edges = xcalloc(b->edge_slots, sizeof(adapt_edge_t));
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].token) {
+            uint32_t j = slot_of(old[i].hash, old[i].parent, b->edge_slots - 1);
+            while (b->edges[j].token) j = (j + 1) & (b->edge_slots - 1);
+            b->edges[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+static uint32_t edge_child(builder_t* b, uint32_t parent, const char* token) {
+    uint32_t len = (uint32_t)strlen(token);
+    uint32_t hash = hash_bytes(token, len);
+    adapt_edge_t* e;
+    uint32_t i, mask;
+
+    if ((b->n_edges + 1) * 2 > b->edge_slots) grow_edges(b);
+    mask = b->edge_slots - 1;
+    for (i = slot_of(hash, parent, mask); b->edges[i].token; i = (i + 1) & mask) {
+        e = &b->edges[i];
+        if (e->hash == hash && e->parent == parent && e->len == len &&
+            memcmp(string_at(b, e->token), token, len) == 0) {
+            return e->child;
+        }
+    }
+    e = &b->edges[i];
+    e->hash = hash;
+    e->parent = parent;
+    e->token = add_string(b, token, len);
+    e->len = len;
+    e->child = add_node(b);
+    b->n_edges++;
+    return e->child;
+}
+
+static void grow_words(builder_t* b) {
+    adapt_word_t* old = b->words;
+    uint32_t old_slots = b->word_slots;
+    uint32_t i;
+
+    b->word_slots = old_slots ? old_slots * 2 : 64;
+    b->words = xcalloc(b->word_slots, sizeof(adapt_word_t));
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].token) {
+            uint32_t j = slot_of(old[i].hash, old[i].owner, b->word_slots - 1);
+            while (b->words[j].token) j = (j + 1) & (b->word_slots - 1);
+            b->words[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+// The entry for (owner, token, classes, cond), added empty if new
+static adapt_word_t* word_entry(builder_t* b, uint32_t owner, const char* token, uint32_t classes,
+                                uint32_t cond, int* added) {
+    uint32_t len = (uint32_t)strlen(token);
+    uint32_t hash = hash_bytes(token, len);
+    adapt_word_t* w;
+    uint32_t i, mask;
+
+    if ((b->n_words + 1) * 2 > b->word_slots) grow_words(b);
+    mask = b->word_slots - 1;
+    for (i = slot_of(hash, owner, mask); b->words[i].token; i = (i + 1) & mask) {
+        w = &b->words[i];
+        if (w->hash == hash && w->owner == owner && w->len == len && w->classes == classes &&
+            w->cond == cond && memcmp(string_at(b, w->token), token, len) == 0) {
+            *added = 0;
+            return w;
+        }
+    }
+    w = &b->words[i];
+    w->hash = hash;
+    w->owner = owner;
+    w->token = add_string(b, token, len);
+    w->len = len;
+    w->classes = classes;
+    w->cond = cond;
+    b->n_words++;
+    *added = 1;
+    return w;
+}
+
+static int find_class(const builder_t* b, const char* name) {
+    int i;
+
+    for (i = 0; i < b->n_classes; i++) {
+        if (strcmp(b->classes[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static uint32_t find_builder_ruleset(const builder_t* b, const char* name) {
+    uint32_t i;
+
+    for (i = 1; i < N_OF(b->rulesets, adapt_ruleset_t); i++) {
+        if (strcmp(string_at(b, AT(b->rulesets, adapt_ruleset_t, i)->name), name) == 0) return i;
+    }
+    return ADAPT_NO_RULES;
+}
+
+static uint32_t add_ruleset(builder_t* b, const char* name, uint32_t parent) {
+    adapt_ruleset_t rs;
+
+    rs.name = add_string(b, name, strlen(name));
+    rs.parent = parent;
+    rs.root = add_node(b);
+    grow_append(&b->rulesets, &rs, sizeof(rs));
+    return N_OF(b->rulesets, adapt_ruleset_t) - 1;
+}
+
+static int compile_takes(builder_t* b, char** words, int n) {
+    int class = find_class(b, words[1]);
+    int i;
+
+    if (class == 0) return build_error(b, "'%s' is built in", words[1]);
+    if (class < 0) {
+        if (b->n_classes == MAX_CLASSES) return build_error(b, "too many classes%s", "");
+        if (strlen(words[1]) >= sizeof(b->classes[0])) return build_error(b, "class name too long: %s", words[1]);
+        class = b->n_classes++;
+        strcpy(b->classes[class], words[1]);
+    }
+    for (i = 2; i < n; i++) {
+        int added;
+        adapt_word_t* w = word_entry(b, ADAPT_NONE, words[i], 0, 0, &added);
+        w->value |= 1u << class;
+    }
+    return 0;
+}
+
+static int compile_for(builder_t* b, char** words, int n) {
+    uint32_t parent = ADAPT_NO_RULES;
+
+    if (n != 2 && !(n == 4 && strcmp(words[2], ":") == 0)) {
+        return build_error(b, "expected: for ID [: PARENT]%s", "");
+    }
+    if (find_builder_ruleset(b, words[1]) != ADAPT_NO_RULES) {
+        return build_error(b, "'%s' already has rules", words[1]);
+    }
+    if (n == 4) {
+        parent = find_builder_ruleset(b, words[3]);
+        if (parent == ADAPT_NO_RULES) return build_error(b, "no rules for '%s' above", words[3]);
+    }
+    b->ruleset = add_ruleset(b, words[1], parent);
+    b->cond = 0;
+    return 0;
+}
+
+static int compile_when(builder_t* b, char** words, int n) {
+    uint32_t i, count = N_OF(b->conds, uint32_t);
+    uint32_t off;
+
+    if (n == 2 && strcmp(words[1], "always") == 0) {
+        b->cond = 0;
+        return 0;
+    }
+    if (n != 3 || strcmp(words[1], "missing") != 0) {
+        return build_error(b, "expected: when always | when missing PROGRAM%s", "");
+    }
+    for (i = 1; i < count; i++) {
+        if (strcmp(string_at(b, *AT(b->conds, uint32_t, i)), words[2]) == 0) {
+            b->cond = i;
+            return 0;
+        }
+    }
+    if (count == MAX_CONDS) return build_error(b, "too many programs in when (%s)", words[2]);
+    off = add_string(b, words[2], strlen(words[2]));
+    grow_append(&b->conds, &off, sizeof(off));
+    b->cond = count;
+    return 0;
+}
+
+// words: "cmd" and the pattern; replacement: the text after =>
+static int compile_cmd(builder_t* b, char** words, int n, const char* replacement) {
+    adapt_rule_t rule;
+    uint32_t node = AT(b->rulesets, adapt_ruleset_t, b->ruleset)->root;
+    const char* p;
+    int i, stars = 0;
+    size_t len;
+
+    if (n < 2) return build_error(b, "cmd needs a pattern%s", "");
+    for (i = 1; i < n; i++) {
+        if (strcmp(words[i], "*") == 0) {
+            adapt_node_t* at = AT(b->nodes, adapt_node_t, node);
+            if (++stars > MAX_CAPTURES) return build_error(b, "more than 9 *s%s", "");
+            if (at->wild == ADAPT_NONE) {
+                uint32_t child = add_node(b);
+                AT(b->nodes, adapt_node_t, node)->wild = child;
+            }
+            node = AT(b->nodes, adapt_node_t, node)->wild;
+        } else {
+            node = edge_child(b, node, words[i]);
+        }
+    }
+    if (AT(b->nodes, adapt_node_t, node)->rule != ADAPT_NONE) {
+        return build_error(b, "duplicate rule for '%s'", words[1]);
+    }
+
+    replacement += strspn(replacement, " \t");
+    len = strlen(replacement);
+    while (len && (replacement[len - 1] == ' ' || replacement[len - 1] == '\t')) len--;
+    if (!len) return build_error(b, "cmd needs a replacement after =>%s", "");
+    for (p = replacement; p < replacement + len; p++) {
+        if (p[0] == '$' && p[1] >= '1' && p[1] <= '9' && p[1] - '0' > stars) {
+            return build_error(b, "no * for $%.1s", p + 1);
+        }
+    }
+
+    rule.replacement = add_string(b, replacement, len);
+    rule.cond = b->cond;
+    grow_append(&b->rules, &rule, sizeof(rule));
+    AT(b->nodes, adapt_node_t, node)->rule = N_OF(b->rules, adapt_rule_t) - 1;
+    return 0;
+}
+
+static int compile_word(builder_t* b, int class, char** words, int n) {
+    adapt_word_t* w;
+    int added;
+
+    if (n != 3) return build_error(b, "expected: %s FROM TO", words[0]);
+    w = word_entry(b, b->ruleset, words[1], 1u << class, b->cond, &added);
+    if (!added) return build_error(b, "duplicate rule for '%s'", words[1]);
+    w->value = add_string(b, words[2], strlen(words[2]));
+    return 0;
+}
+
+static int compile_line(builder_t* b, char* line) {
+    char* words[64];
+    char* arrow = NULL;
+    char* p;
+    int n = 0, class;
+
+    p = strchr(line, '#');
+    if (p) *p = '\0';
+    p = line + strspn(line, " \t");
+    if (strncmp(p, "cmd", 3) == 0 && (p[3] == ' ' || p[3] == '\t')) {
+        arrow = strstr(p, "=>");
+        if (!arrow) return build_error(b, "cmd needs => and a replacement%s", "");
+        *arrow = '\0';
+        arrow += 2;
+    }
+    for (;;) {
+        p += strspn(p, " \t");
+        if (!*p) break;
+        if (n == (int)(sizeof(words) / sizeof(words[0]))) return build_error(b, "too many words%s", "");
+        words[n++] = p;
+        p += strcspn(p, " \t");
+        if (*p) *p++ = '\0';
+    }
+    if (n == 0) return 0;
+
+    if (strcmp(words[0], "takes") == 0) {
+        if (n < 3) return build_error(b, "expected: takes CLASS COMMAND...%s", "");
+        return compile_takes(b, words, n);
+    }
+    if (strcmp(words[0], "for") == 0) return compile_for(b, words, n);
+    if (b->ruleset == ADAPT_NO_RULES) return build_error(b, "'%s' before the first for", words[0]);
+    if (strcmp(words[0], "when") == 0) return compile_when(b, words, n);
+    if (arrow) return compile_cmd(b, words, n, arrow);
+    class = find_class(b, words[0]);
+    if (class < 0) return build_error(b, "unknown directive '%s'", words[0]);
+    return compile_word(b, class, words, n);
+}
+
+static size_t align4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+static int compile_source(const char* path, const char* source, size_t len,
+                          uint8_t** out, size_t* out_len, char* err, size_t err_len) {
+    builder_t b;
+    adapt_header_t h;
+    const char* p = source;
+    const char* end = source + len;
+    char line[4096];
+    uint32_t none = 0;
+    size_t total;
+    uint8_t* image;
+    int rc = 0;
+
+    memset(&b, 0, sizeof(b));
+    b.path = path;
+    b.err = err;
+    b.err_len = err_len;
+    grow_append(&b.strings, "", 1);
+    grow_append(&b.conds, &none, sizeof(none));
+    strcpy(b.classes[b.n_classes++], "path");
+    add_ruleset(&b, "", ADAPT_NO_RULES);
+    grow_edges(&b);
+    grow_words(&b);
+
+    while (p < end && rc == 0) {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        size_t n = nl ? (size_t)(nl - p) : (size_t)(end - p);
+
+        b.line++;
+        if (n && p[n - 1] == '\r') n--;
+        if (n >= sizeof(line)) {
+            rc = build_error(&b, "line too long%s", "");
+            break;
+        }
+        memcpy(line, p, n);
+        line[n] = '\0';
+        rc = compile_line(&b, line);
+        p = nl ? nl + 1 : end;
+    }
+    if (rc == 0 && N_OF(b.rulesets, adapt_ruleset_t) == 1) {
+        rc = set_error(err, err_len, "%s: no rules defined", path);
+    }
+
+    if (rc == 0) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, ADAPT_MAGIC, sizeof(ADAPT_MAGIC));
+        h.version = ADAPT_VERSION;
+        h.byte_order = ADAPT_BYTE_ORDER;
+        h.n_rulesets = N_OF(b.rulesets, adapt_ruleset_t);
+        h.n_nodes = N_OF(b.nodes, adapt_node_t);
+        h.n_rules = N_OF(b.rules, adapt_rule_t);
+        h.n_conds = N_OF(b.conds, uint32_t);
+        h.edge_slots = b.edge_slots;
+        h.word_slots = b.word_slots;
+        h.rulesets_off = (uint32_t)align4(sizeof(h));
+        h.nodes_off = (uint32_t)(h.rulesets_off + b.rulesets.len);
+        h.rules_off = (uint32_t)(h.nodes_off + b.nodes.len);
+        h.conds_off = (uint32_t)(h.rules_off + b.rules.len);
+        h.edges_off = (uint32_t)(h.conds_off + b.conds.len);
+        h.words_off = (uint32_t)(h.edges_off + (size_t)b.edge_slots * sizeof(adapt_edge_t));
+        h.strings_off = (uint32_t)(h.words_off + (size_t)b.word_slots * sizeof(adapt_word_t));
+        h.strings_size = (uint32_t)b.strings.len;
+        total = align4((size_t)h.strings_off + b.strings.len);
+        if (total > UINT32_MAX) {
+            rc = set_error(err, err_len, "%s: rules exceed 4 GiB", path);
+        } else {
+            h.total_size = (uint32_t)total;
+            image = xcalloc(1, total);
+            memcpy(image, &h, sizeof(h));
+            memcpy(image + h.rulesets_off, b.rulesets.data, b.rulesets.len);
+            memcpy(image + h.nodes_off, b.nodes.data, b.nodes.len);
+            if (b.rules.len) memcpy(image + h.rules_off, b.rules.data, b.rules.len);
+            memcpy(image + h.conds_off, b.conds.data, b.conds.len);
+            memcpy(image + h.edges_off, b.edges, (size_t)b.edge_slots * sizeof(adapt_edge_t));
+            memcpy(image + h.words_off, b.words, (size_t)b.word_slots * sizeof(adapt_word_t));
+            memcpy(image + h.strings_off, b.strings.data, b.strings.len);
+            *out = image;
+            *out_len = total;
+        }
+    }
+
+    free(b.rulesets.data);
+    free(b.nodes.data);
+    free(b.rules.data);
+    free(b.conds.data);
+    free(b.strings.data);
+    free(b.edges);
+    free(b.words);
+    return rc;
+}
+
+static int compile_path(const char* source_path, uint8_t** image, size_t* len, char* err, size_t err_len) {
+    size_t source_len;
+    char* source = read_file(source_path, &source_len);
+    int rc;
+
+    if (!source) return set_error(err, err_len, "%s: cannot read", source_path);
+    rc = compile_source(source_path, source, source_len, image, len, err, err_len);
+    free(source);
+    return rc;
+}
+
+int adapt_compile_file(adapt_rules_t* r, const char* source_path, char* err, size_t err_len) {
+    uint8_t* image;
+    size_t len;
+
+    memset(r, 0, sizeof(*r));
+    if (compile_path(source_path, &image, &len, err, err_len) < 0) return -1;
+    if (attach(r, image, len, err, err_len) < 0) {
+        free(image);
+        return -1;
+    }
+    return 0;
+}
+
+int adapt_compile_to(const char* source_path, const char* out_path, char* err, size_t err_len) {
+    char tmp[4096];
+    uint8_t* image;
+    size_t len;
+    FILE* fp;
+    int ok;
+
+    if (compile_path(source_path, &image, &len, err, err_len) < 0) return -1;
+
+    // Write next to the target and rename, as for lesson packs
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        free(image);
+        return set_error(err, err_len, "%s: cannot create", tmp);
+    }
+    ok = fwrite(image, 1, len, fp) == len;
+    ok = (fclose(fp) == 0) && ok;
+    free(image);
+    if (!ok || rename(tmp, out_path) < 0) {
+        unlink(tmp);
+        return set_error(err, err_len, "%s: write failed", out_path);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: rewrite cost as the rule count grows
+// ---------------------------------------------------------------------
+
+static uint64_t bench_rng = 0x2545F4914F6CDD1Dull;
+
+// n rules, half of them cmd patterns and half package names
+static void write_synthetic_rules(const char* path, int n) {
+    FILE* fp = fopen(path, "w");
+    int i;
+
+    if (!fp) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(fp, "takes package apt apt-get dpkg\ntakes service systemctl service\nfor synthetic\n");
+    for (i = 0; i < n / 2; i++) {
+        fprintf(fp, "cmd tool%d sub%d * => newtool%d --sub%d $1\n", i, i, i, i);
+        fprintf(fp, "package pkg%d newpkg%d\n", i, i);
+    }
+    fclose(fp);
+}
+
+#define BENCH_COMMANDS 256
+
+// Lines that match nothing (some walk part of the trie first), and lines
+// that match a pattern or a package
+static void make_commands(char pass[][96], char hit[][96], int n_rules) {
+    static const char* const plain[] = {
+        "ls -la /etc/hosts | head -5",
+        "grep -r 'error' /var/log/ | head -3",
+        "systemctl status ssh",
+        "find /etc -name '*.conf' 2>&1 | head -5",
+        "ps aux | head -10",
+    };
+    int i, k;
+
+    for (i = 0; i < BENCH_COMMANDS; i++) {
+        k = (int)bench_random(&bench_rng, (uint32_t)(n_rules / 2));
+        switch (i % 4) {
+            case 0:
+                snprintf(pass[i], 96, "%s", plain[bench_random(&bench_rng, sizeof(plain) / sizeof(plain[0]))]);
+                break;
+            case 1:
+                snprintf(pass[i], 96, "sudo apt install htop missing%d vim", k);
+                break;
+            case 2:
+                snprintf(pass[i], 96, "tool%d other%d --verbose", k, k);
+                break;
+            default:
+                snprintf(pass[i], 96, "dpkg -l | grep pkg%d", k);
+                break;
+        }
+        if (i % 2) {
+            snprintf(hit[i], 96, "sudo apt install htop pkg%d", k);
+        } else {
+            snprintf(hit[i], 96, "tool%d sub%d arg%d --flag | head -3", k, k, i);
+        }
+    }
+}
+
+// Seconds per rewrite over rounds passes of the commands; *allocs counts
+// results that were not the input
+static double time_rewrites(const adapt_rules_t* r, uint32_t rs, char cmds[][96], int rounds, long* allocs) {
+    double start = bench_now();
+    int round, i;
+
+    *allocs = 0;
+    for (round = 0; round < rounds; round++) {
+        for (i = 0; i < BENCH_COMMANDS; i++) {
+            char* out = adapt_rewrite(r, rs, cmds[i]);
+            if (out != cmds[i]) {
+                (*allocs)++;
+                free(out);
+            }
+        }
+    }
+    return (bench_now() - start) / ((double)rounds * BENCH_COMMANDS);
+}
+
+int adapt_bench(int argc, char** argv) {
+    static const int sizes[] = { 100, 1000, 10000, 100000 };
+    static char pass[BENCH_COMMANDS][96], hit[BENCH_COMMANDS][96];
+    char dir[] = "/tmp/deb1-bench-XXXXXX";
+    char source_path[64], table_path[64], err[256];
+    int rounds = argc > 0 ? atoi(argv[0]) : 2000;
+    size_t i;
+
+    if (rounds <= 0) rounds = 2000;
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(source_path, sizeof(source_path), "%s/synthetic.rules", dir);
+    snprintf(table_path, sizeof(table_path), "%s/synthetic.table", dir);
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        adapt_rules_t r;
+        char metric[64];
+        double t0, per;
+        long allocs;
+        uint32_t rs;
+
+        write_synthetic_rules(source_path, sizes[i]);
+        t0 = bench_now();
+        if (adapt_compile_to(source_path, table_path, err, sizeof(err)) < 0 ||
+            adapt_open(&r, table_path, err, sizeof(err)) < 0) {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+        snprintf(metric, sizeof(metric), "compile_%d_rules", sizes[i]);
+        bench_report("adapt", metric, (bench_now() - t0) * 1e3, "ms");
+        snprintf(metric, sizeof(metric), "table_%d_rules", sizes[i]);
+        bench_report("adapt", metric, r.size / 1024.0, "KiB");
+
+        rs = adapt_select(&r, "synthetic", NULL, NULL);
+        make_commands(pass, hit, sizes[i]);
+
+        per = time_rewrites(&r, rs, pass, rounds, &allocs);
+        snprintf(metric, sizeof(metric), "unchanged_%d_rules", sizes[i]);
+        bench_report("adapt", metric, per * 1e9, "ns");
+        if (allocs) {
+            fprintf(stderr, "adapt: %ld unchanged commands were copied\n", allocs);
+            return 1;
+        }
+
+        per = time_rewrites(&r, rs, hit, rounds, &allocs);
+        snprintf(metric, sizeof(metric), "rewritten_%d_rules", sizes[i]);
+        bench_report("adapt", metric, per * 1e9, "ns");
+        if (allocs != (long)rounds * BENCH_COMMANDS) {
+            fprintf(stderr, "adapt: %ld of %ld commands rewritten\n", allocs, (long)rounds * BENCH_COMMANDS);
+            return 1;
+        }
+        adapt_close(&r);
+    }
+
+    unlink(source_path);
+    unlink(table_path);
+    rmdir(dir);
+    return 0;
+}
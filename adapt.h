@@ -0,0 +1,133 @@
+#ifndef ADAPT_H
+#define ADAPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Command adaptation rules.
+//
+// The lessons are written for Debian; in live mode each command is
+// rewritten for the machine it runs on before it is started. The rules
+// (see lessons/adapt.rules) are compiled into one image, like a lesson
+// pack, that is used in place from the mapped file:
+//
+//   - "cmd" rules form a token trie per ruleset. The edges of every trie
+//     live in one open-addressed table keyed by (node, token), so walking
+//     a command costs one probe per token: the cost depends on the
+//     length of the command, not on the number of rules.
+//   - Word rules (package and service names, paths) are one more table
+//     keyed by (ruleset, token), probed once per argument.
+//
+// A command no rule applies to is returned as it is, without allocating.
+//
+// Layout (all integers native-endian, 4-byte aligned):
+//   adapt_header_t
+//   adapt_ruleset_t rulesets[n_rulesets]     (0 is "no rules")
+//   adapt_node_t    nodes[n_nodes]
+//   adapt_rule_t    rules[n_rules]
+//   uint32_t        conds[n_conds]           (program names; 0 is "always")
+//   adapt_edge_t    edges[edge_slots]        (power of two)
+//   adapt_word_t    words[word_slots]        (power of two)
+//   char            strings[strings_size]    (NUL-terminated, offset 0 is "")
+
+#define ADAPT_MAGIC "DEB1ADR"
+#define ADAPT_VERSION 1
+#define ADAPT_BYTE_ORDER 0x01020304u
+#define ADAPT_NONE 0xffffffffu
+
+// Ruleset 0 has no rules: commands run as written
+#define ADAPT_NO_RULES 0
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t total_size;
+    uint32_t n_rulesets, rulesets_off;
+    uint32_t n_nodes, nodes_off;
+    uint32_t n_rules, rules_off;
+    uint32_t n_conds, conds_off;
+    uint32_t edge_slots, edges_off;
+    uint32_t word_slots, words_off;
+    uint32_t strings_off, strings_size;
+} adapt_header_t;
+
+// The rules for one os-release ID
+typedef struct {
+    uint32_t name;
+    uint32_t parent;        // consulted when no rule here applies; ADAPT_NO_RULES for none
+    uint32_t root;          // trie node
+} adapt_ruleset_t;
+
+typedef struct {
+    uint32_t rule;          // ends a cmd pattern, or ADAPT_NONE
+    uint32_t wild;          // child for "*", or ADAPT_NONE
+} adapt_node_t;
+
+typedef struct {
+    uint32_t replacement;   // with $1..$9 for the tokens the *s matched
+    uint32_t cond;
+} adapt_rule_t;
+
+// Trie edge; token 0 marks an empty slot
+typedef struct {
+    uint32_t hash;
+    uint32_t parent;
+    uint32_t token, len;
+    uint32_t child;
+} adapt_edge_t;
+
+// A word rule (owner: ruleset, value: replacement), or the argument
+// classes a command takes (owner ADAPT_NONE, value: class bits).
+// token 0 marks an empty slot.
+typedef struct {
+    uint32_t hash;
+    uint32_t owner;
+    uint32_t token, len;
+    uint32_t classes;
+    uint32_t value;
+    uint32_t cond;
+} adapt_word_t;
+
+typedef struct {
+    const uint8_t* base;
+    size_t size;
+    const adapt_header_t* header;
+    const adapt_ruleset_t* rulesets;
+    const adapt_node_t* nodes;
+    const adapt_rule_t* rules;
+    const uint32_t* conds;
+    const adapt_edge_t* edges;
+    const adapt_word_t* words;
+    const char* strings;
+    uint32_t active;        // bit per condition that holds; bit 0 always set
+    int mapped;             // 1 if base is an mmap, 0 if malloc'd
+} adapt_rules_t;
+
+// Map compiled rules / compile a source in memory / compile to a file.
+// Return 0, or -1 with a message in err.
+int adapt_open(adapt_rules_t* r, const char* path, char* err, size_t err_len);
+int adapt_compile_file(adapt_rules_t* r, const char* source_path, char* err, size_t err_len);
+int adapt_compile_to(const char* source_path, const char* out_path, char* err, size_t err_len);
+void adapt_close(adapt_rules_t* r);
+
+// Settle the "when missing PROGRAM" conditions. installed answers 1 or 0
+// for a program, or -1 when it does not know; those (and all of them
+// when installed is NULL) are looked for on $PATH. Until this is called
+// only unconditional rules apply.
+void adapt_check_programs(adapt_rules_t* r, int (*installed)(const char* program));
+
+// The ruleset for an os-release ID, else for the first entry of ID_LIKE
+// (space-separated) that has one, else for fallback. Any argument may be
+// NULL. Returns ADAPT_NO_RULES when none matches.
+uint32_t adapt_select(const adapt_rules_t* r, const char* id, const char* id_like, const char* fallback);
+const char* adapt_ruleset_name(const adapt_rules_t* r, uint32_t ruleset);
+
+// Rewrite a command line with a ruleset. Each command of a pipeline or
+// list is rewritten on its own; a leading sudo is kept. Returns command
+// itself when nothing applies, otherwise a malloc'd string.
+char* adapt_rewrite(const adapt_rules_t* r, uint32_t ruleset, const char* command);
+
+int adapt_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,1752 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "apt.h"
+#include "bench.h"
+#include "util.h"
+
+// Lists apt_db_shared() tries after $DEB1_APT_INDEX
+static const char* index_search_path[] = {
+    "/var/lib/apt/lists/deb.debian.org_debian_dists_bookworm_main_binary-amd64_Packages",
+    "lessons/Packages",
+};
+
+// Installed on the simulated server besides required/important packages
+static const char* const seed_packages[] = {
+    "apache2", "cron", "curl", "dbus", "linux-image-amd64", "man-db", "openssh-server",
+    "rsyslog", "sudo", "systemd", "unattended-upgrades", "vim-tiny",
+};
+
+static const char* const dep_labels[APT_DEP_KINDS] = {
+    "PreDepends", "Depends", "Recommends", "Suggests", "Breaks", "Conflicts",
+};
+
+static inline const char* str_at(const apt_db_t* db, apt_str_t s) {
+    return db->map + s.off;
+}
+
+// ---------------------------------------------------------------------
+// Name lookup
+
+static uint32_t hash_name(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+static int slice_equals(const apt_db_t* db, apt_str_t s, const char* name, size_t len) {
+    return s.len == len && memcmp(db->map + s.off, name, len) == 0;
+}
+
+// The slot holding name, or the empty slot where it would go
+static uint32_t* pkg_slot(const apt_db_t* db, uint32_t* table, uint32_t mask, const char* name, size_t len) {
+    uint32_t i = hash_name(name, len) & mask;
+
+    while (table[i] && !slice_equals(db, db->pkgs[table[i] - 1].name, name, len)) i = (i + 1) & mask;
+    return &table[i];
+}
+
+uint32_t apt_db_find(const apt_db_t* db, const char* name, size_t len) {
+    uint32_t slot = *pkg_slot(db, db->hash, db->hash_mask, name, len);
+
+    return slot ? slot - 1 : APT_NONE;
+}
+
+static apt_provide_t* provide_slot(const apt_db_t* db, const char* name, size_t len) {
+    uint32_t i = hash_name(name, len) & db->provides_mask;
+
+    while (db->provides[i].name.len && !slice_equals(db, db->provides[i].name, name, len)) {
+        i = (i + 1) & db->provides_mask;
+    }
+    return &db->provides[i];
+}
+
+// The package that Provides a virtual name, or APT_NONE
+static uint32_t find_provider(const apt_db_t* db, const char* name, size_t len) {
+    const apt_provide_t* p = provide_slot(db, name, len);
+
+    return p->name.len ? p->pkg : APT_NONE;
+}
+
+static void grow_hash(apt_db_t* db) {
+    uint32_t size = db->hash ? (db->hash_mask + 1) * 2 : 1024, i;
+
+    free(db->hash);
+    db->hash = calloc(size, sizeof(uint32_t));
+    if (!db->hash) {
+        perror("calloc");
+        exit(1);
+    }
+    db->hash_mask = size - 1;
+    for (i = 0; i < db->n_pkgs; i++) {
+        apt_str_t s = db->pkgs[i].name;
+
+        *pkg_slot(db, db->hash, db->hash_mask, db->map + s.off, s.len) = i + 1;
+    }
+}
+
+// ---------------------------------------------------------------------
+// Parsing
+
+typedef struct {
+    apt_db_t* db;
+    uint32_t deps_cap, pkgs_cap;
+    apt_provide_t* provided;        // (name, provider) as parsed
+    uint32_t n_provided, provided_cap;
+} parser_t;
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '+' || c == '-' || c == '.';
+}
+
+static apt_str_t slice(const apt_db_t* db, const char* start, const char* end) {
+    apt_str_t s;
+
+    s.off = (uint32_t)(start - db->map);
+    s.len = (uint32_t)(end - start);
+    return s;
+}
+
+// "a (>= 1), b | c [amd64], d:any" -> one dependency per name, "|" chaining
+// alternatives; kind -1 collects Provides names for pkg instead
+static void parse_relations(parser_t* ps, const char* p, const char* end, int kind, uint32_t pkg) {
+    apt_db_t* db = ps->db;
+
+    while (p < end) {
+        const char* name;
+        int added = 0;
+
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n')) p++;
+        name = p;
+        while (p < end && is_name_char(*p)) p++;
+        if (p > name) {
+            if (kind < 0) {
+                if (ps->n_provided == ps->provided_cap) {
+                    ps->provided_cap = ps->provided_cap ? ps->provided_cap * 2 : 1024;
+                    ps->provided = xrealloc(ps->provided, ps->provided_cap * sizeof(apt_provide_t));
+                }
+                ps->provided[ps->n_provided].name = slice(db, name, p);
+                ps->provided[ps->n_provided++].pkg = pkg;
+            } else {
+                apt_dep_t* d;
+
+                if (db->n_deps == ps->deps_cap) {
+                    ps->deps_cap = ps->deps_cap ? ps->deps_cap * 2 : 4096;
+                    db->deps = xrealloc(db->deps, ps->deps_cap * sizeof(apt_dep_t));
+                }
+                d = &db->deps[db->n_deps++];
+                memset(d, 0, sizeof(*d));
+                d->target = APT_NONE;
+                d->name = slice(db, name, p);
+                d->kind = (uint8_t)kind;
+                added = 1;
+            }
+        }
+        // Skip the version, architecture and profile restrictions
+        while (p < end && *p != ',' && *p != '|') p++;
+        if (p < end && *p == '|' && added) db->deps[db->n_deps - 1].or_next = 1;
+        if (p < end) p++;
+    }
+}
+
+static uint32_t parse_number(const char* p, const char* end) {
+    uint64_t n = 0;
+
+    while (p < end && isdigit((unsigned char)*p)) n = n * 10 + (uint64_t)(*p++ - '0');
+    return n > UINT32_MAX ? UINT32_MAX : (uint32_t)n;
+}
+
+static int key_is(const char* key, size_t len, const char* name) {
+    return strlen(name) == len && memcmp(key, name, len) == 0;
+}
+
+// One stanza starting at p; returns the position after it
+static const char* parse_stanza(parser_t* ps, const char* p, const char* end) {
+    apt_db_t* db = ps->db;
+    uint32_t dep_start = db->n_deps, provided_start = ps->n_provided, *slot;
+    const char* start = p;
+    apt_pkg_t pkg;
+    int in_description = 0;
+
+    memset(&pkg, 0, sizeof(pkg));
+    while (p < end && *p != '\n') {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        const char *colon, *value, *value_end;
+        size_t klen;
+        int kind = -2;
+
+        if (!eol) eol = end;
+        if (*p == ' ' || *p == '\t') {
+            // Continuation: only the description's is kept
+            if (in_description) {
+                if (!pkg.long_desc.len) pkg.long_desc.off = (uint32_t)(p - db->map);
+                pkg.long_desc.len = (uint32_t)(eol - db->map) - pkg.long_desc.off;
+            }
+            p = eol < end ? eol + 1 : end;
+            continue;
+        }
+        in_description = 0;
+        colon = memchr(p, ':', (size_t)(eol - p));
+        if (!colon) {
+            p = eol < end ? eol + 1 : end;
+            continue;
+        }
+        klen = (size_t)(colon - p);
+        value = colon + 1;
+        while (value < eol && (*value == ' ' || *value == '\t')) value++;
+        value_end = eol;
+        while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\r')) value_end--;
+
+        switch (p[0]) {
+            case 'A':
+                if (key_is(p, klen, "Architecture")) pkg.arch = slice(db, value, value_end);
+                break;
+            case 'B':
+                if (key_is(p, klen, "Breaks")) kind = APT_DEP_BREAKS;
+                break;
+            case 'C':
+                if (key_is(p, klen, "Conflicts")) kind = APT_DEP_CONFLICTS;
+                break;
+            case 'D':
+                if (key_is(p, klen, "Depends")) {
+                    kind = APT_DEP_DEPENDS;
+                } else if (key_is(p, klen, "Description")) {
+                    pkg.summary = slice(db, value, value_end);
+                    in_description = 1;
+                }
+                break;
+            case 'E':
+                if (key_is(p, klen, "Essential")) pkg.essential = value_end - value == 3 && memcmp(value, "yes", 3) == 0;
+                break;
+            case 'H':
+                if (key_is(p, klen, "Homepage")) pkg.homepage = slice(db, value, value_end);
+                break;
+            case 'I':
+                if (key_is(p, klen, "Installed-Size")) pkg.installed_kb = parse_number(value, value_end);
+                break;
+            case 'M':
+                if (key_is(p, klen, "Maintainer")) pkg.maintainer = slice(db, value, value_end);
+                break;
+            case 'P':
+                if (key_is(p, klen, "Package")) {
+                    pkg.name = slice(db, value, value_end);
+                } else if (key_is(p, klen, "Priority")) {
+                    pkg.priority = slice(db, value, value_end);
+                    pkg.important = (value_end - value == 8 && memcmp(value, "required", 8) == 0) ||
+                                    (value_end - value == 9 && memcmp(value, "important", 9) == 0);
+                } else if (key_is(p, klen, "Pre-Depends")) {
+                    kind = APT_DEP_PRE_DEPENDS;
+                } else if (key_is(p, klen, "Provides")) {
+                    kind = -1;
+                }
+                break;
+            case 'R':
+                if (key_is(p, klen, "Recommends")) kind = APT_DEP_RECOMMENDS;
+                break;
+            case 'S':
+                if (key_is(p, klen, "Section")) {
+                    pkg.section = slice(db, value, value_end);
+                } else if (key_is(p, klen, "Size")) {
+                    pkg.size = parse_number(value, value_end);
+                } else if (key_is(p, klen, "Suggests")) {
+                    kind = APT_DEP_SUGGESTS;
+                }
+                break;
+            case 'V':
+                if (key_is(p, klen, "Version")) pkg.version = slice(db, value, value_end);
+                break;
+        }
+        if (kind >= -1) {
+            // Relationship fields may be folded over several lines
+            const char* field_end = eol;
+
+            while (field_end < end && field_end + 1 < end && (field_end[1] == ' ' || field_end[1] == '\t')) {
+                const char* next = memchr(field_end + 1, '\n', (size_t)(end - field_end - 1));
+                field_end = next ? next : end;
+            }
+            if (kind >= 0) pkg.field[kind] = slice(db, value, field_end);
+            parse_relations(ps, value, field_end, kind, db->n_pkgs);
+            eol = field_end;
+        }
+        p = eol < end ? eol + 1 : end;
+    }
+    pkg.record = slice(db, start, p > start && p[-1] == '\n' ? p - 1 : p);
+
+    // Stanzas without a name, and later versions of a name already seen,
+    // are dropped together with what they contributed
+    if (!pkg.name.len) {
+        db->n_deps = dep_start;
+        ps->n_provided = provided_start;
+        return p;
+    }
+    if ((db->n_pkgs + 1) * 2 > db->hash_mask + 1) grow_hash(db);
+    slot = pkg_slot(db, db->hash, db->hash_mask, str_at(db, pkg.name), pkg.name.len);
+    if (*slot) {
+        db->n_deps = dep_start;
+        ps->n_provided = provided_start;
+        return p;
+    }
+    if (db->n_pkgs == ps->pkgs_cap) {
+        ps->pkgs_cap = ps->pkgs_cap ? ps->pkgs_cap * 2 : 1024;
+        db->pkgs = xrealloc(db->pkgs, ps->pkgs_cap * sizeof(apt_pkg_t));
+    }
+    pkg.first_dep = dep_start;
+    pkg.n_deps = db->n_deps - dep_start;
+    db->pkgs[db->n_pkgs] = pkg;
+    *slot = ++db->n_pkgs;
+    return p;
+}
+
+static int compare_names(const void* a, const void* b, void* ctx) {
+    const apt_db_t* db = ctx;
+    apt_str_t x = db->pkgs[*(const uint32_t*)a].name, y = db->pkgs[*(const uint32_t*)b].name;
+    int c = memcmp(db->map + x.off, db->map + y.off, x.len < y.len ? x.len : y.len);
+
+    return c ? c : (int)x.len - (int)y.len;
+}
+
+// After the last stanza: Provides table, dependency targets, reverse
+// edges and the name order
+static void build_index(parser_t* ps) {
+    apt_db_t* db = ps->db;
+    uint32_t size = 16, i, j, total = 0;
+    uint32_t* fill;
+
+    if (!db->hash) grow_hash(db);
+    while (size < ps->n_provided * 2) size *= 2;
+    db->provides = calloc(size, sizeof(apt_provide_t));
+    if (!db->provides) {
+        perror("calloc");
+        exit(1);
+    }
+    db->provides_mask = size - 1;
+    for (i = 0; i < ps->n_provided; i++) {
+        apt_str_t name = ps->provided[i].name;
+        apt_provide_t* slot;
+
+        if (apt_db_find(db, str_at(db, name), name.len) != APT_NONE) continue;
+        slot = provide_slot(db, str_at(db, name), name.len);
+        if (!slot->name.len) *slot = ps->provided[i];
+    }
+
+    for (i = 0; i < db->n_deps; i++) {
+        apt_dep_t* d = &db->deps[i];
+
+        d->target = apt_db_find(db, str_at(db, d->name), d->name.len);
+        if (d->target == APT_NONE) {
+            d->target = find_provider(db, str_at(db, d->name), d->name.len);
+            d->is_virtual = d->target != APT_NONE;
+        }
+    }
+
+    // Reverse edges for everything that pulls a package in or may
+    for (i = 0; i < db->n_pkgs; i++) {
+        for (j = db->pkgs[i].first_dep; j < db->pkgs[i].first_dep + db->pkgs[i].n_deps; j++) {
+            if (db->deps[j].target != APT_NONE && db->deps[j].kind <= APT_DEP_SUGGESTS) db->pkgs[db->deps[j].target].n_rdeps++;
+        }
+    }
+    for (i = 0; i < db->n_pkgs; i++) {
+        db->pkgs[i].first_rdep = total;
+        total += db->pkgs[i].n_rdeps;
+    }
+    db->rdeps = xrealloc(NULL, (total ? total : 1) * sizeof(uint32_t));
+    fill = calloc(db->n_pkgs ? db->n_pkgs : 1, sizeof(uint32_t));
+    for (i = 0; i < db->n_pkgs; i++) {
+        for (j = db->pkgs[i].first_dep; j < db->pkgs[i].first_dep + db->pkgs[i].n_deps; j++) {
+            uint32_t t = db->deps[j].target;
+
+            if (t != APT_NONE && db->deps[j].kind <= APT_DEP_SUGGESTS) db->rdeps[db->pkgs[t].first_rdep + fill[t]++] = i;
+        }
+    }
+    free(fill);
+
+    db->by_name = xrealloc(NULL, (db->n_pkgs ? db->n_pkgs : 1) * sizeof(uint32_t));
+    for (i = 0; i < db->n_pkgs; i++) db->by_name[i] = i;
+    qsort_r(db->by_name, db->n_pkgs, sizeof(uint32_t), compare_names, db);
+}
+
+apt_db_t* apt_db_open(const char* path, char* err, size_t err_len) {
+    apt_db_t* db;
+    parser_t ps;
+    struct stat st;
+    const char *p, *end;
+    void* base;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        set_error(err, err_len, "%s: cannot open", path);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size <= 0 || (uint64_t)st.st_size >= UINT32_MAX) {
+        close(fd);
+        set_error(err, err_len, "%s: empty, unreadable or too large", path);
+        return NULL;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        set_error(err, err_len, "%s: mmap failed", path);
+        return NULL;
+    }
+    // The whole file is read front to back exactly once
+    madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    db = calloc(1, sizeof(apt_db_t));
+    if (!db) {
+        perror("calloc");
+        exit(1);
+    }
+    db->map = base;
+    db->map_len = (size_t)st.st_size;
+    memset(&ps, 0, sizeof(ps));
+    ps.db = db;
+    p = db->map;
+    end = db->map + db->map_len;
+    while (p < end) {
+        while (p < end && *p == '\n') p++;
+        if (p < end) p = parse_stanza(&ps, p, end);
+    }
+    build_index(&ps);
+    free(ps.provided);
+    madvise(base, db->map_len, MADV_RANDOM);
+    return db;
+}
+
+void apt_db_close(apt_db_t* db) {
+    if (!db) return;
+    munmap((void*)db->map, db->map_len);
+    free(db->pkgs);
+    free(db->deps);
+    free(db->rdeps);
+    free(db->by_name);
+    free(db->hash);
+    free(db->provides);
+    free(db->search_text);
+    free(db->search_off);
+    free(db);
+}
+
+size_t apt_db_memory_used(const apt_db_t* db) {
+    size_t n = sizeof(*db);
+
+    n += db->n_pkgs * (sizeof(apt_pkg_t) + 2 * sizeof(uint32_t));     // pkgs, by_name, rdeps
+    n += db->n_deps * sizeof(apt_dep_t);
+    n += (db->hash_mask + 1) * sizeof(uint32_t);
+    n += (db->provides_mask + 1) * sizeof(apt_provide_t);
+    if (db->search_text) n += db->search_off[db->n_pkgs] + (db->n_pkgs + 1) * sizeof(uint32_t);
+    return n;
+}
+
+static apt_db_t* shared_db;
+static pthread_once_t shared_once = PTHREAD_ONCE_INIT;
+
+// Sessions on several threads (the grader's) may ask for it first at once
+static void open_shared(void) {
+    const char* env_path = getenv("DEB1_APT_INDEX");
+    char err[256];
+    size_t i;
+
+    if (env_path && *env_path) {
+        shared_db = apt_db_open(env_path, err, sizeof(err));
+        if (!shared_db) fprintf(stderr, "%s\n", err);
+        return;
+    }
+    for (i = 0; i < sizeof(index_search_path) / sizeof(index_search_path[0]) && !shared_db; i++) {
+        if (access(index_search_path[i], R_OK) == 0) shared_db = apt_db_open(index_search_path[i], err, sizeof(err));
+    }
+}
+
+apt_db_t* apt_db_shared(void) {
+    pthread_once(&shared_once, open_shared);
+    return shared_db;
+}
+
+// ---------------------------------------------------------------------
+// Queries
+
+typedef char bytes16_t __attribute__((vector_size(16)));
+
+// memmem() for search terms: compares the term's first and last byte at 16
+// positions at a time and only verifies where both match, which glibc's
+// general-purpose memmem() does not do for short needles
+static const char* find_term(const char* s, size_t len, const char* term, size_t n) {
+    bytes16_t first, last;
+    size_t end, i, j;
+
+    if (n > len) return NULL;
+    end = len - n + 1;
+    memset(&first, term[0], sizeof(first));
+    memset(&last, term[n - 1], sizeof(last));
+    for (i = 0; i + 16 <= end; i += 16) {
+        bytes16_t a, b, hit;
+        uint64_t w[2];
+
+        memcpy(&a, s + i, 16);
+        memcpy(&b, s + i + n - 1, 16);
+        hit = (a == first) & (b == last);
+        memcpy(w, &hit, 16);
+        if (!(w[0] | w[1])) continue;
+        for (j = i; j < i + 16; j++) {
+            if (s[j] == term[0] && memcmp(s + j, term, n) == 0) return s + j;
+        }
+    }
+    for (; i < end; i++) {
+        if (s[i] == term[0] && memcmp(s + i, term, n) == 0) return s + i;
+    }
+    return NULL;
+}
+
+static void append_lower(char* out, size_t* len, const char* s, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++) out[*len + i] = (char)tolower((unsigned char)s[i]);
+    *len += n;
+}
+
+// Built on the first search; the shared index is searched from several
+// threads in the server, so it is published only once complete
+static pthread_mutex_t search_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void build_search_text(apt_db_t* db) {
+    size_t len = 0, cap = 1;
+    uint32_t i;
+    char* text;
+
+    for (i = 0; i < db->n_pkgs; i++) {
+        const apt_pkg_t* p = &db->pkgs[i];
+
+        cap += p->name.len + p->summary.len + p->long_desc.len + 3;
+    }
+    text = xrealloc(NULL, cap);
+    db->search_off = xrealloc(NULL, (db->n_pkgs + 1) * sizeof(uint32_t));
+    for (i = 0; i < db->n_pkgs; i++) {
+        const apt_pkg_t* p = &db->pkgs[db->by_name[i]];
+
+        db->search_off[i] = (uint32_t)len;
+        append_lower(text, &len, str_at(db, p->name), p->name.len);
+        text[len++] = '\n';
+        append_lower(text, &len, str_at(db, p->summary), p->summary.len);
+        text[len++] = '\n';
+        append_lower(text, &len, str_at(db, p->long_desc), p->long_desc.len);
+        text[len++] = '\0';
+    }
+    db->search_off[db->n_pkgs] = (uint32_t)len;
+    __atomic_store_n(&db->search_text, text, __ATOMIC_RELEASE);
+}
+
+uint32_t apt_db_search(apt_db_t* db, const char* const* terms, int n_terms, uint32_t* out) {
+    char lowered[16][128];
+    size_t lens[16];
+    const char *text, *end, *hit;
+    uint32_t k = 0, n = 0;
+    int t;
+
+    // Empty terms match everything and are dropped
+    for (t = 0; n < (uint32_t)n_terms && t < 16; n++) {
+        size_t i, len = strlen(terms[n]);
+
+        if (!len) continue;
+        lens[t] = len < sizeof(lowered[t]) ? len : sizeof(lowered[t]) - 1;
+        for (i = 0; i < lens[t]; i++) lowered[t][i] = (char)tolower((unsigned char)terms[n][i]);
+        t++;
+    }
+    n_terms = t;
+    n = 0;
+    if (n_terms == 0) {
+        memcpy(out, db->by_name, db->n_pkgs * sizeof(uint32_t));
+        return db->n_pkgs;
+    }
+    text = __atomic_load_n(&db->search_text, __ATOMIC_ACQUIRE);
+    if (!text) {
+        pthread_mutex_lock(&search_lock);
+        if (!db->search_text) build_search_text(db);
+        pthread_mutex_unlock(&search_lock);
+        text = db->search_text;
+    }
+
+    // The first term is found with one sweep over all packages; the rest
+    // are only checked in the packages it hits
+    end = text + db->search_off[db->n_pkgs];
+    while (k < db->n_pkgs && (hit = find_term(text + db->search_off[k], (size_t)(end - text - db->search_off[k]),
+                                              lowered[0], lens[0])) != NULL) {
+        uint32_t lo = k, hi = db->n_pkgs - 1;
+
+        // Package holding the hit: the last start at or before it
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+
+            if (text + db->search_off[mid] <= hit) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        for (t = 1; t < n_terms; t++) {
+            const char* start = text + db->search_off[lo];
+
+            if (!find_term(start, db->search_off[lo + 1] - db->search_off[lo], lowered[t], lens[t])) break;
+        }
+        if (t == n_terms) out[n++] = db->by_name[lo];
+        k = lo + 1;
+    }
+    return n;
+}
+
+static int compare_names_desc(const void* a, const void* b, void* ctx) {
+    return compare_names(b, a, ctx);
+}
+
+uint32_t apt_db_rdepends(const apt_db_t* db, uint32_t pkg, uint32_t* out) {
+    const apt_pkg_t* p = &db->pkgs[pkg];
+    uint32_t i, n = 0;
+
+    memcpy(out, db->rdeps + p->first_rdep, p->n_rdeps * sizeof(uint32_t));
+    qsort_r(out, p->n_rdeps, sizeof(uint32_t), compare_names_desc, (void*)db);
+    for (i = 0; i < p->n_rdeps; i++) {
+        if (n == 0 || out[n - 1] != out[i]) out[n++] = out[i];
+    }
+    return n;
+}
+
+// ---------------------------------------------------------------------
+// Installed state and resolution
+
+#define INSTALLED(s) ((s) >= APT_AUTO)
+#define MARK_INSTALL 1
+#define MARK_REMOVE 2
+#define MARK_KEEP 3
+
+typedef struct {
+    const apt_db_t* db;
+    const uint8_t* state;
+    uint8_t* mark;              // per package, MARK_*
+    uint32_t* list;             // the packages the plan touches, in order
+    uint32_t n;
+    int recommends;             // follow Recommends when installing
+    uint32_t broken_pkg, broken_dep;
+} plan_t;
+
+static void plan_init(plan_t* plan, const apt_db_t* db, const uint8_t* state) {
+    memset(plan, 0, sizeof(*plan));
+    plan->db = db;
+    plan->state = state;
+    plan->mark = calloc(db->n_pkgs ? db->n_pkgs : 1, 1);
+    plan->list = malloc((db->n_pkgs ? db->n_pkgs : 1) * sizeof(uint32_t));
+    if (!plan->mark || !plan->list) {
+        perror("malloc");
+        exit(1);
+    }
+    plan->recommends = 1;
+    plan->broken_pkg = APT_NONE;
+}
+
+static void plan_free(plan_t* plan) {
+    free(plan->mark);
+    free(plan->list);
+}
+
+// End of the alternative group starting at deps[i]
+static uint32_t group_end(const apt_db_t* db, uint32_t i, uint32_t end) {
+    while (i + 1 < end && db->deps[i].or_next) i++;
+    return i + 1;
+}
+
+// Will the package be there once the plan has run?
+static int present(const plan_t* plan, uint32_t pkg) {
+    if (pkg == APT_NONE) return 0;
+    if (plan->mark[pkg] == MARK_REMOVE) return 0;
+    return INSTALLED(plan->state[pkg]) || plan->mark[pkg] == MARK_INSTALL;
+}
+
+// Mark pkg and what it needs for installation; the list ends up in
+// unpack order (dependencies first). Returns -1 on an unmet dependency.
+static int plan_install(plan_t* plan, uint32_t pkg) {
+    const apt_db_t* db = plan->db;
+    const apt_pkg_t* p = &db->pkgs[pkg];
+    uint32_t i, end = p->first_dep + p->n_deps;
+
+    if (present(plan, pkg)) return 0;
+    plan->mark[pkg] = MARK_INSTALL;
+    for (i = p->first_dep; i < end;) {
+        uint32_t g = group_end(db, i, end), j, pick = APT_NONE;
+        int kind = db->deps[i].kind, satisfied = 0;
+
+        if (kind > APT_DEP_RECOMMENDS || (kind == APT_DEP_RECOMMENDS && !plan->recommends)) {
+            i = g;
+            continue;
+        }
+        for (j = i; j < g; j++) {
+            if (present(plan, db->deps[j].target)) satisfied = 1;
+            if (pick == APT_NONE) pick = db->deps[j].target;
+        }
+        if (!satisfied) {
+            if (pick == APT_NONE || plan_install(plan, pick) < 0) {
+                if (kind != APT_DEP_RECOMMENDS) {
+                    if (plan->broken_pkg == APT_NONE) {
+                        plan->broken_pkg = pkg;
+                        plan->broken_dep = i;
+                    }
+                    return -1;
+                }
+            }
+        }
+        i = g;
+    }
+    plan->list[plan->n++] = pkg;
+    return 0;
+}
+
+// Would a Depends/Pre-Depends group of pkg lose its last member?
+static int needs_removed(const plan_t* plan, uint32_t pkg) {
+    const apt_db_t* db = plan->db;
+    const apt_pkg_t* p = &db->pkgs[pkg];
+    uint32_t i, end = p->first_dep + p->n_deps;
+
+    for (i = p->first_dep; i < end;) {
+        uint32_t g = group_end(db, i, end), j;
+        int satisfied = 0, removed = 0;
+
+        for (j = i; j < g; j++) {
+            uint32_t t = db->deps[j].target;
+
+            if (t == APT_NONE) continue;
+            if (present(plan, t)) satisfied = 1;
+            if (plan->mark[t] == MARK_REMOVE) removed = 1;
+        }
+        if (db->deps[i].kind <= APT_DEP_DEPENDS && removed && !satisfied) return 1;
+        i = g;
+    }
+    return 0;
+}
+
+// The marked packages plus everything installed that depends on them
+static void plan_remove_closure(plan_t* plan) {
+    const apt_db_t* db = plan->db;
+    uint32_t k, i;
+
+    for (k = 0; k < plan->n; k++) {
+        const apt_pkg_t* p = &db->pkgs[plan->list[k]];
+
+        for (i = p->first_rdep; i < p->first_rdep + p->n_rdeps; i++) {
+            uint32_t r = db->rdeps[i];
+
+            if (INSTALLED(plan->state[r]) && !plan->mark[r] && needs_removed(plan, r)) {
+                plan->mark[r] = MARK_REMOVE;
+                plan->list[plan->n++] = r;
+            }
+        }
+    }
+}
+
+// Installed automatic packages nothing manual still needs (apt autoremove).
+// Written to out in name order; returns the count.
+static uint32_t find_unneeded(const plan_t* plan, uint32_t* out) {
+    const apt_db_t* db = plan->db;
+    uint8_t* keep = calloc(db->n_pkgs ? db->n_pkgs : 1, 1);
+    uint32_t* stack = malloc((db->n_pkgs ? db->n_pkgs : 1) * sizeof(uint32_t));
+    uint32_t i, top = 0, n = 0;
+
+    for (i = 0; i < db->n_pkgs; i++) {
+        if (present(plan, i) && (plan->state[i] == APT_MANUAL || plan->mark[i] == MARK_INSTALL || db->pkgs[i].essential)) {
+            keep[i] = 1;
+            stack[top++] = i;
+        }
+    }
+    while (top) {
+        const apt_pkg_t* p = &db->pkgs[stack[--top]];
+
+        for (i = p->first_dep; i < p->first_dep + p->n_deps; i++) {
+            uint32_t t = db->deps[i].target;
+
+            if (db->deps[i].kind <= APT_DEP_RECOMMENDS && t != APT_NONE && present(plan, t) && !keep[t]) {
+                keep[t] = 1;
+                stack[top++] = t;
+            }
+        }
+    }
+    for (i = 0; i < db->n_pkgs; i++) {
+        uint32_t pkg = db->by_name[i];
+
+        if (present(plan, pkg) && !keep[pkg]) out[n++] = pkg;
+    }
+    free(keep);
+    free(stack);
+    return n;
+}
+
+uint8_t* apt_state_new(const apt_db_t* db) {
+    uint8_t* state = calloc(db->n_pkgs ? db->n_pkgs : 1, 1);
+    plan_t plan;
+    uint32_t i;
+    size_t k;
+
+    if (!state) {
+        perror("calloc");
+        exit(1);
+    }
+    plan_init(&plan, db, state);
+    plan.recommends = 0;
+    for (i = 0; i < db->n_pkgs; i++) {
+        if (db->pkgs[i].important || db->pkgs[i].essential) plan_install(&plan, i);
+    }
+    for (k = 0; k < sizeof(seed_packages) / sizeof(seed_packages[0]); k++) {
+        uint32_t pkg = apt_db_find(db, seed_packages[k], strlen(seed_packages[k]));
+
+        if (pkg != APT_NONE) plan_install(&plan, pkg);
+    }
+    // What was asked for is manual, what it pulled in automatic
+    for (i = 0; i < plan.n; i++) state[plan.list[i]] = APT_AUTO;
+    for (i = 0; i < db->n_pkgs; i++) {
+        if (db->pkgs[i].important || db->pkgs[i].essential) state[i] = APT_MANUAL;
+    }
+    for (k = 0; k < sizeof(seed_packages) / sizeof(seed_packages[0]); k++) {
+        uint32_t pkg = apt_db_find(db, seed_packages[k], strlen(seed_packages[k]));
+
+        if (pkg != APT_NONE) state[pkg] = APT_MANUAL;
+    }
+    plan_free(&plan);
+    return state;
+}
+
+// ---------------------------------------------------------------------
+// Output helpers
+
+// apt's SizeToStr(): three significant digits, SI units; callers append "B"
+static void size_str(double size, char* buf, size_t len) {
+    static const char units[] = " kMGTPE";
+    int i;
+
+    for (i = 0; units[i + 1]; i++) {
+        if (size < 100 && i != 0) {
+            snprintf(buf, len, "%.1f %c", size, units[i]);
+            return;
+        }
+        if (size < 10000) break;
+        size /= 1000;
+    }
+    snprintf(buf, len, "%.0f %c", size, units[i]);
+}
+
+static void print_str(const apt_db_t* db, apt_str_t s) {
+    con_write(str_at(db, s), s.len);
+}
+
+// "  a b c" wrapped at 80 columns, as apt lists package names
+static void print_names(const apt_db_t* db, const uint32_t* pkgs, uint32_t n, const char* suffix) {
+    size_t col = 0;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        apt_str_t name = db->pkgs[pkgs[i]].name;
+        size_t w = name.len + strlen(suffix) + 1;
+
+        if (col == 0 || col + w > 79) {
+            if (col) con_write("\n", 1);
+            con_write(" ", 1);
+            col = 1;
+        }
+        con_write(" ", 1);
+        print_str(db, name);
+        con_printf("%s", suffix);
+        col += w;
+    }
+    if (col) con_write("\n", 1);
+}
+
+static void sort_by_name(const apt_db_t* db, uint32_t* pkgs, uint32_t n) {
+    qsort_r(pkgs, n, sizeof(uint32_t), compare_names, (void*)db);
+}
+
+static void print_reading(void) {
+    con_printf("Reading package lists... Done\n");
+    con_printf("Building dependency tree... Done\n");
+    con_printf("Reading state information... Done\n");
+}
+
+static void print_summary(uint32_t installed, uint32_t removed) {
+    con_printf("0 upgraded, %u newly installed, %u to remove and 0 not upgraded.\n", installed, removed);
+}
+
+// What dpkg reports as its database size
+static unsigned long database_files(const apt_db_t* db, const uint8_t* state) {
+    unsigned long files = 0;
+    uint32_t i;
+
+    for (i = 0; i < db->n_pkgs; i++) {
+        if (INSTALLED(state[i])) files += 12 + db->pkgs[i].installed_kb / 24;
+    }
+    return files;
+}
+
+static void print_triggers(const apt_db_t* db, const uint8_t* state, const uint32_t* pkgs, uint32_t n) {
+    static const char* const triggers[] = { "man-db", "libc-bin" };
+    size_t t;
+    uint32_t i;
+
+    for (t = 0; t < sizeof(triggers) / sizeof(triggers[0]); t++) {
+        uint32_t pkg = apt_db_find(db, triggers[t], strlen(triggers[t]));
+        int fire = t == 0;
+
+        if (pkg == APT_NONE || !INSTALLED(state[pkg])) continue;
+        // libc-bin rebuilds the linker cache when libraries change
+        for (i = 0; i < n && !fire; i++) fire = strncmp(str_at(db, db->pkgs[pkgs[i]].name), "lib", 3) == 0;
+        if (!fire || n == 0) continue;
+        con_printf("Processing triggers for %s (", triggers[t]);
+        print_str(db, db->pkgs[pkg].version);
+        con_printf(") ...\n");
+    }
+}
+
+// Archive file names leave out the epoch
+static void print_file_version(const apt_db_t* db, apt_str_t version) {
+    const char* v = str_at(db, version);
+    const char* colon = memchr(v, ':', version.len);
+
+    if (colon) {
+        version.len -= (uint32_t)(colon + 1 - v);
+        version.off += (uint32_t)(colon + 1 - v);
+    }
+    print_str(db, version);
+}
+
+// "name (version)"
+static void print_name_version(const apt_db_t* db, uint32_t pkg) {
+    print_str(db, db->pkgs[pkg].name);
+    con_printf(" (");
+    print_str(db, db->pkgs[pkg].version);
+    con_printf(")");
+}
+
+static int need_root(void) {
+    if (sim_env()->euid == 0) return 0;
+    con_printf("E: Could not open lock file /var/lib/dpkg/lock-frontend - open (13: Permission denied)\n");
+    con_printf("E: Unable to acquire the dpkg frontend lock (/var/lib/dpkg/lock-frontend), are you root?\n");
+    return 100;
+}
+
+static uint8_t* session_state(const apt_db_t* db) {
+    sim_env_t* env = sim_env();
+
+    if (!env->apt_state) env->apt_state = apt_state_new(db);
+    return env->apt_state;
+}
+
+// ---------------------------------------------------------------------
+// apt install / remove / purge / autoremove
+
+typedef struct {
+    int assume_yes;
+    int purge;
+    int recommends;
+} apt_flags_t;
+
+static void print_unmet(const plan_t* plan) {
+    const apt_db_t* db = plan->db;
+    const apt_dep_t* d = &db->deps[plan->broken_dep];
+
+    con_printf("Some packages could not be installed. This may mean that you have\n");
+    con_printf("requested an impossible situation or if you are using the unstable\n");
+    con_printf("distribution that some required packages have not yet been created\n");
+    con_printf("or been moved out of Incoming.\n");
+    con_printf("The following information may help to resolve the situation:\n\n");
+    con_printf("The following packages have unmet dependencies:\n ");
+    print_str(db, db->pkgs[plan->broken_pkg].name);
+    con_printf(" : %s: ", dep_labels[d->kind]);
+    print_str(db, d->name);
+    con_printf(" but it is not installable\n");
+    con_printf("E: Unable to correct problems, you have held broken packages.\n");
+}
+
+static int cmd_install(const apt_db_t* db, int n_names, char** names, const apt_flags_t* flags) {
+    uint8_t* state = session_state(db);
+    uint32_t* requested = malloc((size_t)(n_names ? n_names : 1) * sizeof(uint32_t));
+    uint32_t* extra = malloc(db->n_pkgs * sizeof(uint32_t) + sizeof(uint32_t));
+    uint32_t n_requested = 0, n_extra = 0, i, j;
+    uint64_t download = 0, disk_kb = 0;
+    unsigned long files;
+    char size[32];
+    plan_t plan;
+    int status = 0;
+
+    plan_init(&plan, db, state);
+    plan.recommends = flags->recommends;
+    print_reading();
+    for (i = 0; i < (uint32_t)n_names; i++) {
+        uint32_t pkg = apt_db_find(db, names[i], strlen(names[i]));
+
+        if (pkg == APT_NONE) {
+            pkg = find_provider(db, names[i], strlen(names[i]));
+            if (pkg == APT_NONE) {
+                con_printf("E: Unable to locate package %s\n", names[i]);
+                status = 100;
+                goto done;
+            }
+            con_printf("Note, selecting '");
+            print_str(db, db->pkgs[pkg].name);
+            con_printf("' instead of '%s'\n", names[i]);
+        }
+        requested[n_requested++] = pkg;
+    }
+
+    for (i = 0; i < n_requested; i++) {
+        uint32_t pkg = requested[i];
+
+        if (INSTALLED(state[pkg])) {
+            print_str(db, db->pkgs[pkg].name);
+            con_printf(" is already the newest version (");
+            print_str(db, db->pkgs[pkg].version);
+            con_printf(").\n");
+            if (state[pkg] == APT_AUTO) {
+                state[pkg] = APT_MANUAL;
+                print_str(db, db->pkgs[pkg].name);
+                con_printf(" set to manually installed.\n");
+            }
+        } else if (plan_install(&plan, pkg) < 0) {
+            print_unmet(&plan);
+            status = 100;
+            goto done;
+        }
+    }
+
+    // Additional = pulled in; Suggested = mentioned, not installed
+    for (i = 0; i < plan.n; i++) {
+        uint32_t pkg = plan.list[i];
+
+        for (j = 0; j < n_requested && requested[j] != pkg; j++) {
+        }
+        if (j == n_requested) extra[n_extra++] = pkg;
+        download += db->pkgs[pkg].size;
+        disk_kb += db->pkgs[pkg].installed_kb;
+    }
+    if (n_extra) {
+        sort_by_name(db, extra, n_extra);
+        con_printf("The following additional packages will be installed:\n");
+        print_names(db, extra, n_extra, "");
+    }
+    n_extra = 0;
+    for (i = 0; i < plan.n; i++) {
+        const apt_pkg_t* p = &db->pkgs[plan.list[i]];
+
+        for (j = p->first_dep; j < p->first_dep + p->n_deps; j++) {
+            const apt_dep_t* d = &db->deps[j];
+
+            if ((d->kind == APT_DEP_SUGGESTS || (d->kind == APT_DEP_RECOMMENDS && !plan.recommends)) &&
+                d->target != APT_NONE && !present(&plan, d->target) && plan.mark[d->target] != MARK_KEEP) {
+                plan.mark[d->target] = MARK_KEEP;
+                extra[n_extra++] = d->target;
+            }
+        }
+    }
+    if (n_extra) {
+        sort_by_name(db, extra, n_extra);
+        con_printf("%s packages:\n", plan.recommends ? "Suggested" : "Recommended");
+        print_names(db, extra, n_extra, "");
+    }
+    if (plan.n == 0) {
+        print_summary(0, 0);
+        goto done;
+    }
+
+    memcpy(extra, plan.list, plan.n * sizeof(uint32_t));
+    sort_by_name(db, extra, plan.n);
+    con_printf("The following NEW packages will be installed:\n");
+    print_names(db, extra, plan.n, "");
+    print_summary(plan.n, 0);
+    size_str((double)download, size, sizeof(size));
+    con_printf("Need to get %sB of archives.\n", size);
+    size_str((double)disk_kb * 1024, size, sizeof(size));
+    con_printf("After this operation, %sB of additional disk space will be used.\n", size);
+    if (plan.n > n_requested && !flags->assume_yes) con_printf("Do you want to continue? [Y/n] Y\n");
+
+    for (i = 0; i < plan.n; i++) {
+        const apt_pkg_t* p = &db->pkgs[plan.list[i]];
+
+        size_str((double)p->size, size, sizeof(size));
+        con_printf("Get:%u http://deb.debian.org/debian bookworm/main ", i + 1);
+        print_str(db, p->arch);
+        con_printf(" ");
+        print_str(db, p->name);
+        con_printf(" ");
+        print_str(db, p->arch);
+        con_printf(" ");
+        print_str(db, p->version);
+        con_printf(" [%sB]\n", size);
+    }
+    size_str((double)download, size, sizeof(size));
+    con_printf("Fetched %sB in %us (", size, (unsigned)(1 + download / 25000000));
+    size_str((double)download / (double)(1 + download / 25000000), size, sizeof(size));
+    con_printf("%sB/s)\n", size);
+
+    files = database_files(db, state);
+    for (i = 0; i < plan.n; i++) {
+        const apt_pkg_t* p = &db->pkgs[plan.list[i]];
+
+        con_printf("Selecting previously unselected package ");
+        print_str(db, p->name);
+        con_printf(".\n");
+        if (i == 0) con_printf("(Reading database ... %lu files and directories currently installed.)\n", files);
+        con_printf("Preparing to unpack .../");
+        print_str(db, p->name);
+        con_printf("_");
+        print_file_version(db, p->version);
+        con_printf("_");
+        print_str(db, p->arch);
+        con_printf(".deb ...\nUnpacking ");
+        print_name_version(db, plan.list[i]);
+        con_printf(" ...\n");
+    }
+    for (i = 0; i < plan.n; i++) {
+        con_printf("Setting up ");
+        print_name_version(db, plan.list[i]);
+        con_printf(" ...\n");
+    }
+    for (i = 0; i < plan.n; i++) state[plan.list[i]] = APT_AUTO;
+    for (i = 0; i < n_requested; i++) state[requested[i]] = APT_MANUAL;
+    print_triggers(db, state, plan.list, plan.n);
+
+done:
+    plan_free(&plan);
+    free(requested);
+    free(extra);
+    return status;
+}
+
+// Remove (or purge) the marked packages in plan, after the usual report
+static int run_removal(const apt_db_t* db, uint8_t* state, plan_t* plan, const apt_flags_t* flags, int hint_autoremove) {
+    uint32_t* names = malloc(db->n_pkgs * sizeof(uint32_t) + sizeof(uint32_t));
+    uint32_t i, n_unneeded, n_removing = 0;
+    uint64_t freed_kb = 0;
+    unsigned long files;
+    char size[32];
+
+    for (i = 0; i < plan->n; i++) {
+        const apt_pkg_t* p = &db->pkgs[plan->list[i]];
+
+        if (p->essential) {
+            con_printf("E: Removing essential system-critical packages is not permitted. This might break the system.\n");
+            free(names);
+            return 100;
+        }
+    }
+
+    if (hint_autoremove) {
+        n_unneeded = find_unneeded(plan, names);
+        if (n_unneeded) {
+            con_printf("The following packages were automatically installed and are no longer required:\n");
+            print_names(db, names, n_unneeded, "");
+            con_printf("Use 'sudo apt autoremove' to remove %s.\n", n_unneeded == 1 ? "it" : "them");
+        }
+    }
+    if (plan->n == 0) {
+        print_summary(0, 0);
+        free(names);
+        return 0;
+    }
+
+    memcpy(names, plan->list, plan->n * sizeof(uint32_t));
+    sort_by_name(db, names, plan->n);
+    con_printf("The following packages will be REMOVED:\n");
+    print_names(db, names, plan->n, flags->purge ? "*" : "");
+    for (i = 0; i < plan->n; i++) {
+        if (INSTALLED(state[plan->list[i]])) {
+            freed_kb += db->pkgs[plan->list[i]].installed_kb;
+            n_removing++;
+        }
+    }
+    print_summary(0, plan->n);
+    if (n_removing) {
+        size_str((double)freed_kb * 1024, size, sizeof(size));
+        con_printf("After this operation, %sB disk space will be freed.\n", size);
+    }
+    if (!flags->assume_yes) con_printf("Do you want to continue? [Y/n] Y\n");
+
+    files = database_files(db, state);
+    con_printf("(Reading database ... %lu files and directories currently installed.)\n", files);
+    // Dependents were added to the plan after what they depend on and go first
+    for (i = plan->n; i-- > 0;) {
+        if (!INSTALLED(state[plan->list[i]])) continue;
+        con_printf("Removing ");
+        print_name_version(db, plan->list[i]);
+        con_printf(" ...\n");
+    }
+    if (flags->purge) {
+        for (i = plan->n; i-- > 0;) {
+            con_printf("Purging configuration files for ");
+            print_name_version(db, plan->list[i]);
+            con_printf(" ...\n");
+        }
+    }
+    for (i = 0; i < plan->n; i++) state[plan->list[i]] = flags->purge ? APT_NOT_INSTALLED : APT_CONFIG_FILES;
+    if (n_removing) print_triggers(db, state, plan->list, plan->n);
+    free(names);
+    return 0;
+}
+
+static int cmd_remove(const apt_db_t* db, int n_names, char** names, const apt_flags_t* flags) {
+    uint8_t* state = session_state(db);
+    plan_t plan;
+    int i, status;
+
+    plan_init(&plan, db, state);
+    print_reading();
+    for (i = 0; i < n_names; i++) {
+        uint32_t pkg = apt_db_find(db, names[i], strlen(names[i]));
+
+        if (pkg == APT_NONE) {
+            con_printf("E: Unable to locate package %s\n", names[i]);
+            plan_free(&plan);
+            return 100;
+        }
+        if (INSTALLED(state[pkg]) || (flags->purge && state[pkg] == APT_CONFIG_FILES)) {
+            if (!plan.mark[pkg]) {
+                plan.mark[pkg] = MARK_REMOVE;
+                plan.list[plan.n++] = pkg;
+            }
+        } else {
+            con_printf("Package '%s' is not installed, so not removed\n", names[i]);
+        }
+    }
+    plan_remove_closure(&plan);
+    status = run_removal(db, state, &plan, flags, 1);
+    plan_free(&plan);
+    return status;
+}
+
+static int cmd_autoremove(const apt_db_t* db, const apt_flags_t* flags) {
+    uint8_t* state = session_state(db);
+    plan_t plan;
+    uint32_t i;
+    int status;
+
+    plan_init(&plan, db, state);
+    print_reading();
+    plan.n = find_unneeded(&plan, plan.list);
+    for (i = 0; i < plan.n; i++) plan.mark[plan.list[i]] = MARK_REMOVE;
+    status = run_removal(db, state, &plan, flags, 0);
+    plan_free(&plan);
+    return status;
+}
+
+// ---------------------------------------------------------------------
+// Queries: search, show, depends, rdepends, list
+
+static void print_status_tag(uint8_t state) {
+    if (state == APT_MANUAL) con_printf(" [installed]");
+    if (state == APT_AUTO) con_printf(" [installed,automatic]");
+    if (state == APT_CONFIG_FILES) con_printf(" [residual-config]");
+}
+
+static int cmd_search(apt_db_t* db, int n_terms, char** terms, int cache_style) {
+    const uint8_t* state = session_state(db);
+    uint32_t* found;
+    uint32_t n, i;
+
+    if (n_terms == 0) {
+        con_printf("E: You must give at least one search pattern\n");
+        return 100;
+    }
+    found = malloc(db->n_pkgs * sizeof(uint32_t) + sizeof(uint32_t));
+    n = apt_db_search(db, (const char* const*)terms, n_terms, found);
+    if (!cache_style) con_printf("Sorting... Done\nFull Text Search... Done\n");
+    for (i = 0; i < n; i++) {
+        const apt_pkg_t* p = &db->pkgs[found[i]];
+
+        print_str(db, p->name);
+        if (cache_style) {
+            con_printf(" - ");
+            print_str(db, p->summary);
+            con_printf("\n");
+            continue;
+        }
+        con_printf("/stable ");
+        print_str(db, p->version);
+        con_printf(" ");
+        print_str(db, p->arch);
+        print_status_tag(state[found[i]]);
+        con_printf("\n  ");
+        print_str(db, p->summary);
+        con_printf("\n\n");
+    }
+    free(found);
+    return 0;
+}
+
+static void print_field(const apt_db_t* db, const char* label, apt_str_t value) {
+    if (!value.len) return;
+    con_printf("%s: ", label);
+    print_str(db, value);
+    con_printf("\n");
+}
+
+static int cmd_show(const apt_db_t* db, int n_names, char** names, int cache_style) {
+    const uint8_t* state = session_state(db);
+    int i, k, found = 0;
+    char size[32];
+
+    for (i = 0; i < n_names; i++) {
+        uint32_t pkg = apt_db_find(db, names[i], strlen(names[i]));
+        const apt_pkg_t* p;
+
+        if (pkg == APT_NONE) {
+            con_printf("N: Unable to locate package %s\n", names[i]);
+            continue;
+        }
+        p = &db->pkgs[pkg];
+        if (found++) con_printf("\n");
+        if (cache_style) {
+            // apt-cache prints the stanza as it is in the index
+            print_str(db, p->record);
+            con_printf("\n");
+            continue;
+        }
+        print_field(db, "Package", p->name);
+        print_field(db, "Version", p->version);
+        print_field(db, "Priority", p->priority);
+        if (p->essential) con_printf("Essential: yes\n");
+        print_field(db, "Section", p->section);
+        print_field(db, "Maintainer", p->maintainer);
+        size_str((double)p->installed_kb * 1024, size, sizeof(size));
+        con_printf("Installed-Size: %sB\n", size);
+        for (k = 0; k < APT_DEP_KINDS; k++) print_field(db, k == 0 ? "Pre-Depends" : dep_labels[k], p->field[k]);
+        print_field(db, "Homepage", p->homepage);
+        size_str((double)p->size, size, sizeof(size));
+        con_printf("Download-Size: %sB\n", size);
+        if (INSTALLED(state[pkg])) con_printf("APT-Manual-Installed: %s\n", state[pkg] == APT_MANUAL ? "yes" : "no");
+        con_printf("APT-Sources: http://deb.debian.org/debian bookworm/main amd64 Packages\n");
+        print_field(db, "Description", p->summary);
+        if (p->long_desc.len) {
+            print_str(db, p->long_desc);
+            con_printf("\n");
+        }
+    }
+    if (!found) {
+        con_printf("E: No packages found\n");
+        return 100;
+    }
+    if (!cache_style) con_printf("\n");
+    return 0;
+}
+
+static int cmd_depends(const apt_db_t* db, int n_names, char** names) {
+    int i, status = 0;
+    uint32_t j;
+
+    for (i = 0; i < n_names; i++) {
+        uint32_t pkg = apt_db_find(db, names[i], strlen(names[i]));
+        const apt_pkg_t* p;
+
+        if (pkg == APT_NONE) {
+            con_printf("E: No packages found\n");
+            status = 100;
+            continue;
+        }
+        p = &db->pkgs[pkg];
+        print_str(db, p->name);
+        con_printf("\n");
+        for (j = p->first_dep; j < p->first_dep + p->n_deps; j++) {
+            const apt_dep_t* d = &db->deps[j];
+
+            con_printf("  %s%s: ", d->or_next ? "|" : "", dep_labels[d->kind]);
+            if (d->target == APT_NONE || d->is_virtual) con_printf("<");
+            print_str(db, d->name);
+            if (d->target == APT_NONE || d->is_virtual) con_printf(">");
+            con_printf("\n");
+            // Only the provider resolution picks is known
+            if (d->is_virtual) {
+                con_printf("    ");
+                print_str(db, db->pkgs[d->target].name);
+                con_printf("\n");
+            }
+        }
+    }
+    return status;
+}
+
+static int cmd_rdepends(const apt_db_t* db, int n_names, char** names) {
+    int i, status = 0;
+    uint32_t j, n;
+
+    for (i = 0; i < n_names; i++) {
+        uint32_t pkg = apt_db_find(db, names[i], strlen(names[i]));
+        uint32_t* found;
+
+        if (pkg == APT_NONE) {
+            con_printf("E: No packages found\n");
+            status = 100;
+            continue;
+        }
+        found = malloc(db->pkgs[pkg].n_rdeps * sizeof(uint32_t) + sizeof(uint32_t));
+        n = apt_db_rdepends(db, pkg, found);
+        print_str(db, db->pkgs[pkg].name);
+        con_printf("\nReverse Depends:\n");
+        for (j = 0; j < n; j++) {
+            con_printf("  ");
+            print_str(db, db->pkgs[found[j]].name);
+            con_printf("\n");
+        }
+        free(found);
+    }
+    return status;
+}
+
+static int cmd_list(const apt_db_t* db, int n_patterns, char** patterns, int installed_only) {
+    const uint8_t* state = session_state(db);
+    char name[256];
+    uint32_t i;
+    int k;
+
+    con_printf("Listing... Done\n");
+    for (i = 0; i < db->n_pkgs; i++) {
+        uint32_t pkg = db->by_name[i];
+        const apt_pkg_t* p = &db->pkgs[pkg];
+
+        if (installed_only && !INSTALLED(state[pkg])) continue;
+        if (n_patterns) {
+            snprintf(name, sizeof(name), "%.*s", (int)p->name.len, str_at(db, p->name));
+            for (k = 0; k < n_patterns && fnmatch(patterns[k], name, 0) != 0; k++) {
+            }
+            if (k == n_patterns) continue;
+        }
+        print_str(db, p->name);
+        con_printf("/stable%s ", INSTALLED(state[pkg]) ? ",now" : "");
+        print_str(db, p->version);
+        con_printf(" ");
+        print_str(db, p->arch);
+        print_status_tag(state[pkg]);
+        con_printf("\n");
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Command front ends
+
+typedef enum {
+    FRONT_APT,
+    FRONT_APT_GET,
+    FRONT_APT_CACHE
+} front_t;
+
+static int run_front(int argc, char** argv, front_t front) {
+    apt_db_t* db = apt_db_shared();
+    apt_flags_t flags;
+    const char* sub;
+    char** args;
+    sim_opts_t o;
+    int n;
+
+    // No index to work from: the lesson's example output stands in
+    if (!db) return -1;
+    if (sim_getopt(argc, argv, "yqs", &o) < 0) return 100;
+    if (o.n_operands == 0) return -1;
+    memset(&flags, 0, sizeof(flags));
+    flags.assume_yes = SIM_HAS(&o, 'y') || sim_long_opt(&o, "yes") || sim_long_opt(&o, "assume-yes");
+    flags.purge = sim_long_opt(&o, "purge") != NULL;
+    flags.recommends = !sim_long_opt(&o, "no-install-recommends");
+    sub = argv[1];
+    args = argv + 2;
+    n = o.n_operands - 1;
+
+    if (front != FRONT_APT_GET) {
+        if (strcmp(sub, "search") == 0) return cmd_search(db, n, args, front == FRONT_APT_CACHE);
+        if (strcmp(sub, "show") == 0) return cmd_show(db, n, args, front == FRONT_APT_CACHE);
+        if (strcmp(sub, "depends") == 0) return cmd_depends(db, n, args);
+        if (strcmp(sub, "rdepends") == 0) return cmd_rdepends(db, n, args);
+    }
+    if (front == FRONT_APT && strcmp(sub, "list") == 0) {
+        // Upgrades need a second index to compare against
+        if (sim_long_opt(&o, "upgradable")) return -1;
+        return cmd_list(db, n, args, sim_long_opt(&o, "installed") != NULL);
+    }
+    if (front != FRONT_APT_CACHE) {
+        int root;
+
+        if (strcmp(sub, "install") == 0 || strcmp(sub, "remove") == 0 || strcmp(sub, "purge") == 0 ||
+            strcmp(sub, "autoremove") == 0) {
+            if ((root = need_root()) != 0) return root;
+        }
+        if (strcmp(sub, "install") == 0) return cmd_install(db, n, args, &flags);
+        if (strcmp(sub, "remove") == 0) return cmd_remove(db, n, args, &flags);
+        if (strcmp(sub, "purge") == 0) {
+            flags.purge = 1;
+            return cmd_remove(db, n, args, &flags);
+        }
+        if (strcmp(sub, "autoremove") == 0) return cmd_autoremove(db, &flags);
+    }
+    // update, upgrade, policy, ...
+    return -1;
+}
+
+int apt_cmd_apt(int argc, char** argv) {
+    return run_front(argc, argv, FRONT_APT);
+}
+
+int apt_cmd_apt_get(int argc, char** argv) {
+    return run_front(argc, argv, FRONT_APT_GET);
+}
+
+int apt_cmd_apt_cache(int argc, char** argv) {
+    return run_front(argc, argv, FRONT_APT_CACHE);
+}
+
+// ---------------------------------------------------------------------
+// dpkg -l
+
+static void print_rule(size_t width) {
+    while (width--) con_write("=", 1);
+}
+
+// What dpkg's database knows: installed packages and removed ones whose
+// configuration is left ("rc"), in name order, narrowed to the patterns
+static int cmd_dpkg_list(const apt_db_t* db, int n_patterns, char** patterns) {
+    const uint8_t* state = session_state(db);
+    uint32_t* shown = xrealloc(NULL, (db->n_pkgs ? db->n_pkgs : 1) * sizeof(uint32_t));
+    char* matched = calloc((size_t)n_patterns + 1, 1);
+    size_t w_name = 4, w_version = 7, w_arch = 12, used;
+    char name[256];
+    uint32_t i, n = 0;
+    int k, status = 0;
+
+    if (!matched) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = 0; i < db->n_pkgs; i++) {
+        uint32_t pkg = db->by_name[i];
+        const apt_pkg_t* p = &db->pkgs[pkg];
+        int any = !n_patterns;
+
+        if (state[pkg] == APT_NOT_INSTALLED) continue;
+        if (n_patterns) {
+            snprintf(name, sizeof(name), "%.*s", (int)p->name.len, str_at(db, p->name));
+            for (k = 0; k < n_patterns; k++) {
+                if (fnmatch(patterns[k], name, 0) == 0) any = matched[k] = 1;
+            }
+        }
+        if (!any) continue;
+        shown[n++] = pkg;
+        if (p->name.len > w_name) w_name = p->name.len;
+        if (p->version.len > w_version) w_version = p->version.len;
+        if (p->arch.len > w_arch) w_arch = p->arch.len;
+    }
+
+    if (n) {
+        con_printf("Desired=Unknown/Install/Remove/Purge/Hold\n"
+                   "| Status=Not/Inst/Conf-files/Unpacked/halF-conf/Half-inst/trig-aWait/Trig-pend\n"
+                   "|/ Err?=(none)/Reinst-required (Status,Err: uppercase=bad)\n");
+        con_printf("||/ %-*s %-*s %-*s Description\n", (int)w_name, "Name", (int)w_version, "Version",
+                   (int)w_arch, "Architecture");
+        con_printf("+++-");
+        print_rule(w_name);
+        con_printf("-");
+        print_rule(w_version);
+        con_printf("-");
+        print_rule(w_arch);
+        con_printf("-");
+        used = 4 + w_name + 1 + w_version + 1 + w_arch + 1;
+        print_rule(used + 11 < 80 ? 80 - used : 11);
+        con_printf("\n");
+    }
+    for (i = 0; i < n; i++) {
+        const apt_pkg_t* p = &db->pkgs[shown[i]];
+
+        con_printf("%s  %-*.*s %-*.*s %-*.*s ", state[shown[i]] == APT_CONFIG_FILES ? "rc" : "ii", (int)w_name,
+                   (int)p->name.len, str_at(db, p->name), (int)w_version, (int)p->version.len,
+                   str_at(db, p->version), (int)w_arch, (int)p->arch.len, str_at(db, p->arch));
+        print_str(db, p->summary);
+        con_printf("\n");
+    }
+    for (k = 0; k < n_patterns; k++) {
+        if (matched[k]) continue;
+        con_printf("dpkg-query: no packages found matching %s\n", patterns[k]);
+        status = 1;
+    }
+    free(matched);
+    free(shown);
+    return status;
+}
+
+int apt_cmd_dpkg(int argc, char** argv) {
+    apt_db_t* db = apt_db_shared();
+    sim_opts_t o;
+
+    // Only the listing; -s, -L, -i and the rest keep the lesson's output
+    if (!db || argc < 2 || (strcmp(argv[1], "-l") != 0 && strcmp(argv[1], "--list") != 0)) return -1;
+    if (sim_getopt(argc, argv, "l", &o) < 0) return 2;
+    return cmd_dpkg_list(db, o.n_operands, argv + 1);
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+static uint64_t bench_rng = 88172645463325252ull;
+
+static const char* const bench_words[] = {
+    "library", "runtime", "tool", "server", "client", "data", "files", "module", "python", "perl",
+    "documentation", "development", "network", "graphics", "font", "audio", "video", "kernel", "shell",
+    "editor", "compression", "database", "web", "mail", "desktop", "plugin", "bindings", "utility",
+};
+
+// A Packages file shaped like bookworm main: deep library stacks that
+// most packages end up depending on, ~1.3 kB per stanza
+static int write_bench_index(const char* path, uint32_t count) {
+    FILE* f = fopen(path, "w");
+    uint32_t i, d, w;
+
+    if (!f) return -1;
+    for (i = 0; i < count; i++) {
+        uint32_t n_deps = i ? 1 + bench_random(&bench_rng, i < 8 ? i : 8) : 0;
+
+        fprintf(f, "Package: %s%u\nVersion: %u.%u-%u\nInstalled-Size: %u\n", i < count / 3 ? "lib" : "pkg", i,
+                1 + bench_random(&bench_rng, 9), bench_random(&bench_rng, 40), 1 + bench_random(&bench_rng, 5), 10 + bench_random(&bench_rng, 20000));
+        fprintf(f, "Maintainer: Debian Bench Team <bench%u@lists.debian.org>\nArchitecture: amd64\n", bench_random(&bench_rng, 400));
+        if (i % 50 == 7) fprintf(f, "Provides: virtual%u\n", i % 1000);
+        if (n_deps) {
+            fprintf(f, "Depends: ");
+            for (d = 0; d < n_deps; d++) {
+                // Skewed towards low indexes, like libc6 and friends
+                uint32_t r = bench_random(&bench_rng, 1000), target = (uint32_t)((uint64_t)i * r / 1000 * r / 1000);
+
+                fprintf(f, "%s%s%u (>= %u.%u)", d ? ", " : "", target < count / 3 ? "lib" : "pkg", target,
+                        bench_random(&bench_rng, 9), bench_random(&bench_rng, 40));
+                if (bench_random(&bench_rng, 20) == 0) fprintf(f, " | virtual%u", bench_random(&bench_rng, 1000));
+            }
+            fprintf(f, "\n");
+        }
+        if (i > 10 && bench_random(&bench_rng, 3) == 0) {
+            uint32_t target = i / 2 + bench_random(&bench_rng, i / 2);
+
+            fprintf(f, "Recommends: %s%u\n", target < count / 3 ? "lib" : "pkg", target);
+        }
+        if (i > 10 && bench_random(&bench_rng, 3) == 0) fprintf(f, "Suggests: pkg%u, lib%u\n", count / 3 + bench_random(&bench_rng, count - count / 3), bench_random(&bench_rng, count / 3));
+        fprintf(f, "Description: %s %s for %s\n", bench_words[bench_random(&bench_rng, 28)], bench_words[bench_random(&bench_rng, 28)],
+                bench_words[bench_random(&bench_rng, 28)]);
+        for (d = 0; d < 3 + bench_random(&bench_rng, 6); d++) {
+            fprintf(f, " ");
+            for (w = 0; w < 11; w++) fprintf(f, " %s", bench_words[bench_random(&bench_rng, 28)]);
+            fprintf(f, "\n");
+        }
+        fprintf(f, "Homepage: https://example.org/%u\nSection: misc\nPriority: %s\n", i, i < 40 ? "required" : "optional");
+        fprintf(f, "Filename: pool/main/p/pkg%u/pkg%u_1.0-1_amd64.deb\nSize: %u\n", i, i, 1000 + bench_random(&bench_rng, 2000000));
+        fprintf(f, "SHA256: %016llx%016llx%016llx%016llx\n\n", (unsigned long long)bench_rng, (unsigned long long)bench_rng * 3,
+                (unsigned long long)bench_rng * 5, (unsigned long long)bench_rng * 7);
+    }
+    return fclose(f);
+}
+
+int apt_bench(int argc, char** argv) {
+    const char* path = "/tmp/deb1-bench-Packages";
+    static const char* const queries[][2] = {
+        { "htop", NULL }, { "python", "bindings" }, { "server", "mail" }, { "pkg5999", NULL },
+    };
+    char err[256], name[32];
+    uint32_t *out, i, n = 0, hub = 0, best = 0;
+    double start, elapsed, planned = 0;
+    uint8_t* state;
+    apt_db_t* db;
+    plan_t plan;
+    int q, reps;
+
+    if (argc > 0 && access(argv[0], R_OK) == 0) {
+        path = argv[0];
+    } else {
+        long count = argc > 0 ? atol(argv[0]) : 60000;
+
+        if (count < 100) count = 100;
+        if (write_bench_index(path, (uint32_t)count) < 0) {
+            perror(path);
+            return 1;
+        }
+    }
+
+    start = bench_now();
+    db = apt_db_open(path, err, sizeof(err));
+    elapsed = bench_now() - start;
+    if (!db) {
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    }
+    bench_report("apt", "packages", db->n_pkgs, "count");
+    bench_report("apt", "index_mb", db->map_len / 1e6, "MB");
+    bench_report("apt", "load", elapsed * 1e3, "ms");
+    bench_report("apt", "memory_per_package", (double)apt_db_memory_used(db) / (db->n_pkgs ? db->n_pkgs : 1), "bytes");
+
+    out = malloc((db->n_pkgs + 1) * sizeof(uint32_t));
+    reps = 20;
+    start = bench_now();
+    n += apt_db_search(db, queries[0], 1, out);
+    elapsed = bench_now() - start;
+    bench_report("apt", "search_first", elapsed * 1e3, "ms");
+
+    start = bench_now();
+    for (i = 0; i < (uint32_t)reps; i++) {
+        q = (int)(i % (sizeof(queries) / sizeof(queries[0])));
+        n += apt_db_search(db, queries[q], queries[q][1] ? 2 : 1, out);
+    }
+    elapsed = bench_now() - start;
+    bench_report("apt", "search", elapsed / reps * 1e3, "ms");
+
+    // rdepends of the most depended-on package (libc6 in a real archive)
+    for (i = 0; i < db->n_pkgs; i++) {
+        if (db->pkgs[i].n_rdeps > best) {
+            best = db->pkgs[i].n_rdeps;
+            hub = i;
+        }
+    }
+    start = bench_now();
+    for (i = 0; i < (uint32_t)reps; i++) n += apt_db_rdepends(db, hub, out);
+    elapsed = bench_now() - start;
+    bench_report("apt", "rdepends_max", elapsed / reps * 1e3, "ms");
+    bench_report("apt", "rdepends_max_count", best, "packages");
+
+    // A session's first apt command: seed the installed state
+    start = bench_now();
+    state = apt_state_new(db);
+    elapsed = bench_now() - start;
+    bench_report("apt", "state_seed", elapsed * 1e3, "ms");
+
+    // Install plans for packages from the top of the dependency stacks
+    start = bench_now();
+    for (i = 0; i < (uint32_t)reps; i++) {
+        uint32_t pkg;
+
+        snprintf(name, sizeof(name), "pkg%u", db->n_pkgs - 1 - i);
+        pkg = apt_db_find(db, name, strlen(name));
+        plan_init(&plan, db, state);
+        if (pkg != APT_NONE) plan_install(&plan, pkg);
+        planned += plan.n;
+        plan_free(&plan);
+    }
+    elapsed = bench_now() - start;
+    bench_report("apt", "install_plan", elapsed / reps * 1e3, "ms");
+    bench_report("apt", "install_plan_size", (double)planned / reps, "packages");
+
+    start = bench_now();
+    plan_init(&plan, db, state);
+    n += find_unneeded(&plan, out);
+    plan_free(&plan);
+    elapsed = bench_now() - start;
+    bench_report("apt", "autoremove_scan", elapsed * 1e3, "ms");
+
+    if (n == 0) fprintf(stderr, "apt bench: nothing matched\n");
+    free(state);
+    free(out);
+    apt_db_close(db);
+    return 0;
+}
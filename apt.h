@@ -0,0 +1,127 @@
+#ifndef APT_H
+#define APT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// APT package index for simulation mode.
+//
+// A Debian "Packages" file is memory-mapped read-only and parsed in one
+// pass into a table of packages whose fields are (offset, length) slices
+// of the mapping, so nothing but the index structures is copied. Names
+// are found through an open-addressing hash; dependencies are resolved
+// once at load time into a flat array of package indexes, and the
+// reverse dependencies are the same edges regrouped by target (counted,
+// then filled), so both apt depends and apt rdepends are a walk over a
+// contiguous range. The index is shared by every session; what a session
+// has installed is one state byte per package in its simulated machine.
+
+#define APT_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t off, len;
+} apt_str_t;
+
+typedef enum {
+    APT_DEP_PRE_DEPENDS,
+    APT_DEP_DEPENDS,
+    APT_DEP_RECOMMENDS,
+    APT_DEP_SUGGESTS,
+    APT_DEP_BREAKS,
+    APT_DEP_CONFLICTS,
+    APT_DEP_KINDS
+} apt_dep_kind_t;
+
+typedef struct {
+    uint32_t target;        // package index, APT_NONE if nothing has the name
+    apt_str_t name;         // as written in the field
+    uint8_t kind;
+    uint8_t or_next;        // "a | b": the next entry is an alternative
+    uint8_t is_virtual;     // target is a package that Provides the name
+    uint8_t pad;
+} apt_dep_t;
+
+typedef struct {
+    apt_str_t name;         // virtual package name
+    uint32_t pkg;           // first package in the file that Provides it
+} apt_provide_t;
+
+typedef struct {
+    apt_str_t record;       // the whole stanza, for apt-cache show
+    apt_str_t name, version, arch, section, priority, maintainer, homepage;
+    apt_str_t summary;      // first line of Description
+    apt_str_t long_desc;    // continuation lines, as in the file
+    apt_str_t field[APT_DEP_KINDS];     // raw relationship fields for apt show
+    uint32_t installed_kb;
+    uint32_t size;          // .deb size in bytes
+    uint32_t first_dep, n_deps;
+    uint32_t first_rdep, n_rdeps;
+    uint8_t essential;
+    uint8_t important;      // Priority: required or important
+} apt_pkg_t;
+
+typedef struct {
+    const char* map;        // the Packages file
+    size_t map_len;
+
+    apt_pkg_t* pkgs;
+    uint32_t n_pkgs;
+    apt_dep_t* deps;
+    uint32_t n_deps;
+    uint32_t* rdeps;        // depending package per edge, grouped by target
+    uint32_t* by_name;      // package indexes in name order
+
+    uint32_t* hash;         // index + 1, 0 = empty
+    uint32_t hash_mask;
+    apt_provide_t* provides;    // open addressing too; names no package has
+    uint32_t provides_mask;
+
+    // Built by the first search: name, summary and description of every
+    // package in name order, lower-cased and NUL-separated
+    char* search_text;
+    uint32_t* search_off;   // by_name position -> start in search_text
+} apt_db_t;
+
+// Map and index a Packages file. Returns NULL and a message on failure.
+apt_db_t* apt_db_open(const char* path, char* err, size_t err_len);
+void apt_db_close(apt_db_t* db);
+size_t apt_db_memory_used(const apt_db_t* db);
+
+// The index simulation mode uses: $DEB1_APT_INDEX, the host's bookworm
+// main list, then the bundled lessons/Packages. Opened on first use;
+// NULL when none can be read.
+apt_db_t* apt_db_shared(void);
+
+// Package index by name, or APT_NONE
+uint32_t apt_db_find(const apt_db_t* db, const char* name, size_t len);
+
+// Packages whose name or description contains every term (case
+// insensitive), in name order. out must hold n_pkgs entries.
+uint32_t apt_db_search(apt_db_t* db, const char* const* terms, int n_terms, uint32_t* out);
+
+// Distinct packages with a dependency on pkg, in reverse name order as
+// apt-cache prints them. out must hold n_rdeps entries.
+uint32_t apt_db_rdepends(const apt_db_t* db, uint32_t pkg, uint32_t* out);
+
+// Per-session installed state, one byte per package
+typedef enum {
+    APT_NOT_INSTALLED,
+    APT_CONFIG_FILES,       // removed, configuration left behind ("rc")
+    APT_AUTO,               // installed as a dependency
+    APT_MANUAL
+} apt_state_t;
+
+// The seeded server: required and important packages, a few services and
+// whatever they depend on
+uint8_t* apt_state_new(const apt_db_t* db);
+
+// Simulated commands (see sim.c)
+int apt_cmd_apt(int argc, char** argv);
+int apt_cmd_apt_get(int argc, char** argv);
+int apt_cmd_apt_cache(int argc, char** argv);
+int apt_cmd_dpkg(int argc, char** argv);     // dpkg -l
+
+// --bench apt [packages | Packages-file]
+int apt_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "deb1.h"
+#include "console.h"
+#include "session.h"
+#include "batch.h"
+#include "bench.h"
+#include "util.h"
+
+// A step is everything the tutor does between two reads of a choice:
+// handling the previous choice and rendering the next screen.
+typedef struct {
+    double* samples;
+    size_t count, cap;
+    double last;
+} step_timer_t;
+
+static void record_step(step_timer_t* t, double now) {
+    if (t->last > 0) {
+        if (t->count == t->cap) {
+            t->cap = t->cap ? t->cap * 2 : 4096;
+            t->samples = realloc(t->samples, t->cap * sizeof(double));
+            if (!t->samples) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        t->samples[t->count++] = now - t->last;
+    }
+    t->last = now;
+}
+
+static void on_input(void* ctx) {
+    record_step(ctx, bench_now());
+}
+
+static double percentile(const step_timer_t* t, double p) {
+    size_t i;
+
+    if (t->count == 0) return 0;
+    i = (size_t)(p * (double)(t->count - 1) + 0.5);
+    return t->samples[i];
+}
+
+static char* read_script(const char* path, size_t* len) {
+    FILE* fp = fopen(path, "rb");
+    char* data = NULL;
+    size_t cap = 0, n;
+
+    if (!fp) return NULL;
+    *len = 0;
+    do {
+        if (*len + 4096 > cap) {
+            cap = cap ? cap * 2 : 8192;
+            data = realloc(data, cap);
+            if (!data) break;
+        }
+        n = fread(data + *len, 1, cap - *len, fp);
+        *len += n;
+    } while (n > 0);
+    fclose(fp);
+    return data;
+}
+
+int batch_run(const char* script_path, int sessions, const char* output_path) {
+    step_timer_t timer = { 0 };
+    console_t con;
+    size_t script_len;
+    char* script;
+    double start, elapsed;
+    int s;
+
+    script = read_script(script_path, &script_len);
+    if (!script) {
+        fprintf(stderr, "%s: cannot read batch script\n", script_path);
+        return 1;
+    }
+    if (sessions < 1) sessions = 1;
+
+    memset(&con, 0, sizeof(con));
+    con.out_fd = -1;
+    if (output_path) {
+        con.out_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (con.out_fd < 0) {
+            perror(output_path);
+            free(script);
+            return 1;
+        }
+    }
+    con.echo_input = 1;
+    con.script = script;
+    con.script_len = script_len;
+    con.on_input = on_input;
+    con.on_input_ctx = &timer;
+    console_use(&con);
+
+    start = bench_now();
+    for (s = 0; s < sessions; s++) {
+        memset(&sys_config, 0, sizeof(sys_config));
+        con.script_pos = 0;
+        timer.last = bench_now();
+        run_session();
+        record_step(&timer, bench_now());
+        timer.last = 0;
+    }
+    con_flush();
+    elapsed = bench_now() - start;
+
+    console_use(NULL);
+    console_free(&con);
+    if (con.out_fd >= 0) close(con.out_fd);
+    free(script);
+
+    qsort(timer.samples, timer.count, sizeof(double), compare_double);
+    bench_report("batch", "sessions", sessions, "count");
+    bench_report("batch", "steps", (double)timer.count, "count");
+    bench_report("batch", "elapsed", elapsed, "s");
+    bench_report("batch", "sessions_per_sec", sessions / elapsed, "sessions/s");
+    bench_report("batch", "step_p50", percentile(&timer, 0.50) * 1e6, "us");
+    bench_report("batch", "step_p90", percentile(&timer, 0.90) * 1e6, "us");
+    bench_report("batch", "step_p99", percentile(&timer, 0.99) * 1e6, "us");
+    bench_report("batch", "step_max", percentile(&timer, 1.0) * 1e6, "us");
+    bench_report("batch", "output_per_session", (double)con.bytes_written / sessions, "bytes");
+    free(timer.samples);
+    return 0;
+}
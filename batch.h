@@ -0,0 +1,9 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Headless mode: replay a script of menu choices as `sessions` learner
+// sessions with no clear-screen, colour or pauses, and report throughput
+// and per-step latency. Output is discarded unless output_path is given.
+int batch_run(const char* script_path, int sessions, const char* output_path);
+
+#endif
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "bench.h"
+
+#define MAX_RESULTS 256
+
+// Results so far, for bench_check()
+static struct {
+    char suite[32];
+    char metric[64];
+    double value;
+} results[MAX_RESULTS];
+static int n_results;
+
+double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint32_t bench_random(uint64_t* state, uint32_t n) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (uint32_t)(*state % n);
+}
+
+void bench_report(const char* suite, const char* metric, double value, const char* unit) {
+    const char* json = getenv("DEB1_BENCH_JSON");
+
+    if (json && json[0] == '1') {
+        printf("{\"suite\":\"%s\",\"metric\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n",
+               suite, metric, value, unit);
+    } else {
+        printf("%-10s %-36s %14.4f %s\n", suite, metric, value, unit);
+    }
+    fflush(stdout);
+
+    if (n_results < MAX_RESULTS) {
+        snprintf(results[n_results].suite, sizeof(results[n_results].suite), "%s", suite);
+        snprintf(results[n_results].metric, sizeof(results[n_results].metric), "%s", metric);
+        results[n_results].value = value;
+        n_results++;
+    }
+}
+
+static int find_result(const char* suite, const char* metric) {
+    int i;
+
+    for (i = 0; i < n_results; i++) {
+        if (strcmp(results[i].suite, suite) == 0 && strcmp(results[i].metric, metric) == 0) return i;
+    }
+    return -1;
+}
+
+static int parse_baseline(const char* line, char* suite, char* metric, double* value) {
+    return sscanf(line, " {\"suite\":\"%31[^\"]\",\"metric\":\"%63[^\"]\",\"value\":%lf", suite, metric, value) == 3;
+}
+
+int bench_check(const char* baseline_path, double tolerance) {
+    FILE* fp = fopen(baseline_path, "r");
+    char line[512], ref_suite[32] = "";
+    double speed = 1;       // how much longer the reference takes now
+    int regressions = 0;
+
+    if (!fp) return -errno;
+    // The machine's speed first, from the reference line wherever it is
+    while (fgets(line, sizeof(line), fp)) {
+        char suite[32], metric[64];
+        double base;
+        int i;
+
+        if (!parse_baseline(line, suite, metric, &base) || strcmp(metric, "reference") != 0) continue;
+        i = find_result(suite, metric);
+        if (i >= 0 && base > 0 && results[i].value > 0) {
+            speed = results[i].value / base;
+            snprintf(ref_suite, sizeof(ref_suite), "%s", suite);
+        }
+        break;
+    }
+    rewind(fp);
+
+    fprintf(stderr, "%-10s %-36s %12s %12s %8s\n", "suite", "metric", "baseline", "now", "change");
+    while (fgets(line, sizeof(line), fp)) {
+        char suite[32], metric[64];
+        double base, scaled;
+        int i;
+
+        if (!parse_baseline(line, suite, metric, &base)) continue;
+        i = find_result(suite, metric);
+        if (i < 0) {
+            fprintf(stderr, "%-10s %-36s %12.4g %12s %8s  MISSING\n", suite, metric, base, "-", "-");
+            regressions++;
+            continue;
+        }
+        if (strcmp(metric, "reference") == 0) {
+            fprintf(stderr, "%-10s %-36s %12.4g %12.4g %+7.1f%%  (the machine; baselines scaled by %.3f)\n", suite, metric,
+                    base, results[i].value, (speed - 1) * 100, speed);
+            continue;
+        }
+        scaled = strcmp(suite, ref_suite) == 0 ? base * speed : base;
+        fprintf(stderr, "%-10s %-36s %12.4g %12.4g %+7.1f%%%s\n", suite, metric, scaled, results[i].value,
+                scaled > 0 ? (results[i].value - scaled) / scaled * 100 : 0.0,
+                results[i].value > scaled * (1 + tolerance) ? "  REGRESSION" : "");
+        if (results[i].value > scaled * (1 + tolerance)) regressions++;
+    }
+    fclose(fp);
+    return regressions;
+}
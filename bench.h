@@ -0,0 +1,31 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// Tiny helpers shared by the --bench modes.
+// Results are printed one per line; with DEB1_BENCH_JSON=1 in the
+// environment they are emitted as JSON objects instead so that scripts
+// can collect them.
+
+double bench_now(void);
+
+// xorshift64: the same sequence from the same seed, so a suite's generated
+// workload is identical from run to run. A number in [0, n).
+uint32_t bench_random(uint64_t* state, uint32_t n);
+void bench_report(const char* suite, const char* metric, double value, const char* unit);
+
+// Compare what this process has reported against a baseline file of
+// DEB1_BENCH_JSON=1 lines. Every metric in the baseline is taken as a
+// cost, so one that grew by more than tolerance (0.10 = 10%), or that
+// was not reported, counts. A suite's "reference" metric is not gated:
+// it measures the machine, and the suite's other baselines are scaled by
+// how much it changed. Prints the comparison to stderr and returns the
+// number of regressions, or -errno if the baseline cannot be read.
+int bench_check(const char* baseline_path, double tolerance);
+
+// Entry point for a benchmark suite: argc/argv are the arguments that
+// follow "--bench <name>" on the command line.
+typedef int (*bench_fn_t)(int argc, char** argv);
+
+#endif
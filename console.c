@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include "deb1.h"
+#include "console.h"
+#include "render.h"
+
+#define CONSOLE_FLUSH_AT 65536
+
+static console_t stdio_console;
+static int stdio_ready;
+static __thread console_t* current;
+
+void console_init_stdio(console_t* con) {
+    const char* term = getenv("TERM");
+    int terminal = isatty(STDOUT_FILENO) && !(term && strcmp(term, "dumb") == 0);
+
+    memset(con, 0, sizeof(*con));
+    con->out_fd = STDOUT_FILENO;
+    con->color = terminal && !getenv("NO_COLOR");
+    con->clear_screen = terminal;
+    con->pause = 1;
+    if (terminal) con->render = render_new(STDOUT_FILENO, 24, 80);
+}
+
+void console_free(console_t* con) {
+    con_flush();
+    free(con->buf);
+    con->buf = NULL;
+    con->len = con->cap = 0;
+    render_free(con->render);
+    con->render = NULL;
+}
+
+void console_use(console_t* con) {
+    current = con;
+}
+
+console_t* console_current(void) {
+    if (current) return current;
+    if (!stdio_ready) {
+        console_init_stdio(&stdio_console);
+        stdio_ready = 1;
+    }
+    return &stdio_console;
+}
+
+static void reserve(console_t* con, size_t extra) {
+    if (con->len + extra <= con->cap) return;
+    while (con->len + extra > con->cap) con->cap = con->cap ? con->cap * 2 : 4096;
+    con->buf = realloc(con->buf, con->cap);
+    if (!con->buf) {
+        perror("realloc");
+        exit(1);
+    }
+}
+
+// Drop CSI sequences ("\033[" params final-byte) from data[0..len)
+// into out; returns the number of bytes kept.
+static size_t strip_escapes(char* out, const char* data, size_t len) {
+    size_t i = 0, n = 0;
+
+    while (i < len) {
+        const char* esc = memchr(data + i, '\033', len - i);
+        size_t run = esc ? (size_t)(esc - (data + i)) : len - i;
+
+        memmove(out + n, data + i, run);
+        n += run;
+        i += run;
+        if (!esc) break;
+
+        i++;
+        if (i < len && data[i] == '[') {
+            i++;
+            while (i < len && (unsigned char)data[i] >= 0x20 && (unsigned char)data[i] < 0x40) i++;
+            if (i < len) i++;
+        }
+    }
+    return n;
+}
+
+static void append(console_t* con, const char* data, size_t len) {
+    size_t n = len;
+
+    if (con->sink) {
+        if (!con->sink_done && len && con->sink(con->sink_ctx, data, len)) con->sink_done = 1;
+        return;
+    }
+    reserve(con, len);
+    if (con->color) {
+        memcpy(con->buf + con->len, data, len);
+    } else {
+        n = strip_escapes(con->buf + con->len, data, len);
+    }
+    // Part of a screen: the renderer keeps it until the flush
+    if (con->render && render_add(con->render, con->buf + con->len, n)) {
+        if (con->render->frame_len - con->render->flushed_len >= CONSOLE_FLUSH_AT && !con->capture) con_flush();
+        return;
+    }
+    con->len += n;
+    if (con->len >= CONSOLE_FLUSH_AT && !con->capture) con_flush();
+}
+
+void con_write(const char* data, size_t len) {
+    append(console_current(), data, len);
+}
+
+int con_stopped(void) {
+    return console_current()->sink_done;
+}
+
+void con_printf(const char* fmt, ...) {
+    console_t* con = console_current();
+    char small[1024];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+
+    if ((size_t)n < sizeof(small)) {
+        append(con, small, (size_t)n);
+    } else {
+        char* big = malloc((size_t)n + 1);
+        if (!big) return;
+        va_start(ap, fmt);
+        vsnprintf(big, (size_t)n + 1, fmt, ap);
+        va_end(ap);
+        append(con, big, (size_t)n);
+        free(big);
+    }
+}
+
+void con_clear_screen(void) {
+    console_t* con = console_current();
+
+    if (!con->clear_screen) return;
+    con->screens++;
+    if (con->render) {
+        render_begin(con->render);
+        return;
+    }
+    reserve(con, sizeof(CLEAR_SCREEN));
+    memcpy(con->buf + con->len, CLEAR_SCREEN, sizeof(CLEAR_SCREEN) - 1);
+    con->len += sizeof(CLEAR_SCREEN) - 1;
+}
+
+void con_flush(void) {
+    console_t* con = console_current();
+    size_t off = 0;
+
+    if (con->render) {
+        size_t n;
+        const char* update = render_update(con->render, &n);
+
+        reserve(con, n);
+        memcpy(con->buf + con->len, update, n);
+        con->len += n;
+    }
+    if (con->len) con->frames++;
+    if (con->out_fd < 0 || con->failed) {
+        con->bytes_written += con->len;
+        con->len = 0;
+        return;
+    }
+    while (off < con->len) {
+        ssize_t n = write(con->out_fd, con->buf + off, con->len - off);
+        con->write_calls++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                con->failed = 1;
+                off = con->len;
+            }
+            break;
+        }
+        off += (size_t)n;
+    }
+    con->bytes_written += off;
+    if (off && off < con->len) memmove(con->buf, con->buf + off, con->len - off);
+    con->len -= off;
+
+    if (con->len == 0 && con->release_idle) {
+        free(con->buf);
+        con->buf = NULL;
+        con->cap = 0;
+    }
+}
+
+void con_release_screen(void) {
+    console_t* con = console_current();
+
+    con_flush();
+    if (con->render) render_lost(con->render);
+}
+
+static int next_script_line(console_t* con, char* buf, size_t len) {
+    while (con->script_pos < con->script_len) {
+        const char* p = con->script + con->script_pos;
+        const char* end = con->script + con->script_len;
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        const char* stop = nl ? nl : end;
+        size_t n;
+
+        con->script_pos = (size_t)(stop - con->script) + (nl ? 1 : 0);
+
+        // Skip blanks and comments; one choice per line
+        while (p < stop && (*p == ' ' || *p == '\t')) p++;
+        while (stop > p && (stop[-1] == ' ' || stop[-1] == '\t' || stop[-1] == '\r')) stop--;
+        if (p == stop || *p == '#') continue;
+
+        n = (size_t)(stop - p);
+        if (n >= len) n = len - 1;
+        memcpy(buf, p, n);
+        buf[n] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+int con_read_line(char* buf, size_t len) {
+    console_t* con = console_current();
+    size_t n;
+
+    if (con->on_input) con->on_input(con->on_input_ctx);
+
+    if (con->script) {
+        if (!next_script_line(con, buf, len)) return 0;
+        if (con->echo_input) con_printf("%s\n", buf);
+        return 1;
+    }
+
+    con_flush();
+    if (fgets(buf, (int)len, stdin) == NULL) return 0;
+    n = strlen(buf);
+    if (n && buf[n - 1] == '\n') buf[n - 1] = '\0';
+    if (con->render) render_input(con->render, buf, strlen(buf));
+    return 1;
+}
@@ -0,0 +1,83 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stddef.h>
+
+struct render;
+
+// Where a session's screens go and where its choices come from.
+//
+// All lesson output is written through con_printf() into the current
+// console's buffer, which is flushed in one write when the session waits
+// for input. A console either reads choices from stdin or from a script
+// held in memory (batch mode), and can drop colour and clear-screen
+// sequences for non-terminal destinations. On a terminal, screens go
+// through a renderer that sends only what changed (see render.h).
+
+typedef struct {
+    int out_fd;             // destination, -1 discards output
+    int color;              // keep ANSI colour sequences
+    int clear_screen;       // emit clear-screen sequences
+    int pause;              // wait in press_enter_to_continue()
+    int echo_input;         // copy scripted choices into the output
+    int release_idle;       // free the buffer whenever it drains (server)
+    int failed;             // a write failed; the destination is gone
+    int capture;            // output goes down a pipeline (see pipeline.h)
+
+    // When set, writes go to sink instead of the buffer; a nonzero return
+    // means the reader has all it wants and sets sink_done
+    int (*sink)(void* ctx, const char* data, size_t len);
+    void* sink_ctx;
+    int sink_done;
+
+    // Pending output
+    char* buf;
+    size_t len, cap;
+
+    // Screens between clear-screens are diffed against the last one; NULL
+    // sends them whole
+    struct render* render;
+
+    // Scripted input; NULL reads stdin
+    const char* script;
+    size_t script_len, script_pos;
+
+    // Hook run before every input read (batch timing)
+    void (*on_input)(void* ctx);
+    void* on_input_ctx;
+
+    unsigned long bytes_written;
+    unsigned long write_calls;
+    unsigned long frames;           // flushes that had something to send
+    unsigned long screens;
+} console_t;
+
+// The stdout/stdin console used by the interactive tutor. Colour and
+// screen handling follow what stdout is: a terminal (unless TERM=dumb;
+// NO_COLOR drops colour) or a file or pipe, which gets plain text.
+void console_init_stdio(console_t* con);
+void console_free(console_t* con);
+
+// Select the console used by the calling thread (NULL = stdio console)
+void console_use(console_t* con);
+console_t* console_current(void);
+
+void con_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+void con_write(const char* data, size_t len);
+void con_clear_screen(void);
+// Whether what is written now is thrown away because the pipeline reading
+// it is done ("| head"); long outputs can stop early
+int con_stopped(void);
+// Write out pending output. On a non-blocking descriptor whatever the
+// kernel does not take stays buffered for the next flush.
+void con_flush(void);
+
+// Something else is about to write to the terminal (a real command): send
+// what is pending and redraw the next screen in full
+void con_release_screen(void);
+
+// Read one line of input into buf (newline stripped).
+// Returns 0 when input is exhausted.
+int con_read_line(char* buf, size_t len);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef DEB1_H
+#define DEB1_H
+
+#include <limits.h>
+#include "lesson_pack.h"
+
+// <limits.h> brings <linux/limits.h>, whose MAX_INPUT is the kernel's
+// type-ahead size; this one is the tutor's line buffer. Its guard keeps
+// later includes (<dirent.h> and the like) from putting theirs back.
+#undef MAX_INPUT
+#define MAX_INPUT 256
+#define CLEAR_SCREEN "\033[2J\033[H"
+#define COLOR_GREEN "\033[32m"
+#define COLOR_BLUE "\033[34m"
+#define COLOR_YELLOW "\033[33m"
+#define COLOR_RED "\033[31m"
+#define COLOR_CYAN "\033[36m"
+#define COLOR_RESET "\033[0m"
+
+// Operating system types
+typedef enum {
+    OS_DEBIAN,
+    OS_UBUNTU,
+    OS_SIMULATE_DEBIAN
+} os_type_t;
+
+// Global system configuration
+typedef struct {
+    os_type_t os_type;
+    char os_name[50];
+    int simulate_mode;
+    char prompt_prefix[20];
+    char os_id[32];         // os-release ID and ID_LIKE, "" if not found
+    char os_id_like[64];
+    uint32_t adapt_ruleset; // rules live commands are rewritten with (adapt.h)
+    int last_mode;          // learning mode chosen last time on this host, 0: none
+} system_config_t;
+
+// Per thread: a session copies its own in while it handles a choice
+extern __thread system_config_t sys_config;
+extern lesson_pack_t lessons;
+
+// Read by detect_and_configure_system(); the benchmarks point it at fixtures
+extern const char* os_release_path;
+
+// Screens. Each one renders to the current console and returns; the
+// session state machine (session.c) decides what is shown next.
+void detect_and_configure_system(void);
+void configure_learning_mode(int user_choice);
+void display_welcome(void);
+void show_main_menu(void);
+void show_lesson(const lp_topic_t* topic);
+int show_lesson_step(const lp_step_t* step);
+int step_applies(const lp_step_t* step);
+void interactive_command_demo(const char* command, const char* description);
+void command_demo_choice(int choice, const char* command, const char* description, const char* simulated_output);
+void execute_or_simulate_command(const char* command, const char* simulated_output);
+// Grade the learner's line for the exercise at step_index; Enter alone
+// (or NULL) shows an answer. Returns 1 when the exercise is over.
+int exercise_answer(uint32_t step_index, const char* line);
+int parse_user_choice(const char* input, int max_options);
+void show_choice_error(int max_options);
+void press_enter_to_continue(void);
+
+// Open the lesson pack (--pack, $DEB1_LESSON_PACK, the installed ones or
+// the bundled source) into lessons; exits if there is none
+void load_lessons(const char* explicit_path);
+
+#endif
@@ -0,0 +1,426 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "perm.h"
+#include "find.h"
+#include "util.h"
+
+#define MAX_PATH 4096
+#define UNITS_PER_THREAD 8
+#define MAX_THREADS 16
+
+typedef struct {
+    uint32_t ino;
+    int depth;
+    int whole;              // the subtree, not just the entry
+    char* path;
+    char* out;              // what the unit prints
+    size_t out_len, out_cap;
+    uint64_t lines;
+    uint64_t visited, printed;
+    int errors;
+    int done;
+} unit_t;
+
+typedef struct {
+    const sim_env_t* env;
+    const find_expr_t* e;
+    perm_cred_t cred;       // env's user, looked up once for every thread
+    unit_t* units;
+    size_t n_units;
+
+    pthread_mutex_t lock;
+    pthread_cond_t unit_done;
+    size_t next;
+    int stop;
+} walk_t;
+
+static void add_line(unit_t* u, const char* a, size_t a_len, const char* b, size_t b_len) {
+    if (u->out_len + a_len + b_len + 1 > u->out_cap) {
+        while (u->out_len + a_len + b_len + 1 > u->out_cap) u->out_cap = u->out_cap ? u->out_cap * 2 : 4096;
+        u->out = xrealloc(u->out, u->out_cap);
+    }
+    memcpy(u->out + u->out_len, a, a_len);
+    memcpy(u->out + u->out_len + a_len, b, b_len);
+    u->out_len += a_len + b_len;
+    u->out[u->out_len++] = '\n';
+    u->lines++;
+}
+
+// The last component, as find's -name sees it: "/etc/" is "etc"
+static const char* last_component(const char* path, char* buf, size_t len) {
+    size_t n = strlen(path);
+    const char* p;
+
+    while (n > 1 && path[n - 1] == '/') n--;
+    for (p = path + n; p > path && p[-1] != '/'; p--) {
+    }
+    if (p == path + n) return path;     // "/"
+    snprintf(buf, len, "%.*s", (int)(path + n - p), p);
+    return buf;
+}
+
+static int evaluate(const walk_t* w, uint32_t ino, const char* path, int depth) {
+    const find_expr_t* e = w->e;
+    const vfs_inode_t* node = vfs_inode(w->env->vfs, ino);
+
+    if (depth < e->min_depth) return 0;
+    if (e->type) {
+        if (e->type == 'f' && !S_ISREG(node->mode)) return 0;
+        if (e->type == 'd' && !S_ISDIR(node->mode)) return 0;
+        if (e->type != 'f' && e->type != 'd') return 0;
+    }
+    if (e->size_cmp != FIND_ANY_SIZE) {
+        uint64_t units = (node->size + e->size_unit - 1) / e->size_unit;
+
+        if (e->size_cmp < 0 ? units >= e->size : e->size_cmp > 0 ? units <= e->size : units != e->size) return 0;
+    }
+    if (e->name) {
+        char buf[256];
+
+        if (fnmatch(e->name, last_component(path, buf, sizeof(buf)), e->name_icase ? FNM_CASEFOLD : 0) != 0) {
+            return 0;
+        }
+    }
+    if (e->access && !perm_check(w->env->vfs, &w->cred, ino, e->access)) return 0;
+    return 1;
+}
+
+static int full(const walk_t* w, const unit_t* u) {
+    return (w->e->max_lines >= 0 && u->lines >= (uint64_t)w->e->max_lines) ||
+           __atomic_load_n(&w->stop, __ATOMIC_RELAXED);
+}
+
+// Whether the walk may go below a directory: within -maxdepth, and
+// readable (reported if not)
+static int descend(const walk_t* w, unit_t* u, uint32_t ino, const char* path, size_t len, int depth) {
+    if (w->e->max_depth >= 0 && depth >= w->e->max_depth) return 0;
+    if (!perm_check(w->env->vfs, &w->cred, ino, PERM_READ | PERM_EXEC)) {
+        char msg[MAX_PATH + 64];
+        int n = snprintf(msg, sizeof(msg), "find: '%.*s': Permission denied", (int)len, path);
+
+        add_line(u, msg, (size_t)n < sizeof(msg) ? (size_t)n : sizeof(msg) - 1, "", 0);
+        u->errors++;
+        return 0;
+    }
+    return 1;
+}
+
+static void visit(const walk_t* w, unit_t* u, uint32_t ino, char* path, size_t len, int depth) {
+    const vfs_t* fs = w->env->vfs;
+    const vfs_inode_t* node = vfs_inode(fs, ino);
+    vfs_dirent_t* children;
+    uint32_t i, n;
+
+    u->visited++;
+    if (evaluate(w, ino, path, depth)) {
+        add_line(u, path, len, "", 0);
+        u->printed++;
+    }
+    if (!S_ISDIR(node->mode) || full(w, u) || !descend(w, u, ino, path, len, depth)) return;
+
+    n = node->n_children;
+    children = malloc((n ? n : 1) * sizeof(vfs_dirent_t));
+    vfs_sorted_children(fs, ino, children);
+    for (i = 0; i < n && !full(w, u); i++) {
+        const char* name = vfs_name(fs, children[i].name);
+        size_t name_len = strlen(name);
+        size_t child_len = len + (path[len - 1] == '/' ? 0 : 1) + name_len;
+
+        if (child_len >= MAX_PATH) continue;
+        if (path[len - 1] != '/') path[len] = '/';
+        memcpy(path + child_len - name_len, name, name_len + 1);
+        visit(w, u, children[i].ino, path, child_len, depth + 1);
+        path[len] = '\0';
+    }
+    free(children);
+}
+
+static void run_unit(const walk_t* w, unit_t* u) {
+    char path[MAX_PATH];
+    size_t len = strlen(u->path);
+
+    memcpy(path, u->path, len + 1);
+    if (u->whole) {
+        visit(w, u, u->ino, path, len, u->depth);
+    } else {
+        u->visited++;
+        if (evaluate(w, u->ino, path, u->depth)) {
+            add_line(u, path, len, "", 0);
+            u->printed++;
+        }
+    }
+}
+
+static void* walk_worker(void* arg) {
+    walk_t* w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->next < w->n_units && !w->stop) {
+        unit_t* u = &w->units[w->next++];
+
+        pthread_mutex_unlock(&w->lock);
+        run_unit(w, u);
+        pthread_mutex_lock(&w->lock);
+        u->done = 1;
+        pthread_cond_broadcast(&w->unit_done);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Replace each directory unit by the directory alone and its children's
+// subtrees, a level at a time, until there are enough units
+static void split(walk_t* w, size_t wanted) {
+    const vfs_t* fs = w->env->vfs;
+    int grew = 1;
+
+    while (w->n_units < wanted && grew) {
+        unit_t* next = NULL;
+        size_t n = 0, cap = 0, i;
+
+        grew = 0;
+        for (i = 0; i < w->n_units; i++) {
+            unit_t* u = &w->units[i];
+            const vfs_inode_t* node = vfs_inode(fs, u->ino);
+            int expand = u->whole && S_ISDIR(node->mode) && node->n_children && n + w->n_units - i < wanted &&
+                         (w->e->max_depth < 0 || u->depth < w->e->max_depth) &&
+                         perm_check(fs, &w->cred, u->ino, PERM_READ | PERM_EXEC);
+            size_t len = strlen(u->path);
+            vfs_dirent_t* children;
+            uint32_t c;
+
+            if (n + 1 + (expand ? node->n_children : 0) > cap) {
+                cap = (n + 1 + (expand ? node->n_children : 0)) * 2;
+                next = xrealloc(next, cap * sizeof(unit_t));
+            }
+            next[n] = *u;
+            next[n++].whole = u->whole && !expand;
+            if (!expand) continue;
+
+            grew = 1;
+            children = malloc(node->n_children * sizeof(vfs_dirent_t));
+            vfs_sorted_children(fs, u->ino, children);
+            for (c = 0; c < node->n_children; c++) {
+                const char* name = vfs_name(fs, children[c].name);
+                char* path = malloc(len + strlen(name) + 2);
+
+                sprintf(path, "%s%s%s", u->path, u->path[len - 1] == '/' ? "" : "/", name);
+                memset(&next[n], 0, sizeof(unit_t));
+                next[n].ino = children[c].ino;
+                next[n].depth = u->depth + 1;
+                next[n].whole = 1;
+                next[n++].path = path;
+            }
+            free(children);
+        }
+        free(w->units);
+        w->units = next;
+        w->n_units = n;
+    }
+}
+
+void find_run(const sim_env_t* env, uint32_t start, const char* name, const find_expr_t* e,
+              find_write_fn write, void* ctx, find_result_t* result) {
+    pthread_t threads[MAX_THREADS];
+    int n_threads = e->threads, started = 0, failed = 0, i;
+    walk_t w;
+    size_t u;
+
+    if (e->max_lines == 0) return;
+    if (n_threads <= 0) n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads > MAX_THREADS) n_threads = MAX_THREADS;
+    if (n_threads < 1) n_threads = 1;
+
+    memset(&w, 0, sizeof(w));
+    w.env = env;
+    w.e = e;
+    perm_cred_env(env, &w.cred);
+    w.units = calloc(1, sizeof(unit_t));
+    w.units[0].ino = start;
+    w.units[0].whole = 1;
+    w.units[0].path = strdup(name);
+    w.n_units = 1;
+    if (n_threads > 1) split(&w, (size_t)n_threads * UNITS_PER_THREAD);
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.unit_done, NULL);
+    if (n_threads > 1 && w.n_units > 1) {
+        for (started = 0; started < n_threads; started++) {
+            if (pthread_create(&threads[started], NULL, walk_worker, &w) != 0) break;
+        }
+    }
+
+    // Write the units out in order, up to the lines wanted
+    for (u = 0; u < w.n_units && !w.stop; u++) {
+        unit_t* unit = &w.units[u];
+        const char* out;
+        size_t len;
+
+        if (started) {
+            pthread_mutex_lock(&w.lock);
+            while (!unit->done) pthread_cond_wait(&w.unit_done, &w.lock);
+            pthread_mutex_unlock(&w.lock);
+        } else {
+            run_unit(&w, unit);
+        }
+        out = unit->out;
+        len = unit->out_len;
+        if (e->max_lines >= 0 && result->output_lines + unit->lines >= (uint64_t)e->max_lines) {
+            // Only as far as the last line wanted
+            uint64_t keep = (uint64_t)e->max_lines - result->output_lines, lines = 0;
+
+            for (len = 0; len < unit->out_len && lines < keep; len++) {
+                if (out[len] == '\n') lines++;
+            }
+            result->output_lines += lines;
+            __atomic_store_n(&w.stop, 1, __ATOMIC_RELAXED);
+        } else {
+            result->output_lines += unit->lines;
+        }
+        result->visited += unit->visited;
+        result->printed += unit->printed;
+        result->errors += unit->errors;
+        if (len && !failed && write(ctx, out, len) != 0) {
+            failed = 1;
+            __atomic_store_n(&w.stop, 1, __ATOMIC_RELAXED);
+        }
+        free(unit->out);
+        unit->out = NULL;
+    }
+
+    pthread_mutex_lock(&w.lock);
+    __atomic_store_n(&w.stop, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&w.lock);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    for (u = 0; u < w.n_units; u++) {
+        free(w.units[u].path);
+        free(w.units[u].out);
+    }
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.unit_done);
+    free(w.units);
+}
+
+// ---------------------------------------------------------------------
+// The command
+
+// Stops the walk once a pipeline has read all it wants
+static int write_console(void* ctx, const char* data, size_t len) {
+    (void)ctx;
+    con_write(data, len);
+    return con_stopped();
+}
+
+// "+10k", "-1M", "20": comparison, count and unit
+static int parse_size(const char* text, find_expr_t* e) {
+    char* end;
+
+    e->size_cmp = *text == '+' ? 1 : *text == '-' ? -1 : 0;
+    if (*text == '+' || *text == '-') text++;
+    if (*text < '0' || *text > '9') return -1;
+    e->size = strtoull(text, &end, 10);
+    switch (*end) {
+        case '\0': case 'b': e->size_unit = 512; break;
+        case 'c': e->size_unit = 1; break;
+        case 'w': e->size_unit = 2; break;
+        case 'k': e->size_unit = 1024; break;
+        case 'M': e->size_unit = 1024 * 1024; break;
+        case 'G': e->size_unit = 1024 * 1024 * 1024; break;
+        default: return -1;
+    }
+    return *end && end[1] ? -1 : 0;
+}
+
+int find_cmd(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    static char dot[] = ".";
+    char** starts = argv + 1;
+    int n_starts = 0, status = 0, i;
+    find_expr_t e;
+    find_result_t result;
+
+    memset(&e, 0, sizeof(e));
+    e.size_cmp = FIND_ANY_SIZE;
+    e.max_depth = -1;
+    e.max_lines = sim_line_limit();
+    while (1 + n_starts < argc && argv[1 + n_starts][0] != '-') n_starts++;
+
+    // Only a conjunction of these tests; operators and actions get the
+    // lesson's output
+    for (i = 1 + n_starts; i < argc; i++) {
+        const char* opt = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(opt, "-print") == 0) continue;
+        if (strcmp(opt, "-readable") == 0 || strcmp(opt, "-writable") == 0 || strcmp(opt, "-executable") == 0) {
+            e.access |= opt[1] == 'r' ? PERM_READ : opt[1] == 'w' ? PERM_WRITE : PERM_EXEC;
+            continue;
+        }
+        if (strcmp(opt, "-name") != 0 && strcmp(opt, "-iname") != 0 && strcmp(opt, "-type") != 0 &&
+            strcmp(opt, "-size") != 0 && strcmp(opt, "-maxdepth") != 0 && strcmp(opt, "-mindepth") != 0) {
+            return -1;
+        }
+        if (!value) {
+            sim_error("find", "missing argument to `%s'", opt);
+            return 1;
+        }
+        i++;
+        if (strcmp(opt, "-name") == 0 || strcmp(opt, "-iname") == 0) {
+            e.name = value;
+            e.name_icase = opt[1] == 'i';
+        } else if (strcmp(opt, "-type") == 0) {
+            if (strlen(value) != 1 || !strchr("bcdpfls", value[0])) {
+                sim_error("find", "Unknown argument to -type: %s", value);
+                return 1;
+            }
+            e.type = value[0];
+        } else if (strcmp(opt, "-size") == 0) {
+            if (parse_size(value, &e) < 0) {
+                sim_error("find", "invalid -size type `%s'", value);
+                return 1;
+            }
+        } else {
+            char* end;
+            long depth = strtol(value, &end, 10);
+
+            if (*end || end == value || depth < 0) {
+                sim_error("find", "Expected a positive decimal integer argument to %s, but got `%s'", opt, value);
+                return 1;
+            }
+            if (opt[2] == 'a') {
+                e.max_depth = (int)depth;
+            } else {
+                e.min_depth = (int)depth;
+            }
+        }
+    }
+    if (n_starts == 0) {
+        starts = (char*[]){ dot };
+        n_starts = 1;
+    }
+
+    memset(&result, 0, sizeof(result));
+    for (i = 0; i < n_starts; i++) {
+        uint32_t ino;
+        int err = perm_resolve(env, starts[i], &ino);
+
+        if (err) {
+            sim_error("find", "'%s': %s", starts[i], strerror(-err));
+            status = 1;
+            continue;
+        }
+        find_run(env, ino, starts[i], &e, write_console, NULL, &result);
+        if (e.max_lines >= 0 && result.output_lines >= (uint64_t)e.max_lines) break;
+    }
+    return status || result.errors ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#ifndef FIND_H
+#define FIND_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// find over the simulated filesystem, spread across threads.
+//
+// The tree below a start point is cut into units in traversal order: the
+// start directory is replaced by itself followed by one unit per child
+// subtree, level by level, until there are several units per thread.
+// Workers take units in order and walk them (children in name order,
+// like ls), each into its own buffer; the calling thread writes the
+// buffers out in unit order as they finish, so the output is exactly a
+// sequential find's. With a trailing "| head" the walk stops once enough
+// lines are out.
+
+struct sim_env;
+
+typedef struct {
+    const char* name;       // -name / -iname glob for the last component, NULL for any
+    int name_icase;
+    char type;              // -type letter, 0 for any
+    int size_cmp;           // -size: -1 fewer, 0 exactly, 1 more units; FIND_ANY_SIZE for none
+    uint64_t size;          // in units, file sizes rounded up
+    uint64_t size_unit;     // bytes
+    int min_depth;
+    int max_depth;          // -1 for no limit
+    uint32_t access;        // -readable, -writable, -executable: PERM_* bits (perm.h)
+    long max_lines;         // output lines wanted, -1 for all
+    int threads;            // 0: one per core
+} find_expr_t;
+
+#define FIND_ANY_SIZE 2
+
+typedef struct {
+    uint64_t visited;
+    uint64_t printed;
+    uint64_t output_lines;
+    int errors;             // directories that could not be read
+} find_result_t;
+
+// Same contract as grep's: a nonzero return stops the walk
+typedef int (*find_write_fn)(void* ctx, const char* data, size_t len);
+
+// Walk the tree at start, printed as name, as env's user. Unreadable
+// directories are reported in place ("find: 'NAME': Permission denied").
+void find_run(const struct sim_env* env, uint32_t start, const char* name, const find_expr_t* e,
+              find_write_fn write, void* ctx, find_result_t* result);
+
+// Simulated command (see sim.c)
+int find_cmd(int argc, char** argv);
+
+#endif
@@ -0,0 +1,1082 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "grade.h"
+#include "bench.h"
+#include "util.h"
+
+#define MAX_TOKENS 96
+#define MAX_STAGES 16
+#define MAX_FORM 2048
+#define CHUNK_LINES 1024        // submissions a batch worker takes at a time
+
+// In a normal form: between words, between the parts of a command
+// (options, operands, redirections), and before the operator that ends it
+#define WORD_SEP '\x1f'
+#define PART_SEP '\x1d'
+#define STAGE_SEP '\x1e'
+// Before a character the shell would expand (*, ?, [, $, ~) where it was
+// not quoted
+#define EXPANDS '\x01'
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t h, const char* s, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+#define HASH_INIT 1469598103934665603ull
+
+// ---------------------------------------------------------------------
+// Programs whose options are parsed
+
+typedef struct {
+    const char* name;
+    const char* values;     // short options that take a value
+    const char* longs;      // "long=s ...": --long is -s
+    char count;             // "-5" is this option with the value 5
+    uint8_t patterns;       // leading operands that are not files ...
+    const char* pattern_opts;   // ... unless one of these options gives them
+} program_t;
+
+static const program_t programs[] = {
+    { "apt", "oc", "yes=y assume-yes=y quiet=q simulate=s", 0, 0, "" },
+    { "apt-get", "oc", "yes=y assume-yes=y quiet=q simulate=s", 0, 0, "" },
+    { "awk", "Fvf", "field-separator=F assign=v file=f", 0, 1, "f" },
+    { "cat", "", "number=n show-all=A show-ends=E squeeze-blank=s", 0, 0, "" },
+    { "chmod", "", "recursive=R verbose=v changes=c", 0, 0, "" },
+    { "chown", "", "recursive=R verbose=v changes=c", 0, 0, "" },
+    { "cut", "dfcb", "delimiter=d fields=f characters=c bytes=b", 0, 0, "" },
+    { "df", "tx", "human-readable=h si=H inodes=i print-type=T type=t exclude-type=x all=a local=l", 0, 0, "" },
+    { "du", "dX", "human-readable=h summarize=s max-depth=d all=a si=H total=c", 0, 0, "" },
+    { "free", "sc", "human=h bytes=b kibi=k mebi=m gibi=g total=t wide=w seconds=s count=c", 0, 0, "" },
+    { "grep", "efmABCd",
+      "regexp=e file=f max-count=m after-context=A before-context=B context=C ignore-case=i invert-match=v "
+      "count=c line-number=n recursive=r word-regexp=w line-regexp=x extended-regexp=E fixed-strings=F "
+      "files-with-matches=l only-matching=o quiet=q silent=q no-filename=h with-filename=H",
+      0, 1, "ef" },
+    { "head", "nc", "lines=n bytes=c quiet=q silent=q verbose=v", 'n', 0, "" },
+    { "id", "", "user=u group=g groups=G name=n real=r", 0, 0, "" },
+    { "journalctl", "upntSUoDM",
+      "unit=u priority=p lines=n identifier=t since=S until=U output=o directory=D follow=f reverse=r "
+      "dmesg=k quiet=q",
+      0, 0, "" },
+    { "ls", "IwT",
+      "all=a almost-all=A human-readable=h reverse=r recursive=R directory=d size=s inode=i classify=F "
+      "ignore=I width=w",
+      0, 0, "" },
+    { "mkdir", "m", "parents=p mode=m verbose=v", 0, 0, "" },
+    { "netstat", "", "tcp=t udp=u listening=l numeric=n programs=p all=a route=r interfaces=i statistics=s", 0, 0,
+      "" },
+    { "pgrep", "uUgGPt", "list-name=l list-full=a full=f euid=u uid=U count=c exact=x newest=n oldest=o", 0, 1,
+      "" },
+    { "ps", "opuUCgGt", "", 0, 0, "" },
+    { "rm", "", "recursive=r force=f interactive=i verbose=v dir=d", 0, 0, "" },
+    { "sed", "ef", "expression=e file=f quiet=n silent=n regexp-extended=E", 0, 1, "ef" },
+    { "sort", "ktSoT",
+      "numeric-sort=n reverse=r key=k field-separator=t unique=u human-numeric-sort=h ignore-case=f month-sort=M "
+      "output=o",
+      0, 0, "" },
+    { "ss", "fA", "tcp=t udp=u listening=l numeric=n processes=p all=a extended=e summary=s ipv4=4 ipv6=6", 0, 0,
+      "" },
+    { "stat", "c", "format=c dereference=L terse=t", 0, 0, "" },
+    { "tail", "ncs", "lines=n bytes=c follow=f sleep-interval=s quiet=q silent=q verbose=v", 'n', 0, "" },
+    { "top", "nbdpuUo", "", 0, 0, "" },
+    { "uname", "", "all=a kernel-name=s nodename=n kernel-release=r kernel-version=v machine=m operating-system=o",
+      0, 0, "" },
+    { "uniq", "fsw", "count=c repeated=d unique=u ignore-case=i skip-fields=f skip-chars=s check-chars=w", 0, 0,
+      "" },
+    { "uptime", "", "pretty=p since=s", 0, 0, "" },
+    { "usermod", "cdefgGlLpsu", "append=a groups=G gid=g home=d shell=s login=l lock=L unlock=U comment=c", 0, 0,
+      "" },
+    { "vmstat", "S", "wide=w timestamp=t unit=S active=a", 0, 0, "" },
+    { "wc", "", "lines=l words=w bytes=c chars=m max-line-length=L", 0, 0, "" },
+};
+
+static const program_t* find_program(const char* name) {
+    size_t lo = 0, hi = sizeof(programs) / sizeof(programs[0]);
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int c = strcmp(programs[mid].name, name);
+
+        if (c == 0) return &programs[mid];
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// The short form of a long option, 0 if it has none
+static char long_to_short(const program_t* p, const char* name, size_t len) {
+    const char* l = p->longs;
+
+    while (*l) {
+        size_t n = strcspn(l, "=");
+
+        if (n == len && strncmp(l, name, len) == 0) return l[n + 1];
+        l += n + 2;
+        l += *l == ' ';
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Tokenizer
+
+typedef enum {
+    TOK_WORD,
+    TOK_REDIRECT,           // text is the operator and its target, "2>/dev/null"
+    TOK_OPERATOR            // text is one of | || && ; &
+} token_kind_t;
+
+typedef struct {
+    char* text;
+    uint8_t kind;
+} token_t;
+
+typedef struct {
+    char* p;
+    char* end;
+} arena_t;
+
+static int put(arena_t* a, char c) {
+    if (a->p >= a->end) return -1;
+    *a->p++ = c;
+    return 0;
+}
+
+// One word at *line into the arena, quotes removed and unquoted expansion
+// characters marked. Returns -1 for an unterminated quote or no room.
+static int read_word(const char** line, arena_t* a) {
+    const char* p = *line;
+    int first = 1;
+
+    while (*p && !isspace((unsigned char)*p) && !strchr("|&;<>", *p)) {
+        if (*p == '\'') {
+            for (p++; *p && *p != '\''; p++) {
+                if (put(a, *p) < 0) return -1;
+            }
+            if (*p++ != '\'') return -1;
+        } else if (*p == '"') {
+            for (p++; *p && *p != '"'; p++) {
+                if (*p == '\\' && p[1] && strchr("\"\\$`", p[1])) {
+                    p++;
+                } else if (*p == '$' || *p == '`') {
+                    // Expanded inside double quotes too
+                    if (put(a, EXPANDS) < 0) return -1;
+                }
+                if (put(a, *p) < 0) return -1;
+            }
+            if (*p++ != '"') return -1;
+        } else if (*p == '\\') {
+            if (!p[1]) return -1;
+            if (put(a, p[1]) < 0) return -1;
+            p += 2;
+        } else {
+            // ~ expands only at the start; $HOME is the same directory
+            if (first && strncmp(p, "$HOME", 5) == 0 && (!p[5] || p[5] == '/' || isspace((unsigned char)p[5]))) {
+                if (put(a, EXPANDS) < 0 || put(a, '~') < 0) return -1;
+                p += 5;
+                first = 0;
+                continue;
+            }
+            if (strchr("*?[$`", *p) || (first && *p == '~')) {
+                if (put(a, EXPANDS) < 0) return -1;
+            }
+            if (put(a, *p++) < 0) return -1;
+        }
+        first = 0;
+    }
+    *line = p;
+    return put(a, '\0');
+}
+
+// Split a command line. Returns the token count, or -1.
+static int tokenize(const char* line, arena_t* a, token_t* toks, int max) {
+    int n = 0;
+
+    for (;;) {
+        token_t* t;
+
+        while (isspace((unsigned char)*line)) line++;
+        if (!*line) break;
+        if (n == max) return -1;
+        t = &toks[n++];
+        t->text = a->p;
+
+        if (*line == '|' || *line == '&' || *line == ';') {
+            // | || && ; &, and &> as a redirection
+            if (line[0] == '&' && line[1] == '>') goto redirect;
+            if (put(a, *line) < 0) return -1;
+            if ((line[0] == '|' || line[0] == '&') && line[1] == line[0]) {
+                if (put(a, *line++) < 0) return -1;
+            }
+            line++;
+            t->kind = TOK_OPERATOR;
+            if (put(a, '\0') < 0) return -1;
+            continue;
+        }
+        if (*line == '<' || *line == '>' || (isdigit((unsigned char)line[0]) && (line[1] == '<' || line[1] == '>'))) {
+        redirect:
+            // The default descriptors are left out: >f is 1>f, <f is 0<f
+            if (isdigit((unsigned char)*line)) {
+                if (!((line[0] == '1' && line[1] == '>') || (line[0] == '0' && line[1] == '<'))) {
+                    if (put(a, *line) < 0) return -1;
+                }
+                line++;
+            } else if (*line == '&') {
+                if (put(a, *line++) < 0) return -1;
+            }
+            if (put(a, *line) < 0) return -1;
+            if (line[0] == '>' && line[1] == '>') {
+                if (put(a, *++line) < 0) return -1;
+            }
+            line++;
+            t->kind = TOK_REDIRECT;
+            if (*line == '&' && isdigit((unsigned char)line[1])) {
+                // 2>&1: the target is part of the operator
+                if (put(a, '&') < 0 || put(a, line[1]) < 0 || put(a, '\0') < 0) return -1;
+                line += 2;
+                continue;
+            }
+            while (isspace((unsigned char)*line)) line++;
+            if (!*line || strchr("|&;<>", *line)) return -1;
+            if (read_word(&line, a) < 0) return -1;
+            continue;
+        }
+        t->kind = TOK_WORD;
+        if (read_word(&line, a) < 0) return -1;
+    }
+    return n;
+}
+
+// ---------------------------------------------------------------------
+// Normal form
+
+typedef struct {
+    char* prefix[8];        // sudo and its options
+    int n_prefix;
+    const char* program;
+    const program_t* spec;
+    char* opts[MAX_TOKENS];
+    int n_opts;
+    char* operands[MAX_TOKENS];
+    int n_operands;
+    char* redirects[8];
+    int n_redirects;
+    const char* op;         // the operator after it, "" at the end
+    int merged;             // folded into the next stage
+} stage_t;
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// "-c" or "-c=value" into the arena
+static char* make_option(arena_t* a, char c, const char* value) {
+    char* s = a->p;
+
+    if (put(a, '-') < 0 || put(a, c) < 0) return NULL;
+    if (value) {
+        if (put(a, '=') < 0) return NULL;
+        while (*value) {
+            if (put(a, *value++) < 0) return NULL;
+        }
+    }
+    return put(a, '\0') < 0 ? NULL : s;
+}
+
+// How many leading operands are patterns rather than files
+static int pattern_operands(const stage_t* s) {
+    int i;
+
+    if (!s->spec) return -1;
+    for (i = 0; i < s->n_opts; i++) {
+        if (strchr(s->spec->pattern_opts, s->opts[i][1])) return 0;
+    }
+    return s->spec->patterns;
+}
+
+// Options as getopt would see them. Returns -1 when the arena is full.
+static int parse_options(stage_t* s, char** words, int n, arena_t* a) {
+    const program_t* p = s->spec;
+    int i, dashdash = 0;
+
+    for (i = 0; i < n; i++) {
+        char* w = words[i];
+        char* opt = NULL;
+
+        if (dashdash || w[0] != '-' || w[1] == '\0') {
+            s->operands[s->n_operands++] = w;
+            continue;
+        }
+        if (strcmp(w, "--") == 0) {
+            dashdash = 1;
+            continue;
+        }
+        if (w[1] == '-') {
+            const char* name = w + 2;
+            const char* eq = strchr(name, '=');
+            char c = long_to_short(p, name, eq ? (size_t)(eq - name) : strlen(name));
+
+            if (!c) {
+                s->opts[s->n_opts++] = w;
+            } else if (strchr(p->values, c)) {
+                const char* value = eq ? eq + 1 : i + 1 < n ? words[++i] : "";
+                if (!(opt = make_option(a, c, value))) return -1;
+                s->opts[s->n_opts++] = opt;
+            } else {
+                if (!(opt = make_option(a, c, NULL))) return -1;
+                s->opts[s->n_opts++] = opt;
+            }
+            continue;
+        }
+        if (p->count && strspn(w + 1, "0123456789") == strlen(w + 1)) {
+            if (!(opt = make_option(a, p->count, w + 1))) return -1;
+            s->opts[s->n_opts++] = opt;
+            continue;
+        }
+        for (w++; *w; w++) {
+            if (strchr(p->values, *w)) {
+                const char* value = w[1] ? w + 1 : i + 1 < n ? words[++i] : "";
+                if (!(opt = make_option(a, *w, value))) return -1;
+                s->opts[s->n_opts++] = opt;
+                break;
+            }
+            if (!(opt = make_option(a, *w, NULL))) return -1;
+            s->opts[s->n_opts++] = opt;
+        }
+    }
+    return 0;
+}
+
+// One command of the line from its tokens
+static int parse_stage(stage_t* s, token_t* toks, int n, arena_t* a) {
+    char* words[MAX_TOKENS];
+    char* stdin_file = NULL;
+    int n_words = 0, i, first = 0, patterns;
+
+    memset(s, 0, sizeof(*s));
+    for (i = 0; i < n; i++) {
+        if (toks[i].kind == TOK_WORD) {
+            words[n_words++] = toks[i].text;
+        } else if (toks[i].text[0] == '<' && !stdin_file) {
+            stdin_file = toks[i].text + 1;
+        } else if (s->n_redirects < 8) {
+            s->redirects[s->n_redirects++] = toks[i].text;
+        } else {
+            return -1;
+        }
+    }
+
+    // sudo, with its options, comes before the program
+    if (n_words && strcmp(words[0], "sudo") == 0) {
+        s->prefix[s->n_prefix++] = words[first++];
+        while (first < n_words && words[first][0] == '-' && s->n_prefix < 7) {
+            if (strcmp(words[first], "-u") == 0 && first + 1 < n_words) {
+                if (!(s->prefix[s->n_prefix++] = make_option(a, 'u', words[first + 1]))) return -1;
+                first += 2;
+            } else {
+                s->prefix[s->n_prefix++] = words[first++];
+            }
+        }
+    }
+    if (first == n_words) return -1;
+    s->program = words[first++];
+    s->spec = find_program(s->program);
+    if (s->spec) {
+        if (parse_options(s, words + first, n_words - first, a) < 0) return -1;
+        qsort(s->opts, (size_t)s->n_opts, sizeof(s->opts[0]), compare_strings);
+    } else {
+        for (i = first; i < n_words; i++) s->operands[s->n_operands++] = words[i];
+    }
+
+    // "< FILE" is FILE as an operand, where the program would take one
+    patterns = pattern_operands(s);
+    if (stdin_file) {
+        if (patterns >= 0 && s->n_operands == patterns) {
+            s->operands[s->n_operands++] = stdin_file;
+        } else if (s->n_redirects < 8) {
+            s->redirects[s->n_redirects++] = stdin_file - 1;
+        } else {
+            return -1;
+        }
+    }
+    for (i = patterns < 0 ? 0 : patterns; i < s->n_operands; i++) {
+        size_t len = strlen(s->operands[i]);
+
+        if (len > 1 && s->operands[i][len - 1] == '/') s->operands[i][len - 1] = '\0';
+    }
+    return 0;
+}
+
+static int emit(char** out, char* end, const char* s, char sep) {
+    size_t len = strlen(s);
+
+    if (*out + len + 1 >= end) return -1;
+    memcpy(*out, s, len);
+    *out += len;
+    *(*out)++ = sep;
+    return 0;
+}
+
+int grade_normalize(const char* command, char* out, size_t len) {
+    char buf[MAX_FORM];
+    token_t toks[MAX_TOKENS];
+    stage_t stages[MAX_STAGES];
+    arena_t a = { buf, buf + sizeof(buf) };
+    char* o = out;
+    char* end = out + len;
+    int n, i, start = 0, n_stages = 0, k;
+
+    n = tokenize(command, &a, toks, MAX_TOKENS);
+    if (n <= 0) return -1;
+    for (i = 0; i <= n; i++) {
+        if (i < n && toks[i].kind != TOK_OPERATOR) continue;
+        if (n_stages == MAX_STAGES || i == start) return -1;
+        if (parse_stage(&stages[n_stages], toks + start, i - start, &a) < 0) return -1;
+        stages[n_stages++].op = i < n ? toks[i].text : "";
+        start = i + 1;
+    }
+
+    // "cat FILE | filter" is "filter FILE"
+    for (i = 0; i + 1 < n_stages; i++) {
+        stage_t* s = &stages[i];
+        stage_t* next = &stages[i + 1];
+
+        if (strcmp(s->program, "cat") == 0 && !s->n_prefix && !s->n_opts && s->n_operands == 1 &&
+            !s->n_redirects && strcmp(s->op, "|") == 0 && next->n_operands == pattern_operands(next)) {
+            next->operands[next->n_operands++] = s->operands[0];
+            s->merged = 1;
+        }
+    }
+
+    for (i = 0; i < n_stages; i++) {
+        stage_t* s = &stages[i];
+        char op[4];
+
+        if (s->merged) continue;
+        for (k = 0; k < s->n_prefix; k++) {
+            if (emit(&o, end, s->prefix[k], WORD_SEP) < 0) return -1;
+        }
+        if (emit(&o, end, s->program, PART_SEP) < 0) return -1;
+        for (k = 0; k < s->n_opts; k++) {
+            if (emit(&o, end, s->opts[k], WORD_SEP) < 0) return -1;
+        }
+        if (o >= end) return -1;
+        *o++ = PART_SEP;
+        for (k = 0; k < s->n_operands; k++) {
+            if (emit(&o, end, s->operands[k], WORD_SEP) < 0) return -1;
+        }
+        if (o >= end) return -1;
+        *o++ = PART_SEP;
+        for (k = 0; k < s->n_redirects; k++) {
+            if (emit(&o, end, s->redirects[k], WORD_SEP) < 0) return -1;
+        }
+        snprintf(op, sizeof(op), "%c%s", STAGE_SEP, s->op);
+        if (emit(&o, end, op, STAGE_SEP) < 0) return -1;
+    }
+    if (o >= end) return -1;
+    *o = '\0';
+    return (int)(o - out);
+}
+
+static int form_hash(const char* command, uint64_t* hash) {
+    char form[MAX_FORM];
+    int len = grade_normalize(command, form, sizeof(form));
+
+    if (len < 0) return -1;
+    *hash = hash_bytes(HASH_INIT, form, (size_t)len);
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Exercises
+
+grade_set_t* grade_load(const lesson_pack_t* pack) {
+    grade_set_t* g = calloc(1, sizeof(*g));
+    uint32_t i, cap = 0, forms_cap = 0;
+
+    if (!g) {
+        perror("calloc");
+        exit(1);
+    }
+    g->pack = pack;
+    pthread_mutex_init(&g->lock, NULL);
+    for (i = 0; i < pack->header->n_steps; i++) {
+        const lp_step_t* step = lp_step(pack, i);
+        const char* answers;
+        grade_exercise_t* ex;
+
+        if (step->kind != LP_STEP_EXERCISE) continue;
+        if (g->n_exercises == cap) {
+            cap = cap ? cap * 2 : 16;
+            g->exercises = xrealloc(g->exercises, cap * sizeof(g->exercises[0]));
+        }
+        ex = &g->exercises[g->n_exercises++];
+        memset(ex, 0, sizeof(*ex));
+        ex->step = i;
+        ex->first_form = g->n_forms;
+        ex->check_output = (step->flags & LP_CHECK_OUTPUT) != 0;
+
+        for (answers = lp_str(pack, step->output); *answers;) {
+            size_t n = strcspn(answers, "\n");
+            char answer[MAX_INPUT * 2];
+            uint64_t hash;
+
+            snprintf(answer, sizeof(answer), "%.*s", (int)n, answers);
+            if (form_hash(answer, &hash) < 0) {
+                fprintf(stderr, "exercise %u: cannot read the answer \"%s\"\n", g->n_exercises, answer);
+            } else {
+                if (g->n_forms == forms_cap) {
+                    forms_cap = forms_cap ? forms_cap * 2 : 32;
+                    g->forms = xrealloc(g->forms, forms_cap * sizeof(g->forms[0]));
+                }
+                g->forms[g->n_forms++] = hash;
+                ex->n_forms++;
+            }
+            answers += n;
+            answers += *answers == '\n';
+        }
+    }
+    return g;
+}
+
+void grade_free(grade_set_t* g) {
+    if (!g) return;
+    pthread_mutex_destroy(&g->lock);
+    free(g->exercises);
+    free(g->forms);
+    free(g);
+}
+
+int grade_exercise_of(const grade_set_t* g, uint32_t step) {
+    uint32_t lo = 0, hi = g->n_exercises;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (g->exercises[mid].step == step) return (int)mid;
+        if (g->exercises[mid].step < step) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+const char* grade_answer(const grade_set_t* g, uint32_t exercise, uint32_t n, char* buf, size_t len) {
+    const char* answers;
+
+    if (exercise >= g->n_exercises) return NULL;
+    answers = lp_str(g->pack, lp_step(g->pack, g->exercises[exercise].step)->output);
+    while (n--) {
+        answers = strchr(answers, '\n');
+        if (!answers) return NULL;
+        answers++;
+    }
+    if (!*answers) return NULL;
+    snprintf(buf, len, "%.*s", (int)strcspn(answers, "\n"), answers);
+    return buf;
+}
+
+static int hash_output(void* ctx, const char* data, size_t len) {
+    uint64_t* h = ctx;
+
+    *h = hash_bytes(*h, data, len);
+    return 0;
+}
+
+// Run a command on a fresh simulated machine, hashing what it prints.
+// The machine reads $DEB1_ACCOUNTS's database if there is one, but what
+// the command changes goes to a copy that dies with it: graded commands
+// never write the account files, nor see each other's changes. Returns
+// its status, or -1 if it has no simulator.
+static int simulated_run(const char* command, uint64_t* output) {
+    console_t capture, *saved = console_current();
+    sim_env_t* env = NULL;
+    sim_env_t** saved_slot;
+    int status;
+
+    memset(&capture, 0, sizeof(capture));
+    capture.out_fd = -1;
+    capture.capture = 1;
+    capture.sink = hash_output;
+    capture.sink_ctx = output;
+    *output = HASH_INIT;
+    console_use(&capture);
+    saved_slot = sim_enter(&env);
+    sim_env()->private_accounts = 1;
+    status = sim_execute(command);
+    sim_enter(saved_slot);
+    console_use(saved);
+    sim_env_free(env);
+    return status;
+}
+
+grade_verdict_t grade_check(grade_set_t* g, uint32_t exercise, const char* command) {
+    grade_exercise_t* ex;
+    uint64_t hash, output;
+    uint32_t i;
+    int status;
+
+    if (exercise >= g->n_exercises || form_hash(command, &hash) < 0) return GRADE_UNREADABLE;
+    ex = &g->exercises[exercise];
+    for (i = 0; i < ex->n_forms; i++) {
+        if (g->forms[ex->first_form + i] == hash) return GRADE_RIGHT;
+    }
+    if (!ex->check_output) return GRADE_WRONG;
+
+    pthread_mutex_lock(&g->lock);
+    if (!ex->expected_ready) {
+        char answer[MAX_INPUT * 2];
+
+        ex->expected_status = -1;
+        if (grade_answer(g, exercise, 0, answer, sizeof(answer))) {
+            ex->expected_status = simulated_run(answer, &ex->expected_output);
+        }
+        ex->expected_ready = 1;
+    }
+    pthread_mutex_unlock(&g->lock);
+    if (ex->expected_status < 0) return GRADE_WRONG;
+
+    status = simulated_run(command, &output);
+    return status == ex->expected_status && output == ex->expected_output ? GRADE_SAME_OUTPUT : GRADE_WRONG;
+}
+
+const char* grade_verdict_name(grade_verdict_t v) {
+    static const char* names[] = { "wrong", "right", "same-output", "unreadable" };
+
+    return v <= GRADE_UNREADABLE ? names[v] : "?";
+}
+
+// ---------------------------------------------------------------------
+// Batch grading
+
+typedef struct {
+    grade_set_t* g;
+    char** commands;        // NUL-terminated, edited in place
+    uint32_t* exercises;    // UINT32_MAX: the line names none
+    uint8_t* verdicts;
+    uint32_t n;
+    uint32_t next;          // the next chunk's first line, taken atomically
+} batch_t;
+
+static void* batch_worker(void* arg) {
+    batch_t* b = arg;
+
+    for (;;) {
+        uint32_t start = __atomic_fetch_add(&b->next, CHUNK_LINES, __ATOMIC_RELAXED);
+        uint32_t end, i;
+
+        if (start >= b->n) break;
+        end = start + CHUNK_LINES < b->n ? start + CHUNK_LINES : b->n;
+        for (i = start; i < end; i++) {
+            b->verdicts[i] = b->exercises[i] == UINT32_MAX
+                                 ? GRADE_UNREADABLE
+                                 : (uint8_t)grade_check(b->g, b->exercises[i], b->commands[i]);
+        }
+    }
+    return NULL;
+}
+
+// Grade b's lines on n_threads threads (the calling one among them)
+static void grade_lines(batch_t* b, int n_threads) {
+    pthread_t threads[256];
+    int started = 0, i;
+
+    b->next = 0;
+    if (n_threads > 256) n_threads = 256;
+    for (i = 1; i < n_threads; i++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, b) != 0) break;
+        started++;
+    }
+    batch_worker(b);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+}
+
+static char* read_all(const char* path, size_t* len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    char* data;
+    size_t done = 0;
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    data = xrealloc(NULL, (size_t)st.st_size + 1);
+    while (done < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + done, (size_t)st.st_size - done);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    close(fd);
+    data[done] = '\0';
+    *len = done;
+    return data;
+}
+
+// Split the submissions into lines, and each into its fields: the
+// command is after the last tab, the exercise number before it
+static uint32_t index_lines(char* data, size_t len, batch_t* b, char*** heads) {
+    uint32_t cap = 0, n = 0;
+    char* p = data;
+    char* end = data + len;
+
+    while (p < end) {
+        char* nl = memchr(p, '\n', (size_t)(end - p));
+        char* tab;
+        char* field;
+        char* stop;
+        unsigned long number;
+
+        if (!nl) nl = end;
+        *nl = '\0';
+        if (nl > p && nl[-1] == '\r') nl[-1] = '\0';
+        if (n == cap) {
+            cap = cap ? cap * 2 : 65536;
+            b->commands = xrealloc(b->commands, cap * sizeof(b->commands[0]));
+            b->exercises = xrealloc(b->exercises, cap * sizeof(b->exercises[0]));
+            *heads = xrealloc(*heads, cap * sizeof((*heads)[0]));
+        }
+        (*heads)[n] = p;
+        b->exercises[n] = UINT32_MAX;
+        b->commands[n] = p + strlen(p);
+        tab = strrchr(p, '\t');
+        if (tab) {
+            *tab = '\0';
+            b->commands[n] = tab + 1;
+            field = strrchr(p, '\t');
+            field = field ? field + 1 : p;
+            number = strtoul(field, &stop, 10);
+            if (stop != field && *stop == '\0' && number >= 1 && number <= b->g->n_exercises) {
+                b->exercises[n] = (uint32_t)(number - 1);
+            }
+        }
+        n++;
+        p = nl + 1;
+    }
+    return n;
+}
+
+int grade_batch(const lesson_pack_t* pack, const char* path, int threads, const char* output_path) {
+    batch_t b;
+    char** heads = NULL;
+    unsigned long counts[GRADE_UNREADABLE + 1] = { 0 };
+    size_t len;
+    char* data;
+    double start, elapsed;
+    uint32_t i;
+    int rc = 0;
+
+    memset(&b, 0, sizeof(b));
+    data = read_all(path, &len);
+    if (!data) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    b.g = grade_load(pack);
+    b.n = index_lines(data, len, &b, &heads);
+    b.verdicts = xrealloc(NULL, b.n ? b.n : 1);
+
+    start = bench_now();
+    grade_lines(&b, threads);
+    elapsed = bench_now() - start;
+
+    for (i = 0; i < b.n; i++) counts[b.verdicts[i]]++;
+    if (output_path) {
+        FILE* out = fopen(output_path, "w");
+
+        if (!out) {
+            perror(output_path);
+            rc = 1;
+        } else {
+            for (i = 0; i < b.n; i++) fprintf(out, "%s\t%s\n", heads[i], grade_verdict_name(b.verdicts[i]));
+            if (fclose(out) != 0) {
+                perror(output_path);
+                rc = 1;
+            }
+        }
+    }
+
+    bench_report("grade", "submissions", b.n, "count");
+    bench_report("grade", "right", counts[GRADE_RIGHT], "count");
+    bench_report("grade", "same_output", counts[GRADE_SAME_OUTPUT], "count");
+    bench_report("grade", "wrong", counts[GRADE_WRONG], "count");
+    bench_report("grade", "unreadable", counts[GRADE_UNREADABLE], "count");
+    bench_report("grade", "threads", threads, "count");
+    bench_report("grade", "elapsed", elapsed, "s");
+    bench_report("grade", "submissions_per_sec", elapsed > 0 ? b.n / elapsed : 0, "submissions/s");
+
+    grade_free(b.g);
+    free(b.commands);
+    free(b.exercises);
+    free(b.verdicts);
+    free(heads);
+    free(data);
+    return rc;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: a course of exercises, each with rewrites of its answer that
+// must be accepted and near misses that must not, graded in bulk on one
+// thread and then on every CPU
+
+static const struct {
+    const char* answer;
+    int check_output;
+    const char* right[4];
+    const char* wrong[3];
+    const char* same[2];    // check output: other commands that print the same
+} bench_exercises[] = {
+    { "tail -n 5 /etc/passwd", 0,
+      { "tail -5 /etc/passwd", "cat /etc/passwd | tail -n5", "tail --lines=5 '/etc/passwd'", "tail /etc/passwd -n 5" },
+      { "tail -n 6 /etc/passwd", "head -n 5 /etc/passwd", "tail -n 5 /etc/group" },
+      { NULL, NULL } },
+    { "ls -la /etc", 0,
+      { "ls -al /etc/", "ls -l -a /etc", "ls --all -l /etc", "ls /etc -la" },
+      { "ls -l /etc", "ls -la /var", "ls -lah /etc" },
+      { NULL, NULL } },
+    { "grep -i error /var/log/syslog", 0,
+      { "grep --ignore-case error /var/log/syslog", "cat /var/log/syslog | grep -i error",
+        "grep -i 'error' < /var/log/syslog", "grep error -i /var/log/syslog" },
+      { "grep error /var/log/syslog", "grep -iv error /var/log/syslog", "grep -i errors /var/log/syslog" },
+      { NULL, NULL } },
+    { "ss -tln", 1,
+      { "ss -ltn", "ss -nlt", "ss -t -l -n", "ss --tcp --listening --numeric" },
+      { "ss -uln", "ss -tan", "ss -tln | head -2" },
+      { "ss -tln | head -100", "ss -ntl | tail -n 100" } },
+    { "sudo journalctl -u ssh -p err -n 5", 0,
+      { "sudo journalctl -p err -u ssh -n 5", "sudo journalctl --unit=ssh --priority=err --lines=5",
+        "sudo journalctl -n5 -perr -ussh", "sudo journalctl --unit ssh -n 5 -p \"err\"" },
+      { "journalctl -u ssh -p err -n 5", "sudo journalctl -u ssh -p warning -n 5",
+        "sudo journalctl -u cron -p err -n 5" },
+      { NULL, NULL } },
+    { "find /etc -name '*.conf' | head -5", 0,
+      { "find /etc -name \"*.conf\" | head -n 5", "find /etc -name \\*.conf | head -5",
+        "find /etc/ -name '*.conf' | head --lines 5", "find /etc -name '*.conf' | head -n5" },
+      { "find /etc -name *.conf | head -5", "find /etc -name '*.conf'", "find /etc -name '*.cnf' | head -5" },
+      { NULL, NULL } },
+    { "free -h", 1,
+      { "free --human", "free  -h", "free -h --", "free --human --" },
+      { "free", "free -m", "free -h | head -1" },
+      { "free -h | head -100", "free --human | tail -n 100" } },
+    // Each run adds the same user: none may see another's, nor save it
+    { "sudo adduser zed", 1,
+      { "sudo adduser 'zed'", "sudo  adduser zed", "sudo adduser \"zed\"", "sudo adduser z\\ed" },
+      { "sudo adduser zed2", "adduser zed", "sudo adduser admin" },
+      { "sudo adduser zed | head -100", "sudo adduser zed | tail -n 100" } },
+};
+#define BENCH_EXERCISES (sizeof(bench_exercises) / sizeof(bench_exercises[0]))
+
+// The bench's $DEB1_ACCOUNTS, which grading must leave as it was
+static const char* const bench_accounts[][2] = {
+    { "passwd", "root:x:0:0:root:/root:/bin/bash\nadmin:x:1000:1000:Admin,,,:/home/admin:/bin/bash\n" },
+    { "group", "root:x:0:\nsudo:x:27:admin\nadmin:x:1000:\n" },
+    { "shadow", "root:*:19640:0:99999:7:::\nadmin:!:19640:0:99999:7:::\n" },
+};
+#define BENCH_ACCOUNT_FILES (sizeof(bench_accounts) / sizeof(bench_accounts[0]))
+
+static int write_bench_accounts(const char* dir) {
+    char path[256];
+    size_t i;
+
+    for (i = 0; i < BENCH_ACCOUNT_FILES; i++) {
+        FILE* fp;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, bench_accounts[i][0]);
+        if (!(fp = fopen(path, "w"))) return -1;
+        fputs(bench_accounts[i][1], fp);
+        if (fclose(fp) != 0) return -1;
+    }
+    return 0;
+}
+
+// Whether the directory holds the account files as written and nothing
+// else (saving would have left "passwd-" backups); removes it either way
+static int bench_accounts_intact(const char* dir) {
+    DIR* d = opendir(dir);
+    struct dirent* de;
+    char path[512];
+    int intact = d != NULL;
+
+    while (d && (de = readdir(d)) != NULL) {
+        size_t i, len = 0;
+        char* data;
+
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        for (i = 0; i < BENCH_ACCOUNT_FILES && strcmp(bench_accounts[i][0], de->d_name) != 0; i++) {
+        }
+        data = read_all(path, &len);
+        if (i == BENCH_ACCOUNT_FILES || !data || strcmp(data, bench_accounts[i][1]) != 0) {
+            fprintf(stderr, "grade: grading changed %s\n", path);
+            intact = 0;
+        }
+        free(data);
+        unlink(path);
+    }
+    if (d) closedir(d);
+    rmdir(dir);
+    return intact;
+}
+
+static int write_bench_course(const char* path) {
+    FILE* fp = fopen(path, "w");
+    size_t i;
+
+    if (!fp) return -1;
+    fprintf(fp, "pack Grading benchmark\ntopic Exercises\n  section All\n");
+    for (i = 0; i < BENCH_EXERCISES; i++) {
+        fprintf(fp, "    task Exercise %zu\n    answer %s\n", i + 1, bench_exercises[i].answer);
+        if (bench_exercises[i].check_output) fprintf(fp, "    check output\n");
+    }
+    return fclose(fp);
+}
+
+int grade_bench(int argc, char** argv) {
+    long n = argc > 0 ? atol(argv[0]) : 200000;
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char path[] = "/tmp/deb1-grade-XXXXXX";
+    char accounts[] = "/tmp/deb1-grade-accounts-XXXXXX";
+    char err[256], form[MAX_FORM];
+    lesson_pack_t pack;
+    uint8_t* expected;
+    batch_t b;
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    double start, one, all, normalize;
+    long i, mismatches = 0, by_output = 0;
+    int fd, rc = 0;
+
+    if (n < 1000) n = 1000;
+    if (cpus < 1) cpus = 1;
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    if (write_bench_course(path) < 0 || lesson_pack_compile_file(&pack, path, err, sizeof(err)) < 0) {
+        fprintf(stderr, "grade: %s\n", err);
+        unlink(path);
+        return 1;
+    }
+    unlink(path);
+
+    // Output checks run against a shared account database, as a classroom
+    // would have them
+    if (!mkdtemp(accounts) || write_bench_accounts(accounts) < 0) {
+        perror(accounts);
+        lesson_pack_close(&pack);
+        return 1;
+    }
+    setenv("DEB1_ACCOUNTS", accounts, 1);
+
+    // A submission in four is a rewrite of the answer (or, where output is
+    // checked, half the time another command printing the same), one in
+    // four a near miss, the rest the answer as written
+    memset(&b, 0, sizeof(b));
+    b.g = grade_load(&pack);
+    b.n = (uint32_t)n;
+    b.commands = xrealloc(NULL, b.n * sizeof(b.commands[0]));
+    b.exercises = xrealloc(NULL, b.n * sizeof(b.exercises[0]));
+    b.verdicts = xrealloc(NULL, b.n);
+    expected = xrealloc(NULL, b.n);
+    for (i = 0; i < n; i++) {
+        size_t e, v;
+        uint32_t r;
+
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        r = (uint32_t)(state >> 16);
+        e = r % BENCH_EXERCISES;
+        v = (r >> 8) % 4;
+        b.exercises[i] = (uint32_t)e;
+        switch ((r >> 12) % 4) {
+            case 0:
+                b.commands[i] = (char*)bench_exercises[e].right[v];
+                expected[i] = GRADE_RIGHT;
+                if (bench_exercises[e].check_output && v >= 2) {
+                    b.commands[i] = (char*)bench_exercises[e].same[v - 2];
+                    expected[i] = GRADE_SAME_OUTPUT;
+                }
+                break;
+            case 1:
+                b.commands[i] = (char*)bench_exercises[e].wrong[v % 3];
+                expected[i] = GRADE_WRONG;
+                break;
+            default:
+                b.commands[i] = (char*)bench_exercises[e].answer;
+                expected[i] = GRADE_RIGHT;
+                break;
+        }
+        by_output += bench_exercises[e].check_output && expected[i] != GRADE_RIGHT;
+    }
+
+    start = bench_now();
+    for (i = 0; i < n; i++) grade_normalize(b.commands[i], form, sizeof(form));
+    normalize = (bench_now() - start) / n;
+
+    start = bench_now();
+    grade_lines(&b, 1);
+    one = bench_now() - start;
+    for (i = 0; i < n; i++) {
+        if (b.verdicts[i] != expected[i] && mismatches++ < 5) {
+            fprintf(stderr, "grade: exercise %u, \"%s\": %s, expected %s\n", b.exercises[i] + 1, b.commands[i],
+                    grade_verdict_name(b.verdicts[i]), grade_verdict_name(expected[i]));
+        }
+    }
+
+    memset(b.verdicts, 0, b.n);
+    start = bench_now();
+    grade_lines(&b, cpus);
+    all = bench_now() - start;
+    for (i = 0; i < n; i++) mismatches += b.verdicts[i] != expected[i];
+
+    bench_report("grade", "normalize", normalize * 1e9, "ns");
+    bench_report("grade", "submissions", n, "count");
+    bench_report("grade", "output_checked", by_output, "count");
+    bench_report("grade", "one_thread", n / one, "submissions/s");
+    bench_report("grade", "all_threads", n / all, "submissions/s");
+    bench_report("grade", "threads", cpus, "count");
+    bench_report("grade", "speedup", one / all, "x");
+    if (mismatches) {
+        fprintf(stderr, "grade: %ld verdicts differ from the expected ones\n", mismatches);
+        rc = 1;
+    }
+    if (!bench_accounts_intact(accounts)) rc = 1;
+
+    grade_free(b.g);
+    lesson_pack_close(&pack);
+    free(b.commands);
+    free(b.exercises);
+    free(b.verdicts);
+    free(expected);
+    return rc;
+}
@@ -0,0 +1,89 @@
+#ifndef GRADE_H
+#define GRADE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "lesson_pack.h"
+
+// Exercises: the learner types a command for a task, and it is checked
+// against the accepted answers of the lesson pack's exercise steps.
+//
+// Commands are compared in a normal form, not as text. The tokenizer
+// removes quoting ('a b', "a b" and a\ b are one word) but keeps apart
+// what the shell would not treat alike: an unquoted * or $ is not a
+// quoted one. For the programs in the table in grade.c, options are
+// parsed the way getopt does: clusters are split (-tln is -t -l -n), a
+// value is the same however it is attached (-n5, -n 5, --lines=5,
+// --lines 5 and, for head and tail, -5), long options become their short
+// forms, and options are sorted, since neither their order nor whether
+// they come before the operands matters. A file read through "cat FILE |"
+// or "< FILE" counts as the operand it could have been, and a trailing /
+// on an operand is dropped. Other programs keep their words as written.
+// Each accepted answer is normalized once, when the exercises are loaded,
+// and kept as a hash of its normal form.
+//
+// An exercise marked "check output" also accepts a command that prints
+// what its first answer does, and exits with the same status, when both
+// run on a fresh simulated machine (sim.h). With $DEB1_ACCOUNTS that
+// machine starts from the shared account database, but changes a private
+// copy of it, so grading never writes the account files.
+
+typedef enum {
+    GRADE_WRONG,
+    GRADE_RIGHT,            // the normal form of an accepted answer
+    GRADE_SAME_OUTPUT,      // a different command with the same output
+    GRADE_UNREADABLE        // unbalanced quotes, too long, nothing to run
+} grade_verdict_t;
+
+typedef struct {
+    uint32_t step;          // in the lesson pack
+    uint32_t first_form, n_forms;
+    int check_output;
+
+    // The first answer's run, made when a command first needs it
+    int expected_ready;
+    int expected_status;
+    uint64_t expected_output;
+} grade_exercise_t;
+
+typedef struct grade_set {
+    const lesson_pack_t* pack;
+    grade_exercise_t* exercises;    // in pack order
+    uint32_t n_exercises;
+    uint64_t* forms;        // normal-form hashes of the accepted answers
+    uint32_t n_forms;
+    pthread_mutex_t lock;   // the expected runs
+} grade_set_t;
+
+// The exercises of a pack; answers that cannot be read are reported on
+// stderr and left out
+grade_set_t* grade_load(const lesson_pack_t* pack);
+void grade_free(grade_set_t* g);
+
+// The exercise number of a step, or -1 if the step is not an exercise
+int grade_exercise_of(const grade_set_t* g, uint32_t step);
+// An exercise's n-th accepted answer into buf (0 is the model answer);
+// NULL past the last
+const char* grade_answer(const grade_set_t* g, uint32_t exercise, uint32_t n, char* buf, size_t len);
+
+// The normal form of a command into out, words separated by \x1f (see
+// grade.c). Returns its length, or -1 when the command cannot be read or
+// the form does not fit.
+int grade_normalize(const char* command, char* out, size_t len);
+
+// Grade a command for an exercise. Safe to call from several threads.
+grade_verdict_t grade_check(grade_set_t* g, uint32_t exercise, const char* command);
+const char* grade_verdict_name(grade_verdict_t v);
+
+// Grade a file of submissions, a line each: [LEARNER<TAB>]EXERCISE<TAB>COMMAND
+// with exercises numbered from 1 in pack order, on threads threads (0:
+// one per CPU). With output_path, each line's fields before the command
+// are written there with the verdict. Reports throughput; returns 0, or
+// 1 if the file cannot be read or written.
+int grade_batch(const lesson_pack_t* pack, const char* path, int threads, const char* output_path);
+
+// --bench grade [submissions]
+int grade_bench(int argc, char** argv);
+
+#endif
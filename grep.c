@@ -0,0 +1,902 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <dirent.h>
+#endif
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "logsim.h"
+#include "grep.h"
+#include "bench.h"
+#include "util.h"
+
+#define OUTPUT_BUFFER (64 << 10)
+#define AHEAD_PER_THREAD 4          // pieces a worker may finish before they are written
+
+// ---------------------------------------------------------------------
+// Scanners
+
+typedef struct {
+    unsigned char text[MAX_INPUT];  // folded to lower case with -i
+    size_t len;
+    int ignore_case;
+    unsigned char first[2], last[2];    // first and last byte, both cases
+} needle_t;
+
+typedef const char* (*find_fn)(const needle_t* n, const char* p, const char* end);
+
+static unsigned char fold[256];
+static pthread_once_t fold_once = PTHREAD_ONCE_INIT;
+
+static void init_fold(void) {
+    int i;
+
+    for (i = 0; i < 256; i++) fold[i] = (unsigned char)(i >= 'A' && i <= 'Z' ? i + 32 : i);
+}
+
+static int init_needle(needle_t* n, const char* pattern, int ignore_case) {
+    size_t i;
+
+    pthread_once(&fold_once, init_fold);
+    n->len = strlen(pattern);
+    if (n->len > sizeof(n->text)) return -ENAMETOOLONG;
+    n->ignore_case = ignore_case;
+    for (i = 0; i < n->len; i++) {
+        n->text[i] = ignore_case ? fold[(unsigned char)pattern[i]] : (unsigned char)pattern[i];
+    }
+    if (!n->len) return 0;
+    n->first[0] = n->first[1] = n->text[0];
+    n->last[0] = n->last[1] = n->text[n->len - 1];
+    if (ignore_case && n->text[0] >= 'a' && n->text[0] <= 'z') n->first[1] = (unsigned char)(n->text[0] - 32);
+    if (ignore_case && n->last[0] >= 'a' && n->last[0] <= 'z') n->last[1] = (unsigned char)(n->last[0] - 32);
+    return 0;
+}
+
+// The bytes between the first and last, which the scanners already matched
+static inline int confirm(const needle_t* n, const char* p) {
+    size_t i;
+
+    if (n->len <= 2) return 1;
+    if (!n->ignore_case) return memcmp(p + 1, n->text + 1, n->len - 2) == 0;
+    for (i = 1; i < n->len - 1; i++) {
+        if (fold[(unsigned char)p[i]] != n->text[i]) return 0;
+    }
+    return 1;
+}
+
+static const char* find_memchr(const needle_t* n, const char* p, const char* end) {
+    size_t m = n->len;
+
+    if (!n->ignore_case) {
+        while ((size_t)(end - p) >= m) {
+            p = memchr(p, n->first[0], (size_t)(end - p) - m + 1);
+            if (!p) return NULL;
+            if ((unsigned char)p[m - 1] == n->last[0] && confirm(n, p)) return p;
+            p++;
+        }
+        return NULL;
+    }
+    for (; (size_t)(end - p) >= m; p++) {
+        unsigned char a = (unsigned char)p[0], b = (unsigned char)p[m - 1];
+
+        if ((a == n->first[0] || a == n->first[1]) && (b == n->last[0] || b == n->last[1]) && confirm(n, p)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef __SSE2__
+static const char* find_sse2(const needle_t* n, const char* p, const char* end) {
+    const size_t m = n->len;
+    const __m128i f0 = _mm_set1_epi8((char)n->first[0]), f1 = _mm_set1_epi8((char)n->first[1]);
+    const __m128i l0 = _mm_set1_epi8((char)n->last[0]), l1 = _mm_set1_epi8((char)n->last[1]);
+
+    // Position i is a candidate when p[i] is the first byte and
+    // p[i + m - 1] the last
+    while ((size_t)(end - p) >= m + 15) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + m - 1));
+        __m128i hit = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(a, f0), _mm_cmpeq_epi8(a, f1)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(b, l0), _mm_cmpeq_epi8(b, l1)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+
+        while (mask) {
+            const char* c = p + __builtin_ctz(mask);
+
+            if (confirm(n, c)) return c;
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+    return find_memchr(n, p, end);
+}
+#endif
+
+__attribute__((target("avx2")))
+static const char* find_avx2(const needle_t* n, const char* p, const char* end) {
+    const size_t m = n->len;
+    const __m256i f0 = _mm256_set1_epi8((char)n->first[0]), f1 = _mm256_set1_epi8((char)n->first[1]);
+    const __m256i l0 = _mm256_set1_epi8((char)n->last[0]), l1 = _mm256_set1_epi8((char)n->last[1]);
+
+    while ((size_t)(end - p) >= m + 31) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)p);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + m - 1));
+        __m256i hit = _mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi8(a, f0), _mm256_cmpeq_epi8(a, f1)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(b, l0), _mm256_cmpeq_epi8(b, l1)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+
+        while (mask) {
+            const char* c = p + __builtin_ctz(mask);
+
+            if (confirm(n, c)) return c;
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+    return find_memchr(n, p, end);
+}
+#endif
+
+static find_fn find;
+static const char* scanner_name;
+static pthread_once_t scanner_once = PTHREAD_ONCE_INIT;
+
+static void pick_scanner(void) {
+    find = find_memchr;
+    scanner_name = "memchr";
+#if defined(__x86_64__) || defined(__i386__)
+#ifdef __SSE2__
+    find = find_sse2;
+    scanner_name = "sse2";
+#endif
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        find = find_avx2;
+        scanner_name = "avx2";
+    }
+#endif
+}
+
+const char* grep_scanner(void) {
+    pthread_once(&scanner_once, pick_scanner);
+    return scanner_name;
+}
+
+struct grep_needle {
+    needle_t n;
+};
+
+grep_needle_t* grep_needle_new(const char* pattern, int ignore_case) {
+    grep_needle_t* g = xrealloc(NULL, sizeof(*g));
+
+    pthread_once(&scanner_once, pick_scanner);
+    if (init_needle(&g->n, pattern, ignore_case) < 0) {
+        free(g);
+        return NULL;
+    }
+    return g;
+}
+
+const char* grep_needle_find(const grep_needle_t* g, const char* p, const char* end) {
+    return g->n.len ? find(&g->n, p, end) : p;
+}
+
+void grep_needle_free(grep_needle_t* g) {
+    free(g);
+}
+
+static uint64_t count_newlines(const char* p, const char* end) {
+    uint64_t n = 0;
+
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        n++;
+        p++;
+    }
+    return n;
+}
+
+// ---------------------------------------------------------------------
+// Search
+
+typedef struct {
+    const char* data;       // the mapping; NULL if empty or unreadable
+    size_t size;
+    int error;              // errno from opening it
+    int found;              // -l: written already, the rest can be skipped
+    uint64_t count;         // -c
+    uint64_t lines_before;  // -n: lines in the pieces already written
+} mapped_t;
+
+typedef struct {
+    uint64_t start;
+    uint32_t len;           // without the newline
+    uint64_t line;          // -n: lines before it in the piece
+} match_t;
+
+typedef struct {
+    uint32_t file;
+    int last;               // last piece of its file
+    size_t lo, hi;
+    match_t* matches;
+    size_t n_matches, cap;
+    uint64_t selected;
+    uint64_t newlines;      // -n: lines in the piece
+    int done;
+} piece_t;
+
+typedef struct {
+    const grep_opts_t* opts;
+    const grep_file_t* files;
+    needle_t needle;
+    mapped_t* maps;
+    piece_t* pieces;
+    uint32_t n_pieces;
+    uint64_t wanted;        // most lines one piece needs to record
+
+    pthread_mutex_t lock;
+    pthread_cond_t piece_done;
+    pthread_cond_t room;
+    uint32_t next;          // next piece to hand out
+    uint32_t written;       // pieces written out
+    uint32_t ahead;
+    int stop;               // enough output, or the writer failed
+    int failed;             // the writer failed
+
+    grep_write_fn write;
+    void* ctx;
+    char* out;
+    size_t out_len;
+    grep_result_t* result;
+} search_t;
+
+// The writing thread sets stop, workers poll it between hits
+static void halt(search_t* s) {
+    __atomic_store_n(&s->stop, 1, __ATOMIC_RELAXED);
+}
+
+static int stopped(search_t* s) {
+    return __atomic_load_n(&s->stop, __ATOMIC_RELAXED);
+}
+
+static void fail(search_t* s) {
+    s->failed = 1;
+    halt(s);
+}
+
+static void select_line(search_t* s, piece_t* c, const char* base, const char* line, const char* end,
+                        const char** counted, uint64_t* lines) {
+    const grep_opts_t* o = s->opts;
+
+    c->selected++;
+    if (o->count || o->files_with_matches || o->quiet) return;
+    if (o->line_number) {
+        *lines += count_newlines(*counted, line);
+        *counted = line;
+    }
+    if (c->n_matches == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 64;
+        c->matches = xrealloc(c->matches, c->cap * sizeof(match_t));
+    }
+    c->matches[c->n_matches].start = (uint64_t)(line - base);
+    c->matches[c->n_matches].len = (uint32_t)(end - line);
+    c->matches[c->n_matches++].line = *lines;
+}
+
+// Lines that start in [lo, hi) belong to the piece
+static void scan_piece(search_t* s, piece_t* c) {
+    const grep_opts_t* o = s->opts;
+    mapped_t* f = &s->maps[c->file];
+    const char* base = f->data;
+    const char *p, *end, *counted;
+    uint64_t lines = 0;
+    size_t lo = c->lo, hi = c->hi;
+
+    if (!base || __atomic_load_n(&f->found, __ATOMIC_RELAXED)) return;
+    if (lo > 0 && base[lo - 1] != '\n') {
+        p = memchr(base + lo, '\n', f->size - lo);
+        lo = p ? (size_t)(p - base) + 1 : f->size;
+    }
+    if (hi < f->size && base[hi - 1] != '\n') {
+        p = memchr(base + hi, '\n', f->size - hi);
+        hi = p ? (size_t)(p - base) + 1 : f->size;
+    }
+    if (lo >= hi) return;
+
+    p = counted = base + lo;
+    end = base + hi;
+    while (p < end && c->selected < s->wanted) {
+        const char* hit = s->needle.len ? find(&s->needle, p, end) : p;
+        const char* line = end;
+        const char* eol;
+
+        if (hit) {
+            line = memrchr(p, '\n', (size_t)(hit - p));
+            line = line ? line + 1 : p;
+        }
+        // With -v the lines before the matching one are selected
+        while (o->invert && p < line && c->selected < s->wanted) {
+            eol = memchr(p, '\n', (size_t)(line - p));
+            if (!eol) eol = line;
+            select_line(s, c, base, p, eol, &counted, &lines);
+            p = eol + 1;
+        }
+        if (!hit) break;
+        eol = memchr(hit, '\n', (size_t)(end - hit));
+        if (!eol) eol = end;
+        if (!o->invert) select_line(s, c, base, line, eol, &counted, &lines);
+        p = eol + 1;
+        if (stopped(s)) break;
+    }
+    if (o->line_number) c->newlines = lines + count_newlines(counted, end);
+}
+
+static void* search_worker(void* arg) {
+    search_t* s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        piece_t* c;
+
+        while (!stopped(s) && s->next < s->n_pieces && s->next >= s->written + s->ahead) {
+            pthread_cond_wait(&s->room, &s->lock);
+        }
+        if (stopped(s) || s->next >= s->n_pieces) break;
+        c = &s->pieces[s->next++];
+        pthread_mutex_unlock(&s->lock);
+        scan_piece(s, c);
+        pthread_mutex_lock(&s->lock);
+        c->done = 1;
+        pthread_cond_broadcast(&s->piece_done);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+// Flushing after a stop is fine, unless the stop was the writer failing
+static void flush_output(search_t* s) {
+    if (s->out_len && !s->failed && s->write(s->ctx, s->out, s->out_len) != 0) fail(s);
+    s->out_len = 0;
+}
+
+static void emit(search_t* s, const char* a, size_t a_len, const char* b, size_t b_len) {
+    if (s->out_len + a_len + b_len + 1 > OUTPUT_BUFFER) flush_output(s);
+    if (a_len + b_len + 1 > OUTPUT_BUFFER) {
+        if (!s->failed && (s->write(s->ctx, a, a_len) || s->write(s->ctx, b, b_len) || s->write(s->ctx, "\n", 1))) {
+            fail(s);
+        }
+    } else {
+        memcpy(s->out + s->out_len, a, a_len);
+        memcpy(s->out + s->out_len + a_len, b, b_len);
+        s->out_len += a_len + b_len;
+        s->out[s->out_len++] = '\n';
+    }
+    if (++s->result->output_lines >= (uint64_t)s->opts->max_lines && s->opts->max_lines >= 0) halt(s);
+}
+
+// Write a finished piece out: its lines, or the file's count or name
+static void write_piece(search_t* s, piece_t* c) {
+    const grep_opts_t* o = s->opts;
+    const grep_file_t* file = &s->files[c->file];
+    mapped_t* f = &s->maps[c->file];
+    char prefix[4096 + 32];
+    size_t name_len = strlen(file->name), i;
+
+    if (f->error && c->lo == 0) {
+        char msg[4096 + 64];
+        int n = snprintf(msg, sizeof(msg), "grep: %s: %s\n", file->name, strerror(f->error));
+
+        s->result->errors++;
+        if (o->no_messages) return;
+        flush_output(s);
+        if (s->write(s->ctx, msg, (size_t)n < sizeof(msg) ? (size_t)n : sizeof(msg) - 1)) fail(s);
+        return;
+    }
+    s->result->lines += c->selected;
+    if (o->quiet) {
+        if (c->selected) halt(s);
+    } else if (o->files_with_matches) {
+        if (c->selected && !f->found) {
+            __atomic_store_n(&f->found, 1, __ATOMIC_RELAXED);
+            emit(s, file->name, name_len, "", 0);
+        }
+    } else if (o->count) {
+        f->count += c->selected;
+        if (c->last) {
+            int n = snprintf(prefix, sizeof(prefix), "%s%s%llu", o->with_filename ? file->name : "",
+                             o->with_filename ? ":" : "", (unsigned long long)f->count);
+
+            emit(s, prefix, (size_t)n < sizeof(prefix) ? (size_t)n : sizeof(prefix) - 1, "", 0);
+        }
+    } else {
+        for (i = 0; i < c->n_matches && !stopped(s); i++) {
+            const match_t* m = &c->matches[i];
+            size_t n = 0;
+
+            if (o->with_filename) n = (size_t)snprintf(prefix, sizeof(prefix), "%s:", file->name);
+            if (n >= sizeof(prefix)) n = sizeof(prefix) - 1;
+            if (o->line_number) {
+                n += (size_t)snprintf(prefix + n, sizeof(prefix) - n, "%llu:",
+                                      (unsigned long long)(f->lines_before + m->line + 1));
+            }
+            emit(s, prefix, n, f->data + m->start, m->len);
+        }
+        f->lines_before += c->newlines;
+    }
+}
+
+int grep_search(const grep_opts_t* opts, const grep_file_t* files, int n_files, grep_write_fn write, void* ctx,
+                grep_result_t* result) {
+    search_t s;
+    pthread_t threads[GREP_MAX_THREADS];
+    int n_threads = opts->threads, started = 0, i;
+    uint32_t p;
+
+    pthread_once(&scanner_once, pick_scanner);
+    if (opts->max_lines == 0) return 0;
+    memset(&s, 0, sizeof(s));
+    if (init_needle(&s.needle, opts->pattern, opts->ignore_case) < 0) return -ENAMETOOLONG;
+    s.opts = opts;
+    s.files = files;
+    s.write = write;
+    s.ctx = ctx;
+    s.result = result;
+    s.wanted = UINT64_MAX;
+    if (opts->quiet || opts->files_with_matches) {
+        s.wanted = 1;
+    } else if (!opts->count && opts->max_lines > 0) {
+        s.wanted = (uint64_t)opts->max_lines;
+    }
+
+    // Map every file and cut it into pieces; an empty or unreadable file
+    // still gets one, so its count or error comes out in order
+    s.maps = calloc((size_t)n_files, sizeof(mapped_t));
+    for (i = 0; i < n_files; i++) {
+        mapped_t* f = &s.maps[i];
+        int fd = open(files[i].path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+
+        if (fd < 0 || fstat(fd, &st) < 0) {
+            f->error = errno;
+        } else if (S_ISDIR(st.st_mode)) {
+            f->error = EISDIR;
+        } else if (st.st_size > 0) {
+            void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (map == MAP_FAILED) {
+                f->error = errno;
+            } else {
+                madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+                f->data = map;
+                f->size = (size_t)st.st_size;
+                result->bytes += f->size;
+            }
+        }
+        if (fd >= 0) close(fd);
+        s.n_pieces += f->size ? (uint32_t)((f->size + GREP_CHUNK - 1) / GREP_CHUNK) : 1;
+    }
+    s.pieces = calloc(s.n_pieces ? s.n_pieces : 1, sizeof(piece_t));
+    for (i = 0, p = 0; i < n_files; i++) {
+        size_t lo = 0;
+
+        do {
+            s.pieces[p].file = (uint32_t)i;
+            s.pieces[p].lo = lo;
+            lo = lo + GREP_CHUNK < s.maps[i].size ? lo + GREP_CHUNK : s.maps[i].size;
+            s.pieces[p].hi = lo;
+            s.pieces[p].last = lo == s.maps[i].size;
+            p++;
+        } while (lo < s.maps[i].size);
+    }
+    s.out = malloc(OUTPUT_BUFFER);
+
+    if (n_threads <= 0) n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_threads > GREP_MAX_THREADS) n_threads = GREP_MAX_THREADS;
+    if ((uint32_t)n_threads > s.n_pieces) n_threads = (int)s.n_pieces;
+    s.ahead = (uint32_t)n_threads * AHEAD_PER_THREAD;
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.piece_done, NULL);
+    pthread_cond_init(&s.room, NULL);
+    if (n_threads > 1) {
+        for (started = 0; started < n_threads; started++) {
+            if (pthread_create(&threads[started], NULL, search_worker, &s) != 0) break;
+        }
+    }
+
+    // Without workers this thread scans each piece itself
+    for (p = 0; p < s.n_pieces && !stopped(&s); p++) {
+        piece_t* c = &s.pieces[p];
+
+        if (started) {
+            pthread_mutex_lock(&s.lock);
+            while (!c->done) pthread_cond_wait(&s.piece_done, &s.lock);
+            pthread_mutex_unlock(&s.lock);
+        } else {
+            scan_piece(&s, c);
+        }
+        write_piece(&s, c);
+        free(c->matches);
+        c->matches = NULL;
+        pthread_mutex_lock(&s.lock);
+        s.written = p + 1;
+        pthread_cond_broadcast(&s.room);
+        pthread_mutex_unlock(&s.lock);
+    }
+    flush_output(&s);
+
+    pthread_mutex_lock(&s.lock);
+    halt(&s);
+    pthread_cond_broadcast(&s.room);
+    pthread_mutex_unlock(&s.lock);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    for (p = 0; p < s.n_pieces; p++) free(s.pieces[p].matches);
+    for (i = 0; i < n_files; i++) {
+        if (s.maps[i].data) munmap((void*)s.maps[i].data, s.maps[i].size);
+    }
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.piece_done);
+    pthread_cond_destroy(&s.room);
+    free(s.out);
+    free(s.pieces);
+    free(s.maps);
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// The simulated command
+
+typedef struct {
+    grep_file_t* items;
+    int n, cap;
+} file_list_t;
+
+static void add_file(file_list_t* list, const char* path, const char* name) {
+    if (list->n == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 16;
+        list->items = xrealloc(list->items, (size_t)list->cap * sizeof(grep_file_t));
+    }
+    list->items[list->n].path = strdup(path);
+    list->items[list->n++].name = strdup(name);
+}
+
+static void free_files(file_list_t* list) {
+    int i;
+
+    for (i = 0; i < list->n; i++) {
+        free((char*)list->items[i].path);
+        free((char*)list->items[i].name);
+    }
+    free(list->items);
+}
+
+// The real file behind a simulated one: /var/log comes from the corpus
+// and an empty file reads as /dev/null. Anything else has no contents to
+// search, so the command is left to the canned output.
+static int backing_file(const char* corpus, const char* vfs_file, uint64_t size, char* out, size_t len) {
+    static const char prefix[] = "/var/log/";
+
+    if (corpus && strncmp(vfs_file, prefix, sizeof(prefix) - 1) == 0) {
+        snprintf(out, len, "%s/%s", corpus, vfs_file + sizeof(prefix) - 1);
+        if (access(out, R_OK) == 0) return 0;
+    }
+    if (size > 0) return -1;
+    snprintf(out, len, "/dev/null");
+    return 0;
+}
+
+static void join(char* out, size_t len, const char* dir, const char* name) {
+    size_t n = strlen(dir);
+
+    while (n > 1 && dir[n - 1] == '/') n--;
+    if (n == 0) {
+        snprintf(out, len, "%s", name);
+    } else {
+        snprintf(out, len, "%.*s%s%s", (int)n, dir, dir[n - 1] == '/' ? "" : "/", name);
+    }
+}
+
+// Files under a directory in the order grep -r visits them (sorted)
+static int walk(const sim_env_t* env, const char* corpus, uint32_t dir, const char* name, file_list_t* list) {
+    const vfs_inode_t* node = vfs_inode(env->vfs, dir);
+    vfs_dirent_t* children = malloc((node->n_children ? node->n_children : 1) * sizeof(vfs_dirent_t));
+    char dir_path[4096], vfs_file[4096 + 256], child_name[4096 + 256], real[4096];
+    uint32_t i;
+    int rc = 0;
+
+    vfs_sorted_children(env->vfs, dir, children);
+    vfs_path(env->vfs, dir, dir_path, sizeof(dir_path));
+    for (i = 0; i < node->n_children && rc == 0; i++) {
+        const vfs_inode_t* child = vfs_inode(env->vfs, children[i].ino);
+        const char* base = vfs_name(env->vfs, children[i].name);
+
+        join(child_name, sizeof(child_name), name, base);
+        if (S_ISDIR(child->mode)) {
+            rc = walk(env, corpus, children[i].ino, child_name, list);
+        } else if (S_ISREG(child->mode)) {
+            join(vfs_file, sizeof(vfs_file), dir_path, base);
+            rc = backing_file(corpus, vfs_file, child->size, real, sizeof(real));
+            if (rc == 0) add_file(list, real, child_name);
+        }
+    }
+    free(children);
+    return rc;
+}
+
+// Stops the search once a pipeline has read all it wants
+static int write_console(void* ctx, const char* data, size_t len) {
+    (void)ctx;
+    con_write(data, len);
+    return con_stopped();
+}
+
+int grep_cmd(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    const char* corpus = logsim_corpus();
+    static char dot[] = ".";
+    char* here[1] = { dot };
+    char** operands;
+    file_list_t files = { NULL, 0, 0 };
+    grep_opts_t opts;
+    grep_result_t result;
+    sim_opts_t o;
+    int n_operands, recursive, i;
+
+    if (sim_getopt(argc, argv, "rRivclnHhFqsE", &o) < 0) return 2;
+    for (i = 0; i < o.n_longs; i++) {
+        if (strncmp(o.longs[i], "color", 5) != 0 && strncmp(o.longs[i], "colour", 6) != 0) return -1;
+    }
+    if (o.n_operands < 1) return -1;
+    // Only fixed strings are searched; a pattern that is a regular
+    // expression gets the lesson's output
+    if (!SIM_HAS(&o, 'F') && (strpbrk(argv[1], "\\.[]*^$") ||
+                              (SIM_HAS(&o, 'E') && strpbrk(argv[1], "+?{}|()")))) {
+        return -1;
+    }
+    recursive = SIM_HAS(&o, 'r') || SIM_HAS(&o, 'R');
+    operands = argv + 2;
+    n_operands = o.n_operands - 1;
+    if (n_operands == 0) {
+        // Standard input is not simulated
+        if (!recursive) return -1;
+        operands = here;
+        n_operands = 1;
+    }
+
+    for (i = 0; i < n_operands; i++) {
+        char name[256], dir_path[4096], vfs_file[4096 + 256], real[4096];
+        uint32_t ino, dir;
+        const vfs_inode_t* node;
+        int rc = 0;
+
+        // A missing file or a directory without -r is reported by
+        // opening something that fails the same way
+        if (vfs_resolve(env->vfs, env->cwd, operands[i], &ino) != 0) {
+            add_file(&files, "", operands[i]);
+            continue;
+        }
+        node = vfs_inode(env->vfs, ino);
+        if (S_ISDIR(node->mode)) {
+            if (!recursive) {
+                add_file(&files, "/", operands[i]);
+            } else {
+                // "grep -r x" with no operand prints names without "./"
+                rc = walk(env, corpus, ino, operands == here ? "" : operands[i], &files);
+            }
+        } else if (vfs_resolve_parent(env->vfs, env->cwd, operands[i], &dir, name, sizeof(name)) == 0) {
+            vfs_path(env->vfs, dir, dir_path, sizeof(dir_path));
+            join(vfs_file, sizeof(vfs_file), dir_path, name);
+            rc = backing_file(corpus, vfs_file, node->size, real, sizeof(real));
+            if (rc == 0) add_file(&files, real, operands[i]);
+        }
+        if (rc < 0) {
+            free_files(&files);
+            return -1;
+        }
+    }
+
+    memset(&opts, 0, sizeof(opts));
+    opts.pattern = argv[1];
+    opts.ignore_case = SIM_HAS(&o, 'i');
+    opts.invert = SIM_HAS(&o, 'v');
+    opts.count = SIM_HAS(&o, 'c');
+    opts.files_with_matches = SIM_HAS(&o, 'l');
+    opts.line_number = SIM_HAS(&o, 'n');
+    opts.with_filename = SIM_HAS(&o, 'H') || (!SIM_HAS(&o, 'h') && (recursive || files.n > 1));
+    opts.quiet = SIM_HAS(&o, 'q');
+    opts.no_messages = SIM_HAS(&o, 's');
+    opts.max_lines = sim_line_limit();
+    memset(&result, 0, sizeof(result));
+    if (grep_search(&opts, files.items, files.n, write_console, NULL, &result) < 0) {
+        free_files(&files);
+        return -1;
+    }
+    free_files(&files);
+    if (result.lines && (opts.quiet || !result.errors)) return 0;
+    return result.errors ? 2 : 1;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: a generated /var/log searched by the engine and by the
+// system's grep, from the page cache
+
+#define BENCH_DIR "/tmp/deb1-bench-varlog"
+#define BENCH_ROUNDS 3
+
+static int by_name(const struct dirent** a, const struct dirent** b) {
+    return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+static void collect(const char* dir, const char* name, file_list_t* list) {
+    struct dirent** entries;
+    int n = scandir(dir, &entries, NULL, by_name), i;
+
+    for (i = 0; i < n; i++) {
+        char path[1024], child[1024];
+        struct stat st;
+
+        if (entries[i]->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+            snprintf(child, sizeof(child), "%s/%s", name, entries[i]->d_name);
+            if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+                collect(path, child, list);
+            } else if (S_ISREG(st.st_mode)) {
+                add_file(list, path, child);
+            }
+        }
+        free(entries[i]);
+    }
+    if (n >= 0) free(entries);
+}
+
+typedef struct {
+    FILE* fp;
+    uint64_t bytes;
+} sink_t;
+
+static int write_sink(void* ctx, const char* data, size_t len) {
+    sink_t* sink = ctx;
+
+    sink->bytes += len;
+    if (sink->fp && fwrite(data, 1, len, sink->fp) != len) return -1;
+    return 0;
+}
+
+// Best of BENCH_ROUNDS; the total of the matching lines lands in *lines
+static double time_engine(const grep_opts_t* opts, const file_list_t* files, const char* pipe_to, uint64_t* lines) {
+    double best = 0;
+    int round;
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        grep_result_t result;
+        sink_t sink = { NULL, 0 };
+        double start = bench_now(), elapsed;
+
+        memset(&result, 0, sizeof(result));
+        if (pipe_to) sink.fp = popen(pipe_to, "w");
+        grep_search(opts, files->items, files->n, write_sink, &sink, &result);
+        if (sink.fp) pclose(sink.fp);
+        elapsed = bench_now() - start;
+        if (!best || elapsed < best) best = elapsed;
+        *lines = result.lines;
+    }
+    return best;
+}
+
+// The same for a shell command; its output is summed as numbers
+// ("NAME:COUNT" or wc's total), or counted as lines when as_lines
+static double time_system(const char* command, int as_lines, uint64_t* total) {
+    double best = 0;
+    int round;
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        char line[4096];
+        double start = bench_now(), elapsed;
+        FILE* fp = popen(command, "r");
+
+        if (!fp) return 0;
+        *total = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            const char* colon = strrchr(line, ':');
+
+            *total += as_lines ? 1 : strtoull(colon ? colon + 1 : line, NULL, 10);
+        }
+        if (pclose(fp) == -1) return 0;
+        elapsed = bench_now() - start;
+        if (!best || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int grep_bench(int argc, char** argv) {
+    uint64_t megabytes = argc > 0 ? strtoull(argv[0], NULL, 10) : 512;
+    uint64_t bytes = megabytes << 20, engine_lines = 0, system_lines = 0;
+    int threads = argc > 1 ? atoi(argv[1]) : 0;
+    const int have_grep = system("grep --version >/dev/null 2>&1") == 0;
+    static const struct {
+        const char* metric;
+        int ignore_case;
+        int count;
+        const char* flags;
+    } searches[] = {
+        { "count", 0, 1, "-rc" },
+        { "count_icase", 1, 1, "-ric" },
+        { "lines", 0, 0, "-r" },
+    };
+    file_list_t files = { NULL, 0, 0 };
+    grep_opts_t opts;
+    char command[512], metric[64];
+    double elapsed;
+    size_t i;
+
+    if (megabytes == 0) megabytes = 512;
+    bytes = megabytes << 20;
+    if (!logsim_is_complete(BENCH_DIR, bytes, LOGSIM_SEED)) {
+        double start = bench_now();
+        int rc = logsim_generate(BENCH_DIR, bytes, LOGSIM_SEED);
+
+        if (rc < 0) {
+            fprintf(stderr, "%s: %s\n", BENCH_DIR, strerror(-rc));
+            return 1;
+        }
+        bench_report("grep", "generate", bytes / (bench_now() - start) / 1e6, "MB/s");
+    }
+    collect(BENCH_DIR, BENCH_DIR, &files);
+    printf("grep: %llu MB in %d files, %s scanner, %ld cores\n", (unsigned long long)megabytes, files.n,
+           grep_scanner(), sysconf(_SC_NPROCESSORS_ONLN));
+
+    memset(&opts, 0, sizeof(opts));
+    opts.pattern = "error";
+    opts.with_filename = 1;
+    opts.max_lines = -1;
+    opts.threads = threads;
+    time_engine(&opts, &files, NULL, &engine_lines);     // into the page cache
+
+    for (i = 0; i < sizeof(searches) / sizeof(searches[0]); i++) {
+        opts.ignore_case = searches[i].ignore_case;
+        opts.count = searches[i].count;
+        // Printed lines go through a pipe to wc, as they would for GNU grep
+        elapsed = time_engine(&opts, &files, opts.count ? NULL : "wc -l >/dev/null", &engine_lines);
+        snprintf(metric, sizeof(metric), "%s_engine", searches[i].metric);
+        bench_report("grep", metric, bytes / elapsed / 1e9, "GB/s");
+        if (!have_grep) continue;
+
+        if (searches[i].count) {
+            snprintf(command, sizeof(command), "LC_ALL=C grep %s error %s", searches[i].flags, BENCH_DIR);
+        } else {
+            snprintf(command, sizeof(command), "LC_ALL=C grep %s error %s | wc -l", searches[i].flags, BENCH_DIR);
+        }
+        elapsed = time_system(command, 0, &system_lines);
+        snprintf(metric, sizeof(metric), "%s_system", searches[i].metric);
+        bench_report("grep", metric, bytes / elapsed / 1e9, "GB/s");
+        if (engine_lines != system_lines) {
+            fprintf(stderr, "grep %s: %llu matching lines, system grep found %llu\n", searches[i].flags,
+                    (unsigned long long)engine_lines, (unsigned long long)system_lines);
+        }
+    }
+
+    // "| head -3": the engine stops after three lines; GNU grep when the
+    // pipe closes
+    opts.ignore_case = opts.count = 0;
+    opts.max_lines = 3;
+    elapsed = time_engine(&opts, &files, NULL, &engine_lines);
+    bench_report("grep", "head3_engine", elapsed * 1e3, "ms");
+    if (have_grep) {
+        snprintf(command, sizeof(command), "LC_ALL=C grep -r error %s | head -3", BENCH_DIR);
+        elapsed = time_system(command, 1, &system_lines);
+        bench_report("grep", "head3_system", elapsed * 1e3, "ms");
+    }
+    free_files(&files);
+    return 0;
+}
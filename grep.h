@@ -0,0 +1,76 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fixed-string search over memory-mapped files, for the simulated grep.
+//
+// Each file is mapped read-only and cut into GREP_CHUNK pieces on line
+// boundaries. Worker threads (one per core) take the pieces in order and
+// the calling thread writes out their results in that same order, so the
+// output is what a sequential grep prints; workers run at most a few
+// pieces ahead of the writer. A piece is scanned for the pattern rather
+// than line by line: SIMD compares of the pattern's first and last bytes
+// against 16 (SSE2) or 32 (AVX2, when the CPU has it) positions at a time
+// pick candidates, memcmp confirms them, and only then are the ends of
+// the surrounding line looked for. Other architectures use memchr on the
+// first byte. When only the first lines of the output are wanted (a
+// trailing "| head"), the search stops as soon as they are written.
+
+#define GREP_CHUNK (4u << 20)
+#define GREP_MAX_THREADS 16
+
+typedef struct {
+    const char* pattern;
+    int ignore_case;        // -i (ASCII letters)
+    int invert;             // -v
+    int count;              // -c
+    int files_with_matches; // -l
+    int line_number;        // -n
+    int with_filename;
+    int quiet;              // -q: stop at the first selected line
+    int no_messages;        // -s: no "grep: NAME: ..." for unreadable files
+    long max_lines;         // output lines wanted, -1 for all
+    int threads;            // 0: one per core
+} grep_opts_t;
+
+typedef struct {
+    const char* path;       // file to read
+    const char* name;       // as printed
+} grep_file_t;
+
+typedef struct {
+    uint64_t lines;         // selected lines
+    uint64_t bytes;         // size of the files searched
+    uint64_t output_lines;
+    int errors;             // files that could not be read
+} grep_result_t;
+
+// Output goes to write(ctx, data, len), errors ("grep: NAME: ...") too; a
+// nonzero return stops the search
+typedef int (*grep_write_fn)(void* ctx, const char* data, size_t len);
+
+// Search files in order. Returns 0, or -errno if the search could not
+// start; result accumulates across calls.
+int grep_search(const grep_opts_t* opts, const grep_file_t* files, int n_files, grep_write_fn write, void* ctx,
+                grep_result_t* result);
+
+// The scanner in use: "avx2", "sse2" or "memchr"
+const char* grep_scanner(void);
+
+// The same scanner over a caller's buffer (the grep stage of a pipeline,
+// see pipeline.h). NULL if the pattern is too long.
+typedef struct grep_needle grep_needle_t;
+grep_needle_t* grep_needle_new(const char* pattern, int ignore_case);
+// First occurrence in [p, end), or NULL; an empty pattern is found at p
+const char* grep_needle_find(const grep_needle_t* g, const char* p, const char* end);
+void grep_needle_free(grep_needle_t* g);
+
+// Simulated command: searches the log corpus (logsim.h) for /var/log
+int grep_cmd(int argc, char** argv);
+
+// --bench grep [MB [threads]]
+int grep_bench(int argc, char** argv);
+
+#endif
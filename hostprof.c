@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hostprof.h"
+#include "bench.h"
+
+#define BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+// The lessons' programs and the "when missing" conditions of the
+// adaptation rules; at most 64
+const char* const hostprof_tools[] = {
+    "apt", "apt-get", "apt-cache", "dpkg", "snap", "sudo",
+    "systemctl", "journalctl", "service", "hostnamectl", "lsb_release",
+    "ip", "ss", "netstat", "ifconfig", "ufw", "iptables", "nft",
+    "getent", "useradd", "adduser", "locate", "updatedb",
+    "top", "htop", "free", "vmstat", "uptime", "lscpu", "df",
+};
+const uint32_t hostprof_n_tools = sizeof(hostprof_tools) / sizeof(hostprof_tools[0]);
+
+// FNV-1a
+static uint64_t hash_string(const char* s) {
+    uint64_t h = 1469598103934665603ull;
+
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// First line of a small file into out ("" if it cannot be read)
+static void read_line(const char* path, char* out, size_t len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    ssize_t n = -1;
+
+    if (fd >= 0) {
+        n = read(fd, out, len - 1);
+        close(fd);
+    }
+    out[n > 0 ? n : 0] = '\0';
+    out[strcspn(out, "\n")] = '\0';
+}
+
+static void stamp(const char* path, hostprof_stamp_t* out) {
+    struct stat st;
+
+    memset(out, 0, sizeof(*out));
+    if (stat(path, &st) < 0) return;
+    out->dev = (uint64_t)st.st_dev;
+    out->ino = (uint64_t)st.st_ino;
+    out->size = (uint64_t)st.st_size;
+    out->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static const char* search_path(void) {
+    const char* path = getenv("PATH");
+
+    return path && *path ? path : DEFAULT_PATH;
+}
+
+// The next directory of a $PATH-style list into dir ("" for an empty
+// entry); returns where the rest starts, NULL at the end
+static const char* next_dir(const char* list, char* dir, size_t len) {
+    size_t n = strcspn(list, ":");
+
+    if (!*list) return NULL;
+    snprintf(dir, len, "%.*s", (int)(n < len ? n : len - 1), list);
+    return list[n] ? list + n + 1 : list + n;
+}
+
+// The value of an os-release line, without quotes or the newline
+static void os_release_value(const char* value, char* out, size_t len) {
+    size_t n = strcspn(value, "\"'\n");
+    size_t i = 0;
+
+    if (*value == '"' || *value == '\'') {
+        value++;
+        n = strcspn(value, "\"'\n");
+    }
+    for (; i < n && i + 1 < len; i++) out[i] = value[i];
+    out[i] = '\0';
+}
+
+void hostprof_probe_os(hostprof_t* p, const char* os_release) {
+    char buffer[4096];
+    const char* line;
+    ssize_t len = -1;
+    int fd;
+
+    p->os_id[0] = p->os_id_like[0] = p->os_name[0] = p->pretty_name[0] = '\0';
+    snprintf(p->os_release, sizeof(p->os_release), "%s", os_release);
+    stamp(os_release, &p->stamps[0]);
+    if (!p->n_stamps) p->n_stamps = 1;
+
+    // A few hundred bytes: one read
+    fd = open(os_release, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        len = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+    }
+    buffer[len > 0 ? len : 0] = '\0';
+    for (line = buffer; *line; line += strcspn(line, "\n"), line += *line == '\n') {
+        if (strncmp(line, "ID=", 3) == 0) {
+            os_release_value(line + 3, p->os_id, sizeof(p->os_id));
+        } else if (strncmp(line, "ID_LIKE=", 8) == 0) {
+            os_release_value(line + 8, p->os_id_like, sizeof(p->os_id_like));
+        } else if (strncmp(line, "NAME=", 5) == 0) {
+            os_release_value(line + 5, p->os_name, sizeof(p->os_name));
+        } else if (strncmp(line, "PRETTY_NAME=", 12) == 0) {
+            os_release_value(line + 12, p->pretty_name, sizeof(p->pretty_name));
+        }
+    }
+}
+
+// Stamp $PATH's directories and look for the tools in them, first match
+// wins as in a shell
+static void probe_path(hostprof_t* p) {
+    const char* list = search_path();
+    char dir[4096], candidate[4096 + 64];
+    uint32_t i;
+
+    p->path_hash = hash_string(list);
+    p->n_stamps = 1;
+    p->tools = 0;
+    while ((list = next_dir(list, dir, sizeof(dir)))) {
+        if (!dir[0]) continue;
+        if (p->n_stamps < HOSTPROF_MAX_STAMPS) stamp(dir, &p->stamps[p->n_stamps++]);
+        for (i = 0; i < hostprof_n_tools; i++) {
+            if (p->tools & (1ull << i)) continue;
+            snprintf(candidate, sizeof(candidate), "%s/%s", dir, hostprof_tools[i]);
+            if (access(candidate, X_OK) == 0) p->tools |= 1ull << i;
+        }
+    }
+}
+
+static uint32_t count_numa_nodes(void) {
+    DIR* d = opendir("/sys/devices/system/node");
+    struct dirent* e;
+    uint32_t n = 0;
+
+    if (!d) return 1;
+    while ((e = readdir(d))) {
+        if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9') n++;
+    }
+    closedir(d);
+    return n ? n : 1;
+}
+
+void hostprof_probe(hostprof_t* p, const char* os_release) {
+    double start = bench_now();
+    sysinfo_t si;
+
+    memset(p, 0, sizeof(*p));
+    memcpy(p->magic, HOSTPROF_MAGIC, sizeof(p->magic));
+    p->version = HOSTPROF_VERSION;
+    p->byte_order = HOSTPROF_BYTE_ORDER;
+    p->size = sizeof(*p);
+    read_line(BOOT_ID_PATH, p->boot_id, sizeof(p->boot_id));
+    hostprof_probe_os(p, os_release);
+    probe_path(p);
+
+    sysinfo_init(&si);
+    if (sysinfo_read_uname(&si) == 0) p->uts = si.uts;
+    if (sysinfo_read_cpu(&si) == 0) p->cpu = si.cpu;
+    if (sysinfo_read_mem(&si) == 0) {
+        p->mem_total_kb = si.mem.total_kb;
+        p->swap_total_kb = si.mem.swap_total_kb;
+    }
+    sysinfo_close(&si);
+    p->numa_nodes = count_numa_nodes();
+    p->probe_seconds = bench_now() - start;
+}
+
+int hostprof_current(const hostprof_t* p, const char* os_release) {
+    const char* list = search_path();
+    char boot_id[sizeof(p->boot_id)];
+    char dir[4096];
+    hostprof_stamp_t now;
+    uint32_t n = 1;
+
+    read_line(BOOT_ID_PATH, boot_id, sizeof(boot_id));
+    if (strcmp(boot_id, p->boot_id) != 0 || strcmp(os_release, p->os_release) != 0) return 0;
+    if (hash_string(list) != p->path_hash) return 0;
+    stamp(os_release, &now);
+    if (memcmp(&now, &p->stamps[0], sizeof(now)) != 0) return 0;
+    while ((list = next_dir(list, dir, sizeof(dir))) && n < HOSTPROF_MAX_STAMPS) {
+        if (!dir[0]) continue;
+        if (n >= p->n_stamps) return 0;
+        stamp(dir, &now);
+        if (memcmp(&now, &p->stamps[n++], sizeof(now)) != 0) return 0;
+    }
+    return n == p->n_stamps;
+}
+
+int hostprof_read(hostprof_t* p, const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    ssize_t n;
+
+    if (fd < 0) return -errno;
+    // One byte more than a profile, to notice a longer file
+    n = read(fd, p, sizeof(*p));
+    if (n == (ssize_t)sizeof(*p)) {
+        char extra;
+        if (read(fd, &extra, 1) != 0) n = -1;
+    }
+    close(fd);
+    if (n != (ssize_t)sizeof(*p) || memcmp(p->magic, HOSTPROF_MAGIC, sizeof(p->magic)) != 0 ||
+        p->version != HOSTPROF_VERSION || p->byte_order != HOSTPROF_BYTE_ORDER || p->size != sizeof(*p) ||
+        p->n_stamps == 0 || p->n_stamps > HOSTPROF_MAX_STAMPS) {
+        return -EINVAL;
+    }
+    // Strings are only trusted as far as their buffers
+    p->boot_id[sizeof(p->boot_id) - 1] = '\0';
+    p->os_release[sizeof(p->os_release) - 1] = '\0';
+    p->os_id[sizeof(p->os_id) - 1] = '\0';
+    p->os_id_like[sizeof(p->os_id_like) - 1] = '\0';
+    p->os_name[sizeof(p->os_name) - 1] = '\0';
+    p->pretty_name[sizeof(p->pretty_name) - 1] = '\0';
+    p->cpu.model[sizeof(p->cpu.model) - 1] = '\0';
+    p->cpu.vendor[sizeof(p->cpu.vendor) - 1] = '\0';
+    return 0;
+}
+
+static int make_dirs(const char* path) {
+    char buf[512];
+    char* p;
+
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(buf, 0755) < 0 && errno != EEXIST) return -errno;
+        *p = '/';
+    }
+    if (mkdir(buf, 0755) < 0 && errno != EEXIST) return -errno;
+    return 0;
+}
+
+int hostprof_save(const hostprof_t* p, const char* path) {
+    char dir[512], tmp[600];
+    char* slash;
+    ssize_t n;
+    int fd, rc;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = '\0';
+        if ((rc = make_dirs(dir)) < 0) return rc;
+    }
+    // Written aside and renamed, so another tutor never reads half of it
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -errno;
+    n = write(fd, p, sizeof(*p));
+    rc = n == (ssize_t)sizeof(*p) ? 0 : n < 0 ? -errno : -EIO;
+    if (close(fd) < 0 && rc == 0) rc = -errno;
+    if (rc == 0 && rename(tmp, path) < 0) rc = -errno;
+    if (rc < 0) unlink(tmp);
+    return rc;
+}
+
+int hostprof_load(hostprof_t* p, const char* path, const char* os_release, int* warm) {
+    uint32_t last_mode = 0;
+
+    *warm = 0;
+    if (hostprof_read(p, path) == 0) {
+        if (hostprof_current(p, os_release)) {
+            *warm = 1;
+            return 0;
+        }
+        last_mode = p->last_mode;
+    }
+    hostprof_probe(p, os_release);
+    p->last_mode = last_mode;
+    return hostprof_save(p, path);
+}
+
+const char* hostprof_default_path(char* buf, size_t len) {
+    const char* env = getenv("DEB1_HOST_PROFILE");
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    if (env && *env) {
+        snprintf(buf, len, "%s", env);
+    } else if (cache && *cache) {
+        snprintf(buf, len, "%s/deb1/host-profile", cache);
+    } else {
+        snprintf(buf, len, "%s/.cache/deb1/host-profile", home && *home ? home : "/tmp");
+    }
+    return buf;
+}
+
+int hostprof_has(const hostprof_t* p, const char* program) {
+    uint32_t i;
+
+    for (i = 0; i < hostprof_n_tools; i++) {
+        if (strcmp(hostprof_tools[i], program) == 0) return (p->tools >> i) & 1;
+    }
+    return -1;
+}
+
+void hostprof_fill_sysinfo(const hostprof_t* p, sysinfo_t* si) {
+    si->uts = p->uts;
+    si->cpu = p->cpu;
+    si->static_filled = 1;
+}
+
+// Benchmark: a start without a profile (probe and save) against one with
+// a current profile (read and check), in a scratch directory
+
+int hostprof_bench(int argc, char** argv) {
+    int runs = argc > 0 ? atoi(argv[0]) : 200;
+    char dir[] = "/tmp/deb1-hostprof-XXXXXX";
+    char path[64];
+    hostprof_t p;
+    double start, cold, warm, check;
+    int r, was_warm, rc = 0;
+
+    if (runs < 10) runs = 10;
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/host-profile", dir);
+
+    start = bench_now();
+    for (r = 0; r < runs; r++) {
+        unlink(path);
+        if (hostprof_load(&p, path, "/etc/os-release", &was_warm) < 0 || was_warm) rc = 1;
+    }
+    cold = (bench_now() - start) / runs;
+
+    start = bench_now();
+    for (r = 0; r < runs; r++) {
+        if (hostprof_load(&p, path, "/etc/os-release", &was_warm) < 0 || !was_warm) rc = 1;
+    }
+    warm = (bench_now() - start) / runs;
+
+    start = bench_now();
+    for (r = 0; r < runs; r++) {
+        if (!hostprof_current(&p, "/etc/os-release")) rc = 1;
+    }
+    check = (bench_now() - start) / runs;
+
+    if (rc) fprintf(stderr, "hostprof: a cold start found a profile or a warm one did not\n");
+    bench_report("hostprof", "cold_start", cold * 1e6, "us");
+    bench_report("hostprof", "warm_start", warm * 1e6, "us");
+    bench_report("hostprof", "check", check * 1e6, "us");
+    bench_report("hostprof", "speedup", cold / warm, "x");
+    bench_report("hostprof", "stamps", p.n_stamps, "count");
+    bench_report("hostprof", "file", sizeof(p), "bytes");
+
+    unlink(path);
+    rmdir(dir);
+    return rc;
+}
@@ -0,0 +1,107 @@
+#ifndef HOSTPROF_H
+#define HOSTPROF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/utsname.h>
+#include "sysinfo.h"
+
+// What the tutor knows about the host it runs on, probed once and kept
+// between runs.
+//
+// A profile is the machine's identity from os-release, uname, the CPU and
+// memory topology, and which of the programs the lessons and the
+// adaptation rules care about are on $PATH. Probing takes a few
+// milliseconds (cpuinfo and the $PATH walk dominate); a profile saved in
+// a cache file is read back with one read() and checked against what it
+// was probed from: the kernel's boot ID (a reboot may bring a new kernel,
+// CPUs or memory), the os-release file and every $PATH directory, by
+// inode, size and mtime (installing or removing a program changes its
+// directory's mtime), and $PATH itself. Any difference, or a file written
+// by another version or byte order, and the host is probed again.
+//
+// The file also remembers the learning mode chosen last time, so the mode
+// screen can offer it again.
+//
+// Layout: the hostprof_t below, as is (native-endian, fixed size).
+
+#define HOSTPROF_MAGIC "DEB1HPF"
+#define HOSTPROF_VERSION 1
+#define HOSTPROF_BYTE_ORDER 0x01020304u
+#define HOSTPROF_MAX_STAMPS 24
+
+// A file the profile was probed from, as stat() saw it; all zero if it
+// did not exist
+typedef struct {
+    uint64_t dev, ino, size;
+    int64_t mtime_ns;
+} hostprof_stamp_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t size;          // sizeof(hostprof_t)
+    uint32_t last_mode;     // learning mode chosen last time (1-4), 0: none
+
+    // What it was probed from
+    char boot_id[40];
+    char os_release[256];   // path
+    uint64_t path_hash;     // of $PATH
+    hostprof_stamp_t stamps[HOSTPROF_MAX_STAMPS];   // os-release, then $PATH's directories
+    uint32_t n_stamps;
+
+    // OS identity (os-release), "" when absent
+    char os_id[32];
+    char os_id_like[64];
+    char os_name[50];
+    char pretty_name[96];
+
+    struct utsname uts;
+
+    // Topology
+    sysinfo_cpu_t cpu;
+    uint32_t numa_nodes;
+    uint64_t mem_total_kb, swap_total_kb;
+
+    uint64_t tools;         // bit per hostprof_tools[] entry that is on $PATH
+    double probe_seconds;   // what probing took
+} hostprof_t;
+
+// The programs a profile records
+extern const char* const hostprof_tools[];
+extern const uint32_t hostprof_n_tools;
+
+// Probe the host, with the OS identity from os_release
+void hostprof_probe(hostprof_t* p, const char* os_release);
+// Read the OS identity (and its stamp) again, from another file
+void hostprof_probe_os(hostprof_t* p, const char* os_release);
+// 1 if nothing the profile was probed from has changed since
+int hostprof_current(const hostprof_t* p, const char* os_release);
+
+// Read a profile; 0, or -errno (-EINVAL: another version or byte order)
+int hostprof_read(hostprof_t* p, const char* path);
+// Write one, atomically, creating the directory. 0 or -errno.
+int hostprof_save(const hostprof_t* p, const char* path);
+
+// The profile in path if it is current, else a fresh probe saved there
+// (keeping the remembered mode). *warm tells which. Returns 0, or -errno
+// if the probe could not be saved.
+int hostprof_load(hostprof_t* p, const char* path, const char* os_release, int* warm);
+
+// $DEB1_HOST_PROFILE, else host-profile in $XDG_CACHE_HOME/deb1 or
+// ~/.cache/deb1
+const char* hostprof_default_path(char* buf, size_t len);
+
+// 1 or 0 for whether program is on $PATH; -1 if the profile does not
+// record it
+int hostprof_has(const hostprof_t* p, const char* program);
+
+// Hand uname and the CPU to the live-mode collectors, which then do not
+// read them again
+void hostprof_fill_sysinfo(const hostprof_t* p, sysinfo_t* si);
+
+// --bench hostprof [runs]
+int hostprof_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "deb1.h"
+#include "bench.h"
+#include "console.h"
+#include "session.h"
+#include "render.h"
+#include "instr.h"
+#include "util.h"
+
+int instr_on;
+__thread uint64_t instr_command_ns;
+__thread int instr_topic = INSTR_MENU;
+
+// Upper bucket bounds: screens take microseconds, choices seconds to minutes
+static const uint64_t bounds_ns[INSTR_BUCKETS] = {
+    10000, 50000, 100000, 500000,                   // 10us .. 500us
+    1000000, 5000000, 10000000, 50000000,           // 1ms .. 50ms
+    100000000, 500000000, 1000000000, 5000000000u,  // 100ms .. 5s
+    30000000000u, 120000000000u,                    // 30s, 2min
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+} metrics[INSTR_N_METRICS] = {
+    { "deb1_screen_seconds", "Handling a choice and rendering the next screen, without real commands" },
+    { "deb1_input_wait_seconds", "Time from a screen to the learner's next choice" },
+    { "deb1_command_seconds", "Real commands run in live mode" },
+    { "deb1_simulation_seconds", "Simulated commands" },
+};
+
+// [metric][0] is the menus, [metric][1 + topic] a lesson topic. Each
+// thread that records gets its own set, which only it writes, so a record
+// is two plain increments; an export adds the sets up.
+typedef struct instr_block {
+    instr_histogram_t h[INSTR_N_METRICS][INSTR_MAX_TOPICS + 1];
+    struct instr_block* next;
+} instr_block_t;
+
+static instr_block_t* blocks;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread instr_block_t* mine;
+
+// What an export writes
+static instr_histogram_t histograms[INSTR_N_METRICS][INSTR_MAX_TOPICS + 1];
+
+// The bucket of a duration without searching: no two bounds are in the
+// same power of two, so below[k] counts the bounds under 2^k and cut[k] is
+// the one between 2^k and 2^(k+1), if any
+static uint8_t below[64];
+static uint64_t cut[64];
+static pthread_once_t buckets_once = PTHREAD_ONCE_INIT;
+
+static const char* export_path;
+static volatile sig_atomic_t export_requested;
+
+static void on_export(int sig) {
+    (void)sig;
+    export_requested = 1;
+}
+
+static void init_buckets(void) {
+    int k, b;
+
+    for (k = 0; k < 64; k++) {
+        uint64_t low = 1ull << k;
+
+        cut[k] = UINT64_MAX;
+        for (b = 0; b < INSTR_BUCKETS; b++) {
+            if (bounds_ns[b] < low) below[k] = (uint8_t)(b + 1);
+            if (bounds_ns[b] >= low && (k == 63 || bounds_ns[b] < low << 1)) cut[k] = bounds_ns[b];
+        }
+    }
+}
+
+static instr_block_t* new_block(void) {
+    instr_block_t* block = calloc(1, sizeof(*block));
+
+    if (!block) {
+        perror("calloc");
+        exit(1);
+    }
+    pthread_once(&buckets_once, init_buckets);
+    // Kept after the thread ends: its counts still belong in the export
+    pthread_mutex_lock(&blocks_lock);
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&blocks_lock);
+    return block;
+}
+
+// Only the owning thread writes; relaxed atomics keep the exporter's
+// reads well defined and compile to plain loads and stores
+static inline void bump(uint64_t* v, uint64_t n) {
+    __atomic_store_n(v, __atomic_load_n(v, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+void instr_record(instr_metric_t metric, int topic, uint64_t ns) {
+    instr_histogram_t* h;
+    int k = 63 - __builtin_clzll(ns | 1);
+
+    if (!mine) mine = new_block();
+    if (topic >= INSTR_MAX_TOPICS) topic = INSTR_MAX_TOPICS - 1;
+    h = &mine->h[metric][topic < 0 ? 0 : topic + 1];
+    bump(&h->bucket[below[k] + (ns > cut[k])], 1);
+    bump(&h->sum_ns, ns);
+}
+
+// Add up every thread's counts into histograms; a count is its buckets
+static void merge(void) {
+    const instr_block_t* block;
+    int m, t, b;
+
+    memset(histograms, 0, sizeof(histograms));
+    pthread_mutex_lock(&blocks_lock);
+    for (block = blocks; block; block = block->next) {
+        for (m = 0; m < INSTR_N_METRICS; m++) {
+            for (t = 0; t <= INSTR_MAX_TOPICS; t++) {
+                const instr_histogram_t* from = &block->h[m][t];
+                instr_histogram_t* h = &histograms[m][t];
+
+                for (b = 0; b <= INSTR_BUCKETS; b++) {
+                    uint64_t n = __atomic_load_n(&from->bucket[b], __ATOMIC_RELAXED);
+
+                    h->bucket[b] += n;
+                    h->count += n;
+                }
+                h->sum_ns += __atomic_load_n(&from->sum_ns, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    pthread_mutex_unlock(&blocks_lock);
+}
+
+void instr_enable(const char* path) {
+    struct sigaction sa;
+
+    instr_on = 1;
+    export_path = path;
+    if (!path) return;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_export;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);
+}
+
+void instr_poll(void) {
+    // Only the thread that clears the request writes the file
+    if (!__atomic_exchange_n(&export_requested, 0, __ATOMIC_ACQ_REL)) return;
+    instr_export();
+}
+
+// The topic's menu label, quoted for a Prometheus label or JSON string
+static void print_topic(FILE* fp, int index) {
+    const char* label = "menu";
+    char number[16];
+    const char* p;
+
+    if (index > 0) {
+        const lp_topic_t* topic = lessons.header ? lp_topic(&lessons, (uint32_t)index - 1) : NULL;
+
+        if (index == INSTR_MAX_TOPICS) {
+            label = "other";
+        } else if (topic) {
+            // Without the emoji and padding the menu puts in front
+            label = lp_str(&lessons, topic->label);
+            while (*label && !isalnum((unsigned char)*label)) label++;
+        } else {
+            snprintf(number, sizeof(number), "%d", index - 1);
+            label = number;
+        }
+    }
+    fputc('"', fp);
+    for (p = label; *p; p++) {
+        if (*p == '"' || *p == '\\') fputc('\\', fp);
+        if (*p == '\n') {
+            fputs("\\n", fp);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+static void write_prometheus(FILE* fp) {
+    int m, t, b;
+
+    for (m = 0; m < INSTR_N_METRICS; m++) {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s histogram\n", metrics[m].name, metrics[m].help, metrics[m].name);
+        for (t = 0; t <= INSTR_MAX_TOPICS; t++) {
+            const instr_histogram_t* h = &histograms[m][t];
+            uint64_t cumulative = 0;
+
+            if (!h->count) continue;
+            for (b = 0; b <= INSTR_BUCKETS; b++) {
+                cumulative += h->bucket[b];
+                fprintf(fp, "%s_bucket{topic=", metrics[m].name);
+                print_topic(fp, t);
+                if (b < INSTR_BUCKETS) {
+                    fprintf(fp, ",le=\"%g\"} %llu\n", bounds_ns[b] / 1e9, (unsigned long long)cumulative);
+                } else {
+                    fprintf(fp, ",le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+                }
+            }
+            fprintf(fp, "%s_sum{topic=", metrics[m].name);
+            print_topic(fp, t);
+            fprintf(fp, "} %.9f\n%s_count{topic=", h->sum_ns / 1e9, metrics[m].name);
+            print_topic(fp, t);
+            fprintf(fp, "} %llu\n", (unsigned long long)h->count);
+        }
+    }
+}
+
+static void write_json(FILE* fp) {
+    const char* sep = "";
+    int m, t, b;
+
+    fprintf(fp, "{\"metrics\": [");
+    for (m = 0; m < INSTR_N_METRICS; m++) {
+        for (t = 0; t <= INSTR_MAX_TOPICS; t++) {
+            const instr_histogram_t* h = &histograms[m][t];
+            uint64_t cumulative = 0;
+
+            if (!h->count) continue;
+            fprintf(fp, "%s\n  {\"name\": \"%s\", \"topic\": ", sep, metrics[m].name);
+            print_topic(fp, t);
+            fprintf(fp, ", \"count\": %llu, \"sum\": %.9f, \"buckets\": [", (unsigned long long)h->count,
+                    h->sum_ns / 1e9);
+            for (b = 0; b <= INSTR_BUCKETS; b++) {
+                cumulative += h->bucket[b];
+                if (b < INSTR_BUCKETS) {
+                    fprintf(fp, "[%g, %llu], ", bounds_ns[b] / 1e9, (unsigned long long)cumulative);
+                } else {
+                    fprintf(fp, "[\"+Inf\", %llu]]}", (unsigned long long)cumulative);
+                }
+            }
+            sep = ",";
+        }
+    }
+    fprintf(fp, "\n]}\n");
+}
+
+int instr_export(void) {
+    char tmp[512];
+    size_t len;
+    FILE* fp;
+    int rc = 0;
+
+    if (!export_path) return 0;
+    // Renamed into place, so a collector never reads half a file
+    snprintf(tmp, sizeof(tmp), "%s.tmp", export_path);
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        rc = -errno;
+        fprintf(stderr, "%s: %s\n", tmp, strerror(errno));
+        return rc;
+    }
+    merge();
+    len = strlen(export_path);
+    if (len > 5 && strcmp(export_path + len - 5, ".json") == 0) {
+        write_json(fp);
+    } else {
+        write_prometheus(fp);
+    }
+    if (fclose(fp) != 0) rc = -errno;
+    if (rc == 0 && rename(tmp, export_path) < 0) rc = -errno;
+    if (rc < 0) {
+        fprintf(stderr, "%s: %s\n", export_path, strerror(-rc));
+        unlink(tmp);
+    }
+    return rc;
+}
+
+// Benchmark: the lesson tour with instrumentation off and on, once as a learner at a 40x120 terminal sees it
+// (output to /dev/null through the renderer) and once headless like
+// --batch, the worst case since a step then does the least work. Then the
+// cost of one span either way.
+
+static void flush_on_input(void* ctx) {
+    (void)ctx;
+    con_flush();
+}
+
+// Spans recorded so far, on every thread
+static uint64_t recorded(void) {
+    uint64_t n = 0;
+    int m, t;
+
+    merge();
+    for (m = 0; m < INSTR_N_METRICS; m++) {
+        for (t = 0; t <= INSTR_MAX_TOPICS; t++) n += histograms[m][t].count;
+    }
+    return n;
+}
+
+// Sessions alternate off and on, so drift in the machine's speed hits
+// both alike; best of several rounds
+static void run_tour(console_t* con, int sessions, double* best) {
+    double elapsed[2] = { 0, 0 };
+    int s, on;
+
+    for (s = 0; s < sessions; s++) {
+        for (on = 0; on < 2; on++) {
+            double start = bench_now();
+
+            instr_on = on;
+            memset(&sys_config, 0, sizeof(sys_config));
+            con->script_pos = 0;
+            run_session();
+            con_flush();
+            elapsed[on] += bench_now() - start;
+        }
+    }
+    instr_on = 0;
+    for (on = 0; on < 2; on++) {
+        if (!best[on] || elapsed[on] < best[on]) best[on] = elapsed[on];
+    }
+}
+
+int instr_bench(int argc, char** argv) {
+    int sessions = argc > 0 ? atoi(argv[0]) : 200;
+    const char* script_path = "lessons/tour.script";
+    size_t script_len = 0;
+    char* script = read_file(script_path, &script_len);
+    int pass, round, on, i, spans = 1000000;
+    double span_ns[2], per_session[2], session_us[2];
+
+    if (!script) {
+        fprintf(stderr, "%s: cannot read the tour script\n", script_path);
+        return 1;
+    }
+    if (sessions < 1) sessions = 1;
+    load_lessons(NULL);
+
+    for (pass = 0; pass < 2; pass++) {
+        const char* name = pass ? "headless" : "terminal";
+        double best[2] = { 0, 0 };
+        char metric[64];
+        console_t con;
+
+        memset(&con, 0, sizeof(con));
+        con.script = script;
+        con.script_len = script_len;
+        if (pass) {
+            con.out_fd = -1;
+            con.echo_input = 1;
+        } else {
+            con.out_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+            con.color = 1;
+            con.clear_screen = 1;
+            con.on_input = flush_on_input;
+            con.render = render_new(-1, 40, 120);
+        }
+        console_use(&con);
+
+        per_session[pass] = (double)recorded();
+        for (round = 0; round < 8; round++) {
+            run_tour(&con, sessions, best);
+        }
+        per_session[pass] = ((double)recorded() - per_session[pass]) / (8.0 * sessions);
+        session_us[pass] = best[0] / sessions * 1e6;
+        console_use(NULL);
+
+        snprintf(metric, sizeof(metric), "%s_off", name);
+        bench_report("instr", metric, best[0] / sessions * 1e6, "us/session");
+        snprintf(metric, sizeof(metric), "%s_on", name);
+        bench_report("instr", metric, best[1] / sessions * 1e6, "us/session");
+        snprintf(metric, sizeof(metric), "%s_overhead", name);
+        bench_report("instr", metric, (best[1] - best[0]) / best[0] * 100, "%");
+        console_free(&con);
+        if (!pass) close(con.out_fd);
+    }
+
+    for (on = 0; on < 2; on++) {
+        double start;
+
+        instr_on = on;
+        start = bench_now();
+        for (i = 0; i < spans; i++) {
+            instr_span_t span = instr_begin();
+            instr_end(INSTR_SIMULATION, INSTR_MENU, span);
+        }
+        span_ns[on] = (bench_now() - start) / spans * 1e9;
+        bench_report("instr", on ? "span_on" : "span_off", span_ns[on], "ns");
+    }
+    instr_on = 0;
+
+    // The overheads above are within the noise of a whole session; this is
+    // what the spans a session records cost, measured one at a time
+    for (pass = 0; pass < 2; pass++) {
+        const char* name = pass ? "headless" : "terminal";
+        char metric[64];
+
+        snprintf(metric, sizeof(metric), "%s_spans", name);
+        bench_report("instr", metric, per_session[pass], "spans/session");
+        snprintf(metric, sizeof(metric), "%s_span_share", name);
+        bench_report("instr", metric, per_session[pass] * (span_ns[1] - span_ns[0]) / (session_us[pass] * 1e3) * 100, "%");
+    }
+
+    lesson_pack_close(&lessons);
+    free(script);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef INSTR_H
+#define INSTR_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Timing histograms for where learners and the tutor spend time.
+//
+// A span is two reads of CLOCK_MONOTONIC (vDSO, no system call); its
+// duration lands in one of a fixed set of buckets, per metric and per
+// lesson topic. While instrumentation is off (no --metrics) a span is a
+// single predictable branch, and building with -DDEB1_NO_INSTR removes
+// even that. The histograms are written as Prometheus text or JSON when
+// the process exits and after it gets SIGUSR2 (at the learner's next
+// choice, or at once in the server).
+
+typedef enum {
+    INSTR_SCREEN,           // handling a choice and rendering the next screen
+    INSTR_INPUT_WAIT,       // from a screen to the learner's next choice
+    INSTR_COMMAND,          // a real command in live mode
+    INSTR_SIMULATION,       // a simulated command
+    INSTR_N_METRICS
+} instr_metric_t;
+
+#define INSTR_BUCKETS 14            // upper bounds, plus +Inf
+#define INSTR_MAX_TOPICS 32         // further topics share the last label
+#define INSTR_MENU (-1)             // label for screens outside any topic
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t bucket[INSTR_BUCKETS + 1];     // not cumulative
+} instr_histogram_t;
+
+typedef struct {
+    uint64_t start;
+    uint64_t nested;        // command time already counted when it began
+} instr_span_t;
+
+extern int instr_on;
+// Per thread, as server sessions are handled on several
+extern __thread uint64_t instr_command_ns;
+extern __thread int instr_topic;    // label for commands run by the screen being handled
+
+static inline uint64_t instr_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void instr_record(instr_metric_t metric, int topic, uint64_t ns);
+
+#ifndef DEB1_NO_INSTR
+static inline instr_span_t instr_begin(void) {
+    instr_span_t span = { 0, 0 };
+
+    if (instr_on) {
+        span.start = instr_now();
+        span.nested = instr_command_ns;
+    }
+    return span;
+}
+
+// Returns when the span ended (0 while off). A screen does not include
+// the real commands run while producing it.
+static inline uint64_t instr_end(instr_metric_t metric, int topic, instr_span_t span) {
+    uint64_t now, ns;
+
+    if (!instr_on) return 0;
+    now = instr_now();
+    ns = now - span.start;
+    if (metric == INSTR_COMMAND) {
+        instr_command_ns += ns;
+    } else if (metric == INSTR_SCREEN) {
+        ns -= instr_command_ns - span.nested;
+    }
+    instr_record(metric, topic, ns);
+    return now;
+}
+#else
+static inline instr_span_t instr_begin(void) {
+    instr_span_t span = { 0, 0 };
+    return span;
+}
+static inline uint64_t instr_end(instr_metric_t metric, int topic, instr_span_t span) {
+    (void)metric;
+    (void)topic;
+    (void)span;
+    return 0;
+}
+#endif
+
+// Turn instrumentation on, exporting to path (JSON if it ends in .json,
+// otherwise Prometheus text), and install the SIGUSR2 handler
+void instr_enable(const char* path);
+
+// Write the export if SIGUSR2 asked for one; cheap enough to call often
+void instr_poll(void);
+
+// Write the export now. Returns 0 or -errno.
+int instr_export(void);
+
+// --bench instr [sessions]
+int instr_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,787 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "deb1.h"
+#include "bench.h"
+#include "lesson_pack.h"
+#include "journal.h"
+#include "util.h"
+
+#define JOURNAL_MAGIC "DEB1JRN"
+#define SNAP_MAGIC "DEB1SNP"
+#define JOURNAL_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t generation;
+} journal_header_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t generation;    // journals up to this one are folded in
+    uint32_t n_entries;
+    uint32_t sessions;
+    uint32_t check;         // hash of the entries
+    uint32_t reserved;
+} snap_header_t;
+
+static uint32_t fnv1a(const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint32_t h = 2166136261u;
+
+    while (len--) {
+        h ^= *p++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+uint32_t journal_hash(const char* text) {
+    return fnv1a(text, strlen(text));
+}
+
+static uint32_t record_check(const journal_record_t* rec) {
+    return fnv1a(rec, offsetof(journal_record_t, check));
+}
+
+// Fold one record into progress
+static void apply(journal_progress_t* p, const journal_record_t* rec) {
+    journal_entry_t* e;
+    uint32_t lo = 0, hi = p->n_entries;
+
+    if (rec->kind == JOURNAL_SESSION) {
+        p->sessions++;
+        return;
+    }
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (p->entries[mid].command < rec->command) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == p->n_entries || p->entries[lo].command != rec->command) {
+        if (p->n_entries == p->cap) {
+            p->cap = p->cap ? p->cap * 2 : 64;
+            p->entries = xrealloc(p->entries, p->cap * sizeof(p->entries[0]));
+        }
+        memmove(p->entries + lo + 1, p->entries + lo, (p->n_entries - lo) * sizeof(p->entries[0]));
+        p->n_entries++;
+        memset(&p->entries[lo], 0, sizeof(p->entries[lo]));
+        p->entries[lo].command = rec->command;
+        p->entries[lo].first = rec->time;
+    }
+    e = &p->entries[lo];
+    e->last = rec->time;
+    switch (rec->kind) {
+        case JOURNAL_EXPLAIN:
+            e->explained++;
+            break;
+        case JOURNAL_SKIP:
+            e->skipped++;
+            break;
+        case JOURNAL_OUTCOME:
+            e->runs++;
+            if (rec->value == 0) {
+                e->ok++;
+            } else {
+                e->failed++;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static const journal_entry_t* find_entry(const journal_progress_t* p, uint32_t command) {
+    uint32_t lo = 0, hi = p->n_entries;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (p->entries[mid].command == command) return &p->entries[mid];
+        if (p->entries[mid].command < command) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+static int mkdir_p(const char* dir) {
+    char path[512];
+    char* p;
+
+    if (snprintf(path, sizeof(path), "%s", dir) >= (int)sizeof(path)) return -ENAMETOOLONG;
+    for (p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) return -errno;
+        *p = '/';
+    }
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) return -errno;
+    return 0;
+}
+
+// Write a journal (header and records) under a temporary name and move it
+// into place, so path is always either the old file or the complete new one
+static int write_journal_file(const char* path, int dir_fd, uint32_t generation, const journal_record_t* recs,
+                              size_t n, int sync) {
+    char tmp[520];
+    journal_header_t h;
+    int fd, rc;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    h.version = JOURNAL_VERSION;
+    h.generation = generation;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -errno;
+    rc = write_all(fd, &h, sizeof(h));
+    if (rc == 0 && n) rc = write_all(fd, recs, n * sizeof(recs[0]));
+    if (rc == 0 && sync && fsync(fd) < 0) rc = -errno;
+    close(fd);
+    if (rc == 0 && rename(tmp, path) < 0) rc = -errno;
+    if (rc == 0 && sync && dir_fd >= 0) fsync(dir_fd);
+    if (rc < 0) unlink(tmp);
+    return rc;
+}
+
+static int write_snapshot(const char* path, int dir_fd, const journal_progress_t* p) {
+    char tmp[520];
+    snap_header_t h;
+    int fd, rc;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC));
+    h.version = JOURNAL_VERSION;
+    h.generation = p->generation;
+    h.n_entries = p->n_entries;
+    h.sessions = p->sessions;
+    h.check = fnv1a(p->entries, p->n_entries * sizeof(p->entries[0]));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -errno;
+    rc = write_all(fd, &h, sizeof(h));
+    if (rc == 0) rc = write_all(fd, p->entries, p->n_entries * sizeof(p->entries[0]));
+    if (rc == 0 && fsync(fd) < 0) rc = -errno;
+    close(fd);
+    if (rc == 0 && rename(tmp, path) < 0) rc = -errno;
+    if (rc == 0 && dir_fd >= 0) fsync(dir_fd);
+    if (rc < 0) unlink(tmp);
+    return rc;
+}
+
+static int read_snapshot(const char* path, journal_progress_t* p) {
+    snap_header_t h;
+    size_t size;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    int rc = 0;
+
+    if (fd < 0) return -errno;
+    if (read(fd, &h, sizeof(h)) != (ssize_t)sizeof(h) || memcmp(h.magic, SNAP_MAGIC, sizeof(SNAP_MAGIC)) != 0 ||
+        h.version != JOURNAL_VERSION) {
+        close(fd);
+        return -EINVAL;
+    }
+    if (h.n_entries > p->cap) {
+        p->cap = h.n_entries;
+        p->entries = xrealloc(p->entries, p->cap * sizeof(p->entries[0]));
+    }
+    size = h.n_entries * sizeof(p->entries[0]);
+    if (size && read(fd, p->entries, size) != (ssize_t)size) rc = -EINVAL;
+    if (rc == 0 && fnv1a(p->entries, size) != h.check) rc = -EINVAL;
+    close(fd);
+    if (rc == 0) {
+        p->n_entries = h.n_entries;
+        p->sessions = h.sessions;
+        p->generation = h.generation;
+    }
+    return rc;
+}
+
+// Replay a journal newer than progress->generation into progress. Returns
+// the number of good records (*good_end is where they end), -ESTALE for a
+// journal the snapshot already has, or -errno.
+static long replay(const char* path, journal_progress_t* p, off_t* good_end) {
+    journal_record_t recs[1024];
+    journal_header_t h;
+    long n_good = 0;
+    ssize_t got;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (good_end) *good_end = 0;
+    if (fd < 0) return -errno;
+    if (read(fd, &h, sizeof(h)) != (ssize_t)sizeof(h) ||
+        memcmp(h.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || h.version != JOURNAL_VERSION) {
+        close(fd);
+        return -EINVAL;
+    }
+    if (h.generation <= p->generation) {
+        close(fd);
+        return -ESTALE;
+    }
+    p->generation = h.generation;
+    while ((got = read(fd, recs, sizeof(recs))) > 0) {
+        size_t i, n = (size_t)got / sizeof(recs[0]);
+
+        for (i = 0; i < n; i++) {
+            if (record_check(&recs[i]) != recs[i].check) break;
+            apply(p, &recs[i]);
+            n_good++;
+        }
+        // A torn or partial record: the rest is not trusted
+        if (i < n || (size_t)got % sizeof(recs[0])) break;
+    }
+    close(fd);
+    if (good_end) *good_end = (off_t)(sizeof(h) + n_good * sizeof(journal_record_t));
+    return n_good;
+}
+
+static void reset_progress(journal_progress_t* p) {
+    p->n_entries = 0;
+    p->sessions = 0;
+    p->generation = 0;
+}
+
+static void set_paths(char* path, char* prev_path, char* snap_path, size_t len, const char* dir,
+                      const char* learner) {
+    char name[128];
+    size_t i;
+
+    // Learner names become file names
+    for (i = 0; learner[i] && i + 1 < sizeof(name); i++) {
+        char c = learner[i];
+        int ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' ||
+                 c == '_' || (c == '.' && i > 0);
+
+        name[i] = ok ? c : '_';
+    }
+    name[i] = '\0';
+    snprintf(path, len, "%s/%s.journal", dir, name);
+    snprintf(prev_path, len, "%s/%s.journal.prev", dir, name);
+    snprintf(snap_path, len, "%s/%s.snap", dir, name);
+}
+
+int journal_load(const char* dir, const char* learner, journal_progress_t* progress) {
+    char path[512], prev_path[512], snap_path[512];
+    long rc;
+
+    reset_progress(progress);
+    set_paths(path, prev_path, snap_path, sizeof(path), dir, learner);
+    read_snapshot(snap_path, progress);
+    replay(prev_path, progress, NULL);
+    rc = replay(path, progress, NULL);
+    return rc < 0 && rc != -ESTALE && rc != -ENOENT ? (int)rc : 0;
+}
+
+void journal_progress_free(journal_progress_t* progress) {
+    free(progress->entries);
+    memset(progress, 0, sizeof(*progress));
+}
+
+// The writer thread. With j->lock held; commits batches and compacts.
+
+static void commit(journal_t* j) {
+    journal_record_t batch[JOURNAL_BATCH];
+    uint32_t n = j->n_pending;
+    int rc = 0;
+
+    memcpy(batch, j->pending, n * sizeof(batch[0]));
+    j->n_pending = 0;
+    pthread_cond_broadcast(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+
+    if (j->fd >= 0) {
+        rc = write_all(j->fd, batch, n * sizeof(batch[0]));
+        if (rc == 0 && fdatasync(j->fd) < 0) rc = -errno;
+        if (rc < 0) {
+            fprintf(stderr, "%s: %s; progress is no longer saved\n", j->path, strerror(-rc));
+            close(j->fd);
+            j->fd = -1;
+        }
+    }
+
+    pthread_mutex_lock(&j->lock);
+    j->commits++;
+    j->records_written += n;
+    j->committed += n;
+}
+
+// Only with nothing pending, so the copy holds exactly what the journal
+// being retired holds
+static void compact(journal_t* j) {
+    journal_progress_t copy = j->progress;
+    int rc;
+
+    copy.entries = xrealloc(NULL, (copy.n_entries ? copy.n_entries : 1) * sizeof(copy.entries[0]));
+    memcpy(copy.entries, j->progress.entries, copy.n_entries * sizeof(copy.entries[0]));
+    copy.cap = copy.n_entries;
+    j->progress.generation++;
+    j->committed = 0;
+    pthread_mutex_unlock(&j->lock);
+
+    // From here the retired journal is .prev until the snapshot has it
+    rc = rename(j->path, j->prev_path) < 0 ? -errno : 0;
+    if (rc == 0) rc = write_journal_file(j->path, j->dir_fd, copy.generation + 1, NULL, 0, 1);
+    if (rc == 0) {
+        close(j->fd);
+        j->fd = open(j->path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (j->fd < 0) rc = -errno;
+    }
+    if (rc == 0) rc = write_snapshot(j->snap_path, j->dir_fd, &copy);
+    if (rc == 0) {
+        unlink(j->prev_path);
+        fsync(j->dir_fd);
+    } else {
+        fprintf(stderr, "%s: compaction failed: %s\n", j->snap_path, strerror(-rc));
+    }
+    free(copy.entries);
+
+    pthread_mutex_lock(&j->lock);
+    j->compactions++;
+}
+
+static void* writer(void* arg) {
+    journal_t* j = arg;
+
+    pthread_mutex_lock(&j->lock);
+    for (;;) {
+        double now = bench_now();
+
+        if (j->n_pending && (j->n_pending == JOURNAL_BATCH || j->quit || now >= j->oldest + JOURNAL_SYNC_MS / 1e3)) {
+            commit(j);
+            continue;
+        }
+        if (!j->n_pending && j->committed >= JOURNAL_COMPACT_AT && j->fd >= 0) {
+            compact(j);
+            continue;
+        }
+        if (j->quit) break;
+        if (j->n_pending) {
+            struct timespec until;
+            double wait = j->oldest + JOURNAL_SYNC_MS / 1e3 - now;
+
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += (time_t)wait;
+            until.tv_nsec += (long)((wait - (double)(time_t)wait) * 1e9);
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&j->wake, &j->lock, &until);
+        } else {
+            pthread_cond_wait(&j->wake, &j->lock);
+        }
+    }
+    pthread_mutex_unlock(&j->lock);
+    return NULL;
+}
+
+journal_t* journal_open(const char* dir, const char* learner) {
+    journal_t* j;
+    off_t good_end = 0;
+    long replayed, had_prev;
+    int rc, saved;
+    struct stat st;
+
+    rc = mkdir_p(dir);
+    if (rc < 0) {
+        errno = -rc;
+        return NULL;
+    }
+    j = xrealloc(NULL, sizeof(*j));
+    memset(j, 0, sizeof(*j));
+    j->fd = -1;
+    set_paths(j->path, j->prev_path, j->snap_path, sizeof(j->path), dir, learner);
+    j->dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (j->dir_fd < 0) goto fail;
+
+    // Recovery: the snapshot, then any newer journals
+    read_snapshot(j->snap_path, &j->progress);
+    had_prev = replay(j->prev_path, &j->progress, NULL);
+    replayed = replay(j->path, &j->progress, &good_end);
+
+    if (had_prev >= 0) {
+        // A compaction was interrupted: finish it before anything else
+        // renames over .prev
+        if (replayed < 0) j->progress.generation++;
+        if (write_snapshot(j->snap_path, j->dir_fd, &j->progress) < 0) goto fail;
+        if (write_journal_file(j->path, j->dir_fd, j->progress.generation + 1, NULL, 0, 1) < 0) goto fail;
+        j->progress.generation++;
+        unlink(j->prev_path);
+        replayed = 0;
+        good_end = 0;
+    } else if (replayed < 0) {
+        // Missing, unreadable or already in the snapshot: start a new one
+        j->progress.generation++;
+        if (write_journal_file(j->path, j->dir_fd, j->progress.generation, NULL, 0, 1) < 0) goto fail;
+        replayed = 0;
+        good_end = 0;
+    }
+    // Left over from a compaction that got as far as the snapshot
+    if (had_prev == -ESTALE || had_prev == -EINVAL) unlink(j->prev_path);
+    j->fd = open(j->path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (j->fd < 0) goto fail;
+    // Cut off a torn tail so new records follow the last good one
+    if (good_end && fstat(j->fd, &st) == 0 && st.st_size > good_end && ftruncate(j->fd, good_end) < 0) goto fail;
+    j->committed = (uint32_t)replayed;
+
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->wake, NULL);
+    if (pthread_create(&j->thread, NULL, writer, j) != 0) goto fail;
+    return j;
+
+fail:
+    saved = errno;
+    if (j->fd >= 0) close(j->fd);
+    if (j->dir_fd >= 0) close(j->dir_fd);
+    journal_progress_free(&j->progress);
+    free(j);
+    errno = saved;
+    return NULL;
+}
+
+void journal_close(journal_t* j) {
+    if (!j) return;
+    pthread_mutex_lock(&j->lock);
+    j->quit = 1;
+    pthread_cond_broadcast(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+    pthread_join(j->thread, NULL);
+
+    if (j->fd >= 0) close(j->fd);
+    close(j->dir_fd);
+    pthread_mutex_destroy(&j->lock);
+    pthread_cond_destroy(&j->wake);
+    journal_progress_free(&j->progress);
+    free(j);
+}
+
+void journal_append(journal_t* j, journal_kind_t kind, const char* command, int simulated, int value) {
+    journal_record_t rec;
+
+    if (!j) return;
+    memset(&rec, 0, sizeof(rec));
+    rec.time = (uint32_t)time(NULL);
+    rec.command = kind == JOURNAL_SESSION ? 0 : journal_hash(command);
+    rec.kind = (uint8_t)kind;
+    rec.flags = simulated ? JOURNAL_SIMULATED : 0;
+    rec.value = (int16_t)value;
+    rec.check = record_check(&rec);
+
+    pthread_mutex_lock(&j->lock);
+    // The writer is behind by a whole batch: wait for it
+    while (j->n_pending == JOURNAL_BATCH) pthread_cond_wait(&j->wake, &j->lock);
+    apply(&j->progress, &rec);
+    if (j->n_pending == 0) j->oldest = bench_now();
+    j->pending[j->n_pending++] = rec;
+    if (j->n_pending == 1 || j->n_pending == JOURNAL_BATCH) pthread_cond_broadcast(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+}
+
+const char* journal_default_dir(char* buf, size_t len) {
+    const char* dir = getenv("DEB1_JOURNAL_DIR");
+    const char* home = getenv("HOME");
+
+    if (dir && *dir) return dir;
+    dir = getenv("XDG_DATA_HOME");
+    if (dir && *dir) {
+        snprintf(buf, len, "%s/deb1/progress", dir);
+    } else {
+        snprintf(buf, len, "%s/.local/share/deb1/progress", home && *home ? home : ".");
+    }
+    return buf;
+}
+
+// Report: every learner's progress folded against the lesson pack's
+// commands. A topic counts as completed when each of its commands that
+// every learner sees (no mode restriction) ran successfully.
+
+typedef struct {
+    uint32_t hash;
+    const char* text;
+    uint32_t learners, runs, failed, skipped, explained;
+} command_total_t;
+
+typedef struct {
+    const char* label;
+    uint32_t first, n;      // its commands in the topic_commands list
+    uint32_t completed;
+} topic_total_t;
+
+static int has_suffix(const char* name, const char* suffix) {
+    size_t n = strlen(name), s = strlen(suffix);
+    return n > s && strcmp(name + n - s, suffix) == 0;
+}
+
+static uint32_t collect_commands(command_total_t** out) {
+    command_total_t* cmds = NULL;
+    uint32_t n = 0, i, k;
+
+    for (i = 0; i < lessons.header->n_steps; i++) {
+        const lp_step_t* step = lp_step(&lessons, i);
+        uint32_t hash;
+
+        if (step->kind == LP_STEP_TEXT) continue;
+        hash = journal_hash(lp_str(&lessons, step->text));
+        for (k = 0; k < n && cmds[k].hash != hash; k++) {
+        }
+        if (k < n) continue;
+        cmds = xrealloc(cmds, (n + 1) * sizeof(cmds[0]));
+        memset(&cmds[n], 0, sizeof(cmds[n]));
+        cmds[n].hash = hash;
+        cmds[n].text = lp_str(&lessons, step->text);
+        n++;
+    }
+    *out = cmds;
+    return n;
+}
+
+// The commands of one topic that count towards completing it
+static void topic_steps(const lp_topic_t* topic, uint32_t** list, uint32_t* n, uint32_t* cap) {
+    uint32_t s, i;
+
+    for (s = 0; s < topic->n_sections; s++) {
+        const lp_section_t* section = lp_section(&lessons, topic, s);
+
+        for (i = 0; i < section->n_steps; i++) {
+            const lp_step_t* step = lp_step(&lessons, section->first_step + i);
+
+            if (step->kind == LP_STEP_TEXT || step->when != LP_WHEN_ALWAYS) continue;
+            if (*n == *cap) {
+                *cap = *cap ? *cap * 2 : 64;
+                *list = xrealloc(*list, *cap * sizeof(**list));
+            }
+            (*list)[(*n)++] = journal_hash(lp_str(&lessons, step->text));
+        }
+    }
+}
+
+int journal_report(const char* dir, FILE* out) {
+    DIR* d = opendir(dir);
+    struct dirent* de;
+    command_total_t* cmds;
+    topic_total_t* topics;
+    journal_progress_t p;
+    uint32_t* topic_commands = NULL;
+    uint32_t n_cmds, n_topic_commands = 0, topic_cap = 0, n_topics, t, i;
+    unsigned long learners = 0, sessions = 0;
+    char learner[256];
+
+    if (!d) return -errno;
+    memset(&p, 0, sizeof(p));
+    n_cmds = collect_commands(&cmds);
+    n_topics = lessons.header->n_topics;
+    topics = xrealloc(NULL, (n_topics ? n_topics : 1) * sizeof(topics[0]));
+    for (t = 0; t < n_topics; t++) {
+        const lp_topic_t* topic = lp_topic(&lessons, t);
+
+        topics[t].label = lp_str(&lessons, topic->label);
+        topics[t].first = n_topic_commands;
+        topic_steps(topic, &topic_commands, &n_topic_commands, &topic_cap);
+        topics[t].n = n_topic_commands - topics[t].first;
+        topics[t].completed = 0;
+    }
+
+    while ((de = readdir(d))) {
+        size_t len;
+
+        if (!has_suffix(de->d_name, ".journal")) continue;
+        len = strlen(de->d_name) - strlen(".journal");
+        if (len >= sizeof(learner)) continue;
+        memcpy(learner, de->d_name, len);
+        learner[len] = '\0';
+        if (journal_load(dir, learner, &p) < 0) continue;
+        learners++;
+        sessions += p.sessions;
+
+        for (i = 0; i < n_cmds; i++) {
+            const journal_entry_t* e = find_entry(&p, cmds[i].hash);
+
+            if (!e) continue;
+            if (e->ok) cmds[i].learners++;
+            cmds[i].runs += e->runs;
+            cmds[i].failed += e->failed;
+            cmds[i].skipped += e->skipped;
+            cmds[i].explained += e->explained;
+        }
+        for (t = 0; t < n_topics; t++) {
+            const journal_entry_t* e = NULL;
+
+            for (i = 0; i < topics[t].n; i++) {
+                e = find_entry(&p, topic_commands[topics[t].first + i]);
+                if (!e || !e->ok) break;
+            }
+            if (topics[t].n && i == topics[t].n) topics[t].completed++;
+        }
+    }
+    closedir(d);
+
+    fprintf(out, "%lu learners, %lu sessions (%s)\n\n", learners, sessions, dir);
+    // Labels start with emoji of varying width, so they go last
+    fprintf(out, "%9s %5s  %s\n", "Completed", "", "Topic");
+    for (t = 0; t < n_topics; t++) {
+        fprintf(out, "%9u %4.0f%%  %s\n", topics[t].completed,
+                learners ? 100.0 * topics[t].completed / learners : 0, topics[t].label);
+    }
+    fprintf(out, "\n%-44s %8s %8s %7s %8s %9s\n", "Command", "Learners", "Runs", "Failed", "Skipped", "Explained");
+    for (i = 0; i < n_cmds; i++) {
+        fprintf(out, "%-44.44s %8u %8u %7u %8u %9u\n", cmds[i].text, cmds[i].learners, cmds[i].runs,
+                cmds[i].failed, cmds[i].skipped, cmds[i].explained);
+    }
+
+    journal_progress_free(&p);
+    free(topic_commands);
+    free(topics);
+    free(cmds);
+    return 0;
+}
+
+// Benchmark: group commit against an fsync per record, recovery from a
+// long journal and from a snapshot, and the report over many learners.
+
+static void fill_record(journal_record_t* rec, uint32_t command, uint32_t i) {
+    static const uint8_t kinds[] = { JOURNAL_RUN, JOURNAL_OUTCOME, JOURNAL_RUN, JOURNAL_OUTCOME, JOURNAL_SKIP,
+                                     JOURNAL_EXPLAIN };
+
+    memset(rec, 0, sizeof(*rec));
+    rec->time = 1700000000u + i;
+    rec->command = command;
+    rec->kind = kinds[i % sizeof(kinds)];
+    rec->flags = JOURNAL_SIMULATED;
+    rec->value = (int16_t)(rec->kind == JOURNAL_OUTCOME && i % 7 == 0);
+    rec->check = record_check(rec);
+}
+
+static void remove_dir(const char* dir) {
+    DIR* d = opendir(dir);
+    struct dirent* de;
+    char path[1024];
+
+    if (!d) return;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+int journal_bench(int argc, char** argv) {
+    int learners = argc > 0 ? atoi(argv[0]) : 10000;
+    char dir[] = "/tmp/deb1-journal-XXXXXX";
+    char path[512], learner[64];
+    command_total_t* cmds;
+    journal_record_t* recs;
+    journal_t* j;
+    uint32_t n_cmds, i;
+    double start, elapsed;
+    unsigned long commits;
+    int fd, l, appends = 20000, synced = 300, long_journal = 200000;
+    FILE* null_out;
+
+    if (learners < 1) learners = 1;
+    load_lessons(NULL);
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    n_cmds = collect_commands(&cmds);
+    recs = xrealloc(NULL, (size_t)long_journal * sizeof(recs[0]));
+
+    // Appends through the writer thread, against fdatasync per record
+    j = journal_open(dir, "append");
+    if (!j) {
+        perror(dir);
+        return 1;
+    }
+    start = bench_now();
+    for (l = 0; l < appends; l++) {
+        journal_append(j, l % 3 ? JOURNAL_OUTCOME : JOURNAL_RUN, cmds[l % n_cmds].text, 1, 0);
+    }
+    pthread_mutex_lock(&j->lock);
+    commits = j->commits + (j->n_pending != 0);
+    pthread_mutex_unlock(&j->lock);
+    journal_close(j);
+    elapsed = bench_now() - start;
+    bench_report("journal", "group_commit", appends / elapsed, "records/s");
+    bench_report("journal", "group_commit_fsyncs", (double)commits, "fsyncs");
+
+    snprintf(path, sizeof(path), "%s/fsync-each", dir);
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    start = bench_now();
+    for (l = 0; l < synced; l++) {
+        fill_record(&recs[0], cmds[l % n_cmds].hash, (uint32_t)l);
+        if (write_all(fd, &recs[0], sizeof(recs[0])) < 0 || fdatasync(fd) < 0) break;
+    }
+    elapsed = bench_now() - start;
+    close(fd);
+    unlink(path);
+    bench_report("journal", "fsync_per_record", synced / elapsed, "records/s");
+
+    // Recovery: a long journal replayed, then the same progress from a snapshot
+    for (i = 0; i < (uint32_t)long_journal; i++) fill_record(&recs[i], cmds[i % n_cmds].hash, i);
+    snprintf(path, sizeof(path), "%s/recover.journal", dir);
+    write_journal_file(path, -1, 1, recs, (size_t)long_journal, 0);
+    start = bench_now();
+    j = journal_open(dir, "recover");
+    elapsed = bench_now() - start;
+    bench_report("journal", "recover_200k_records", elapsed * 1e3, "ms");
+    journal_close(j);       // compacts first: over JOURNAL_COMPACT_AT
+    start = bench_now();
+    j = journal_open(dir, "recover");
+    elapsed = bench_now() - start;
+    bench_report("journal", "recover_snapshot", elapsed * 1e3, "ms");
+    journal_close(j);
+
+    // Many learners, each with a few sessions' worth of records; every
+    // other one already compacted
+    for (l = 0; l < learners; l++) {
+        uint32_t n = 60 + (uint32_t)(l % 5) * 20;
+
+        for (i = 0; i < n; i++) fill_record(&recs[i], cmds[(i * 7 + (uint32_t)l) % n_cmds].hash, i);
+        snprintf(learner, sizeof(learner), "learner%05d", l);
+        snprintf(path, sizeof(path), "%s/%s.journal", dir, learner);
+        if (l % 2) {
+            journal_progress_t p;
+
+            memset(&p, 0, sizeof(p));
+            for (i = 0; i < n; i++) apply(&p, &recs[i]);
+            p.generation = 1;
+            snprintf(path, sizeof(path), "%s/%s.snap", dir, learner);
+            write_snapshot(path, -1, &p);
+            journal_progress_free(&p);
+            snprintf(path, sizeof(path), "%s/%s.journal", dir, learner);
+            write_journal_file(path, -1, 2, recs, 10, 0);
+        } else {
+            write_journal_file(path, -1, 1, recs, n, 0);
+        }
+    }
+    null_out = fopen("/dev/null", "w");
+    start = bench_now();
+    journal_report(dir, null_out);
+    elapsed = bench_now() - start;
+    fclose(null_out);
+    bench_report("journal", "report_learners", learners, "learners");
+    bench_report("journal", "report", elapsed * 1e3, "ms");
+
+    remove_dir(dir);
+    free(recs);
+    free(cmds);
+    lesson_pack_close(&lessons);
+    return 0;
+}
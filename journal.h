@@ -0,0 +1,107 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// Learner progress, kept across runs.
+//
+// Every demo choice and command outcome is appended to the learner's
+// journal, DIR/<learner>.journal: a 16-byte header, then 16-byte records
+// that each carry a checksum, so a torn write at the end is found and cut
+// off on the next start. Appends only reach memory; a writer thread
+// commits them in groups, one write() and one fdatasync() per batch,
+// when JOURNAL_BATCH records are waiting or the oldest has waited
+// JOURNAL_SYNC_MS.
+//
+// Progress is folded per command (keyed by a hash of the command text, so
+// it survives edits to the lesson pack). Once JOURNAL_COMPACT_AT records
+// have been committed, the writer thread renames the journal to
+// <learner>.journal.prev, starts a new one with the next generation and
+// writes the folded progress to <learner>.snap; the .prev file goes when
+// the snapshot is safely in place. Starting up reads the snapshot and
+// replays only the journals of later generations.
+
+#define JOURNAL_BATCH 64
+#define JOURNAL_SYNC_MS 2000
+#define JOURNAL_COMPACT_AT 4096
+
+typedef enum {
+    JOURNAL_SESSION = 1,    // the tutor started
+    JOURNAL_RUN,            // "Run this command now"
+    JOURNAL_EXPLAIN,        // "Just see the explanation"
+    JOURNAL_SKIP,
+    JOURNAL_OUTCOME         // value is the exit status
+} journal_kind_t;
+
+#define JOURNAL_SIMULATED 0x01
+
+typedef struct {
+    uint32_t time;
+    uint32_t command;       // journal_hash() of the command
+    uint8_t kind;
+    uint8_t flags;
+    int16_t value;
+    uint32_t check;         // hash of the 12 bytes before it
+} journal_record_t;
+
+// A command's progress, folded from its records
+typedef struct {
+    uint32_t command;
+    uint32_t runs, ok, failed, explained, skipped;
+    uint32_t first, last;   // times of the first and last record
+} journal_entry_t;
+
+typedef struct {
+    journal_entry_t* entries;   // sorted by command
+    uint32_t n_entries, cap;
+    uint32_t sessions;
+    uint32_t generation;        // of the newest journal folded in
+} journal_progress_t;
+
+typedef struct {
+    char path[512], prev_path[512], snap_path[512];
+    int fd;                 // current journal, written by the thread only
+    int dir_fd;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t thread;
+    int quit;
+
+    journal_progress_t progress;    // includes records not committed yet
+    journal_record_t pending[JOURNAL_BATCH];
+    uint32_t n_pending;
+    double oldest;          // when the first pending record was appended
+    uint32_t committed;     // records in the journals since the snapshot
+
+    unsigned long commits, records_written, compactions;
+} journal_t;
+
+uint32_t journal_hash(const char* text);
+
+// Open (creating DIR if needed) and recover the journal of learner.
+// Returns NULL with errno set.
+journal_t* journal_open(const char* dir, const char* learner);
+
+// Commit what is pending, stop the writer thread and free everything
+void journal_close(journal_t* j);
+
+void journal_append(journal_t* j, journal_kind_t kind, const char* command, int simulated, int value);
+
+// Where progress goes by default: $DEB1_JOURNAL_DIR, else
+// $XDG_DATA_HOME/deb1/progress or ~/.local/share/deb1/progress
+const char* journal_default_dir(char* buf, size_t len);
+
+// Progress of one learner from what is on disk (read-only)
+int journal_load(const char* dir, const char* learner, journal_progress_t* progress);
+void journal_progress_free(journal_progress_t* progress);
+
+// Summary of every learner in dir against the loaded lesson pack
+int journal_report(const char* dir, FILE* out);
+
+// --bench journal [learners]
+int journal_bench(int argc, char** argv);
+
+#endif
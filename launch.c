@@ -0,0 +1,522 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "sim.h"
+#include "launch.h"
+
+#define MAX_ARGS 64
+#define MAX_STAGES (MAX_ARGS / 2)
+#define CHUNK 16384
+// Time a stopped command gets between SIGTERM and SIGKILL
+#define STOP_GRACE_MS 1000
+
+extern char** environ;
+
+typedef struct {
+    pid_t pid;              // 0 once reaped, or if it never started
+    int pidfd;              // readable when the process exits; -1 if unsupported
+    int status;
+} stage_t;
+
+typedef struct {
+    const launch_opts_t* opts;
+    launch_result_t* result;
+    stage_t stage[MAX_STAGES];
+    int n_stages;
+    pid_t pgid;
+    int fd;                 // read end of the output pipe, -1 once closed
+    double kill_at;         // when SIGTERM becomes SIGKILL, 0 = not stopping
+    int killed;
+} run_t;
+
+// Words that only mean something to a shell
+static const char* shell_words[] = {
+    "!", ".", "alias", "bg", "cd", "eval", "exec", "exit", "export", "fg", "hash", "history",
+    "jobs", "read", "set", "source", "time", "type", "ulimit", "umask", "unalias", "unset", "wait",
+};
+
+static volatile sig_atomic_t interrupted;
+
+static void on_sigint(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int shell_status(int wstatus) {
+    if (WIFEXITED(wstatus)) return WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus)) return 128 + WTERMSIG(wstatus);
+    return 1;
+}
+
+// Whether the tokenized line still needs /bin/sh: builtins, variable
+// assignments and ~user, which the tokenizer leaves alone
+static int needs_shell(char** argv, int argc) {
+    int i;
+    size_t j;
+
+    for (i = 0; i < argc; i++) {
+        const char* word = argv[i];
+        const char* eq;
+
+        if (!word) continue;
+        if (word[0] == '~') return 1;
+        if (i > 0 && argv[i - 1]) continue;
+        for (j = 0; j < sizeof(shell_words) / sizeof(shell_words[0]); j++) {
+            if (strcmp(word, shell_words[j]) == 0) return 1;
+        }
+        eq = strchr(word, '=');
+        if (eq && eq != word && !memchr(word, '/', (size_t)(eq - word))) return 1;
+    }
+    return 0;
+}
+
+// Start one stage in process group pgid (0: a new group led by it).
+// in_fd < 0 reads /dev/null, STDIN_FILENO keeps the terminal.
+static int start_stage(char** argv, int in_fd, int out_fd, int err_fd, pid_t pgid, int search_path, pid_t* pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    int rc;
+
+    posix_spawn_file_actions_init(&actions);
+    if (in_fd < 0) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    } else if (in_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+    // Own process group, default signal handling, nothing blocked
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigfillset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+
+    rc = search_path ? posix_spawnp(pid, argv[0], &actions, &attr, argv, environ)
+                     : posix_spawn(pid, argv[0], &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return -rc;
+}
+
+static int any_running(const run_t* r) {
+    int i;
+
+    for (i = 0; i < r->n_stages; i++) {
+        if (r->stage[i].pid) return 1;
+    }
+    return 0;
+}
+
+static void stop(run_t* r, launch_end_t why) {
+    if (r->kill_at) return;
+    r->result->end = why;
+    r->kill_at = now_ms() + STOP_GRACE_MS;
+    if (any_running(r)) {
+        kill(-r->pgid, SIGTERM);
+        kill(-r->pgid, SIGCONT);
+    }
+    // Nothing more is passed on; writers get EPIPE and finish sooner
+    if (r->fd >= 0) close(r->fd);
+    r->fd = -1;
+}
+
+static void deliver(run_t* r, const char* data, size_t len) {
+    size_t max = r->opts->max_output;
+    size_t done = r->result->output_bytes;
+    int over = 0;
+
+    if (max && len > max - done) {
+        len = max - done;
+        over = 1;
+    }
+    if (len) {
+        r->result->output_bytes += len;
+        if (r->opts->on_output && r->opts->on_output(r->opts->ctx, data, len) != 0) {
+            stop(r, LAUNCH_CANCELLED);
+            return;
+        }
+    }
+    if (over) stop(r, LAUNCH_OUTPUT_LIMIT);
+}
+
+// Collect stages that have exited; returns how many are still running
+static int reap(run_t* r) {
+    int i, live = 0;
+
+    for (i = 0; i < r->n_stages; i++) {
+        stage_t* s = &r->stage[i];
+        int wstatus;
+        pid_t got;
+
+        if (!s->pid) continue;
+        got = waitpid(s->pid, &wstatus, WNOHANG);
+        if (got == 0 || (got < 0 && errno == EINTR)) {
+            live++;
+            continue;
+        }
+        // ECHILD: someone else reaped it; its status is lost
+        s->status = got == s->pid ? shell_status(wstatus) : 0;
+        s->pid = 0;
+        if (s->pidfd >= 0) close(s->pidfd);
+        s->pidfd = -1;
+    }
+    return live;
+}
+
+// Read what is already in the pipe without waiting for writers that
+// outlived the command (daemons it started in the background)
+static void drain(run_t* r) {
+    char chunk[CHUNK];
+    ssize_t got;
+
+    fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) | O_NONBLOCK);
+    while (r->fd >= 0 && (got = read(r->fd, chunk, sizeof(chunk))) > 0) deliver(r, chunk, (size_t)got);
+    if (r->fd >= 0) close(r->fd);
+    r->fd = -1;
+}
+
+// Hand the terminal to pgid (0: take it back). SIGTTOU is blocked because
+// a background process group may not change the foreground one.
+static void set_terminal(pid_t pgid) {
+    sigset_t block, old;
+
+    sigemptyset(&block);
+    sigaddset(&block, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &block, &old);
+    tcsetpgrp(STDIN_FILENO, pgid ? pgid : getpgrp());
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+static void wait_for_output(run_t* r, double deadline) {
+    char chunk[CHUNK];
+    int live = any_running(r);
+
+    while (r->fd >= 0 || live) {
+        struct pollfd pfd[MAX_STAGES + 2];
+        int n_pfd = 0, timeout = -1, all_pidfds = 1, cancel = -1, i, n;
+        double now = now_ms();
+
+        if (!r->kill_at) {
+            if (r->opts->foreground && interrupted) {
+                stop(r, LAUNCH_CANCELLED);
+            } else if (deadline && now >= deadline) {
+                stop(r, LAUNCH_TIMED_OUT);
+            }
+        }
+        if (r->kill_at) {
+            if (!r->killed && now >= r->kill_at) {
+                if (any_running(r)) kill(-r->pgid, SIGKILL);
+                r->killed = 1;
+            }
+            if (!r->killed) timeout = (int)(r->kill_at - now) + 1;
+        } else if (deadline) {
+            timeout = (int)(deadline - now) + 1;
+        }
+
+        if (r->fd >= 0) {
+            pfd[n_pfd].fd = r->fd;
+            pfd[n_pfd++].events = POLLIN;
+        }
+        for (i = 0; i < r->n_stages; i++) {
+            if (!r->stage[i].pid) continue;
+            if (r->stage[i].pidfd < 0) {
+                all_pidfds = 0;
+                continue;
+            }
+            pfd[n_pfd].fd = r->stage[i].pidfd;
+            pfd[n_pfd++].events = POLLIN;
+        }
+        if (r->opts->cancel_fd > 0 && !r->kill_at) {
+            cancel = n_pfd;
+            pfd[n_pfd].fd = r->opts->cancel_fd;
+            pfd[n_pfd++].events = POLLIN;
+        }
+        // Without pidfds, exits are only noticed by checking now and then
+        if (!all_pidfds && r->fd < 0 && (timeout < 0 || timeout > 10)) timeout = 10;
+
+        n = poll(pfd, (nfds_t)n_pfd, timeout);
+        if (n < 0) {
+            if (errno != EINTR) stop(r, LAUNCH_FAILED);
+            continue;
+        }
+        if (cancel >= 0 && pfd[cancel].revents) stop(r, LAUNCH_CANCELLED);
+        if (r->fd >= 0 && pfd[0].revents) {
+            ssize_t got = read(r->fd, chunk, sizeof(chunk));
+
+            if (got > 0) {
+                deliver(r, chunk, (size_t)got);
+            } else if (got == 0 || errno != EINTR) {
+                close(r->fd);
+                r->fd = -1;
+            }
+        }
+        live = reap(r);
+        if (!live && r->fd >= 0) drain(r);
+    }
+}
+
+int launch_command(const char* command, const launch_opts_t* opts, launch_result_t* result) {
+    char buf[4096];
+    char* argv[MAX_ARGS];
+    char* shell_argv[] = { "sh", "-c", (char*)command, NULL };
+    char** stage_argv[MAX_STAGES];
+    const char* home = getenv("HOME");
+    struct sigaction sa, old_sa;
+    int argc, i, out[2], in, terminal;
+    double start = now_ms();
+    run_t r;
+
+    memset(result, 0, sizeof(*result));
+    memset(&r, 0, sizeof(r));
+    r.opts = opts;
+    r.result = result;
+
+    // Plain words and pipes run directly; anything else goes to the shell
+    argc = sim_tokenize(command, buf, sizeof(buf), argv, MAX_ARGS - 1, home ? home : "/");
+    if (argc > 0 && argv[0] && argv[argc - 1] && !needs_shell(argv, argc)) {
+        argv[argc] = NULL;
+        stage_argv[r.n_stages++] = argv;
+        for (i = 0; i < argc; i++) {
+            if (argv[i]) continue;
+            if (!argv[i + 1]) break;
+            stage_argv[r.n_stages++] = argv + i + 1;
+        }
+        if (i < argc) r.n_stages = 0;
+    }
+    if (r.n_stages == 0) {
+        stage_argv[r.n_stages++] = shell_argv;
+        shell_argv[0] = "/bin/sh";
+        result->used_shell = 1;
+    }
+    result->stages = r.n_stages;
+
+    if (pipe2(out, O_CLOEXEC) < 0) {
+        result->end = LAUNCH_FAILED;
+        return -errno;
+    }
+    r.fd = out[0];
+    terminal = opts->foreground && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+
+    in = terminal ? STDIN_FILENO : -1;
+    for (i = 0; i < r.n_stages; i++) {
+        stage_t* s = &r.stage[i];
+        int next[2] = { -1, -1 };
+        int rc;
+
+        s->pidfd = -1;
+        if (i + 1 < r.n_stages && pipe2(next, O_CLOEXEC) < 0) {
+            // Out of descriptors: stop the stages already started
+            r.n_stages = i;
+            stop(&r, LAUNCH_FAILED);
+            break;
+        }
+        rc = start_stage(stage_argv[i], in, next[1] >= 0 ? next[1] : out[1], out[1], r.pgid,
+                         !result->used_shell, &s->pid);
+        if (in > STDIN_FILENO) close(in);
+        if (next[1] >= 0) close(next[1]);
+        in = next[0];
+
+        if (rc == 0) {
+            if (!r.pgid) r.pgid = s->pid;
+            s->pidfd = (int)syscall(SYS_pidfd_open, s->pid, 0);
+        } else if (result->used_shell) {
+            close(out[0]);
+            close(out[1]);
+            result->end = LAUNCH_FAILED;
+            return rc;
+        } else {
+            // As a shell would: the rest of the pipeline still runs
+            char msg[300];
+            int len = snprintf(msg, sizeof(msg), "%s: %s\n", stage_argv[i][0],
+                               rc == -ENOENT ? "command not found" : strerror(-rc));
+
+            s->pid = 0;
+            s->status = rc == -ENOENT ? 127 : 126;
+            deliver(&r, msg, (size_t)len < sizeof(msg) ? (size_t)len : sizeof(msg) - 1);
+        }
+    }
+    if (in > STDIN_FILENO) close(in);
+    close(out[1]);
+
+    // Ctrl-C reaches the command directly while it owns the terminal;
+    // otherwise it arrives here and stops the command
+    if (opts->foreground) {
+        interrupted = 0;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_sigint;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, &old_sa);
+    }
+    if (terminal && r.pgid) {
+        set_terminal(r.pgid);
+        // In case it touched the terminal before it was allowed to
+        kill(-r.pgid, SIGCONT);
+    }
+
+    wait_for_output(&r, opts->timeout_ms > 0 ? start + opts->timeout_ms : 0);
+
+    if (terminal && r.pgid) set_terminal(0);
+    if (opts->foreground) {
+        sigaction(SIGINT, &old_sa, NULL);
+        if (result->end == LAUNCH_EXITED && interrupted) result->end = LAUNCH_CANCELLED;
+    }
+    result->status = result->end == LAUNCH_FAILED || !r.n_stages ? 1 : r.stage[r.n_stages - 1].status;
+    result->elapsed = (now_ms() - start) / 1e3;
+    return 0;
+}
+
+// Benchmark: starting commands with system() (fork of the whole tutor,
+// then /bin/sh, then the command) against launch_command(), for a single
+// command and a two-stage pipeline, with the tutor's heap small and then
+// inflated to show what the fork costs as the process grows.
+
+static int discard_output(void* ctx, const char* data, size_t len) {
+    (void)data;
+    *(size_t*)ctx += len;
+    return 0;
+}
+
+static int run_with_system(const char* command) {
+    char redirected[256];
+
+    snprintf(redirected, sizeof(redirected), "%s >/dev/null 2>&1 </dev/null", command);
+    return system(redirected);
+}
+
+static int run_with_spawn(const char* command) {
+    launch_opts_t opts;
+    launch_result_t result;
+    size_t bytes = 0;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.timeout_ms = 10000;
+    opts.on_output = discard_output;
+    opts.ctx = &bytes;
+    return launch_command(command, &opts, &result) < 0 ? -1 : result.status;
+}
+
+static double time_runs(int (*run)(const char*), const char* command, int runs) {
+    double start;
+    int i;
+
+    run(command);
+    start = bench_now();
+    for (i = 0; i < runs; i++) {
+        if (run(command) != 0) {
+            fprintf(stderr, "'%s' failed\n", command);
+            return 0;
+        }
+    }
+    return (bench_now() - start) / runs * 1e6;
+}
+
+static char* inflate_heap(size_t mb) {
+    char* heap;
+
+    if (!mb) return NULL;
+    heap = mmap(NULL, mb << 20, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (heap == MAP_FAILED) return NULL;
+    // Small pages, like a heap built from many allocations
+    madvise(heap, mb << 20, MADV_NOHUGEPAGE);
+    memset(heap, 1, mb << 20);
+    return heap;
+}
+
+// Largest resident size any of the commands (or the forks behind them)
+// reached, measured in a helper process with a heap of the given size
+static long child_peak_kb(int (*run)(const char*), const char* command, size_t heap_mb, int runs) {
+    int fds[2], i, status;
+    long peak = -1;
+    pid_t pid;
+
+    if (pipe(fds) < 0) return -1;
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        struct rusage ru;
+
+        close(fds[0]);
+        inflate_heap(heap_mb);
+        for (i = 0; i < runs; i++) run(command);
+        getrusage(RUSAGE_CHILDREN, &ru);
+        peak = ru.ru_maxrss;
+        if (write(fds[1], &peak, sizeof(peak)) < 0) _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &peak, sizeof(peak)) != sizeof(peak)) peak = -1;
+        waitpid(pid, &status, 0);
+    }
+    close(fds[0]);
+    return peak;
+}
+
+int launch_bench(int argc, char** argv) {
+    static const struct {
+        const char* name;
+        const char* command;
+    } cases[] = {
+        { "true", "true" },
+        { "pipeline", "echo hello | tr a-z A-Z" },
+    };
+    int runs = argc > 0 ? atoi(argv[0]) : 200;
+    size_t heap_mb = argc > 1 ? (size_t)atol(argv[1]) : 256;
+    char metric[64];
+    char* heap;
+    size_t i;
+
+    if (runs < 10) runs = 10;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        snprintf(metric, sizeof(metric), "system_%s", cases[i].name);
+        bench_report("launch", metric, time_runs(run_with_system, cases[i].command, runs), "us");
+        snprintf(metric, sizeof(metric), "spawn_%s", cases[i].name);
+        bench_report("launch", metric, time_runs(run_with_spawn, cases[i].command, runs), "us");
+    }
+
+    heap = inflate_heap(heap_mb);
+    if (!heap) {
+        fprintf(stderr, "Could not allocate a %zu MB heap\n", heap_mb);
+        return 1;
+    }
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        snprintf(metric, sizeof(metric), "system_%s_heap%zuMB", cases[i].name, heap_mb);
+        bench_report("launch", metric, time_runs(run_with_system, cases[i].command, runs), "us");
+        snprintf(metric, sizeof(metric), "spawn_%s_heap%zuMB", cases[i].name, heap_mb);
+        bench_report("launch", metric, time_runs(run_with_spawn, cases[i].command, runs), "us");
+    }
+    munmap(heap, heap_mb << 20);
+
+    // Linux charges the parent's high-water mark to a child that execs
+    // from a shared address space too, so both show the tutor's size here
+    bench_report("launch", "system_peak_rss", child_peak_kb(run_with_system, "true", heap_mb, 10), "KB");
+    bench_report("launch", "spawn_peak_rss", child_peak_kb(run_with_spawn, "true", heap_mb, 10), "KB");
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <stddef.h>
+
+// Running real commands in live mode.
+//
+// A command line is split with the simulator's tokenizer; when it is plain
+// words and pipes, every stage is started directly with posix_spawnp() and
+// connected with pipes, otherwise it goes to /bin/sh -c. All stages share
+// one process group, so a time limit, an output limit or Ctrl-C stops the
+// whole pipeline. stdout and stderr of every stage arrive on one pipe and
+// are handed to the caller chunk by chunk as they are produced.
+
+typedef enum {
+    LAUNCH_EXITED,           // ran to completion (status is its exit code)
+    LAUNCH_TIMED_OUT,
+    LAUNCH_OUTPUT_LIMIT,
+    LAUNCH_CANCELLED,        // Ctrl-C, cancel_fd, or on_output asked to stop
+    LAUNCH_FAILED            // could not be started
+} launch_end_t;
+
+typedef struct {
+    int timeout_ms;         // wall-clock limit, 0 = none
+    size_t max_output;      // bytes passed on before the command is stopped, 0 = no limit
+    int foreground;         // lend the controlling terminal (prompts, Ctrl-C)
+    int cancel_fd;          // stop the command once this is readable, 0 = none
+
+    // Receives output as it arrives; returning nonzero stops the command
+    int (*on_output)(void* ctx, const char* data, size_t len);
+    void* ctx;
+} launch_opts_t;
+
+typedef struct {
+    launch_end_t end;
+    int status;             // as a shell reports it: exit code, 128 + signal
+    int used_shell;
+    int stages;
+    size_t output_bytes;
+    double elapsed;         // seconds
+} launch_result_t;
+
+// Run command and wait for it (or for a limit). Returns 0, or -errno when
+// nothing could be started; a stage that is not found reports 127 like sh.
+// Only a foreground run touches the terminal or SIGINT, so background runs
+// may happen on other threads.
+int launch_command(const char* command, const launch_opts_t* opts, launch_result_t* result);
+
+// --bench launch [runs]
+int launch_bench(int argc, char** argv);
+
+#endif
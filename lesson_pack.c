@@ -0,0 +1,636 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lesson_pack.h"
+#include "bench.h"
+#include "util.h"
+
+// ---------------------------------------------------------------------
+// Loading and access
+// ---------------------------------------------------------------------
+
+static int table_fits(size_t size, uint32_t off, uint32_t count, size_t elem) {
+    return off % 4 == 0 && off <= size && (size - off) / elem >= count;
+}
+
+// Header-only validation: constant time regardless of pack size.
+// Individual offsets are range-checked lazily by the accessors.
+static int attach(lesson_pack_t* pack, const uint8_t* base, size_t size, char* err, size_t err_len) {
+    const lp_header_t* h = (const lp_header_t*)base;
+
+    if (size < sizeof(lp_header_t) || memcmp(h->magic, LP_MAGIC, sizeof(LP_MAGIC)) != 0) {
+        return set_error(err, err_len, "not a lesson pack");
+    }
+    if (h->byte_order != LP_BYTE_ORDER) {
+        return set_error(err, err_len, "lesson pack built for a different byte order");
+    }
+    if (h->version != LP_VERSION) {
+        return set_error(err, err_len, "unsupported lesson pack version %u", h->version);
+    }
+    if (h->total_size != size ||
+        !table_fits(size, h->topics_off, h->n_topics, sizeof(lp_topic_t)) ||
+        !table_fits(size, h->sections_off, h->n_sections, sizeof(lp_section_t)) ||
+        !table_fits(size, h->steps_off, h->n_steps, sizeof(lp_step_t)) ||
+        h->strings_size == 0 || !table_fits(size, h->strings_off, h->strings_size, 1) ||
+        base[h->strings_off + h->strings_size - 1] != '\0') {
+        return set_error(err, err_len, "lesson pack is truncated or corrupt");
+    }
+
+    pack->base = base;
+    pack->size = size;
+    pack->header = h;
+    pack->topics = (const lp_topic_t*)(base + h->topics_off);
+    pack->sections = (const lp_section_t*)(base + h->sections_off);
+    pack->steps = (const lp_step_t*)(base + h->steps_off);
+    pack->strings = (const char*)(base + h->strings_off);
+    return 0;
+}
+
+int lesson_pack_open(lesson_pack_t* pack, const char* path, char* err, size_t err_len) {
+    struct stat st;
+    void* base;
+    int fd;
+
+    memset(pack, 0, sizeof(*pack));
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return set_error(err, err_len, "%s: cannot open", path);
+    }
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        close(fd);
+        return set_error(err, err_len, "%s: empty or unreadable", path);
+    }
+
+    // MAP_SHARED of a read-only file: every process on the host that opens
+    // the same pack shares the same page-cache pages.
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return set_error(err, err_len, "%s: mmap failed", path);
+    }
+
+    if (attach(pack, base, (size_t)st.st_size, err, err_len) < 0) {
+        munmap(base, (size_t)st.st_size);
+        return -1;
+    }
+    pack->mapped = 1;
+    return 0;
+}
+
+void lesson_pack_close(lesson_pack_t* pack) {
+    if (pack->base) {
+        if (pack->mapped) {
+            munmap((void*)pack->base, pack->size);
+        } else {
+            free((void*)pack->base);
+        }
+    }
+    memset(pack, 0, sizeof(*pack));
+}
+
+const char* lp_str(const lesson_pack_t* pack, uint32_t offset) {
+    if (offset >= pack->header->strings_size) return "";
+    return pack->strings + offset;
+}
+
+const lp_topic_t* lp_topic(const lesson_pack_t* pack, uint32_t index) {
+    if (index >= pack->header->n_topics) return NULL;
+    return &pack->topics[index];
+}
+
+const lp_section_t* lp_section(const lesson_pack_t* pack, const lp_topic_t* topic, uint32_t index) {
+    uint32_t i;
+
+    if (index >= topic->n_sections) return NULL;
+    i = topic->first_section + index;
+    if (i < topic->first_section || i >= pack->header->n_sections) return NULL;
+    return &pack->sections[i];
+}
+
+const lp_step_t* lp_step(const lesson_pack_t* pack, uint32_t index) {
+    if (index >= pack->header->n_steps) return NULL;
+    return &pack->steps[index];
+}
+
+// ---------------------------------------------------------------------
+// Compiler
+// ---------------------------------------------------------------------
+//
+// Source format: one directive per line, "#" starts a comment.
+//
+//   pack <title>
+//   topic <main menu label>
+//     title <heading line>             (repeat for more lines)
+//     say[.color][@when] <text>         (repeat to continue the paragraph)
+//     menu <submenu question>
+//     section <submenu label>
+//       say ...
+//       cmd <command>
+//       desc <what it does>
+//       out <simulated output line>     (repeat for more lines)
+//       task <what the learner should do>   (an exercise; repeat for more lines)
+//       answer <accepted command>       (repeat; the first is shown as the solution)
+//       hint <shown after a wrong answer>
+//       check output                    (also accept what prints the same)
+//     outro                            (following says run after any section)
+//
+// color: green blue yellow red cyan     when: sim live ubuntu debian
+
+typedef struct {
+    char* data;
+    size_t len, cap;
+    size_t lines;           // lines added with grow_line()
+} grow_t;
+
+typedef struct {
+    uint32_t* slots;        // string offsets + 1, 0 = empty slot
+    size_t cap, count;
+} intern_t;
+
+typedef struct {
+    grow_t topics, sections, steps, strings;
+    intern_t intern;
+    uint32_t title;
+
+    // The topic being built
+    int in_topic;
+    int in_outro;
+    lp_topic_t topic;
+    grow_t topic_title;
+
+    // The step being built, flushed when a different directive arrives
+    int pending;            // 0 none, 1 text, 2 command, 3 exercise
+    lp_step_t step;
+    grow_t text, desc, output;
+    char last_directive[16];
+
+    const char* path;
+    int line;
+    char* err;
+    size_t err_len;
+} builder_t;
+
+static void grow_reserve(grow_t* g, size_t extra) {
+    if (g->len + extra <= g->cap) return;
+    while (g->len + extra > g->cap) g->cap = g->cap ? g->cap * 2 : 256;
+    g->data = realloc(g->data, g->cap);
+    if (!g->data) {
+        perror("realloc");
+        exit(1);
+    }
+}
+
+static void grow_append(grow_t* g, const void* data, size_t len) {
+    if (!len) return;
+    grow_reserve(g, len);
+    memcpy(g->data + g->len, data, len);
+    g->len += len;
+}
+
+static void grow_line(grow_t* g, const char* text) {
+    if (g->lines++) grow_append(g, "\n", 1);
+    grow_append(g, text, strlen(text));
+}
+
+static uint32_t hash_bytes(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Store a string once; identical strings share one offset.
+static uint32_t intern(builder_t* b, const char* s, size_t len) {
+    intern_t* in = &b->intern;
+    size_t i, mask;
+    uint32_t off;
+
+    if (len == 0) return 0;
+
+    if ((in->count + 1) * 2 > in->cap) {
+        intern_t bigger = { 0 };
+        bigger.cap = in->cap ? in->cap * 2 : 1024;
+        bigger.slots = calloc(bigger.cap, sizeof(uint32_t));
+        for (i = 0; i < in->cap; i++) {
+            if (in->slots[i]) {
+                const char* old = b->strings.data + in->slots[i] - 1;
+                size_t j = hash_bytes(old, strlen(old)) & (bigger.cap - 1);
+                while (bigger.slots[j]) j = (j + 1) & (bigger.cap - 1);
+                bigger.slots[j] = in->slots[i];
+            }
+        }
+        bigger.count = in->count;
+        free(in->slots);
+        *in = bigger;
+    }
+
+    mask = in->cap - 1;
+    for (i = hash_bytes(s, len) & mask; in->slots[i]; i = (i + 1) & mask) {
+        const char* old = b->strings.data + in->slots[i] - 1;
+        if (strncmp(old, s, len) == 0 && old[len] == '\0') {
+            return in->slots[i] - 1;
+        }
+    }
+
+    off = (uint32_t)b->strings.len;
+    grow_append(&b->strings, s, len);
+    grow_append(&b->strings, "", 1);
+    in->slots[i] = off + 1;
+    in->count++;
+    return off;
+}
+
+static int build_error(builder_t* b, const char* message) {
+    return set_error(b->err, b->err_len, "%s:%d: %s", b->path, b->line, message);
+}
+
+static uint32_t step_count(builder_t* b) {
+    return (uint32_t)(b->steps.len / sizeof(lp_step_t));
+}
+
+static void flush_step(builder_t* b) {
+    if (!b->pending) return;
+
+    b->step.text = intern(b, b->text.data, b->text.len);
+    if (b->pending >= 2) {
+        b->step.description = intern(b, b->desc.data, b->desc.len);
+        b->step.output = intern(b, b->output.data, b->output.len);
+    }
+    grow_append(&b->steps, &b->step, sizeof(b->step));
+
+    if (b->in_outro) {
+        b->topic.n_outro++;
+    } else if (b->topic.n_sections) {
+        lp_section_t* s = (lp_section_t*)b->sections.data + b->sections.len / sizeof(lp_section_t) - 1;
+        s->n_steps++;
+    } else {
+        b->topic.n_intro++;
+    }
+
+    b->pending = 0;
+    b->text.len = b->desc.len = b->output.len = 0;
+    b->text.lines = b->desc.lines = b->output.lines = 0;
+}
+
+static void flush_topic(builder_t* b) {
+    flush_step(b);
+    if (!b->in_topic) return;
+    b->topic.title = intern(b, b->topic_title.data, b->topic_title.len);
+    grow_append(&b->topics, &b->topic, sizeof(b->topic));
+    b->in_topic = 0;
+}
+
+static int parse_color(const char* name, size_t len) {
+    static const char* names[] = { "", "green", "blue", "yellow", "red", "cyan" };
+    size_t i;
+
+    for (i = 1; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i]) == len && strncmp(names[i], name, len) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static int parse_when(const char* name) {
+    if (strcmp(name, "sim") == 0) return LP_WHEN_SIM;
+    if (strcmp(name, "live") == 0) return LP_WHEN_LIVE;
+    if (strcmp(name, "ubuntu") == 0) return LP_WHEN_UBUNTU;
+    if (strcmp(name, "debian") == 0) return LP_WHEN_DEBIAN;
+    return -1;
+}
+
+static int compile_line(builder_t* b, char* line) {
+    char* directive;
+    char* value;
+    char* at;
+    char* dot;
+    int color = LP_COLOR_NONE;
+    int when = LP_WHEN_ALWAYS;
+
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '#') return 0;
+
+    directive = line;
+    value = line + strcspn(line, " \t");
+    if (*value) {
+        *value++ = '\0';
+    }
+
+    // say.color@when
+    if ((at = strchr(directive, '@')) != NULL) {
+        *at++ = '\0';
+        if ((when = parse_when(at)) < 0) return build_error(b, "unknown @condition");
+    }
+    if ((dot = strchr(directive, '.')) != NULL) {
+        *dot++ = '\0';
+        if ((color = parse_color(dot, strlen(dot))) < 0) return build_error(b, "unknown colour");
+    }
+
+    // An exercise ends at the first directive that is not part of it
+    if (b->pending == 3 && b->output.len == 0 && strcmp(directive, "answer") != 0 &&
+        strcmp(directive, "hint") != 0 && strcmp(directive, "check") != 0 &&
+        !(strcmp(directive, "task") == 0 && strcmp(b->last_directive, "task") == 0)) {
+        return build_error(b, "task without an answer");
+    }
+
+    if (strcmp(directive, "pack") == 0) {
+        b->title = intern(b, value, strlen(value));
+    } else if (strcmp(directive, "topic") == 0) {
+        flush_topic(b);
+        memset(&b->topic, 0, sizeof(b->topic));
+        b->topic.label = intern(b, value, strlen(value));
+        b->topic.first_section = (uint32_t)(b->sections.len / sizeof(lp_section_t));
+        b->topic.first_intro = step_count(b);
+        b->topic_title.len = b->topic_title.lines = 0;
+        b->in_topic = 1;
+        b->in_outro = 0;
+    } else if (!b->in_topic) {
+        return build_error(b, "directive outside of a topic");
+    } else if (strcmp(directive, "title") == 0) {
+        grow_line(&b->topic_title, value);
+    } else if (strcmp(directive, "menu") == 0) {
+        flush_step(b);
+        b->topic.prompt = intern(b, value, strlen(value));
+    } else if (strcmp(directive, "section") == 0) {
+        lp_section_t s = { 0 };
+        flush_step(b);
+        if (b->in_outro) return build_error(b, "section after outro");
+        s.label = intern(b, value, strlen(value));
+        s.first_step = step_count(b);
+        grow_append(&b->sections, &s, sizeof(s));
+        b->topic.n_sections++;
+    } else if (strcmp(directive, "outro") == 0) {
+        flush_step(b);
+        b->in_outro = 1;
+        b->topic.first_outro = step_count(b);
+    } else if (strcmp(directive, "say") == 0) {
+        if (!(b->pending == 1 && strcmp(b->last_directive, "say") == 0 &&
+              b->step.color == color && b->step.when == when)) {
+            flush_step(b);
+            memset(&b->step, 0, sizeof(b->step));
+            b->step.kind = LP_STEP_TEXT;
+            b->step.color = (uint8_t)color;
+            b->step.when = (uint8_t)when;
+            b->pending = 1;
+        }
+        grow_line(&b->text, value);
+    } else if (strcmp(directive, "cmd") == 0) {
+        flush_step(b);
+        memset(&b->step, 0, sizeof(b->step));
+        b->step.kind = LP_STEP_COMMAND;
+        b->step.when = (uint8_t)when;
+        b->pending = 2;
+        grow_line(&b->text, value);
+    } else if (strcmp(directive, "desc") == 0 || strcmp(directive, "out") == 0) {
+        if (b->pending != 2) return build_error(b, "desc/out without a preceding cmd");
+        grow_line(directive[0] == 'd' ? &b->desc : &b->output, value);
+    } else if (strcmp(directive, "task") == 0) {
+        if (!(b->pending == 3 && strcmp(b->last_directive, "task") == 0)) {
+            flush_step(b);
+            memset(&b->step, 0, sizeof(b->step));
+            b->step.kind = LP_STEP_EXERCISE;
+            b->step.when = (uint8_t)when;
+            b->pending = 3;
+        }
+        grow_line(&b->text, value);
+    } else if (strcmp(directive, "answer") == 0 || strcmp(directive, "hint") == 0) {
+        if (b->pending != 3) return build_error(b, "answer/hint without a preceding task");
+        if (!*value) return build_error(b, "empty answer or hint");
+        grow_line(directive[0] == 'a' ? &b->output : &b->desc, value);
+    } else if (strcmp(directive, "check") == 0) {
+        if (b->pending != 3) return build_error(b, "check without a preceding task");
+        if (strcmp(value, "output") != 0) return build_error(b, "unknown check (only \"check output\")");
+        b->step.flags |= LP_CHECK_OUTPUT;
+    } else {
+        return build_error(b, "unknown directive");
+    }
+
+    snprintf(b->last_directive, sizeof(b->last_directive), "%.15s", directive);
+    return 0;
+}
+
+static size_t align4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+static int compile_source(const char* path, const char* source, size_t len,
+                          uint8_t** out, size_t* out_len, char* err, size_t err_len) {
+    builder_t b;
+    lp_header_t h;
+    const char* p = source;
+    const char* end = source + len;
+    char line[4096];
+    size_t total;
+    uint8_t* image;
+    int rc = 0;
+
+    memset(&b, 0, sizeof(b));
+    b.path = path;
+    b.err = err;
+    b.err_len = err_len;
+    grow_append(&b.strings, "", 1);
+
+    while (p < end && rc == 0) {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        size_t n = nl ? (size_t)(nl - p) : (size_t)(end - p);
+
+        b.line++;
+        if (n && p[n - 1] == '\r') n--;
+        if (n >= sizeof(line)) {
+            rc = build_error(&b, "line too long");
+            break;
+        }
+        memcpy(line, p, n);
+        line[n] = '\0';
+        rc = compile_line(&b, line);
+        p = nl ? nl + 1 : end;
+    }
+    if (rc == 0 && b.pending == 3 && b.output.len == 0) rc = build_error(&b, "task without an answer");
+    if (rc == 0) {
+        flush_topic(&b);
+        if (b.topics.len == 0) rc = set_error(err, err_len, "%s: no topics defined", path);
+    }
+
+    if (rc == 0) {
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, LP_MAGIC, sizeof(LP_MAGIC));
+        h.version = LP_VERSION;
+        h.byte_order = LP_BYTE_ORDER;
+        h.title = b.title;
+        h.n_topics = (uint32_t)(b.topics.len / sizeof(lp_topic_t));
+        h.n_sections = (uint32_t)(b.sections.len / sizeof(lp_section_t));
+        h.n_steps = step_count(&b);
+        h.topics_off = (uint32_t)align4(sizeof(h));
+        h.sections_off = (uint32_t)(h.topics_off + b.topics.len);
+        h.steps_off = (uint32_t)(h.sections_off + b.sections.len);
+        h.strings_off = (uint32_t)(h.steps_off + b.steps.len);
+        h.strings_size = (uint32_t)b.strings.len;
+        total = align4(h.strings_off + b.strings.len);
+        if (total > UINT32_MAX) {
+            rc = set_error(err, err_len, "%s: pack exceeds 4 GiB", path);
+        } else {
+            h.total_size = (uint32_t)total;
+            image = calloc(1, total);
+            memcpy(image, &h, sizeof(h));
+            memcpy(image + h.topics_off, b.topics.data, b.topics.len);
+            memcpy(image + h.sections_off, b.sections.data, b.sections.len);
+            memcpy(image + h.steps_off, b.steps.data, b.steps.len);
+            memcpy(image + h.strings_off, b.strings.data, b.strings.len);
+            *out = image;
+            *out_len = total;
+        }
+    }
+
+    free(b.topics.data);
+    free(b.sections.data);
+    free(b.steps.data);
+    free(b.strings.data);
+    free(b.intern.slots);
+    free(b.topic_title.data);
+    free(b.text.data);
+    free(b.desc.data);
+    free(b.output.data);
+    return rc;
+}
+
+static int compile_path(const char* source_path, uint8_t** image, size_t* len, char* err, size_t err_len) {
+    size_t source_len;
+    char* source = read_file(source_path, &source_len);
+    int rc;
+
+    if (!source) return set_error(err, err_len, "%s: cannot read", source_path);
+    rc = compile_source(source_path, source, source_len, image, len, err, err_len);
+    free(source);
+    return rc;
+}
+
+int lesson_pack_compile_file(lesson_pack_t* pack, const char* source_path, char* err, size_t err_len) {
+    uint8_t* image;
+    size_t len;
+
+    memset(pack, 0, sizeof(*pack));
+    if (compile_path(source_path, &image, &len, err, err_len) < 0) return -1;
+    if (attach(pack, image, len, err, err_len) < 0) {
+        free(image);
+        return -1;
+    }
+    return 0;
+}
+
+int lesson_pack_compile_to(const char* source_path, const char* out_path, char* err, size_t err_len) {
+    char tmp[4096];
+    uint8_t* image;
+    size_t len;
+    FILE* fp;
+    int ok;
+
+    if (compile_path(source_path, &image, &len, err, err_len) < 0) return -1;
+
+    // Write next to the target and rename, so running tutors that have the
+    // old pack mapped keep a consistent view.
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        free(image);
+        return set_error(err, err_len, "%s: cannot create", tmp);
+    }
+    ok = fwrite(image, 1, len, fp) == len;
+    ok = (fclose(fp) == 0) && ok;
+    free(image);
+    if (!ok || rename(tmp, out_path) < 0) {
+        unlink(tmp);
+        return set_error(err, err_len, "%s: write failed", out_path);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: open time and first-menu walk as the catalog grows
+// ---------------------------------------------------------------------
+
+static void write_synthetic_source(const char* path, int n_topics) {
+    FILE* fp = fopen(path, "w");
+    int t, s, c;
+
+    if (!fp) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(fp, "pack Synthetic catalog\n");
+    for (t = 0; t < n_topics; t++) {
+        fprintf(fp, "topic Topic %d\n  title Topic %d heading\n  say Intro for topic %d\n  menu Pick one:\n", t, t, t);
+        for (s = 0; s < 4; s++) {
+            fprintf(fp, "  section Section %d.%d\n", t, s);
+            for (c = 0; c < 3; c++) {
+                fprintf(fp, "    cmd command-%d-%d-%d --flag\n    desc Description %d/%d/%d\n"
+                            "    out output line one for %d\n    out output line two\n",
+                        t, s, c, t, s, c, c);
+            }
+        }
+    }
+    fclose(fp);
+}
+
+int lesson_pack_bench(int argc, char** argv) {
+    static const int sizes[] = { 10, 1000, 10000, 50000 };
+    char src[] = "/tmp/deb1-bench-XXXXXX";
+    char source_path[64], pack_path[64], err[256];
+    size_t i;
+    int rounds = argc > 0 ? atoi(argv[0]) : 200;
+
+    if (rounds <= 0) rounds = 200;
+    if (!mkdtemp(src)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(source_path, sizeof(source_path), "%s/catalog.lessons", src);
+    snprintf(pack_path, sizeof(pack_path), "%s/catalog.pack", src);
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        lesson_pack_t pack;
+        char metric[64];
+        double t0, t1, open_total = 0;
+        size_t bytes = 0;
+        int r;
+
+        write_synthetic_source(source_path, sizes[i]);
+        t0 = bench_now();
+        if (lesson_pack_compile_to(source_path, pack_path, err, sizeof(err)) < 0) {
+            fprintf(stderr, "%s\n", err);
+            return 1;
+        }
+        t1 = bench_now();
+        snprintf(metric, sizeof(metric), "compile_%d_topics", sizes[i]);
+        bench_report("pack", metric, (t1 - t0) * 1e3, "ms");
+
+        // Open, render the first screen's worth of labels, close
+        for (r = 0; r < rounds; r++) {
+            uint32_t k;
+            t0 = bench_now();
+            if (lesson_pack_open(&pack, pack_path, err, sizeof(err)) < 0) {
+                fprintf(stderr, "%s\n", err);
+                return 1;
+            }
+            for (k = 0; k < 20 && k < pack.header->n_topics; k++) {
+                bytes += strlen(lp_str(&pack, lp_topic(&pack, k)->label));
+            }
+            open_total += bench_now() - t0;
+            lesson_pack_close(&pack);
+        }
+        snprintf(metric, sizeof(metric), "open_first_menu_%d_topics", sizes[i]);
+        bench_report("pack", metric, open_total / rounds * 1e6, "us");
+        if (bytes == 0) return 1;
+    }
+
+    unlink(source_path);
+    unlink(pack_path);
+    rmdir(src);
+    return 0;
+}
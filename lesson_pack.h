@@ -0,0 +1,122 @@
+#ifndef LESSON_PACK_H
+#define LESSON_PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary lesson pack.
+//
+// A pack is compiled from a text source (see lessons/debian.lessons) into
+// a single file that is memory-mapped read-only and walked in place.
+// Every table entry refers to other entries by index and to text by an
+// offset into the string blob, so nothing is copied or parsed at startup:
+// opening a pack only checks the header, whatever the size of the catalog.
+//
+// Layout (all integers native-endian, 4-byte aligned):
+//   lp_header_t
+//   lp_topic_t   topics[n_topics]
+//   lp_section_t sections[n_sections]
+//   lp_step_t    steps[n_steps]
+//   char         strings[strings_size]   (NUL-terminated, offset 0 is "")
+
+#define LP_MAGIC "DEB1LPK"
+#define LP_VERSION 1
+#define LP_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t total_size;
+    uint32_t title;
+    uint32_t n_topics, topics_off;
+    uint32_t n_sections, sections_off;
+    uint32_t n_steps, steps_off;
+    uint32_t strings_off, strings_size;
+} lp_header_t;
+
+// A main-menu entry and the lesson screen behind it
+typedef struct {
+    uint32_t label;         // main menu text
+    uint32_t title;         // lesson screen heading
+    uint32_t prompt;        // submenu question
+    uint32_t first_section, n_sections;
+    uint32_t first_intro, n_intro;   // steps shown before the submenu
+    uint32_t first_outro, n_outro;   // steps shown after any section
+} lp_topic_t;
+
+// A submenu entry: a sequence of steps
+typedef struct {
+    uint32_t label;
+    uint32_t first_step, n_steps;
+} lp_section_t;
+
+typedef enum {
+    LP_STEP_TEXT,
+    LP_STEP_COMMAND,
+    LP_STEP_EXERCISE        // the learner types the command (see grade.h)
+} lp_step_kind_t;
+
+typedef enum {
+    LP_COLOR_NONE,
+    LP_COLOR_GREEN,
+    LP_COLOR_BLUE,
+    LP_COLOR_YELLOW,
+    LP_COLOR_RED,
+    LP_COLOR_CYAN
+} lp_color_t;
+
+// Steps can be restricted to one learning mode
+typedef enum {
+    LP_WHEN_ALWAYS,
+    LP_WHEN_SIM,
+    LP_WHEN_LIVE,
+    LP_WHEN_UBUNTU,
+    LP_WHEN_DEBIAN
+} lp_when_t;
+
+// EXERCISE: an answer is also right when it prints what the first
+// accepted one does on a fresh simulated machine
+#define LP_CHECK_OUTPUT 0x01
+
+typedef struct {
+    uint8_t kind;
+    uint8_t color;
+    uint8_t when;
+    uint8_t flags;          // EXERCISE: LP_CHECK_OUTPUT
+    uint32_t text;          // TEXT: the line(s); COMMAND: the command; EXERCISE: the task
+    uint32_t description;   // COMMAND: what it does; EXERCISE: the hint
+    uint32_t output;        // COMMAND: simulated output; EXERCISE: accepted answers, one per line
+} lp_step_t;
+
+typedef struct {
+    const uint8_t* base;
+    size_t size;
+    const lp_header_t* header;
+    const lp_topic_t* topics;
+    const lp_section_t* sections;
+    const lp_step_t* steps;
+    const char* strings;
+    int mapped;             // 1 if base is an mmap, 0 if malloc'd
+} lesson_pack_t;
+
+// Map a compiled pack. Returns 0 on success, -1 on error (message in err).
+int lesson_pack_open(lesson_pack_t* pack, const char* path, char* err, size_t err_len);
+
+// Compile a text source into a pack held in memory.
+int lesson_pack_compile_file(lesson_pack_t* pack, const char* source_path, char* err, size_t err_len);
+
+// Compile a text source and write the binary pack to out_path.
+int lesson_pack_compile_to(const char* source_path, const char* out_path, char* err, size_t err_len);
+
+void lesson_pack_close(lesson_pack_t* pack);
+
+// Zero-copy accessors. Out-of-range indexes and offsets yield NULL / "".
+const char* lp_str(const lesson_pack_t* pack, uint32_t offset);
+const lp_topic_t* lp_topic(const lesson_pack_t* pack, uint32_t index);
+const lp_section_t* lp_section(const lesson_pack_t* pack, const lp_topic_t* topic, uint32_t index);
+const lp_step_t* lp_step(const lesson_pack_t* pack, uint32_t index);
+
+int lesson_pack_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "deb1.h"
+#include "server.h"
+#include "bench.h"
+#include "util.h"
+
+#define DEFAULT_SCRIPT "lessons/tour.script"
+
+typedef enum {
+    CLIENT_CONNECTING,
+    CLIENT_WAITING,         // request sent, reading until the NUL
+    CLIENT_CLOSING,         // script finished, waiting for the server to hang up
+    CLIENT_DONE
+} client_state_t;
+
+typedef struct {
+    int fd;
+    client_state_t state;
+    int round;
+    size_t line;            // next script line to send
+    double sent_at;
+    double due;             // with --think: when to send the next line, 0 if not waiting
+    int handshake;          // the first NUL answers "#script"
+} client_t;
+
+typedef struct {
+    double* v;
+    size_t n, cap;
+} samples_t;
+
+typedef struct {
+    struct sockaddr_storage addr;
+    unsigned addr_len;
+    int family;
+    int epfd;
+    char** lines;
+    size_t n_lines;
+    int rounds;
+    double think;           // mean pause before each line, in seconds
+    unsigned seed;
+    samples_t latency, connect;
+    unsigned long errors, sessions;
+} loadtest_t;
+
+static void add_sample(samples_t* s, double value) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 4096;
+        s->v = realloc(s->v, s->cap * sizeof(double));
+        if (!s->v) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    s->v[s->n++] = value;
+}
+
+static double percentile(samples_t* s, double p) {
+    if (s->n == 0) return 0;
+    return s->v[(size_t)(p * (double)(s->n - 1) + 0.5)];
+}
+
+static int load_script(loadtest_t* lt, const char* path) {
+    char buf[MAX_INPUT];
+    FILE* fp = fopen(path, "r");
+
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(buf, sizeof(buf), fp)) {
+        char* p = buf;
+        size_t n;
+
+        while (*p == ' ' || *p == '\t') p++;
+        n = strcspn(p, "\r\n");
+        p[n] = '\0';
+        if (*p == '\0' || *p == '#') continue;
+
+        lt->lines = realloc(lt->lines, (lt->n_lines + 1) * sizeof(char*));
+        lt->lines[lt->n_lines] = malloc(n + 2);
+        memcpy(lt->lines[lt->n_lines], p, n);
+        memcpy(lt->lines[lt->n_lines] + n, "\n", 2);
+        lt->n_lines++;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int send_text(client_t* c, const char* text) {
+    size_t len = strlen(text);
+    return write(c->fd, text, len) == (ssize_t)len ? 0 : -1;
+}
+
+static void start_round(loadtest_t* lt, client_t* c) {
+    struct epoll_event ev;
+
+    c->fd = socket(lt->family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    c->line = 0;
+    c->due = 0;
+    c->handshake = 1;
+    c->sent_at = bench_now();
+    c->state = CLIENT_CONNECTING;
+    if (c->fd < 0 || (connect(c->fd, (struct sockaddr*)&lt->addr, lt->addr_len) < 0 && errno != EINPROGRESS)) {
+        perror("connect");
+        exit(1);
+    }
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.ptr = c;
+    epoll_ctl(lt->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void end_round(loadtest_t* lt, client_t* c, int ok) {
+    close(c->fd);
+    if (ok) {
+        lt->sessions++;
+    } else {
+        lt->errors++;
+    }
+    if (++c->round < lt->rounds) {
+        start_round(lt, c);
+    } else {
+        c->state = CLIENT_DONE;
+    }
+}
+
+static int send_line(loadtest_t* lt, client_t* c) {
+    c->due = 0;
+    c->sent_at = bench_now();
+    return send_text(c, lt->lines[c->line++]);
+}
+
+// A full response arrived: record it and send the next line, at once or
+// after the learner's pause
+static int next_request(loadtest_t* lt, client_t* c) {
+    double now = bench_now();
+
+    if (c->handshake) {
+        add_sample(&lt->connect, now - c->sent_at);
+        c->handshake = 0;
+    } else {
+        add_sample(&lt->latency, now - c->sent_at);
+    }
+    if (c->line == lt->n_lines) {
+        c->state = CLIENT_CLOSING;
+        return 0;
+    }
+    if (lt->think > 0) {
+        // Anywhere from half to one and a half times the mean, so the
+        // clients drift apart as learners do
+        c->due = now + lt->think * (0.5 + (double)rand_r(&lt->seed) / RAND_MAX);
+        return 0;
+    }
+    return send_line(lt, c);
+}
+
+// Send the lines whose pause is over; returns how many went, and in
+// *wait_ms the time until the next one is due (at most 10s)
+static int send_due(loadtest_t* lt, client_t* pool, int clients, int* wait_ms) {
+    double now = bench_now(), next = now + 10;
+    int i, sent = 0;
+
+    for (i = 0; i < clients; i++) {
+        client_t* c = &pool[i];
+
+        if (!c->due) continue;
+        if (c->due <= now) {
+            if (send_line(lt, c) < 0) {
+                end_round(lt, c, 0);
+            } else {
+                sent++;
+            }
+        } else if (c->due < next) {
+            next = c->due;
+        }
+    }
+    *wait_ms = (int)((next - now) * 1e3) + 1;
+    return sent;
+}
+
+static void client_event(loadtest_t* lt, client_t* c, uint32_t events) {
+    struct epoll_event ev;
+    char buf[16384];
+
+    if (c->state == CLIENT_CONNECTING && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err || send_text(c, "#script\n") < 0) {
+            end_round(lt, c, 0);
+            return;
+        }
+        c->state = CLIENT_WAITING;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(lt->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        return;
+    }
+
+    for (;;) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        ssize_t i;
+
+        if (n == 0) {
+            end_round(lt, c, c->state == CLIENT_CLOSING);
+            return;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            end_round(lt, c, 0);
+            return;
+        }
+        for (i = 0; i < n; i++) {
+            if (buf[i] == '\0' && c->state == CLIENT_WAITING && next_request(lt, c) < 0) {
+                end_round(lt, c, 0);
+                return;
+            }
+        }
+    }
+}
+
+int server_loadtest(const char* address, const char* script_path, int clients, int rounds, int think_ms) {
+    struct epoll_event events[256];
+    struct rlimit rl;
+    loadtest_t lt;
+    client_t* pool;
+    double start, elapsed;
+    int i, active;
+
+    memset(&lt, 0, sizeof(lt));
+    if (server_parse_address(address, &lt.addr, &lt.addr_len, &lt.family) < 0) {
+        fprintf(stderr, "Bad address '%s'\n", address);
+        return 1;
+    }
+    if (load_script(&lt, script_path ? script_path : DEFAULT_SCRIPT) < 0) return 1;
+    if (clients < 1) clients = 1;
+    lt.rounds = rounds < 1 ? 1 : rounds;
+    lt.think = think_ms > 0 ? think_ms / 1e3 : 0;
+    lt.seed = 1;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    lt.epfd = epoll_create1(EPOLL_CLOEXEC);
+    pool = calloc((size_t)clients, sizeof(client_t));
+    start = bench_now();
+    for (i = 0; i < clients; i++) start_round(&lt, &pool[i]);
+
+    do {
+        int wait_ms = 10000, sent = 0, n;
+
+        if (lt.think > 0) sent = send_due(&lt, pool, clients, &wait_ms);
+        n = epoll_wait(lt.epfd, events, 256, wait_ms);
+        if (n == 0 && !sent && wait_ms >= 10000) {
+            fprintf(stderr, "load test stalled: no response for 10s\n");
+            break;
+        }
+        for (i = 0; i < n; i++) client_event(&lt, events[i].data.ptr, events[i].events);
+        for (active = 0, i = 0; i < clients; i++) active += pool[i].state != CLIENT_DONE;
+    } while (active);
+    elapsed = bench_now() - start;
+
+    qsort(lt.latency.v, lt.latency.n, sizeof(double), compare_double);
+    qsort(lt.connect.v, lt.connect.n, sizeof(double), compare_double);
+    bench_report("loadtest", "clients", clients, "count");
+    bench_report("loadtest", "think_time", think_ms > 0 ? think_ms : 0, "ms");
+    bench_report("loadtest", "sessions", (double)lt.sessions, "count");
+    bench_report("loadtest", "errors", (double)lt.errors, "count");
+    bench_report("loadtest", "responses", (double)lt.latency.n, "count");
+    bench_report("loadtest", "responses_per_sec", lt.latency.n / elapsed, "responses/s");
+    bench_report("loadtest", "first_screen_p50", percentile(&lt.connect, 0.50) * 1e3, "ms");
+    bench_report("loadtest", "response_p50", percentile(&lt.latency, 0.50) * 1e3, "ms");
+    bench_report("loadtest", "response_p99", percentile(&lt.latency, 0.99) * 1e3, "ms");
+    bench_report("loadtest", "response_max", percentile(&lt.latency, 1.0) * 1e3, "ms");
+
+    for (i = 0; i < (int)lt.n_lines; i++) free(lt.lines[i]);
+    free(lt.lines);
+    free(lt.latency.v);
+    free(lt.connect.v);
+    free(pool);
+    close(lt.epfd);
+    return lt.errors ? 1 : 0;
+}
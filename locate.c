@@ -0,0 +1,1052 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "find.h"
+#include "locate.h"
+#include "bench.h"
+#include "util.h"
+
+#define LOCATE_MAGIC "DEB1LOC1"
+#define MAX_PATH 4096
+#define MAX_TRIGRAMS 64             // per query; more only narrow it further
+#define BLOCK_SET 8192              // distinct trigrams per block before the set is full
+
+// The buffer starts with this; the offsets are from its start and every
+// section is 8-byte aligned
+typedef struct {
+    char magic[8];
+    uint64_t n_paths, n_blocks, n_trigrams;
+    uint64_t blocks_off;        // uint64_t[n_blocks + 1]: where each block's paths start
+    uint64_t paths_off;         // front-coded paths
+    uint64_t keys_off;          // uint32_t[n_trigrams], ascending
+    uint64_t lists_off;         // uint64_t[n_trigrams + 1]: where each block list starts
+    uint64_t postings_off;      // block lists: first block, then gaps, as varints
+    uint64_t total;
+} header_t;
+
+struct locate_db {
+    const uint8_t* data;
+    size_t len;
+    int mapped;
+    const header_t* h;
+    const uint64_t* blocks;
+    const uint8_t* paths;
+    const uint32_t* keys;
+    const uint64_t* lists;
+    const uint8_t* postings;
+};
+
+static unsigned char fold[256];
+static pthread_once_t fold_once = PTHREAD_ONCE_INIT;
+
+static void init_fold(void) {
+    int i;
+
+    for (i = 0; i < 256; i++) fold[i] = (unsigned char)(i >= 'A' && i <= 'Z' ? i + 32 : i);
+}
+
+static uint32_t trigram(const char* p) {
+    return (uint32_t)fold[(unsigned char)p[0]] << 16 | (uint32_t)fold[(unsigned char)p[1]] << 8 |
+           fold[(unsigned char)p[2]];
+}
+
+static size_t put_varint(uint8_t* out, uint64_t v) {
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static const uint8_t* get_varint(const uint8_t* p, uint64_t* v) {
+    uint64_t x = 0;
+    int shift = 0;
+
+    while (*p & 0x80) {
+        x |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *v = x | (uint64_t)*p++ << shift;
+    return p;
+}
+
+// ---------------------------------------------------------------------
+// Building
+
+typedef struct {
+    uint8_t* data;
+    size_t len, cap;
+} bytes_t;
+
+static void reserve(bytes_t* b, size_t more) {
+    if (b->len + more <= b->cap) return;
+    while (b->len + more > b->cap) b->cap = b->cap ? b->cap * 2 : 1 << 16;
+    b->data = xrealloc(b->data, b->cap);
+}
+
+static void append(bytes_t* b, const void* data, size_t len) {
+    reserve(b, len);
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void append_varint(bytes_t* b, uint64_t v) {
+    reserve(b, 10);
+    b->len += put_varint(b->data + b->len, v);
+}
+
+static void align8(bytes_t* b) {
+    static const uint8_t zero[8];
+
+    append(b, zero, (8 - b->len % 8) % 8);
+}
+
+struct locate_builder {
+    bytes_t paths;              // front-coded, as they will be saved
+    uint64_t* blocks;
+    uint64_t n_paths, n_blocks, blocks_cap;
+    char prev[MAX_PATH];
+    size_t prev_len;
+
+    // (trigram << 32 | block) for every distinct trigram of every block
+    uint64_t* pairs;
+    size_t n_pairs, pairs_cap;
+    uint32_t set[BLOCK_SET];    // this block's trigrams, + 1 (0 = empty)
+    uint32_t set_used;
+};
+
+locate_builder_t* locate_builder_new(void) {
+    locate_builder_t* b = calloc(1, sizeof(*b));
+
+    if (!b) {
+        perror("calloc");
+        exit(1);
+    }
+    pthread_once(&fold_once, init_fold);
+    return b;
+}
+
+static void add_trigram(locate_builder_t* b, uint32_t t) {
+    uint32_t slot = (t * 2654435761u) >> 19;    // 13 bits: BLOCK_SET
+
+    while (b->set[slot]) {
+        if (b->set[slot] == t + 1) return;
+        slot = (slot + 1) & (BLOCK_SET - 1);
+    }
+    // Never let the set fill up: at the limit, start over; the block's
+    // trigrams may then be listed twice, which finish() drops
+    if (++b->set_used > BLOCK_SET / 2) {
+        memset(b->set, 0, sizeof(b->set));
+        b->set_used = 1;
+        slot = (t * 2654435761u) >> 19;
+    }
+    b->set[slot] = t + 1;
+    if (b->n_pairs == b->pairs_cap) {
+        b->pairs_cap = b->pairs_cap ? b->pairs_cap * 2 : 1 << 16;
+        b->pairs = xrealloc(b->pairs, b->pairs_cap * sizeof(uint64_t));
+    }
+    b->pairs[b->n_pairs++] = (uint64_t)t << 32 | (b->n_blocks - 1);
+}
+
+void locate_builder_add(locate_builder_t* b, const char* path, size_t len) {
+    size_t shared = 0, i;
+
+    if (len >= MAX_PATH) return;
+    if (b->n_paths % LOCATE_BLOCK == 0) {
+        if (b->n_blocks + 1 >= b->blocks_cap) {
+            b->blocks_cap = b->blocks_cap ? b->blocks_cap * 2 : 1024;
+            b->blocks = xrealloc(b->blocks, b->blocks_cap * sizeof(uint64_t));
+        }
+        b->blocks[b->n_blocks++] = b->paths.len;
+        memset(b->set, 0, sizeof(b->set));
+        b->set_used = 0;
+        b->prev_len = 0;
+    } else {
+        while (shared < len && shared < b->prev_len && path[shared] == b->prev[shared]) shared++;
+    }
+    append_varint(&b->paths, shared);
+    append_varint(&b->paths, len - shared);
+    append(&b->paths, path + shared, len - shared);
+
+    // Trigrams inside the shared prefix came with the previous path
+    for (i = shared >= 2 ? shared - 2 : 0; i + 3 <= len; i++) add_trigram(b, trigram(path + i));
+    memcpy(b->prev + shared, path + shared, len - shared);
+    b->prev_len = len;
+    b->n_paths++;
+}
+
+// Stable radix sort on the trigram (bits 32..55); pairs come in block
+// order, so each trigram's blocks stay ascending
+static void sort_pairs(uint64_t* pairs, size_t n) {
+    uint64_t* tmp = malloc(n * sizeof(uint64_t) + 1);
+    size_t count[256], i;
+    int shift;
+
+    for (shift = 32; shift < 56; shift += 8) {
+        size_t sum = 0;
+
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; i++) count[(pairs[i] >> shift) & 0xff]++;
+        for (i = 0; i < 256; i++) {
+            size_t c = count[i];
+
+            count[i] = sum;
+            sum += c;
+        }
+        for (i = 0; i < n; i++) tmp[count[(pairs[i] >> shift) & 0xff]++] = pairs[i];
+        memcpy(pairs, tmp, n * sizeof(uint64_t));
+    }
+    free(tmp);
+}
+
+static locate_db_t* wrap(const uint8_t* data, size_t len, int mapped) {
+    locate_db_t* db = calloc(1, sizeof(*db));
+    const header_t* h = (const header_t*)data;
+
+    if (!db) {
+        perror("calloc");
+        exit(1);
+    }
+    db->data = data;
+    db->len = len;
+    db->mapped = mapped;
+    db->h = h;
+    db->blocks = (const uint64_t*)(data + h->blocks_off);
+    db->paths = data + h->paths_off;
+    db->keys = (const uint32_t*)(data + h->keys_off);
+    db->lists = (const uint64_t*)(data + h->lists_off);
+    db->postings = data + h->postings_off;
+    return db;
+}
+
+locate_db_t* locate_builder_finish(locate_builder_t* b) {
+    bytes_t out = { NULL, 0, 0 };
+    header_t h;
+    uint64_t n_trigrams = 0, i, j;
+    uint64_t* lists;
+    bytes_t postings = { NULL, 0, 0 };
+    uint32_t* keys;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LOCATE_MAGIC, 8);
+    h.n_paths = b->n_paths;
+    h.n_blocks = b->n_blocks;
+    if (!b->blocks) b->blocks = xrealloc(NULL, sizeof(uint64_t));
+    b->blocks[b->n_blocks] = b->paths.len;
+
+    sort_pairs(b->pairs, b->n_pairs);
+    keys = malloc((b->n_pairs + 1) * sizeof(uint32_t));
+    lists = malloc((b->n_pairs + 2) * sizeof(uint64_t));
+    for (i = 0; i < b->n_pairs; i = j) {
+        uint32_t t = (uint32_t)(b->pairs[i] >> 32);
+        uint64_t last = 0;
+
+        keys[n_trigrams] = t;
+        lists[n_trigrams++] = postings.len;
+        for (j = i; j < b->n_pairs && (uint32_t)(b->pairs[j] >> 32) == t; j++) {
+            uint64_t block = (uint32_t)b->pairs[j];
+
+            if (j > i && block == last) continue;
+            append_varint(&postings, j > i ? block - last : block);
+            last = block;
+        }
+    }
+    lists[n_trigrams] = postings.len;
+    h.n_trigrams = n_trigrams;
+
+    append(&out, &h, sizeof(h));
+    h.blocks_off = out.len;
+    append(&out, b->blocks, (b->n_blocks + 1) * sizeof(uint64_t));
+    h.paths_off = out.len;
+    append(&out, b->paths.data, b->paths.len);
+    align8(&out);
+    h.keys_off = out.len;
+    append(&out, keys, n_trigrams * sizeof(uint32_t));
+    align8(&out);
+    h.lists_off = out.len;
+    append(&out, lists, (n_trigrams + 1) * sizeof(uint64_t));
+    h.postings_off = out.len;
+    append(&out, postings.data, postings.len);
+    align8(&out);
+    h.total = out.len;
+    memcpy(out.data, &h, sizeof(h));
+
+    free(keys);
+    free(lists);
+    free(postings.data);
+    free(b->paths.data);
+    free(b->blocks);
+    free(b->pairs);
+    free(b);
+    return wrap(out.data, out.len, 0);
+}
+
+static void add_vfs_tree(locate_builder_t* b, const vfs_t* fs, uint32_t dir, char* path, size_t len) {
+    const vfs_inode_t* node = vfs_inode(fs, dir);
+    vfs_dirent_t* children = malloc((node->n_children ? node->n_children : 1) * sizeof(vfs_dirent_t));
+    uint32_t i;
+
+    vfs_sorted_children(fs, dir, children);
+    for (i = 0; i < node->n_children; i++) {
+        const char* name = vfs_name(fs, children[i].name);
+        size_t name_len = strlen(name), n = len > 1 ? len + 1 + name_len : 1 + name_len;
+
+        if (n >= MAX_PATH) continue;
+        snprintf(path + len, MAX_PATH - len, "%s%s", len > 1 ? "/" : "", name);
+        locate_builder_add(b, path, n);
+        if (S_ISDIR(vfs_inode(fs, children[i].ino)->mode)) add_vfs_tree(b, fs, children[i].ino, path, n);
+        path[len] = '\0';
+    }
+    free(children);
+}
+
+locate_db_t* locate_build_vfs(const vfs_t* fs) {
+    locate_builder_t* b = locate_builder_new();
+    char path[MAX_PATH] = "/";
+
+    locate_builder_add(b, path, 1);
+    add_vfs_tree(b, fs, VFS_ROOT, path, 1);
+    return locate_builder_finish(b);
+}
+
+static int by_name(const struct dirent** a, const struct dirent** b) {
+    return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+static void add_dir_tree(locate_builder_t* b, char* path, size_t len) {
+    struct dirent** entries;
+    int n = scandir(path, &entries, NULL, by_name), i;
+
+    for (i = 0; i < n; i++) {
+        const char* name = entries[i]->d_name;
+        size_t name_len = strlen(name), n_len = len > 1 ? len + 1 + name_len : 1 + name_len;
+        struct stat st;
+        int is_dir;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || n_len >= MAX_PATH) {
+            free(entries[i]);
+            continue;
+        }
+        snprintf(path + len, MAX_PATH - len, "%s%s", len > 1 ? "/" : "", name);
+        locate_builder_add(b, path, n_len);
+        is_dir = entries[i]->d_type == DT_DIR;
+        if (entries[i]->d_type == DT_UNKNOWN) is_dir = lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        if (is_dir) add_dir_tree(b, path, n_len);
+        path[len] = '\0';
+        free(entries[i]);
+    }
+    if (n >= 0) free(entries);
+}
+
+locate_db_t* locate_build_dir(const char* root) {
+    char path[MAX_PATH];
+    size_t len = strlen(root);
+    locate_builder_t* b;
+    struct stat st;
+
+    if (stat(root, &st) < 0) return NULL;
+    if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+    while (len > 1 && root[len - 1] == '/') len--;
+    if (len >= MAX_PATH) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    memcpy(path, root, len);
+    path[len] = '\0';
+    b = locate_builder_new();
+    locate_builder_add(b, path, len);
+    add_dir_tree(b, path, len);
+    return locate_builder_finish(b);
+}
+
+int locate_save(const locate_db_t* db, const char* path) {
+    char tmp[MAX_PATH];
+    size_t done = 0;
+    int fd, rc = 0;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -errno;
+    while (done < db->len) {
+        ssize_t n = write(fd, db->data + done, db->len - done);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            rc = -errno;
+            break;
+        }
+        done += (size_t)n;
+    }
+    if (close(fd) < 0 && rc == 0) rc = -errno;
+    if (rc == 0 && rename(tmp, path) < 0) rc = -errno;
+    if (rc < 0) unlink(tmp);
+    return rc;
+}
+
+locate_db_t* locate_open(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    const header_t* h;
+    struct stat st;
+    void* map;
+
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    h = map;
+    if (memcmp(h->magic, LOCATE_MAGIC, 8) != 0 || h->total != (uint64_t)st.st_size ||
+        h->blocks_off + (h->n_blocks + 1) * 8 > h->total || h->keys_off + h->n_trigrams * 4 > h->total ||
+        h->lists_off + (h->n_trigrams + 1) * 8 > h->total || h->postings_off > h->total) {
+        munmap(map, (size_t)st.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+    pthread_once(&fold_once, init_fold);
+    return wrap(map, (size_t)st.st_size, 1);
+}
+
+void locate_free(locate_db_t* db) {
+    if (!db) return;
+    if (db->mapped) {
+        munmap((void*)db->data, db->len);
+    } else {
+        free((void*)db->data);
+    }
+    free(db);
+}
+
+uint64_t locate_count(const locate_db_t* db) {
+    return db->h->n_paths;
+}
+
+size_t locate_size(const locate_db_t* db) {
+    return db->len;
+}
+
+// ---------------------------------------------------------------------
+// Queries
+
+typedef struct {
+    const char* text;           // as given (globs)
+    char literal[MAX_PATH];     // substrings: folded with -i
+    size_t len;
+    int glob;
+} pattern_t;
+
+// Literal runs of a glob: the characters between *, ? and [...]
+static int glob_runs(const char* p, char* out, size_t* starts, size_t* lens, int max) {
+    size_t n = 0;
+    int runs = 0;
+
+    while (*p && runs < max) {
+        size_t start = n;
+
+        while (*p && !strchr("*?[", *p)) {
+            if (*p == '\\' && p[1]) p++;
+            out[n++] = *p++;
+        }
+        if (n > start) {
+            starts[runs] = start;
+            lens[runs++] = n - start;
+        }
+        if (*p == '[') {
+            // Skip the class: "[]x]" and "[!]x]" start with a literal ]
+            p++;
+            if (*p == '!' || *p == '^') p++;
+            if (*p == ']') p++;
+            while (*p && *p != ']') p++;
+        }
+        if (*p) p++;
+    }
+    return runs;
+}
+
+static int add_query_trigrams(const char* run, size_t len, uint32_t* out, int n) {
+    size_t i;
+    int j;
+
+    for (i = 0; i + 3 <= len && n < MAX_TRIGRAMS; i++) {
+        uint32_t t = trigram(run + i);
+
+        for (j = 0; j < n && out[j] != t; j++) {
+        }
+        if (j == n) out[n++] = t;
+    }
+    return n;
+}
+
+static int find_key(const locate_db_t* db, uint32_t t, uint64_t* index) {
+    uint64_t lo = 0, hi = db->h->n_trigrams;
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+
+        if (db->keys[mid] < t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *index = lo;
+    return lo < db->h->n_trigrams && db->keys[lo] == t;
+}
+
+// Blocks on every trigram's list, decoded shortest list first. Returns
+// the count; *all set when there was nothing to narrow by.
+static uint64_t candidates(const locate_db_t* db, const uint32_t* trigrams, int n, uint32_t** out, int* all) {
+    uint64_t index[MAX_TRIGRAMS], count = 0;
+    uint32_t* blocks = NULL;
+    int i, j;
+
+    *all = n == 0;
+    *out = NULL;
+    if (n == 0) return db->h->n_blocks;
+    for (i = 0; i < n; i++) {
+        if (!find_key(db, trigrams[i], &index[i])) return 0;
+    }
+    // By encoded length, a good stand-in for the number of blocks
+    for (i = 1; i < n; i++) {
+        uint64_t x = index[i];
+
+        for (j = i; j > 0 && db->lists[index[j - 1] + 1] - db->lists[index[j - 1]] > db->lists[x + 1] - db->lists[x];
+             j--) {
+            index[j] = index[j - 1];
+        }
+        index[j] = x;
+    }
+    for (i = 0; i < n; i++) {
+        const uint8_t* p = db->postings + db->lists[index[i]];
+        const uint8_t* end = db->postings + db->lists[index[i] + 1];
+        uint64_t block = 0, gap, kept = 0, k = 0;
+
+        if (i == 0) {
+            blocks = malloc((size_t)(end - p) * sizeof(uint32_t) + sizeof(uint32_t));
+            while (p < end) {
+                p = get_varint(p, &gap);
+                block += gap;
+                blocks[count++] = (uint32_t)block;
+            }
+            continue;
+        }
+        // Merge: keep the candidates this list has too
+        while (p < end && k < count) {
+            p = get_varint(p, &gap);
+            block += gap;
+            while (k < count && blocks[k] < block) k++;
+            if (k < count && blocks[k] == block) blocks[kept++] = blocks[k++];
+        }
+        count = kept;
+        if (!count) break;
+    }
+    *out = blocks;
+    return count;
+}
+
+static int contains_folded(const char* hay, size_t hay_len, const char* needle, size_t len) {
+    size_t i;
+
+    if (len > hay_len) return 0;
+    for (i = 0; i + len <= hay_len; i++) {
+        size_t k = 0;
+
+        while (k < len && fold[(unsigned char)hay[i + k]] == (unsigned char)needle[k]) k++;
+        if (k == len) return 1;
+    }
+    return 0;
+}
+
+static int matches(const locate_query_t* q, const pattern_t* pats, const char* path, size_t len) {
+    const char* subject = path;
+    size_t subject_len = len;
+    int i;
+
+    if (q->basename && len > 1) {
+        const char* slash = memrchr(path, '/', len);
+
+        if (slash) {
+            subject = slash + 1;
+            subject_len = len - (size_t)(subject - path);
+        }
+    }
+    for (i = 0; i < q->n_patterns; i++) {
+        const pattern_t* p = &pats[i];
+
+        if (p->glob) {
+            if (fnmatch(p->text, subject, q->ignore_case ? FNM_CASEFOLD : 0) != 0) return 0;
+        } else if (q->ignore_case) {
+            if (!contains_folded(subject, subject_len, p->literal, p->len)) return 0;
+        } else if (!memmem(subject, subject_len, p->literal, p->len)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+uint64_t locate_query(const locate_db_t* db, const locate_query_t* q, locate_match_fn fn, void* ctx) {
+    pattern_t* pats = malloc((size_t)(q->n_patterns ? q->n_patterns : 1) * sizeof(pattern_t));
+    uint32_t trigrams[MAX_TRIGRAMS];
+    uint32_t* blocks;
+    uint64_t n_blocks, found = 0, c;
+    int n_trigrams = 0, i, all, stop = 0;
+    char path[MAX_PATH + 1];
+
+    pthread_once(&fold_once, init_fold);
+    for (i = 0; i < q->n_patterns; i++) {
+        pattern_t* p = &pats[i];
+        size_t starts[MAX_TRIGRAMS], lens[MAX_TRIGRAMS], k;
+        int runs;
+
+        p->text = q->patterns[i];
+        p->glob = strpbrk(p->text, "*?[") != NULL;
+        if (!p->glob) {
+            p->len = strlen(p->text);
+            if (p->len >= sizeof(p->literal)) p->len = sizeof(p->literal) - 1;
+            for (k = 0; k < p->len; k++) {
+                p->literal[k] = q->ignore_case ? (char)fold[(unsigned char)p->text[k]] : p->text[k];
+            }
+            n_trigrams = add_query_trigrams(p->literal, p->len, trigrams, n_trigrams);
+            continue;
+        }
+        if (strlen(p->text) >= sizeof(p->literal)) continue;
+        runs = glob_runs(p->text, p->literal, starts, lens, MAX_TRIGRAMS);
+        for (k = 0; k < (size_t)runs; k++) {
+            n_trigrams = add_query_trigrams(p->literal + starts[k], lens[k], trigrams, n_trigrams);
+        }
+    }
+
+    n_blocks = candidates(db, trigrams, n_trigrams, &blocks, &all);
+    for (c = 0; c < n_blocks && !stop; c++) {
+        uint64_t block = all ? c : blocks[c];
+        const uint8_t* p = db->paths + db->blocks[block];
+        const uint8_t* end = db->paths + db->blocks[block + 1];
+        size_t len = 0;
+
+        while (p < end) {
+            uint64_t shared, suffix;
+
+            p = get_varint(p, &shared);
+            p = get_varint(p, &suffix);
+            memcpy(path + shared, p, suffix);
+            p += suffix;
+            len = shared + suffix;
+            path[len] = '\0';
+            if (!matches(q, pats, path, len)) continue;
+            found++;
+            if (fn && fn(ctx, path, len)) stop = 1;
+            if ((q->limit >= 0 && found >= (uint64_t)q->limit) || stop) {
+                stop = 1;
+                break;
+            }
+        }
+    }
+    free(blocks);
+    free(pats);
+    return found;
+}
+
+// ---------------------------------------------------------------------
+// Commands
+
+// What locate searches before the learner runs updatedb: the machine as
+// it was seeded, or $DEB1_LOCATE_DB (a database saved by --updatedb)
+static locate_db_t* shared_db;
+static pthread_once_t shared_once = PTHREAD_ONCE_INIT;
+
+static void open_shared(void) {
+    const char* path = getenv("DEB1_LOCATE_DB");
+
+    if (path && *path) {
+        shared_db = locate_open(path);
+    } else {
+        vfs_t* fs = vfs_new();
+
+        vfs_seed_debian(fs);
+        shared_db = locate_build_vfs(fs);
+        vfs_free(fs);
+    }
+}
+
+static int print_match(void* ctx, const char* path, size_t len) {
+    (void)ctx;
+    con_write(path, len);
+    con_write("\n", 1);
+    return con_stopped();
+}
+
+int locate_cmd_locate(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    const locate_db_t* db = env->locate;
+    locate_query_t q;
+    sim_opts_t o;
+    const char* limit;
+    uint64_t found;
+    long lines = sim_line_limit();
+    int i;
+
+    if (sim_getopt(argc, argv, "icbl:n:", &o) < 0) return 1;
+    for (i = 0; i < o.n_longs; i++) {
+        if (strcmp(o.longs[i], "ignore-case") != 0 && strcmp(o.longs[i], "count") != 0 &&
+            strcmp(o.longs[i], "basename") != 0 && strncmp(o.longs[i], "limit=", 6) != 0) {
+            return -1;
+        }
+    }
+    if (o.n_operands == 0) {
+        sim_error("locate", "no pattern to search for specified");
+        return 1;
+    }
+    if (!db) {
+        pthread_once(&shared_once, open_shared);
+        db = shared_db;
+    }
+    if (!db) return -1;
+
+    memset(&q, 0, sizeof(q));
+    q.patterns = (const char* const*)argv + 1;
+    q.n_patterns = o.n_operands;
+    q.ignore_case = SIM_HAS(&o, 'i') || sim_long_opt(&o, "ignore-case");
+    q.basename = SIM_HAS(&o, 'b') || sim_long_opt(&o, "basename");
+    q.limit = -1;
+    limit = sim_long_opt(&o, "limit");
+    if (SIM_HAS(&o, 'l') || SIM_HAS(&o, 'n')) limit = o.value;
+    if (limit) q.limit = strtol(limit, NULL, 10);
+    if (SIM_HAS(&o, 'c') || sim_long_opt(&o, "count")) {
+        found = locate_query(db, &q, NULL, NULL);
+        con_printf("%llu\n", (unsigned long long)found);
+    } else {
+        if (lines >= 0 && (q.limit < 0 || lines < q.limit)) q.limit = lines;
+        found = q.limit == 0 ? 0 : locate_query(db, &q, print_match, NULL);
+    }
+    return found ? 0 : 1;
+}
+
+int locate_cmd_updatedb(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+
+    (void)argc;
+    (void)argv;
+    if (env->euid != 0) {
+        con_printf("updatedb: can not open a temporary file for `/var/lib/plocate/plocate.db'\n");
+        return 1;
+    }
+    locate_free(env->locate);
+    env->locate = locate_build_vfs(env->vfs);
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: a generated Debian-like tree of a million entries (or a
+// real directory) indexed and queried, and find over the same tree
+
+static uint64_t bench_rng = 0x2545F4914F6CDD1Dull;
+
+static const char* const syllables[] = {
+    "ab", "al", "an", "ar", "ba", "be", "bo", "ca", "co", "da", "de", "di", "do", "el", "en", "fa",
+    "fi", "ga", "ge", "go", "ha", "in", "ja", "ka", "ki", "la", "le", "li", "lo", "ma", "me", "mi",
+    "mo", "na", "ne", "ni", "no", "pa", "pe", "pi", "po", "ra", "re", "ri", "ro", "sa", "se", "si",
+    "so", "ta", "te", "ti", "to", "va", "ve", "vi", "xa", "ze", "zo", "qu", "ul", "ux",
+};
+
+static const char* const extensions[] = {
+    "py", "json", "xml", "png", "svg", "txt", "conf", "html", "js", "css", "so", "h", "pm", "gz",
+};
+
+static const char* const languages[] = { "de", "es", "fr", "it", "ja", "pt_BR", "ru", "zh_CN" };
+
+static void random_word(char* out, size_t len, int syllables_wanted) {
+    size_t n = 0;
+    int i;
+
+    for (i = 0; i < syllables_wanted && n + 3 < len; i++) {
+        const char* s = syllables[bench_random(&bench_rng, sizeof(syllables) / sizeof(syllables[0]))];
+
+        out[n++] = s[0];
+        out[n++] = s[1];
+    }
+    out[n] = '\0';
+}
+
+static uint32_t fixture_dir(vfs_t* fs, uint32_t parent, const char* name) {
+    uint32_t ino = vfs_lookup(fs, parent, name);
+
+    if (ino == VFS_NONE) vfs_create(fs, parent, name, S_IFDIR | 0755, 0, 0, 0, &ino);
+    return ino;
+}
+
+static void fixture_file(vfs_t* fs, uint32_t dir, const char* name) {
+    uint32_t ino;
+
+    if (vfs_create(fs, dir, name, S_IFREG | 0644, 0, 0, 0, &ino) == 0) {
+        vfs_set_size(fs, ino, (1u << bench_random(&bench_rng, 22)) + bench_random(&bench_rng, 4096), 0);
+    }
+}
+
+static uint32_t fixture_path(vfs_t* fs, const char* path) {
+    char buf[MAX_PATH], *p, *save = NULL;
+    uint32_t dir = VFS_ROOT;
+
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (p = strtok_r(buf, "/", &save); p; p = strtok_r(NULL, "/", &save)) dir = fixture_dir(fs, dir, p);
+    return dir;
+}
+
+// Packages with their docs, binaries, man pages, data, Python modules,
+// configuration and translations, until the tree has about entries
+static void build_fixture(vfs_t* fs, long entries) {
+    uint32_t doc = fixture_path(fs, "/usr/share/doc"), bin = fixture_path(fs, "/usr/bin");
+    uint32_t man = fixture_path(fs, "/usr/share/man/man1"), lib = fixture_path(fs, "/usr/lib/x86_64-linux-gnu");
+    uint32_t share = fixture_path(fs, "/usr/share"), python = fixture_path(fs, "/usr/lib/python3/dist-packages");
+    uint32_t etc = fixture_path(fs, "/etc"), locale = fixture_path(fs, "/usr/share/locale");
+    char pkg[64], name[128], word[32];
+    long n;
+
+    for (n = 0; (long)vfs_inode_count(fs) < entries; n++) {
+        uint32_t d, sub;
+        int i, j;
+
+        random_word(word, sizeof(word), 2 + (int)bench_random(&bench_rng, 3));
+        snprintf(pkg, sizeof(pkg), "%s%s%s", n % 4 == 0 ? "lib" : "", word, n % 7 == 0 ? "3" : "");
+        if (vfs_lookup(fs, doc, pkg) != VFS_NONE) continue;
+        d = fixture_dir(fs, doc, pkg);
+        fixture_file(fs, d, "changelog.Debian.gz");
+        fixture_file(fs, d, "copyright");
+        if (n % 3 == 0) {
+            fixture_file(fs, bin, pkg);
+            snprintf(name, sizeof(name), "%s.1.gz", pkg);
+            fixture_file(fs, man, name);
+        }
+        if (n % 4 == 0) {
+            snprintf(name, sizeof(name), "%s.so.%u", pkg, 1 + bench_random(&bench_rng, 6));
+            fixture_file(fs, lib, name);
+        }
+        if (n % 2 == 0) {
+            d = fixture_dir(fs, share, pkg);
+            for (i = 0; i < 1 + (int)bench_random(&bench_rng, 4); i++) {
+                random_word(word, sizeof(word), 2);
+                sub = fixture_dir(fs, d, word);
+                for (j = 0; j < 2 + (int)bench_random(&bench_rng, 12); j++) {
+                    random_word(word, sizeof(word), 2 + (int)bench_random(&bench_rng, 3));
+                    snprintf(name, sizeof(name), "%s.%s", word,
+                             extensions[bench_random(&bench_rng, sizeof(extensions) / sizeof(extensions[0]))]);
+                    fixture_file(fs, sub, name);
+                }
+            }
+        }
+        if (n % 5 == 0) {
+            d = fixture_dir(fs, python, pkg);
+            fixture_file(fs, d, "__init__.py");
+            for (j = 0; j < 3 + (int)bench_random(&bench_rng, 10); j++) {
+                random_word(word, sizeof(word), 2 + (int)bench_random(&bench_rng, 2));
+                snprintf(name, sizeof(name), "%s.py", word);
+                fixture_file(fs, d, name);
+            }
+        }
+        if (n % 6 == 0) {
+            d = fixture_dir(fs, etc, pkg);
+            snprintf(name, sizeof(name), "%s.conf", pkg);
+            fixture_file(fs, d, name);
+        }
+        if (n % 4 == 1) {
+            for (i = 0; i < (int)(sizeof(languages) / sizeof(languages[0])); i++) {
+                sub = fixture_dir(fs, fixture_dir(fs, locale, languages[i]), "LC_MESSAGES");
+                snprintf(name, sizeof(name), "%s.mo", pkg);
+                fixture_file(fs, sub, name);
+            }
+        }
+    }
+}
+
+static int count_match(void* ctx, const char* path, size_t len) {
+    (void)path;
+    (void)len;
+    (*(uint64_t*)ctx)++;
+    return 0;
+}
+
+// Every path decoded and checked, no index: what the index saves
+static double scan_all(const locate_db_t* db, const locate_query_t* q, uint64_t* found) {
+    double start = bench_now();
+    uint64_t b, count = 0;
+    char path[MAX_PATH + 1];
+    pattern_t pat;
+
+    memset(&pat, 0, sizeof(pat));
+    pat.text = q->patterns[0];
+    pat.len = strlen(pat.text);
+    memcpy(pat.literal, pat.text, pat.len);
+    for (b = 0; b < db->h->n_blocks; b++) {
+        const uint8_t* p = db->paths + db->blocks[b];
+        const uint8_t* end = db->paths + db->blocks[b + 1];
+
+        while (p < end) {
+            uint64_t shared, suffix;
+
+            p = get_varint(p, &shared);
+            p = get_varint(p, &suffix);
+            memcpy(path + shared, p, suffix);
+            p += suffix;
+            if (memmem(path, shared + suffix, pat.literal, pat.len)) count++;
+        }
+    }
+    *found = count;
+    return bench_now() - start;
+}
+
+static int discard(void* ctx, const char* data, size_t len) {
+    (void)ctx;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+static int sum_lengths(void* ctx, const char* path, size_t len) {
+    (void)path;
+    *(uint64_t*)ctx += len + 1;
+    return 0;
+}
+
+int locate_bench(int argc, char** argv) {
+    long entries = 1000000;
+    const char* dir = NULL;
+    static const struct {
+        const char* metric;
+        const char* pattern;
+        int ignore_case;
+    } queries[] = {
+        { "rare", "sshd_config", 0 },
+        { "word", "python3", 0 },
+        { "common", "LC_MESSAGES", 0 },
+        { "icase", "MAN1", 1 },
+        { "glob", "*/man1/*ra*.1.gz", 0 },
+        { "short", "so", 0 },
+    };
+    static const int thread_counts[] = { 1, 4 };
+    locate_db_t* db;
+    vfs_t* fs = NULL;
+    uint64_t raw = 0, found, scanned;
+    double start, elapsed;
+    size_t i;
+    char metric[64];
+
+    if (argc > 0) {
+        struct stat st;
+
+        if (stat(argv[0], &st) == 0 && S_ISDIR(st.st_mode)) {
+            dir = argv[0];
+        } else {
+            entries = atol(argv[0]);
+        }
+    }
+    if (entries < 1000) entries = 1000;
+
+    if (dir) {
+        start = bench_now();
+        db = locate_build_dir(dir);
+        elapsed = bench_now() - start;
+        if (!db) {
+            fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+            return 1;
+        }
+    } else {
+        fs = vfs_new();
+        vfs_seed_debian(fs);
+        build_fixture(fs, entries);
+        start = bench_now();
+        db = locate_build_vfs(fs);
+        elapsed = bench_now() - start;
+    }
+    bench_report("locate", "paths", (double)locate_count(db), "paths");
+    bench_report("locate", "build", elapsed * 1e3, "ms");
+    bench_report("locate", "build_rate", locate_count(db) / elapsed, "paths/s");
+
+    // Against the paths as a plain list, one per line
+    locate_query(db, &(locate_query_t){ (const char* const[]){ "" }, 1, 0, 0, -1 }, sum_lengths, &raw);
+    bench_report("locate", "size", locate_size(db) / 1048576.0, "MB");
+    bench_report("locate", "size_ratio", (double)locate_size(db) / (double)raw, "of plain");
+    bench_report("locate", "size_paths", (db->h->keys_off - db->h->paths_off) / 1048576.0, "MB");
+    bench_report("locate", "size_index", (db->h->total - db->h->keys_off) / 1048576.0, "MB");
+
+    for (i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+        const char* patterns[1] = { queries[i].pattern };
+        locate_query_t q = { patterns, 1, queries[i].ignore_case, 0, -1 };
+        int rounds = 0;
+
+        start = bench_now();
+        do {
+            found = locate_query(db, &q, count_match, &scanned);
+            rounds++;
+        } while (bench_now() - start < 0.2);
+        snprintf(metric, sizeof(metric), "query_%s", queries[i].metric);
+        bench_report("locate", metric, (bench_now() - start) / rounds * 1e6, "us");
+        printf("  %-8s %-20s %llu matches\n", queries[i].metric, queries[i].pattern, (unsigned long long)found);
+    }
+    {
+        const char* patterns[1] = { queries[0].pattern };
+        locate_query_t q = { patterns, 1, 0, 0, -1 };
+
+        bench_report("locate", "scan_rare", scan_all(db, &q, &scanned) * 1e6, "us");
+    }
+
+    // find -name '*.conf' -type f, and -size +1M, over the whole tree
+    if (fs) {
+        sim_env_t env;
+
+        memset(&env, 0, sizeof(env));
+        env.vfs = fs;
+        for (i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+            find_expr_t e;
+            find_result_t result;
+            int pass;
+
+            memset(&e, 0, sizeof(e));
+            e.max_depth = -1;
+            e.max_lines = -1;
+            e.threads = thread_counts[i];
+            for (pass = 0; pass < 2; pass++) {
+                double best = 0;
+                int round;
+
+                e.name = pass ? NULL : "*.conf";
+                e.type = pass ? 0 : 'f';
+                e.size_cmp = pass ? 1 : FIND_ANY_SIZE;
+                e.size = 1;
+                e.size_unit = 1024 * 1024;
+                for (round = 0; round < 3; round++) {
+                    memset(&result, 0, sizeof(result));
+                    start = bench_now();
+                    find_run(&env, VFS_ROOT, "/", &e, discard, NULL, &result);
+                    elapsed = bench_now() - start;
+                    if (!best || elapsed < best) best = elapsed;
+                }
+                snprintf(metric, sizeof(metric), "find_%s_%dt", pass ? "size" : "name", thread_counts[i]);
+                bench_report("locate", metric, best * 1e3, "ms");
+            }
+        }
+        vfs_free(fs);
+    }
+    locate_free(db);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef LOCATE_H
+#define LOCATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Path database for the simulated locate, built the way updatedb does.
+//
+// The paths of a tree (the simulated machine, or a real directory) are
+// sorted and front-coded in blocks of LOCATE_BLOCK: each path stores only
+// the bytes that differ from the one before it, and every block starts
+// with a whole path so it can be decoded on its own. For every trigram of
+// the lower-cased paths the database keeps the blocks that contain it, as
+// delta-encoded varints. A query takes the trigrams of the literal parts
+// of its pattern, intersects their block lists starting from the
+// shortest, and only decodes and checks the blocks that are left. The
+// whole database is one buffer, so a saved one is used straight from
+// the mapped file.
+
+#define LOCATE_BLOCK 32
+
+typedef struct vfs vfs_t;
+typedef struct locate_db locate_db_t;
+
+// Collects paths for a database
+typedef struct locate_builder locate_builder_t;
+
+locate_builder_t* locate_builder_new(void);
+void locate_builder_add(locate_builder_t* b, const char* path, size_t len);
+// Sort, encode and index what was added; frees the builder
+locate_db_t* locate_builder_finish(locate_builder_t* b);
+
+// Every path of a simulated filesystem, from "/" down
+locate_db_t* locate_build_vfs(const vfs_t* fs);
+// Every path under a real directory (not following symlinks). Returns
+// NULL and sets errno if root cannot be read.
+locate_db_t* locate_build_dir(const char* root);
+
+// Save to a file / map one back. Return 0 or -errno; NULL with errno set.
+int locate_save(const locate_db_t* db, const char* path);
+locate_db_t* locate_open(const char* path);
+void locate_free(locate_db_t* db);
+
+uint64_t locate_count(const locate_db_t* db);
+size_t locate_size(const locate_db_t* db);
+
+typedef struct {
+    const char* const* patterns;    // all must match
+    int n_patterns;
+    int ignore_case;        // -i
+    int basename;           // -b: match the last component only
+    long limit;             // results wanted, -1 for all
+} locate_query_t;
+
+// Called per match with the path (not NUL-terminated); nonzero stops
+typedef int (*locate_match_fn)(void* ctx, const char* path, size_t len);
+
+// A pattern with *, ? or [ is a glob that must match the whole path;
+// any other is a substring. Returns the number of matches.
+uint64_t locate_query(const locate_db_t* db, const locate_query_t* q, locate_match_fn fn, void* ctx);
+
+// Simulated commands (see sim.c)
+int locate_cmd_locate(int argc, char** argv);
+int locate_cmd_updatedb(int argc, char** argv);
+
+// --bench locate [entries | DIR]
+int locate_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,571 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "logsim.h"
+#include "util.h"
+
+// 2023-10-15 14:30:00 UTC, when the simulated clock starts (see sim.c);
+// the logs cover the two weeks before
+#define LOGSIM_END 1697380200
+#define LOGSIM_SPAN_MS (14 * 86400 * 1000LL)
+#define LOGSIM_VERSION 2
+#define WRITE_BUFFER (1 << 20)
+#define MAX_LINE 1024
+#define STAMP_FILE ".logsim"
+
+typedef struct {
+    uint64_t rng;
+    int64_t now_ms;         // time of the current line
+    int64_t start_ms;
+    uint64_t total;         // bytes the file will have
+    int64_t boot_ms;
+    time_t stamp_sec;       // second the stamps below show
+    char syslog_stamp[16];  // "Oct 15 14:30:00"
+    char iso_stamp[20];     // "2023-10-15 14:30:00"
+    char nginx_stamp[32];   // "15/Oct/2023:14:30:00 +0000"
+    char slash_stamp[20];   // "2023/10/15 14:30:00"
+    uint32_t pid;
+} gen_t;
+
+typedef int (*line_fn)(gen_t* g, char* out);
+
+static uint32_t rnd(gen_t* g, uint32_t n) {
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return (uint32_t)((((g->rng * 2685821657736338717ull) >> 32) * n) >> 32);
+}
+
+#define PICK(g, table) (table)[rnd(g, sizeof(table) / sizeof((table)[0]))]
+
+// A process id that changes now and then, as daemons restart and cron
+// jobs come and go
+static uint32_t next_pid(gen_t* g) {
+    if (rnd(g, 8) == 0) g->pid += 1 + rnd(g, 40);
+    if (g->pid > 4194000) g->pid = 300;
+    return g->pid;
+}
+
+static uint32_t uptime_sec(const gen_t* g) {
+    return (uint32_t)((g->now_ms - g->boot_ms) / 1000);
+}
+
+static uint32_t uptime_usec(const gen_t* g) {
+    return (uint32_t)((g->now_ms - g->boot_ms) % 1000) * 1000 + (uint32_t)(g->rng % 1000);
+}
+
+// Time moves with the bytes written, so the last line is stamped just
+// before the simulated clock starts whatever the lines' lengths
+static void advance(gen_t* g, uint64_t written) {
+    time_t sec;
+    struct tm tm;
+
+    g->now_ms = g->start_ms + (int64_t)((double)written / (double)g->total * LOGSIM_SPAN_MS);
+    sec = (time_t)(g->now_ms / 1000);
+    if (sec == g->stamp_sec) return;
+    g->stamp_sec = sec;
+    gmtime_r(&sec, &tm);
+    strftime(g->syslog_stamp, sizeof(g->syslog_stamp), "%b %e %H:%M:%S", &tm);
+    strftime(g->iso_stamp, sizeof(g->iso_stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    strftime(g->nginx_stamp, sizeof(g->nginx_stamp), "%d/%b/%Y:%H:%M:%S +0000", &tm);
+    strftime(g->slash_stamp, sizeof(g->slash_stamp), "%Y/%m/%d %H:%M:%S", &tm);
+}
+
+// ---------------------------------------------------------------------
+// Line templates
+
+static const char* const units[][2] = {
+    { "apt-daily.service", "Daily apt download activities" },
+    { "apt-daily-upgrade.service", "Daily apt upgrade and clean activities" },
+    { "logrotate.service", "Rotate log files" },
+    { "man-db.service", "Daily man-db regeneration" },
+    { "systemd-tmpfiles-clean.service", "Cleanup of Temporary Directories" },
+    { "phpsessionclean.service", "Clean php session files" },
+    { "fstrim.service", "Discard unused blocks on filesystems from /etc/fstab" },
+    { "e2scrub_all.service", "Online ext4 Metadata Check for All Filesystems" },
+    { "certbot.service", "Certbot" },
+    { "dpkg-db-backup.service", "Daily dpkg database backup service" },
+};
+
+static const char* const cron_jobs[] = {
+    "   cd / && run-parts --report /etc/cron.hourly",
+    "[ -x /usr/lib/php/sessionclean ] && if [ ! -d /run/systemd/system ]; then /usr/lib/php/sessionclean; fi",
+    "command -v debian-sa1 > /dev/null && debian-sa1 1 1",
+    "test -x /usr/bin/certbot -a \\! -d /run/systemd/system && perl -e 'sleep int(rand(43200))' && certbot -q renew",
+    "/usr/local/bin/backup.sh --quiet",
+};
+
+static const char* const kernel_messages[] = {
+    "IPv6: ADDRCONF(NETDEV_CHANGE): eth0: link becomes ready",
+    "e1000e 0000:00:1f.6 eth0: NIC Link is Up 1000 Mbps Full Duplex, Flow Control: Rx/Tx",
+    "EXT4-fs (sda1): mounted filesystem with ordered data mode. Quota mode: none.",
+    "nf_conntrack: default automatic helper assignment has been turned off for security reasons",
+    "perf: interrupt took too long (2503 > 2500), lowering kernel.perf_event_max_sample_rate to 79750",
+    "TCP: request_sock_TCP: Possible SYN flooding on port 443. Sending cookies.",
+};
+
+static const char* const kernel_errors[] = {
+    "blk_update_request: I/O error, dev sda, sector %u op 0x0:(READ) flags 0x80700 phys_seg 1 prio class 0",
+    "EXT4-fs error (device sda1): ext4_find_entry:1683: inode #%u: comm nginx: reading directory lblock 0",
+    "ata1.00: error: { UNC } at sector %u",
+};
+
+static const char* const usernames[] = {
+    "admin", "test", "oracle", "ubuntu", "pi", "git", "postgres", "user", "guest", "ftpuser", "deploy",
+};
+
+static const char* const sudo_commands[] = {
+    "/usr/bin/apt update", "/usr/bin/apt upgrade", "/usr/bin/systemctl restart nginx",
+    "/usr/bin/tail -f /var/log/syslog", "/usr/bin/journalctl -u nginx", "/usr/sbin/ufw status",
+};
+
+static const char* const packages[][2] = {
+    { "libc6", "2.36-9+deb12u3" }, { "openssl", "3.0.11-1~deb12u2" }, { "libssl3", "3.0.11-1~deb12u2" },
+    { "nginx", "1.22.1-9" }, { "nginx-common", "1.22.1-9" }, { "curl", "7.88.1-10+deb12u4" },
+    { "libcurl4", "7.88.1-10+deb12u4" }, { "htop", "3.2.2-2" }, { "vim", "2:9.0.1378-2" },
+    { "tzdata", "2024a-0+deb12u1" }, { "linux-image-6.1.0-13-amd64", "6.1.55-1" },
+    { "systemd", "252.19-1~deb12u1" }, { "python3.11", "3.11.2-6" }, { "git", "1:2.39.2-1.1" },
+};
+
+static const char* const url_paths[] = {
+    "/", "/index.html", "/about", "/api/v1/status", "/api/v1/items", "/api/v1/items/42", "/static/css/site.css",
+    "/static/js/app.js", "/static/img/logo.png", "/favicon.ico", "/robots.txt", "/login", "/feed.xml",
+};
+
+static const char* const probe_paths[] = {
+    "/wp-login.php", "/.env", "/phpmyadmin/", "/.git/config", "/cgi-bin/luci", "/admin/config.php",
+};
+
+static const char* const user_agents[] = {
+    "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0",
+    "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/117.0.0.0 Safari/537.36",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 17_0 like Mac OS X) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.0 Mobile/15E148 Safari/604.1",
+    "curl/7.88.1",
+    "Googlebot/2.1 (+http://www.google.com/bot.html)",
+    "python-requests/2.31.0",
+};
+
+// The systemd, timesyncd and dbus lines syslog shares with daemon.log
+static int daemon_line(gen_t* g, char* out, const char* stamp) {
+    uint32_t r = rnd(g, 100);
+    const char* const* unit = PICK(g, units);
+
+    if (r < 22) {
+        return snprintf(out, MAX_LINE, "%s debian systemd[1]: Starting %s - %s...\n", stamp, unit[0], unit[1]);
+    } else if (r < 44) {
+        return snprintf(out, MAX_LINE, "%s debian systemd[1]: %s: Deactivated successfully.\n", stamp, unit[0]);
+    } else if (r < 66) {
+        return snprintf(out, MAX_LINE, "%s debian systemd[1]: Finished %s - %s.\n", stamp, unit[0], unit[1]);
+    } else if (r < 78) {
+        uint32_t session = 100 + uptime_sec(g) / 3600;
+
+        return snprintf(out, MAX_LINE, "%s debian systemd[1]: Started session-%u.scope - Session %u of User admin.\n",
+                        stamp, session, session);
+    } else if (r < 88) {
+        return snprintf(out, MAX_LINE,
+                        "%s debian systemd-timesyncd[%u]: Contacted time server 185.125.190.%u:123 (2.debian.pool.ntp.org).\n",
+                        stamp, 412, 56 + rnd(g, 4));
+    } else if (r < 94) {
+        return snprintf(out, MAX_LINE, "%s debian systemd[1]: nginx.service: Reloading requested from client PID %u ('systemctl').\n",
+                        stamp, next_pid(g));
+    } else if (r < 97) {
+        return snprintf(out, MAX_LINE,
+                        "%s debian dbus-daemon[%u]: [system] Activating via systemd: service name='org.freedesktop.hostname1' unit='dbus-org.freedesktop.hostname1.service' requested by ':1.%u' (uid=0 pid=%u comm=\"hostnamectl\")\n",
+                        stamp, 389, rnd(g, 900), next_pid(g));
+    } else if (r < 99) {
+        return snprintf(out, MAX_LINE,
+                        "%s debian containerd[%u]: time=\"%s\" level=error msg=\"failed to reload cni configuration after receiving fs change event\" error=\"cni config load failed: no network config found in /etc/cni/net.d\"\n",
+                        stamp, 702, g->iso_stamp);
+    }
+    return snprintf(out, MAX_LINE, "%s debian systemd[1]: Failed to start %s - %s.\n", stamp, unit[0], unit[1]);
+}
+
+static int kernel_line(gen_t* g, char* out) {
+    uint32_t r = rnd(g, 100);
+    int n = snprintf(out, MAX_LINE, "%s debian kernel: [%5u.%06u] ", g->syslog_stamp, uptime_sec(g), uptime_usec(g));
+
+    if (r < 45) {
+        n += snprintf(out + n, MAX_LINE - n,
+                      "[UFW BLOCK] IN=eth0 OUT= MAC=52:54:00:12:34:56:52:54:00:ab:cd:ef:08:00 SRC=%u.%u.%u.%u DST=192.168.1.10 LEN=%u TOS=0x00 PREC=0x00 TTL=%u ID=%u PROTO=TCP SPT=%u DPT=%u WINDOW=1024 RES=0x00 SYN URGP=0\n",
+                      1 + rnd(g, 222), rnd(g, 256), rnd(g, 256), 1 + rnd(g, 254), 40 + rnd(g, 24), 40 + rnd(g, 200),
+                      rnd(g, 65536), 1024 + rnd(g, 64000), PICK(g, ((const uint32_t[]) { 22, 23, 3389, 5900, 8080, 445 })));
+    } else if (r < 60) {
+        n += snprintf(out + n, MAX_LINE - n,
+                      "audit: type=1400 audit(%u.%03u:%u): apparmor=\"DENIED\" operation=\"open\" profile=\"/usr/sbin/nginx\" name=\"/etc/ssl/private/\" pid=%u comm=\"nginx\" requested_mask=\"r\" denied_mask=\"r\" fsuid=33 ouid=0\n",
+                      (uint32_t)g->stamp_sec, rnd(g, 1000), rnd(g, 9000), next_pid(g));
+    } else if (r < 75) {
+        n += snprintf(out + n, MAX_LINE - n, "usb 1-1: %s, device number %u\n",
+                      rnd(g, 2) ? "USB disconnect" : "new high-speed USB device", 2 + rnd(g, 12));
+    } else if (r < 96) {
+        n += snprintf(out + n, MAX_LINE - n, "%s\n", PICK(g, kernel_messages));
+    } else {
+        n += snprintf(out + n, MAX_LINE - n, PICK(g, kernel_errors), rnd(g, 500000000));
+        out[n++] = '\n';
+    }
+    return n;
+}
+
+static int syslog_line(gen_t* g, char* out) {
+    uint32_t r = rnd(g, 100);
+
+    if (r < 45) return daemon_line(g, out, g->syslog_stamp);
+    if (r < 55) return kernel_line(g, out);
+    if (r < 72) {
+        return snprintf(out, MAX_LINE, "%s debian CRON[%u]: (root) CMD (%s)\n", g->syslog_stamp, next_pid(g),
+                        PICK(g, cron_jobs));
+    }
+    if (r < 84) {
+        uint32_t host = 10 + rnd(g, 200);
+
+        if (rnd(g, 2)) {
+            return snprintf(out, MAX_LINE, "%s debian dhclient[%u]: DHCPREQUEST for 192.168.1.%u on eth0 to 192.168.1.1 port 67\n",
+                            g->syslog_stamp, 611, host);
+        }
+        return snprintf(out, MAX_LINE, "%s debian dhclient[%u]: bound to 192.168.1.%u -- renewal in %u seconds.\n",
+                        g->syslog_stamp, 611, host, 1800 + rnd(g, 1800));
+    }
+    if (r < 92) {
+        return snprintf(out, MAX_LINE,
+                        "%s debian rsyslogd: [origin software=\"rsyslogd\" swVersion=\"8.2302.0\" x-pid=\"%u\" x-info=\"https://www.rsyslog.com\"] rsyslogd was HUPed\n",
+                        g->syslog_stamp, 402);
+    }
+    if (r < 99) {
+        return snprintf(out, MAX_LINE, "%s debian systemd-logind[%u]: %s session %u.\n", g->syslog_stamp, 398,
+                        rnd(g, 2) ? "New" : "Removed", 100 + uptime_sec(g) / 3600);
+    }
+    return snprintf(out, MAX_LINE, "%s debian smartd[%u]: Device: /dev/sda [SAT], %u Currently unreadable (pending) sectors\n",
+                    g->syslog_stamp, 395, 1 + rnd(g, 16));
+}
+
+static int daemon_log_line(gen_t* g, char* out) {
+    return daemon_line(g, out, g->syslog_stamp);
+}
+
+static int auth_line(gen_t* g, char* out) {
+    uint32_t r = rnd(g, 100);
+    uint32_t pid = next_pid(g);
+    char ip[20];
+
+    snprintf(ip, sizeof(ip), "%u.%u.%u.%u", 1 + rnd(g, 222), rnd(g, 256), rnd(g, 256), 1 + rnd(g, 254));
+    if (r < 25) {
+        return snprintf(out, MAX_LINE, "%s debian sshd[%u]: Invalid user %s from %s port %u\n", g->syslog_stamp, pid,
+                        PICK(g, usernames), ip, 1024 + rnd(g, 64000));
+    } else if (r < 45) {
+        return snprintf(out, MAX_LINE, "%s debian sshd[%u]: Failed password for invalid user %s from %s port %u ssh2\n",
+                        g->syslog_stamp, pid, PICK(g, usernames), ip, 1024 + rnd(g, 64000));
+    } else if (r < 57) {
+        return snprintf(out, MAX_LINE, "%s debian sshd[%u]: Connection closed by invalid user %s %s port %u [preauth]\n",
+                        g->syslog_stamp, pid, PICK(g, usernames), ip, 1024 + rnd(g, 64000));
+    } else if (r < 65) {
+        return snprintf(out, MAX_LINE,
+                        "%s debian sshd[%u]: Accepted publickey for admin from 192.168.1.%u port %u ssh2: ED25519 SHA256:Vq3Xr0cVbZ1tJ0m9Yh5kQ2Lx8sT4nW6pE7aB1dF3gH0\n",
+                        g->syslog_stamp, pid, 20 + rnd(g, 10), 40000 + rnd(g, 20000));
+    } else if (r < 73) {
+        return snprintf(out, MAX_LINE, "%s debian sshd[%u]: pam_unix(sshd:session): session %s for user admin%s\n",
+                        g->syslog_stamp, pid, rnd(g, 2) ? "opened" : "closed", rnd(g, 2) ? "(uid=1000) by (uid=0)" : "");
+    } else if (r < 81) {
+        return snprintf(out, MAX_LINE, "%s debian sudo:    admin : TTY=pts/%u ; PWD=/home/admin ; USER=root ; COMMAND=%s\n",
+                        g->syslog_stamp, rnd(g, 3), PICK(g, sudo_commands));
+    } else if (r < 86) {
+        return snprintf(out, MAX_LINE,
+                        "%s debian sudo: pam_unix(sudo:session): session opened for user root(uid=0) by admin(uid=1000)\n",
+                        g->syslog_stamp);
+    } else if (r < 96) {
+        return snprintf(out, MAX_LINE,
+                        "%s debian CRON[%u]: pam_unix(cron:session): session %s for user root%s\n", g->syslog_stamp, pid,
+                        rnd(g, 2) ? "opened" : "closed", rnd(g, 2) ? "(uid=0) by (uid=0)" : "");
+    } else if (r < 98) {
+        return snprintf(out, MAX_LINE, "%s debian sshd[%u]: error: kex_exchange_identification: Connection closed by remote host\n",
+                        g->syslog_stamp, pid);
+    }
+    return snprintf(out, MAX_LINE,
+                    "%s debian sshd[%u]: error: maximum authentication attempts exceeded for invalid user %s from %s port %u ssh2 [preauth]\n",
+                    g->syslog_stamp, pid, PICK(g, usernames), ip, 1024 + rnd(g, 64000));
+}
+
+static int kern_log_line(gen_t* g, char* out) {
+    return kernel_line(g, out);
+}
+
+static int dpkg_line(gen_t* g, char* out) {
+    const char* const* pkg = PICK(g, packages);
+    uint32_t r = rnd(g, 100);
+
+    if (r < 10) return snprintf(out, MAX_LINE, "%s startup archives unpack\n", g->iso_stamp);
+    if (r < 25) return snprintf(out, MAX_LINE, "%s upgrade %s:amd64 %s %s\n", g->iso_stamp, pkg[0], pkg[1], pkg[1]);
+    if (r < 40) return snprintf(out, MAX_LINE, "%s status unpacked %s:amd64 %s\n", g->iso_stamp, pkg[0], pkg[1]);
+    if (r < 55) return snprintf(out, MAX_LINE, "%s status half-configured %s:amd64 %s\n", g->iso_stamp, pkg[0], pkg[1]);
+    if (r < 75) return snprintf(out, MAX_LINE, "%s status installed %s:amd64 %s\n", g->iso_stamp, pkg[0], pkg[1]);
+    if (r < 85) return snprintf(out, MAX_LINE, "%s configure %s:amd64 %s <none>\n", g->iso_stamp, pkg[0], pkg[1]);
+    if (r < 95) return snprintf(out, MAX_LINE, "%s trigproc man-db:amd64 2.11.2-2 <none>\n", g->iso_stamp);
+    return snprintf(out, MAX_LINE, "%s startup packages configure\n", g->iso_stamp);
+}
+
+static int access_line(gen_t* g, char* out) {
+    uint32_t r = rnd(g, 1000);
+    const char* path = PICK(g, url_paths);
+    const char* method = "GET";
+    uint32_t status = 200, bytes = 200 + rnd(g, 40000);
+
+    if (r < 60) {
+        path = PICK(g, probe_paths);
+        status = 404;
+        bytes = 162;
+    } else if (r < 160) {
+        status = 304;
+        bytes = 0;
+    } else if (r < 200) {
+        method = "POST";
+        path = "/api/v1/items";
+        status = 201;
+    } else if (r < 205) {
+        method = "POST";
+        path = "/api/error-report";
+    } else if (r < 215) {
+        status = 502;
+        bytes = 157;
+    }
+    return snprintf(out, MAX_LINE, "%u.%u.%u.%u - - [%s] \"%s %s HTTP/1.1\" %u %u \"%s\" \"%s\"\n", 1 + rnd(g, 222),
+                    rnd(g, 256), rnd(g, 256), 1 + rnd(g, 254), g->nginx_stamp, method, path, status, bytes,
+                    rnd(g, 4) ? "-" : "https://example.org/", PICK(g, user_agents));
+}
+
+static int nginx_error_line(gen_t* g, char* out) {
+    uint32_t r = rnd(g, 100);
+    uint32_t worker = 1200 + rnd(g, 4);
+    char client[64];
+
+    snprintf(client, sizeof(client), "client: %u.%u.%u.%u, server: example.org", 1 + rnd(g, 222), rnd(g, 256),
+             rnd(g, 256), 1 + rnd(g, 254));
+    if (r < 45) {
+        const char* path = PICK(g, probe_paths);
+
+        return snprintf(out, MAX_LINE,
+                        "%s [error] %u#%u: *%u open() \"/var/www/html%s\" failed (2: No such file or directory), %s, request: \"GET %s HTTP/1.1\", host: \"example.org\"\n",
+                        g->slash_stamp, worker, worker, rnd(g, 900000), path, client, path);
+    } else if (r < 60) {
+        return snprintf(out, MAX_LINE,
+                        "%s [error] %u#%u: *%u connect() failed (111: Connection refused) while connecting to upstream, %s, request: \"GET /api/v1/items HTTP/1.1\", upstream: \"http://127.0.0.1:8000/api/v1/items\", host: \"example.org\"\n",
+                        g->slash_stamp, worker, worker, rnd(g, 900000), client);
+    } else if (r < 90) {
+        return snprintf(out, MAX_LINE,
+                        "%s [warn] %u#%u: *%u an upstream response is buffered to a temporary file /var/lib/nginx/proxy/%u/%02u/%010u while reading upstream, %s, request: \"GET /api/v1/items HTTP/1.1\", host: \"example.org\"\n",
+                        g->slash_stamp, worker, worker, rnd(g, 900000), rnd(g, 10), rnd(g, 100), rnd(g, 1000000000), client);
+    }
+    return snprintf(out, MAX_LINE, "%s [notice] %u#%u: signal process started\n", g->slash_stamp, worker, worker);
+}
+
+// Shares are per mille of the corpus
+static const struct {
+    const char* name;
+    unsigned share;
+    line_fn line;
+} log_files[] = {
+    { "auth.log", 120, auth_line },
+    { "daemon.log", 60, daemon_log_line },
+    { "dpkg.log", 30, dpkg_line },
+    { "kern.log", 90, kern_log_line },
+    { "nginx/access.log", 300, access_line },
+    { "nginx/error.log", 40, nginx_error_line },
+    { "syslog", 360, syslog_line },
+};
+#define N_LOG_FILES (sizeof(log_files) / sizeof(log_files[0]))
+
+// ---------------------------------------------------------------------
+// Writing
+
+typedef struct {
+    char path[512];
+    uint64_t bytes;
+    uint64_t seed;
+    line_fn line;
+    int rc;
+} file_job_t;
+
+static void* write_log(void* arg) {
+    file_job_t* job = arg;
+    gen_t g;
+    char* buf = malloc(WRITE_BUFFER + MAX_LINE);
+    uint64_t written = 0;
+    size_t len = 0;
+    int fd;
+
+    job->rc = 0;
+    if (!buf) {
+        job->rc = -ENOMEM;
+        return NULL;
+    }
+    fd = open(job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        job->rc = -errno;
+        free(buf);
+        return NULL;
+    }
+
+    memset(&g, 0, sizeof(g));
+    g.rng = job->seed * 0x9E3779B97F4A7C15ull + 1;
+    g.total = job->bytes;
+    g.start_ms = g.now_ms = LOGSIM_END * 1000LL - LOGSIM_SPAN_MS;
+    g.boot_ms = g.start_ms - 86400 * 1000LL;
+    g.stamp_sec = -1;
+    g.pid = 1000 + rnd(&g, 10000);
+
+    while (written + len < job->bytes && job->rc == 0) {
+        advance(&g, written + len);
+        len += (size_t)job->line(&g, buf + len);
+        if (len >= WRITE_BUFFER) {
+            job->rc = write_all(fd, buf, len);
+            written += len;
+            len = 0;
+        }
+    }
+    if (job->rc == 0 && len) job->rc = write_all(fd, buf, len);
+    if (close(fd) < 0 && job->rc == 0) job->rc = -errno;
+    free(buf);
+    return NULL;
+}
+
+static int make_dirs(const char* path) {
+    char buf[512];
+    char* p;
+
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (p = buf + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(buf, 0755) < 0 && errno != EEXIST) return -errno;
+        *p = '/';
+    }
+    if (mkdir(buf, 0755) < 0 && errno != EEXIST) return -errno;
+    return 0;
+}
+
+int logsim_generate(const char* dir, uint64_t total_bytes, uint64_t seed) {
+    file_job_t jobs[N_LOG_FILES];
+    pthread_t threads[N_LOG_FILES];
+    int started[N_LOG_FILES];
+    char path[512];
+    FILE* fp;
+    size_t i;
+    int rc;
+
+    snprintf(path, sizeof(path), "%s/nginx", dir);
+    if ((rc = make_dirs(path)) < 0) return rc;
+    snprintf(path, sizeof(path), "%s/" STAMP_FILE, dir);
+    unlink(path);
+
+    // The files are independent, so each gets a thread
+    for (i = 0; i < N_LOG_FILES; i++) {
+        snprintf(jobs[i].path, sizeof(jobs[i].path), "%s/%s", dir, log_files[i].name);
+        jobs[i].bytes = total_bytes / 1000 * log_files[i].share + total_bytes % 1000 * log_files[i].share / 1000;
+        jobs[i].seed = seed * N_LOG_FILES + i;
+        jobs[i].line = log_files[i].line;
+        started[i] = pthread_create(&threads[i], NULL, write_log, &jobs[i]) == 0;
+        if (!started[i]) write_log(&jobs[i]);
+    }
+    rc = 0;
+    for (i = 0; i < N_LOG_FILES; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        if (jobs[i].rc < 0 && rc == 0) rc = jobs[i].rc;
+    }
+    if (rc < 0) return rc;
+
+    // Written last: the tree is complete
+    fp = fopen(path, "w");
+    if (!fp) return -errno;
+    fprintf(fp, "logsim %d %llu %llu\n", LOGSIM_VERSION, (unsigned long long)total_bytes, (unsigned long long)seed);
+    if (fclose(fp) != 0) return -errno;
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// The lessons' corpus
+
+int logsim_is_complete(const char* dir, uint64_t bytes, uint64_t seed) {
+    char path[600], want[96], have[96] = "";
+    FILE* fp;
+
+    snprintf(path, sizeof(path), "%s/" STAMP_FILE, dir);
+    fp = fopen(path, "r");
+    if (!fp) return 0;
+    if (!fgets(have, sizeof(have), fp)) have[0] = '\0';
+    fclose(fp);
+    snprintf(want, sizeof(want), "logsim %d %llu %llu\n", LOGSIM_VERSION, (unsigned long long)bytes,
+             (unsigned long long)seed);
+    return strcmp(have, want) == 0;
+}
+
+static void remove_corpus(const char* dir) {
+    char path[512];
+    size_t i;
+
+    for (i = 0; i < N_LOG_FILES; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, log_files[i].name);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/" STAMP_FILE, dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/nginx", dir);
+    rmdir(path);
+    rmdir(dir);
+}
+
+const char* logsim_corpus(void) {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static char corpus[512];
+    static int state;       // 0 not tried, 1 ready, -1 failed
+    const char* env = getenv("DEB1_LOG_CORPUS");
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char base[480], tmp[600];
+    struct stat st;
+
+    if (env && *env) return stat(env, &st) == 0 && S_ISDIR(st.st_mode) ? env : NULL;
+
+    pthread_mutex_lock(&lock);
+    if (state == 0) {
+        state = -1;
+        if (cache && *cache) {
+            snprintf(base, sizeof(base), "%s/deb1", cache);
+        } else {
+            snprintf(base, sizeof(base), "%s/.cache/deb1", home && *home ? home : "/tmp");
+        }
+        snprintf(corpus, sizeof(corpus), "%s/varlog-v%d-%u", base, LOGSIM_VERSION, LOGSIM_LESSON_BYTES);
+        if (logsim_is_complete(corpus, LOGSIM_LESSON_BYTES, LOGSIM_SEED)) {
+            state = 1;
+        } else if (make_dirs(base) == 0) {
+            remove_corpus(corpus);
+            // Built aside and renamed, so another tutor never sees half of it
+            snprintf(tmp, sizeof(tmp), "%s.tmp.%d", corpus, (int)getpid());
+            if (logsim_generate(tmp, LOGSIM_LESSON_BYTES, LOGSIM_SEED) == 0 && rename(tmp, corpus) == 0) {
+                state = 1;
+            } else {
+                remove_corpus(tmp);
+                if (logsim_is_complete(corpus, LOGSIM_LESSON_BYTES, LOGSIM_SEED)) state = 1;
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return state == 1 ? corpus : NULL;
+}
+
+uint64_t logsim_parse_size(const char* text) {
+    char* end;
+    unsigned long long n = strtoull(text, &end, 10);
+
+    switch (*end) {
+        case 'k': case 'K': n <<= 10; end++; break;
+        case 'm': case 'M': n <<= 20; end++; break;
+        case 'g': case 'G': n <<= 30; end++; break;
+        case 't': case 'T': n <<= 40; end++; break;
+        default: break;
+    }
+    if (*end == 'B' || *end == 'b') end++;
+    return end == text || *end ? 0 : (uint64_t)n;
+}
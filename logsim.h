@@ -0,0 +1,36 @@
+#ifndef LOGSIM_H
+#define LOGSIM_H
+
+#include <stdint.h>
+
+// Synthetic /var/log for the simulated machine.
+//
+// logsim_generate() writes a deterministic log tree: syslog, auth.log,
+// daemon.log, kern.log, dpkg.log and nginx/access.log, nginx/error.log,
+// in the proportions of a busy web server, with timestamps spread over
+// the two weeks before the simulated clock starts. The same size and seed
+// always give the same bytes. Lines are built from templates filled from
+// a xorshift generator; roughly one line in fifty says "error" somewhere.
+//
+// The simulated grep (grep.c) searches the real files of a corpus in
+// place of /var/log: $DEB1_LOG_CORPUS when set (to practise on a large
+// tree made with --gen-logs), otherwise a small one generated once into
+// the user's cache directory.
+
+#define LOGSIM_LESSON_BYTES (8u << 20)
+#define LOGSIM_SEED 20231015
+
+// Write about total_bytes of logs under dir (created if needed).
+// Returns 0 or -errno.
+int logsim_generate(const char* dir, uint64_t total_bytes, uint64_t seed);
+// Whether dir holds a finished logsim_generate() of that size and seed
+int logsim_is_complete(const char* dir, uint64_t total_bytes, uint64_t seed);
+
+// Directory standing in for /var/log, generated on first use; NULL if
+// there is none and one cannot be made
+const char* logsim_corpus(void);
+
+// "512M", "4G", "100000": bytes, or 0 if unparseable
+uint64_t logsim_parse_size(const char* text);
+
+#endif
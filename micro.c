@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "deb1.h"
+#include "bench.h"
+#include "console.h"
+#include "sim.h"
+#include "micro.h"
+
+#define MICRO_SAMPLES 21
+#define MICRO_SAMPLE_SECONDS 0.01
+
+static const char* choice_inputs[] = { "1", "3", " 2", "7\n", "12", "abc", "", "-1" };
+
+// The lesson pack's command steps, for the simulation case
+static const lp_step_t** commands;
+static uint32_t n_commands;
+
+static volatile uint32_t sink;
+
+// A fixed loop that touches nothing else: when it is slower too, the
+// machine is, not the code
+static unsigned char reference_data[4096];
+
+static void run_reference(long n) {
+    uint32_t h = 2166136261u;
+    long i;
+    size_t j;
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < sizeof(reference_data); j++) h = (h ^ reference_data[j]) * 16777619u;
+    }
+    sink += h;
+}
+
+static void run_choice_parse(long n) {
+    long i;
+
+    for (i = 0; i < n; i++) {
+        sink += parse_user_choice(choice_inputs[i & 7], 9);
+    }
+}
+
+static void run_main_menu(long n) {
+    long i;
+
+    for (i = 0; i < n; i++) {
+        show_main_menu();
+        con_flush();
+    }
+}
+
+static void run_lesson_screen(long n) {
+    long i;
+
+    for (i = 0; i < n; i++) {
+        show_lesson(lp_topic(&lessons, (uint32_t)(i % lessons.header->n_topics)));
+        con_flush();
+    }
+}
+
+// The machine the per-command case runs on, set up (journal seeded,
+// process table ticking) by one pass over the commands before timing
+static sim_env_t* warm_env;
+
+static void run_commands(uint32_t first, long n) {
+    long i;
+
+    for (i = 0; i < n; i++) {
+        const lp_step_t* step = commands[(first + i) % n_commands];
+
+        execute_or_simulate_command(lp_str(&lessons, step->text), lp_str(&lessons, step->output));
+        con_flush();
+    }
+}
+
+// Carries on round the commands from where the last sample stopped
+static void run_simulate(long n) {
+    static uint32_t next;
+
+    if (!n_commands) return;
+    sim_enter(&warm_env);
+    run_commands(next, n);
+    next = (uint32_t)((next + n) % n_commands);
+    sim_enter(NULL);
+}
+
+// What a learner's first pass pays: a new machine, every command once.
+// Each subsystem builds its state on first use.
+static void run_simulate_machine(long n) {
+    long i;
+
+    for (i = 0; i < n && n_commands; i++) {
+        sim_env_t* env = NULL;
+
+        sim_enter(&env);
+        run_commands(0, n_commands);
+        sim_enter(NULL);
+        sim_env_free(env);
+    }
+}
+
+static void run_detect(long n) {
+    long i;
+
+    for (i = 0; i < n; i++) {
+        detect_and_configure_system();
+        con_flush();
+    }
+}
+
+typedef struct {
+    const char* metric;
+    void (*run)(long n);
+    const char* os_release;     // fixture for the detection cases
+    long n;                     // operations per sample
+    double best;                // seconds per operation
+} micro_case_t;
+
+static micro_case_t cases[] = {
+    { "reference", run_reference, NULL, 0, 0 },
+    { "choice_parse", run_choice_parse, NULL, 0, 0 },
+    { "main_menu", run_main_menu, NULL, 0, 0 },
+    { "lesson_screen", run_lesson_screen, NULL, 0, 0 },
+    { "simulate_command", run_simulate, NULL, 0, 0 },
+    { "simulate_machine", run_simulate_machine, NULL, 0, 0 },
+    { "os_release_debian", run_detect, "bench/fixtures/os-release.debian", 0, 0 },
+    { "os_release_ubuntu", run_detect, "bench/fixtures/os-release.ubuntu", 0, 0 },
+    { "os_release_other", run_detect, "bench/fixtures/os-release.fedora", 0, 0 },
+};
+#define N_CASES (sizeof(cases) / sizeof(cases[0]))
+
+static double time_sample(micro_case_t* c, long n) {
+    double start;
+
+    if (c->os_release) os_release_path = c->os_release;
+    start = bench_now();
+    c->run(n);
+    return bench_now() - start;
+}
+
+// Each case gets enough operations per sample to take MICRO_SAMPLE_SECONDS;
+// then the samples go round the cases, so a slow patch of the machine
+// spoils one sample of each rather than every sample of one, and the best
+// is kept
+static void run_cases(void) {
+    size_t i;
+    int sample;
+
+    for (i = 0; i < N_CASES; i++) {
+        micro_case_t* c = &cases[i];
+        double elapsed;
+
+        for (c->n = 1;; c->n *= elapsed > MICRO_SAMPLE_SECONDS / 16 ? 2 : 8) {
+            elapsed = time_sample(c, c->n);
+            if (elapsed >= MICRO_SAMPLE_SECONDS || c->n >= 1L << 30) break;
+        }
+        c->best = 0;
+    }
+    for (sample = 0; sample < MICRO_SAMPLES; sample++) {
+        for (i = 0; i < N_CASES; i++) {
+            micro_case_t* c = &cases[i];
+            double per_op = time_sample(c, c->n) / c->n;
+
+            if (!c->best || per_op < c->best) c->best = per_op;
+        }
+    }
+}
+
+int micro_bench(int argc, char** argv) {
+    const char* baseline = NULL;
+    double tolerance = 10;
+    const char* saved_os_release = os_release_path;
+    console_t con;
+    uint32_t i;
+    int rc = 0;
+
+    for (i = 0; i < (uint32_t)argc; i++) {
+        if (strcmp(argv[i], "--check") == 0 && i + 1 < (uint32_t)argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < (uint32_t)argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: --bench micro [--check BASELINE [--tolerance PERCENT]]\n");
+            return 1;
+        }
+    }
+    load_lessons(NULL);
+
+    commands = malloc(lessons.header->n_steps * sizeof(*commands));
+    n_commands = 0;
+    for (i = 0; i < lessons.header->n_steps; i++) {
+        const lp_step_t* step = lp_step(&lessons, i);
+
+        if (step->kind == LP_STEP_COMMAND) commands[n_commands++] = step;
+    }
+
+    // A terminal's worth of colour and clear-screens, sent nowhere
+    memset(&con, 0, sizeof(con));
+    con.out_fd = -1;
+    con.color = 1;
+    con.clear_screen = 1;
+    console_use(&con);
+
+    memset(&sys_config, 0, sizeof(sys_config));
+    sys_config.os_type = OS_SIMULATE_DEBIAN;
+    sys_config.simulate_mode = 1;
+    strcpy(sys_config.os_name, "Debian");
+    strcpy(sys_config.prompt_prefix, "sim-debian");
+
+    sim_enter(&warm_env);
+    run_commands(0, n_commands);
+    sim_enter(NULL);
+    run_cases();
+    os_release_path = saved_os_release;
+    for (i = 0; i < N_CASES; i++) {
+        bench_report("micro", cases[i].metric, cases[i].best * 1e9, "ns/op");
+    }
+
+    console_use(NULL);
+    console_free(&con);
+    sim_env_free(warm_env);
+    warm_env = NULL;
+    free(commands);
+    lesson_pack_close(&lessons);
+
+    if (baseline) {
+        rc = bench_check(baseline, tolerance / 100);
+        if (rc < 0) {
+            fprintf(stderr, "%s: %s\n", baseline, strerror(-rc));
+            return 1;
+        }
+        fprintf(stderr, "%d regression%s over %g%%\n", rc, rc == 1 ? "" : "s", tolerance);
+    }
+    return rc > 0 ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+#ifndef MICRO_H
+#define MICRO_H
+
+// --bench micro [--check BASELINE [--tolerance PERCENT]]
+//
+// The per-choice hot paths, each in isolation: parsing a menu choice,
+// rendering the main menu and lesson screens to a null sink, simulating
+// the lesson commands one at a time on a machine already running and all
+// of them once on a new machine, and detecting the system from os-release
+// fixtures (bench/fixtures). Each is reported in nanoseconds per operation,
+// the best of several timed samples. With --check the results are compared
+// against a stored baseline (bench/baseline.json, see the Makefile) and
+// the exit status is the number of metrics more than PERCENT (default 10)
+// slower, after allowing for the machine's own speed (see bench_check()).
+int micro_bench(int argc, char** argv);
+
+#endif
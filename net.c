@@ -0,0 +1,1807 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <ctype.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "proc.h"
+#include "net.h"
+#include "bench.h"
+#include "util.h"
+
+#define MAX_TOKENS 128
+#define LINE_MAX_LEN 512
+
+// ss's and netstat's address columns
+#define SS_ADDR_WIDTH 20
+#define SS_PORT_WIDTH 8
+#define NETSTAT_ADDR_WIDTH 23
+
+// The lesson machine's DHCP lease, renewed halfway through
+#define LEASE_SECONDS 86400
+
+typedef enum {
+    KEY_TUPLE,
+    KEY_PID
+} key_kind_t;
+
+typedef enum {
+    NET_EXPR_AND,
+    NET_EXPR_OR,
+    NET_EXPR_NOT,
+    NET_EXPR_SPORT,
+    NET_EXPR_DPORT,
+    NET_EXPR_SRC,
+    NET_EXPR_DST
+} net_expr_kind_t;
+
+typedef enum {
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_GT,
+    OP_LE,
+    OP_GE
+} port_op_t;
+
+#define STATE(s) (1u << (s))
+#define STATES_ALL (((1u << NET_STATES) - 1) & ~STATE(NET_FREE))
+#define STATES_CONNECTED (STATES_ALL & ~(STATE(NET_LISTEN) | STATE(NET_CLOSE)))
+#define STATES_BUCKET (STATE(NET_SYN_RECV) | STATE(NET_TIME_WAIT))
+// What ss shows without -a or -l
+#define STATES_DEFAULT (STATES_CONNECTED & ~STATES_BUCKET)
+
+// ---------------------------------------------------------------------
+// Addresses and ports
+
+static int parse_ipv4(const char* s, size_t len, uint32_t* addr) {
+    uint32_t value = 0, part = 0;
+    int parts = 0, digits = 0;
+    size_t i;
+
+    for (i = 0; i <= len; i++) {
+        if (i < len && isdigit((unsigned char)s[i])) {
+            part = part * 10 + (uint32_t)(s[i] - '0');
+            if (part > 255 || ++digits > 3) return -1;
+        } else if (i == len || s[i] == '.') {
+            if (!digits || parts == 4) return -1;
+            value = value << 8 | part;
+            parts++;
+            part = 0;
+            digits = 0;
+        } else {
+            return -1;
+        }
+    }
+    if (parts != 4) return -1;
+    *addr = value;
+    return 0;
+}
+
+static uint32_t prefix_mask(uint8_t len) {
+    return len ? ~0u << (32 - len) : 0;
+}
+
+// "10.8.0.0/16", "192.168.1.7" (a /32) or "default"
+static int parse_prefix(const char* s, uint32_t* addr, uint8_t* len) {
+    const char* slash = strchr(s, '/');
+    char* end;
+    long bits = 32;
+
+    if (strcmp(s, "default") == 0 || strcmp(s, "all") == 0 || strcmp(s, "any") == 0) {
+        *addr = 0;
+        *len = 0;
+        return 0;
+    }
+    if (slash) {
+        bits = strtol(slash + 1, &end, 10);
+        if (*end || end == slash + 1 || bits < 0 || bits > 32) return -1;
+    }
+    if (parse_ipv4(s, slash ? (size_t)(slash - s) : strlen(s), addr) != 0) return -1;
+    *len = (uint8_t)bits;
+    return 0;
+}
+
+static const char* format_ip(uint32_t addr, char* buf) {
+    sprintf(buf, "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 255, (addr >> 8) & 255, addr & 255);
+    return buf;
+}
+
+// /etc/services, the ports the lessons meet
+static const struct {
+    uint16_t port;
+    const char* name;
+} services[] = {
+    { 21, "ftp" },
+    { 22, "ssh" },
+    { 23, "telnet" },
+    { 25, "smtp" },
+    { 53, "domain" },
+    { 67, "bootps" },
+    { 68, "bootpc" },
+    { 80, "http" },
+    { 110, "pop3" },
+    { 123, "ntp" },
+    { 143, "imap2" },
+    { 443, "https" },
+    { 631, "ipp" },
+    { 993, "imaps" },
+    { 3306, "mysql" },
+    { 5432, "postgresql" },
+    { 8080, "http-alt" },
+};
+
+static const char* service_name(uint16_t port) {
+    size_t i;
+
+    for (i = 0; i < sizeof(services) / sizeof(services[0]); i++) {
+        if (services[i].port == port) return services[i].name;
+    }
+    return NULL;
+}
+
+// "22", ":22", "ssh" or ":ssh"
+static int parse_port(const char* s, uint16_t* port) {
+    char* end;
+    long value;
+    size_t i;
+
+    if (*s == ':') s++;
+    for (i = 0; i < sizeof(services) / sizeof(services[0]); i++) {
+        if (strcmp(services[i].name, s) == 0) {
+            *port = services[i].port;
+            return 0;
+        }
+    }
+    value = strtol(s, &end, 10);
+    if (*end || end == s || value < 0 || value > 65535) return -1;
+    *port = (uint16_t)value;
+    return 0;
+}
+
+static const char* port_string(uint16_t port, int numeric, char* buf) {
+    const char* name = numeric ? NULL : service_name(port);
+
+    if (name) return name;
+    sprintf(buf, "%u", port);
+    return buf;
+}
+
+// ---------------------------------------------------------------------
+// The stack
+
+net_stack_t* net_new(void) {
+    net_stack_t* n = calloc(1, sizeof(*n));
+
+    if (!n) {
+        perror("calloc");
+        exit(1);
+    }
+    n->ifs = xrealloc(NULL, sizeof(net_if_t));
+    memset(n->ifs, 0, sizeof(net_if_t));
+    n->n_ifs = 1;
+    n->nodes = xrealloc(NULL, 64 * sizeof(net_node_t));
+    n->nodes_cap = 64;
+    n->nodes[0] = (net_node_t){ { 0, 0 }, NET_NONE };
+    n->n_nodes = 1;
+    n->free_route = NET_NONE;
+    n->free_socket = NET_NONE;
+    n->next_inode = 18300;
+    return n;
+}
+
+void net_free(net_stack_t* n) {
+    if (!n) return;
+    free(n->ifs);
+    free(n->addrs);
+    free(n->routes);
+    free(n->nodes);
+    free(n->sockets);
+    free(n->by_tuple.slots);
+    free(n->by_pid.slots);
+    free(n);
+}
+
+uint32_t net_add_interface(net_stack_t* n, const char* name, uint32_t flags, uint32_t mtu, const uint8_t* mac) {
+    net_if_t* ifc;
+
+    n->ifs = xrealloc(n->ifs, (n->n_ifs + 1) * sizeof(net_if_t));
+    ifc = &n->ifs[n->n_ifs];
+    memset(ifc, 0, sizeof(*ifc));
+    snprintf(ifc->name, sizeof(ifc->name), "%s", name);
+    ifc->flags = flags;
+    ifc->mtu = mtu;
+    ifc->qdisc = (flags & NET_IF_LOOPBACK) ? "noqueue" : "fq_codel";
+    if (mac) memcpy(ifc->mac, mac, sizeof(ifc->mac));
+    return n->n_ifs++;
+}
+
+void net_add_address(net_stack_t* n, uint32_t dev, uint32_t addr, uint8_t len, uint8_t scope, uint8_t dynamic) {
+    if (n->n_addrs == n->addrs_cap) {
+        n->addrs_cap = n->addrs_cap ? n->addrs_cap * 2 : 8;
+        n->addrs = xrealloc(n->addrs, n->addrs_cap * sizeof(net_addr_t));
+    }
+    n->addrs[n->n_addrs++] = (net_addr_t){ addr, len, scope, dynamic, (uint16_t)dev };
+}
+
+uint32_t net_interface(const net_stack_t* n, const char* name) {
+    uint32_t i;
+
+    for (i = 1; i < n->n_ifs; i++) {
+        if (strcmp(n->ifs[i].name, name) == 0) return i;
+    }
+    return 0;
+}
+
+// The address a route's packets leave with: its own preferred source,
+// else the device's first address
+static uint32_t source_address(const net_stack_t* n, const net_route_t* r) {
+    uint32_t i;
+
+    if (r->src) return r->src;
+    for (i = 0; i < n->n_addrs; i++) {
+        if (n->addrs[i].dev == r->dev) return n->addrs[i].addr;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Routes
+
+// The trie node of a prefix, made on the way if create; NET_NONE if not
+static uint32_t trie_node(net_stack_t* n, uint32_t dst, uint8_t len, int create) {
+    uint32_t node = 0, b;
+
+    for (b = 0; b < len; b++) {
+        uint32_t bit = (dst >> (31 - b)) & 1, next = n->nodes[node].child[bit];
+
+        if (!next) {
+            if (!create) return NET_NONE;
+            if (n->n_nodes == n->nodes_cap) {
+                n->nodes_cap *= 2;
+                n->nodes = xrealloc(n->nodes, n->nodes_cap * sizeof(net_node_t));
+            }
+            next = n->n_nodes++;
+            n->nodes[next] = (net_node_t){ { 0, 0 }, NET_NONE };
+            n->nodes[node].child[bit] = next;
+        }
+        node = next;
+    }
+    return node;
+}
+
+int net_route_add(net_stack_t* n, const net_route_t* r, int replace) {
+    uint32_t node = trie_node(n, r->dst & prefix_mask(r->len), r->len, 1), i, *link;
+
+    for (i = n->nodes[node].route; i != NET_NONE; i = n->routes[i].next) {
+        if (n->routes[i].metric != r->metric) continue;
+        if (!replace) return -EEXIST;
+        link = &n->routes[i].next;
+        n->routes[i] = *r;
+        n->routes[i].next = *link;
+        n->routes[i].live = 1;
+        return 0;
+    }
+    if (n->free_route != NET_NONE) {
+        i = n->free_route;
+        n->free_route = n->routes[i].next;
+    } else {
+        if (n->n_routes == n->routes_cap) {
+            n->routes_cap = n->routes_cap ? n->routes_cap * 2 : 16;
+            n->routes = xrealloc(n->routes, n->routes_cap * sizeof(net_route_t));
+        }
+        i = n->n_routes++;
+    }
+    n->routes[i] = *r;
+    n->routes[i].dst &= prefix_mask(r->len);
+    n->routes[i].live = 1;
+
+    // Lowest metric first: the head is the one lookups take
+    for (link = &n->nodes[node].route; *link != NET_NONE && n->routes[*link].metric < r->metric;
+         link = &n->routes[*link].next) {
+    }
+    n->routes[i].next = *link;
+    *link = i;
+    n->live_routes++;
+    return 0;
+}
+
+int net_route_del(net_stack_t* n, uint32_t dst, uint8_t len, const net_route_t* match) {
+    uint32_t node = trie_node(n, dst & prefix_mask(len), len, 0), *link;
+
+    if (node == NET_NONE) return -ESRCH;
+    for (link = &n->nodes[node].route; *link != NET_NONE; link = &n->routes[*link].next) {
+        net_route_t* r = &n->routes[*link];
+        uint32_t i = *link;
+
+        if ((match->gateway && r->gateway != match->gateway) || (match->dev && r->dev != match->dev) ||
+            (match->metric && r->metric != match->metric)) {
+            continue;
+        }
+        *link = r->next;
+        r->live = 0;
+        r->next = n->free_route;
+        n->free_route = i;
+        n->live_routes--;
+        return 0;
+    }
+    return -ESRCH;
+}
+
+uint32_t net_route_lookup(const net_stack_t* n, uint32_t addr) {
+    const net_node_t* nodes = n->nodes;
+    uint32_t node = 0, best = nodes[0].route, b;
+
+    for (b = 0; b < 32; b++) {
+        node = nodes[node].child[(addr >> (31 - b)) & 1];
+        if (!node) break;
+        if (nodes[node].route != NET_NONE) best = nodes[node].route;
+    }
+    return best;
+}
+
+void net_route_walk(const net_stack_t* n, net_route_fn fn, void* ctx) {
+    uint32_t stack[66], depth = 0, i;
+
+    // Preorder, 0 before 1: shorter prefixes, then by address
+    stack[depth++] = 0;
+    while (depth) {
+        const net_node_t* node = &n->nodes[stack[--depth]];
+
+        for (i = node->route; i != NET_NONE; i = n->routes[i].next) {
+            if (fn(ctx, &n->routes[i])) return;
+        }
+        if (node->child[1]) stack[depth++] = node->child[1];
+        if (node->child[0]) stack[depth++] = node->child[0];
+    }
+}
+
+// ---------------------------------------------------------------------
+// Sockets
+
+static uint32_t hash_tuple(uint8_t proto, uint32_t laddr, uint16_t lport, uint32_t raddr, uint16_t rport) {
+    uint64_t h = ((uint64_t)laddr << 32 | raddr) * 0x9E3779B97F4A7C15ull;
+
+    h ^= ((uint64_t)lport << 32 | (uint64_t)rport << 8 | proto) + (h >> 29);
+    h *= 0xBF58476D1CE4E5B9ull;
+    return (uint32_t)(h >> 32);
+}
+
+static uint32_t hash_pid(int32_t pid) {
+    uint32_t id = (uint32_t)pid;
+
+    id ^= id >> 16;
+    id *= 0x7feb352du;
+    id ^= id >> 15;
+    return id;
+}
+
+static uint32_t key_hash(const net_stack_t* n, key_kind_t kind, uint32_t i) {
+    const net_socket_t* s = &n->sockets[i];
+
+    return kind == KEY_TUPLE ? hash_tuple(s->proto, s->laddr, s->lport, s->raddr, s->rport) : hash_pid(s->pid);
+}
+
+static uint32_t* tuple_slot(const net_stack_t* n, uint8_t proto, uint32_t laddr, uint16_t lport, uint32_t raddr,
+                            uint16_t rport) {
+    const net_index_t* ix = &n->by_tuple;
+    uint32_t i = hash_tuple(proto, laddr, lport, raddr, rport) & ix->mask;
+
+    while (ix->slots[i]) {
+        const net_socket_t* s = &n->sockets[ix->slots[i] - 1];
+
+        if (s->laddr == laddr && s->raddr == raddr && s->lport == lport && s->rport == rport && s->proto == proto) break;
+        i = (i + 1) & ix->mask;
+    }
+    return &ix->slots[i];
+}
+
+static uint32_t* pid_slot(const net_stack_t* n, int32_t pid) {
+    const net_index_t* ix = &n->by_pid;
+    uint32_t i = hash_pid(pid) & ix->mask;
+
+    while (ix->slots[i] && n->sockets[ix->slots[i] - 1].pid != pid) i = (i + 1) & ix->mask;
+    return &ix->slots[i];
+}
+
+// Rehash into at least twice as many slots as entries, for count entries
+static void index_reserve(const net_stack_t* n, net_index_t* ix, key_kind_t kind, uint32_t count) {
+    uint32_t old_size = ix->slots ? ix->mask + 1 : 0, size = old_size ? old_size : 64, i;
+    uint32_t* old = ix->slots;
+
+    while (count * 2 > size) size *= 2;
+    if (size == old_size) return;
+    ix->slots = calloc(size, sizeof(uint32_t));
+    if (!ix->slots) {
+        perror("calloc");
+        exit(1);
+    }
+    ix->mask = size - 1;
+    for (i = 0; i < old_size; i++) {
+        uint32_t j;
+
+        if (!old[i]) continue;
+        j = key_hash(n, kind, old[i] - 1) & ix->mask;
+        while (ix->slots[j]) j = (j + 1) & ix->mask;
+        ix->slots[j] = old[i];
+    }
+    free(old);
+}
+
+// Empty a slot, moving later entries of its probe run back into the hole
+// so no lookup stops short (no tombstones)
+static void index_remove(const net_stack_t* n, net_index_t* ix, key_kind_t kind, uint32_t* slot) {
+    uint32_t hole = (uint32_t)(slot - ix->slots), i = hole;
+
+    for (;;) {
+        uint32_t home;
+
+        i = (i + 1) & ix->mask;
+        if (!ix->slots[i]) break;
+        home = key_hash(n, kind, ix->slots[i] - 1) & ix->mask;
+        if (((i - home) & ix->mask) >= ((i - hole) & ix->mask)) {
+            ix->slots[hole] = ix->slots[i];
+            hole = i;
+        }
+    }
+    ix->slots[hole] = 0;
+    ix->count--;
+}
+
+uint32_t net_socket_add(net_stack_t* n, const net_socket_t* s) {
+    net_socket_t* sock;
+    uint32_t i, *slot;
+
+    if (!n->by_tuple.slots || (n->by_tuple.count + 1) * 2 > n->by_tuple.mask + 1) {
+        index_reserve(n, &n->by_tuple, KEY_TUPLE, n->by_tuple.count + 1);
+    }
+    slot = tuple_slot(n, s->proto, s->laddr, s->lport, s->raddr, s->rport);
+    if (*slot) return NET_NONE;
+    if (n->free_socket != NET_NONE) {
+        i = n->free_socket;
+        n->free_socket = n->sockets[i].next_of_pid;
+    } else {
+        if (n->n_sockets == n->sockets_cap) {
+            n->sockets_cap = n->sockets_cap ? n->sockets_cap * 2 : 64;
+            n->sockets = xrealloc(n->sockets, n->sockets_cap * sizeof(net_socket_t));
+        }
+        i = n->n_sockets++;
+    }
+    sock = &n->sockets[i];
+    *sock = *s;
+    if (!sock->inode) sock->inode = n->next_inode++;
+    sock->prev_of_pid = sock->next_of_pid = NET_NONE;
+    *slot = i + 1;
+    n->by_tuple.count++;
+    n->live_sockets++;
+
+    // Newest first in its process's chain
+    if (s->pid > 0) {
+        if (!n->by_pid.slots || (n->by_pid.count + 1) * 2 > n->by_pid.mask + 1) {
+            index_reserve(n, &n->by_pid, KEY_PID, n->by_pid.count + 1);
+        }
+        slot = pid_slot(n, s->pid);
+        if (*slot) {
+            sock->next_of_pid = *slot - 1;
+            n->sockets[*slot - 1].prev_of_pid = i;
+        } else {
+            n->by_pid.count++;
+        }
+        *slot = i + 1;
+    }
+    return i;
+}
+
+uint32_t net_socket_find(const net_stack_t* n, uint8_t proto, uint32_t laddr, uint16_t lport, uint32_t raddr,
+                         uint16_t rport) {
+    return n->by_tuple.slots ? *tuple_slot(n, proto, laddr, lport, raddr, rport) - 1 : NET_NONE;
+}
+
+void net_socket_close(net_stack_t* n, uint32_t i) {
+    net_socket_t* s = &n->sockets[i];
+
+    index_remove(n, &n->by_tuple, KEY_TUPLE, tuple_slot(n, s->proto, s->laddr, s->lport, s->raddr, s->rport));
+    if (s->pid > 0) {
+        if (s->prev_of_pid != NET_NONE) {
+            n->sockets[s->prev_of_pid].next_of_pid = s->next_of_pid;
+        } else if (s->next_of_pid != NET_NONE) {
+            *pid_slot(n, s->pid) = s->next_of_pid + 1;
+        } else {
+            index_remove(n, &n->by_pid, KEY_PID, pid_slot(n, s->pid));
+        }
+        if (s->next_of_pid != NET_NONE) n->sockets[s->next_of_pid].prev_of_pid = s->prev_of_pid;
+    }
+    s->state = NET_FREE;
+    s->next_of_pid = n->free_socket;
+    n->free_socket = i;
+    n->live_sockets--;
+}
+
+uint32_t net_pid_sockets(const net_stack_t* n, int32_t pid) {
+    return n->by_pid.slots && pid > 0 ? *pid_slot(n, pid) - 1 : NET_NONE;
+}
+
+uint32_t net_close_pid(net_stack_t* n, int32_t pid) {
+    uint32_t count = 0, i;
+
+    while ((i = net_pid_sockets(n, pid)) != NET_NONE) {
+        net_socket_close(n, i);
+        count++;
+    }
+    return count;
+}
+
+// ---------------------------------------------------------------------
+// ss filters
+
+static const struct {
+    const char* name;
+    uint32_t states;
+} state_names[] = {
+    { "all", STATES_ALL },
+    { "connected", STATES_CONNECTED },
+    { "synchronized", STATES_CONNECTED & ~STATE(NET_SYN_SENT) },
+    { "bucket", STATES_BUCKET },
+    { "big", STATES_ALL & ~STATES_BUCKET },
+    { "established", STATE(NET_ESTABLISHED) },
+    { "syn-sent", STATE(NET_SYN_SENT) },
+    { "syn-recv", STATE(NET_SYN_RECV) },
+    { "fin-wait-1", STATE(NET_FIN_WAIT1) },
+    { "fin-wait-2", STATE(NET_FIN_WAIT2) },
+    { "time-wait", STATE(NET_TIME_WAIT) },
+    { "closed", STATE(NET_CLOSE) },
+    { "close-wait", STATE(NET_CLOSE_WAIT) },
+    { "last-ack", STATE(NET_LAST_ACK) },
+    { "listening", STATE(NET_LISTEN) },
+    { "closing", STATE(NET_CLOSING) },
+};
+
+typedef struct {
+    char** tok;
+    int n, pos;
+    net_filter_t* f;
+    char* err;
+    size_t err_len;
+} parser_t;
+
+static const char* peek(const parser_t* p) {
+    return p->pos < p->n ? p->tok[p->pos] : NULL;
+}
+
+static int is_word(const parser_t* p, const char* a, const char* b) {
+    const char* t = peek(p);
+
+    return t && (strcmp(t, a) == 0 || (b && strcmp(t, b) == 0));
+}
+
+static int syntax_error(parser_t* p) {
+    return set_error(p->err, p->err_len, "ss: bison bellows (while parsing filter): \"syntax error!\"");
+}
+
+static int new_node(parser_t* p, const net_expr_t* e) {
+    if (p->f->n_nodes == NET_FILTER_MAX) return set_error(p->err, p->err_len, "ss: filter is too long");
+    p->f->nodes[p->f->n_nodes] = *e;
+    return p->f->n_nodes++;
+}
+
+static int parse_or(parser_t* p);
+
+// "10.0.0.0/8", "10.0.0.1:443", ":22", "*:ssh", "*"
+static int parse_host(parser_t* p, const char* text, net_expr_t* e) {
+    const char* colon = strrchr(text, ':');
+    size_t len = colon ? (size_t)(colon - text) : strlen(text);
+    char host[64];
+    uint8_t bits;
+
+    if (colon) {
+        if (parse_port(colon + 1, &e->port) != 0) {
+            return set_error(p->err, p->err_len, "Error: \"%s\" does not look like a port.", colon + 1);
+        }
+        e->has_port = 1;
+    }
+    if (len == 0 || (len == 1 && text[0] == '*')) return 0;
+    if (len >= sizeof(host)) return syntax_error(p);
+    memcpy(host, text, len);
+    host[len] = '\0';
+    if (parse_prefix(host, &e->addr, &bits) != 0) {
+        return set_error(p->err, p->err_len, "Error: an inet prefix is expected rather than \"%s\".", host);
+    }
+    e->mask = prefix_mask(bits);
+    e->addr &= e->mask;
+    return 0;
+}
+
+static int parse_term(parser_t* p) {
+    static const struct {
+        const char* word;
+        port_op_t op;
+    } ops[] = {
+        { "=", OP_EQ }, { "==", OP_EQ }, { "eq", OP_EQ }, { "!=", OP_NE }, { "ne", OP_NE }, { "neq", OP_NE },
+        { "<", OP_LT }, { "lt", OP_LT }, { ">", OP_GT }, { "gt", OP_GT }, { "<=", OP_LE }, { "le", OP_LE },
+        { "leq", OP_LE }, { ">=", OP_GE }, { "ge", OP_GE }, { "geq", OP_GE },
+    };
+    net_expr_t e;
+    const char* t = peek(p);
+    size_t i;
+    int negate = 0, node;
+
+    if (!t) return syntax_error(p);
+    memset(&e, 0, sizeof(e));
+    if (strcmp(t, "sport") == 0 || strcmp(t, "dport") == 0) {
+        e.kind = t[0] == 's' ? NET_EXPR_SPORT : NET_EXPR_DPORT;
+        p->pos++;
+        for (i = 0; peek(p) && i < sizeof(ops) / sizeof(ops[0]); i++) {
+            if (strcmp(peek(p), ops[i].word) == 0) {
+                e.op = (uint8_t)ops[i].op;
+                p->pos++;
+                break;
+            }
+        }
+        if (!peek(p)) return syntax_error(p);
+        if (parse_port(peek(p), &e.port) != 0) {
+            return set_error(p->err, p->err_len, "Error: \"%s\" does not look like a port.", peek(p));
+        }
+        p->pos++;
+        return new_node(p, &e);
+    }
+    if (strcmp(t, "src") == 0 || strcmp(t, "dst") == 0) {
+        e.kind = t[0] == 's' ? NET_EXPR_SRC : NET_EXPR_DST;
+        p->pos++;
+        if (is_word(p, "=", "==") || is_word(p, "eq", NULL)) {
+            p->pos++;
+        } else if (is_word(p, "!=", "ne") || is_word(p, "neq", NULL)) {
+            negate = 1;
+            p->pos++;
+        }
+        if (!peek(p)) return syntax_error(p);
+        if (parse_host(p, peek(p), &e) != 0) return -1;
+        p->pos++;
+        node = new_node(p, &e);
+        if (node < 0 || !negate) return node;
+        memset(&e, 0, sizeof(e));
+        e.kind = NET_EXPR_NOT;
+        e.left = (uint8_t)node;
+        return new_node(p, &e);
+    }
+    return syntax_error(p);
+}
+
+static int parse_unary(parser_t* p) {
+    net_expr_t e;
+    int node;
+
+    if (is_word(p, "not", "!")) {
+        p->pos++;
+        node = parse_unary(p);
+        if (node < 0) return -1;
+        memset(&e, 0, sizeof(e));
+        e.kind = NET_EXPR_NOT;
+        e.left = (uint8_t)node;
+        return new_node(p, &e);
+    }
+    if (is_word(p, "(", NULL)) {
+        p->pos++;
+        node = parse_or(p);
+        if (node < 0) return -1;
+        if (!is_word(p, ")", NULL)) return syntax_error(p);
+        p->pos++;
+        return node;
+    }
+    return parse_term(p);
+}
+
+// Terms side by side are and-ed, as with "and"
+static int parse_and(parser_t* p) {
+    int left = parse_unary(p);
+
+    while (left >= 0 && peek(p) && !is_word(p, "or", "||") && !is_word(p, ")", NULL)) {
+        net_expr_t e;
+        int right;
+
+        if (is_word(p, "and", "&&")) p->pos++;
+        right = parse_unary(p);
+        if (right < 0) return -1;
+        memset(&e, 0, sizeof(e));
+        e.kind = NET_EXPR_AND;
+        e.left = (uint8_t)left;
+        e.right = (uint8_t)right;
+        left = new_node(p, &e);
+    }
+    return left;
+}
+
+static int parse_or(parser_t* p) {
+    int left = parse_and(p);
+
+    while (left >= 0 && is_word(p, "or", "||")) {
+        net_expr_t e;
+        int right;
+
+        p->pos++;
+        right = parse_and(p);
+        if (right < 0) return -1;
+        memset(&e, 0, sizeof(e));
+        e.kind = NET_EXPR_OR;
+        e.left = (uint8_t)left;
+        e.right = (uint8_t)right;
+        left = new_node(p, &e);
+    }
+    return left;
+}
+
+static uint32_t scan_state(const char* name) {
+    size_t i;
+
+    for (i = 0; i < sizeof(state_names) / sizeof(state_names[0]); i++) {
+        if (strcmp(state_names[i].name, name) == 0) return state_names[i].states;
+    }
+    return 0;
+}
+
+int net_filter_parse(net_filter_t* f, int argc, char** argv, uint32_t default_states, char* err, size_t err_len) {
+    char buf[LINE_MAX_LEN * 2], *tok[MAX_TOKENS];
+    size_t used = 0;
+    int i = 0, n = 0, saw_states = 0;
+    parser_t p;
+
+    memset(f, 0, sizeof(*f));
+    f->states = default_states;
+    f->root = -1;
+    while (i + 1 < argc && (strcmp(argv[i], "state") == 0 || strcmp(argv[i], "exclude") == 0 ||
+                            strcmp(argv[i], "excl") == 0)) {
+        uint32_t states = scan_state(argv[i + 1]);
+
+        if (!states) return set_error(err, err_len, "ss: wrong state name: %s", argv[i + 1]);
+        if (argv[i][0] == 's') {
+            if (!saw_states) f->states = 0;
+            f->states |= states;
+        } else {
+            if (!saw_states) f->states = STATES_ALL;
+            f->states &= ~states;
+        }
+        saw_states = 1;
+        i += 2;
+    }
+
+    // The rest is one expression however the shell split it; parentheses
+    // are words of their own
+    for (; i < argc; i++) {
+        const char* s = argv[i];
+
+        while (*s) {
+            size_t len;
+
+            if (isspace((unsigned char)*s)) {
+                s++;
+                continue;
+            }
+            len = (*s == '(' || *s == ')') ? 1 : strcspn(s, " \t()");
+            if (n == MAX_TOKENS || used + len + 1 > sizeof(buf)) return set_error(err, err_len, "ss: filter is too long");
+            memcpy(buf + used, s, len);
+            buf[used + len] = '\0';
+            tok[n++] = buf + used;
+            used += len + 1;
+            s += len;
+        }
+    }
+    if (!n) return 0;
+    p = (parser_t){ tok, n, 0, f, err, err_len };
+    f->root = parse_or(&p);
+    if (f->root < 0) return -1;
+    if (p.pos != n) return syntax_error(&p);
+    return 0;
+}
+
+static int compare_port(uint16_t port, uint8_t op, uint16_t value) {
+    switch (op) {
+        case OP_NE: return port != value;
+        case OP_LT: return port < value;
+        case OP_GT: return port > value;
+        case OP_LE: return port <= value;
+        case OP_GE: return port >= value;
+        default: return port == value;
+    }
+}
+
+static int evaluate(const net_filter_t* f, int i, const net_socket_t* s) {
+    const net_expr_t* e = &f->nodes[i];
+
+    switch (e->kind) {
+        case NET_EXPR_AND: return evaluate(f, e->left, s) && evaluate(f, e->right, s);
+        case NET_EXPR_OR: return evaluate(f, e->left, s) || evaluate(f, e->right, s);
+        case NET_EXPR_NOT: return !evaluate(f, e->left, s);
+        case NET_EXPR_SPORT: return compare_port(s->lport, e->op, e->port);
+        case NET_EXPR_DPORT: return compare_port(s->rport, e->op, e->port);
+        case NET_EXPR_SRC: return (s->laddr & e->mask) == e->addr && (!e->has_port || s->lport == e->port);
+        default: return (s->raddr & e->mask) == e->addr && (!e->has_port || s->rport == e->port);
+    }
+}
+
+int net_filter_match(const net_filter_t* f, const net_socket_t* s) {
+    return (f->states >> s->state & 1) && (f->root < 0 || evaluate(f, f->root, s));
+}
+
+// ---------------------------------------------------------------------
+// The lesson machine
+
+#define IP(a, b, c, d) ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (uint32_t)(c) << 8 | (uint32_t)(d))
+#define HOST_ADDR IP(192, 168, 1, 100)
+#define GATEWAY IP(192, 168, 1, 1)
+
+// Sockets of the seeded processes. The owner is the first process whose
+// command line starts with cmd (and runs as uid, unless ANY_UID); a
+// lasting socket comes back whenever such a process runs, the others are
+// there only at first.
+#define ANY_UID UINT32_MAX
+
+static const struct {
+    const char* cmd;            // NULL: no owner
+    uint32_t uid;
+    uint8_t proto, state, lasting;
+    uint32_t laddr;
+    uint16_t lport;
+    uint32_t raddr;
+    uint16_t rport;
+    uint32_t recv_q, send_q, fd;
+} seed_sockets[] = {
+    { "/lib/systemd/systemd-resolved", ANY_UID, NET_UDP, NET_CLOSE, 1, IP(127, 0, 0, 54), 53, 0, 0, 0, 0, 15 },
+    { "/lib/systemd/systemd-resolved", ANY_UID, NET_UDP, NET_CLOSE, 1, IP(127, 0, 0, 53), 53, 0, 0, 0, 0, 13 },
+    { "/lib/systemd/systemd-timesyncd", ANY_UID, NET_UDP, NET_ESTABLISHED, 0, HOST_ADDR, 39571, IP(162, 159, 200, 123), 123, 0, 0, 11 },
+    { "/lib/systemd/systemd-resolved", ANY_UID, NET_TCP, NET_LISTEN, 1, IP(127, 0, 0, 53), 53, 0, 0, 0, 4096, 14 },
+    { "/usr/sbin/sshd", ANY_UID, NET_TCP, NET_LISTEN, 1, 0, 22, 0, 0, 0, 128, 3 },
+    { "/lib/systemd/systemd-resolved", ANY_UID, NET_TCP, NET_LISTEN, 1, IP(127, 0, 0, 54), 53, 0, 0, 0, 4096, 16 },
+    { "/usr/sbin/apache2", 0, NET_TCP, NET_LISTEN, 1, 0, 80, 0, 0, 0, 511, 4 },
+    { "sshd: admin@pts/0", ANY_UID, NET_TCP, NET_ESTABLISHED, 0, HOST_ADDR, 22, IP(192, 168, 1, 50), 52344, 0, 36, 4 },
+    { "/usr/sbin/apache2", 33, NET_TCP, NET_ESTABLISHED, 0, HOST_ADDR, 80, IP(192, 168, 1, 73), 51514, 0, 0, 11 },
+    { NULL, 0, NET_TCP, NET_TIME_WAIT, 0, HOST_ADDR, 80, IP(192, 168, 1, 64), 50412, 0, 0, 0 },
+    { NULL, 0, NET_TCP, NET_TIME_WAIT, 0, HOST_ADDR, 46810, IP(151, 101, 2, 132), 80, 0, 0, 0 },
+};
+
+static void seed_stack(net_stack_t* n) {
+    static const uint8_t mac[6] = { 0x08, 0x00, 0x27, 0x4e, 0x66, 0xa1 };
+    uint32_t lo, eth;
+
+    lo = net_add_interface(n, "lo", NET_IF_LOOPBACK | NET_IF_UP | NET_IF_RUNNING | NET_IF_LOWER_UP, 65536, NULL);
+    eth = net_add_interface(n, "enp0s3", NET_IF_BROADCAST | NET_IF_MULTICAST | NET_IF_UP | NET_IF_RUNNING | NET_IF_LOWER_UP,
+                            1500, mac);
+    n->ifs[lo].rx_packets = n->ifs[lo].tx_packets = 5420;
+    n->ifs[eth].rx_packets = 482133;
+    n->ifs[eth].tx_packets = 301877;
+    net_add_address(n, lo, IP(127, 0, 0, 1), 8, NET_SCOPE_HOST, 0);
+    net_add_address(n, eth, HOST_ADDR, 24, NET_SCOPE_GLOBAL, 1);
+
+    // systemd-networkd's DHCP routes, plus two static routes to the VPN's
+    // networks, one inside the other
+    net_route_add(n, &(net_route_t){ 0, 0, NET_PROTO_DHCP, NET_SCOPE_GLOBAL, 1, (uint16_t)eth, GATEWAY, HOST_ADDR, 1024, 0 }, 0);
+    net_route_add(n, &(net_route_t){ IP(10, 8, 0, 0), 16, NET_PROTO_BOOT, NET_SCOPE_GLOBAL, 1, (uint16_t)eth, IP(192, 168, 1, 254), 0, 0, 0 }, 0);
+    net_route_add(n, &(net_route_t){ IP(10, 8, 4, 0), 24, NET_PROTO_BOOT, NET_SCOPE_GLOBAL, 1, (uint16_t)eth, IP(192, 168, 1, 253), 0, 0, 0 }, 0);
+    net_route_add(n, &(net_route_t){ IP(192, 168, 1, 0), 24, NET_PROTO_KERNEL, NET_SCOPE_LINK, 1, (uint16_t)eth, 0, HOST_ADDR, 0, 0 }, 0);
+    net_route_add(n, &(net_route_t){ GATEWAY, 32, NET_PROTO_DHCP, NET_SCOPE_LINK, 1, (uint16_t)eth, 0, HOST_ADDR, 1024, 0 }, 0);
+}
+
+static int find_owner(const proc_table_t* pt, const char* cmd, uint32_t uid) {
+    size_t len = strlen(cmd);
+    uint32_t i;
+
+    for (i = 0; i < pt->count; i++) {
+        if ((uid == ANY_UID || pt->uid[i] == uid) && strncmp(proc_cmd(pt, (int)i), cmd, len) == 0) return (int)i;
+    }
+    return -1;
+}
+
+// Close what exited processes owned; open the lasting sockets of the
+// ones that run again
+static void sync_processes(net_stack_t* n, const proc_table_t* pt) {
+    int32_t dead[64];
+    uint32_t n_dead = 0, i;
+    size_t k;
+
+    for (i = 0; n->by_pid.slots && i <= n->by_pid.mask; i++) {
+        int32_t pid;
+
+        if (!n->by_pid.slots[i]) continue;
+        pid = n->sockets[n->by_pid.slots[i] - 1].pid;
+        if (proc_find(pt, pid) < 0 && n_dead < sizeof(dead) / sizeof(dead[0])) dead[n_dead++] = pid;
+    }
+    for (i = 0; i < n_dead; i++) net_close_pid(n, dead[i]);
+
+    for (k = 0; k < sizeof(seed_sockets) / sizeof(seed_sockets[0]); k++) {
+        net_socket_t s;
+        int owner = -1;
+
+        if (n->seeded && !seed_sockets[k].lasting) continue;
+        if (seed_sockets[k].cmd && (owner = find_owner(pt, seed_sockets[k].cmd, seed_sockets[k].uid)) < 0) continue;
+        memset(&s, 0, sizeof(s));
+        s.proto = seed_sockets[k].proto;
+        s.state = seed_sockets[k].state;
+        s.laddr = seed_sockets[k].laddr;
+        s.lport = seed_sockets[k].lport;
+        s.raddr = seed_sockets[k].raddr;
+        s.rport = seed_sockets[k].rport;
+        s.recv_q = seed_sockets[k].recv_q;
+        s.send_q = seed_sockets[k].send_q;
+        s.fd = seed_sockets[k].fd;
+        if (owner >= 0) {
+            s.pid = pt->pid[owner];
+            s.uid = pt->uid[owner];
+        }
+        net_socket_add(n, &s);
+    }
+    n->seeded = 1;
+}
+
+net_stack_t* net_session(void) {
+    sim_env_t* env = sim_env();
+
+    if (!env->net) {
+        env->net = net_new();
+        seed_stack(env->net);
+    }
+    sync_processes(env->net, proc_session());
+    return env->net;
+}
+
+// ---------------------------------------------------------------------
+// ip
+
+// ip's abbreviations: "a" for address, "r" for route
+static int matches(const char* arg, const char* word) {
+    size_t len = strlen(arg);
+
+    return len && len <= strlen(word) && strncmp(arg, word, len) == 0;
+}
+
+static void flag_list(const net_if_t* ifc, char* buf, size_t len) {
+    snprintf(buf, len, "<%s%s%s%s%s>", ifc->flags & NET_IF_LOOPBACK ? "LOOPBACK," : "",
+             ifc->flags & NET_IF_BROADCAST ? "BROADCAST," : "", ifc->flags & NET_IF_MULTICAST ? "MULTICAST," : "",
+             ifc->flags & NET_IF_UP ? "UP," : "", ifc->flags & NET_IF_LOWER_UP ? "LOWER_UP," : "");
+    len = strlen(buf);
+    if (len > 2 && buf[len - 2] == ',') memmove(buf + len - 2, ">", 2);
+}
+
+static const char* oper_state(const net_if_t* ifc) {
+    if (ifc->flags & NET_IF_LOOPBACK) return "UNKNOWN";
+    return (ifc->flags & NET_IF_LOWER_UP) ? "UP" : "DOWN";
+}
+
+static const char* scope_name(uint8_t scope) {
+    return scope == NET_SCOPE_HOST ? "host" : scope == NET_SCOPE_LINK ? "link" : "global";
+}
+
+static void print_link(const net_stack_t* n, uint32_t i, int brief, int addresses, time_t lease_left) {
+    const net_if_t* ifc = &n->ifs[i];
+    char flags[64], ip[16], mac[18];
+    uint32_t a;
+
+    snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x", ifc->mac[0], ifc->mac[1], ifc->mac[2], ifc->mac[3],
+             ifc->mac[4], ifc->mac[5]);
+    flag_list(ifc, flags, sizeof(flags));
+    if (brief) {
+        char line[LINE_MAX_LEN];
+        size_t len;
+
+        len = (size_t)snprintf(line, sizeof(line), "%-16s %-14s ", ifc->name, oper_state(ifc));
+        if (!addresses) {
+            snprintf(line + len, sizeof(line) - len, "%s %s", mac, flags);
+        } else {
+            for (a = 0; a < n->n_addrs && len < sizeof(line); a++) {
+                if (n->addrs[a].dev != i) continue;
+                len += (size_t)snprintf(line + len, sizeof(line) - len, "%s/%u ", format_ip(n->addrs[a].addr, ip),
+                                        n->addrs[a].len);
+            }
+            while (len && line[len - 1] == ' ') line[--len] = '\0';
+        }
+        con_printf("%s\n", line);
+        return;
+    }
+    con_printf("%u: %s: %s mtu %u qdisc %s state %s %sgroup default qlen 1000\n", i, ifc->name, flags, ifc->mtu, ifc->qdisc,
+               oper_state(ifc), addresses ? "" : "mode DEFAULT ");
+    if (ifc->flags & NET_IF_LOOPBACK) {
+        con_printf("    link/loopback %s brd 00:00:00:00:00:00\n", mac);
+    } else {
+        con_printf("    link/ether %s brd ff:ff:ff:ff:ff:ff\n", mac);
+    }
+    for (a = 0; addresses && a < n->n_addrs; a++) {
+        const net_addr_t* addr = &n->addrs[a];
+        char brd[16];
+
+        if (addr->dev != i) continue;
+        con_printf("    inet %s/%u ", format_ip(addr->addr, ip), addr->len);
+        if (addr->scope == NET_SCOPE_GLOBAL && addr->len < 31) {
+            con_printf("brd %s ", format_ip(addr->addr | ~prefix_mask(addr->len), brd));
+        }
+        con_printf("scope %s %s%s\n", scope_name(addr->scope), addr->dynamic ? "dynamic " : "", ifc->name);
+        if (addr->dynamic) {
+            con_printf("       valid_lft %ldsec preferred_lft %ldsec\n", (long)lease_left, (long)lease_left);
+        } else {
+            con_printf("       valid_lft forever preferred_lft forever\n");
+        }
+    }
+}
+
+// ip address / ip link [show [dev] NAME]
+static int ip_show_links(const net_stack_t* n, int argc, char** argv, int brief, int addresses) {
+    const proc_table_t* pt = proc_session();
+    time_t up = sim_env()->clock - pt->boot;
+    uint32_t only = 0, i;
+
+    if (argc > 0 && (matches(argv[0], "show") || matches(argv[0], "list") || strcmp(argv[0], "lst") == 0)) {
+        argc--;
+        argv++;
+    }
+    if (argc > 0 && strcmp(argv[0], "dev") == 0) {
+        argc--;
+        argv++;
+    }
+    if (argc > 1) return -1;
+    if (argc == 1) {
+        only = net_interface(n, argv[0]);
+        if (!only) {
+            con_printf("Device \"%s\" does not exist.\n", argv[0]);
+            return 1;
+        }
+    }
+    for (i = 1; i < n->n_ifs; i++) {
+        if (!only || i == only) print_link(n, i, brief, addresses, LEASE_SECONDS - up % (LEASE_SECONDS / 2));
+    }
+    return 0;
+}
+
+typedef struct {
+    const net_stack_t* n;
+    uint32_t dev;           // 0 for every device
+} route_list_t;
+
+static int print_route(void* ctx, const net_route_t* r) {
+    const route_list_t* list = ctx;
+    char line[LINE_MAX_LEN], ip[16];
+    size_t len = 0;
+
+    if (list->dev && r->dev != list->dev) return 0;
+    if (!r->len) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "default");
+    } else if (r->len == 32) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "%s", format_ip(r->dst, ip));
+    } else {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "%s/%u", format_ip(r->dst, ip), r->len);
+    }
+    if (r->gateway) len += (size_t)snprintf(line + len, sizeof(line) - len, " via %s", format_ip(r->gateway, ip));
+    len += (size_t)snprintf(line + len, sizeof(line) - len, " dev %s", list->n->ifs[r->dev].name);
+    if (r->proto == NET_PROTO_KERNEL || r->proto == NET_PROTO_DHCP || r->proto == NET_PROTO_STATIC) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " proto %s",
+                                r->proto == NET_PROTO_KERNEL ? "kernel" : r->proto == NET_PROTO_DHCP ? "dhcp" : "static");
+    }
+    if (r->scope != NET_SCOPE_GLOBAL) len += (size_t)snprintf(line + len, sizeof(line) - len, " scope %s", scope_name(r->scope));
+    if (r->src) len += (size_t)snprintf(line + len, sizeof(line) - len, " src %s", format_ip(r->src, ip));
+    if (r->metric) snprintf(line + len, sizeof(line) - len, " metric %u", r->metric);
+    con_printf("%s\n", line);
+    return con_stopped();
+}
+
+// The destination of a packet to addr if it is this machine's own
+static int local_address(const net_stack_t* n, uint32_t addr, uint32_t* src) {
+    uint32_t a;
+
+    for (a = 0; a < n->n_addrs; a++) {
+        const net_addr_t* own = &n->addrs[a];
+
+        if (!(n->ifs[own->dev].flags & NET_IF_UP)) continue;
+        if (own->addr == addr || (own->scope == NET_SCOPE_HOST && (addr & prefix_mask(own->len)) == (own->addr & prefix_mask(own->len)))) {
+            *src = own->scope == NET_SCOPE_HOST ? addr : own->addr;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int ip_route_get(const net_stack_t* n, int argc, char** argv) {
+    char ip[16], via[16], src[16];
+    uint32_t addr, r, local_src;
+
+    if (argc != 1) return -1;
+    if (parse_ipv4(argv[0], strlen(argv[0]), &addr) != 0) {
+        con_printf("Error: inet prefix is expected rather than \"%s\".\n", argv[0]);
+        return 1;
+    }
+    if (local_address(n, addr, &local_src)) {
+        con_printf("local %s dev lo src %s uid %u\n    cache <local>\n", format_ip(addr, ip), format_ip(local_src, src),
+                   sim_env()->euid);
+        return 0;
+    }
+    r = net_route_lookup(n, addr);
+    if (r == NET_NONE) {
+        con_printf("RTNETLINK answers: Network is unreachable\n");
+        return 2;
+    }
+    con_printf("%s", format_ip(addr, ip));
+    if (n->routes[r].gateway) con_printf(" via %s", format_ip(n->routes[r].gateway, via));
+    con_printf(" dev %s src %s uid %u\n    cache\n", n->ifs[n->routes[r].dev].name, format_ip(source_address(n, &n->routes[r]), src),
+               sim_env()->euid);
+    return 0;
+}
+
+// ip route add|replace|del PREFIX [via GW] [dev DEV] [metric N] [proto P] [src A] [scope S]
+static int ip_route_change(net_stack_t* n, const char* verb, int argc, char** argv) {
+    net_route_t r;
+    uint32_t full;
+    int i, err, del = matches(verb, "delete");
+
+    if (argc < 1) return -1;
+    memset(&r, 0, sizeof(r));
+    r.proto = NET_PROTO_BOOT;
+    if (parse_prefix(argv[0], &r.dst, &r.len) != 0) {
+        con_printf("Error: inet prefix is expected rather than \"%s\".\n", argv[0]);
+        return 1;
+    }
+    for (i = 1; i + 1 < argc; i += 2) {
+        const char* key = argv[i];
+        const char* value = argv[i + 1];
+        char* end;
+
+        if (strcmp(key, "via") == 0) {
+            if (parse_ipv4(value, strlen(value), &r.gateway) != 0) {
+                con_printf("Error: inet address is expected rather than \"%s\".\n", value);
+                return 1;
+            }
+        } else if (strcmp(key, "dev") == 0 || strcmp(key, "oif") == 0) {
+            r.dev = (uint16_t)net_interface(n, value);
+            if (!r.dev) {
+                con_printf("Cannot find device \"%s\"\n", value);
+                return 1;
+            }
+        } else if (strcmp(key, "metric") == 0 || strcmp(key, "priority") == 0 || strcmp(key, "preference") == 0) {
+            r.metric = (uint32_t)strtoul(value, &end, 10);
+            if (*end || end == value) {
+                con_printf("Error: argument \"%s\" is wrong: \"metric\" value is invalid\n\n", value);
+                return 1;
+            }
+        } else if (strcmp(key, "proto") == 0) {
+            r.proto = strcmp(value, "static") == 0 ? NET_PROTO_STATIC : strcmp(value, "kernel") == 0 ? NET_PROTO_KERNEL
+                    : strcmp(value, "dhcp") == 0 ? NET_PROTO_DHCP : NET_PROTO_BOOT;
+        } else if (strcmp(key, "src") == 0) {
+            if (parse_ipv4(value, strlen(value), &r.src) != 0) {
+                con_printf("Error: inet address is expected rather than \"%s\".\n", value);
+                return 1;
+            }
+        } else if (strcmp(key, "scope") != 0) {
+            return -1;
+        }
+    }
+    if (i < argc) return -1;
+    if (sim_env()->euid != 0) {
+        con_printf("RTNETLINK answers: Operation not permitted\n");
+        return 2;
+    }
+    if (del) {
+        if (net_route_del(n, r.dst, r.len, &r) != 0) {
+            con_printf("RTNETLINK answers: No such process\n");
+            return 2;
+        }
+        return 0;
+    }
+    full = r.dst;
+    if (full & ~prefix_mask(r.len)) {
+        con_printf("Error: Invalid prefix for given prefix length.\n");
+        return 2;
+    }
+    // A gateway has to be on a network this machine is directly on
+    if (r.gateway) {
+        uint32_t via = net_route_lookup(n, r.gateway);
+
+        if (via == NET_NONE || n->routes[via].gateway || (r.dev && n->routes[via].dev != r.dev)) {
+            con_printf("Error: Nexthop has invalid gateway.\n");
+            return 2;
+        }
+        r.dev = n->routes[via].dev;
+    } else {
+        r.scope = NET_SCOPE_LINK;
+    }
+    if (!r.dev) {
+        con_printf("RTNETLINK answers: No such device\n");
+        return 2;
+    }
+    if (!(n->ifs[r.dev].flags & NET_IF_UP)) {
+        con_printf("Error: Nexthop device is not up.\n");
+        return 2;
+    }
+    err = net_route_add(n, &r, matches(verb, "replace") || matches(verb, "change"));
+    if (err == -EEXIST) {
+        con_printf("RTNETLINK answers: File exists\n");
+        return 2;
+    }
+    return 0;
+}
+
+// ip link set [dev] NAME up|down. Taking a link down takes every route
+// through it with it; bringing it up again only restores the networks
+// its addresses are on.
+static int ip_link_set(net_stack_t* n, int argc, char** argv) {
+    uint32_t dev, i, n_gone = 0, *gone;
+    int up;
+
+    if (argc > 0 && strcmp(argv[0], "dev") == 0) {
+        argc--;
+        argv++;
+    }
+    if (argc != 2 || (strcmp(argv[1], "up") != 0 && strcmp(argv[1], "down") != 0)) return -1;
+    up = argv[1][0] == 'u';
+    dev = net_interface(n, argv[0]);
+    if (!dev) {
+        con_printf("Cannot find device \"%s\"\n", argv[0]);
+        return 1;
+    }
+    if (sim_env()->euid != 0) {
+        con_printf("RTNETLINK answers: Operation not permitted\n");
+        return 2;
+    }
+    if (up == !!(n->ifs[dev].flags & NET_IF_UP)) return 0;
+    if (!up) {
+        n->ifs[dev].flags &= ~(uint32_t)(NET_IF_UP | NET_IF_RUNNING | NET_IF_LOWER_UP);
+        gone = xrealloc(NULL, (n->n_routes ? n->n_routes : 1) * sizeof(uint32_t));
+        for (i = 0; i < n->n_routes; i++) {
+            if (n->routes[i].live && n->routes[i].dev == dev) gone[n_gone++] = i;
+        }
+        for (i = 0; i < n_gone; i++) {
+            net_route_t match = n->routes[gone[i]];
+
+            net_route_del(n, match.dst, match.len, &match);
+        }
+        free(gone);
+        return 0;
+    }
+    n->ifs[dev].flags |= NET_IF_UP | NET_IF_RUNNING | NET_IF_LOWER_UP;
+    for (i = 0; i < n->n_addrs; i++) {
+        const net_addr_t* a = &n->addrs[i];
+
+        if (a->dev != dev || a->scope == NET_SCOPE_HOST) continue;
+        net_route_add(n, &(net_route_t){ a->addr & prefix_mask(a->len), a->len, NET_PROTO_KERNEL, NET_SCOPE_LINK, 1, (uint16_t)dev,
+                                         0, a->addr, 0, 0 }, 0);
+    }
+    return 0;
+}
+
+int net_cmd_ip(int argc, char** argv) {
+    net_stack_t* n;
+    const char* object;
+    int i = 1, brief = 0;
+
+    // Options before the object: -4, -br, -c
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-br") == 0 || strcmp(argv[i], "-brief") == 0) {
+            brief = 1;
+        } else if (strcmp(argv[i], "-4") != 0 && strcmp(argv[i], "-c") != 0 && strcmp(argv[i], "-color") != 0) {
+            return -1;
+        }
+    }
+    if (i == argc) {
+        con_printf("Usage: ip [ OPTIONS ] OBJECT { COMMAND | help }\n"
+                   "where  OBJECT := { address | link | route | ... }\n");
+        return 255;
+    }
+    object = argv[i++];
+    n = net_session();
+    if (matches(object, "address")) return ip_show_links(n, argc - i, argv + i, brief, 1);
+    if (matches(object, "link")) {
+        if (i < argc && strcmp(argv[i], "set") == 0) return ip_link_set(n, argc - i - 1, argv + i + 1);
+        return ip_show_links(n, argc - i, argv + i, brief, 0);
+    }
+    if (matches(object, "route")) {
+        route_list_t list = { n, 0 };
+
+        if (i < argc && matches(argv[i], "get")) return ip_route_get(n, argc - i - 1, argv + i + 1);
+        if (i < argc && (matches(argv[i], "add") || matches(argv[i], "delete") || matches(argv[i], "replace") ||
+                         matches(argv[i], "change"))) {
+            return ip_route_change(n, argv[i], argc - i - 1, argv + i + 1);
+        }
+        if (i < argc && (matches(argv[i], "show") || matches(argv[i], "list"))) i++;
+        if (i + 2 == argc && strcmp(argv[i], "dev") == 0) {
+            list.dev = net_interface(n, argv[i + 1]);
+            if (!list.dev) {
+                con_printf("Cannot find device \"%s\"\n", argv[i + 1]);
+                return 1;
+            }
+        } else if (i != argc) {
+            return -1;
+        }
+        net_route_walk(n, print_route, &list);
+        return 0;
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------------------
+// ss
+
+static const char* const ss_states[NET_STATES] = {
+    "", "ESTAB", "SYN-SENT", "SYN-RECV", "FIN-WAIT-1", "FIN-WAIT-2", "TIME-WAIT", "UNCONN", "CLOSE-WAIT", "LAST-ACK",
+    "LISTEN", "CLOSING",
+};
+
+static const char* const netstat_states[NET_STATES] = {
+    "", "ESTABLISHED", "SYN_SENT", "SYN_RECV", "FIN_WAIT1", "FIN_WAIT2", "TIME_WAIT", "CLOSE", "CLOSE_WAIT", "LAST_ACK",
+    "LISTEN", "CLOSING",
+};
+
+typedef struct {
+    const net_stack_t* n;
+    const proc_table_t* pt;
+    const net_filter_t* filter;
+    uint32_t euid;
+    int numeric, processes, show_netid, show_state;
+    int hidden;             // a process was not shown: not the user's
+    long lines, limit;
+} listing_t;
+
+// Print a line with its trailing blanks cut, counting it against a
+// pipeline's limit; nonzero once no more lines are wanted
+static int emit(listing_t* l, char* line, size_t len) {
+    while (len && line[len - 1] == ' ') len--;
+    line[len++] = '\n';
+    con_write(line, len);
+    l->lines++;
+    return (l->limit >= 0 && l->lines >= l->limit) || con_stopped();
+}
+
+// Process of a socket, if the user may see it
+static int socket_owner(listing_t* l, const net_socket_t* s) {
+    int i;
+
+    if (s->pid <= 0) return -1;
+    if (l->euid != 0 && s->uid != l->euid) {
+        l->hidden = 1;
+        return -1;
+    }
+    i = proc_find(l->pt, s->pid);
+    return i;
+}
+
+static void ss_endpoint(uint32_t addr, uint16_t port, int numeric, int wildcard, char* addr_buf, char* port_buf) {
+    format_ip(addr, addr_buf);
+    if (wildcard && !port) {
+        strcpy(port_buf, "*");
+    } else {
+        char num[8];
+
+        snprintf(port_buf, SS_PORT_WIDTH * 2, "%s", port_string(port, numeric, num));
+    }
+}
+
+static int ss_row(listing_t* l, const net_socket_t* s) {
+    char line[LINE_MAX_LEN], laddr[16], lport[SS_PORT_WIDTH * 2], raddr[16], rport[SS_PORT_WIDTH * 2];
+    size_t len = 0;
+    int owner;
+
+    ss_endpoint(s->laddr, s->lport, l->numeric, 0, laddr, lport);
+    ss_endpoint(s->raddr, s->rport, l->numeric, 1, raddr, rport);
+    if (l->show_netid) len += (size_t)snprintf(line + len, sizeof(line) - len, "%-6s", s->proto == NET_TCP ? "tcp" : "udp");
+    if (l->show_state) len += (size_t)snprintf(line + len, sizeof(line) - len, "%-11s", ss_states[s->state]);
+    len += (size_t)snprintf(line + len, sizeof(line) - len, "%-7u%-7u%*s:%-*s%*s:%-*s", s->recv_q, s->send_q, SS_ADDR_WIDTH,
+                            laddr, SS_PORT_WIDTH, lport, SS_ADDR_WIDTH, raddr, SS_PORT_WIDTH, rport);
+    if (l->processes && (owner = socket_owner(l, s)) >= 0) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "users:((\"%s\",pid=%d,fd=%u))", proc_comm(l->pt, owner),
+                                s->pid, s->fd);
+    }
+    if (len >= sizeof(line)) len = sizeof(line) - 1;
+    return emit(l, line, len);
+}
+
+typedef int (*row_fn)(listing_t* l, const net_socket_t* s);
+
+// The kernel's dump order: UDP, then TCP's listening sockets, then the
+// rest of TCP (netstat: TCP first)
+static void list_sockets(listing_t* l, const uint8_t* protos, int n_protos, row_fn row) {
+    const net_stack_t* n = l->n;
+    int p, pass;
+    uint32_t i;
+
+    for (p = 0; p < n_protos; p++) {
+        for (pass = 0; pass < (protos[p] == NET_TCP ? 2 : 1); pass++) {
+            for (i = 0; i < n->n_sockets; i++) {
+                const net_socket_t* s = &n->sockets[i];
+
+                if (s->state == NET_FREE || s->proto != protos[p]) continue;
+                if (protos[p] == NET_TCP && (s->state == NET_LISTEN) != (pass == 0)) continue;
+                if (!net_filter_match(l->filter, s)) continue;
+                if (row(l, s)) return;
+            }
+        }
+    }
+}
+
+int net_cmd_ss(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    uint8_t protos[2];
+    int n_protos = 0, single_state;
+    uint32_t states = STATES_DEFAULT;
+    char err[256], line[LINE_MAX_LEN];
+    net_filter_t filter;
+    listing_t l;
+    sim_opts_t o;
+    size_t len = 0;
+
+    if (sim_getopt(argc, argv, "tualnp4H", &o) < 0) return 1;
+    if (o.n_longs) return -1;
+    if (SIM_HAS(&o, 'a')) {
+        states = STATES_ALL;
+    } else if (SIM_HAS(&o, 'l')) {
+        states = STATE(NET_LISTEN) | STATE(NET_CLOSE);
+    }
+    if (net_filter_parse(&filter, o.n_operands, argv + 1, states, err, sizeof(err)) != 0) {
+        con_printf("%s\n", err);
+        return 1;
+    }
+    if (SIM_HAS(&o, 'u') || !SIM_HAS(&o, 't')) protos[n_protos++] = NET_UDP;
+    if (SIM_HAS(&o, 't') || !SIM_HAS(&o, 'u')) protos[n_protos++] = NET_TCP;
+
+    memset(&l, 0, sizeof(l));
+    l.n = net_session();
+    l.pt = proc_session();
+    l.filter = &filter;
+    l.euid = env->euid;
+    l.numeric = SIM_HAS(&o, 'n');
+    l.processes = SIM_HAS(&o, 'p');
+    l.show_netid = n_protos > 1;
+    // One state asked for: no column for it
+    single_state = filter.states && !(filter.states & (filter.states - 1));
+    l.show_state = !single_state;
+    l.limit = sim_line_limit();
+    if (!SIM_HAS(&o, 'H')) {
+        if (l.show_netid) len += (size_t)snprintf(line + len, sizeof(line) - len, "%-6s", "Netid");
+        if (l.show_state) len += (size_t)snprintf(line + len, sizeof(line) - len, "%-11s", "State");
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "%-7s%-7s%*s:%-*s%*s:%-*s%s", "Recv-Q", "Send-Q", SS_ADDR_WIDTH,
+                                "Local Address", SS_PORT_WIDTH, "Port", SS_ADDR_WIDTH, "Peer Address", SS_PORT_WIDTH, "Port",
+                                l.processes ? "Process" : "");
+        if (emit(&l, line, len)) return 0;
+    }
+    list_sockets(&l, protos, n_protos, ss_row);
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// netstat
+
+// What netstat's reverse lookups find for the lesson machine's addresses
+static const char* host_name(const net_stack_t* n, uint32_t addr, char* buf) {
+    uint32_t r;
+
+    if (addr == IP(127, 0, 0, 1)) return "localhost";
+    if (addr == IP(127, 0, 0, 53)) return "_localdnsstub";
+    if (addr == IP(127, 0, 0, 54)) return "_localdnsproxy";
+    if (addr == HOST_ADDR) return "debian-server";
+    r = net_route_lookup(n, 0);
+    if (addr && r != NET_NONE && n->routes[r].len == 0 && n->routes[r].gateway == addr) return "_gateway";
+    return format_ip(addr, buf);
+}
+
+static void netstat_endpoint(const listing_t* l, uint32_t addr, uint16_t port, int wildcard, char* out) {
+    char ip[16], num[8];
+    const char* host = l->numeric ? format_ip(addr, ip) : host_name(l->n, addr, ip);
+    const char* service = wildcard && !port ? "*" : port_string(port, l->numeric, num);
+    int room = NETSTAT_ADDR_WIDTH - (int)strlen(service) - 1;
+
+    // Long names are cut to keep the column, as netstat does without -W
+    snprintf(out, NETSTAT_ADDR_WIDTH + 1, "%.*s:%s", room > 0 ? room : 0, host, service);
+}
+
+static int netstat_row(listing_t* l, const net_socket_t* s) {
+    char line[LINE_MAX_LEN], local[NETSTAT_ADDR_WIDTH + 1], foreign[NETSTAT_ADDR_WIDTH + 1];
+    size_t len;
+    int owner;
+
+    netstat_endpoint(l, s->laddr, s->lport, 0, local);
+    netstat_endpoint(l, s->raddr, s->rport, 1, foreign);
+    len = (size_t)snprintf(line, sizeof(line), "%-5s %6u %6u %-23s %-23s %-11s", s->proto == NET_TCP ? "tcp" : "udp", s->recv_q,
+                           s->proto == NET_TCP && s->state == NET_LISTEN ? 0 : s->send_q, local, foreign,
+                           s->proto == NET_UDP && s->state == NET_CLOSE ? "" : netstat_states[s->state]);
+    if (l->processes) {
+        owner = socket_owner(l, s);
+        if (owner >= 0) {
+            len += (size_t)snprintf(line + len, sizeof(line) - len, " %d/%s", s->pid, proc_comm(l->pt, owner));
+        } else {
+            len += (size_t)snprintf(line + len, sizeof(line) - len, " -");
+        }
+    }
+    if (len >= sizeof(line)) len = sizeof(line) - 1;
+    return emit(l, line, len);
+}
+
+typedef struct {
+    listing_t* l;
+    int stop;
+} route_table_t;
+
+static int netstat_route(void* ctx, const net_route_t* r) {
+    route_table_t* t = ctx;
+    const listing_t* l = t->l;
+    char line[LINE_MAX_LEN], dst[16], gw[16], mask[16], flags[8];
+    const char* dst_name = !r->len && !l->numeric ? "default" : format_ip(r->dst, dst);
+    const char* gw_name = r->gateway ? (l->numeric ? format_ip(r->gateway, gw) : host_name(l->n, r->gateway, gw)) : "0.0.0.0";
+    size_t len;
+
+    snprintf(flags, sizeof(flags), "U%s%s", r->gateway ? "G" : "", r->len == 32 ? "H" : "");
+    len = (size_t)snprintf(line, sizeof(line), "%-15s %-15s %-15s %-5s %5u %-6u %5u %s", dst_name, gw_name,
+                           format_ip(prefix_mask(r->len), mask), flags, 0u, 0u, 0u, l->n->ifs[r->dev].name);
+    t->stop = emit(t->l, line, len);
+    return t->stop;
+}
+
+int net_cmd_netstat(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    uint8_t protos[2];
+    int n_protos = 0;
+    char line[LINE_MAX_LEN];
+    net_filter_t filter;
+    listing_t l;
+    sim_opts_t o;
+    size_t len;
+    uint32_t i;
+
+    if (sim_getopt(argc, argv, "tualnpriW", &o) < 0) return 1;
+    if (o.n_longs || o.n_operands) return -1;
+    memset(&l, 0, sizeof(l));
+    l.n = net_session();
+    l.pt = proc_session();
+    l.euid = env->euid;
+    l.numeric = SIM_HAS(&o, 'n');
+    l.processes = SIM_HAS(&o, 'p');
+    l.limit = sim_line_limit();
+
+    if (SIM_HAS(&o, 'r')) {
+        route_table_t t = { &l, 0 };
+
+        len = (size_t)snprintf(line, sizeof(line), "Kernel IP routing table");
+        if (emit(&l, line, len)) return 0;
+        len = (size_t)snprintf(line, sizeof(line), "%-15s %-15s %-15s %-5s %5s %-6s %5s %s", "Destination", "Gateway", "Genmask",
+                               "Flags", "MSS", "Window", "irtt", "Iface");
+        if (emit(&l, line, len)) return 0;
+        net_route_walk(l.n, netstat_route, &t);
+        return 0;
+    }
+    if (SIM_HAS(&o, 'i')) {
+        len = (size_t)snprintf(line, sizeof(line), "Kernel Interface table");
+        if (emit(&l, line, len)) return 0;
+        len = (size_t)snprintf(line, sizeof(line), "%-10s %5s %8s %6s %6s %-6s %8s %6s %6s %6s %s", "Iface", "MTU", "RX-OK", "RX-ERR",
+                               "RX-DRP", "RX-OVR", "TX-OK", "TX-ERR", "TX-DRP", "TX-OVR", "Flg");
+        if (emit(&l, line, len)) return 0;
+        for (i = 1; i < l.n->n_ifs; i++) {
+            const net_if_t* ifc = &l.n->ifs[i];
+            char flags[8];
+
+            snprintf(flags, sizeof(flags), "%s%s%s%s%s", ifc->flags & NET_IF_BROADCAST ? "B" : "",
+                     ifc->flags & NET_IF_LOOPBACK ? "L" : "", ifc->flags & NET_IF_MULTICAST ? "M" : "",
+                     ifc->flags & NET_IF_RUNNING ? "R" : "", ifc->flags & NET_IF_UP ? "U" : "");
+            len = (size_t)snprintf(line, sizeof(line), "%-10s %5u %8llu %6u %6u %-6u %8llu %6u %6u %6u %s", ifc->name, ifc->mtu,
+                                   (unsigned long long)ifc->rx_packets, 0u, 0u, 0u, (unsigned long long)ifc->tx_packets, 0u, 0u,
+                                   0u, flags);
+            if (emit(&l, line, len)) return 0;
+        }
+        return 0;
+    }
+
+    memset(&filter, 0, sizeof(filter));
+    filter.root = -1;
+    if (SIM_HAS(&o, 'a')) {
+        filter.states = STATES_ALL;
+        strcpy(line, "Active Internet connections (servers and established)");
+    } else if (SIM_HAS(&o, 'l')) {
+        filter.states = STATE(NET_LISTEN) | STATE(NET_CLOSE);
+        strcpy(line, "Active Internet connections (only servers)");
+    } else {
+        filter.states = STATES_CONNECTED;
+        strcpy(line, "Active Internet connections (w/o servers)");
+    }
+    l.filter = &filter;
+    if (SIM_HAS(&o, 't') || !SIM_HAS(&o, 'u')) protos[n_protos++] = NET_TCP;
+    if (SIM_HAS(&o, 'u') || !SIM_HAS(&o, 't')) protos[n_protos++] = NET_UDP;
+
+    // Not root: say so before the table, as netstat does
+    if (l.processes && env->euid != 0) {
+        for (i = 0; i < l.n->n_sockets; i++) {
+            const net_socket_t* s = &l.n->sockets[i];
+
+            if (s->state != NET_FREE && s->pid > 0 && s->uid != env->euid && net_filter_match(&filter, s)) break;
+        }
+        if (i < l.n->n_sockets) {
+            con_printf("(Not all processes could be identified, non-owned process info\n"
+                       " will not be shown, you would have to be root to see it all.)\n");
+        }
+    }
+    if (emit(&l, line, strlen(line))) return 0;
+    len = (size_t)snprintf(line, sizeof(line), "%-5s %6s %6s %-23s %-23s %-11s%s", "Proto", "Recv-Q", "Send-Q", "Local Address",
+                           "Foreign Address", "State", l.processes ? " PID/Program name" : "");
+    if (emit(&l, line, len)) return 0;
+    list_sockets(&l, protos, n_protos, netstat_row);
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+static uint64_t bench_rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t bench_address(void) {
+    return bench_random(&bench_rng, 0xffff) << 16 | bench_random(&bench_rng, 0x10000);
+}
+
+// The route a linear scan picks: longest prefix, then lowest metric
+static uint32_t scan_routes(const net_stack_t* n, uint32_t addr) {
+    uint32_t best = NET_NONE, i;
+
+    for (i = 0; i < n->n_routes; i++) {
+        const net_route_t* r = &n->routes[i];
+
+        if (!r->live || (addr & prefix_mask(r->len)) != r->dst) continue;
+        if (best == NET_NONE || r->len > n->routes[best].len || (r->len == n->routes[best].len && r->metric < n->routes[best].metric)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static int count_route(void* ctx, const net_route_t* r) {
+    (void)r;
+    (*(uint32_t*)ctx)++;
+    return 0;
+}
+
+static int bench_routes(uint32_t n_routes) {
+    net_stack_t* n = net_new();
+    uint32_t* probes, lookups = 4000000, i, found = 0, walked = 0, failed = 0, dev;
+    double start, elapsed;
+    int rc = 0;
+
+    dev = net_add_interface(n, "eth0", NET_IF_UP | NET_IF_LOWER_UP, 1500, NULL);
+    start = bench_now();
+    for (i = 0; i < n_routes; i++) {
+        uint32_t pick = bench_random(&bench_rng, 100);
+        uint8_t len = (uint8_t)(pick < 60 ? 24 : pick < 75 ? 16 + bench_random(&bench_rng, 8) : pick < 90 ? 25 + bench_random(&bench_rng, 8) : 8 + bench_random(&bench_rng, 8));
+        net_route_t r = { bench_address() & prefix_mask(len), len, NET_PROTO_BOOT, NET_SCOPE_GLOBAL, 1, (uint16_t)dev,
+                          bench_address(), 0, bench_random(&bench_rng, 4) * 100, 0 };
+
+        net_route_add(n, &r, 0);
+    }
+    elapsed = bench_now() - start;
+    bench_report("net", "routes", n->live_routes, "routes");
+    bench_report("net", "trie_nodes", n->n_nodes, "nodes");
+    bench_report("net", "route_insert", elapsed / n_routes * 1e9, "ns");
+
+    // Half the addresses inside some route's prefix, half anywhere
+    probes = xrealloc(NULL, lookups * sizeof(uint32_t));
+    for (i = 0; i < lookups; i++) {
+        const net_route_t* r = &n->routes[bench_random(&bench_rng, n->n_routes)];
+
+        probes[i] = i & 1 ? bench_address() : r->dst | (bench_address() & ~prefix_mask(r->len));
+    }
+    start = bench_now();
+    for (i = 0; i < lookups; i++) found += net_route_lookup(n, probes[i]) != NET_NONE;
+    elapsed = bench_now() - start;
+    bench_report("net", "route_lookup", lookups / elapsed / 1e6, "M/s");
+    bench_report("net", "route_hit", found * 100.0 / lookups, "%");
+
+    start = bench_now();
+    net_route_walk(n, count_route, &walked);
+    bench_report("net", "route_walk", (bench_now() - start) * 1e3, "ms");
+    if (walked != n->live_routes) {
+        fprintf(stderr, "net: walked %u routes of %u\n", walked, n->live_routes);
+        rc = 1;
+    }
+
+    // A tenth of the routes go, then the trie must still agree with a scan
+    start = bench_now();
+    for (i = 0; i < n->n_routes; i += 10) {
+        net_route_t match = n->routes[i];
+
+        if (match.live) net_route_del(n, match.dst, match.len, &match);
+    }
+    bench_report("net", "route_delete", (bench_now() - start) * 1e3, "ms");
+    for (i = 0; i < 2000; i++) {
+        uint32_t addr = probes[bench_random(&bench_rng, lookups)], trie = net_route_lookup(n, addr), scan = scan_routes(n, addr);
+
+        if (trie != scan && (trie == NET_NONE || scan == NET_NONE || n->routes[trie].len != n->routes[scan].len ||
+                             n->routes[trie].metric != n->routes[scan].metric)) {
+            failed++;
+        }
+    }
+    if (failed) {
+        fprintf(stderr, "net: %u of 2000 lookups disagree with a linear scan\n", failed);
+        rc = 1;
+    }
+    free(probes);
+    net_free(n);
+    return rc;
+}
+
+static int bench_sockets(uint32_t n_sockets) {
+    static char* words[] = { "state", "established", "( sport = :https or sport = :http )", "and", "dst", "10.128.0.0/9" };
+    net_stack_t* n = net_new();
+    uint32_t* added = xrealloc(NULL, n_sockets * sizeof(uint32_t));
+    uint32_t lookups = 2000000, n_added = 0, i, found = 0, matched = 0, closed = 0, pids = 5000;
+    char err[256];
+    net_filter_t filter;
+    double start, elapsed;
+    int rc = 0;
+
+    start = bench_now();
+    for (i = 0; i < n_sockets; i++) {
+        static const uint16_t ports[] = { 22, 80, 443, 5432 };
+        uint32_t pick = bench_random(&bench_rng, 100);
+        net_socket_t s;
+
+        memset(&s, 0, sizeof(s));
+        s.proto = NET_TCP;
+        s.state = pick < 85 ? NET_ESTABLISHED : pick < 93 ? NET_TIME_WAIT : pick < 97 ? NET_CLOSE_WAIT : NET_SYN_RECV;
+        s.laddr = IP(10, 0, 0, 1);
+        s.lport = ports[bench_random(&bench_rng, 4)];
+        s.raddr = IP(10, 0, 0, 0) | bench_random(&bench_rng, 1u << 24);
+        s.rport = (uint16_t)(1024 + bench_random(&bench_rng, 64512));
+        s.pid = s.state == NET_TIME_WAIT ? 0 : (int32_t)(1000 + bench_random(&bench_rng, pids));
+        s.fd = 3 + i % 1000;
+        if (net_socket_add(n, &s) != NET_NONE) added[n_added++] = i;
+    }
+    elapsed = bench_now() - start;
+    bench_report("net", "sockets", n->live_sockets, "sockets");
+    bench_report("net", "socket_insert", elapsed / n_sockets * 1e9, "ns");
+
+    start = bench_now();
+    for (i = 0; i < lookups; i++) {
+        const net_socket_t* s = &n->sockets[bench_random(&bench_rng, n->n_sockets)];
+
+        found += net_socket_find(n, s->proto, s->laddr, s->lport, s->raddr, i & 1 ? s->rport : (uint16_t)(s->rport ^ 1)) != NET_NONE;
+    }
+    elapsed = bench_now() - start;
+    bench_report("net", "socket_lookup", elapsed / lookups * 1e9, "ns");
+
+    if (net_filter_parse(&filter, 6, words, STATES_DEFAULT, err, sizeof(err)) != 0) {
+        fprintf(stderr, "net: %s\n", err);
+        free(added);
+        net_free(n);
+        return 1;
+    }
+    start = bench_now();
+    for (i = 0; i < n->n_sockets; i++) matched += n->sockets[i].state != NET_FREE && net_filter_match(&filter, &n->sockets[i]);
+    elapsed = bench_now() - start;
+    bench_report("net", "filter", n->n_sockets / elapsed / 1e6, "M sockets/s");
+    bench_report("net", "filter_matched", matched * 100.0 / n->live_sockets, "%");
+
+    // A tenth of the processes exit
+    start = bench_now();
+    for (i = 0; i < pids / 10; i++) closed += net_close_pid(n, (int32_t)(1000 + i * 10));
+    elapsed = bench_now() - start;
+    bench_report("net", "close_pid", closed ? elapsed / closed * 1e9 : 0, "ns/socket");
+
+    // Both indexes still find exactly the live sockets
+    if (n->by_tuple.count != n->live_sockets) {
+        fprintf(stderr, "net: %u sockets indexed, %u live\n", n->by_tuple.count, n->live_sockets);
+        rc = 1;
+    }
+    for (i = 0; i < n->n_sockets && !rc; i++) {
+        const net_socket_t* s = &n->sockets[i];
+        uint32_t at;
+
+        if (s->state == NET_FREE) continue;
+        at = net_socket_find(n, s->proto, s->laddr, s->lport, s->raddr, s->rport);
+        if (at != i || (s->pid > 0 && (s->pid - 1000) % 10 == 0 && s->pid < 1000 + (int32_t)pids)) {
+            fprintf(stderr, "net: socket %u is lost or outlived its process\n", i);
+            rc = 1;
+        }
+    }
+    free(added);
+    net_free(n);
+    return rc;
+}
+
+int net_bench(int argc, char** argv) {
+    long n_sockets = argc > 0 ? atol(argv[0]) : 1000000;
+    long n_routes = argc > 1 ? atol(argv[1]) : 100000;
+    int rc;
+
+    if (n_sockets < 1000) n_sockets = 1000;
+    if (n_routes < 100) n_routes = 100;
+    rc = bench_routes((uint32_t)n_routes);
+    rc |= bench_sockets((uint32_t)n_sockets);
+    return rc;
+}
@@ -0,0 +1,220 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Network stack tables for simulation mode: what ip, ss and netstat read
+// from the kernel. Only IPv4 is modelled.
+//
+// Routes live in a binary trie on the destination's bits, a node per bit
+// of prefix. A node that ends a prefix points at that prefix's routes,
+// chained lowest metric first, so a lookup walks at most 32 nodes and
+// keeps the last route it passed: the longest matching prefix. Walking
+// the trie in order lists the routes the way ip route does, default
+// first, then by address and length. Nodes of a deleted prefix stay,
+// empty, for the next route with that prefix.
+//
+// Sockets are an array with a free list, indexed twice: by 4-tuple
+// (protocol, local and peer address and port) in an open-addressing hash
+// with backward-shift deletion, and by owning pid, a hash of pids to the
+// head of a doubly linked chain of that process's sockets, so a process
+// that goes away closes what it owned in time proportional to that.
+// ss's filter expressions are compiled once into a small tree that is
+// evaluated per socket.
+//
+// A session's stack starts as the lesson machine's: lo and enp0s3, a DHCP
+// default route, and the sockets of sshd, systemd-resolved and apache2
+// tied to their processes (proc.h). Stopping a service closes its
+// sockets; when it runs again it listens again.
+
+#define NET_NONE UINT32_MAX
+
+enum {
+    NET_TCP = 6,
+    NET_UDP = 17
+};
+
+// TCP states, numbered as the kernel's. UDP sockets are NET_CLOSE
+// ("UNCONN"), or NET_ESTABLISHED once connected.
+typedef enum {
+    NET_FREE = 0,           // an unused socket slot
+    NET_ESTABLISHED,
+    NET_SYN_SENT,
+    NET_SYN_RECV,
+    NET_FIN_WAIT1,
+    NET_FIN_WAIT2,
+    NET_TIME_WAIT,
+    NET_CLOSE,
+    NET_CLOSE_WAIT,
+    NET_LAST_ACK,
+    NET_LISTEN,
+    NET_CLOSING,
+    NET_STATES
+} net_state_t;
+
+// Interface flags, as in <net/if.h>
+#define NET_IF_UP 0x1
+#define NET_IF_BROADCAST 0x2
+#define NET_IF_LOOPBACK 0x8
+#define NET_IF_RUNNING 0x40
+#define NET_IF_MULTICAST 0x1000
+#define NET_IF_LOWER_UP 0x10000
+
+typedef struct {
+    char name[16];
+    uint32_t flags;
+    uint32_t mtu;
+    uint8_t mac[6];
+    const char* qdisc;
+    uint64_t rx_packets, tx_packets;
+} net_if_t;
+
+typedef enum {
+    NET_SCOPE_GLOBAL = 0,
+    NET_SCOPE_LINK = 253,
+    NET_SCOPE_HOST = 254
+} net_scope_t;
+
+typedef struct {
+    uint32_t addr;          // host byte order, as everything here
+    uint8_t len;
+    uint8_t scope;
+    uint8_t dynamic;        // leased by DHCP
+    uint16_t dev;           // interface index
+} net_addr_t;
+
+typedef enum {
+    NET_PROTO_BOOT = 3,     // ip route add's default; not shown
+    NET_PROTO_KERNEL = 2,
+    NET_PROTO_STATIC = 4,
+    NET_PROTO_DHCP = 16
+} net_proto_t;
+
+typedef struct {
+    uint32_t dst;
+    uint8_t len;
+    uint8_t proto;
+    uint8_t scope;
+    uint8_t live;
+    uint16_t dev;
+    uint32_t gateway;       // 0: directly connected
+    uint32_t src;           // preferred source, 0 for none
+    uint32_t metric;
+    uint32_t next;          // the prefix's next route, or the next free one
+} net_route_t;
+
+typedef struct {
+    uint32_t child[2];      // 0 for none: the root is no one's child
+    uint32_t route;         // first route of this prefix, NET_NONE
+} net_node_t;
+
+typedef struct {
+    uint32_t laddr, raddr;
+    uint16_t lport, rport;
+    uint8_t proto;
+    uint8_t state;          // net_state_t
+    uint32_t recv_q, send_q;
+    int32_t pid;            // 0: no process (TIME-WAIT)
+    uint32_t fd, uid, inode;
+    uint32_t prev_of_pid, next_of_pid;  // NET_NONE at the ends; next free
+} net_socket_t;
+
+typedef struct {
+    uint32_t* slots;        // socket index + 1, 0 = empty
+    uint32_t mask, count;
+} net_index_t;
+
+typedef struct net_stack {
+    net_if_t* ifs;          // index 0 is unused: interfaces count from 1
+    uint32_t n_ifs;
+    net_addr_t* addrs;
+    uint32_t n_addrs, addrs_cap;
+
+    net_route_t* routes;
+    uint32_t n_routes, routes_cap, free_route;
+    uint32_t live_routes;
+    net_node_t* nodes;
+    uint32_t n_nodes, nodes_cap;
+
+    net_socket_t* sockets;
+    uint32_t n_sockets, sockets_cap, free_socket;
+    uint32_t live_sockets;
+    net_index_t by_tuple;
+    net_index_t by_pid;     // head of each pid's chain
+    uint32_t next_inode;
+
+    uint8_t seeded;         // the lesson machine's sockets are in
+} net_stack_t;
+
+net_stack_t* net_new(void);
+void net_free(net_stack_t* n);
+
+// Interfaces and addresses; returns the new interface's index
+uint32_t net_add_interface(net_stack_t* n, const char* name, uint32_t flags, uint32_t mtu, const uint8_t* mac);
+void net_add_address(net_stack_t* n, uint32_t dev, uint32_t addr, uint8_t len, uint8_t scope, uint8_t dynamic);
+// Interface index of a name, or 0
+uint32_t net_interface(const net_stack_t* n, const char* name);
+
+// Add a route: 0, or -EEXIST when the prefix already has a route with
+// that metric (replace: it is overwritten instead)
+int net_route_add(net_stack_t* n, const net_route_t* r, int replace);
+// Delete the first route of dst/len matching the non-zero fields of
+// match (gateway, dev, metric). Returns 0 or -ESRCH.
+int net_route_del(net_stack_t* n, uint32_t dst, uint8_t len, const net_route_t* match);
+// The route a packet to addr takes, or NET_NONE
+uint32_t net_route_lookup(const net_stack_t* n, uint32_t addr);
+// Every route in ip route's order; a nonzero return stops the walk
+typedef int (*net_route_fn)(void* ctx, const net_route_t* r);
+void net_route_walk(const net_stack_t* n, net_route_fn fn, void* ctx);
+
+// Add a socket; returns its index, or NET_NONE if its 4-tuple is taken
+uint32_t net_socket_add(net_stack_t* n, const net_socket_t* s);
+uint32_t net_socket_find(const net_stack_t* n, uint8_t proto, uint32_t laddr, uint16_t lport, uint32_t raddr,
+                         uint16_t rport);
+void net_socket_close(net_stack_t* n, uint32_t i);
+// Close every socket a process owns; returns how many
+uint32_t net_close_pid(net_stack_t* n, int32_t pid);
+// First socket of a process (then follow next_of_pid), or NET_NONE
+uint32_t net_pid_sockets(const net_stack_t* n, int32_t pid);
+
+// ss's state list and filter expression, as in ss(8):
+//   state established '( dport = :ssh or sport = :ssh )'
+//   exclude listening dst 10.0.0.0/8 and not sport :22
+#define NET_FILTER_MAX 64
+
+typedef struct {
+    uint8_t kind;           // NET_EXPR_*
+    uint8_t op;             // comparisons of ports
+    uint8_t has_port;
+    uint16_t port;
+    uint32_t addr, mask;
+    uint8_t left, right;
+} net_expr_t;
+
+typedef struct {
+    uint32_t states;        // 1 << net_state_t
+    net_expr_t nodes[NET_FILTER_MAX];
+    int n_nodes;
+    int root;               // -1: no expression
+} net_filter_t;
+
+// Parse from argv (states before the expression, expression words joined
+// as ss does). states starts as default_states unless a state or exclude
+// word says otherwise. Returns 0, or -1 after writing err.
+int net_filter_parse(net_filter_t* f, int argc, char** argv, uint32_t default_states, char* err, size_t err_len);
+int net_filter_match(const net_filter_t* f, const net_socket_t* s);
+
+// The session's stack (see sim.h), seeded on first use and caught up with
+// the processes that exited or came back since
+net_stack_t* net_session(void);
+
+// Simulated commands (see sim.c)
+int net_cmd_ip(int argc, char** argv);
+int net_cmd_ss(int argc, char** argv);
+int net_cmd_netstat(int argc, char** argv);
+
+// --bench net [sockets] [routes]
+int net_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,1803 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <ctype.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "nss.h"
+#include "bench.h"
+#include "util.h"
+
+#define MAX_PATH 4096
+#define MAX_GROUPS 256
+
+// adduser.conf
+#define FIRST_SYSTEM_UID 100
+#define LAST_SYSTEM_UID 999
+#define FIRST_UID 1000
+#define LAST_UID 59999
+#define GID_USERS 100
+#define GID_NOGROUP 65534
+#define NAME_MAX_LEN 32
+
+static uint32_t hash_name(const char* s) {
+    uint32_t h = 2166136261u;
+
+    for (; *s; s++) h = (h ^ (uint8_t)*s) * 16777619u;
+    return h;
+}
+
+static uint32_t hash_id(uint32_t id) {
+    id ^= id >> 16;
+    id *= 0x7feb352du;
+    id ^= id >> 15;
+    return id;
+}
+
+static uint32_t add_string(nss_db_t* db, const char* s, size_t len) {
+    uint32_t off;
+
+    if (db->strings_len + len + 1 > db->strings_cap) {
+        db->strings_cap = (db->strings_len + len + 1) * 2;
+        db->strings = xrealloc(db->strings, db->strings_cap);
+    }
+    off = (uint32_t)db->strings_len;
+    memcpy(db->strings + off, s, len);
+    db->strings[off + len] = '\0';
+    db->strings_len += len + 1;
+    return off;
+}
+
+static uint32_t add_cstring(nss_db_t* db, const char* s) {
+    return add_string(db, s, strlen(s));
+}
+
+// ---------------------------------------------------------------------
+// Indexes
+
+typedef enum {
+    KEY_USER_NAME,
+    KEY_USER_UID,
+    KEY_GROUP_NAME,
+    KEY_GROUP_GID,
+    KEY_SHADOW_NAME,
+    KEY_MEMBER_NAME
+} key_kind_t;
+
+static const char* key_name(const nss_db_t* db, key_kind_t kind, uint32_t i) {
+    switch (kind) {
+        case KEY_USER_NAME:
+            return nss_str(db, db->users[i].name);
+        case KEY_GROUP_NAME:
+            return nss_str(db, db->groups[i].name);
+        case KEY_SHADOW_NAME:
+            return nss_str(db, db->shadow[i].name);
+        default:
+            return nss_str(db, db->members[i].name);
+    }
+}
+
+static uint32_t key_id(const nss_db_t* db, key_kind_t kind, uint32_t i) {
+    return kind == KEY_USER_UID ? db->users[i].uid : db->groups[i].gid;
+}
+
+static int by_id(key_kind_t kind) {
+    return kind == KEY_USER_UID || kind == KEY_GROUP_GID;
+}
+
+static uint32_t key_hash(const nss_db_t* db, key_kind_t kind, uint32_t i) {
+    return by_id(kind) ? hash_id(key_id(db, kind, i)) : hash_name(key_name(db, kind, i));
+}
+
+// The slot holding name, or the empty slot where it would go
+static uint32_t* name_slot(const nss_db_t* db, const nss_index_t* ix, key_kind_t kind, const char* name) {
+    uint32_t i = hash_name(name) & ix->mask;
+
+    while (ix->slots[i] && strcmp(key_name(db, kind, ix->slots[i] - 1), name) != 0) i = (i + 1) & ix->mask;
+    return &ix->slots[i];
+}
+
+static uint32_t* id_slot(const nss_db_t* db, const nss_index_t* ix, key_kind_t kind, uint32_t id) {
+    uint32_t i = hash_id(id) & ix->mask;
+
+    while (ix->slots[i] && key_id(db, kind, ix->slots[i] - 1) != id) i = (i + 1) & ix->mask;
+    return &ix->slots[i];
+}
+
+// Rehash into at least twice as many slots as entries, for count entries
+static void index_reserve(const nss_db_t* db, nss_index_t* ix, key_kind_t kind, uint32_t count) {
+    uint32_t old_size = ix->slots ? ix->mask + 1 : 0, size = old_size ? old_size : 64, i;
+    uint32_t* old = ix->slots;
+
+    while (count * 2 > size) size *= 2;
+    if (size == old_size) return;
+    ix->slots = calloc(size, sizeof(uint32_t));
+    if (!ix->slots) {
+        perror("calloc");
+        exit(1);
+    }
+    ix->mask = size - 1;
+    for (i = 0; i < old_size; i++) {
+        uint32_t j;
+
+        if (!old[i]) continue;
+        j = key_hash(db, kind, old[i] - 1) & ix->mask;
+        while (ix->slots[j]) j = (j + 1) & ix->mask;
+        ix->slots[j] = old[i];
+    }
+    free(old);
+}
+
+// Index entry i under its key. The first entry with a key keeps it, as
+// getent finds the first matching line; for members the newest record
+// becomes the head of its name's chain. Returns the entry that had the
+// key before, or NSS_NONE.
+static uint32_t index_add(nss_db_t* db, nss_index_t* ix, key_kind_t kind, uint32_t i) {
+    uint32_t* slot;
+    uint32_t had;
+
+    if (!ix->slots || (ix->count + 1) * 2 > ix->mask + 1) index_reserve(db, ix, kind, ix->count + 1);
+    slot = by_id(kind) ? id_slot(db, ix, kind, key_id(db, kind, i)) : name_slot(db, ix, kind, key_name(db, kind, i));
+    had = *slot - 1;
+    if (*slot && kind != KEY_MEMBER_NAME) return had;
+    if (!*slot) ix->count++;
+    *slot = i + 1;
+    return had;
+}
+
+static uint32_t find_name(const nss_db_t* db, const nss_index_t* ix, key_kind_t kind, const char* name) {
+    return ix->slots ? *name_slot(db, ix, kind, name) - 1 : NSS_NONE;
+}
+
+static uint32_t find_id(const nss_db_t* db, const nss_index_t* ix, key_kind_t kind, uint32_t id) {
+    return ix->slots ? *id_slot(db, ix, kind, id) - 1 : NSS_NONE;
+}
+
+uint32_t nss_user_by_name(const nss_db_t* db, const char* name) {
+    return find_name(db, &db->user_by_name, KEY_USER_NAME, name);
+}
+
+uint32_t nss_user_by_uid(const nss_db_t* db, uint32_t uid) {
+    return find_id(db, &db->user_by_uid, KEY_USER_UID, uid);
+}
+
+uint32_t nss_group_by_name(const nss_db_t* db, const char* name) {
+    return find_name(db, &db->group_by_name, KEY_GROUP_NAME, name);
+}
+
+uint32_t nss_group_by_gid(const nss_db_t* db, uint32_t gid) {
+    return find_id(db, &db->group_by_gid, KEY_GROUP_GID, gid);
+}
+
+uint32_t nss_shadow_by_name(const nss_db_t* db, const char* name) {
+    return find_name(db, &db->shadow_by_name, KEY_SHADOW_NAME, name);
+}
+
+// ---------------------------------------------------------------------
+// Tables
+
+#define GROW(arr, n, cap)                                        \
+    do {                                                         \
+        if ((n) == (cap)) {                                      \
+            (cap) = (cap) ? (cap) * 2 : 64;                      \
+            (arr) = xrealloc((arr), (cap) * sizeof(*(arr)));     \
+        }                                                        \
+    } while (0)
+
+static uint32_t add_user(nss_db_t* db, const nss_user_t* u) {
+    uint32_t i = db->n_users;
+
+    GROW(db->users, db->n_users, db->users_cap);
+    db->users[db->n_users++] = *u;
+    index_add(db, &db->user_by_name, KEY_USER_NAME, i);
+    index_add(db, &db->user_by_uid, KEY_USER_UID, i);
+    return i;
+}
+
+static uint32_t add_group(nss_db_t* db, uint32_t name, uint32_t passwd, uint32_t gid) {
+    uint32_t i = db->n_groups;
+
+    GROW(db->groups, db->n_groups, db->groups_cap);
+    db->groups[i] = (nss_group_t){ name, passwd, gid, NSS_NONE, NSS_NONE };
+    db->n_groups++;
+    index_add(db, &db->group_by_name, KEY_GROUP_NAME, i);
+    index_add(db, &db->group_by_gid, KEY_GROUP_GID, i);
+    return i;
+}
+
+static uint32_t add_shadow(nss_db_t* db, const nss_shadow_t* s) {
+    uint32_t i = db->n_shadow;
+
+    GROW(db->shadow, db->n_shadow, db->shadow_cap);
+    db->shadow[db->n_shadow++] = *s;
+    index_add(db, &db->shadow_by_name, KEY_SHADOW_NAME, i);
+    return i;
+}
+
+// Append a member to group g's list
+static void add_member(nss_db_t* db, uint32_t g, uint32_t name) {
+    uint32_t i = db->n_members;
+
+    GROW(db->members, db->n_members, db->members_cap);
+    db->members[i] = (nss_member_t){ name, g, NSS_NONE, NSS_NONE };
+    db->n_members++;
+    db->members[i].next_of_name = index_add(db, &db->member_by_name, KEY_MEMBER_NAME, i);
+    if (db->groups[g].last_member == NSS_NONE) {
+        db->groups[g].first_member = i;
+    } else {
+        db->members[db->groups[g].last_member].next_in_group = i;
+    }
+    db->groups[g].last_member = i;
+}
+
+static int is_member(const nss_db_t* db, uint32_t g, const char* name) {
+    uint32_t m;
+
+    for (m = find_name(db, &db->member_by_name, KEY_MEMBER_NAME, name); m != NSS_NONE; m = db->members[m].next_of_name) {
+        if (db->members[m].group == g) return 1;
+    }
+    return 0;
+}
+
+// Unlink name from group g's list; its record stays in the name's chain
+// with no group
+static void remove_member(nss_db_t* db, uint32_t g, const char* name) {
+    uint32_t m, prev = NSS_NONE;
+
+    for (m = db->groups[g].first_member; m != NSS_NONE; prev = m, m = db->members[m].next_in_group) {
+        if (strcmp(nss_str(db, db->members[m].name), name) != 0) continue;
+        if (prev == NSS_NONE) {
+            db->groups[g].first_member = db->members[m].next_in_group;
+        } else {
+            db->members[prev].next_in_group = db->members[m].next_in_group;
+        }
+        if (db->groups[g].last_member == m) db->groups[g].last_member = prev;
+        db->members[m].group = NSS_NONE;
+        return;
+    }
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+uint32_t nss_user_groups(const nss_db_t* db, const char* name, uint32_t gid, uint32_t* out, uint32_t max) {
+    uint32_t primary = nss_group_by_gid(db, gid), n = 0, kept = 0, i, m;
+    uint32_t* found;
+
+    for (m = find_name(db, &db->member_by_name, KEY_MEMBER_NAME, name); m != NSS_NONE; m = db->members[m].next_of_name) {
+        if (db->members[m].group != NSS_NONE && db->members[m].group != primary) n++;
+    }
+    found = xrealloc(NULL, (n + 1) * sizeof(uint32_t));
+    n = 0;
+    for (m = find_name(db, &db->member_by_name, KEY_MEMBER_NAME, name); m != NSS_NONE; m = db->members[m].next_of_name) {
+        if (db->members[m].group != NSS_NONE && db->members[m].group != primary) found[n++] = db->members[m].group;
+    }
+    qsort(found, n, sizeof(uint32_t), compare_u32);
+    if (primary != NSS_NONE && max) out[kept] = primary;
+    if (primary != NSS_NONE) kept++;
+    for (i = 0; i < n; i++) {
+        if (i && found[i] == found[i - 1]) continue;
+        if (kept < max) out[kept] = found[i];
+        kept++;
+    }
+    free(found);
+    return kept;
+}
+
+// ---------------------------------------------------------------------
+// Loading
+
+static int parse_id(const char* s, uint32_t* id) {
+    uint64_t v = 0;
+
+    if (!*s) return -1;
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9' || (v = v * 10 + (uint64_t)(*s - '0')) >= UINT32_MAX) return -1;
+    }
+    *id = (uint32_t)v;
+    return 0;
+}
+
+static void reserve_table(nss_db_t* db, int table, uint32_t lines, uint32_t members) {
+    if (table == NSS_PASSWD && db->n_users + lines > db->users_cap) {
+        db->users_cap = db->n_users + lines;
+        db->users = xrealloc(db->users, db->users_cap * sizeof(*db->users));
+        index_reserve(db, &db->user_by_name, KEY_USER_NAME, db->users_cap);
+        index_reserve(db, &db->user_by_uid, KEY_USER_UID, db->users_cap);
+    } else if (table == NSS_GROUP && db->n_groups + lines > db->groups_cap) {
+        db->groups_cap = db->n_groups + lines;
+        db->groups = xrealloc(db->groups, db->groups_cap * sizeof(*db->groups));
+        index_reserve(db, &db->group_by_name, KEY_GROUP_NAME, db->groups_cap);
+        index_reserve(db, &db->group_by_gid, KEY_GROUP_GID, db->groups_cap);
+    }
+    if (db->n_members + members > db->members_cap) {
+        db->members_cap = db->n_members + members;
+        db->members = xrealloc(db->members, db->members_cap * sizeof(*db->members));
+        index_reserve(db, &db->member_by_name, KEY_MEMBER_NAME, db->members_cap);
+    } else if (table == NSS_SHADOW && db->n_shadow + lines > db->shadow_cap) {
+        db->shadow_cap = db->n_shadow + lines;
+        db->shadow = xrealloc(db->shadow, db->shadow_cap * sizeof(*db->shadow));
+        index_reserve(db, &db->shadow_by_name, KEY_SHADOW_NAME, db->shadow_cap);
+    }
+}
+
+// Split the lines of strings[start, end) in place and add them to table.
+// Shadow lines keep their last six fields as one.
+static int parse_table(nss_db_t* db, int table, size_t start, size_t end, const char* path, char* err, size_t err_len) {
+    int want = table == NSS_PASSWD ? 7 : table == NSS_GROUP ? 4 : 9;
+    int split = table == NSS_SHADOW ? 3 : want - 1;
+    uint32_t line_no = 0, lines = 0, commas = 0;
+    const char* scan;
+    size_t pos = start;
+
+    // Size the table and its indexes once instead of growing them line by line
+    for (scan = db->strings + start; (scan = memchr(scan, '\n', (size_t)(db->strings + end - scan))) != NULL; scan++) lines++;
+    if (table == NSS_GROUP) {
+        for (scan = db->strings + start; (scan = memchr(scan, ',', (size_t)(db->strings + end - scan))) != NULL; scan++) commas++;
+    }
+    // At most one more member than commas per line
+    reserve_table(db, table, lines + 1, table == NSS_GROUP ? commas + lines + 1 : 0);
+    while (pos < end) {
+        char* line = db->strings + pos;
+        char* nl = memchr(line, '\n', end - pos);
+        size_t len = nl ? (size_t)(nl - line) : end - pos;
+        uint32_t field[9];
+        int n = 1, colons = 0;
+        char* p;
+
+        line_no++;
+        line[len] = '\0';
+        field[0] = (uint32_t)pos;
+        pos += len + 1;
+        if (len == 0) continue;
+        for (p = line; (p = memchr(p, ':', (size_t)(line + len - p))) != NULL; p++) {
+            colons++;
+            if (n <= split) {
+                *p = '\0';
+                if (n < 9) field[n] = (uint32_t)(p + 1 - db->strings);
+                n++;
+            }
+        }
+        if (colons != want - 1) return set_error(err, err_len, "%s:%u: expected %d fields", path, line_no, want);
+
+        if (table == NSS_PASSWD) {
+            nss_user_t u = { field[0], field[1], field[4], field[5], field[6], 0, 0 };
+
+            if (parse_id(db->strings + field[2], &u.uid) != 0 || parse_id(db->strings + field[3], &u.gid) != 0) {
+                return set_error(err, err_len, "%s:%u: invalid user or group id", path, line_no);
+            }
+            add_user(db, &u);
+        } else if (table == NSS_GROUP) {
+            uint32_t gid, g;
+            char* m = db->strings + field[3];
+
+            if (parse_id(db->strings + field[2], &gid) != 0) return set_error(err, err_len, "%s:%u: invalid group id", path, line_no);
+            g = add_group(db, field[0], field[1], gid);
+            while (*m) {
+                size_t k = strcspn(m, ",");
+                int last = m[k] == '\0';
+
+                m[k] = '\0';
+                if (k) add_member(db, g, (uint32_t)(m - db->strings));
+                if (last) break;
+                m += k + 1;
+            }
+        } else {
+            nss_shadow_t s = { field[0], field[1], field[2], field[3] };
+
+            add_shadow(db, &s);
+        }
+    }
+    return 0;
+}
+
+// Read a file to the end of the arena. Returns 0, or -errno.
+static int read_into_arena(nss_db_t* db, const char* path, size_t* start, size_t* end) {
+    FILE* f = fopen(path, "r");
+    struct stat st;
+    size_t n;
+
+    if (!f) return -errno;
+    if (fstat(fileno(f), &st) == 0 && db->strings_len + (size_t)st.st_size + 2 > db->strings_cap) {
+        db->strings_cap = db->strings_len + (size_t)st.st_size + 4096;
+        db->strings = xrealloc(db->strings, db->strings_cap);
+    }
+    *start = db->strings_len;
+    do {
+        if (db->strings_cap - db->strings_len < 2) {
+            db->strings_cap *= 2;
+            db->strings = xrealloc(db->strings, db->strings_cap);
+        }
+        n = fread(db->strings + db->strings_len, 1, db->strings_cap - db->strings_len - 1, f);
+        db->strings_len += n;
+    } while (n > 0);
+    fclose(f);
+    // The last line may lack its newline
+    *end = db->strings_len;
+    db->strings[db->strings_len++] = '\0';
+    return 0;
+}
+
+static nss_db_t* db_new(void) {
+    nss_db_t* db = calloc(1, sizeof(*db));
+
+    if (!db) {
+        perror("calloc");
+        exit(1);
+    }
+    db->strings_cap = 4096;
+    db->strings = xrealloc(NULL, db->strings_cap);
+    db->strings[0] = '\0';
+    db->strings_len = 1;
+    pthread_mutex_init(&db->lock, NULL);
+    return db;
+}
+
+static const char* const table_files[] = { "passwd", "group", "shadow" };
+
+nss_db_t* nss_load(const char* dir, char* err, size_t err_len) {
+    nss_db_t* db = db_new();
+    char path[MAX_PATH];
+    int t, rc;
+
+    db->dir = strdup(dir);
+    for (t = 0; t < 3; t++) {
+        size_t start = 0, end = 0;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, table_files[t]);
+        if ((rc = read_into_arena(db, path, &start, &end)) < 0) {
+            // Without a readable shadow there are no passwords to show
+            if (t == 2 && (rc == -ENOENT || rc == -EACCES)) break;
+            set_error(err, err_len, "%s: %s", path, strerror(-rc));
+            nss_free(db);
+            return NULL;
+        }
+        if (parse_table(db, 1 << t, start, end, path, err, err_len) != 0) {
+            nss_free(db);
+            return NULL;
+        }
+        db->has_shadow = t == 2;
+    }
+    return db;
+}
+
+// The lesson machine's accounts
+static const char seed_passwd[] =
+    "root:x:0:0:root:/root:/bin/bash\n"
+    "daemon:x:1:1:daemon:/usr/sbin:/usr/sbin/nologin\n"
+    "bin:x:2:2:bin:/bin:/usr/sbin/nologin\n"
+    "sys:x:3:3:sys:/dev:/usr/sbin/nologin\n"
+    "sync:x:4:65534:sync:/bin:/bin/sync\n"
+    "games:x:5:60:games:/usr/games:/usr/sbin/nologin\n"
+    "man:x:6:12:man:/var/cache/man:/usr/sbin/nologin\n"
+    "lp:x:7:7:lp:/var/spool/lpd:/usr/sbin/nologin\n"
+    "mail:x:8:8:mail:/var/mail:/usr/sbin/nologin\n"
+    "news:x:9:9:news:/var/spool/news:/usr/sbin/nologin\n"
+    "uucp:x:10:10:uucp:/var/spool/uucp:/usr/sbin/nologin\n"
+    "proxy:x:13:13:proxy:/bin:/usr/sbin/nologin\n"
+    "www-data:x:33:33:www-data:/var/www:/usr/sbin/nologin\n"
+    "backup:x:34:34:backup:/var/backups:/usr/sbin/nologin\n"
+    "list:x:38:38:Mailing List Manager:/var/list:/usr/sbin/nologin\n"
+    "irc:x:39:39:ircd:/run/ircd:/usr/sbin/nologin\n"
+    "_apt:x:42:65534::/nonexistent:/usr/sbin/nologin\n"
+    "nobody:x:65534:65534:nobody:/nonexistent:/usr/sbin/nologin\n"
+    "messagebus:x:100:107::/nonexistent:/usr/sbin/nologin\n"
+    "sshd:x:101:65534::/run/sshd:/usr/sbin/nologin\n"
+    "systemd-coredump:x:999:999:systemd Core Dumper:/:/usr/sbin/nologin\n"
+    "systemd-network:x:998:998:systemd Network Management:/:/usr/sbin/nologin\n"
+    "systemd-resolve:x:997:997:systemd Resolver:/:/usr/sbin/nologin\n"
+    "systemd-timesync:x:996:996:systemd Time Synchronization:/:/usr/sbin/nologin\n"
+    "admin:x:1000:1000:System Administrator,,,:/home/admin:/bin/bash\n";
+
+static const char seed_group[] =
+    "root:x:0:\n"
+    "daemon:x:1:\n"
+    "bin:x:2:\n"
+    "sys:x:3:\n"
+    "adm:x:4:\n"
+    "tty:x:5:\n"
+    "disk:x:6:\n"
+    "lp:x:7:\n"
+    "mail:x:8:\n"
+    "news:x:9:\n"
+    "uucp:x:10:\n"
+    "man:x:12:\n"
+    "proxy:x:13:\n"
+    "kmem:x:15:\n"
+    "dialout:x:20:\n"
+    "fax:x:21:\n"
+    "voice:x:22:\n"
+    "cdrom:x:24:admin\n"
+    "floppy:x:25:admin\n"
+    "tape:x:26:\n"
+    "sudo:x:27:admin\n"
+    "audio:x:29:admin\n"
+    "dip:x:30:admin\n"
+    "www-data:x:33:\n"
+    "backup:x:34:\n"
+    "operator:x:37:\n"
+    "list:x:38:\n"
+    "irc:x:39:\n"
+    "src:x:40:\n"
+    "shadow:x:42:\n"
+    "utmp:x:43:\n"
+    "video:x:44:admin\n"
+    "sasl:x:45:\n"
+    "plugdev:x:46:admin\n"
+    "staff:x:50:\n"
+    "games:x:60:\n"
+    "users:x:100:\n"
+    "nogroup:x:65534:\n"
+    "systemd-journal:x:101:\n"
+    "systemd-network:x:998:\n"
+    "systemd-resolve:x:997:\n"
+    "systemd-timesync:x:996:\n"
+    "systemd-coredump:x:999:\n"
+    "messagebus:x:107:\n"
+    "netdev:x:108:admin\n"
+    "bluetooth:x:114:admin\n"
+    "lpadmin:x:119:admin\n"
+    "ssl-cert:x:120:\n"
+    "scanner:x:134:admin\n"
+    "admin:x:1000:\n";
+
+// 19640: 2023-10-10, when the machine was installed
+static const char seed_shadow[] =
+    "root:*:19640:0:99999:7:::\n"
+    "daemon:*:19640:0:99999:7:::\n"
+    "bin:*:19640:0:99999:7:::\n"
+    "sys:*:19640:0:99999:7:::\n"
+    "sync:*:19640:0:99999:7:::\n"
+    "games:*:19640:0:99999:7:::\n"
+    "man:*:19640:0:99999:7:::\n"
+    "lp:*:19640:0:99999:7:::\n"
+    "mail:*:19640:0:99999:7:::\n"
+    "news:*:19640:0:99999:7:::\n"
+    "uucp:*:19640:0:99999:7:::\n"
+    "proxy:*:19640:0:99999:7:::\n"
+    "www-data:*:19640:0:99999:7:::\n"
+    "backup:*:19640:0:99999:7:::\n"
+    "list:*:19640:0:99999:7:::\n"
+    "irc:*:19640:0:99999:7:::\n"
+    "_apt:*:19640:0:99999:7:::\n"
+    "nobody:*:19640:0:99999:7:::\n"
+    "messagebus:!:19640::::::\n"
+    "sshd:!:19640::::::\n"
+    "systemd-coredump:!*:19640::::::\n"
+    "systemd-network:!*:19640::::::\n"
+    "systemd-resolve:!*:19640::::::\n"
+    "systemd-timesync:!*:19640::::::\n"
+    "admin:$y$j9T$Ve2ChVbOXm0HkKn0nwOlh.$5Kq1bZ0tFhZq7PmQh6kNKsVv3lhn0mO1bwDUP8xYbB3:19640:0:99999:7:::\n";
+
+nss_db_t* nss_seed_debian(void) {
+    static const char* const seeds[] = { seed_passwd, seed_group, seed_shadow };
+    nss_db_t* db = db_new();
+    int t;
+
+    for (t = 0; t < 3; t++) {
+        size_t start = db->strings_len;
+
+        add_string(db, seeds[t], strlen(seeds[t]));
+        parse_table(db, 1 << t, start, db->strings_len - 1, table_files[t], NULL, 0);
+    }
+    db->has_shadow = 1;
+    return db;
+}
+
+static void copy_index(nss_index_t* to, const nss_index_t* from) {
+    *to = *from;
+    if (!from->slots) return;
+    to->slots = xrealloc(NULL, ((size_t)from->mask + 1) * sizeof(from->slots[0]));
+    memcpy(to->slots, from->slots, ((size_t)from->mask + 1) * sizeof(from->slots[0]));
+}
+
+// A table's entries, with room for its capacity
+static void* copy_table(const void* from, uint32_t n, uint32_t cap, size_t size) {
+    void* to;
+
+    if (!cap) return NULL;
+    to = xrealloc(NULL, cap * size);
+    memcpy(to, from, n * size);
+    return to;
+}
+
+nss_db_t* nss_copy(nss_db_t* db) {
+    nss_db_t* c = calloc(1, sizeof(*c));
+
+    if (!c) {
+        perror("calloc");
+        exit(1);
+    }
+    pthread_mutex_lock(&db->lock);
+    *c = *db;
+    c->users = copy_table(db->users, db->n_users, db->users_cap, sizeof(db->users[0]));
+    c->groups = copy_table(db->groups, db->n_groups, db->groups_cap, sizeof(db->groups[0]));
+    c->shadow = copy_table(db->shadow, db->n_shadow, db->shadow_cap, sizeof(db->shadow[0]));
+    c->members = copy_table(db->members, db->n_members, db->members_cap, sizeof(db->members[0]));
+    c->strings = xrealloc(NULL, db->strings_cap);
+    memcpy(c->strings, db->strings, db->strings_len);
+    copy_index(&c->user_by_name, &db->user_by_name);
+    copy_index(&c->user_by_uid, &db->user_by_uid);
+    copy_index(&c->group_by_name, &db->group_by_name);
+    copy_index(&c->group_by_gid, &db->group_by_gid);
+    copy_index(&c->shadow_by_name, &db->shadow_by_name);
+    copy_index(&c->member_by_name, &db->member_by_name);
+    pthread_mutex_unlock(&db->lock);
+    c->dir = NULL;
+    c->dirty = 0;
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+void nss_free(nss_db_t* db) {
+    if (!db) return;
+    free(db->users);
+    free(db->groups);
+    free(db->shadow);
+    free(db->members);
+    free(db->strings);
+    free(db->user_by_name.slots);
+    free(db->user_by_uid.slots);
+    free(db->group_by_name.slots);
+    free(db->group_by_gid.slots);
+    free(db->shadow_by_name.slots);
+    free(db->member_by_name.slots);
+    free(db->dir);
+    pthread_mutex_destroy(&db->lock);
+    free(db);
+}
+
+// ---------------------------------------------------------------------
+// Saving
+
+static void write_user(const nss_db_t* db, const nss_user_t* u, FILE* f) {
+    fprintf(f, "%s:%s:%u:%u:%s:%s:%s\n", nss_str(db, u->name), nss_str(db, u->passwd), u->uid, u->gid, nss_str(db, u->gecos),
+            nss_str(db, u->dir), nss_str(db, u->shell));
+}
+
+static void write_group(const nss_db_t* db, const nss_group_t* g, FILE* f) {
+    uint32_t m;
+
+    fprintf(f, "%s:%s:%u:", nss_str(db, g->name), nss_str(db, g->passwd), g->gid);
+    for (m = g->first_member; m != NSS_NONE; m = db->members[m].next_in_group) {
+        if (m != g->first_member) putc(',', f);
+        fputs(nss_str(db, db->members[m].name), f);
+    }
+    putc('\n', f);
+}
+
+static void write_shadow(const nss_db_t* db, const nss_shadow_t* s, FILE* f) {
+    fprintf(f, "%s:%s:%s:%s\n", nss_str(db, s->name), nss_str(db, s->passwd), nss_str(db, s->lastchg), nss_str(db, s->rest));
+}
+
+static void write_table(const nss_db_t* db, int table, FILE* f) {
+    uint32_t i;
+
+    if (table == NSS_PASSWD) {
+        for (i = 0; i < db->n_users; i++) write_user(db, &db->users[i], f);
+    } else if (table == NSS_GROUP) {
+        for (i = 0; i < db->n_groups; i++) write_group(db, &db->groups[i], f);
+    } else {
+        for (i = 0; i < db->n_shadow; i++) write_shadow(db, &db->shadow[i], f);
+    }
+}
+
+// FILE+ written and synced, FILE linked to FILE-, FILE+ renamed over FILE
+static int save_table(const nss_db_t* db, int t, char* err, size_t err_len) {
+    char path[MAX_PATH], tmp[MAX_PATH + 1], backup[MAX_PATH + 1];
+    struct stat st;
+    FILE* f;
+    int fd, failed;
+
+    snprintf(path, sizeof(path), "%s/%s", db->dir, table_files[t]);
+    snprintf(tmp, sizeof(tmp), "%s+", path);
+    snprintf(backup, sizeof(backup), "%s-", path);
+    if (stat(path, &st) != 0) st.st_mode = t == 2 ? 0640 : 0644;
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777);
+    if (fd < 0 || !(f = fdopen(fd, "w"))) {
+        if (fd >= 0) close(fd);
+        return set_error(err, err_len, "%s: %s", tmp, strerror(errno));
+    }
+    write_table(db, 1 << t, f);
+    failed = fflush(f) != 0 || fsync(fd) != 0;
+    failed |= fclose(f) != 0;
+    if (failed) {
+        set_error(err, err_len, "%s: %s", tmp, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    unlink(backup);
+    if (link(path, backup) != 0 && errno != ENOENT) {
+        // No backup is no reason to lose the change
+    }
+    if (rename(tmp, path) != 0) {
+        set_error(err, err_len, "%s: %s", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int nss_save(nss_db_t* db, char* err, size_t err_len) {
+    int t;
+
+    if (!db->dir) return set_error(err, err_len, "not loaded from a directory");
+    for (t = 0; t < 3; t++) {
+        if (!(db->dirty & (1 << t)) || (t == 2 && !db->has_shadow)) continue;
+        if (save_table(db, t, err, err_len) != 0) return -1;
+        db->dirty &= (uint8_t) ~(1 << t);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// The session's database
+
+static nss_db_t* shared_db;
+static pthread_once_t shared_once = PTHREAD_ONCE_INIT;
+
+static void open_shared(void) {
+    const char* dir = getenv("DEB1_ACCOUNTS");
+    char err[256];
+
+    if (!dir || !*dir) return;
+    shared_db = nss_load(dir, err, sizeof(err));
+    if (!shared_db) fprintf(stderr, "DEB1_ACCOUNTS: %s\n", err);
+}
+
+nss_db_t* nss_session(void) {
+    sim_env_t* env = sim_env();
+
+    if (env->accounts) return env->accounts;
+    pthread_once(&shared_once, open_shared);
+    if (shared_db) return shared_db;
+    env->accounts = nss_seed_debian();
+    return env->accounts;
+}
+
+nss_db_t* nss_session_for_change(void) {
+    sim_env_t* env = sim_env();
+    nss_db_t* db = nss_session();
+
+    if (db == shared_db && env->private_accounts) db = env->accounts = nss_copy(shared_db);
+    return db;
+}
+
+const char* nss_user_name(uint32_t uid, char* buf, size_t len) {
+    nss_db_t* db = nss_session();
+    uint32_t u;
+
+    pthread_mutex_lock(&db->lock);
+    u = nss_user_by_uid(db, uid);
+    if (u != NSS_NONE) {
+        snprintf(buf, len, "%s", nss_str(db, db->users[u].name));
+    } else {
+        snprintf(buf, len, "%u", uid);
+    }
+    pthread_mutex_unlock(&db->lock);
+    return buf;
+}
+
+const char* nss_group_name(uint32_t gid, char* buf, size_t len) {
+    nss_db_t* db = nss_session();
+    uint32_t g;
+
+    pthread_mutex_lock(&db->lock);
+    g = nss_group_by_gid(db, gid);
+    if (g != NSS_NONE) {
+        snprintf(buf, len, "%s", nss_str(db, db->groups[g].name));
+    } else {
+        snprintf(buf, len, "%u", gid);
+    }
+    pthread_mutex_unlock(&db->lock);
+    return buf;
+}
+
+int nss_group_id(const char* name, uint32_t* gid) {
+    nss_db_t* db = nss_session();
+    uint32_t g;
+
+    pthread_mutex_lock(&db->lock);
+    g = nss_group_by_name(db, name);
+    if (g != NSS_NONE) *gid = db->groups[g].gid;
+    pthread_mutex_unlock(&db->lock);
+    return g != NSS_NONE ? 0 : parse_id(name, gid);
+}
+
+int nss_user_id(const char* name, uint32_t* uid) {
+    nss_db_t* db = nss_session();
+    uint32_t u;
+
+    pthread_mutex_lock(&db->lock);
+    u = nss_user_by_name(db, name);
+    if (u != NSS_NONE) *uid = db->users[u].uid;
+    pthread_mutex_unlock(&db->lock);
+    return u != NSS_NONE ? 0 : parse_id(name, uid);
+}
+
+// Make a change stick: the files of a loaded database, or the simulated
+// /etc's sizes and times for the lesson machine's
+static int commit(nss_db_t* db, const char* command) {
+    static const char* const etc_paths[] = { "/etc/passwd", "/etc/group", "/etc/shadow" };
+    sim_env_t* env = sim_env();
+    char err[256];
+    int t;
+
+    db->generation++;
+    if (db->dir) {
+        if (nss_save(db, err, sizeof(err)) == 0) return 0;
+        sim_error(command, "%s", err);
+        return -1;
+    }
+    for (t = 0; t < 3; t++) {
+        char* text = NULL;
+        size_t len = 0;
+        uint32_t ino;
+        FILE* f;
+
+        if (!(db->dirty & (1 << t)) || !(f = open_memstream(&text, &len))) continue;
+        write_table(db, 1 << t, f);
+        fclose(f);
+        free(text);
+        if (vfs_resolve(env->vfs, VFS_ROOT, etc_paths[t], &ino) == 0) vfs_set_size(env->vfs, ino, len, env->clock);
+    }
+    db->dirty = 0;
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Commands
+
+static uint32_t session_uid(void) {
+    sim_env_t* env = sim_env();
+
+    return env->euid;
+}
+
+static const char* group_name_or_id(const nss_db_t* db, uint32_t gid, char* buf, size_t len) {
+    uint32_t g = nss_group_by_gid(db, gid);
+
+    if (g != NSS_NONE) return nss_str(db, db->groups[g].name);
+    snprintf(buf, len, "%u", gid);
+    return buf;
+}
+
+// A user by name, or by number as id(1) also takes them
+static uint32_t find_user(const nss_db_t* db, const char* arg) {
+    uint32_t u = nss_user_by_name(db, arg), uid;
+
+    if (u == NSS_NONE && parse_id(arg, &uid) == 0) u = nss_user_by_uid(db, uid);
+    return u;
+}
+
+static int getent_table(const nss_db_t* db, int table, int argc, char** argv) {
+    uint32_t i, id;
+    int status = 0, k;
+
+    if (argc < 3) {
+        uint32_t n = table == NSS_PASSWD ? db->n_users : table == NSS_GROUP ? db->n_groups : db->n_shadow;
+
+        for (i = 0; i < n && !con_stopped(); i++) {
+            char line[1024];
+            FILE* f = fmemopen(line, sizeof(line), "w");
+
+            if (!f) break;
+            if (table == NSS_PASSWD) {
+                write_user(db, &db->users[i], f);
+            } else if (table == NSS_GROUP) {
+                write_group(db, &db->groups[i], f);
+            } else {
+                write_shadow(db, &db->shadow[i], f);
+            }
+            putc('\0', f);
+            fclose(f);
+            con_write(line, strlen(line));
+        }
+        return 0;
+    }
+    for (k = 2; k < argc; k++) {
+        const char* key = argv[k];
+        FILE* f;
+        char* line = NULL;
+        size_t len = 0;
+
+        if (table == NSS_PASSWD) {
+            i = nss_user_by_name(db, key);
+            if (i == NSS_NONE && parse_id(key, &id) == 0) i = nss_user_by_uid(db, id);
+        } else if (table == NSS_GROUP) {
+            i = nss_group_by_name(db, key);
+            if (i == NSS_NONE && parse_id(key, &id) == 0) i = nss_group_by_gid(db, id);
+        } else {
+            i = nss_shadow_by_name(db, key);
+        }
+        if (i == NSS_NONE) {
+            status = 2;
+            continue;
+        }
+        if (!(f = open_memstream(&line, &len))) continue;
+        if (table == NSS_PASSWD) {
+            write_user(db, &db->users[i], f);
+        } else if (table == NSS_GROUP) {
+            write_group(db, &db->groups[i], f);
+        } else {
+            write_shadow(db, &db->shadow[i], f);
+        }
+        fclose(f);
+        con_write(line, len);
+        free(line);
+    }
+    return status;
+}
+
+int nss_cmd_getent(int argc, char** argv) {
+    nss_db_t* db;
+    int table, status;
+
+    if (argc < 2) {
+        con_printf("Usage: getent [OPTION...] database [key ...]\n");
+        return 1;
+    }
+    if (strcmp(argv[1], "passwd") == 0) {
+        table = NSS_PASSWD;
+    } else if (strcmp(argv[1], "group") == 0) {
+        table = NSS_GROUP;
+    } else if (strcmp(argv[1], "shadow") == 0) {
+        table = NSS_SHADOW;
+    } else {
+        return -1;
+    }
+    db = nss_session();
+    pthread_mutex_lock(&db->lock);
+    // Only root can read /etc/shadow
+    if (table == NSS_SHADOW && session_uid() != 0) {
+        status = argc > 2 ? 2 : 0;
+    } else {
+        status = getent_table(db, table, argc, argv);
+    }
+    pthread_mutex_unlock(&db->lock);
+    return status;
+}
+
+int nss_cmd_id(int argc, char** argv) {
+    uint32_t groups[MAX_GROUPS], n, i, u, uid, gid;
+    char num[16], num2[16];
+    nss_db_t* db;
+    const char* name;
+    sim_opts_t o;
+    int names;
+
+    if (sim_getopt(argc, argv, "ugGnr", &o) < 0) return 1;
+    names = SIM_HAS(&o, 'n');
+    if (names && !SIM_HAS(&o, 'u') && !SIM_HAS(&o, 'g') && !SIM_HAS(&o, 'G')) {
+        sim_error(argv[0], "cannot print only names or real IDs in default format");
+        return 1;
+    }
+    db = nss_session();
+    pthread_mutex_lock(&db->lock);
+    u = o.n_operands ? find_user(db, argv[1]) : nss_user_by_uid(db, session_uid());
+    if (u == NSS_NONE) {
+        pthread_mutex_unlock(&db->lock);
+        if (o.n_operands) {
+            sim_error(argv[0], "‘%s’: no such user", argv[1]);
+        } else {
+            con_printf("uid=%u gid=%u groups=%u\n", session_uid(), session_uid(), session_uid());
+        }
+        return o.n_operands ? 1 : 0;
+    }
+    name = nss_str(db, db->users[u].name);
+    uid = db->users[u].uid;
+    gid = db->users[u].gid;
+    n = nss_user_groups(db, name, gid, groups, MAX_GROUPS);
+    if (n > MAX_GROUPS) n = MAX_GROUPS;
+
+    if (SIM_HAS(&o, 'u')) {
+        if (names) {
+            con_printf("%s\n", name);
+        } else {
+            con_printf("%u\n", uid);
+        }
+    } else if (SIM_HAS(&o, 'g')) {
+        if (names) {
+            con_printf("%s\n", group_name_or_id(db, gid, num, sizeof(num)));
+        } else {
+            con_printf("%u\n", gid);
+        }
+    } else if (SIM_HAS(&o, 'G')) {
+        if (nss_group_by_gid(db, gid) == NSS_NONE) con_printf(n ? "%u " : "%u", gid);
+        for (i = 0; i < n; i++) {
+            if (names) {
+                con_printf("%s%s", i ? " " : "", nss_str(db, db->groups[groups[i]].name));
+            } else {
+                con_printf("%s%u", i ? " " : "", db->groups[groups[i]].gid);
+            }
+        }
+        con_printf("\n");
+    } else {
+        con_printf("uid=%u(%s) gid=%u", uid, name, gid);
+        if (nss_group_by_gid(db, gid) != NSS_NONE) con_printf("(%s)", group_name_or_id(db, gid, num2, sizeof(num2)));
+        con_printf(" groups=");
+        if (nss_group_by_gid(db, gid) == NSS_NONE) con_printf(n ? "%u," : "%u", gid);
+        for (i = 0; i < n; i++) {
+            con_printf("%s%u(%s)", i ? "," : "", db->groups[groups[i]].gid, nss_str(db, db->groups[groups[i]].name));
+        }
+        con_printf("\n");
+    }
+    pthread_mutex_unlock(&db->lock);
+    return 0;
+}
+
+int nss_cmd_groups(int argc, char** argv) {
+    uint32_t groups[MAX_GROUPS], n, i, u;
+    nss_db_t* db = nss_session();
+    int status = 0, k;
+
+    pthread_mutex_lock(&db->lock);
+    for (k = 1; k < argc || (k == 1 && argc == 1); k++) {
+        const char* name;
+
+        u = argc > 1 ? find_user(db, argv[k]) : nss_user_by_uid(db, session_uid());
+        if (u == NSS_NONE) {
+            sim_error(argv[0], "‘%s’: no such user", argc > 1 ? argv[k] : "?");
+            status = 1;
+            continue;
+        }
+        name = nss_str(db, db->users[u].name);
+        n = nss_user_groups(db, name, db->users[u].gid, groups, MAX_GROUPS);
+        if (n > MAX_GROUPS) n = MAX_GROUPS;
+        if (argc > 1) con_printf("%s : ", name);
+        for (i = 0; i < n; i++) con_printf("%s%s", i ? " " : "", nss_str(db, db->groups[groups[i]].name));
+        con_printf("\n");
+    }
+    pthread_mutex_unlock(&db->lock);
+    return status;
+}
+
+int nss_cmd_whoami(int argc, char** argv) {
+    char buf[64];
+
+    if (argc > 1) {
+        sim_error(argv[0], "extra operand ‘%s’\nTry 'whoami --help' for more information.", argv[1]);
+        return 1;
+    }
+    con_printf("%s\n", nss_user_name(session_uid(), buf, sizeof(buf)));
+    return 0;
+}
+
+// adduser's default NAME_REGEX: ^[a-z][-a-z0-9_]*\$?$
+static int valid_name(const char* name) {
+    size_t len = strlen(name), i;
+
+    if (!len || len > NAME_MAX_LEN || name[0] < 'a' || name[0] > 'z') return 0;
+    for (i = 1; i < len; i++) {
+        char c = name[i];
+
+        if (!(islower((unsigned char)c) || isdigit((unsigned char)c) || c == '-' || c == '_' || (c == '$' && i == len - 1))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint32_t free_id(const nss_db_t* db, int groups, uint32_t first, uint32_t last) {
+    uint32_t id;
+
+    for (id = first; id <= last; id++) {
+        if ((groups ? nss_group_by_gid(db, id) : nss_user_by_uid(db, id)) == NSS_NONE) return id;
+    }
+    return NSS_NONE;
+}
+
+// A yescrypt-shaped hash, the same for the same name and time
+static void make_hash(const char* name, time_t when, char* out, size_t len) {
+    static const char alphabet[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    uint64_t x = hash_name(name) ^ ((uint64_t)when << 32) ^ 0x9E3779B97F4A7C15ull;
+    size_t n = (size_t)snprintf(out, len, "$y$j9T$"), i;
+
+    for (i = 0; i < 22 + 1 + 43 && n + 1 < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        out[n++] = i == 22 ? '$' : alphabet[x % 64];
+    }
+    out[n] = '\0';
+}
+
+static uint32_t add_shadow_entry(nss_db_t* db, uint32_t name, const char* passwd, time_t now) {
+    char day[24];
+    nss_shadow_t s;
+
+    snprintf(day, sizeof(day), "%ld", (long)(now / 86400));
+    s.name = name;
+    s.passwd = add_cstring(db, passwd);
+    s.lastchg = add_cstring(db, day);
+    s.rest = add_cstring(db, "0:99999:7:::");
+    return add_shadow(db, &s);
+}
+
+static void set_password(nss_db_t* db, uint32_t s, const char* passwd, time_t now) {
+    char day[24];
+
+    snprintf(day, sizeof(day), "%ld", (long)(now / 86400));
+    db->shadow[s].passwd = add_cstring(db, passwd);
+    db->shadow[s].lastchg = add_cstring(db, day);
+    db->dirty |= NSS_SHADOW;
+}
+
+static void print_password_prompts(void) {
+    con_printf("New password: \nRetype new password: \npasswd: password updated successfully\n");
+}
+
+// A home directory with the files of /etc/skel
+static void make_home(sim_env_t* env, const char* path, uint32_t uid, uint32_t gid) {
+    static const struct {
+        const char* name;
+        uint32_t size;
+    } skel[] = { { ".bash_logout", 220 }, { ".bashrc", 3526 }, { ".profile", 807 } };
+    char name[256];
+    uint32_t dir, home, ino;
+    size_t i;
+
+    if (vfs_resolve_parent(env->vfs, VFS_ROOT, path, &dir, name, sizeof(name)) != 0) return;
+    if (vfs_create(env->vfs, dir, name, S_IFDIR | 0700, uid, gid, env->clock, &home) != 0) return;
+    for (i = 0; i < sizeof(skel) / sizeof(skel[0]); i++) {
+        if (vfs_create(env->vfs, home, skel[i].name, S_IFREG | 0644, uid, gid, env->clock, &ino) == 0) {
+            vfs_set_size(env->vfs, ino, skel[i].size, env->clock);
+        }
+    }
+}
+
+static int adduser_to_group(nss_db_t* db, const char* user, const char* group) {
+    uint32_t g = nss_group_by_name(db, group);
+
+    if (nss_user_by_name(db, user) == NSS_NONE) {
+        con_printf("adduser: The user `%s' does not exist.\n", user);
+        return 1;
+    }
+    if (g == NSS_NONE) {
+        con_printf("adduser: The group `%s' does not exist.\n", group);
+        return 1;
+    }
+    if (is_member(db, g, user)) {
+        con_printf("The user `%s' is already a member of `%s'.\n", user, group);
+        return 0;
+    }
+    con_printf("Adding user `%s' to group `%s' ...\n", user, group);
+    add_member(db, g, add_cstring(db, user));
+    db->dirty |= NSS_GROUP;
+    if (commit(db, "adduser") != 0) return 1;
+    con_printf("Done.\n");
+    return 0;
+}
+
+typedef struct {
+    const char* gecos;
+    const char* home;
+    const char* shell;
+    const char* ingroup;
+    uint32_t uid;
+    int system, no_password;
+} adduser_opts_t;
+
+static int create_user(nss_db_t* db, const char* name, const adduser_opts_t* a) {
+    sim_env_t* env = sim_env();
+    char home[MAX_PATH], hash[128], gecos[256];
+    uint32_t uid = a->uid, gid, name_off, g = NSS_NONE;
+    nss_user_t u;
+
+    if (nss_user_by_name(db, name) != NSS_NONE) {
+        con_printf("adduser: The user `%s' already exists.\n", name);
+        return 1;
+    }
+    if (!valid_name(name)) {
+        con_printf("adduser: Please enter a username matching the regular expression\n"
+                   "configured via the NAME_REGEX configuration variable.  Use the `--allow-bad-names'\n"
+                   "option to relax this check or reconfigure NAME_REGEX in configuration.\n");
+        return 1;
+    }
+    if (uid == NSS_NONE) {
+        uid = a->system ? free_id(db, 0, FIRST_SYSTEM_UID, LAST_SYSTEM_UID) : free_id(db, 0, FIRST_UID, LAST_UID);
+        if (uid == NSS_NONE) {
+            con_printf("adduser: No UID is available in the range %u-%u (%s).\n", a->system ? FIRST_SYSTEM_UID : FIRST_UID,
+                       a->system ? LAST_SYSTEM_UID : LAST_UID, a->system ? "FIRST_SYS_UID - LAST_SYS_UID" : "FIRST_UID - LAST_UID");
+            return 1;
+        }
+    } else if (nss_user_by_uid(db, uid) != NSS_NONE) {
+        con_printf("adduser: The UID %u is already in use.\n", uid);
+        return 1;
+    }
+    if (a->ingroup && (g = nss_group_by_name(db, a->ingroup)) == NSS_NONE) {
+        con_printf("adduser: The group `%s' does not exist.\n", a->ingroup);
+        return 1;
+    }
+    if (!a->ingroup && !a->system && nss_group_by_name(db, name) != NSS_NONE) {
+        con_printf("adduser: The group `%s' already exists.\n", name);
+        return 1;
+    }
+
+    name_off = add_cstring(db, name);
+    snprintf(home, sizeof(home), "%s", a->home ? a->home : a->system ? "/nonexistent" : "/home/");
+    if (!a->home && !a->system) snprintf(home, sizeof(home), "/home/%s", name);
+    if (a->ingroup) {
+        gid = db->groups[g].gid;
+    } else if (a->system) {
+        gid = GID_NOGROUP;
+    } else {
+        gid = nss_group_by_gid(db, uid) == NSS_NONE ? uid : free_id(db, 1, FIRST_UID, LAST_UID);
+        if (gid == NSS_NONE) {
+            con_printf("adduser: No GID is available in the range %u-%u (FIRST_GID - LAST_GID).\n", FIRST_UID, LAST_UID);
+            return 1;
+        }
+    }
+
+    if (a->system) {
+        con_printf("Adding system user `%s' (UID %u) ...\n", name, uid);
+        con_printf("Adding new user `%s' (UID %u) with group `%s' ...\n", name, uid, group_name_or_id(db, gid, hash, sizeof(hash)));
+    } else {
+        con_printf("Adding user `%s' ...\n", name);
+        if (!a->ingroup) {
+            con_printf("Adding new group `%s' (%u) ...\n", name, gid);
+            add_group(db, name_off, add_cstring(db, "x"), gid);
+        }
+        con_printf("Adding new user `%s' (%u) with group `%s' ...\n", name, uid, a->ingroup ? a->ingroup : name);
+    }
+    snprintf(gecos, sizeof(gecos), "%s", a->gecos ? a->gecos : ",,,");
+    u.name = name_off;
+    u.passwd = add_cstring(db, "x");
+    u.uid = uid;
+    u.gid = gid;
+    u.gecos = add_cstring(db, a->system && !a->gecos ? "" : gecos);
+    u.dir = add_cstring(db, home);
+    u.shell = add_cstring(db, a->shell ? a->shell : a->system ? "/usr/sbin/nologin" : "/bin/bash");
+    add_user(db, &u);
+
+    if (a->system && !a->home) {
+        con_printf("Not creating `%s'.\n", home);
+    } else {
+        con_printf("Creating home directory `%s' ...\n", home);
+        make_home(env, home, uid, gid);
+        if (!a->system) con_printf("Copying files from `/etc/skel' ...\n");
+    }
+    if (a->system || a->no_password) {
+        add_shadow_entry(db, name_off, a->system ? "!" : "!", env->clock);
+    } else {
+        // Nobody types at the simulated prompts: they take what was
+        // typed in the lesson
+        print_password_prompts();
+        make_hash(name, env->clock, hash, sizeof(hash));
+        add_shadow_entry(db, name_off, hash, env->clock);
+    }
+    if (!a->system && !a->gecos) {
+        con_printf("Changing the user information for %s\n"
+                   "Enter the new value, or press ENTER for the default\n"
+                   "\tFull Name []: \n\tRoom Number []: \n\tWork Phone []: \n\tHome Phone []: \n\tOther []: \n"
+                   "Is the information correct? [Y/n] Y\n",
+                   name);
+    }
+    db->dirty |= NSS_PASSWD | NSS_GROUP | NSS_SHADOW;
+    return commit(db, "adduser") != 0;
+}
+
+int nss_cmd_adduser(int argc, char** argv) {
+    adduser_opts_t a;
+    const char* operands[2];
+    nss_db_t* db;
+    int n = 0, i, status;
+
+    memset(&a, 0, sizeof(a));
+    a.uid = NSS_NONE;
+    for (i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char** value = NULL;
+
+        if (strcmp(arg, "--system") == 0) {
+            a.system = 1;
+        } else if (strcmp(arg, "--disabled-password") == 0 || strcmp(arg, "--disabled-login") == 0) {
+            a.no_password = 1;
+        } else if (strcmp(arg, "--quiet") == 0 || strcmp(arg, "-q") == 0 || strcmp(arg, "--allow-bad-names") == 0) {
+            continue;
+        } else if (strcmp(arg, "--gecos") == 0 || strcmp(arg, "--comment") == 0) {
+            value = &a.gecos;
+        } else if (strcmp(arg, "--home") == 0) {
+            value = &a.home;
+        } else if (strcmp(arg, "--shell") == 0) {
+            value = &a.shell;
+        } else if (strcmp(arg, "--ingroup") == 0) {
+            value = &a.ingroup;
+        } else if (strcmp(arg, "--uid") == 0) {
+            const char* v = i + 1 < argc ? argv[++i] : "";
+
+            if (parse_id(v, &a.uid) != 0) {
+                con_printf("adduser: --uid: invalid number '%s'\n", v);
+                return 1;
+            }
+        } else if (arg[0] == '-') {
+            return -1;
+        } else if (n < 2) {
+            operands[n++] = arg;
+        } else {
+            con_printf("adduser: Only one or two names allowed.\n");
+            return 1;
+        }
+        if (value) {
+            if (i + 1 == argc) {
+                con_printf("adduser: option '%s' requires an argument\n", arg);
+                return 1;
+            }
+            *value = argv[++i];
+        }
+    }
+    if (sim_env()->euid != 0) {
+        con_printf("adduser: Only root may add a user or group to the system.\n");
+        return 1;
+    }
+    if (!n) {
+        con_printf("adduser: Only one or two names allowed.\n");
+        return 1;
+    }
+    db = nss_session_for_change();
+    pthread_mutex_lock(&db->lock);
+    status = n == 2 ? adduser_to_group(db, operands[0], operands[1]) : create_user(db, operands[0], &a);
+    pthread_mutex_unlock(&db->lock);
+    return status;
+}
+
+static int usermod_usage(void) {
+    con_printf("Usage: usermod [options] LOGIN\n\n"
+               "Options:\n"
+               "  -a, --append                  append the user to the supplemental GROUPS\n"
+               "                                mentioned by the -G option without removing\n"
+               "                                the user from other groups\n"
+               "  -c, --comment COMMENT         new value of the GECOS field\n"
+               "  -d, --home HOME_DIR           new home directory for the user account\n"
+               "  -g, --gid GROUP               force use GROUP as new primary group\n"
+               "  -G, --groups GROUPS           new list of supplementary GROUPS\n"
+               "  -L, --lock                    lock the user account\n"
+               "  -m, --move-home               move contents of the home directory to the\n"
+               "                                new location (use only with -d)\n"
+               "  -s, --shell SHELL             new login shell for the user account\n"
+               "  -U, --unlock                  unlock the user account\n");
+    return 2;
+}
+
+int nss_cmd_usermod(int argc, char** argv) {
+    const char* values[128] = { 0 };
+    const char* login = NULL;
+    uint32_t supp[MAX_GROUPS], n_supp = 0, u, s, i, gid = 0;
+    int flags[128] = { 0 }, k, status = 0;
+    sim_env_t* env = sim_env();
+    nss_db_t* db;
+
+    // Several options take values, which sim_getopt() does not do
+    for (k = 1; k < argc; k++) {
+        const char* p = argv[k];
+
+        if (p[0] != '-' || !p[1]) {
+            if (login) return usermod_usage();
+            login = p;
+            continue;
+        }
+        for (p++; *p; p++) {
+            unsigned char c = (unsigned char)*p;
+
+            if (!strchr("acdgGLmsU", c)) return -1;
+            flags[c] = 1;
+            if (strchr("cdgGs", c)) {
+                if (p[1]) {
+                    values[c] = p + 1;
+                } else if (k + 1 < argc) {
+                    values[c] = argv[++k];
+                } else {
+                    con_printf("usermod: option requires an argument -- '%c'\n", c);
+                    return usermod_usage();
+                }
+                break;
+            }
+        }
+    }
+    if (!login) return usermod_usage();
+    if (flags['a'] && !flags['G']) {
+        con_printf("usermod: -a flag is only allowed with the -G flag\n");
+        return usermod_usage();
+    }
+    if (flags['L'] && flags['U']) {
+        con_printf("usermod: the -L and -U flags are exclusive\n");
+        return usermod_usage();
+    }
+    if (env->euid != 0) {
+        con_printf("usermod: Permission denied.\nusermod: cannot lock /etc/passwd; try again later.\n");
+        return 1;
+    }
+
+    db = nss_session_for_change();
+    pthread_mutex_lock(&db->lock);
+    u = nss_user_by_name(db, login);
+    if (u == NSS_NONE) {
+        con_printf("usermod: user '%s' does not exist\n", login);
+        status = 6;
+        goto out;
+    }
+    if (values['g']) {
+        uint32_t g = nss_group_by_name(db, values['g']);
+
+        if (g == NSS_NONE && parse_id(values['g'], &gid) == 0) g = nss_group_by_gid(db, gid);
+        if (g == NSS_NONE) {
+            con_printf("usermod: group '%s' does not exist\n", values['g']);
+            status = 6;
+            goto out;
+        }
+        gid = db->groups[g].gid;
+    }
+    if (values['G']) {
+        const char* p = values['G'];
+
+        while (*p) {
+            char name[NAME_MAX_LEN + 1];
+            size_t len = strcspn(p, ",");
+            uint32_t g, id;
+
+            snprintf(name, sizeof(name), "%.*s", (int)len, p);
+            g = nss_group_by_name(db, name);
+            if (g == NSS_NONE && parse_id(name, &id) == 0) g = nss_group_by_gid(db, id);
+            if (len && g == NSS_NONE) {
+                con_printf("usermod: group '%s' does not exist\n", name);
+                status = 6;
+                goto out;
+            }
+            if (len && n_supp < MAX_GROUPS) supp[n_supp++] = g;
+            p += len;
+            if (*p) p++;
+        }
+    }
+    s = nss_shadow_by_name(db, login);
+    if ((flags['L'] || flags['U']) && s == NSS_NONE) {
+        con_printf("usermod: user '%s' does not exist in /etc/shadow\n", login);
+        status = 6;
+        goto out;
+    }
+
+    if (values['g']) {
+        db->users[u].gid = gid;
+        db->dirty |= NSS_PASSWD;
+    }
+    if (values['c']) {
+        db->users[u].gecos = add_cstring(db, values['c']);
+        db->dirty |= NSS_PASSWD;
+    }
+    if (values['d']) {
+        db->users[u].dir = add_cstring(db, values['d']);
+        db->dirty |= NSS_PASSWD;
+    }
+    if (values['s']) {
+        db->users[u].shell = add_cstring(db, values['s']);
+        db->dirty |= NSS_PASSWD;
+    }
+    if (values['G']) {
+        if (!flags['a']) {
+            uint32_t m;
+
+            // -G without -a: out of every group not listed
+            for (m = find_name(db, &db->member_by_name, KEY_MEMBER_NAME, login); m != NSS_NONE; m = db->members[m].next_of_name) {
+                uint32_t g = db->members[m].group;
+                int keep = 0;
+
+                for (i = 0; i < n_supp; i++) keep |= supp[i] == g;
+                if (g != NSS_NONE && !keep) remove_member(db, g, login);
+            }
+        }
+        for (i = 0; i < n_supp; i++) {
+            if (!is_member(db, supp[i], login)) add_member(db, supp[i], db->users[u].name);
+        }
+        db->dirty |= NSS_GROUP;
+    }
+    if (flags['L'] && nss_str(db, db->shadow[s].passwd)[0] != '!') {
+        char locked[256];
+
+        snprintf(locked, sizeof(locked), "!%s", nss_str(db, db->shadow[s].passwd));
+        db->shadow[s].passwd = add_cstring(db, locked);
+        db->dirty |= NSS_SHADOW;
+    }
+    if (flags['U'] && nss_str(db, db->shadow[s].passwd)[0] == '!') {
+        if (!nss_str(db, db->shadow[s].passwd)[1]) {
+            con_printf("usermod: unlocking the user's password would result in a passwordless account.\n"
+                       "You should set a password with usermod -p to unlock this user's password.\n");
+        } else {
+            db->shadow[s].passwd = add_cstring(db, nss_str(db, db->shadow[s].passwd) + 1);
+            db->dirty |= NSS_SHADOW;
+        }
+    }
+    if (db->dirty && commit(db, "usermod") != 0) status = 1;
+out:
+    pthread_mutex_unlock(&db->lock);
+    return status;
+}
+
+int nss_cmd_passwd(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    uint32_t u, s;
+    const char* login;
+    char hash[128], self[64];
+    nss_db_t* db;
+    sim_opts_t o;
+    int status = 0;
+
+    if (sim_getopt(argc, argv, "ludS", &o) < 0) return 1;
+    login = o.n_operands ? argv[1] : nss_user_name(session_uid(), self, sizeof(self));
+    db = nss_session_for_change();
+    pthread_mutex_lock(&db->lock);
+    u = nss_user_by_name(db, login);
+    if (u == NSS_NONE) {
+        con_printf("passwd: user '%s' does not exist\n", login);
+        status = 1;
+        goto out;
+    }
+    if (env->euid != 0 && (db->users[u].uid != env->uid || o.flags)) {
+        con_printf(o.flags && db->users[u].uid == env->uid ? "passwd: Permission denied.\n"
+                                                            : "passwd: You may not view or modify password information for %s.\n",
+                   login);
+        status = 1;
+        goto out;
+    }
+    s = nss_shadow_by_name(db, login);
+    if (s == NSS_NONE) {
+        con_printf("passwd: Authentication token manipulation error\npasswd: password unchanged\n");
+        status = 1;
+        goto out;
+    }
+    if (SIM_HAS(&o, 'S')) {
+        const char* pw = nss_str(db, db->shadow[s].passwd);
+        long day = atol(nss_str(db, db->shadow[s].lastchg));
+        time_t when = (time_t)day * 86400;
+        struct tm tm;
+        char date[16], rest[64];
+        char* p;
+
+        gmtime_r(&when, &tm);
+        strftime(date, sizeof(date), "%m/%d/%Y", &tm);
+        // min max warn inactive, with -1 for an empty inactive
+        snprintf(rest, sizeof(rest), "%s", nss_str(db, db->shadow[s].rest));
+        for (p = rest; *p; p++) {
+            if (*p == ':') *p = ' ';
+        }
+        p = rest;
+        con_printf("%s %s %s", login, pw[0] == '!' || pw[0] == '*' ? "L" : pw[0] ? "P" : "NP", date);
+        {
+            int field;
+
+            for (field = 0; field < 4; field++) {
+                size_t len = strcspn(p, " ");
+
+                con_printf(len ? " %.*s" : " -1", (int)len, p);
+                p += len;
+                if (*p) p++;
+            }
+        }
+        con_printf("\n");
+    } else if (SIM_HAS(&o, 'l') || SIM_HAS(&o, 'u') || SIM_HAS(&o, 'd')) {
+        const char* pw = nss_str(db, db->shadow[s].passwd);
+
+        if (SIM_HAS(&o, 'l') && pw[0] != '!') {
+            snprintf(hash, sizeof(hash), "!%s", pw);
+            db->shadow[s].passwd = add_cstring(db, hash);
+        } else if (SIM_HAS(&o, 'u') && pw[0] == '!') {
+            db->shadow[s].passwd = add_cstring(db, pw + 1);
+        } else if (SIM_HAS(&o, 'd')) {
+            db->shadow[s].passwd = add_cstring(db, "");
+        }
+        db->dirty |= NSS_SHADOW;
+        if (commit(db, "passwd") != 0) {
+            status = 1;
+        } else {
+            con_printf("passwd: password changed.\n");
+        }
+    } else {
+        if (env->euid != 0) con_printf("Changing password for %s.\nCurrent password: \n", login);
+        print_password_prompts();
+        make_hash(login, env->clock, hash, sizeof(hash));
+        set_password(db, s, hash, env->clock);
+        if (commit(db, "passwd") != 0) status = 1;
+    }
+out:
+    pthread_mutex_unlock(&db->lock);
+    return status;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+static uint64_t bench_rng = 0x9E3779B97F4A7C15ull;
+
+// A directory dump: users u0000001.. with uids from 100000, all in
+// "users", and one group per hundred users, each with about 150 members
+static int write_dump(const char* dir, uint32_t n, uint32_t n_groups) {
+    char path[MAX_PATH];
+    FILE* f;
+    uint32_t i, j;
+
+    snprintf(path, sizeof(path), "%s/passwd", dir);
+    if (!(f = fopen(path, "w"))) return -1;
+    fputs(seed_passwd, f);
+    for (i = 0; i < n; i++) {
+        fprintf(f, "u%07u:x:%u:%u:Directory User %u,,,:/home/u%07u:/bin/bash\n", i, 100000 + i, GID_USERS, i, i);
+    }
+    if (fclose(f) != 0) return -1;
+
+    snprintf(path, sizeof(path), "%s/group", dir);
+    if (!(f = fopen(path, "w"))) return -1;
+    fputs(seed_group, f);
+    for (j = 0; j < n_groups; j++) {
+        uint32_t members = 100 + bench_random(&bench_rng, 100);
+
+        fprintf(f, "g%05u:x:%u:", j, 200000 + j);
+        for (i = 0; i < members; i++) fprintf(f, "%su%07u", i ? "," : "", bench_random(&bench_rng, n));
+        putc('\n', f);
+    }
+    if (fclose(f) != 0) return -1;
+
+    snprintf(path, sizeof(path), "%s/shadow", dir);
+    if (!(f = fopen(path, "w"))) return -1;
+    fputs(seed_shadow, f);
+    for (i = 0; i < n; i++) {
+        char hash[128], name[16];
+
+        snprintf(name, sizeof(name), "u%07u", i);
+        make_hash(name, i, hash, sizeof(hash));
+        fprintf(f, "%s:%s:19640:0:99999:7:::\n", name, hash);
+    }
+    return fclose(f);
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+// Whether two files have the same bytes
+static int same_file(const char* a, const char* b) {
+    FILE* fa = fopen(a, "r");
+    FILE* fb = fopen(b, "r");
+    char ba[65536], bb[65536];
+    int same = fa && fb;
+
+    while (same) {
+        size_t na = fread(ba, 1, sizeof(ba), fa), nb = fread(bb, 1, sizeof(bb), fb);
+
+        same = na == nb && memcmp(ba, bb, na) == 0;
+        if (!na) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+static uint64_t dump_bytes(const char* dir) {
+    char path[MAX_PATH];
+    struct stat st;
+    uint64_t total = 0;
+    int t;
+
+    for (t = 0; t < 3; t++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, table_files[t]);
+        if (stat(path, &st) == 0) total += (uint64_t)st.st_size;
+    }
+    return total;
+}
+
+int nss_bench(int argc, char** argv) {
+    long n = argc > 0 ? atol(argv[0]) : 1000000;
+    char dir[] = "/tmp/deb1-bench-XXXXXX";
+    char err[256], name[16], path[MAX_PATH], backup[MAX_PATH];
+    uint32_t groups[MAX_GROUPS], lookups = 1000000, i, sum = 0;
+    uint64_t bytes;
+    double start, elapsed;
+    nss_db_t* db;
+    nss_user_t u;
+    int rc = 0, t;
+
+    if (n < 1000) n = 1000;
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (write_dump(dir, (uint32_t)n, (uint32_t)(n / 100)) != 0) {
+        perror(dir);
+        nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return 1;
+    }
+    bytes = dump_bytes(dir);
+
+    start = bench_now();
+    db = nss_load(dir, err, sizeof(err));
+    elapsed = bench_now() - start;
+    if (!db) {
+        fprintf(stderr, "%s\n", err);
+        nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return 1;
+    }
+    bench_report("nss", "users", db->n_users, "users");
+    bench_report("nss", "memberships", db->n_members, "members");
+    bench_report("nss", "load", elapsed * 1e3, "ms");
+    bench_report("nss", "load_rate", bytes / elapsed / 1e6, "MB/s");
+
+    start = bench_now();
+    for (i = 0; i < lookups; i++) {
+        snprintf(name, sizeof(name), "u%07u", bench_random(&bench_rng, (uint32_t)n));
+        sum += nss_user_by_name(db, name);
+    }
+    bench_report("nss", "lookup_name", (bench_now() - start) / lookups * 1e9, "ns");
+    start = bench_now();
+    for (i = 0; i < lookups; i++) sum += nss_user_by_uid(db, 100000 + bench_random(&bench_rng, (uint32_t)n));
+    bench_report("nss", "lookup_uid", (bench_now() - start) / lookups * 1e9, "ns");
+    start = bench_now();
+    for (i = 0; i < lookups; i++) {
+        snprintf(name, sizeof(name), "u%07u", bench_random(&bench_rng, (uint32_t)n));
+        sum += nss_user_groups(db, name, GID_USERS, groups, MAX_GROUPS);
+    }
+    bench_report("nss", "user_groups", (bench_now() - start) / lookups * 1e9, "ns");
+    if (sum == 0) fprintf(stderr, "nss: no lookups succeeded\n");
+
+    // Writing back what was read must give the same bytes
+    db->dirty = NSS_PASSWD | NSS_GROUP | NSS_SHADOW;
+    start = bench_now();
+    if (nss_save(db, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        rc = 1;
+    }
+    elapsed = bench_now() - start;
+    bench_report("nss", "save", elapsed * 1e3, "ms");
+    bench_report("nss", "save_rate", bytes / elapsed / 1e6, "MB/s");
+    for (t = 0; t < 3; t++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, table_files[t]);
+        snprintf(backup, sizeof(backup), "%s/%s-", dir, table_files[t]);
+        if (!same_file(path, backup)) {
+            fprintf(stderr, "nss: %s changed on a save without changes\n", path);
+            rc = 1;
+        }
+    }
+
+    // adduser and usermod -aG, then what they write read back
+    start = bench_now();
+    u.name = add_cstring(db, "newuser");
+    u.passwd = add_cstring(db, "x");
+    u.uid = 100000 + (uint32_t)n;
+    u.gid = GID_USERS;
+    u.gecos = add_cstring(db, ",,,");
+    u.dir = add_cstring(db, "/home/newuser");
+    u.shell = add_cstring(db, "/bin/bash");
+    add_user(db, &u);
+    add_shadow_entry(db, u.name, "!", 1697380200);
+    add_member(db, nss_group_by_name(db, "sudo"), u.name);
+    db->dirty = NSS_PASSWD | NSS_GROUP | NSS_SHADOW;
+    bench_report("nss", "add_user", (bench_now() - start) * 1e6, "us");
+    start = bench_now();
+    if (nss_save(db, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        rc = 1;
+    }
+    bench_report("nss", "add_user_save", (bench_now() - start) * 1e3, "ms");
+    nss_free(db);
+
+    db = nss_load(dir, err, sizeof(err));
+    if (!db || db->n_users != (uint32_t)n + 26 || nss_user_by_name(db, "newuser") == NSS_NONE ||
+        nss_user_groups(db, "newuser", GID_USERS, groups, MAX_GROUPS) != 2) {
+        fprintf(stderr, "nss: the saved files do not read back with the new user%s%s\n", db ? "" : ": ", db ? "" : err);
+        rc = 1;
+    }
+    nss_free(db);
+    nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return rc;
+}
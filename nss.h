@@ -0,0 +1,143 @@
+#ifndef NSS_H
+#define NSS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Account database for simulation mode: what getent passwd/group/shadow
+// would ask NSS's "files" module for.
+//
+// The passwd, group and shadow files are read straight into one string
+// arena and split in place, so a field is an offset to its own bytes of
+// the file and loading a million users is one pass with no per-field
+// allocation. Each table is an array in file order (getent's order)
+// indexed by open-addressing hashes: users by name and by uid, groups by
+// name and by gid, shadow entries by name. Group members are records
+// chained both per group (for writing the member list back) and per
+// member name, so "id" finds a user's groups without scanning the group
+// file. Changes append to the arena and the tables; saving rewrites each
+// changed file next to the original, fsyncs it and renames it over, with
+// the old one kept as "FILE-" the way the shadow tools do.
+//
+// $DEB1_ACCOUNTS=DIR loads DIR/passwd, DIR/group and DIR/shadow once per
+// process and writes changes back there; every session shares it. Without
+// it each session gets its own copy of the lesson machine's accounts, and
+// changes only show in the simulated /etc.
+
+#define NSS_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t name, passwd, gecos, dir, shell;   // offsets into strings
+    uint32_t uid, gid;
+} nss_user_t;
+
+typedef struct {
+    uint32_t name, passwd;
+    uint32_t gid;
+    uint32_t first_member, last_member;         // NSS_NONE: no members
+} nss_group_t;
+
+typedef struct {
+    uint32_t name, passwd, lastchg;
+    uint32_t rest;          // min:max:warn:inactive:expire:reserved, as read
+} nss_shadow_t;
+
+typedef struct {
+    uint32_t name;          // member's name
+    uint32_t group;
+    uint32_t next_in_group;
+    uint32_t next_of_name;  // the same name's next group, in no order
+} nss_member_t;
+
+typedef struct {
+    uint32_t* slots;        // entry index + 1, 0 = empty
+    uint32_t mask, count;
+} nss_index_t;
+
+enum {
+    NSS_PASSWD = 0x01,
+    NSS_GROUP = 0x02,
+    NSS_SHADOW = 0x04
+};
+
+typedef struct nss_db {
+    nss_user_t* users;
+    uint32_t n_users, users_cap;
+    nss_group_t* groups;
+    uint32_t n_groups, groups_cap;
+    nss_shadow_t* shadow;
+    uint32_t n_shadow, shadow_cap;
+    nss_member_t* members;
+    uint32_t n_members, members_cap;
+
+    char* strings;
+    size_t strings_len, strings_cap;
+
+    nss_index_t user_by_name, user_by_uid;
+    nss_index_t group_by_name, group_by_gid;
+    nss_index_t shadow_by_name;
+    nss_index_t member_by_name;     // first member record of a name
+
+    char* dir;              // where it was loaded from; NULL: the lesson machine
+    uint8_t has_shadow;
+    uint8_t dirty;          // NSS_PASSWD | NSS_GROUP | NSS_SHADOW
+    uint32_t generation;    // counts the commands that changed something
+    pthread_mutex_t lock;   // held by the commands: a shared database changes
+} nss_db_t;
+
+// Load DIR/passwd, DIR/group and (if present) DIR/shadow. Returns NULL
+// after writing err.
+nss_db_t* nss_load(const char* dir, char* err, size_t err_len);
+// The lesson machine's accounts
+nss_db_t* nss_seed_debian(void);
+// A copy that belongs to no directory: its changes are never saved
+nss_db_t* nss_copy(nss_db_t* db);
+// Write the changed files back to the directory they came from.
+// Returns 0, or -1 after writing err.
+int nss_save(nss_db_t* db, char* err, size_t err_len);
+void nss_free(nss_db_t* db);
+
+static inline const char* nss_str(const nss_db_t* db, uint32_t off) {
+    return db->strings + off;
+}
+
+// Table indexes, or NSS_NONE
+uint32_t nss_user_by_name(const nss_db_t* db, const char* name);
+uint32_t nss_user_by_uid(const nss_db_t* db, uint32_t uid);
+uint32_t nss_group_by_name(const nss_db_t* db, const char* name);
+uint32_t nss_group_by_gid(const nss_db_t* db, uint32_t gid);
+uint32_t nss_shadow_by_name(const nss_db_t* db, const char* name);
+
+// The groups of a user as initgroups() sees them: gid's group first, then
+// the groups listing name, in file order. Returns the count, which may be
+// more than max.
+uint32_t nss_user_groups(const nss_db_t* db, const char* name, uint32_t gid, uint32_t* out, uint32_t max);
+
+// The session's accounts: the shared database, or the session's own
+// (see sim.h). Lock db->lock around use. Commands that change accounts
+// ask for nss_session_for_change(), which gives a session with
+// private_accounts its own copy of the shared database first.
+nss_db_t* nss_session(void);
+nss_db_t* nss_session_for_change(void);
+
+// For sim.h's name helpers: the session's name for an id, copied into
+// buf (the number when there is none), and the id of a name
+const char* nss_user_name(uint32_t uid, char* buf, size_t len);
+const char* nss_group_name(uint32_t gid, char* buf, size_t len);
+int nss_user_id(const char* name, uint32_t* uid);
+int nss_group_id(const char* name, uint32_t* gid);
+
+// Simulated commands (see sim.c)
+int nss_cmd_getent(int argc, char** argv);
+int nss_cmd_id(int argc, char** argv);
+int nss_cmd_groups(int argc, char** argv);
+int nss_cmd_whoami(int argc, char** argv);
+int nss_cmd_adduser(int argc, char** argv);
+int nss_cmd_usermod(int argc, char** argv);
+int nss_cmd_passwd(int argc, char** argv);
+
+// --bench nss [users]
+int nss_bench(int argc, char** argv);
+
+#endif
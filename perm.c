@@ -0,0 +1,1206 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "nss.h"
+#include "perm.h"
+#include "bench.h"
+#include "util.h"
+
+#define MAX_PATH 4096
+#define NAME_MAX_LEN 255
+#define MAX_ACL 64
+
+// Reach states, a byte per directory inode
+#define REACH_UNKNOWN 0
+#define REACH_NO 1
+#define REACH_YES 2
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// ---------------------------------------------------------------------
+// Credentials
+
+static void cred_sort(perm_cred_t* c) {
+    uint32_t i, n = 0;
+
+    qsort(c->groups, c->n_groups, sizeof(uint32_t), compare_u32);
+    for (i = 0; i < c->n_groups; i++) {
+        if (!n || c->groups[n - 1] != c->groups[i]) c->groups[n++] = c->groups[i];
+    }
+    c->n_groups = n;
+}
+
+int perm_cred_user(uint32_t uid, perm_cred_t* c) {
+    nss_db_t* db = nss_session();
+    uint32_t groups[PERM_MAX_GROUPS], u, n, i;
+
+    memset(c, 0, sizeof(*c));
+    c->uid = uid;
+    pthread_mutex_lock(&db->lock);
+    u = nss_user_by_uid(db, uid);
+    if (u == NSS_NONE) {
+        pthread_mutex_unlock(&db->lock);
+        c->gid = c->groups[0] = uid;
+        c->n_groups = 1;
+        return -1;
+    }
+    c->gid = db->users[u].gid;
+    n = nss_user_groups(db, nss_str(db, db->users[u].name), c->gid, groups, PERM_MAX_GROUPS - 1);
+    if (n > PERM_MAX_GROUPS - 1) n = PERM_MAX_GROUPS - 1;
+    for (i = 0; i < n; i++) c->groups[i] = db->groups[groups[i]].gid;
+    pthread_mutex_unlock(&db->lock);
+    // A primary gid with no group line is still the user's group
+    c->groups[n++] = c->gid;
+    c->n_groups = n;
+    cred_sort(c);
+    return 0;
+}
+
+void perm_cred_env(const sim_env_t* env, perm_cred_t* c) {
+    if (env->euid == 0) {
+        memset(c, 0, sizeof(*c));
+        c->n_groups = 1;
+        return;
+    }
+    if (perm_cred_user(env->euid, c) != 0 && env->euid == env->uid) {
+        c->gid = c->groups[0] = env->gid;
+    }
+}
+
+int perm_in_group(const perm_cred_t* c, uint32_t gid) {
+    uint32_t lo = 0, hi = c->n_groups;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (c->groups[mid] == gid) return 1;
+        if (c->groups[mid] < gid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Checks
+
+int perm_check(const vfs_t* fs, const perm_cred_t* c, uint32_t ino, uint32_t want) {
+    const vfs_inode_t* node = vfs_inode(fs, ino);
+    const vfs_acl_entry_t* acl;
+    uint32_t n, i, mask = 7, group_obj = (node->mode >> 3) & 7;
+    int matched = 0;
+
+    // Root is not checked, except that a file no one may execute stays so
+    if (c->uid == 0) return !(want & PERM_EXEC) || S_ISDIR(node->mode) || (node->mode & 0111);
+    if (node->uid == c->uid) return ((node->mode >> 6) & want) == want;
+
+    n = vfs_acl(fs, ino, &acl);
+    for (i = 0; i < n; i++) {
+        if (acl[i].tag == VFS_ACL_MASK) mask = acl[i].perm;
+        if (acl[i].tag == VFS_ACL_GROUP_OBJ) group_obj = acl[i].perm;
+    }
+    for (i = 0; i < n; i++) {
+        if (acl[i].tag == VFS_ACL_USER && acl[i].id == c->uid) return (acl[i].perm & mask & want) == want;
+    }
+
+    // The group class: any matching entry that grants will do
+    if (perm_in_group(c, node->gid)) {
+        if ((group_obj & mask & want) == want) return 1;
+        matched = 1;
+    }
+    for (i = 0; i < n; i++) {
+        if (acl[i].tag != VFS_ACL_GROUP || !perm_in_group(c, acl[i].id)) continue;
+        if ((acl[i].perm & mask & want) == want) return 1;
+        matched = 1;
+    }
+    if (matched) return 0;
+    return (node->mode & want) == want;
+}
+
+int perm_check_unlink(const vfs_t* fs, const perm_cred_t* c, uint32_t dir, uint32_t ino) {
+    const vfs_inode_t* d = vfs_inode(fs, dir);
+
+    if (!perm_check(fs, c, dir, PERM_WRITE | PERM_EXEC)) return 0;
+    return !(d->mode & S_ISVTX) || c->uid == 0 || c->uid == d->uid || c->uid == vfs_inode(fs, ino)->uid;
+}
+
+// ---------------------------------------------------------------------
+// The reach cache
+
+struct perm_cache {
+    perm_cred_t cred;
+    const vfs_t* fs;
+    uint64_t generation;
+    uint8_t* reach;         // REACH_* per inode
+    uint32_t reach_cap;
+    uint32_t* chain;        // directories on the way down, for perm_reach
+    uint32_t chain_cap;
+
+    // What the session's cache was made for
+    uint32_t euid;
+    uint32_t accounts_generation;
+    const void* accounts;
+};
+
+perm_cache_t* perm_cache_new(const perm_cred_t* c) {
+    perm_cache_t* pc = calloc(1, sizeof(*pc));
+
+    if (!pc) {
+        perror("calloc");
+        exit(1);
+    }
+    pc->cred = *c;
+    return pc;
+}
+
+void perm_cache_free(perm_cache_t* pc) {
+    if (!pc) return;
+    free(pc->reach);
+    free(pc->chain);
+    free(pc);
+}
+
+const perm_cred_t* perm_cache_cred(const perm_cache_t* pc) {
+    return &pc->cred;
+}
+
+int perm_reach(perm_cache_t* pc, const vfs_t* fs, uint32_t dir) {
+    uint32_t n = 0, ino, i;
+    uint8_t state;
+
+    if (pc->fs != fs || pc->generation != vfs_generation(fs)) {
+        if (pc->reach) memset(pc->reach, REACH_UNKNOWN, pc->reach_cap);
+        pc->fs = fs;
+        pc->generation = vfs_generation(fs);
+    }
+    if (dir >= pc->reach_cap) {
+        uint32_t cap = pc->reach_cap ? pc->reach_cap : 1024;
+
+        while (cap <= dir) cap *= 2;
+        pc->reach = xrealloc(pc->reach, cap);
+        memset(pc->reach + pc->reach_cap, REACH_UNKNOWN, cap - pc->reach_cap);
+        pc->reach_cap = cap;
+    }
+    if (pc->reach[dir] != REACH_UNKNOWN) return pc->reach[dir] == REACH_YES;
+
+    // Up to the nearest directory with a known answer (or /), then down
+    // again deciding each one
+    for (ino = dir;; ino = vfs_inode(fs, ino)->parent) {
+        if (n == pc->chain_cap) {
+            pc->chain_cap = pc->chain_cap ? pc->chain_cap * 2 : 64;
+            pc->chain = xrealloc(pc->chain, pc->chain_cap * sizeof(uint32_t));
+        }
+        pc->chain[n++] = ino;
+        if (ino == VFS_ROOT || (vfs_inode(fs, ino)->parent < pc->reach_cap && pc->reach[vfs_inode(fs, ino)->parent] != REACH_UNKNOWN)) {
+            break;
+        }
+    }
+    ino = pc->chain[n - 1];
+    state = ino == VFS_ROOT ? REACH_YES : pc->reach[vfs_inode(fs, ino)->parent];
+    for (i = n; i-- > 0;) {
+        ino = pc->chain[i];
+        if (state == REACH_YES && !perm_check(fs, &pc->cred, ino, PERM_EXEC)) state = REACH_NO;
+        // Ancestors are below dir's number only by chance: grow for any
+        if (ino >= pc->reach_cap) continue;
+        pc->reach[ino] = state;
+    }
+    return state == REACH_YES;
+}
+
+int perm_lookup(perm_cache_t* pc, const vfs_t* fs, uint32_t cwd, const char* path, uint32_t* ino) {
+    char name[NAME_MAX_LEN + 1];
+    uint32_t dir;
+    int err = vfs_resolve_parent(fs, cwd, path, &dir, name, sizeof(name));
+
+    if (err) return err;
+    if (!perm_reach(pc, fs, dir)) return -EACCES;
+    // "/", "dir/.", "dir/..": as resolved
+    if (!name[0] || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return vfs_resolve(fs, cwd, path, ino);
+    *ino = vfs_lookup(fs, dir, name);
+    if (*ino == VFS_NONE) return -ENOENT;
+    if (path[strlen(path) - 1] == '/' && !S_ISDIR(vfs_inode(fs, *ino)->mode)) return -ENOTDIR;
+    return 0;
+}
+
+int perm_access(perm_cache_t* pc, const vfs_t* fs, uint32_t cwd, const char* path, uint32_t want) {
+    uint32_t ino;
+    int err = perm_lookup(pc, fs, cwd, path, &ino);
+
+    if (err) return err;
+    return !want || perm_check(fs, &pc->cred, ino, want) ? 0 : -EACCES;
+}
+
+// ---------------------------------------------------------------------
+// The session's
+
+static perm_cache_t* session_cache(sim_env_t* env) {
+    nss_db_t* db = nss_session();
+    perm_cache_t* pc = env->perms;
+    perm_cred_t c;
+
+    if (pc && pc->euid == env->euid && pc->accounts == db && pc->accounts_generation == db->generation) return pc;
+    perm_cred_env(env, &c);
+    if (pc && memcmp(&pc->cred, &c, sizeof(c)) == 0) {
+        // Same credential: what was reached still is
+    } else {
+        perm_cache_free(pc);
+        pc = env->perms = perm_cache_new(&c);
+    }
+    pc->euid = env->euid;
+    pc->accounts = db;
+    pc->accounts_generation = db->generation;
+    return pc;
+}
+
+const perm_cred_t* perm_session_cred(sim_env_t* env) {
+    return &session_cache(env)->cred;
+}
+
+int perm_resolve(sim_env_t* env, const char* path, uint32_t* ino) {
+    return perm_lookup(session_cache(env), env->vfs, env->cwd, path, ino);
+}
+
+int perm_resolve_parent(sim_env_t* env, const char* path, uint32_t* dir, char* name, size_t name_len) {
+    int err = vfs_resolve_parent(env->vfs, env->cwd, path, dir, name, name_len);
+
+    if (!err && !perm_reach(session_cache(env), env->vfs, *dir)) err = -EACCES;
+    return err;
+}
+
+int perm_may(sim_env_t* env, uint32_t ino, uint32_t want) {
+    return perm_check(env->vfs, &session_cache(env)->cred, ino, want);
+}
+
+int perm_may_unlink(sim_env_t* env, uint32_t dir, uint32_t ino) {
+    return perm_check_unlink(env->vfs, &session_cache(env)->cred, dir, ino);
+}
+
+// ---------------------------------------------------------------------
+// chmod
+
+// Who-masks of symbolic modes
+#define WHO_U (S_ISUID | 0700)
+#define WHO_G (S_ISGID | 0070)
+#define WHO_O (S_ISVTX | 0007)
+
+// chmod's MODE against a file's current one: octal, or symbolic clauses
+// like "u+x,go-w" and "g=u". Returns -1 if it is neither.
+static int apply_mode(const char* text, uint32_t old, int is_dir, uint32_t umask, uint32_t* out) {
+    uint32_t mode = old & 07777;
+    const char* p = text;
+
+    if (*p >= '0' && *p <= '7') {
+        uint32_t value = 0;
+        size_t len = 0;
+
+        for (; *p >= '0' && *p <= '7'; p++, len++) value = value * 8 + (uint32_t)(*p - '0');
+        if (*p || len > 4) return -1;
+        // Short octal modes leave a directory's setuid and setgid alone
+        if (is_dir && len < 5) value |= old & (S_ISUID | S_ISGID);
+        *out = value;
+        return 0;
+    }
+    while (1) {
+        uint32_t who = 0;
+        int masked;
+
+        for (; *p && strchr("ugoa", *p); p++) {
+            who |= *p == 'u' ? WHO_U : *p == 'g' ? WHO_G : *p == 'o' ? WHO_O : WHO_U | WHO_G | WHO_O;
+        }
+        // No who: all, less the umask's bits
+        masked = !who;
+        if (!who) who = WHO_U | WHO_G | WHO_O;
+        if (*p != '+' && *p != '-' && *p != '=') return -1;
+        while (*p == '+' || *p == '-' || *p == '=') {
+            char op = *p++;
+            uint32_t bits = 0;
+
+            if (*p && strchr("ugo", *p)) {
+                uint32_t from = *p == 'u' ? (mode >> 6) & 7 : *p == 'g' ? (mode >> 3) & 7 : mode & 7;
+
+                bits = from * 0111;
+                p++;
+            } else {
+                for (; *p && strchr("rwxXst", *p); p++) {
+                    switch (*p) {
+                        case 'r': bits |= 0444; break;
+                        case 'w': bits |= 0222; break;
+                        case 'x': bits |= 0111; break;
+                        case 'X':
+                            if (is_dir || (mode & 0111)) bits |= 0111;
+                            break;
+                        case 's': bits |= S_ISUID | S_ISGID; break;
+                        case 't': bits |= S_ISVTX; break;
+                    }
+                }
+            }
+            bits &= who;
+            if (masked) bits &= ~umask | ~0777u;
+            if (op == '+') {
+                mode |= bits;
+            } else if (op == '-') {
+                mode &= ~bits;
+            } else {
+                // A directory's setuid and setgid stay unless named
+                uint32_t keep = is_dir ? (S_ISUID | S_ISGID) & ~bits & who : 0;
+
+                mode = (mode & ~who) | bits | (old & keep);
+            }
+        }
+        if (!*p) break;
+        if (*p++ != ',') return -1;
+    }
+    *out = mode;
+    return 0;
+}
+
+typedef struct {
+    sim_env_t* env;
+    const char* command;
+    int recursive, verbose, changes;
+    int status;
+} walk_opts_t;
+
+typedef int (*apply_fn)(walk_opts_t* w, uint32_t ino, const char* path, const void* arg);
+
+// Apply to path and, with -R, everything below it that can be read
+static void apply_tree(walk_opts_t* w, uint32_t ino, char* path, size_t len, apply_fn fn, const void* arg) {
+    const vfs_t* fs = w->env->vfs;
+    const vfs_inode_t* node = vfs_inode(fs, ino);
+    vfs_dirent_t* children;
+    uint32_t i, n;
+
+    if (fn(w, ino, path, arg) != 0) w->status = 1;
+    if (!w->recursive || !S_ISDIR(node->mode)) return;
+    if (!perm_may(w->env, ino, PERM_READ | PERM_EXEC)) {
+        sim_error(w->command, "cannot read directory '%s': %s", path, strerror(EACCES));
+        w->status = 1;
+        return;
+    }
+    n = node->n_children;
+    children = xrealloc(NULL, (n ? n : 1) * sizeof(vfs_dirent_t));
+    vfs_sorted_children(fs, ino, children);
+    for (i = 0; i < n; i++) {
+        const char* name = vfs_name(fs, children[i].name);
+        size_t name_len = strlen(name), child_len = len + (path[len - 1] == '/' ? 0 : 1) + name_len;
+
+        if (child_len >= MAX_PATH) continue;
+        if (path[len - 1] != '/') path[len] = '/';
+        memcpy(path + child_len - name_len, name, name_len + 1);
+        apply_tree(w, children[i].ino, path, child_len, fn, arg);
+        path[len] = '\0';
+    }
+    free(children);
+}
+
+// Resolve each operand and apply
+static int apply_operands(walk_opts_t* w, char** operands, int n, apply_fn fn, const void* arg) {
+    char path[MAX_PATH];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t ino;
+        int err = perm_resolve(w->env, operands[i], &ino);
+
+        if (err) {
+            sim_error(w->command, "cannot access '%s': %s", operands[i], strerror(-err));
+            w->status = 1;
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s", operands[i]);
+        apply_tree(w, ino, path, strlen(path), fn, arg);
+    }
+    return w->status;
+}
+
+static int chmod_one(walk_opts_t* w, uint32_t ino, const char* path, const void* arg) {
+    sim_env_t* env = w->env;
+    const vfs_inode_t* node = vfs_inode(env->vfs, ino);
+    const perm_cred_t* c = perm_session_cred(env);
+    uint32_t old = node->mode & 07777, mode;
+
+    if (apply_mode(arg, node->mode, S_ISDIR(node->mode), env->umask, &mode) != 0) return 1;
+    if (c->uid != 0 && c->uid != node->uid) {
+        sim_error("chmod", "changing permissions of '%s': %s", path, strerror(EPERM));
+        return 1;
+    }
+    // Only a member of the file's group may make it setgid
+    if (c->uid != 0 && !S_ISDIR(node->mode) && !perm_in_group(c, node->gid)) mode &= ~(uint32_t)S_ISGID;
+    vfs_chmod(env->vfs, ino, mode, env->clock);
+    if (w->verbose || (w->changes && mode != old)) {
+        con_printf(mode != old ? "mode of '%s' changed from %04o to %04o\n" : "mode of '%s' retained as %04o%.0o\n", path, old,
+                   mode);
+    }
+    return 0;
+}
+
+int perm_cmd_chmod(int argc, char** argv) {
+    walk_opts_t w;
+    const char* mode_text = NULL;
+    char* operands[64];
+    int n = 0, i, only_operands = 0;
+    uint32_t probe;
+
+    memset(&w, 0, sizeof(w));
+    w.env = sim_env();
+    w.command = "chmod";
+    // "-w" is a mode, not an option: sim_getopt() would take it
+    for (i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+
+        if (!only_operands && strcmp(arg, "--") == 0) {
+            only_operands = 1;
+        } else if (!only_operands && (strcmp(arg, "-R") == 0 || strcmp(arg, "--recursive") == 0)) {
+            w.recursive = 1;
+        } else if (!only_operands && (strcmp(arg, "-v") == 0 || strcmp(arg, "--verbose") == 0)) {
+            w.verbose = 1;
+        } else if (!only_operands && (strcmp(arg, "-c") == 0 || strcmp(arg, "--changes") == 0)) {
+            w.changes = 1;
+        } else if (!only_operands && arg[0] == '-' && arg[1] == '-') {
+            return -1;
+        } else if (!mode_text) {
+            mode_text = arg;
+        } else if (n < 64) {
+            operands[n++] = argv[i];
+        }
+    }
+    if (!mode_text) {
+        sim_error("chmod", "missing operand\nTry 'chmod --help' for more information.");
+        return 1;
+    }
+    if (apply_mode(mode_text, 0, 0, 0, &probe) != 0) {
+        sim_error("chmod", "invalid mode: ‘%s’\nTry 'chmod --help' for more information.", mode_text);
+        return 1;
+    }
+    if (!n) {
+        sim_error("chmod", "missing operand after ‘%s’\nTry 'chmod --help' for more information.", mode_text);
+        return 1;
+    }
+    return apply_operands(&w, operands, n, chmod_one, mode_text);
+}
+
+// ---------------------------------------------------------------------
+// chown, chgrp
+
+typedef struct {
+    uint32_t uid, gid;      // UINT32_MAX: unchanged
+} owner_t;
+
+static int chown_one(walk_opts_t* w, uint32_t ino, const char* path, const void* arg) {
+    const owner_t* to = arg;
+    sim_env_t* env = w->env;
+    const vfs_inode_t* node = vfs_inode(env->vfs, ino);
+    const perm_cred_t* c = perm_session_cred(env);
+    uint32_t uid = to->uid == UINT32_MAX ? node->uid : to->uid;
+    uint32_t gid = to->gid == UINT32_MAX ? node->gid : to->gid;
+    uint32_t mode = node->mode & 07777;
+    int group_only = to->uid == UINT32_MAX;
+
+    // Giving a file away takes root; an owner may only pick one of their groups
+    if (c->uid != 0 && (uid != node->uid || c->uid != node->uid || (gid != node->gid && !perm_in_group(c, gid)))) {
+        sim_error(w->command, "changing %s of '%s': %s", group_only ? "group" : "ownership", path, strerror(EPERM));
+        return 1;
+    }
+    // Changing owners drops setuid, and setgid on group-executables
+    if (!S_ISDIR(node->mode)) {
+        if (mode & 0111) mode &= ~(uint32_t)S_ISUID;
+        if ((mode & (S_ISGID | 0010)) == (S_ISGID | 0010)) mode &= ~(uint32_t)S_ISGID;
+    }
+    if (w->verbose || (w->changes && (uid != node->uid || gid != node->gid))) {
+        int same = uid == node->uid && gid == node->gid;
+
+        if (group_only) {
+            con_printf(same ? "group of '%s' retained as %s\n" : "changed group of '%s' from %s", path, sim_group_name(node->gid));
+            if (!same) con_printf(" to %s\n", sim_group_name(gid));
+        } else {
+            char old_owner[80];
+
+            snprintf(old_owner, sizeof(old_owner), "%s:%s", sim_user_name(node->uid), sim_group_name(node->gid));
+            con_printf(same ? "ownership of '%s' retained as %s\n" : "changed ownership of '%s' from %s", path, old_owner);
+            if (!same) con_printf(" to %s:%s\n", sim_user_name(uid), sim_group_name(gid));
+        }
+    }
+    vfs_chown(env->vfs, ino, uid, gid, env->clock);
+    if (mode != (node->mode & 07777)) vfs_chmod(env->vfs, ino, mode, env->clock);
+    return 0;
+}
+
+// chown's OWNER[:[GROUP]] (or "."): "bob:" is bob and bob's login group
+static int parse_owner(const char* spec, owner_t* to, char* bad, size_t bad_len) {
+    const char* colon = strpbrk(spec, ":.");
+    char user[NAME_MAX_LEN + 1];
+    perm_cred_t c;
+
+    to->uid = to->gid = UINT32_MAX;
+    snprintf(user, sizeof(user), "%.*s", colon ? (int)(colon - spec) : (int)strlen(spec), spec);
+    if (user[0] && sim_user_id(user, &to->uid) != 0) {
+        snprintf(bad, bad_len, "invalid user: ‘%s’", spec);
+        return -1;
+    }
+    if (!colon) return 0;
+    if (colon[1]) {
+        if (sim_group_id(colon + 1, &to->gid) != 0) {
+            snprintf(bad, bad_len, "invalid group: ‘%s’", spec);
+            return -1;
+        }
+    } else if (user[0]) {
+        perm_cred_user(to->uid, &c);
+        to->gid = c.gid;
+    }
+    return 0;
+}
+
+static int owner_command(int argc, char** argv, int group_only) {
+    walk_opts_t w;
+    owner_t to;
+    char bad[300];
+    sim_opts_t o;
+
+    if (sim_getopt(argc, argv, "Rvcfh", &o) < 0) return 1;
+    memset(&w, 0, sizeof(w));
+    w.env = sim_env();
+    w.command = argv[0];
+    w.recursive = SIM_HAS(&o, 'R');
+    w.verbose = SIM_HAS(&o, 'v');
+    w.changes = SIM_HAS(&o, 'c');
+    if (o.n_operands < 2) {
+        if (o.n_operands == 0) {
+            sim_error(argv[0], "missing operand\nTry '%s --help' for more information.", argv[0]);
+        } else {
+            sim_error(argv[0], "missing operand after ‘%s’\nTry '%s --help' for more information.", argv[1], argv[0]);
+        }
+        return 1;
+    }
+    if (group_only) {
+        to.uid = UINT32_MAX;
+        if (sim_group_id(argv[1], &to.gid) != 0) {
+            sim_error(argv[0], "invalid group: ‘%s’", argv[1]);
+            return 1;
+        }
+    } else if (parse_owner(argv[1], &to, bad, sizeof(bad)) != 0) {
+        sim_error(argv[0], "%s", bad);
+        return 1;
+    }
+    return apply_operands(&w, argv + 2, o.n_operands - 1, chown_one, &to);
+}
+
+int perm_cmd_chown(int argc, char** argv) {
+    return owner_command(argc, argv, 0);
+}
+
+int perm_cmd_chgrp(int argc, char** argv) {
+    return owner_command(argc, argv, 1);
+}
+
+// ---------------------------------------------------------------------
+// ACLs
+
+static void perm_string(uint32_t perm, char* out) {
+    out[0] = perm & 4 ? 'r' : '-';
+    out[1] = perm & 2 ? 'w' : '-';
+    out[2] = perm & 1 ? 'x' : '-';
+    out[3] = '\0';
+}
+
+int perm_cmd_getfacl(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    int i, status = 0, warned = 0;
+    sim_opts_t o;
+
+    if (sim_getopt(argc, argv, "cpn", &o) < 0) return 1;
+    if (o.n_operands == 0) {
+        con_printf("Usage: getfacl [-aceEsRLPtpndvh] file ...\nTry `getfacl --help' for more information.\n");
+        return 1;
+    }
+    for (i = 1; i <= o.n_operands; i++) {
+        const vfs_acl_entry_t* acl;
+        const vfs_inode_t* node;
+        char perm[4], effective[4];
+        uint32_t ino, n, k, mask = 7, group_obj;
+        const char* shown = argv[i];
+        int err = perm_resolve(env, argv[i], &ino);
+
+        if (err) {
+            con_printf("getfacl: %s: %s\n", argv[i], strerror(-err));
+            status = 1;
+            continue;
+        }
+        node = vfs_inode(env->vfs, ino);
+        n = vfs_acl(env->vfs, ino, &acl);
+        group_obj = (node->mode >> 3) & 7;
+        for (k = 0; k < n; k++) {
+            if (acl[k].tag == VFS_ACL_MASK) mask = acl[k].perm;
+            if (acl[k].tag == VFS_ACL_GROUP_OBJ) group_obj = acl[k].perm;
+        }
+        if (shown[0] == '/' && !SIM_HAS(&o, 'p')) {
+            if (!warned++) con_printf("getfacl: Removing leading '/' from absolute path names\n");
+            while (shown[0] == '/' && shown[1]) shown++;
+        }
+        if (!SIM_HAS(&o, 'c')) {
+            con_printf("# file: %s\n", shown);
+            con_printf("# owner: %s\n", SIM_HAS(&o, 'n') ? "" : sim_user_name(node->uid));
+            con_printf("# group: %s\n", sim_group_name(node->gid));
+            if (node->mode & (S_ISUID | S_ISGID | S_ISVTX)) {
+                con_printf("# flags: %c%c%c\n", node->mode & S_ISUID ? 's' : '-', node->mode & S_ISGID ? 's' : '-',
+                           node->mode & S_ISVTX ? 't' : '-');
+            }
+        }
+        perm_string((node->mode >> 6) & 7, perm);
+        con_printf("user::%s\n", perm);
+        for (k = 0; k < n; k++) {
+            if (acl[k].tag != VFS_ACL_USER) continue;
+            perm_string(acl[k].perm, perm);
+            perm_string(acl[k].perm & mask, effective);
+            con_printf("user:%s:%s", sim_user_name(acl[k].id), perm);
+            if ((acl[k].perm & mask) != acl[k].perm) con_printf("\t\t\t#effective:%s", effective);
+            con_printf("\n");
+        }
+        perm_string(group_obj, perm);
+        perm_string(group_obj & mask, effective);
+        con_printf("group::%s", perm);
+        if (n && (group_obj & mask) != group_obj) con_printf("\t\t\t#effective:%s", effective);
+        con_printf("\n");
+        for (k = 0; k < n; k++) {
+            if (acl[k].tag != VFS_ACL_GROUP) continue;
+            perm_string(acl[k].perm, perm);
+            perm_string(acl[k].perm & mask, effective);
+            con_printf("group:%s:%s", sim_group_name(acl[k].id), perm);
+            if ((acl[k].perm & mask) != acl[k].perm) con_printf("\t\t\t#effective:%s", effective);
+            con_printf("\n");
+        }
+        if (n) {
+            perm_string(mask, perm);
+            con_printf("mask::%s\n", perm);
+        }
+        perm_string(node->mode & 7, perm);
+        con_printf("other::%s\n\n", perm);
+    }
+    return status;
+}
+
+// One setfacl entry: "u:bob:rwx", "g:sudo:r-x", "m::rx", "o::-", "u::rw"
+// (or for -x, without the permissions)
+typedef struct {
+    char tag;               // 'u', 'g', 'm', 'o'
+    int named;
+    uint32_t id;
+    uint32_t perm;
+} acl_spec_t;
+
+static int parse_acl_spec(const char* text, size_t len, int with_perm, acl_spec_t* s) {
+    char buf[NAME_MAX_LEN + 64], *name, *perm, *colon;
+    size_t i;
+
+    if (len >= sizeof(buf)) return -1;
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    colon = strchr(buf, ':');
+    if (!colon) return -1;
+    *colon = '\0';
+    if (strcmp(buf, "u") == 0 || strcmp(buf, "user") == 0) {
+        s->tag = 'u';
+    } else if (strcmp(buf, "g") == 0 || strcmp(buf, "group") == 0) {
+        s->tag = 'g';
+    } else if (strcmp(buf, "m") == 0 || strcmp(buf, "mask") == 0) {
+        s->tag = 'm';
+    } else if (strcmp(buf, "o") == 0 || strcmp(buf, "other") == 0) {
+        s->tag = 'o';
+    } else {
+        return -1;
+    }
+    name = colon + 1;
+    perm = strchr(name, ':');
+    if (perm) *perm++ = '\0';
+    if (with_perm && !perm) return -1;
+    s->named = name[0] != '\0';
+    if (s->named && (s->tag == 'm' || s->tag == 'o')) return -1;
+    if (s->named && (s->tag == 'u' ? sim_user_id(name, &s->id) : sim_group_id(name, &s->id)) != 0) return -1;
+    s->perm = 0;
+    if (!perm) return 0;
+    if (perm[0] >= '0' && perm[0] <= '7' && !perm[1]) {
+        s->perm = (uint32_t)(perm[0] - '0');
+        return 0;
+    }
+    for (i = 0; perm[i]; i++) {
+        switch (perm[i]) {
+            case 'r': s->perm |= 4; break;
+            case 'w': s->perm |= 2; break;
+            case 'x': s->perm |= 1; break;
+            case 'X': s->perm |= 1; break;
+            case '-': break;
+            default: return -1;
+        }
+    }
+    return 0;
+}
+
+// Change an inode's ACL by one of -m, -x, -b, recalculating the mask
+// unless one was given
+static void change_acl(sim_env_t* env, uint32_t ino, char op, const acl_spec_t* specs, int n_specs) {
+    const vfs_inode_t* node = vfs_inode(env->vfs, ino);
+    const vfs_acl_entry_t* old;
+    vfs_acl_entry_t acl[MAX_ACL];
+    uint32_t n = 0, n_old = vfs_acl(env->vfs, ino, &old), mode = node->mode & 07777, k, group_obj = (mode >> 3) & 7;
+    int s, explicit_mask = 0, named = 0, has_mask = 0;
+
+    for (k = 0; k < n_old; k++) {
+        if (old[k].tag == VFS_ACL_GROUP_OBJ) group_obj = old[k].perm;
+        if (op != 'b' && old[k].tag != VFS_ACL_GROUP_OBJ && n < MAX_ACL) acl[n++] = old[k];
+    }
+    if (op == 'b') {
+        mode = (mode & ~070u) | (group_obj << 3);
+        n = 0;
+    }
+    for (s = 0; s < n_specs && op != 'b'; s++) {
+        const acl_spec_t* sp = &specs[s];
+        uint8_t tag = sp->tag == 'u' ? VFS_ACL_USER : sp->tag == 'g' ? VFS_ACL_GROUP : VFS_ACL_MASK;
+
+        if (!sp->named && sp->tag == 'u') {
+            if (op == 'm') mode = (mode & ~0700u) | (sp->perm << 6);
+            continue;
+        }
+        if (sp->tag == 'o') {
+            if (op == 'm') mode = (mode & ~07u) | sp->perm;
+            continue;
+        }
+        if (!sp->named && sp->tag == 'g') {
+            if (op == 'm') group_obj = sp->perm;
+            continue;
+        }
+        if (sp->tag == 'm') explicit_mask = op == 'm';
+        for (k = 0; k < n; k++) {
+            if (acl[k].tag == tag && (tag == VFS_ACL_MASK || acl[k].id == sp->id)) break;
+        }
+        if (op == 'x') {
+            if (k < n) acl[k] = acl[--n];
+        } else if (k < n) {
+            acl[k].perm = (uint8_t)sp->perm;
+        } else if (n < MAX_ACL) {
+            acl[n++] = (vfs_acl_entry_t){ tag == VFS_ACL_MASK ? 0 : sp->id, tag, (uint8_t)sp->perm };
+        }
+    }
+
+    // The mask is the union of the group class unless set
+    for (k = 0; k < n; k++) named |= acl[k].tag == VFS_ACL_USER || acl[k].tag == VFS_ACL_GROUP;
+    for (k = 0; k < n; k++) has_mask |= acl[k].tag == VFS_ACL_MASK;
+    if (op != 'b' && named) {
+        uint32_t mask = group_obj;
+
+        for (k = 0; k < n; k++) {
+            if (acl[k].tag == VFS_ACL_USER || acl[k].tag == VFS_ACL_GROUP) mask |= acl[k].perm;
+        }
+        for (k = 0; k < n && acl[k].tag != VFS_ACL_MASK; k++) {
+        }
+        if (k == n) acl[n++] = (vfs_acl_entry_t){ 0, VFS_ACL_MASK, 0 };
+        if (!explicit_mask || !has_mask) acl[k].perm = (uint8_t)mask;
+        if (explicit_mask) {
+            for (s = 0; s < n_specs; s++) {
+                if (specs[s].tag == 'm') acl[k].perm = (uint8_t)specs[s].perm;
+            }
+        }
+        acl[n++] = (vfs_acl_entry_t){ 0, VFS_ACL_GROUP_OBJ, (uint8_t)group_obj };
+        mode = (mode & ~070u) | ((uint32_t)acl[k].perm << 3);
+    } else {
+        // Nothing named left: back to the mode alone
+        n = 0;
+        mode = (mode & ~070u) | (group_obj << 3);
+    }
+    vfs_set_acl(env->vfs, ino, acl, n, env->clock);
+    vfs_chmod(env->vfs, ino, mode, env->clock);
+}
+
+int perm_cmd_setfacl(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    acl_spec_t specs[16];
+    const char* spec_text = NULL;
+    char op = 0;
+    int n_specs = 0, i, status = 0, first_file = 0;
+
+    for (i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+
+        if ((strcmp(arg, "-m") == 0 || strcmp(arg, "-x") == 0) && i + 1 < argc) {
+            op = arg[1];
+            spec_text = argv[++i];
+        } else if (strncmp(arg, "--modify=", 9) == 0 || strncmp(arg, "--remove=", 9) == 0) {
+            op = arg[4] == 'o' ? 'm' : 'x';
+            spec_text = arg + 9;
+        } else if (strcmp(arg, "-b") == 0 || strcmp(arg, "--remove-all") == 0) {
+            op = 'b';
+        } else if (strcmp(arg, "-k") == 0 || strcmp(arg, "--remove-default") == 0) {
+            // Default ACLs are not modelled: there are none to remove
+            if (!op) op = 'k';
+        } else if (arg[0] == '-') {
+            return -1;
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+    if (!op || !first_file) {
+        con_printf("Usage: setfacl [-bkndRLP] { -m|-M|-x|-X ... } file ...\nTry `setfacl --help' for more information.\n");
+        return 2;
+    }
+    if (spec_text) {
+        const char* p = spec_text;
+
+        while (*p) {
+            size_t len = strcspn(p, ",");
+
+            if (n_specs == 16 || parse_acl_spec(p, len, op == 'm', &specs[n_specs]) != 0) {
+                con_printf("setfacl: Option -%c: Invalid argument near character %d\n", op, (int)(p - spec_text) + 1);
+                return 2;
+            }
+            n_specs++;
+            p += len;
+            if (*p) p++;
+        }
+    }
+    for (i = first_file; i < argc; i++) {
+        const perm_cred_t* c;
+        uint32_t ino;
+        int err = perm_resolve(env, argv[i], &ino);
+
+        if (err) {
+            con_printf("setfacl: %s: %s\n", argv[i], strerror(-err));
+            status = 1;
+            continue;
+        }
+        c = perm_session_cred(env);
+        if (c->uid != 0 && c->uid != vfs_inode(env->vfs, ino)->uid) {
+            con_printf("setfacl: %s: %s\n", argv[i], strerror(EPERM));
+            status = 1;
+            continue;
+        }
+        if (op != 'k') change_acl(env, ino, op, specs, n_specs);
+    }
+    return status;
+}
+
+// ---------------------------------------------------------------------
+// namei
+
+// namei's line for a component: -m shows the mode, -o the owners
+static void namei_line(const sim_env_t* env, uint32_t ino, const char* name, int modes, int owners, int w_user, int w_group) {
+    const vfs_inode_t* node = vfs_inode(env->vfs, ino);
+
+    if (modes) {
+        static const char rwx[] = "rwxrwxrwx";
+        char mode[11];
+        int i;
+
+        mode[0] = S_ISDIR(node->mode) ? 'd' : '-';
+        for (i = 0; i < 9; i++) mode[i + 1] = (node->mode & (0400u >> i)) ? rwx[i] : '-';
+        if (node->mode & S_ISUID) mode[3] = (node->mode & 0100) ? 's' : 'S';
+        if (node->mode & S_ISGID) mode[6] = (node->mode & 0010) ? 's' : 'S';
+        if (node->mode & S_ISVTX) mode[9] = (node->mode & 0001) ? 't' : 'T';
+        mode[10] = '\0';
+        con_printf("%s ", mode);
+    } else {
+        con_printf(" %c ", S_ISDIR(node->mode) ? 'd' : '-');
+    }
+    if (owners) con_printf("%-*s %-*s ", w_user, sim_user_name(node->uid), w_group, sim_group_name(node->gid));
+    con_printf("%s\n", name);
+}
+
+// Each component of a path, with the permissions on the way: where
+// access stops is where "Permission denied" shows
+int perm_cmd_namei(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    sim_opts_t o;
+    int i, status = 0, modes, owners;
+
+    if (sim_getopt(argc, argv, "lmovnx", &o) < 0) return 1;
+    modes = SIM_HAS(&o, 'l') || SIM_HAS(&o, 'm');
+    owners = SIM_HAS(&o, 'l') || SIM_HAS(&o, 'o');
+    if (o.n_operands == 0) {
+        con_printf("namei: pathname argument is missing\nTry 'namei --help' for more information.\n");
+        return 1;
+    }
+    for (i = 1; i <= o.n_operands; i++) {
+        const perm_cred_t* c = perm_session_cred(env);
+        const char* path = argv[i];
+        const char* p = path;
+        uint32_t cur = path[0] == '/' ? VFS_ROOT : env->cwd, inos[256];
+        const char* names[256];
+        char buf[MAX_PATH];
+        int n = 0, k, w_user = 0, w_group = 0, failed = 0;
+        size_t used = 0;
+
+        con_printf("f: %s\n", path);
+        if (path[0] == '/') {
+            inos[n] = VFS_ROOT;
+            names[n++] = "/";
+        }
+        while (*p && n < 256) {
+            size_t len;
+            uint32_t next;
+
+            while (*p == '/') p++;
+            if (!*p) break;
+            len = strcspn(p, "/");
+            if (len > NAME_MAX_LEN || used + len + 1 > sizeof(buf)) break;
+            memcpy(buf + used, p, len);
+            buf[used + len] = '\0';
+            names[n] = buf + used;
+            used += len + 1;
+            p += len;
+            if (!S_ISDIR(vfs_inode(env->vfs, cur)->mode)) {
+                failed = ENOTDIR;
+            } else if (!perm_check(env->vfs, c, cur, PERM_EXEC)) {
+                failed = EACCES;
+            } else if (strcmp(names[n], ".") == 0) {
+                next = cur;
+            } else if (strcmp(names[n], "..") == 0) {
+                next = vfs_inode(env->vfs, cur)->parent;
+            } else if ((next = vfs_lookup(env->vfs, cur, names[n])) == VFS_NONE) {
+                failed = ENOENT;
+            }
+            if (failed) {
+                n++;
+                break;
+            }
+            inos[n++] = cur = next;
+        }
+        for (k = 0; k < n - (failed != 0); k++) {
+            int w = (int)strlen(sim_user_name(vfs_inode(env->vfs, inos[k])->uid));
+
+            if (w > w_user) w_user = w;
+            w = (int)strlen(sim_group_name(vfs_inode(env->vfs, inos[k])->gid));
+            if (w > w_group) w_group = w;
+        }
+        for (k = 0; k < n; k++) {
+            if (failed && k == n - 1) {
+                con_printf("%*s%s - %s\n", (modes ? 11 : 3) + (owners ? w_user + w_group + 2 : 0), "", names[k],
+                           strerror(failed));
+                status = 1;
+            } else {
+                namei_line(env, inos[k], names[k], modes, owners, w_user, w_group);
+            }
+        }
+    }
+    return status;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+static uint64_t bench_rng = 0x9E3779B97F4A7C15ull;
+
+#define BENCH_USERS 64
+#define BENCH_GROUPS 32
+#define BENCH_PATHS 65536
+
+typedef struct {
+    vfs_t* fs;
+    uint32_t* dirs;
+    uint32_t n_dirs, dirs_cap;
+    char** paths;           // a sample of files, for path checks
+    uint32_t n_paths;
+    uint64_t n_entries, n_acls;
+} bench_tree_t;
+
+static const uint32_t bench_dir_modes[] = { 0755, 0755, 0755, 0750, 0770, 0700, 01777, 02775, 0711 };
+static const uint32_t bench_file_modes[] = { 0644, 0644, 0644, 0640, 0600, 0664, 0660, 0755, 0400 };
+
+// Owner and group from a few users and groups, the way a shared server's
+// /srv looks: mostly readable, some private, some group-shared with ACLs
+static void bench_owner(uint32_t* uid, uint32_t* gid) {
+    *uid = bench_random(&bench_rng, 8) == 0 ? 0 : 2000 + bench_random(&bench_rng, BENCH_USERS);
+    *gid = bench_random(&bench_rng, 4) == 0 ? *uid : 3000 + bench_random(&bench_rng, BENCH_GROUPS);
+}
+
+static void bench_add(bench_tree_t* t, uint32_t dir, const char* dir_path, uint64_t n_wanted, int depth) {
+    uint32_t n_children = 4 + bench_random(&bench_rng, 12), i;
+    char path[MAX_PATH + 32], name[32];
+
+    for (i = 0; i < n_children && t->n_entries < n_wanted; i++) {
+        int is_dir = depth < 8 && bench_random(&bench_rng, 4) == 0;
+        uint32_t uid, gid, ino, mode;
+
+        bench_owner(&uid, &gid);
+        snprintf(name, sizeof(name), "%s%u", is_dir ? "d" : "f", i);
+        mode = is_dir ? S_IFDIR | bench_dir_modes[bench_random(&bench_rng, 9)] : S_IFREG | bench_file_modes[bench_random(&bench_rng, 9)];
+        if (vfs_create(t->fs, dir, name, mode, uid, gid, 0, &ino) != 0) continue;
+        t->n_entries++;
+        if (bench_random(&bench_rng, 16) == 0) {
+            vfs_acl_entry_t acl[3] = {
+                { 2000 + bench_random(&bench_rng, BENCH_USERS), VFS_ACL_USER, (uint8_t)(4 | bench_random(&bench_rng, 4)) },
+                { 3000 + bench_random(&bench_rng, BENCH_GROUPS), VFS_ACL_GROUP, (uint8_t)(5 | (bench_random(&bench_rng, 2) << 1)) },
+                { 0, VFS_ACL_GROUP_OBJ, (uint8_t)((mode >> 3) & 7) },
+            };
+
+            vfs_set_acl(t->fs, ino, acl, 3, 0);
+            vfs_chmod(t->fs, ino, (mode & ~070u) | 070, 0);
+            t->n_acls++;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir_path, name);
+        if (!is_dir) {
+            if (t->n_paths < BENCH_PATHS) {
+                t->paths[t->n_paths++] = strdup(path);
+            } else if (bench_random(&bench_rng, (uint32_t)t->n_entries) < BENCH_PATHS) {
+                uint32_t k = bench_random(&bench_rng, BENCH_PATHS);
+
+                free(t->paths[k]);
+                t->paths[k] = strdup(path);
+            }
+            continue;
+        }
+        if (t->n_dirs == t->dirs_cap) {
+            t->dirs_cap = t->dirs_cap ? t->dirs_cap * 2 : 1024;
+            t->dirs = xrealloc(t->dirs, t->dirs_cap * sizeof(uint32_t));
+        }
+        t->dirs[t->n_dirs++] = ino;
+    }
+    // Then fill the tree breadth-first through the directories made
+}
+
+static void bench_build(bench_tree_t* t, uint64_t n_wanted) {
+    char path[MAX_PATH];
+    uint32_t next = 0, srv;
+
+    memset(t, 0, sizeof(*t));
+    t->fs = vfs_new();
+    t->paths = xrealloc(NULL, BENCH_PATHS * sizeof(char*));
+    vfs_create(t->fs, VFS_ROOT, "srv", S_IFDIR | 0755, 0, 0, 0, &srv);
+    t->dirs = xrealloc(NULL, 1024 * sizeof(uint32_t));
+    t->dirs_cap = 1024;
+    t->dirs[t->n_dirs++] = srv;
+    while (t->n_entries < n_wanted) {
+        uint32_t dir = t->dirs[next % t->n_dirs];
+
+        vfs_path(t->fs, dir, path, sizeof(path));
+        bench_add(t, dir, path, n_wanted, (int)(strlen(path) / 4));
+        next++;
+    }
+}
+
+static void bench_cred(perm_cred_t* c, uint32_t user) {
+    uint32_t k;
+
+    memset(c, 0, sizeof(*c));
+    c->uid = 2000 + user;
+    c->gid = 3000 + user % BENCH_GROUPS;
+    c->groups[c->n_groups++] = c->gid;
+    for (k = 0; k < 3; k++) c->groups[c->n_groups++] = 3000 + (user * 7 + k * 13) % BENCH_GROUPS;
+    cred_sort(c);
+}
+
+// perm_reach() without the memo: every ancestor checked every time
+static int bench_walk_up(const vfs_t* fs, const perm_cred_t* c, uint32_t dir) {
+    for (;; dir = vfs_inode(fs, dir)->parent) {
+        if (!perm_check(fs, c, dir, PERM_EXEC)) return 0;
+        if (dir == VFS_ROOT) return 1;
+    }
+}
+
+// Count what a user can read and write below dir, as an audit would:
+// every entry of every directory the user can reach and list
+static void bench_audit(perm_cache_t* pc, const vfs_t* fs, uint32_t dir, uint64_t* readable, uint64_t* writable, uint64_t* checked) {
+    const vfs_dirent_t* children;
+    uint32_t n = vfs_children(fs, dir, &children), i;
+
+    if (!perm_reach(pc, fs, dir) || !perm_check(fs, perm_cache_cred(pc), dir, PERM_READ)) return;
+    for (i = 0; i < n; i++) {
+        uint32_t ino = children[i].ino;
+
+        *checked += 2;
+        *readable += perm_check(fs, perm_cache_cred(pc), ino, PERM_READ);
+        *writable += perm_check(fs, perm_cache_cred(pc), ino, PERM_WRITE);
+        if (S_ISDIR(vfs_inode(fs, ino)->mode)) bench_audit(pc, fs, ino, readable, writable, checked);
+    }
+}
+
+int perm_bench(int argc, char** argv) {
+    long n = argc > 0 ? atol(argv[0]) : 1000000;
+    perm_cache_t* caches[BENCH_USERS];
+    perm_cred_t creds[BENCH_USERS];
+    uint64_t readable = 0, writable = 0, checked = 0, granted = 0;
+    uint32_t checks = 4000000, i, u;
+    bench_tree_t t;
+    double start, elapsed;
+    int rc = 0;
+
+    if (n < 1000) n = 1000;
+    start = bench_now();
+    bench_build(&t, (uint64_t)n);
+    bench_report("perm", "entries", (double)t.n_entries, "entries");
+    bench_report("perm", "directories", t.n_dirs, "dirs");
+    bench_report("perm", "acls", (double)t.n_acls, "acls");
+    bench_report("perm", "build", (bench_now() - start) * 1e3, "ms");
+    for (u = 0; u < BENCH_USERS; u++) {
+        bench_cred(&creds[u], u);
+        caches[u] = perm_cache_new(&creds[u]);
+    }
+
+    // Inode checks alone
+    start = bench_now();
+    for (i = 0; i < checks; i++) {
+        granted += perm_check(t.fs, &creds[i % BENCH_USERS], 1 + bench_random(&bench_rng, vfs_inode_count(t.fs) - 1), 1u << bench_random(&bench_rng, 3));
+    }
+    elapsed = bench_now() - start;
+    bench_report("perm", "check", checks / elapsed / 1e6, "M/s");
+
+    // Reaching random directories, cold then memoized
+    start = bench_now();
+    for (i = 0; i < checks; i++) granted += perm_reach(caches[i % BENCH_USERS], t.fs, t.dirs[bench_random(&bench_rng, t.n_dirs)]);
+    elapsed = bench_now() - start;
+    bench_report("perm", "reach", checks / elapsed / 1e6, "M/s");
+    start = bench_now();
+    for (i = 0; i < checks; i++) granted += bench_walk_up(t.fs, &creds[i % BENCH_USERS], t.dirs[bench_random(&bench_rng, t.n_dirs)]);
+    elapsed = bench_now() - start;
+    bench_report("perm", "reach_uncached", checks / elapsed / 1e6, "M/s");
+
+    // access(2) on paths: resolution plus the memoized traversal
+    start = bench_now();
+    for (i = 0; i < checks / 4; i++) {
+        granted += perm_access(caches[i % BENCH_USERS], t.fs, VFS_ROOT, t.paths[bench_random(&bench_rng, t.n_paths)], 1u << bench_random(&bench_rng, 3)) == 0;
+    }
+    elapsed = bench_now() - start;
+    bench_report("perm", "access", checks / 4 / elapsed / 1e6, "M/s");
+
+    // Who can read and write what, for every user over the whole tree
+    start = bench_now();
+    for (u = 0; u < BENCH_USERS; u++) bench_audit(caches[u], t.fs, VFS_ROOT, &readable, &writable, &checked);
+    elapsed = bench_now() - start;
+    bench_report("perm", "audit", checked / elapsed / 1e6, "M checks/s");
+    bench_report("perm", "audit_readable", readable * 100.0 / (checked / 2), "%");
+    bench_report("perm", "audit_writable", writable * 100.0 / (checked / 2), "%");
+
+    // A chmod on a directory drops the memo; the answers follow it
+    start = bench_now();
+    vfs_chmod(t.fs, t.dirs[1 + bench_random(&bench_rng, t.n_dirs - 1)], 0700, 1);
+    for (u = 0; u < BENCH_USERS; u++) perm_reach(caches[u], t.fs, t.dirs[t.n_dirs - 1]);
+    bench_report("perm", "invalidate", (bench_now() - start) * 1e3, "ms");
+    for (i = 0; i < 100000; i++) {
+        uint32_t dir = t.dirs[bench_random(&bench_rng, t.n_dirs)];
+
+        u = i % BENCH_USERS;
+        if (perm_reach(caches[u], t.fs, dir) != bench_walk_up(t.fs, &creds[u], dir)) {
+            fprintf(stderr, "perm: memoized reach of inode %u for uid %u is stale\n", dir, creds[u].uid);
+            rc = 1;
+            break;
+        }
+    }
+    if (!granted) fprintf(stderr, "perm: nothing was granted\n");
+
+    for (u = 0; u < BENCH_USERS; u++) perm_cache_free(caches[u]);
+    for (i = 0; i < t.n_paths; i++) free(t.paths[i]);
+    free(t.paths);
+    free(t.dirs);
+    vfs_free(t.fs);
+    return rc;
+}
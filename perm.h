@@ -0,0 +1,87 @@
+#ifndef PERM_H
+#define PERM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Access decisions for simulation mode, as the kernel makes them.
+//
+// A credential is a user's uid, primary gid and sorted group list, taken
+// from the session's accounts (nss.h), so "usermod -aG" changes what a
+// user may do. Checking an inode follows acl(5): root passes everything
+// but execute on files no one may execute; the owner gets the owner
+// bits; a named user ACL entry, then the owning group and named group
+// entries (any that match and grant), are limited by the mask; everyone
+// else gets the other bits. Reaching a path needs search permission on
+// every directory from / down to it. That part is memoized in a cache
+// per credential: a byte per directory inode saying whether the
+// directory can be reached, so an audit of a tree checks each directory
+// once and each file with one inode check. A cache is thrown away
+// whenever vfs_generation() moves (a directory's permissions changed, or
+// a directory moved or went away).
+
+#define PERM_READ 4
+#define PERM_WRITE 2
+#define PERM_EXEC 1
+
+#define PERM_MAX_GROUPS 64
+
+typedef struct vfs vfs_t;
+struct sim_env;
+
+typedef struct {
+    uint32_t uid, gid;
+    uint32_t n_groups;
+    uint32_t groups[PERM_MAX_GROUPS];   // sorted, with gid among them
+} perm_cred_t;
+
+// A user's credential from the session's accounts. Returns -1 (and a
+// credential with only gid = uid) if the uid has no account.
+int perm_cred_user(uint32_t uid, perm_cred_t* c);
+// The credential a session's commands run with: root under sudo
+void perm_cred_env(const struct sim_env* env, perm_cred_t* c);
+int perm_in_group(const perm_cred_t* c, uint32_t gid);
+
+// Whether c has all of want on an inode itself. Reads only; safe from
+// any thread.
+int perm_check(const vfs_t* fs, const perm_cred_t* c, uint32_t ino, uint32_t want);
+// Whether c may remove or rename dir's entry ino: write and search on
+// dir, and with the sticky bit, owning ino or dir
+int perm_check_unlink(const vfs_t* fs, const perm_cred_t* c, uint32_t dir, uint32_t ino);
+
+typedef struct perm_cache perm_cache_t;
+
+perm_cache_t* perm_cache_new(const perm_cred_t* c);
+void perm_cache_free(perm_cache_t* pc);
+const perm_cred_t* perm_cache_cred(const perm_cache_t* pc);
+
+// Whether the cache's credential can search every directory from / down
+// to dir, dir included
+int perm_reach(perm_cache_t* pc, const vfs_t* fs, uint32_t dir);
+// Path resolution with the searches it takes: 0 and the inode, or
+// -EACCES, -ENOENT, -ENOTDIR. Paths are checked as if resolved from /.
+int perm_lookup(perm_cache_t* pc, const vfs_t* fs, uint32_t cwd, const char* path, uint32_t* ino);
+// access(2): 0 when the path can be reached and want (0 for existence)
+// is granted, else -errno
+int perm_access(perm_cache_t* pc, const vfs_t* fs, uint32_t cwd, const char* path, uint32_t want);
+
+// The session's cache (see sim.h), rebuilt when the effective user or
+// the accounts change. These resolve from env's working directory.
+int perm_resolve(struct sim_env* env, const char* path, uint32_t* ino);
+int perm_resolve_parent(struct sim_env* env, const char* path, uint32_t* dir, char* name, size_t name_len);
+int perm_may(struct sim_env* env, uint32_t ino, uint32_t want);
+int perm_may_unlink(struct sim_env* env, uint32_t dir, uint32_t ino);
+const perm_cred_t* perm_session_cred(struct sim_env* env);
+
+// Simulated commands (see sim.c)
+int perm_cmd_chmod(int argc, char** argv);
+int perm_cmd_chown(int argc, char** argv);
+int perm_cmd_chgrp(int argc, char** argv);
+int perm_cmd_getfacl(int argc, char** argv);
+int perm_cmd_setfacl(int argc, char** argv);
+int perm_cmd_namei(int argc, char** argv);
+
+// --bench perm [entries]
+int perm_bench(int argc, char** argv);
+
+#endif
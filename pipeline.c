@@ -0,0 +1,1113 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "grep.h"
+#include "pipeline.h"
+#include "bench.h"
+#include "util.h"
+
+// What push() returns when the stage wants no more input
+#define PIPE_STOP 1
+#define MAX_RANGES 16
+// "N-" in a cut list: to the end of the line
+#define TO_END ((long)(~0UL >> 1))
+
+const char pipeline_filters[] = "head tail grep wc sort cut";
+
+typedef struct {
+    char* data;
+    size_t len, cap;
+} buf_t;
+
+static void buf_add(buf_t* b, const char* data, size_t len) {
+    if (!len) return;
+    if (b->len + len > b->cap) {
+        while (b->len + len > b->cap) b->cap = b->cap ? b->cap * 2 : 4096;
+        b->data = xrealloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static uint64_t count_lines(const char* p, const char* end) {
+    uint64_t n = 0;
+
+    while (p < end && (p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        n++;
+        p++;
+    }
+    return n;
+}
+
+// Start of the last n lines of [data, end), which ends with a newline
+static const char* last_lines(const char* data, const char* end, uint64_t n) {
+    const char* p;
+
+    if (n == 0 || data == end) return end;
+    p = end - 1;
+    while (n-- > 0) {
+        p = memrchr(data, '\n', (size_t)(p - data));
+        if (!p) return data;
+    }
+    return p + 1;
+}
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// ---------------------------------------------------------------------
+// Stages
+
+typedef struct stage stage_t;
+
+struct stage {
+    // Takes whole lines; returns PIPE_STOP when it wants no more
+    int (*push)(stage_t* s, const char* data, size_t len);
+    // End of input: pass on what was held back and return the exit status
+    int (*finish)(stage_t* s);
+    void (*free)(stage_t* s);
+    stage_t* next;
+    pipeline_t* pipe;
+    int done;
+};
+
+struct pipeline {
+    stage_t* first;
+    stage_t* last;
+    long line_limit;
+    console_t* out;         // where the last stage writes
+    console_t source;       // where the first command writes
+    buf_t carry;            // a line split across two writes
+};
+
+static int pass(stage_t* to, const char* data, size_t len) {
+    if (to->done) return PIPE_STOP;
+    if (to->push(to, data, len)) to->done = 1;
+    return to->done;
+}
+
+// Whole lines on to the next stage, or out after the last one
+static int emit(stage_t* s, const char* data, size_t len) {
+    console_t* was;
+
+    if (!len) return 0;
+    if (s->next) return pass(s->next, data, len);
+    was = console_current();
+    console_use(s->pipe->out);
+    con_write(data, len);
+    console_use(was);
+    return 0;
+}
+
+static int finish_ok(stage_t* s) {
+    (void)s;
+    return 0;
+}
+
+static void free_plain(stage_t* s) {
+    free(s);
+}
+
+static void* new_stage(size_t size, int (*push)(stage_t*, const char*, size_t), int (*finish)(stage_t*),
+                       void (*free_fn)(stage_t*)) {
+    stage_t* s = xrealloc(NULL, size);
+
+    memset(s, 0, size);
+    s->push = push;
+    s->finish = finish;
+    s->free = free_fn;
+    return s;
+}
+
+// Options as sim_getopt() takes them, but silent (one that is not known
+// means "not simulated") and with any number of options taking a value.
+// Operands are compacted into argv[1..].
+typedef struct {
+    uint64_t flags;
+    const char* value[128];
+    int n_operands;
+} filter_opts_t;
+
+static int filter_getopt(int argc, char** argv, const char* spec, filter_opts_t* o) {
+    int i, only_operands = 0;
+
+    memset(o, 0, sizeof(*o));
+    for (i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        const char* p;
+
+        if (only_operands || arg[0] != '-' || arg[1] == '\0') {
+            argv[++o->n_operands] = arg;
+            continue;
+        }
+        if (strcmp(arg, "--") == 0) {
+            only_operands = 1;
+            continue;
+        }
+        if (arg[1] == '-') return -1;
+        for (p = arg + 1; *p; p++) {
+            const char* s = isalnum((unsigned char)*p) ? strchr(spec, *p) : NULL;
+
+            if (!s) return -1;
+            o->flags |= SIM_FLAG(*p);
+            if (s[1] == ':') {
+                if (p[1]) {
+                    o->value[(unsigned char)*p] = p + 1;
+                } else if (i + 1 < argc) {
+                    o->value[(unsigned char)*p] = argv[++i];
+                } else {
+                    return -1;
+                }
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+static int parse_number(const char* text, long* n) {
+    char* end;
+
+    if (!isdigit((unsigned char)*text)) return -1;
+    *n = strtol(text, &end, 10);
+    return *end ? -1 : 0;
+}
+
+// head and tail: [-n] N or -N, default 10
+static int parse_line_count(int argc, char** argv, long* count) {
+    *count = 10;
+    if (argc == 1) return 0;
+    if (argc == 2 && argv[1][0] == '-' && argv[1][1] == 'n') return parse_number(argv[1] + 2, count);
+    if (argc == 2 && argv[1][0] == '-') return parse_number(argv[1] + 1, count);
+    if (argc == 3 && strcmp(argv[1], "-n") == 0) return parse_number(argv[2], count);
+    return -1;
+}
+
+// ---------------------------------------------------------------------
+// head: passes on a prefix of each block, then stops everything upstream
+
+typedef struct {
+    stage_t base;
+    long count, seen;
+} head_t;
+
+static int head_push(stage_t* s, const char* data, size_t len) {
+    head_t* h = (head_t*)s;
+    const char* end = data + len;
+    const char* p = data;
+
+    while (h->seen < h->count && p < end) {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+
+        p = nl ? nl + 1 : end;
+        h->seen++;
+    }
+    if (emit(s, data, (size_t)(p - data))) return PIPE_STOP;
+    return h->seen >= h->count ? PIPE_STOP : 0;
+}
+
+static stage_t* head_new(int argc, char** argv) {
+    head_t* h;
+    long count;
+
+    if (parse_line_count(argc, argv, &count) < 0) return NULL;
+    h = new_stage(sizeof(*h), head_push, finish_ok, free_plain);
+    h->count = count;
+    h->base.done = count == 0;
+    return &h->base;
+}
+
+// ---------------------------------------------------------------------
+// tail: keeps between N and 2N lines, trimming as they pile up
+
+typedef struct {
+    stage_t base;
+    long count;
+    buf_t kept;
+    uint64_t kept_lines;
+} tail_t;
+
+static int tail_push(stage_t* s, const char* data, size_t len) {
+    tail_t* t = (tail_t*)s;
+    const char* end = data + len;
+    const char* start = last_lines(data, end, (uint64_t)t->count);
+
+    // A block with more than N lines replaces everything before it
+    if (start != data) {
+        t->kept.len = 0;
+        buf_add(&t->kept, start, (size_t)(end - start));
+        t->kept_lines = (uint64_t)t->count;
+        return 0;
+    }
+    buf_add(&t->kept, data, len);
+    t->kept_lines += count_lines(data, end);
+    if (t->kept_lines >= 2 * (uint64_t)t->count) {
+        start = last_lines(t->kept.data, t->kept.data + t->kept.len, (uint64_t)t->count);
+        t->kept.len -= (size_t)(start - t->kept.data);
+        memmove(t->kept.data, start, t->kept.len);
+        t->kept_lines = (uint64_t)t->count;
+    }
+    return 0;
+}
+
+static int tail_finish(stage_t* s) {
+    tail_t* t = (tail_t*)s;
+    const char* end = t->kept.data + t->kept.len;
+    const char* start = last_lines(t->kept.data, end, (uint64_t)t->count);
+
+    emit(s, start, (size_t)(end - start));
+    return 0;
+}
+
+static void tail_free(stage_t* s) {
+    free(((tail_t*)s)->kept.data);
+    free(s);
+}
+
+static stage_t* tail_new(int argc, char** argv) {
+    tail_t* t;
+    long count;
+
+    if (parse_line_count(argc, argv, &count) < 0) return NULL;
+    t = new_stage(sizeof(*t), tail_push, tail_finish, tail_free);
+    t->count = count;
+    t->base.done = count == 0;
+    return &t->base;
+}
+
+// ---------------------------------------------------------------------
+// grep: the simulated grep's scanner over each block. Adjacent selected
+// lines are passed on as one view.
+
+typedef struct {
+    stage_t base;
+    grep_needle_t* needle;
+    int invert, count, number;
+    uint64_t selected;
+    uint64_t line;          // -n: lines before counted
+    const char* counted;
+    buf_t numbered;         // -n: the block's selected lines, numbered
+} grep_stage_t;
+
+typedef struct {
+    const char* start;
+    const char* end;
+} span_t;
+
+static void number_lines(grep_stage_t* g, const char* from, const char* to) {
+    while (from < to) {
+        const char* eol = memchr(from, '\n', (size_t)(to - from));
+        char prefix[24];
+        int n;
+
+        eol = eol ? eol + 1 : to;
+        g->line += count_lines(g->counted, from);
+        g->counted = from;
+        n = snprintf(prefix, sizeof(prefix), "%llu:", (unsigned long long)g->line + 1);
+        buf_add(&g->numbered, prefix, (size_t)n);
+        buf_add(&g->numbered, from, (size_t)(eol - from));
+        from = eol;
+    }
+}
+
+// Lines [from, to) are selected
+static int select_lines(grep_stage_t* g, const char* from, const char* to, span_t* run) {
+    g->selected += g->invert ? count_lines(from, to) : 1;
+    if (g->count) return 0;
+    if (g->number) {
+        number_lines(g, from, to);
+        return 0;
+    }
+    if (from != run->end) {
+        if (emit(&g->base, run->start, (size_t)(run->end - run->start))) return PIPE_STOP;
+        run->start = from;
+    }
+    run->end = to;
+    return 0;
+}
+
+static int grep_push(stage_t* s, const char* data, size_t len) {
+    grep_stage_t* g = (grep_stage_t*)s;
+    const char* end = data + len;
+    const char* p = data;
+    span_t run = { data, data };
+
+    g->counted = data;
+    while (p < end) {
+        const char* hit = grep_needle_find(g->needle, p, end);
+        const char* line = end;
+        const char* eol;
+
+        if (hit) {
+            line = memrchr(p, '\n', (size_t)(hit - p));
+            line = line ? line + 1 : p;
+        }
+        // With -v the lines before the matching one are selected
+        if (g->invert && p < line && select_lines(g, p, line, &run)) return PIPE_STOP;
+        if (!hit) break;
+        eol = memchr(hit, '\n', (size_t)(end - hit));
+        eol = eol ? eol + 1 : end;
+        if (!g->invert && select_lines(g, line, eol, &run)) return PIPE_STOP;
+        p = eol;
+    }
+    if (g->number) {
+        g->line += count_lines(g->counted, end);
+        run.start = g->numbered.data;
+        run.end = g->numbered.data + g->numbered.len;
+        g->numbered.len = 0;
+    }
+    return emit(s, run.start, (size_t)(run.end - run.start));
+}
+
+static int grep_finish(stage_t* s) {
+    grep_stage_t* g = (grep_stage_t*)s;
+
+    if (g->count) {
+        char text[24];
+        int n = snprintf(text, sizeof(text), "%llu\n", (unsigned long long)g->selected);
+
+        emit(s, text, (size_t)n);
+    }
+    return g->selected ? 0 : 1;
+}
+
+static void grep_free(stage_t* s) {
+    grep_stage_t* g = (grep_stage_t*)s;
+
+    grep_needle_free(g->needle);
+    free(g->numbered.data);
+    free(g);
+}
+
+static stage_t* grep_new(int argc, char** argv) {
+    grep_stage_t* g;
+    grep_needle_t* needle;
+    filter_opts_t o;
+    const char* pattern;
+
+    if (filter_getopt(argc, argv, "ivcnFEe:", &o) < 0) return NULL;
+    pattern = o.value['e'];
+    if (pattern ? o.n_operands != 0 : o.n_operands != 1) return NULL;
+    if (!pattern) pattern = argv[1];
+    // Fixed strings only, as for the simulated grep
+    if (!SIM_HAS(&o, 'F') && (strpbrk(pattern, "\\.[]*^$") || (SIM_HAS(&o, 'E') && strpbrk(pattern, "+?{}|()")))) {
+        return NULL;
+    }
+    needle = grep_needle_new(pattern, SIM_HAS(&o, 'i'));
+    if (!needle) return NULL;
+    g = new_stage(sizeof(*g), grep_push, grep_finish, grep_free);
+    g->needle = needle;
+    g->invert = SIM_HAS(&o, 'v');
+    g->count = SIM_HAS(&o, 'c');
+    g->number = SIM_HAS(&o, 'n');
+    return &g->base;
+}
+
+// ---------------------------------------------------------------------
+// wc
+
+typedef struct {
+    stage_t base;
+    int lines, words, bytes;
+    int in_word;
+    uint64_t n_lines, n_words, n_bytes;
+} wc_t;
+
+static int wc_push(stage_t* s, const char* data, size_t len) {
+    wc_t* w = (wc_t*)s;
+    size_t i;
+
+    w->n_bytes += len;
+    if (w->lines) w->n_lines += count_lines(data, data + len);
+    if (!w->words) return 0;
+    for (i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)data[i];
+        int space = c == ' ' || (c >= '\t' && c <= '\r');
+
+        w->n_words += !space && !w->in_word;
+        w->in_word = !space;
+    }
+    return 0;
+}
+
+// One count alone, several in columns, as wc prints them for stdin
+static int wc_finish(stage_t* s) {
+    wc_t* w = (wc_t*)s;
+    const uint64_t counts[3] = { w->n_lines, w->n_words, w->n_bytes };
+    const int shown[3] = { w->lines, w->words, w->bytes };
+    char text[96];
+    int n = 0, i, wide = w->lines + w->words + w->bytes > 1;
+
+    for (i = 0; i < 3; i++) {
+        if (!shown[i]) continue;
+        n += snprintf(text + n, sizeof(text) - (size_t)n, "%s%*llu", n ? " " : "", wide ? 7 : 0,
+                      (unsigned long long)counts[i]);
+    }
+    text[n++] = '\n';
+    emit(s, text, (size_t)n);
+    return 0;
+}
+
+static stage_t* wc_new(int argc, char** argv) {
+    wc_t* w;
+    filter_opts_t o;
+
+    if (filter_getopt(argc, argv, "lwc", &o) < 0 || o.n_operands) return NULL;
+    w = new_stage(sizeof(*w), wc_push, wc_finish, free_plain);
+    w->lines = SIM_HAS(&o, 'l');
+    w->words = SIM_HAS(&o, 'w');
+    w->bytes = SIM_HAS(&o, 'c');
+    if (!w->lines && !w->words && !w->bytes) w->lines = w->words = w->bytes = 1;
+    return &w->base;
+}
+
+// ---------------------------------------------------------------------
+// sort: in the C locale's byte order, like LC_ALL=C sort
+
+typedef struct {
+    const char* text;       // with its newline
+    size_t len;
+    const char* key;
+    size_t key_len;
+    double number;          // -n
+    size_t order;           // position in the input
+} sort_line_t;
+
+typedef struct {
+    stage_t base;
+    int reverse, numeric, unique, fold;
+    char separator;         // -t; 0: fields are separated by blanks
+    long key_start;         // -k fields, 1-based; 0 for the whole line
+    long key_end;           // 0 for the end of the line
+    buf_t text;
+} sort_t;
+
+// Start of field n of [p, end). Blank-separated fields begin with the
+// blanks in front of them, as in sort.
+static const char* field_start(const sort_t* o, const char* p, const char* end, long n) {
+    while (--n > 0 && p < end) {
+        if (o->separator) {
+            const char* sep = memchr(p, o->separator, (size_t)(end - p));
+
+            if (!sep) return end;
+            p = sep + 1;
+        } else {
+            while (p < end && is_blank(*p)) p++;
+            while (p < end && !is_blank(*p)) p++;
+        }
+    }
+    return p;
+}
+
+static const char* field_end(const sort_t* o, const char* p, const char* end) {
+    if (o->separator) {
+        const char* sep = memchr(p, o->separator, (size_t)(end - p));
+
+        return sep ? sep : end;
+    }
+    while (p < end && is_blank(*p)) p++;
+    while (p < end && !is_blank(*p)) p++;
+    return p;
+}
+
+// A leading number: blanks, an optional minus, digits and a fraction
+static double parse_key_number(const char* p, const char* end) {
+    double value = 0, scale = 0.1;
+    int negative = 0;
+
+    while (p < end && is_blank(*p)) p++;
+    if (p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    for (; p < end && isdigit((unsigned char)*p); p++) value = value * 10 + (*p - '0');
+    if (p < end && *p == '.') {
+        for (p++; p < end && isdigit((unsigned char)*p); p++, scale /= 10) value += (*p - '0') * scale;
+    }
+    return negative ? -value : value;
+}
+
+static int compare_keys(const sort_t* o, const sort_line_t* a, const sort_line_t* b) {
+    size_t n = a->key_len < b->key_len ? a->key_len : b->key_len, i;
+    int c = 0;
+
+    if (o->numeric) return (a->number > b->number) - (a->number < b->number);
+    if (!o->fold) {
+        c = memcmp(a->key, b->key, n);
+    } else {
+        for (i = 0; i < n && !c; i++) c = toupper((unsigned char)a->key[i]) - toupper((unsigned char)b->key[i]);
+    }
+    return c ? c : (a->key_len > b->key_len) - (a->key_len < b->key_len);
+}
+
+// Equal keys fall back to the whole line, as in sort without -s; lines
+// that are still equal keep their input order
+static int compare_lines(const void* x, const void* y, void* ctx) {
+    const sort_t* o = ctx;
+    const sort_line_t* a = *(const sort_line_t* const*)x;
+    const sort_line_t* b = *(const sort_line_t* const*)y;
+    int c = compare_keys(o, a, b);
+
+    if (!c && !o->unique) {
+        size_t n = a->len < b->len ? a->len : b->len;
+
+        c = memcmp(a->text, b->text, n);
+        if (!c) c = (a->len > b->len) - (a->len < b->len);
+    }
+    if (c) return o->reverse ? -c : c;
+    return (a->order > b->order) - (a->order < b->order);
+}
+
+static int sort_push(stage_t* s, const char* data, size_t len) {
+    buf_add(&((sort_t*)s)->text, data, len);
+    return 0;
+}
+
+// The lines are sorted by pointer, which moves less than the records
+static int sort_finish(stage_t* s) {
+    sort_t* o = (sort_t*)s;
+    const char* p = o->text.data;
+    const char* end = p + o->text.len;
+    size_t n = count_lines(p, end), i;
+    sort_line_t* lines = xrealloc(NULL, n * sizeof(sort_line_t) + 1);
+    sort_line_t** sorted = xrealloc(NULL, n * sizeof(sort_line_t*) + 1);
+
+    for (i = 0; i < n; i++) {
+        const char* eol = memchr(p, '\n', (size_t)(end - p));
+        sort_line_t* l = &lines[i];
+        const char* key_end = eol;
+
+        l->text = p;
+        l->len = (size_t)(eol - p);
+        l->key = o->key_start ? field_start(o, p, eol, o->key_start) : p;
+        if (o->key_end) key_end = field_end(o, field_start(o, p, eol, o->key_end), eol);
+        l->key_len = key_end > l->key ? (size_t)(key_end - l->key) : 0;
+        l->number = o->numeric ? parse_key_number(l->key, l->key + l->key_len) : 0;
+        l->order = i;
+        sorted[i] = l;
+        p = eol + 1;
+    }
+    qsort_r(sorted, n, sizeof(sort_line_t*), compare_lines, o);
+    for (i = 0; i < n; i++) {
+        if (o->unique && i > 0 && compare_keys(o, sorted[i - 1], sorted[i]) == 0) continue;
+        if (emit(s, sorted[i]->text, sorted[i]->len + 1)) break;
+    }
+    free(sorted);
+    free(lines);
+    return 0;
+}
+
+static void sort_free(stage_t* s) {
+    free(((sort_t*)s)->text.data);
+    free(s);
+}
+
+// -k N or -k N,M: whole fields only
+static int parse_key(const char* text, long* start, long* end) {
+    char* stop;
+
+    *start = strtol(text, &stop, 10);
+    *end = 0;
+    if (*start < 1 || stop == text) return -1;
+    if (*stop == ',') {
+        text = stop + 1;
+        *end = strtol(text, &stop, 10);
+        if (*end < *start || stop == text) return -1;
+    }
+    return *stop ? -1 : 0;
+}
+
+static stage_t* sort_new(int argc, char** argv) {
+    sort_t* o;
+    filter_opts_t f;
+    long key_start = 0, key_end = 0;
+    const char* separator;
+
+    if (filter_getopt(argc, argv, "rnuft:k:", &f) < 0 || f.n_operands) return NULL;
+    separator = f.value['t'];
+    if (separator && strlen(separator) != 1) return NULL;
+    if (f.value['k'] && parse_key(f.value['k'], &key_start, &key_end) < 0) return NULL;
+    o = new_stage(sizeof(*o), sort_push, sort_finish, sort_free);
+    o->reverse = SIM_HAS(&f, 'r');
+    o->numeric = SIM_HAS(&f, 'n');
+    o->unique = SIM_HAS(&f, 'u');
+    o->fold = SIM_HAS(&f, 'f');
+    o->separator = separator ? separator[0] : 0;
+    o->key_start = key_start;
+    o->key_end = key_end;
+    return &o->base;
+}
+
+// ---------------------------------------------------------------------
+// cut: each block's lines are cut into one buffer, passed on whole
+
+typedef struct {
+    long lo, hi;            // 1-based, inclusive
+} range_t;
+
+typedef struct {
+    stage_t base;
+    int fields;             // -f, else -c/-b
+    char delimiter;
+    int only_delimited;     // -s
+    range_t ranges[MAX_RANGES];     // sorted and merged
+    int n_ranges;
+    buf_t out;
+} cut_t;
+
+static int compare_ranges(const void* a, const void* b) {
+    const range_t* x = a;
+    const range_t* y = b;
+
+    return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+// "1,3-5,7-": N, N-M, N- and -M
+static int parse_list(cut_t* c, const char* text) {
+    const char* p = text;
+    int i, n = 0;
+
+    for (;;) {
+        range_t r = { 1, TO_END };
+        char* stop;
+
+        if (n == MAX_RANGES) return -1;
+        if (isdigit((unsigned char)*p)) {
+            r.lo = r.hi = strtol(p, &stop, 10);
+            p = stop;
+        }
+        if (*p == '-') {
+            p++;
+            r.hi = TO_END;
+            if (isdigit((unsigned char)*p)) {
+                r.hi = strtol(p, &stop, 10);
+                p = stop;
+            }
+        } else if (p == text || p[-1] == ',') {
+            return -1;
+        }
+        if (r.lo < 1 || r.hi < r.lo) return -1;
+        c->ranges[n++] = r;
+        if (!*p) break;
+        if (*p++ != ',') return -1;
+        text = p;
+    }
+    qsort(c->ranges, (size_t)n, sizeof(range_t), compare_ranges);
+    c->n_ranges = 0;
+    for (i = 0; i < n; i++) {
+        range_t* last = c->n_ranges ? &c->ranges[c->n_ranges - 1] : NULL;
+
+        if (last && c->ranges[i].lo <= (last->hi == TO_END ? TO_END : last->hi + 1)) {
+            if (c->ranges[i].hi > last->hi) last->hi = c->ranges[i].hi;
+        } else {
+            c->ranges[c->n_ranges++] = c->ranges[i];
+        }
+    }
+    return 0;
+}
+
+static void cut_fields(cut_t* c, const char* p, const char* eol) {
+    const char* sep = memchr(p, c->delimiter, (size_t)(eol - p));
+    long field = 1;
+    int r = 0, wrote = 0;
+
+    if (!sep) {
+        if (c->only_delimited) return;
+        buf_add(&c->out, p, (size_t)(eol - p) + 1);
+        return;
+    }
+    while (r < c->n_ranges) {
+        const char* end = sep ? sep : eol;
+
+        if (field > c->ranges[r].hi) {
+            r++;
+            continue;
+        }
+        if (field >= c->ranges[r].lo) {
+            if (wrote++) buf_add(&c->out, &c->delimiter, 1);
+            buf_add(&c->out, p, (size_t)(end - p));
+        }
+        if (!sep) break;
+        p = sep + 1;
+        sep = memchr(p, c->delimiter, (size_t)(eol - p));
+        field++;
+    }
+    buf_add(&c->out, "\n", 1);
+}
+
+static void cut_bytes(cut_t* c, const char* p, const char* eol) {
+    long len = eol - p;
+    int r;
+
+    for (r = 0; r < c->n_ranges && c->ranges[r].lo <= len; r++) {
+        long hi = c->ranges[r].hi < len ? c->ranges[r].hi : len;
+
+        buf_add(&c->out, p + c->ranges[r].lo - 1, (size_t)(hi - c->ranges[r].lo + 1));
+    }
+    buf_add(&c->out, "\n", 1);
+}
+
+static int cut_push(stage_t* s, const char* data, size_t len) {
+    cut_t* c = (cut_t*)s;
+    const char* end = data + len;
+    int rc;
+
+    while (data < end) {
+        const char* eol = memchr(data, '\n', (size_t)(end - data));
+
+        if (c->fields) {
+            cut_fields(c, data, eol);
+        } else {
+            cut_bytes(c, data, eol);
+        }
+        data = eol + 1;
+    }
+    rc = emit(s, c->out.data, c->out.len);
+    c->out.len = 0;
+    return rc;
+}
+
+static void cut_free(stage_t* s) {
+    free(((cut_t*)s)->out.data);
+    free(s);
+}
+
+static stage_t* cut_new(int argc, char** argv) {
+    cut_t* c;
+    filter_opts_t o;
+    const char* list;
+    const char* delimiter;
+
+    if (filter_getopt(argc, argv, "d:f:c:b:s", &o) < 0 || o.n_operands) return NULL;
+    list = o.value['f'] ? o.value['f'] : o.value['c'] ? o.value['c'] : o.value['b'];
+    if (!list || !!o.value['f'] + !!o.value['c'] + !!o.value['b'] != 1) return NULL;
+    delimiter = o.value['d'] ? o.value['d'] : "\t";
+    if (strlen(delimiter) != 1 || (o.value['d'] && !o.value['f'])) return NULL;
+    c = new_stage(sizeof(*c), cut_push, finish_ok, cut_free);
+    c->fields = o.value['f'] != NULL;
+    c->delimiter = delimiter[0];
+    c->only_delimited = SIM_HAS(&o, 's');
+    if (parse_list(c, list) < 0) {
+        cut_free(&c->base);
+        return NULL;
+    }
+    return &c->base;
+}
+
+// ---------------------------------------------------------------------
+// The pipeline
+
+static const struct {
+    const char* name;
+    stage_t* (*make)(int argc, char** argv);
+} filters[] = {
+    { "cut", cut_new },
+    { "grep", grep_new },
+    { "head", head_new },
+    { "sort", sort_new },
+    { "tail", tail_new },
+    { "wc", wc_new },
+};
+
+pipeline_t* pipeline_new(void) {
+    pipeline_t* p = xrealloc(NULL, sizeof(*p));
+
+    memset(p, 0, sizeof(*p));
+    p->line_limit = -1;
+    return p;
+}
+
+void pipeline_free(pipeline_t* p) {
+    stage_t* s;
+
+    if (!p) return;
+    while ((s = p->first) != NULL) {
+        p->first = s->next;
+        s->free(s);
+    }
+    free(p->carry.data);
+    free(p);
+}
+
+int pipeline_add(pipeline_t* p, int argc, char** argv) {
+    stage_t* s = NULL;
+    size_t i;
+
+    for (i = 0; i < sizeof(filters) / sizeof(filters[0]) && !s; i++) {
+        if (strcmp(filters[i].name, argv[0]) == 0) s = filters[i].make(argc, argv);
+    }
+    if (!s) return -1;
+    s->pipe = p;
+    if (!p->first && s->push == head_push) p->line_limit = ((head_t*)s)->count;
+    if (p->last) {
+        p->last->next = s;
+    } else {
+        p->first = s;
+    }
+    p->last = s;
+    return 0;
+}
+
+long pipeline_line_limit(const pipeline_t* p) {
+    return p->line_limit;
+}
+
+// The source console's sink: whole lines go to the first stage as they
+// are written; only a line split between writes is put together
+static int source_write(void* ctx, const char* data, size_t len) {
+    pipeline_t* p = ctx;
+    const char* end = data + len;
+    const char* last;
+
+    if (p->carry.len) {
+        const char* nl = memchr(data, '\n', len);
+
+        buf_add(&p->carry, data, nl ? (size_t)(nl + 1 - data) : len);
+        if (!nl) return 0;
+        if (pass(p->first, p->carry.data, p->carry.len)) return PIPE_STOP;
+        p->carry.len = 0;
+        data = nl + 1;
+    }
+    last = data < end ? memrchr(data, '\n', (size_t)(end - data)) : NULL;
+    if (last) {
+        if (pass(p->first, data, (size_t)(last + 1 - data))) return PIPE_STOP;
+        data = last + 1;
+    }
+    buf_add(&p->carry, data, (size_t)(end - data));
+    return 0;
+}
+
+int pipeline_run(pipeline_t* p, sim_command_fn source, int argc, char** argv) {
+    console_t* out = console_current();
+    stage_t* s;
+    int status;
+
+    memset(&p->source, 0, sizeof(p->source));
+    p->source.out_fd = -1;
+    p->source.capture = 1;
+    p->source.sink = source_write;
+    p->source.sink_ctx = p;
+    p->source.sink_done = p->first->done;
+    p->out = out;
+    p->carry.len = 0;
+    console_use(&p->source);
+    status = source(argc, argv);
+    console_use(out);
+    if (status < 0) return -1;
+
+    // An unterminated last line is still a line
+    if (p->carry.len && !p->source.sink_done) {
+        buf_add(&p->carry, "\n", 1);
+        pass(p->first, p->carry.data, p->carry.len);
+    }
+    for (s = p->first; s; s = s->next) status = s->finish(s);
+    return status;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: filter throughput on a large generated log
+
+#define BENCH_ROUNDS 3
+#define BENCH_CHUNK (64 << 10)
+
+static uint64_t bench_rng = 0x2545F4914F6CDD1Dull;
+
+static struct {
+    const char* data;
+    size_t len;
+    size_t chunk;           // bytes per write, 0: a line per write
+    size_t written;         // before the pipeline stopped it
+} bench_input;
+
+static int bench_source(int argc, char** argv) {
+    const char* p = bench_input.data;
+    const char* end = p + bench_input.len;
+
+    (void)argc;
+    (void)argv;
+    while (p < end && !con_stopped()) {
+        size_t n = (size_t)(end - p);
+
+        if (!bench_input.chunk) {
+            n = (size_t)((const char*)memchr(p, '\n', n) + 1 - p);
+        } else if (n > bench_input.chunk) {
+            n = bench_input.chunk;
+        }
+        con_write(p, n);
+        p += n;
+    }
+    bench_input.written = (size_t)(p - bench_input.data);
+    return 0;
+}
+
+static void generate_log(buf_t* b, size_t size) {
+    static const char* const programs[] = { "sshd", "systemd", "CRON", "kernel", "dhclient", "apt", "sudo" };
+    static const char* const messages[] = {
+        "Accepted publickey for admin from 10.0.%u.%u port %u ssh2",
+        "Started Session %u of user admin.",
+        "(root) CMD (run-parts /etc/cron.hourly %u %u)",
+        "EXT4-fs (sda1): error count since last fsck: %u %u %u",
+        "DHCPACK of 192.168.%u.%u from 192.168.1.%u",
+        "Unpacking libssl3:amd64 (3.0.%u-%u) over (3.0.%u)",
+        "pam_unix(sudo:session): session opened for user root(uid=0) by admin(uid=%u) %u",
+        "Failed password for invalid user test from 203.0.113.%u port %u ssh2",
+    };
+    char line[256];
+
+    while (b->len < size) {
+        int n = snprintf(line, sizeof(line), "Oct 15 %02u:%02u:%02u sim-debian %s[%u]: ", bench_random(&bench_rng, 24),
+                         bench_random(&bench_rng, 60), bench_random(&bench_rng, 60), programs[bench_random(&bench_rng, 7)], 300 + bench_random(&bench_rng, 30000));
+
+        n += snprintf(line + n, sizeof(line) - (size_t)n, messages[bench_random(&bench_rng, 8)], bench_random(&bench_rng, 256),
+                      bench_random(&bench_rng, 256), 1024 + bench_random(&bench_rng, 60000));
+        line[n++] = '\n';
+        buf_add(b, line, (size_t)n);
+    }
+}
+
+static int collect(void* ctx, const char* data, size_t len) {
+    buf_add(ctx, data, len);
+    return 0;
+}
+
+// Best of BENCH_ROUNDS; the output lands in out
+static double time_pipeline(const char* filters_line, buf_t* out) {
+    double best = 0;
+    int round;
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        char words[512];
+        char* argv[64];
+        int argc = sim_tokenize(filters_line, words, sizeof(words), argv, 63, "/"), start = 0, i;
+        pipeline_t* p = pipeline_new();
+        console_t collector;
+        double began, elapsed;
+
+        for (i = 0; i <= argc; i++) {
+            if (i < argc && argv[i]) continue;
+            argv[i] = NULL;
+            if (pipeline_add(p, i - start, argv + start) < 0) {
+                fprintf(stderr, "pipeline: cannot run \"%s\"\n", filters_line);
+                pipeline_free(p);
+                return 0;
+            }
+            start = i + 1;
+        }
+        memset(&collector, 0, sizeof(collector));
+        collector.out_fd = -1;
+        collector.sink = collect;
+        collector.sink_ctx = out;
+        out->len = 0;
+        console_use(&collector);
+        began = bench_now();
+        pipeline_run(p, bench_source, 1, (char*[]){ "cat", NULL });
+        elapsed = bench_now() - began;
+        console_use(NULL);
+        pipeline_free(p);
+        if (!best || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// The same through sh, cat and the system's tools
+static double time_system(const char* file, const char* filters_line, buf_t* out) {
+    char command[1024];
+    double best = 0;
+    int round;
+
+    snprintf(command, sizeof(command), "LC_ALL=C; export LC_ALL; cat %s | %s", file, filters_line);
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        char chunk[4096];
+        double start = bench_now(), elapsed;
+        FILE* fp = popen(command, "r");
+        size_t n;
+
+        if (!fp) return 0;
+        out->len = 0;
+        while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) buf_add(out, chunk, n);
+        if (pclose(fp) == -1) return 0;
+        elapsed = bench_now() - start;
+        if (!best || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+int pipeline_bench(int argc, char** argv) {
+    uint64_t megabytes = argc > 0 ? strtoull(argv[0], NULL, 10) : 256;
+    static const struct {
+        const char* metric;
+        const char* filters;
+        size_t chunk;
+    } runs[] = {
+        { "grep_count", "grep -c error", BENCH_CHUNK },
+        { "grep_count_lines", "grep -c error", 0 },
+        { "grep_wc", "grep sshd | wc -l", BENCH_CHUNK },
+        { "grep_v_count", "grep -v -c CRON", BENCH_CHUNK },
+        { "wc", "wc", BENCH_CHUNK },
+        { "cut_sort_head", "cut -d ' ' -f 5 | sort -u | head -3", BENCH_CHUNK },
+        { "tail", "tail -5", BENCH_CHUNK },
+    };
+    char file[] = "/tmp/deb1-bench-pipeline-XXXXXX";
+    buf_t log = { NULL, 0, 0 }, ours = { NULL, 0, 0 }, theirs = { NULL, 0, 0 };
+    const int have_sh = system("cat /dev/null | wc -l >/dev/null 2>&1") == 0;
+    double elapsed;
+    char metric[64];
+    size_t i;
+    int fd;
+
+    if (megabytes == 0) megabytes = 256;
+    generate_log(&log, megabytes << 20);
+    bench_input.data = log.data;
+    bench_input.len = log.len;
+    printf("pipeline: %llu MB of log, %llu lines\n", (unsigned long long)megabytes,
+           (unsigned long long)count_lines(log.data, log.data + log.len));
+
+    fd = have_sh ? mkstemp(file) : -1;
+    if (fd >= 0) {
+        if (write(fd, log.data, log.len) != (ssize_t)log.len) {
+            unlink(file);
+            close(fd);
+            fd = -1;
+        } else {
+            close(fd);
+        }
+    }
+
+    for (i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        bench_input.chunk = runs[i].chunk;
+        elapsed = time_pipeline(runs[i].filters, &ours);
+        if (!elapsed) continue;
+        bench_report("pipeline", runs[i].metric, log.len / elapsed / 1e6, "MB/s");
+        if (fd < 0 || !runs[i].chunk) continue;
+
+        elapsed = time_system(file, runs[i].filters, &theirs);
+        if (!elapsed) continue;
+        snprintf(metric, sizeof(metric), "%s_system", runs[i].metric);
+        bench_report("pipeline", metric, log.len / elapsed / 1e6, "MB/s");
+        if (ours.len != theirs.len || memcmp(ours.data, theirs.data, ours.len) != 0) {
+            fprintf(stderr, "pipeline %s: output differs from the system's:\n%.*s---\n%.*s", runs[i].filters,
+                    (int)(ours.len < 400 ? ours.len : 400), ours.data, (int)(theirs.len < 400 ? theirs.len : 400),
+                    theirs.data);
+        }
+    }
+
+    // "| head": the source stops as soon as head has its lines
+    bench_input.chunk = 0;
+    elapsed = time_pipeline("grep sshd | head -10", &ours);
+    bench_report("pipeline", "grep_head10", elapsed * 1e6, "us");
+    bench_report("pipeline", "grep_head10_read", bench_input.written / 1024.0, "KB");
+
+    if (fd >= 0) unlink(file);
+    free(log.data);
+    free(ours.data);
+    free(theirs.data);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sim.h"
+
+// The filters after a "|" in a simulated command line.
+//
+// The first command of a pipeline is a simulator writing to its console
+// as usual; the console hands each write to the first filter instead of
+// buffering it. Filters work on whole lines and pass each other views of
+// the writer's own memory: only a line split across two writes is copied
+// (to join it), and tail and sort keep copies of what they still need.
+// When a filter wants nothing more ("head -3" after its third line) it
+// says so upstream; the console then drops further writes and
+// con_stopped() tells the simulator it may stop.
+//
+// Filters: head [-n] N, tail [-n] N, grep [-ivcnF] [-e] STRING (fixed
+// strings, like the simulated grep), wc [-lwc], sort [-rnuf] [-t C]
+// [-k N[,M]], cut -d C -f LIST | -c LIST [-s].
+
+typedef struct pipeline pipeline_t;
+
+pipeline_t* pipeline_new(void);
+void pipeline_free(pipeline_t* p);
+
+// Append a filter. Returns -1 (printing nothing) for a command or an
+// option that is not simulated.
+int pipeline_add(pipeline_t* p, int argc, char** argv);
+
+// Lines the first filter lets through, if it is head; -1 otherwise
+long pipeline_line_limit(const pipeline_t* p);
+
+// Run source with its output going through the filters; the last one
+// writes to the current console. Returns the last filter's exit status,
+// or -1 if source is not simulated after all (nothing was written).
+int pipeline_run(pipeline_t* p, sim_command_fn source, int argc, char** argv);
+
+// Space-separated filter names, for help texts
+extern const char pipeline_filters[];
+
+// --bench pipeline [MB]
+int pipeline_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "deb1.h"
+#include "bench.h"
+#include "lesson_pack.h"
+#include "sim.h"
+#include "sysinfo.h"
+#include "prefetch.h"
+
+#define MAX_ARGS 64
+
+// What a program may be given to count as read-only
+typedef struct {
+    const char* name;
+    const char* const* verbs;       // the first operand (or argv[1]) must be one of these
+    int verb_is_first_arg;          // verbs are options (dpkg -l)
+    const char* refuse_letters;     // short options that write, follow or wait
+    const char* const* refuse_args; // arguments that do, exactly or as --opt=value
+    int max_operands;               // -1 = any
+    int reads_stdin;                // first in a pipeline only with a file to read
+} safe_program_t;
+
+static const char* const apt_verbs[] = { "search", "show", "list", "depends", "rdepends", "policy", NULL };
+static const char* const apt_cache_verbs[] = {
+    "search", "show", "showpkg", "showsrc", "policy", "depends", "rdepends", "pkgnames", "stats", "madison", NULL
+};
+static const char* const dpkg_verbs[] = {
+    "-l", "--list", "-L", "--listfiles", "-s", "--status", "-S", "--search", "-p", "--print-avail",
+    "--get-selections", NULL
+};
+static const char* const ip_verbs[] = { "a", "addr", "address", "l", "link", "r", "route", "n", "neigh", NULL };
+static const char* const systemctl_verbs[] = {
+    "status", "list-units", "list-unit-files", "list-timers", "list-sockets", "list-dependencies",
+    "is-active", "is-enabled", "is-failed", "show", "cat", NULL
+};
+
+static const char* const date_refuse[] = { "--set", NULL };
+static const char* const dmesg_refuse[] = {
+    "--clear", "--read-clear", "--console-off", "--console-on", "--console-level", "--follow", "--follow-new", NULL
+};
+static const char* const file_refuse[] = { "--compile", NULL };
+static const char* const find_refuse[] = {
+    "-delete", "-exec", "-execdir", "-ok", "-okdir", "-fprint", "-fprint0", "-fprintf", "-fls", NULL
+};
+static const char* const hostname_refuse[] = { "--file", "--boot", NULL };
+static const char* const ip_refuse[] = {
+    "add", "del", "delete", "set", "change", "replace", "flush", "append", "prepend", "monitor", NULL
+};
+static const char* const journalctl_refuse[] = {
+    "--follow", "--flush", "--rotate", "--sync", "--relinquish-var", "--smart-relinquish-var",
+    "--vacuum-size", "--vacuum-time", "--vacuum-files", "--setup-keys", "--update-catalog", NULL
+};
+static const char* const sort_refuse[] = { "--output", "--compress-program", NULL };
+static const char* const ss_refuse[] = { "--kill", "--events", NULL };
+static const char* const tail_refuse[] = { "--follow", NULL };
+
+// Sorted by name
+static const safe_program_t safelist[] = {
+    { "apt", apt_verbs, 0, NULL, NULL, -1, 0 },
+    { "apt-cache", apt_cache_verbs, 0, NULL, NULL, -1, 0 },
+    { "cat", NULL, 0, NULL, NULL, -1, 1 },
+    { "cut", NULL, 0, NULL, NULL, -1, 1 },
+    { "date", NULL, 0, "s", date_refuse, 0, 0 },
+    { "df", NULL, 0, NULL, NULL, -1, 0 },
+    { "dmesg", NULL, 0, "cCDEnw", dmesg_refuse, 0, 0 },
+    { "dpkg", dpkg_verbs, 1, NULL, NULL, -1, 0 },
+    { "dpkg-query", NULL, 0, NULL, NULL, -1, 0 },
+    { "du", NULL, 0, NULL, NULL, -1, 0 },
+    { "file", NULL, 0, "C", file_refuse, -1, 0 },
+    { "find", NULL, 0, NULL, find_refuse, -1, 0 },
+    { "free", NULL, 0, NULL, NULL, 0, 0 },
+    { "getent", NULL, 0, NULL, NULL, -1, 0 },
+    { "grep", NULL, 0, NULL, NULL, -1, 1 },
+    { "head", NULL, 0, NULL, NULL, -1, 1 },
+    { "hostname", NULL, 0, "Fb", hostname_refuse, 0, 0 },
+    { "id", NULL, 0, NULL, NULL, -1, 0 },
+    { "ip", ip_verbs, 0, NULL, ip_refuse, -1, 0 },
+    { "journalctl", NULL, 0, "f", journalctl_refuse, -1, 0 },
+    { "last", NULL, 0, NULL, NULL, -1, 0 },
+    { "locate", NULL, 0, NULL, NULL, -1, 0 },
+    { "ls", NULL, 0, NULL, NULL, -1, 0 },
+    { "lsb_release", NULL, 0, NULL, NULL, 0, 0 },
+    { "lsblk", NULL, 0, NULL, NULL, -1, 0 },
+    { "lscpu", NULL, 0, NULL, NULL, 0, 0 },
+    { "pgrep", NULL, 0, NULL, NULL, -1, 0 },
+    { "ps", NULL, 0, NULL, NULL, -1, 0 },
+    { "pwd", NULL, 0, NULL, NULL, 0, 0 },
+    { "sort", NULL, 0, "o", sort_refuse, -1, 1 },
+    { "ss", NULL, 0, "KE", ss_refuse, -1, 0 },
+    { "stat", NULL, 0, NULL, NULL, -1, 0 },
+    { "systemctl", systemctl_verbs, 0, NULL, NULL, -1, 0 },
+    { "tail", NULL, 0, "fF", tail_refuse, -1, 1 },
+    { "uname", NULL, 0, NULL, NULL, 0, 0 },
+    { "uniq", NULL, 0, NULL, NULL, 1, 1 },
+    { "uptime", NULL, 0, NULL, NULL, 0, 0 },
+    { "w", NULL, 0, NULL, NULL, -1, 0 },
+    { "wc", NULL, 0, NULL, NULL, -1, 1 },
+    { "which", NULL, 0, NULL, NULL, -1, 0 },
+    { "who", NULL, 0, NULL, NULL, -1, 0 },
+    { "whoami", NULL, 0, NULL, NULL, 0, 0 },
+};
+
+static const safe_program_t* find_program(const char* name) {
+    size_t lo = 0, hi = sizeof(safelist) / sizeof(safelist[0]);
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int cmp = strcmp(safelist[mid].name, name);
+
+        if (cmp == 0) return &safelist[mid];
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+static int in_list(const char* const* list, const char* arg) {
+    size_t len;
+
+    for (; list && *list; list++) {
+        len = strlen(*list);
+        if (strncmp(arg, *list, len) == 0 && (arg[len] == '\0' || arg[len] == '=')) return 1;
+    }
+    return 0;
+}
+
+static int stage_safe(char** argv, int argc, int first) {
+    const safe_program_t* p = find_program(argv[0]);
+    const char* first_operand = NULL;
+    int operands = 0, i;
+
+    if (!p) return 0;
+    for (i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+
+        if (in_list(p->refuse_args, arg)) return 0;
+        if (arg[0] == '-' && arg[1] != '-' && p->refuse_letters && strpbrk(arg + 1, p->refuse_letters)) return 0;
+        if (arg[0] == '-' || arg[0] == '+') continue;
+        if (!first_operand) first_operand = arg;
+        operands++;
+    }
+    if (p->max_operands >= 0 && operands > p->max_operands) return 0;
+    if (p->verbs) {
+        const char* verb = p->verb_is_first_arg ? (argc > 1 ? argv[1] : NULL) : first_operand;
+        if (!verb || !in_list(p->verbs, verb)) return 0;
+    }
+    // A filter at the start of a pipeline would read the terminal when run
+    // for real and /dev/null here: only with a file it can read instead
+    if (first && p->reads_stdin && (argc < 2 || access(argv[argc - 1], R_OK) < 0)) return 0;
+    return 1;
+}
+
+int prefetch_safe(const char* command) {
+    char buf[1024];
+    char* argv[MAX_ARGS];
+    const char* home = getenv("HOME");
+    int argc, start = 0, i;
+
+    argc = sim_tokenize(command, buf, sizeof(buf), argv, MAX_ARGS - 1, home ? home : "/");
+    if (argc <= 0) return 0;
+    for (i = 0; i <= argc; i++) {
+        if (i < argc && argv[i]) continue;
+        if (i == start || !stage_safe(argv + start, i - start, start == 0)) return 0;
+        start = i + 1;
+    }
+    return 1;
+}
+
+// The pool: one job slot per worker. A slot is queued by the main thread,
+// run by whichever worker is free and then either taken or cancelled.
+
+typedef enum {
+    JOB_FREE,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE
+} job_state_t;
+
+typedef struct {
+    job_state_t state;
+    int cancelled;          // free the slot as soon as the worker lets go
+    int taken;              // the learner is reading it (output waits for room)
+    int overflowed;         // outgrew the buffer before it was taken
+    int cancel_fd;          // eventfd that stops the running command
+    char command[MAX_INPUT];
+    launch_opts_t opts;
+    char* buf;              // output not yet delivered: buf[read..len)
+    size_t len, read;
+    launch_result_t result;
+    int rc;
+    double started, finished;
+} job_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t workers[PREFETCH_WORKERS];
+    int n_workers;
+    int quit;
+    job_t jobs[PREFETCH_WORKERS];
+    prefetch_stats_t stats;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER };
+
+static volatile sig_atomic_t interrupted;
+
+static void on_sigint(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+static void release(job_t* job) {
+    uint64_t drain;
+
+    if (read(job->cancel_fd, &drain, sizeof(drain)) < 0) {
+        // Nothing was pending
+    }
+    job->state = JOB_FREE;
+    job->cancelled = job->taken = job->overflowed = 0;
+    job->len = job->read = 0;
+}
+
+// With pool.lock held
+static void cancel_job(job_t* job) {
+    uint64_t one = 1;
+
+    if (job->state == JOB_FREE || job->cancelled) return;
+    if (!job->taken) pool.stats.cancelled++;
+    if (job->state == JOB_RUNNING) {
+        job->cancelled = 1;
+        if (write(job->cancel_fd, &one, sizeof(one)) < 0) {
+            // The counter cannot overflow with one write per run
+        }
+        pthread_cond_broadcast(&pool.changed);
+    } else {
+        release(job);
+    }
+}
+
+// launch_command() output callback, on the worker
+static int collect(void* ctx, const char* data, size_t len) {
+    job_t* job = ctx;
+    int stop;
+
+    pthread_mutex_lock(&pool.lock);
+    while (len && !job->cancelled) {
+        size_t room = PREFETCH_MAX_OUTPUT - job->len;
+
+        if (room == 0) {
+            if (!job->taken) {
+                job->overflowed = 1;
+                break;
+            }
+            pthread_cond_wait(&pool.changed, &pool.lock);
+            continue;
+        }
+        if (room > len) room = len;
+        memcpy(job->buf + job->len, data, room);
+        job->len += room;
+        data += room;
+        len -= room;
+        pthread_cond_broadcast(&pool.changed);
+    }
+    stop = job->cancelled || job->overflowed;
+    pthread_mutex_unlock(&pool.lock);
+    return stop;
+}
+
+static void* worker(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        job_t* job = NULL;
+        launch_opts_t opts;
+        launch_result_t result;
+        int i, rc;
+
+        for (i = 0; i < PREFETCH_WORKERS && !job; i++) {
+            if (pool.jobs[i].state == JOB_QUEUED) job = &pool.jobs[i];
+        }
+        if (pool.quit) break;
+        if (!job) {
+            pthread_cond_wait(&pool.changed, &pool.lock);
+            continue;
+        }
+        job->state = JOB_RUNNING;
+        job->started = bench_now();
+        opts = job->opts;
+        opts.foreground = 0;
+        opts.cancel_fd = job->cancel_fd;
+        opts.on_output = collect;
+        opts.ctx = job;
+        pthread_mutex_unlock(&pool.lock);
+
+        rc = launch_command(job->command, &opts, &result);
+
+        pthread_mutex_lock(&pool.lock);
+        job->rc = rc;
+        job->result = result;
+        job->finished = bench_now();
+        job->state = JOB_DONE;
+        if (job->cancelled && !job->taken) release(job);
+        pthread_cond_broadcast(&pool.changed);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+// With pool.lock held. Workers get every signal blocked, so Ctrl-C and
+// SIGWINCH keep going to the main thread.
+static int start_workers(void) {
+    sigset_t all, old;
+    int i;
+
+    if (pool.n_workers) return 0;
+    for (i = 0; i < PREFETCH_WORKERS; i++) {
+        job_t* job = &pool.jobs[i];
+
+        job->cancel_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        job->buf = malloc(PREFETCH_MAX_OUTPUT);
+        if (job->cancel_fd < 0 || !job->buf) return -1;
+    }
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i = 0; i < PREFETCH_WORKERS; i++) {
+        if (pthread_create(&pool.workers[pool.n_workers], NULL, worker, NULL) != 0) break;
+        pool.n_workers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return pool.n_workers ? 0 : -1;
+}
+
+void prefetch_start(const char* command, const launch_opts_t* limits) {
+    job_t* slot = NULL;
+    double now = bench_now();
+    int i;
+
+    if (strlen(command) >= MAX_INPUT || !prefetch_safe(command)) {
+        pthread_mutex_lock(&pool.lock);
+        pool.stats.refused++;
+        pthread_mutex_unlock(&pool.lock);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    if (start_workers() < 0) {
+        pthread_mutex_unlock(&pool.lock);
+        return;
+    }
+    for (i = 0; i < PREFETCH_WORKERS; i++) {
+        job_t* job = &pool.jobs[i];
+
+        if (job->state == JOB_FREE || job->cancelled) continue;
+        // Already running for this demo (it was shown again)
+        if (strcmp(job->command, command) == 0 && !job->taken && !job->overflowed &&
+            (job->state != JOB_DONE || (now - job->finished) * 1e3 < PREFETCH_FRESH_MS)) {
+            pthread_mutex_unlock(&pool.lock);
+            return;
+        }
+        cancel_job(job);
+    }
+    for (i = 0; i < PREFETCH_WORKERS && !slot; i++) {
+        if (pool.jobs[i].state == JOB_FREE) slot = &pool.jobs[i];
+    }
+    // Otherwise every worker is still stopping a cancelled run
+    if (slot) {
+        snprintf(slot->command, sizeof(slot->command), "%s", command);
+        memset(&slot->opts, 0, sizeof(slot->opts));
+        slot->opts.timeout_ms = limits ? limits->timeout_ms : 0;
+        slot->opts.max_output = limits ? limits->max_output : 0;
+        slot->state = JOB_QUEUED;
+        pool.stats.started++;
+        pthread_cond_broadcast(&pool.changed);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+int prefetch_take(const char* command, const launch_opts_t* opts, launch_result_t* result, double* saved) {
+    struct sigaction sa, old_sa;
+    job_t* job = NULL;
+    double now = bench_now();
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    for (i = 0; i < PREFETCH_WORKERS && !job; i++) {
+        if (pool.jobs[i].state != JOB_FREE && !pool.jobs[i].cancelled &&
+            strcmp(pool.jobs[i].command, command) == 0) {
+            job = &pool.jobs[i];
+        }
+    }
+    if (!job || job->overflowed ||
+        (job->state == JOB_DONE && (job->rc < 0 || (now - job->finished) * 1e3 >= PREFETCH_FRESH_MS))) {
+        if (job) cancel_job(job);
+        pool.stats.misses++;
+        pthread_mutex_unlock(&pool.lock);
+        return -1;
+    }
+    job->taken = 1;
+    pool.stats.hits++;
+    if (job->state == JOB_QUEUED) {
+        *saved = 0;
+    } else {
+        *saved = (job->state == JOB_DONE ? job->finished : now) - job->started;
+    }
+    pool.stats.saved += *saved;
+
+    // Ctrl-C stops the run like it stops one started in the foreground
+    interrupted = 0;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_sa);
+
+    for (;;) {
+        if (job->read < job->len) {
+            const char* data = job->buf + job->read;
+            size_t len = job->len - job->read;
+            int stop = 0;
+
+            pthread_mutex_unlock(&pool.lock);
+            if (opts->on_output) stop = opts->on_output(opts->ctx, data, len);
+            pthread_mutex_lock(&pool.lock);
+            job->read += len;
+            memmove(job->buf, job->buf + job->read, job->len - job->read);
+            job->len -= job->read;
+            job->read = 0;
+            pthread_cond_broadcast(&pool.changed);
+            if (stop) interrupted = 1;
+            continue;
+        }
+        if (job->state == JOB_DONE) break;
+        if (interrupted && !job->cancelled) {
+            uint64_t one = 1;
+
+            // Taken, so the worker leaves the slot to us when it is done
+            job->cancelled = 1;
+            if (write(job->cancel_fd, &one, sizeof(one)) < 0) {
+                // See cancel_job()
+            }
+            pthread_cond_broadcast(&pool.changed);
+        }
+        {
+            struct timespec until;
+
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += 100 * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&pool.changed, &pool.lock, &until);
+        }
+    }
+    sigaction(SIGINT, &old_sa, NULL);
+
+    *result = job->result;
+    if (interrupted && result->end == LAUNCH_EXITED) result->end = LAUNCH_CANCELLED;
+    release(job);
+    pthread_mutex_unlock(&pool.lock);
+    return 0;
+}
+
+void prefetch_cancel(void) {
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    for (i = 0; i < PREFETCH_WORKERS; i++) cancel_job(&pool.jobs[i]);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void prefetch_shutdown(void) {
+    int i;
+
+    pthread_mutex_lock(&pool.lock);
+    for (i = 0; i < PREFETCH_WORKERS; i++) cancel_job(&pool.jobs[i]);
+    pool.quit = 1;
+    pthread_cond_broadcast(&pool.changed);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (i = 0; i < pool.n_workers; i++) pthread_join(pool.workers[i], NULL);
+    for (i = 0; i < PREFETCH_WORKERS; i++) {
+        if (pool.jobs[i].cancel_fd > 0) close(pool.jobs[i].cancel_fd);
+        free(pool.jobs[i].buf);
+        pool.jobs[i].cancel_fd = 0;
+        pool.jobs[i].buf = NULL;
+        pool.jobs[i].state = JOB_FREE;
+    }
+    pool.n_workers = 0;
+    pool.quit = 0;
+}
+
+void prefetch_get_stats(prefetch_stats_t* stats) {
+    pthread_mutex_lock(&pool.lock);
+    *stats = pool.stats;
+    pthread_mutex_unlock(&pool.lock);
+}
+
+// Benchmark: the lesson commands the safelist accepts, as a learner who
+// reads each demo for think-ms and then runs two out of three. Reports
+// how long "Run" takes to finish with and without prefetching, the hit
+// rate and the time saved.
+
+static int discard_output(void* ctx, const char* data, size_t len) {
+    (void)ctx;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+static void think(int ms) {
+    struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+int prefetch_bench(int argc, char** argv) {
+    int think_ms = argc > 0 ? atoi(argv[0]) : 300;
+    launch_opts_t opts;
+    launch_result_t result;
+    prefetch_stats_t stats;
+    uint32_t i, commands = 0, safe = 0, demos = 0;
+    double cold = 0, warm = 0;
+
+    if (think_ms < 0) think_ms = 0;
+    load_lessons(NULL);
+    memset(&opts, 0, sizeof(opts));
+    opts.timeout_ms = 30000;
+    opts.on_output = discard_output;
+
+    for (i = 0; i < lessons.header->n_steps; i++) {
+        const lp_step_t* step = lp_step(&lessons, i);
+        const char* command = lp_str(&lessons, step->text);
+        double saved, start;
+
+        if (step->kind != LP_STEP_COMMAND) continue;
+        commands++;
+        if (!prefetch_safe(command)) continue;
+        safe++;
+        // Answered without a process anyway
+        if (sysinfo_covers(command)) continue;
+
+        // Without prefetching: read, then run
+        think(think_ms);
+        start = bench_now();
+        launch_command(command, &opts, &result);
+        if (demos % 3 != 2) cold += bench_now() - start;
+
+        // With it: the run starts when the demo is shown
+        prefetch_start(command, &opts);
+        think(think_ms);
+        if (demos % 3 == 2) {
+            prefetch_cancel();
+        } else {
+            start = bench_now();
+            if (prefetch_take(command, &opts, &result, &saved) < 0) launch_command(command, &opts, &result);
+            warm += bench_now() - start;
+        }
+        demos++;
+    }
+    prefetch_get_stats(&stats);
+    prefetch_shutdown();
+
+    bench_report("prefetch", "lesson_commands", commands, "commands");
+    bench_report("prefetch", "safelisted", safe, "commands");
+    bench_report("prefetch", "run_latency_cold", stats.hits + stats.misses ? cold * 1e3 / (stats.hits + stats.misses) : 0, "ms");
+    bench_report("prefetch", "run_latency_prefetched", stats.hits + stats.misses ? warm * 1e3 / (stats.hits + stats.misses) : 0, "ms");
+    bench_report("prefetch", "hit_rate", stats.started ? 100.0 * stats.hits / stats.started : 0, "%");
+    bench_report("prefetch", "saved_total", stats.saved * 1e3, "ms");
+    bench_report("prefetch", "cancelled", stats.cancelled, "runs");
+    lesson_pack_close(&lessons);
+    return 0;
+}
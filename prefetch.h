@@ -0,0 +1,59 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stddef.h>
+#include "launch.h"
+
+// Speculative runs of read-only lesson commands in live mode.
+//
+// While the learner reads a command demo and decides, a worker thread
+// already runs the command in the background (no terminal, stdin from
+// /dev/null) and keeps its output in a bounded buffer. Choosing "Run"
+// takes the run over: what is buffered appears at once and the rest
+// streams as it arrives. Skipping, or a run that outgrows the buffer
+// before it is taken, cancels it.
+//
+// Only commands that cannot change anything are started: every stage of
+// the pipeline must be a program on a fixed safelist, with the arguments
+// that would write, follow or wait rejected. Anything the tokenizer does
+// not understand (redirection, variables, globs), sudo and shell builtins
+// are never prefetched.
+
+#define PREFETCH_WORKERS 2
+#define PREFETCH_MAX_OUTPUT (256 << 10)    // buffered per run before it is taken
+#define PREFETCH_FRESH_MS 60000             // output older than this is run again
+
+typedef struct {
+    unsigned long started;      // runs started speculatively
+    unsigned long hits;         // "Run" found one
+    unsigned long misses;       // "Run" found none, or a stale or overflowed one
+    unsigned long cancelled;    // skipped, or replaced by the next demo
+    unsigned long refused;      // not on the safelist
+    double saved;               // seconds of running already done when taken
+} prefetch_stats_t;
+
+// 1 if command is read-only by the safelist rules
+int prefetch_safe(const char* command);
+
+// Start command in the background if it is safe and a worker is free.
+// Any earlier run that was not taken is cancelled.
+void prefetch_start(const char* command, const launch_opts_t* limits);
+
+// Take over the run of command: deliver its output through
+// opts->on_output (buffered output first) and wait for it to finish.
+// Returns 0 with *result filled in, or -1 when there is no usable run
+// and the command should be started normally.
+int prefetch_take(const char* command, const launch_opts_t* opts, launch_result_t* result, double* saved);
+
+// Cancel whatever is running or waiting to be taken
+void prefetch_cancel(void);
+
+// Cancel everything and stop the workers
+void prefetch_shutdown(void);
+
+void prefetch_get_stats(prefetch_stats_t* stats);
+
+// --bench prefetch [think-ms]
+int prefetch_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,1399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <regex.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "proc.h"
+#include "sysstat.h"
+#include "bench.h"
+#include "util.h"
+
+// Per-second decay of the 1, 5 and 15 minute load averages: exp(-1/60) ...
+static const double load_decay[3] = { 0.98347145, 0.99667221, 0.99888950 };
+
+proc_table_t* proc_new(uint32_t ncpu, uint64_t mem_total_kb, time_t boot) {
+    proc_table_t* pt = calloc(1, sizeof(proc_table_t));
+
+    if (!pt) {
+        perror("calloc");
+        exit(1);
+    }
+    pt->ncpu = ncpu ? ncpu : 1;
+    pt->mem_total_kb = mem_total_kb;
+    pt->boot = pt->now = boot;
+    pt->next_pid = 1;
+    return pt;
+}
+
+void proc_free(proc_table_t* pt) {
+    if (!pt) return;
+    free(pt->pid);
+    free(pt->ppid);
+    free(pt->uid);
+    free(pt->state);
+    free(pt->flags);
+    free(pt->nice);
+    free(pt->tty);
+    free(pt->job);
+    free(pt->demand);
+    free(pt->used);
+    free(pt->cpu_ms);
+    free(pt->vsz_kb);
+    free(pt->rss_kb);
+    free(pt->shr_kb);
+    free(pt->start);
+    free(pt->comm);
+    free(pt->cmd);
+    free(pt->strings);
+    free(pt->scratch);
+    sysstat_free(pt->stats);
+    free(pt);
+}
+
+// What proc_tick() reads from a slot past the last process
+static void clear_slot(proc_table_t* pt, uint32_t i) {
+    pt->pid[i] = 0;
+    pt->state[i] = 0;
+    pt->demand[i] = 0;
+    pt->used[i] = 0;
+    pt->cpu_ms[i] = 0;
+    pt->rss_kb[i] = 0;
+}
+
+static void grow(proc_table_t* pt) {
+    uint32_t cap = pt->cap ? pt->cap * 2 : 128, i;
+
+#define GROW(field) pt->field = xrealloc(pt->field, cap * sizeof(*pt->field))
+    GROW(pid);
+    GROW(ppid);
+    GROW(uid);
+    GROW(state);
+    GROW(flags);
+    GROW(nice);
+    GROW(tty);
+    GROW(job);
+    GROW(demand);
+    GROW(used);
+    GROW(cpu_ms);
+    GROW(vsz_kb);
+    GROW(rss_kb);
+    GROW(shr_kb);
+    GROW(start);
+    GROW(comm);
+    GROW(cmd);
+#undef GROW
+    for (i = pt->cap; i < cap; i++) clear_slot(pt, i);
+    pt->cap = cap;
+}
+
+static uint32_t add_string(proc_table_t* pt, const char* s, size_t len) {
+    uint32_t off;
+
+    if (pt->strings_len + len + 1 > pt->strings_cap) {
+        while (pt->strings_len + len + 1 > pt->strings_cap) pt->strings_cap = pt->strings_cap ? pt->strings_cap * 2 : 4096;
+        pt->strings = xrealloc(pt->strings, pt->strings_cap);
+    }
+    off = (uint32_t)pt->strings_len;
+    memcpy(pt->strings + off, s, len);
+    pt->strings[off + len] = '\0';
+    pt->strings_len += len + 1;
+    return off;
+}
+
+// The name ps and pgrep match: "[kthreadd]" -> kthreadd,
+// "/usr/sbin/sshd -D" -> sshd, "sshd: admin [priv]" -> sshd, "-bash" -> bash
+static uint32_t add_comm(proc_table_t* pt, const char* cmd) {
+    const char* p = cmd;
+    size_t len;
+
+    if (*p == '[') {
+        p++;
+        len = strcspn(p, "]");
+    } else {
+        const char* end;
+
+        if (*p == '-') p++;
+        end = p + strcspn(p, " :");
+        len = (size_t)(end - p);
+        while (len && memchr(p, '/', len)) {
+            const char* slash = memchr(p, '/', len);
+            len -= (size_t)(slash + 1 - p);
+            p = slash + 1;
+        }
+    }
+    if (len > 15) len = 15;
+    return add_string(pt, p, len);
+}
+
+// Processes are appended in pid order; pids only grow
+static int add_proc(proc_table_t* pt, int32_t pid, int32_t ppid, uint32_t uid, const char* cmd,
+                    float demand, uint32_t vsz_kb, uint32_t rss_kb, uint8_t state, uint8_t flags,
+                    uint8_t tty, time_t start) {
+    uint32_t i;
+
+    if (pt->count == pt->cap) grow(pt);
+    i = pt->count++;
+    pt->pid[i] = pid;
+    pt->ppid[i] = ppid;
+    pt->uid[i] = uid;
+    pt->state[i] = state;
+    pt->flags[i] = flags;
+    pt->nice[i] = (int8_t)((flags & PROC_HIGH_PRIORITY) ? -20 : (flags & PROC_LOW_PRIORITY) ? 19 : 0);
+    pt->tty[i] = tty;
+    pt->job[i] = 0;
+    pt->demand[i] = demand;
+    pt->used[i] = 0;
+    pt->cpu_ms[i] = (uint64_t)(demand * 1000.0 * (double)(pt->now - start));
+    pt->vsz_kb[i] = vsz_kb;
+    pt->rss_kb[i] = rss_kb;
+    pt->shr_kb[i] = rss_kb / 3 * 2;
+    pt->start[i] = start;
+    pt->comm[i] = add_comm(pt, cmd);
+    pt->cmd[i] = add_string(pt, cmd, strlen(cmd));
+    if (pid >= pt->next_pid) pt->next_pid = pid + 1;
+    return (int)i;
+}
+
+int32_t proc_spawn(proc_table_t* pt, int32_t ppid, uint32_t uid, const char* cmd,
+                   float demand, uint32_t rss_kb, uint8_t flags) {
+    int parent = proc_find(pt, ppid);
+    int32_t pid = pt->next_pid;
+
+    add_proc(pt, pid, ppid, uid, cmd, demand, rss_kb * 3, rss_kb, PROC_SLEEPING, flags,
+             parent >= 0 ? pt->tty[parent] : 0, pt->now);
+    return pid;
+}
+
+int proc_find(const proc_table_t* pt, int32_t pid) {
+    uint32_t lo = 0, hi = pt->count;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (pt->pid[mid] < pid) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < pt->count && pt->pid[lo] == pid ? (int)lo : -1;
+}
+
+const char* proc_comm(const proc_table_t* pt, int i) {
+    return pt->strings + pt->comm[i];
+}
+
+const char* proc_cmd(const proc_table_t* pt, int i) {
+    return pt->strings + pt->cmd[i];
+}
+
+// Remove entry i, keeping pid order; orphans are adopted by init
+static void reap(proc_table_t* pt, uint32_t i) {
+    int32_t pid = pt->pid[i];
+    uint32_t n = pt->count - i - 1, j;
+
+#define SHIFT(field) memmove(pt->field + i, pt->field + i + 1, n * sizeof(*pt->field))
+    SHIFT(pid);
+    SHIFT(ppid);
+    SHIFT(uid);
+    SHIFT(state);
+    SHIFT(flags);
+    SHIFT(nice);
+    SHIFT(tty);
+    SHIFT(job);
+    SHIFT(demand);
+    SHIFT(used);
+    SHIFT(cpu_ms);
+    SHIFT(vsz_kb);
+    SHIFT(rss_kb);
+    SHIFT(shr_kb);
+    SHIFT(start);
+    SHIFT(comm);
+    SHIFT(cmd);
+#undef SHIFT
+    pt->count--;
+    clear_slot(pt, pt->count);
+    for (j = 0; j < pt->count; j++) {
+        if (pt->ppid[j] == pid) pt->ppid[j] = 1;
+    }
+}
+
+// ---------------------------------------------------------------------
+// Scheduler
+
+// The tick walks the arrays in blocks of PROC_LANES entries with a
+// constant inner trip count, which GCC and Clang turn into vector code
+// even at -O2. The capacity is always a whole number of blocks and unused
+// slots are kept zeroed (state 0, no demand, no memory), so the last
+// partial block needs no scalar tail.
+#define PROC_LANES 8
+
+void proc_tick(proc_table_t* pt) {
+    const uint32_t n = (pt->count + PROC_LANES - 1) / PROC_LANES * PROC_LANES;
+    const int32_t* restrict pid = pt->pid;
+    const float* restrict demand = pt->demand;
+    float* restrict used = pt->used;
+    uint8_t* restrict state = pt->state;
+    uint64_t* restrict cpu_ms = pt->cpu_ms;
+    const uint32_t* restrict rss = pt->rss_kb;
+    const uint32_t seed = (uint32_t)pt->ticks * 2654435761u;
+    float sum[PROC_LANES] = { 0 };
+    uint32_t count[6][PROC_LANES] = { { 0 } };
+    uint64_t rss_sum[PROC_LANES] = { 0 };
+    float wanted, scale;
+    uint32_t i, j, k;
+
+    // What everyone asks for this second: demand +/- 50%, nothing while
+    // stopped or a zombie
+    for (i = 0; i < n; i += PROC_LANES) {
+#pragma GCC unroll 8
+        for (j = 0; j < PROC_LANES; j++) {
+            uint32_t h = ((uint32_t)pid[i + j] ^ seed) * 2246822519u;
+            float jitter = 0.5f + (float)(int32_t)(h >> 16) * (1.0f / 65536.0f);
+            uint8_t s = state[i + j];
+            float runnable = (float)((s != PROC_STOPPED) & (s != PROC_ZOMBIE));
+
+            used[i + j] = demand[i + j] * jitter * runnable;
+            sum[j] += used[i + j];
+        }
+    }
+    wanted = ((sum[0] + sum[1]) + (sum[2] + sum[3])) + ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+
+    // More demand than CPUs: everyone gets the same fraction of it.
+    // Processes that want CPU show as running, queued or not; other
+    // states are left alone.
+    scale = wanted > (float)pt->ncpu ? (float)pt->ncpu / wanted : 1.0f;
+    for (i = 0; i < n; i += PROC_LANES) {
+#pragma GCC unroll 8
+        for (j = 0; j < PROC_LANES; j++) {
+            uint8_t s = state[i + j];
+            float u = used[i + j] * scale;
+            uint8_t schedulable = (uint8_t)(-((s == PROC_RUNNING) | (s == PROC_SLEEPING)));
+            uint8_t next = (uint8_t)(PROC_SLEEPING - (used[i + j] >= 0.25f));
+
+            used[i + j] = u;
+            cpu_ms[i + j] += (uint32_t)(int32_t)(u * 1000.0f);
+            state[i + j] = (uint8_t)((next & schedulable) | (s & ~schedulable));
+        }
+    }
+
+    // Totals for top's summary area
+    for (i = 0; i < n; i += PROC_LANES) {
+#pragma GCC unroll 8
+        for (j = 0; j < PROC_LANES; j++) {
+            uint8_t s = state[i + j];
+
+            count[0][j] += s == PROC_RUNNING;
+            count[1][j] += s == PROC_SLEEPING;
+            count[2][j] += s == PROC_DISK;
+            count[3][j] += s == PROC_IDLE;
+            count[4][j] += s == PROC_STOPPED;
+            count[5][j] += s == PROC_ZOMBIE;
+            rss_sum[j] += rss[i + j];
+        }
+    }
+    pt->rss_total_kb = 0;
+    for (k = 0; k < 6; k++) {
+        pt->n_state[k] = 0;
+        for (j = 0; j < PROC_LANES; j++) pt->n_state[k] += count[k][j];
+    }
+    for (j = 0; j < PROC_LANES; j++) pt->rss_total_kb += rss_sum[j];
+
+    pt->cpu_busy = wanted * scale;
+    for (k = 0; k < 3; k++) {
+        pt->load[k] = pt->load[k] * load_decay[k] + (pt->n_state[0] + pt->n_state[2]) * (1 - load_decay[k]);
+    }
+    pt->ticks++;
+    pt->now++;
+    if (pt->stats) sysstat_tick(pt->stats, pt);
+}
+
+void proc_advance(proc_table_t* pt, time_t now) {
+    // Long gaps only need the last ten minutes of history
+    if (now - pt->now > 600) pt->now = now - 600;
+    while (pt->now < now) proc_tick(pt);
+}
+
+// ---------------------------------------------------------------------
+// Signals
+
+static int fatal_by_default(int sig) {
+    return sig != SIGCHLD && sig != SIGCONT && sig != SIGSTOP && sig != SIGTSTP &&
+           sig != SIGTTIN && sig != SIGTTOU && sig != SIGURG && sig != SIGWINCH;
+}
+
+int proc_signal(proc_table_t* pt, int32_t pid, int sig, uint32_t sender_uid) {
+    int i = proc_find(pt, pid);
+    int daemon;
+
+    if (sig < 0 || sig > 64) return -EINVAL;
+    if (i < 0) return -ESRCH;
+    if (sender_uid != 0 && pt->uid[i] != sender_uid) return -EPERM;
+    if (sig == 0 || (pt->flags[i] & PROC_KERNEL) || pid == 1) return 0;
+
+    // Daemons treat HUP and the user signals as "reload"; interactive
+    // shells ignore TERM and INT
+    daemon = pt->tty[i] == 0;
+    if (daemon && (sig == SIGHUP || sig == SIGUSR1 || sig == SIGUSR2)) return 0;
+    if (strcmp(proc_comm(pt, i), "bash") == 0 && (sig == SIGTERM || sig == SIGINT || sig == SIGQUIT)) return 0;
+
+    switch (sig) {
+        case SIGSTOP:
+        case SIGTSTP:
+            if (pt->state[i] != PROC_ZOMBIE) pt->state[i] = PROC_STOPPED;
+            return 0;
+        case SIGCONT:
+            if (pt->state[i] == PROC_STOPPED) {
+                pt->state[i] = PROC_SLEEPING;
+                if (pt->flags[i] & PROC_PENDING_TERM) reap(pt, (uint32_t)i);
+            }
+            return 0;
+        case SIGKILL:
+            reap(pt, (uint32_t)i);
+            return 0;
+        default:
+            if (!fatal_by_default(sig)) return 0;
+            // A stopped process only acts on the signal once continued
+            if (pt->state[i] == PROC_STOPPED) {
+                pt->flags[i] |= PROC_PENDING_TERM;
+            } else {
+                reap(pt, (uint32_t)i);
+            }
+            return 0;
+    }
+}
+
+// ---------------------------------------------------------------------
+// top's ordering
+
+static uint32_t float_key(float f) {
+    uint32_t bits;
+
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;        // non-negative floats order like their bit patterns
+}
+
+static void sift_down(uint64_t* heap, uint32_t n, uint32_t i) {
+    for (;;) {
+        uint32_t l = 2 * i + 1, m = i;
+        uint64_t t;
+
+        if (l < n && heap[l] < heap[m]) m = l;
+        if (l + 1 < n && heap[l + 1] < heap[m]) m = l + 1;
+        if (m == i) return;
+        t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+static int compare_desc(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x < y) - (x > y);
+}
+
+uint32_t proc_top(proc_table_t* pt, proc_sort_t sort, uint32_t* out, uint32_t k) {
+    const uint32_t n = pt->count;
+    uint64_t* restrict keys;
+    uint64_t* heap;
+    uint32_t i, m = 0;
+
+    if (k > n) k = n;
+    if (k == 0) return 0;
+    if (pt->scratch_cap < n + k) {
+        pt->scratch_cap = n + k;
+        pt->scratch = xrealloc(pt->scratch, pt->scratch_cap * sizeof(uint64_t));
+    }
+    keys = pt->scratch;
+    heap = pt->scratch + n;
+
+    // Sort key in the high half, inverted index (lower pid wins ties) low
+    switch (sort) {
+        case PROC_SORT_CPU:
+            for (i = 0; i < n; i++) keys[i] = (uint64_t)float_key(pt->used[i]) << 32 | (~i & 0xffffffffu);
+            break;
+        case PROC_SORT_MEM:
+            for (i = 0; i < n; i++) keys[i] = (uint64_t)pt->rss_kb[i] << 32 | (~i & 0xffffffffu);
+            break;
+        case PROC_SORT_TIME:
+            for (i = 0; i < n; i++) keys[i] = (pt->cpu_ms[i] < 0xffffffffu ? pt->cpu_ms[i] : 0xffffffffu) << 32 | (~i & 0xffffffffu);
+            break;
+        case PROC_SORT_PID:
+            for (i = 0; i < n; i++) keys[i] = (uint64_t)i << 32;
+            break;
+    }
+
+    // Keep the k largest in a min-heap; most keys lose to its root
+    for (i = 0; i < n; i++) {
+        if (m < k) {
+            uint32_t j = m++;
+
+            heap[j] = keys[i];
+            while (j && heap[(j - 1) / 2] > heap[j]) {
+                uint64_t t = heap[j];
+                heap[j] = heap[(j - 1) / 2];
+                heap[(j - 1) / 2] = t;
+                j = (j - 1) / 2;
+            }
+        } else if (keys[i] > heap[0]) {
+            heap[0] = keys[i];
+            sift_down(heap, m, 0);
+        }
+    }
+    qsort(heap, m, sizeof(uint64_t), compare_desc);
+    for (i = 0; i < m; i++) {
+        out[i] = sort == PROC_SORT_PID ? (uint32_t)(heap[i] >> 32) : ~(uint32_t)heap[i];
+    }
+    return m;
+}
+
+// ---------------------------------------------------------------------
+// The simulated Debian server
+
+#define UID_RESOLVE 997
+#define UID_TIMESYNC 996
+#define UID_MESSAGEBUS 100
+#define UID_ADMIN 1000
+#define PTS0 2
+
+typedef struct {
+    int32_t pid, ppid;
+    uint32_t uid;
+    const char* cmd;
+    float demand;
+    uint32_t vsz_kb, rss_kb;
+    uint8_t state, flags, tty, job;
+    int32_t started;        // seconds after boot; negative = before "now"
+    const char* comm;       // when it differs from the command line's
+} seed_proc_t;
+
+#define KTHREAD(pid, name, state, flags) { pid, 2, 0, "[" name "]", 0.0f, 0, 0, state, (flags) | PROC_KERNEL, 0, 0, 0, NULL }
+
+static const seed_proc_t debian_procs[] = {
+    { 1, 0, 0, "/sbin/init", 0.000005f, 167304, 13524, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 0, "systemd" },
+    { 2, 0, 0, "[kthreadd]", 0.0f, 0, 0, PROC_SLEEPING, PROC_KERNEL, 0, 0, 0, NULL },
+    KTHREAD(3, "rcu_gp", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(4, "rcu_par_gp", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(6, "kworker/0:0H-events_highpri", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(9, "mm_percpu_wq", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(10, "rcu_tasks_rude_", PROC_SLEEPING, 0),
+    KTHREAD(11, "rcu_tasks_trace", PROC_SLEEPING, 0),
+    KTHREAD(12, "slub_flushwq", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(13, "netns", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(14, "ksoftirqd/0", PROC_SLEEPING, 0),
+    KTHREAD(15, "rcu_preempt", PROC_IDLE, 0),
+    KTHREAD(16, "migration/0", PROC_SLEEPING, 0),
+    KTHREAD(18, "cpuhp/0", PROC_SLEEPING, 0),
+    KTHREAD(19, "cpuhp/1", PROC_SLEEPING, 0),
+    KTHREAD(20, "migration/1", PROC_SLEEPING, 0),
+    KTHREAD(21, "ksoftirqd/1", PROC_SLEEPING, 0),
+    KTHREAD(25, "kdevtmpfs", PROC_SLEEPING, 0),
+    KTHREAD(26, "inet_frag_wq", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(27, "kauditd", PROC_SLEEPING, 0),
+    KTHREAD(28, "khungtaskd", PROC_SLEEPING, 0),
+    KTHREAD(29, "oom_reaper", PROC_SLEEPING, 0),
+    KTHREAD(31, "writeback", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(32, "kcompactd0", PROC_SLEEPING, 0),
+    KTHREAD(33, "ksmd", PROC_SLEEPING, PROC_LOW_PRIORITY),
+    KTHREAD(34, "khugepaged", PROC_SLEEPING, PROC_LOW_PRIORITY),
+    KTHREAD(36, "kblockd", PROC_IDLE, PROC_HIGH_PRIORITY),
+    KTHREAD(41, "kswapd0", PROC_SLEEPING, 0),
+    KTHREAD(62, "kworker/u4:2-events_unbound", PROC_IDLE, 0),
+    KTHREAD(88, "jbd2/sda1-8", PROC_SLEEPING, 0),
+    { 123, 1, UID_RESOLVE, "/lib/systemd/systemd-resolved", 0.000025f, 24756, 12234, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 4, NULL },
+    { 201, 1, 0, "/lib/systemd/systemd-journald", 0.0015f, 48212, 20480, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 3, NULL },
+    { 230, 1, 0, "/lib/systemd/systemd-udevd", 0.0002f, 25868, 6512, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 3, NULL },
+    { 301, 1, UID_TIMESYNC, "/lib/systemd/systemd-timesyncd", 0.0001f, 90080, 6680, PROC_SLEEPING, PROC_SESSION_LEADER | PROC_THREADED, 0, 0, 5, NULL },
+    { 380, 1, 0, "/usr/sbin/cron -f", 0.0001f, 6612, 2744, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 6, NULL },
+    { 381, 1, UID_MESSAGEBUS, "/usr/bin/dbus-daemon --system --address=systemd: --nofork --nopidfile --systemd-activation --syslog-only",
+      0.0002f, 9224, 5028, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 6, NULL },
+    { 384, 1, 0, "/usr/sbin/rsyslogd -n -iNONE", 0.0008f, 222220, 6128, PROC_SLEEPING, PROC_SESSION_LEADER | PROC_THREADED, 0, 0, 6, NULL },
+    { 387, 1, 0, "/lib/systemd/systemd-logind", 0.0001f, 17972, 8048, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 6, NULL },
+    { 402, 1, 0, "/sbin/agetty -o -p -- \\u --noclear - linux", 0.0f, 5872, 1004, PROC_SLEEPING, PROC_SESSION_LEADER | PROC_FOREGROUND, 1, 0, 7, NULL },
+    { 456, 1, 0, "/usr/sbin/sshd -D", 0.000013f, 72456, 23456, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, 7, NULL },
+    { 512, 1, 0, "/usr/bin/python3 /usr/share/unattended-upgrades/unattended-upgrade-shutdown --wait-for-signal",
+      0.0f, 109812, 21904, PROC_SLEEPING, PROC_SESSION_LEADER | PROC_THREADED, 0, 0, 8, NULL },
+    { 789, 1, UID_ADMIN, "ssh-agent -s", 0.0f, 7860, 1084, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, -2400, NULL },
+    { 1201, 456, 0, "sshd: admin [priv]", 0.0001f, 17360, 10940, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, -1920, NULL },
+    { 1207, 1, UID_ADMIN, "/lib/systemd/systemd --user", 0.0003f, 18932, 10464, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, -1918, NULL },
+    { 1208, 1207, UID_ADMIN, "(sd-pam)", 0.0f, 169132, 3152, PROC_SLEEPING, 0, 0, 0, -1918, NULL },
+    { 1221, 1201, UID_ADMIN, "sshd: admin@pts/0", 0.0008f, 17360, 6592, PROC_SLEEPING, 0, 0, 0, -1917, NULL },
+    { 1222, 1221, UID_ADMIN, "-bash", 0.0002f, 8256, 5100, PROC_SLEEPING, PROC_SESSION_LEADER, PTS0, 0, -1917, NULL },
+    { 1290, 1222, UID_ADMIN, "vim /etc/hosts", 0.0f, 20984, 10056, PROC_STOPPED, 0, PTS0, 1, -1500, NULL },
+    { 1312, 1222, UID_ADMIN, "tail -f /var/log/syslog", 0.0001f, 5516, 1028, PROC_SLEEPING, 0, PTS0, 2, -1260, NULL },
+    { 1340, 1, 0, "/usr/sbin/apache2 -k start", 0.004f, 6784, 4632, PROC_SLEEPING, PROC_SESSION_LEADER, 0, 0, -900, NULL },
+    { 1341, 1340, 33, "/usr/sbin/apache2 -k start", 0.02f, 1213924, 5408, PROC_SLEEPING, PROC_THREADED, 0, 0, -900, NULL },
+    { 1342, 1340, 33, "/usr/sbin/apache2 -k start", 0.02f, 1213924, 5412, PROC_SLEEPING, PROC_THREADED, 0, 0, -900, NULL },
+};
+
+#undef KTHREAD
+
+void proc_seed_debian(proc_table_t* pt) {
+    size_t i;
+
+    for (i = 0; i < sizeof(debian_procs) / sizeof(debian_procs[0]); i++) {
+        const seed_proc_t* p = &debian_procs[i];
+        time_t start = p->started >= 0 ? pt->boot + p->started : pt->now + p->started;
+        int j = add_proc(pt, p->pid, p->ppid, p->uid, p->cmd, p->demand, p->vsz_kb, p->rss_kb,
+                         p->state, p->flags, p->tty, start);
+
+        pt->job[j] = p->job;
+        if (p->comm) pt->comm[j] = add_string(pt, p->comm, strlen(p->comm));
+    }
+    pt->load[0] = 0.15;
+    pt->load[1] = 0.23;
+    pt->load[2] = 0.18;
+    proc_tick(pt);
+}
+
+// ---------------------------------------------------------------------
+// Simulated commands
+
+// 2023-10-08 01:47:00 UTC: "up 7 days, 12:45" in the lesson examples
+#define SIM_BOOT 1696729620
+#define SIM_NCPU 2
+#define SIM_MEM_KB 16307916
+#define SIM_SWAP_KB 2097148
+#define LOGIN_SHELL 1222
+
+static proc_table_t* sim_procs(void) {
+    sim_env_t* env = sim_env();
+
+    if (!env->procs) {
+        env->procs = proc_new(SIM_NCPU, SIM_MEM_KB, SIM_BOOT);
+        // Seeding runs one tick, which brings the table up to the clock
+        env->procs->now = env->clock - 1;
+        proc_seed_debian(env->procs);
+        env->procs->stats = sysstat_new(env->procs, SIM_SWAP_KB);
+        // $DEB1_SCENARIO: a workload misbehaving from the start
+        if (sysstat_scenario(env->procs->stats, env->procs, getenv("DEB1_SCENARIO"), LOGIN_SHELL) < 0) {
+            fprintf(stderr, "DEB1_SCENARIO: unknown scenario (leak, forkbomb or iostorm)\n");
+        }
+    }
+    proc_advance(env->procs, env->clock);
+    return env->procs;
+}
+
+proc_table_t* proc_session(void) {
+    return sim_procs();
+}
+
+// The command itself shows up in its own listing while it runs
+static int32_t spawn_self(proc_table_t* pt, int argc, char** argv, float demand, uint32_t rss_kb) {
+    char line[256];
+    size_t len = 0;
+    int32_t pid;
+    int i;
+
+    line[0] = '\0';
+    for (i = 0; i < argc && len < sizeof(line) - 1; i++) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "%s%s", i ? " " : "", argv[i]);
+    }
+    pid = proc_spawn(pt, proc_find(pt, LOGIN_SHELL) >= 0 ? LOGIN_SHELL : 1, sim_env()->euid, line,
+                     demand, rss_kb, PROC_FOREGROUND);
+    i = proc_find(pt, pid);
+    pt->state[i] = PROC_RUNNING;
+    pt->used[i] = demand;
+    pt->n_state[0]++;
+    return pid;
+}
+
+static void reap_self(proc_table_t* pt, int32_t pid) {
+    proc_signal(pt, pid, SIGKILL, 0);
+}
+
+static void format_tty(uint8_t tty, char* buf, size_t len) {
+    if (tty == 0) {
+        snprintf(buf, len, "?");
+    } else if (tty == 1) {
+        snprintf(buf, len, "tty1");
+    } else {
+        snprintf(buf, len, "pts/%u", tty - 2u);
+    }
+}
+
+static void format_stat(const proc_table_t* pt, int i, char* buf) {
+    uint8_t f = pt->flags[i];
+    char* p = buf;
+
+    *p++ = (char)pt->state[i];
+    if (f & PROC_HIGH_PRIORITY) *p++ = '<';
+    if (f & PROC_LOW_PRIORITY) *p++ = 'N';
+    if (f & PROC_SESSION_LEADER) *p++ = 's';
+    if (f & PROC_THREADED) *p++ = 'l';
+    if (f & PROC_FOREGROUND) *p++ = '+';
+    *p = '\0';
+}
+
+// ps truncates long user names to seven characters and a "+"
+static const char* short_user(uint32_t uid, char* buf) {
+    const char* name = sim_user_name(uid);
+
+    if (strlen(name) <= 8) return name;
+    memcpy(buf, name, 7);
+    buf[7] = '+';
+    buf[8] = '\0';
+    return buf;
+}
+
+// START/STIME: the time of day for processes started today, else the date
+static void format_start(const proc_table_t* pt, int i, char* buf, size_t len) {
+    time_t start = pt->start[i], now = pt->now;
+    struct tm tm;
+
+    gmtime_r(&start, &tm);
+    strftime(buf, len, start / 86400 == now / 86400 ? "%H:%M" : "%b%d", &tm);
+}
+
+static double cpu_percent(const proc_table_t* pt, int i) {
+    time_t elapsed = pt->now - pt->start[i];
+
+    return elapsed > 0 ? pt->cpu_ms[i] / 10.0 / (double)elapsed : 0.0;
+}
+
+static double mem_percent(const proc_table_t* pt, int i) {
+    return pt->rss_kb[i] * 100.0 / (double)pt->mem_total_kb;
+}
+
+typedef enum {
+    PS_SHORT,           // ps
+    PS_FULL,            // ps -f
+    PS_BSD,             // ps ax
+    PS_USER             // ps aux
+} ps_format_t;
+
+static void print_ps_header(ps_format_t format) {
+    switch (format) {
+        case PS_SHORT:
+            con_printf("    PID TTY          TIME CMD\n");
+            break;
+        case PS_FULL:
+            con_printf("UID          PID    PPID  C STIME TTY          TIME CMD\n");
+            break;
+        case PS_BSD:
+            con_printf("    PID TTY      STAT   TIME COMMAND\n");
+            break;
+        case PS_USER:
+            con_printf("USER         PID %%CPU %%MEM    VSZ   RSS TTY      STAT START   TIME COMMAND\n");
+            break;
+    }
+}
+
+static void print_ps_row(const proc_table_t* pt, int i, ps_format_t format) {
+    char tty[16], stat[8], start[16], time_buf[32], user[16];
+    uint64_t secs = pt->cpu_ms[i] / 1000;
+
+    format_tty(pt->tty[i], tty, sizeof(tty));
+    switch (format) {
+        case PS_SHORT:
+            snprintf(time_buf, sizeof(time_buf), "%02u:%02u:%02u", (unsigned)(secs / 3600), (unsigned)(secs / 60 % 60), (unsigned)(secs % 60));
+            con_printf("%7d %-8s %8s %s\n", pt->pid[i], tty, time_buf, proc_comm(pt, i));
+            break;
+        case PS_FULL:
+            snprintf(time_buf, sizeof(time_buf), "%02u:%02u:%02u", (unsigned)(secs / 3600), (unsigned)(secs / 60 % 60), (unsigned)(secs % 60));
+            format_start(pt, i, start, sizeof(start));
+            con_printf("%-8s %7d %7d %2d %-5s %-8s %8s %s\n", short_user(pt->uid[i], user), pt->pid[i], pt->ppid[i],
+                       (int)cpu_percent(pt, i), start, tty, time_buf, proc_cmd(pt, i));
+            break;
+        case PS_BSD:
+            snprintf(time_buf, sizeof(time_buf), "%u:%02u", (unsigned)(secs / 60), (unsigned)(secs % 60));
+            format_stat(pt, i, stat);
+            con_printf("%7d %-8s %-4s %6s %s\n", pt->pid[i], tty, stat, time_buf, proc_cmd(pt, i));
+            break;
+        case PS_USER:
+            snprintf(time_buf, sizeof(time_buf), "%u:%02u", (unsigned)(secs / 60), (unsigned)(secs % 60));
+            format_stat(pt, i, stat);
+            format_start(pt, i, start, sizeof(start));
+            con_printf("%-8s %7d %4.1f %4.1f %6u %5u %-8s %-4s %5s %6s %s\n", short_user(pt->uid[i], user), pt->pid[i],
+                       cpu_percent(pt, i), mem_percent(pt, i), pt->vsz_kb[i], pt->rss_kb[i], tty, stat, start,
+                       time_buf, proc_cmd(pt, i));
+            break;
+    }
+}
+
+// Does a comma-separated list contain item?
+static int list_has(const char* list, const char* item) {
+    size_t len = strlen(item);
+
+    while (list && *list) {
+        size_t n = strcspn(list, ",");
+
+        if (n == len && strncmp(list, item, len) == 0) return 1;
+        list += n;
+        if (*list == ',') list++;
+    }
+    return 0;
+}
+
+static int parse_sort(const char* spec, proc_sort_t* sort, int* ascending) {
+    static const struct {
+        const char* name;
+        proc_sort_t sort;
+    } keys[] = {
+        { "pid", PROC_SORT_PID },
+        { "%cpu", PROC_SORT_CPU },
+        { "pcpu", PROC_SORT_CPU },
+        { "%mem", PROC_SORT_MEM },
+        { "pmem", PROC_SORT_MEM },
+        { "rss", PROC_SORT_MEM },
+        { "time", PROC_SORT_TIME },
+        { "cputime", PROC_SORT_TIME },
+    };
+    size_t i;
+
+    *ascending = *spec != '-';
+    if (*spec == '-' || *spec == '+') spec++;
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (strcmp(keys[i].name, spec) == 0) {
+            *sort = keys[i].sort;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int proc_cmd_ps(int argc, char** argv) {
+    proc_table_t* pt = sim_procs();
+    sim_env_t* env = sim_env();
+    ps_format_t format = PS_SHORT;
+    const char *users = NULL, *pids = NULL, *names = NULL, *sort_spec = NULL;
+    int all = 0, bsd_all = 0, bsd_notty = 0, i;
+    uint32_t* order;
+    uint32_t n, k;
+    proc_sort_t sort = PROC_SORT_PID;
+    int ascending = 1;
+    int32_t self;
+
+    for (i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+
+        if (strncmp(arg, "--sort", 6) == 0) {
+            sort_spec = arg[6] == '=' ? arg + 7 : i + 1 < argc ? argv[++i] : "";
+        } else if (arg[0] != '-' || strcmp(arg, "-aux") == 0) {
+            // BSD syntax: ps aux, ps ax, ps u
+            const char* p;
+
+            for (p = arg[0] == '-' ? arg + 1 : arg; *p; p++) {
+                if (*p == 'a') {
+                    bsd_all = 1;
+                } else if (*p == 'x') {
+                    bsd_notty = 1;
+                } else if (*p == 'u') {
+                    format = PS_USER;
+                } else {
+                    con_printf("error: unsupported option (BSD syntax)\n");
+                    return 1;
+                }
+            }
+            if (format != PS_USER) format = PS_BSD;
+        } else if (strcmp(arg, "-e") == 0 || strcmp(arg, "-A") == 0) {
+            all = 1;
+        } else if (strcmp(arg, "-f") == 0) {
+            format = PS_FULL;
+        } else if (strcmp(arg, "-ef") == 0 || strcmp(arg, "-fe") == 0) {
+            all = 1;
+            format = PS_FULL;
+        } else if ((strcmp(arg, "-u") == 0 || strcmp(arg, "-p") == 0 || strcmp(arg, "-C") == 0) && i + 1 < argc) {
+            if (arg[1] == 'u') users = argv[++i];
+            if (arg[1] == 'p') pids = argv[++i];
+            if (arg[1] == 'C') names = argv[++i];
+        } else {
+            con_printf("error: unsupported option\n\nUsage:\n ps [options]\n");
+            return 1;
+        }
+    }
+    if (sort_spec && parse_sort(sort_spec, &sort, &ascending) < 0) {
+        con_printf("error: unknown sort specifier\n");
+        return 1;
+    }
+
+    self = spawn_self(pt, argc, argv, 0.9f, 3400);
+    order = malloc(pt->count * sizeof(uint32_t));
+    if (sort == PROC_SORT_PID) {
+        n = pt->count;
+        for (k = 0; k < n; k++) order[k] = k;
+    } else {
+        n = proc_top(pt, sort, order, pt->count);
+    }
+
+    print_ps_header(format);
+    for (k = 0; k < n; k++) {
+        uint32_t j = order[ascending == (sort != PROC_SORT_PID) ? n - 1 - k : k];
+        int show;
+
+        if (users || pids || names) {
+            char pid_buf[16], uid_buf[16];
+
+            snprintf(pid_buf, sizeof(pid_buf), "%d", pt->pid[j]);
+            snprintf(uid_buf, sizeof(uid_buf), "%u", pt->uid[j]);
+            show = (users && (list_has(users, sim_user_name(pt->uid[j])) || list_has(users, uid_buf))) ||
+                   (pids && list_has(pids, pid_buf)) ||
+                   (names && list_has(names, proc_comm(pt, j)));
+        } else if (all || (bsd_all && bsd_notty)) {
+            show = 1;
+        } else if (bsd_all) {
+            show = pt->tty[j] != 0;
+        } else if (bsd_notty) {
+            show = pt->uid[j] == env->euid;
+        } else {
+            show = pt->uid[j] == env->euid && pt->tty[j] == 2;
+        }
+        if (show) print_ps_row(pt, (int)j, format);
+    }
+    free(order);
+    reap_self(pt, self);
+    return 0;
+}
+
+#define TOP_SCREEN_ROWS 17
+
+// The summary area's CPU line covers the seconds since the last refresh
+static void print_top_frame(proc_table_t* pt, proc_sort_t sort, int64_t only_uid, uint32_t max_rows, uint32_t* order,
+                            uint32_t interval) {
+    const sysstat_t* s = pt->stats;
+    uint32_t i, n, shown = 0;
+    sysstat_sample_t m;
+    double swap_total = s->swap_total_kb / 1024.0;
+
+    sysstat_average(s, interval, &m);
+    sysstat_print_uptime(pt, "top - ");
+    con_printf("Tasks: %3u total, %3u running, %3u sleeping, %3u stopped, %3u zombie\n", pt->count, pt->n_state[0],
+               pt->n_state[1] + pt->n_state[2] + pt->n_state[3], pt->n_state[4], pt->n_state[5]);
+    con_printf("%%Cpu(s): %4.1f us, %4.1f sy, %4.1f ni, %4.1f id, %4.1f wa, %4.1f hi, %4.1f si, %4.1f st\n",
+               m.cpu[SYSSTAT_US] * 100.0, m.cpu[SYSSTAT_SY] * 100.0, m.cpu[SYSSTAT_NI] * 100.0,
+               m.cpu[SYSSTAT_ID] * 100.0, m.cpu[SYSSTAT_WA] * 100.0, m.cpu[SYSSTAT_HI] * 100.0,
+               m.cpu[SYSSTAT_SI] * 100.0, m.cpu[SYSSTAT_ST] * 100.0);
+    con_printf("MiB Mem : %8.1f total, %8.1f free, %8.1f used, %8.1f buff/cache\n", pt->mem_total_kb / 1024.0,
+               m.free_kb / 1024.0, sysstat_used_kb(s, &m) / 1024.0, ((double)m.buffers_kb + m.cache_kb) / 1024.0);
+    con_printf("MiB Swap: %8.1f total, %8.1f free, %8.1f used. %8.1f avail Mem\n", swap_total,
+               swap_total - m.swap_used_kb / 1024.0, m.swap_used_kb / 1024.0, sysstat_available_kb(s, &m) / 1024.0);
+    con_printf("\n    PID USER      PR  NI    VIRT    RES    SHR S  %%CPU  %%MEM     TIME+ COMMAND\n");
+
+    n = proc_top(pt, sort, order, only_uid >= 0 ? pt->count : max_rows);
+    for (i = 0; i < n && shown < max_rows; i++) {
+        uint32_t j = order[i];
+        uint64_t cs = pt->cpu_ms[j] / 10;
+        char user[16], pr[8], time_buf[32];
+
+        if (only_uid >= 0 && pt->uid[j] != (uint64_t)only_uid) continue;
+        if (strncmp(proc_comm(pt, (int)j), "migration", 9) == 0) {
+            snprintf(pr, sizeof(pr), "rt");
+        } else {
+            snprintf(pr, sizeof(pr), "%d", 20 + pt->nice[j]);
+        }
+        snprintf(time_buf, sizeof(time_buf), "%u:%02u.%02u", (unsigned)(cs / 6000), (unsigned)(cs / 100 % 60), (unsigned)(cs % 100));
+        con_printf("%7d %-8s %3s %3d %7u %6u %6u %c %5.1f %5.1f %9s %s\n", pt->pid[j], short_user(pt->uid[j], user), pr,
+                   pt->nice[j], pt->vsz_kb[j], pt->rss_kb[j], pt->shr_kb[j], (char)pt->state[j], pt->used[j] * 100.0,
+                   mem_percent(pt, (int)j), time_buf, proc_comm(pt, (int)j));
+        shown++;
+    }
+}
+
+int proc_cmd_top(int argc, char** argv) {
+    static const struct {
+        const char* name;
+        proc_sort_t sort;
+    } fields[] = {
+        { "%CPU", PROC_SORT_CPU },
+        { "%MEM", PROC_SORT_MEM },
+        { "RES", PROC_SORT_MEM },
+        { "TIME+", PROC_SORT_TIME },
+        { "TIME", PROC_SORT_TIME },
+        { "PID", PROC_SORT_PID },
+    };
+    proc_table_t* pt = sim_procs();
+    sim_env_t* env = sim_env();
+    proc_sort_t sort = PROC_SORT_CPU;
+    int batch = 0, iterations = 1, delay = 3, i, iter;
+    int64_t only_uid = -1;
+    uint32_t* order;
+    int32_t self;
+
+    for (i = 1; i < argc; i++) {
+        const char* p = argv[i];
+
+        if (*p++ != '-') {
+            sim_error("top", "unknown option '%s'", argv[i]);
+            return 1;
+        }
+        for (; *p; p++) {
+            const char* value;
+            size_t f;
+
+            if (*p == 'b') {
+                batch = 1;
+                continue;
+            }
+            if (!strchr("nduo", *p)) {
+                sim_error("top", "unknown option '%c'", *p);
+                return 1;
+            }
+            value = p[1] ? p + 1 : i + 1 < argc ? argv[++i] : NULL;
+            if (!value) {
+                sim_error("top", "-%c requires argument", *p);
+                return 1;
+            }
+            if (*p == 'n') {
+                iterations = atoi(value);
+                if (iterations < 1) iterations = 1;
+            } else if (*p == 'd') {
+                delay = atoi(value);
+                if (delay < 1) delay = 1;
+            } else if (*p == 'u') {
+                uint32_t uid;
+
+                if (sim_user_id(value, &uid) < 0) {
+                    sim_error("top", "Invalid user");
+                    return 1;
+                }
+                only_uid = uid;
+            } else {
+                for (f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+                    if (strcmp(fields[f].name, value) == 0) break;
+                }
+                if (f == sizeof(fields) / sizeof(fields[0])) {
+                    sim_error("top", "Unknown field name: '%s'", value);
+                    return 1;
+                }
+                sort = fields[f].sort;
+            }
+            break;
+        }
+    }
+
+    // Without -b this is the first screen of the interactive display
+    self = spawn_self(pt, 1, argv, 0.02f, 4200);
+    order = NULL;
+    for (iter = 0; iter < iterations; iter++) {
+        if (iter > 0) {
+            env->clock += delay;
+            proc_advance(pt, env->clock);
+            con_printf("\n");
+        }
+        // The table may have grown between refreshes
+        order = xrealloc(order, pt->count * sizeof(uint32_t) + sizeof(uint32_t));
+        print_top_frame(pt, sort, only_uid, batch ? pt->count : TOP_SCREEN_ROWS, order, (uint32_t)delay);
+    }
+    free(order);
+    reap_self(pt, self);
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Signal names, pgrep/pkill, kill, killall, jobs
+
+static const char* const signal_names[32] = {
+    NULL, "HUP", "INT", "QUIT", "ILL", "TRAP", "ABRT", "BUS", "FPE", "KILL", "USR1", "SEGV", "USR2", "PIPE",
+    "ALRM", "TERM", "STKFLT", "CHLD", "CONT", "STOP", "TSTP", "TTIN", "TTOU", "URG", "XCPU", "XFSZ", "VTALRM",
+    "PROF", "WINCH", "IO", "PWR", "SYS",
+};
+
+// "9", "KILL", "SIGKILL" or "kill"; -1 if unknown
+static int parse_signal(const char* s) {
+    char* end;
+    long n = strtol(s, &end, 10);
+    int i;
+
+    if (*s && !*end) return n >= 0 && n <= 64 ? (int)n : -1;
+    if (strncasecmp(s, "SIG", 3) == 0) s += 3;
+    for (i = 1; i < 32; i++) {
+        if (strcasecmp(signal_names[i], s) == 0) return i;
+    }
+    return -1;
+}
+
+static void print_signal_list(void) {
+    char name[16];
+    int i, col = 0;
+
+    for (i = 1; i <= 64; i++) {
+        if (i == 32 || i == 33) continue;
+        if (i < 32) {
+            snprintf(name, sizeof(name), "SIG%s", signal_names[i]);
+        } else if (i == 34) {
+            snprintf(name, sizeof(name), "SIGRTMIN");
+        } else if (i < 50) {
+            snprintf(name, sizeof(name), "SIGRTMIN+%d", i - 34);
+        } else if (i < 64) {
+            snprintf(name, sizeof(name), "SIGRTMAX-%d", 64 - i);
+        } else {
+            snprintf(name, sizeof(name), "SIGRTMAX");
+        }
+        con_printf("%2d) %s%s", i, name, ++col % 5 == 0 || i == 64 ? "\n" : "\t");
+    }
+}
+
+// Signal a process on the learner's behalf; prints nothing
+static int send_signal(proc_table_t* pt, int32_t pid, int sig) {
+    return proc_signal(pt, pid, sig, sim_env()->euid);
+}
+
+typedef struct {
+    regex_t re;
+    int full, has_user;
+    uint32_t uid;
+} proc_match_t;
+
+static int matches(const proc_table_t* pt, int i, const proc_match_t* m) {
+    if (m->has_user && pt->uid[i] != m->uid) return 0;
+    return regexec(&m->re, m->full ? proc_cmd(pt, i) : proc_comm(pt, i), 0, NULL, 0) == 0;
+}
+
+// Shared by pgrep and pkill: options, then matching pids into out
+static int pgrep_common(int argc, char** argv, const char* spec, sim_opts_t* o, proc_match_t* m) {
+    const char* cmd = argv[0];
+    char pattern[512];
+    int err;
+
+    if (sim_getopt(argc, argv, spec, o) < 0) return -1;
+    memset(m, 0, sizeof(*m));
+    if (SIM_HAS(o, 'u')) {
+        if (sim_user_id(o->value, &m->uid) < 0) {
+            sim_error(cmd, "invalid user name: %s", o->value);
+            return -1;
+        }
+        m->has_user = 1;
+    }
+    if (o->n_operands == 0 && !m->has_user) {
+        sim_error(cmd, "no matching criteria specified\nTry `%s --help' for more information.", cmd);
+        return -1;
+    }
+    if (o->n_operands > 1) {
+        sim_error(cmd, "only one pattern can be provided\nTry `%s --help' for more information.", cmd);
+        return -1;
+    }
+    snprintf(pattern, sizeof(pattern), SIM_HAS(o, 'x') ? "^(%s)$" : "%s", o->n_operands ? argv[1] : "");
+    err = regcomp(&m->re, pattern, REG_EXTENDED | REG_NOSUB | (SIM_HAS(o, 'i') ? REG_ICASE : 0));
+    if (err) {
+        regerror(err, &m->re, pattern, sizeof(pattern));
+        sim_error(cmd, "%s", pattern);
+        return -1;
+    }
+    m->full = SIM_HAS(o, 'f');
+    return 0;
+}
+
+int proc_cmd_pgrep(int argc, char** argv) {
+    proc_table_t* pt = sim_procs();
+    proc_match_t m;
+    sim_opts_t o;
+    int found = 0, i;
+
+    if (pgrep_common(argc, argv, "laxfiu:", &o, &m) < 0) return 2;
+    for (i = 0; i < (int)pt->count; i++) {
+        if (!matches(pt, i, &m)) continue;
+        found = 1;
+        if (SIM_HAS(&o, 'a')) {
+            con_printf("%d %s\n", pt->pid[i], proc_cmd(pt, i));
+        } else if (SIM_HAS(&o, 'l')) {
+            con_printf("%d %s\n", pt->pid[i], proc_comm(pt, i));
+        } else {
+            con_printf("%d\n", pt->pid[i]);
+        }
+    }
+    regfree(&m.re);
+    return found ? 0 : 1;
+}
+
+// A leading -SIGNAL, as kill takes it, before the usual options
+static int leading_signal(int* argc, char** argv, int* sig) {
+    int s;
+
+    if (*argc < 2 || argv[1][0] != '-' || !argv[1][1]) return 0;
+    s = parse_signal(argv[1] + 1);
+    if (s < 0) return 0;
+    *sig = s;
+    memmove(argv + 1, argv + 2, (size_t)(*argc - 2) * sizeof(char*));
+    (*argc)--;
+    return 1;
+}
+
+int proc_cmd_pkill(int argc, char** argv) {
+    proc_table_t* pt = sim_procs();
+    int32_t* victims;
+    proc_match_t m;
+    sim_opts_t o;
+    int sig = SIGTERM, found = 0, i, n = 0;
+
+    leading_signal(&argc, argv, &sig);
+    if (pgrep_common(argc, argv, "xfiu:", &o, &m) < 0) return 2;
+    victims = malloc(pt->count * sizeof(int32_t));
+    for (i = 0; i < (int)pt->count; i++) {
+        if (matches(pt, i, &m)) victims[n++] = pt->pid[i];
+    }
+    regfree(&m.re);
+    // Signalled separately: a kill reshuffles the table
+    for (i = 0; i < n; i++) {
+        int err = send_signal(pt, victims[i], sig);
+
+        if (err) {
+            sim_error("pkill", "killing pid %d failed: %s", victims[i], strerror(-err));
+        } else {
+            found = 1;
+        }
+    }
+    free(victims);
+    return found ? 0 : 1;
+}
+
+// The learner shell's job n, or -1
+static int find_job(const proc_table_t* pt, long n) {
+    uint32_t i;
+
+    for (i = 0; i < pt->count; i++) {
+        if (pt->ppid[i] == LOGIN_SHELL && pt->job[i] == n && n > 0) return (int)i;
+    }
+    return -1;
+}
+
+int proc_cmd_kill(int argc, char** argv) {
+    proc_table_t* pt = sim_procs();
+    int sig = SIGTERM, status = 0, i = 1;
+
+    if (argc > 1 && strcmp(argv[1], "-l") == 0) {
+        if (argc == 2) {
+            print_signal_list();
+            return 0;
+        }
+        for (i = 2; i < argc; i++) {
+            int s = parse_signal(argv[i]);
+
+            if (s <= 0 || s >= 32) {
+                con_printf("bash: kill: %s: invalid signal specification\n", argv[i]);
+                status = 1;
+            } else if (isdigit((unsigned char)argv[i][0])) {
+                con_printf("%s\n", signal_names[s]);
+            } else {
+                con_printf("%d\n", s);
+            }
+        }
+        return status;
+    }
+    if (argc > 2 && (strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "-n") == 0)) {
+        sig = parse_signal(argv[2]);
+        if (sig < 0) {
+            con_printf("bash: kill: %s: invalid signal specification\n", argv[2]);
+            return 1;
+        }
+        i = 3;
+    } else if (argc > 1 && argv[1][0] == '-' && argv[1][1]) {
+        sig = parse_signal(argv[1] + 1);
+        if (sig < 0) {
+            con_printf("bash: kill: %s: invalid signal specification\n", argv[1] + 1);
+            return 1;
+        }
+        i = 2;
+    }
+    if (i >= argc) {
+        con_printf("kill: usage: kill [-s sigspec | -n signum | -sigspec] pid | jobspec ... or kill -l [sigspec]\n");
+        return 2;
+    }
+
+    for (; i < argc; i++) {
+        const char* arg = argv[i];
+        char* end;
+        long pid;
+        int err;
+
+        if (arg[0] == '%') {
+            int j = find_job(pt, strtol(arg + 1, &end, 10));
+
+            if (j < 0 || *end) {
+                con_printf("bash: kill: %s: no such job\n", arg);
+                status = 1;
+                continue;
+            }
+            pid = pt->pid[j];
+        } else {
+            pid = strtol(arg, &end, 10);
+            if (!*arg || *end || pid <= 0) {
+                con_printf("bash: kill: %s: arguments must be process or job IDs\n", arg);
+                status = 1;
+                continue;
+            }
+        }
+        err = send_signal(pt, (int32_t)pid, sig);
+        if (err) {
+            con_printf("bash: kill: (%ld) - %s\n", pid, err == -ESRCH ? "No such process" : "Operation not permitted");
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int proc_cmd_killall(int argc, char** argv) {
+    proc_table_t* pt = sim_procs();
+    int sig = SIGTERM, status = 0, i, j, n;
+    int32_t* victims;
+    sim_opts_t o;
+    uint32_t uid = 0;
+
+    leading_signal(&argc, argv, &sig);
+    if (sim_getopt(argc, argv, "qvs:u:", &o) < 0) return 1;
+    // Only one option takes a value here; which one it was decides its meaning
+    if (SIM_HAS(&o, 's')) {
+        sig = parse_signal(o.value);
+        if (sig < 0) {
+            sim_error("killall", "unknown signal; killall -l lists signals.");
+            return 1;
+        }
+    } else if (SIM_HAS(&o, 'u') && sim_user_id(o.value, &uid) < 0) {
+        sim_error("killall", "cannot find user %s", o.value);
+        return 1;
+    }
+    if (o.n_operands == 0 && !SIM_HAS(&o, 'u')) {
+        con_printf("Usage: killall [OPTION]... [--] NAME...\n");
+        return 1;
+    }
+
+    victims = malloc(pt->count * sizeof(int32_t));
+    for (i = 1; i <= (o.n_operands ? o.n_operands : 1); i++) {
+        const char* name = o.n_operands ? argv[i] : NULL;
+
+        n = 0;
+        for (j = 0; j < (int)pt->count; j++) {
+            if (name && strcmp(proc_comm(pt, j), name) != 0) continue;
+            if (SIM_HAS(&o, 'u') && pt->uid[j] != uid) continue;
+            victims[n++] = pt->pid[j];
+        }
+        if (n == 0) {
+            if (!SIM_HAS(&o, 'q')) con_printf("%s: no process found\n", name ? name : sim_user_name(uid));
+            status = 1;
+        }
+        for (j = 0; j < n; j++) {
+            int k = proc_find(pt, victims[j]);
+            char comm[16];
+            int err;
+
+            snprintf(comm, sizeof(comm), "%s", proc_comm(pt, k));
+            err = send_signal(pt, victims[j], sig);
+            if (err) {
+                if (!SIM_HAS(&o, 'q')) con_printf("%s(%d): %s\n", comm, victims[j], strerror(-err));
+                status = 1;
+            } else if (SIM_HAS(&o, 'v')) {
+                con_printf("Killed %s(%d) with signal %d\n", comm, victims[j], sig);
+            }
+        }
+    }
+    free(victims);
+    return status;
+}
+
+int proc_cmd_jobs(int argc, char** argv) {
+    proc_table_t* pt = sim_procs();
+    int current = -1, previous = -1;
+    sim_opts_t o;
+    uint32_t i;
+
+    if (sim_getopt(argc, argv, "lprs", &o) < 0) return 2;
+
+    // "+" is the most recent stopped job (else the most recent job), "-"
+    // the one before it
+    for (i = 0; i < pt->count; i++) {
+        if (pt->ppid[i] != LOGIN_SHELL || !pt->job[i]) continue;
+        if (current < 0 || (pt->state[i] == PROC_STOPPED) >= (pt->state[current] == PROC_STOPPED)) {
+            previous = current;
+            current = (int)i;
+        } else if (previous < 0 || pt->job[i] > pt->job[previous]) {
+            previous = (int)i;
+        }
+    }
+
+    for (i = 0; i < pt->count; i++) {
+        int stopped = pt->state[i] == PROC_STOPPED;
+        const char* state = stopped ? "Stopped" : "Running";
+
+        if (pt->ppid[i] != LOGIN_SHELL || !pt->job[i]) continue;
+        if ((SIM_HAS(&o, 'r') && stopped) || (SIM_HAS(&o, 's') && !stopped)) continue;
+        if (SIM_HAS(&o, 'p')) {
+            con_printf("%d\n", pt->pid[i]);
+        } else if (SIM_HAS(&o, 'l')) {
+            con_printf("[%d]%c  %d %-24s%s%s\n", pt->job[i], (int)i == current ? '+' : (int)i == previous ? '-' : ' ',
+                       pt->pid[i], state, proc_cmd(pt, (int)i), stopped ? "" : " &");
+        } else {
+            con_printf("[%d]%c  %-24s%s%s\n", pt->job[i], (int)i == current ? '+' : (int)i == previous ? '-' : ' ',
+                       state, proc_cmd(pt, (int)i), stopped ? "" : " &");
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// --bench proc
+
+static uint64_t bench_rng = 88172645463325252ull;
+
+int proc_bench(int argc, char** argv) {
+    long count = argc > 0 ? atol(argv[0]) : 100000;
+    uint32_t top[20], *order;
+    int refreshes = 200, i;
+    double start, elapsed, tick_time = 0, select_time = 0;
+    console_t discard, *out = console_current();
+    proc_table_t* pt;
+    char cmd[64];
+
+    if (count < 100) count = 100;
+    pt = proc_new(64, (uint64_t)256 << 20, 0);
+    pt->now = 86400;
+
+    // Mostly idle daemons and a few busy ones, as on a real machine
+    start = bench_now();
+    for (i = 0; i < count; i++) {
+        float demand = bench_random(&bench_rng, 100) < 5 ? 0.05f + bench_random(&bench_rng, 1000) / 1000.0f : bench_random(&bench_rng, 100) / 100000.0f;
+
+        snprintf(cmd, sizeof(cmd), "/usr/bin/worker-%u --id %d", bench_random(&bench_rng, 500), i);
+        add_proc(pt, i + 1, i ? 1 : 0, bench_random(&bench_rng, 4) ? 1000 : 0, cmd, demand, 20000 + bench_random(&bench_rng, 200000),
+                 1000 + bench_random(&bench_rng, 60000), PROC_SLEEPING, 0, 0, (time_t)bench_random(&bench_rng, 86400));
+    }
+    elapsed = bench_now() - start;
+    bench_report("proc", "processes", pt->count, "count");
+    bench_report("proc", "spawn_rate", pt->count / elapsed, "procs/s");
+
+    // One top refresh: a scheduler tick (shares, states, totals) plus the
+    // top-20 selection by %CPU
+    for (i = 0; i < refreshes; i++) {
+        double t0 = bench_now(), t1;
+
+        proc_tick(pt);
+        t1 = bench_now();
+        proc_top(pt, PROC_SORT_CPU, top, 20);
+        tick_time += t1 - t0;
+        select_time += bench_now() - t1;
+    }
+    bench_report("proc", "tick", tick_time / refreshes * 1e6, "us");
+    bench_report("proc", "select_top20", select_time / refreshes * 1e6, "us");
+    bench_report("proc", "refresh_rate", refreshes / (tick_time + select_time), "refreshes/s");
+
+    // Rendering into a console that discards its output
+    memset(&discard, 0, sizeof(discard));
+    discard.out_fd = -1;
+    console_use(&discard);
+    order = malloc(pt->count * sizeof(uint32_t));
+    pt->stats = sysstat_new(pt, 0);
+    start = bench_now();
+    for (i = 0; i < refreshes; i++) print_top_frame(pt, PROC_SORT_CPU, -1, TOP_SCREEN_ROWS, order, 3);
+    elapsed = bench_now() - start;
+    console_use(out);
+    bench_report("proc", "render_top_screen", elapsed / refreshes * 1e6, "us");
+
+    console_use(&discard);
+    start = bench_now();
+    print_ps_header(PS_USER);
+    for (i = 0; i < (int)pt->count; i++) print_ps_row(pt, i, PS_USER);
+    con_flush();
+    elapsed = bench_now() - start;
+    console_use(out);
+    bench_report("proc", "render_ps_aux", elapsed * 1e3, "ms");
+
+    free(order);
+    free(discard.buf);
+    proc_free(pt);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#ifndef PROC_H
+#define PROC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+struct sysstat;
+
+// Simulated process table.
+//
+// Processes are stored as a struct of arrays ordered by PID: one array per
+// attribute, so the scheduler tick and top's per-refresh work (CPU shares,
+// state counts, memory totals, the %CPU ranking) are straight loops over
+// contiguous floats and integers that the compiler can vectorize. A tick
+// hands out CPU time in proportion to each process's demand, capped by the
+// number of CPUs, and updates states and load averages; the commands
+// advance the table to the session's simulated clock before reading it.
+// A process counts as running when it wants a quarter of a CPU or more,
+// whether or not it got it, so an overloaded machine's load climbs.
+
+typedef enum {
+    PROC_RUNNING = 'R',
+    PROC_SLEEPING = 'S',
+    PROC_DISK = 'D',
+    PROC_IDLE = 'I',         // idle kernel thread
+    PROC_STOPPED = 'T',
+    PROC_ZOMBIE = 'Z'
+} proc_state_t;
+
+// ps STAT modifiers
+#define PROC_SESSION_LEADER 0x01    // s
+#define PROC_HIGH_PRIORITY 0x02     // <
+#define PROC_LOW_PRIORITY 0x04      // N
+#define PROC_FOREGROUND 0x08        // +
+#define PROC_THREADED 0x10          // l
+#define PROC_KERNEL 0x20            // kernel thread: ignores signals
+#define PROC_PENDING_TERM 0x40      // stopped with a fatal signal pending
+
+typedef enum {
+    PROC_SORT_CPU,
+    PROC_SORT_MEM,
+    PROC_SORT_TIME,
+    PROC_SORT_PID
+} proc_sort_t;
+
+typedef struct proc_table {
+    uint32_t count, cap;
+
+    // One entry per process, sorted by pid
+    int32_t* pid;
+    int32_t* ppid;
+    uint32_t* uid;
+    uint8_t* state;
+    uint8_t* flags;
+    int8_t* nice;
+    uint8_t* tty;           // 0 = none, 1 = tty1, n = pts/(n-2)
+    uint8_t* job;           // job number in the learner's shell, 0 = none
+    float* demand;          // share of one CPU the process wants
+    float* used;            // share of one CPU it got in the last tick
+    uint64_t* cpu_ms;       // accumulated CPU time
+    uint32_t* vsz_kb;
+    uint32_t* rss_kb;
+    uint32_t* shr_kb;
+    int64_t* start;
+    uint32_t* comm;         // offsets into strings
+    uint32_t* cmd;
+
+    char* strings;
+    size_t strings_len, strings_cap;
+
+    int32_t next_pid;
+    uint32_t ncpu;
+    uint64_t mem_total_kb;
+    uint64_t ticks;
+    time_t boot, now;
+    double load[3];
+
+    // Totals from the last tick (top's summary area)
+    uint32_t n_state[6];    // R S D I T Z
+    double cpu_busy;        // CPUs' worth of time used
+    uint64_t rss_total_kb;
+
+    uint64_t* scratch;      // sort keys for proc_top()
+    uint32_t scratch_cap;
+
+    struct sysstat* stats;  // machine-wide statistics (sysstat.h), fed by every tick
+} proc_table_t;
+
+proc_table_t* proc_new(uint32_t ncpu, uint64_t mem_total_kb, time_t boot);
+void proc_free(proc_table_t* pt);
+
+// The processes of the simulated Debian server, learner shell included
+void proc_seed_debian(proc_table_t* pt);
+
+int32_t proc_spawn(proc_table_t* pt, int32_t ppid, uint32_t uid, const char* cmd,
+                   float demand, uint32_t rss_kb, uint8_t flags);
+// Index of a pid, or -1
+int proc_find(const proc_table_t* pt, int32_t pid);
+const char* proc_comm(const proc_table_t* pt, int i);
+const char* proc_cmd(const proc_table_t* pt, int i);
+
+// Run the scheduler for one simulated second, then recount totals
+void proc_tick(proc_table_t* pt);
+// Tick in one-second steps until the table's clock reaches now
+void proc_advance(proc_table_t* pt, time_t now);
+
+// Deliver a signal; returns 0 or -errno (ESRCH, EPERM, EINVAL)
+int proc_signal(proc_table_t* pt, int32_t pid, int sig, uint32_t sender_uid);
+
+// Indexes of the first k processes in top's order (largest first, ties
+// by pid) into out; returns how many were written
+uint32_t proc_top(proc_table_t* pt, proc_sort_t sort, uint32_t* out, uint32_t k);
+
+// The session's simulated machine's table (see sim.h), created on first
+// use and advanced to the session's clock
+proc_table_t* proc_session(void);
+
+// Simulated commands (see sim.c)
+int proc_cmd_ps(int argc, char** argv);
+int proc_cmd_top(int argc, char** argv);
+int proc_cmd_pgrep(int argc, char** argv);
+int proc_cmd_kill(int argc, char** argv);
+int proc_cmd_killall(int argc, char** argv);
+int proc_cmd_pkill(int argc, char** argv);
+int proc_cmd_jobs(int argc, char** argv);
+
+// --bench proc [processes]
+int proc_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "deb1.h"
+#include "bench.h"
+#include "console.h"
+#include "session.h"
+#include "render.h"
+#include "util.h"
+
+#define ERASE_LINE "\033[K"
+#define ERASE_BELOW "\033[J"
+#define SGR_RESET "\033[0m"
+
+static volatile sig_atomic_t resized;
+
+static void on_sigwinch(int sig) {
+    (void)sig;
+    resized = 1;
+}
+
+static void grow(char** buf, size_t* cap, size_t need) {
+    if (need <= *cap) return;
+    while (need > *cap) *cap = *cap ? *cap * 2 : 4096;
+    *buf = xrealloc(*buf, *cap);
+}
+
+static void query_size(render_t* r) {
+    struct winsize ws;
+
+    if (r->fd >= 0 && ioctl(r->fd, TIOCGWINSZ, &ws) == 0 && ws.ws_row && ws.ws_col) {
+        r->rows = ws.ws_row;
+        r->cols = ws.ws_col;
+    }
+}
+
+render_t* render_new(int fd, int rows, int cols) {
+    render_t* r = calloc(1, sizeof(*r));
+
+    if (!r) {
+        perror("calloc");
+        exit(1);
+    }
+    r->fd = fd;
+    r->rows = rows;
+    r->cols = cols;
+    if (fd >= 0) {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_sigwinch;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGWINCH, &sa, NULL);
+        query_size(r);
+    }
+    return r;
+}
+
+void render_free(render_t* r) {
+    if (!r) return;
+    free(r->frame);
+    free(r->shown);
+    free(r->shown_row);
+    free(r->row);
+    free(r->out);
+    free(r);
+}
+
+void render_begin(render_t* r) {
+    r->screens++;
+    r->frame_len = 0;
+    r->frame_rows = 0;
+    r->flushed_len = 0;
+    r->active = 1;
+}
+
+int render_add(render_t* r, const char* data, size_t len) {
+    const char* p = data;
+    const char* end = data + len;
+
+    if (!r->active) return 0;
+    grow(&r->frame, &r->frame_cap, r->frame_len + len);
+    memcpy(r->frame + r->frame_len, data, len);
+    r->frame_len += len;
+
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        r->frame_rows++;
+        p++;
+    }
+    return 1;
+}
+
+void render_input(render_t* r, const char* line, size_t len) {
+    // The terminal echoed the line after the prompt
+    if (!r->active || !r->valid) return;
+    grow(&r->frame, &r->frame_cap, r->frame_len + len + 1);
+    memcpy(r->frame + r->frame_len, line, len);
+    r->frame[r->frame_len + len] = '\n';
+    r->frame_len += len + 1;
+    r->frame_rows++;
+    grow(&r->shown, &r->shown_cap, r->frame_len);
+    memcpy(r->shown + r->shown_len, r->frame + r->shown_len, r->frame_len - r->shown_len);
+    r->shown_len = r->frame_len;
+}
+
+void render_lost(render_t* r) {
+    r->active = 0;
+    r->valid = 0;
+}
+
+static void put(render_t* r, const char* data, size_t len) {
+    grow(&r->out, &r->out_cap, r->out_len + len);
+    memcpy(r->out + r->out_len, data, len);
+    r->out_len += len;
+}
+
+static void move_to(render_t* r, uint32_t row, uint32_t col) {
+    char seq[32];
+
+    put(r, seq, (size_t)snprintf(seq, sizeof(seq), "\033[%u;%uH", row + 1, col + 1));
+}
+
+static render_row_t* add_row(render_row_t** rows, uint32_t* cap, uint32_t n) {
+    if (n == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *rows = xrealloc(*rows, *cap * sizeof(render_row_t));
+    }
+    return &(*rows)[n];
+}
+
+// Cut text into rows, noting the colour in effect at the start of each
+// and at the end. Returns the number of rows, or 0 when the text cannot
+// be placed cell by cell: a row wider than the screen, a control
+// character or an escape other than a colour change.
+static uint32_t split_rows(const render_t* r, const char* text, size_t len, render_row_t** rows, uint32_t* cap,
+                           render_row_t* end) {
+    const unsigned char* f = (const unsigned char*)text;
+    uint32_t n = 0, sgr = 0, sgr_len = 0, width = 0, min_width = 0, i = 0;
+    uint32_t limit = r->cols > 1 ? (uint32_t)r->cols - 1 : 1;
+    render_row_t* row = add_row(rows, cap, n++);
+
+    row->start = row->sgr = row->sgr_len = 0;
+    while (i < len) {
+        if (f[i] == '\n') {
+            row->len = i - row->start;
+            row->min_width = (uint16_t)min_width;
+            row->max_width = (uint16_t)width;
+            row = add_row(rows, cap, n++);
+            row->start = ++i;
+            row->sgr = sgr;
+            row->sgr_len = sgr_len;
+            width = min_width = 0;
+            continue;
+        }
+        if (f[i] == '\033') {
+            uint32_t j = i + 1;
+
+            if (j >= len || f[j] != '[') return 0;
+            j++;
+            while (j < len && f[j] >= 0x20 && f[j] < 0x40) j++;
+            if (j >= len || f[j] != 'm') return 0;
+            sgr = i;
+            sgr_len = j + 1 - i;
+            i = j + 1;
+            continue;
+        }
+        if (f[i] < 0x20 || f[i] == 0x7f) return 0;
+        if (f[i] < 0x80) {
+            width++;
+            min_width++;
+        } else if ((f[i] & 0xc0) != 0x80) {
+            // Box drawing (U+2500..U+257F, E2 94/95 xx) is one column;
+            // anything else non-ASCII is counted as two, which is never
+            // less than the terminal uses, and as at least one unless it
+            // is combining (CC/CD xx), zero-width (E2 80 8B..8F) or a
+            // variation selector (EF B8 xx)
+            uint8_t next = i + 1 < len ? f[i + 1] : 0;
+            uint8_t third = i + 2 < len ? f[i + 2] : 0;
+
+            width += f[i] == 0xe2 && (next == 0x94 || next == 0x95) ? 1 : 2;
+            min_width += !(f[i] == 0xcc || f[i] == 0xcd || (f[i] == 0xef && next == 0xb8) ||
+                           (f[i] == 0xe2 && next == 0x80 && third >= 0x8b && third <= 0x8f));
+        }
+        if (width > limit) return 0;
+        i++;
+    }
+    row->len = (uint32_t)len - row->start;
+    row->min_width = (uint16_t)min_width;
+    row->max_width = (uint16_t)width;
+    end->sgr = sgr;
+    end->sgr_len = sgr_len;
+    return n;
+}
+
+static int same_sgr(const render_t* r, const render_row_t* now, const render_row_t* was) {
+    return now->sgr_len == was->sgr_len &&
+           memcmp(r->frame + now->sgr, r->shown + was->sgr, now->sgr_len) == 0;
+}
+
+// Leading bytes two versions of a row share that are plain ASCII, i.e.
+// the column where they start to differ when that is known
+static uint32_t plain_prefix(const render_t* r, const render_row_t* now, const render_row_t* was) {
+    const char* a = r->frame + now->start;
+    const char* b = r->shown + was->start;
+    uint32_t n = now->len < was->len ? now->len : was->len, i;
+
+    for (i = 0; i < n && a[i] == b[i] && a[i] >= 0x20 && a[i] < 0x7f; i++) {
+    }
+    return i;
+}
+
+// Columns a row takes when it is ASCII apart from colour changes, else -1
+static int plain_width(const render_t* r, const render_row_t* row) {
+    const char* p = r->frame + row->start;
+    const char* end = p + row->len;
+    int width = 0;
+
+    while (p < end) {
+        if (*p == '\033') {
+            while (p < end && *p != 'm') p++;
+            p++;
+            continue;
+        }
+        if ((unsigned char)*p >= 0x80) return -1;
+        width++;
+        p++;
+    }
+    return width;
+}
+
+static void full_redraw(render_t* r) {
+    r->out_len = 0;
+    put(r, CLEAR_SCREEN, sizeof(CLEAR_SCREEN) - 1);
+    put(r, r->frame, r->frame_len);
+    r->full_redraws++;
+    r->rows_sent += r->frame_rows + 1;
+}
+
+// Rewrite the rows that differ from what the terminal shows. The cursor
+// starts at the end of the shown text and ends at the end of the frame.
+// Returns 0 if either cannot be placed cell by cell, or the frame does
+// not fit (one row stays free for the echo of the learner's input).
+static int diff_rows(render_t* r) {
+    render_row_t frame_end, shown_end;
+    const render_row_t* shown_row;
+    const char* sgr;
+    uint32_t n, m, i, sgr_len, cur = 0;
+    int moved = 0;
+
+    n = split_rows(r, r->frame, r->frame_len, &r->row, &r->row_cap, &frame_end);
+    if (n == 0 || n + 1 >= (uint32_t)r->rows) return 0;
+    m = split_rows(r, r->shown, r->shown_len, &r->shown_row, &r->shown_row_cap, &shown_end);
+    if (m == 0) return 0;
+    // Shown text taller than the terminal scrolled: its last rows are on
+    // screen, the last one at the bottom
+    shown_row = r->shown_row;
+    if (m > (uint32_t)r->rows) {
+        shown_row += m - (uint32_t)r->rows;
+        m = (uint32_t)r->rows;
+    }
+    cur = m - 1;
+    sgr = r->shown + shown_end.sgr;
+    sgr_len = shown_end.sgr_len;
+
+    for (i = 0; i < n; i++) {
+        const render_row_t* now = &r->row[i];
+        const render_row_t* was = i < m ? &shown_row[i] : NULL;
+        int last = i == n - 1, same = 0;
+        uint32_t from = 0;
+
+        if (was && same_sgr(r, now, was)) {
+            same = now->len == was->len && memcmp(r->frame + now->start, r->shown + was->start, now->len) == 0;
+            from = plain_prefix(r, now, was);
+        }
+        if (same && !last) {
+            r->rows_skipped++;
+            continue;
+        }
+        if (same) {
+            // The last row is unchanged: the cursor has to end up after it
+            int width = plain_width(r, now);
+
+            if (!moved && n == m) {
+                r->rows_skipped++;
+                break;
+            }
+            if (width >= 0) {
+                move_to(r, i, (uint32_t)width);
+                if (n < m) put(r, ERASE_BELOW, sizeof(ERASE_BELOW) - 1);
+                sgr = NULL;
+                r->rows_skipped++;
+                break;
+            }
+            from = 0;
+        }
+
+        // Go to the first differing column and set its colour
+        if (from == 0 && i == cur + 1) {
+            put(r, "\n", 1);
+        } else {
+            move_to(r, i, from);
+        }
+        moved = 1;
+        if (now->sgr_len != sgr_len || (sgr_len && memcmp(r->frame + now->sgr, sgr, sgr_len) != 0)) {
+            if (now->sgr_len) {
+                put(r, r->frame + now->sgr, now->sgr_len);
+            } else {
+                put(r, SGR_RESET, sizeof(SGR_RESET) - 1);
+            }
+        }
+        put(r, r->frame + now->start + from, now->len - from);
+        if (last && n < m) {
+            put(r, ERASE_BELOW, sizeof(ERASE_BELOW) - 1);
+        } else if (was && was->max_width > now->min_width) {
+            put(r, ERASE_LINE, sizeof(ERASE_LINE) - 1);
+        }
+        cur = i;
+        r->rows_sent++;
+
+        // Colour in effect at the end of the row
+        if (last) {
+            sgr = r->frame + frame_end.sgr;
+            sgr_len = frame_end.sgr_len;
+        } else {
+            sgr = r->frame + r->row[i + 1].sgr;
+            sgr_len = r->row[i + 1].sgr_len;
+        }
+    }
+
+    // Leave the frame's final colour in effect for what follows it
+    if (sgr == NULL || frame_end.sgr_len != sgr_len || memcmp(r->frame + frame_end.sgr, sgr, sgr_len) != 0) {
+        if (frame_end.sgr_len) {
+            put(r, r->frame + frame_end.sgr, frame_end.sgr_len);
+        } else {
+            put(r, SGR_RESET, sizeof(SGR_RESET) - 1);
+        }
+    }
+    return 1;
+}
+
+const char* render_update(render_t* r, size_t* len) {
+    r->out_len = 0;
+    if (!r->active) {
+        *len = 0;
+        return r->out;
+    }
+    if (resized) {
+        resized = 0;
+        query_size(r);
+        r->valid = 0;
+    }
+
+    // Text only ever goes on the end of a frame, so once part of it was
+    // flushed the terminal shows a prefix of it
+    if (r->valid && (r->flushed_len || (r->frame_len >= r->shown_len &&
+                                        memcmp(r->frame, r->shown, r->shown_len) == 0))) {
+        // The screen only grew: the new text goes where the cursor is,
+        // scrolling the terminal if it has to
+        put(r, r->frame + r->shown_len, r->frame_len - r->shown_len);
+        grow(&r->shown, &r->shown_cap, r->frame_len);
+        memcpy(r->shown + r->shown_len, r->frame + r->shown_len, r->frame_len - r->shown_len);
+    } else {
+        if (!r->valid || !diff_rows(r) || r->out_len >= r->frame_len + sizeof(CLEAR_SCREEN)) full_redraw(r);
+        grow(&r->shown, &r->shown_cap, r->frame_len);
+        memcpy(r->shown, r->frame, r->frame_len);
+    }
+    r->shown_len = r->frame_len;
+    r->flushed_len = r->frame_len;
+    r->valid = 1;
+    *len = r->out_len;
+    return r->out;
+}
+
+// Benchmark: scripted sessions replayed against a terminal of the given
+// size (output discarded), once with every screen sent whole after a
+// clear and once through the renderer. The tour reads every lesson; the
+// menu walk opens each topic's menu and goes back to the main menu.
+
+static void flush_on_input(void* ctx) {
+    (void)ctx;
+    con_flush();
+}
+
+// Simulation mode, then each topic and its "Back to main menu", then Exit
+static char* menu_script(size_t* len) {
+    uint32_t n = lessons.header->n_topics, t;
+    size_t cap = 16 + (size_t)n * 24, used;
+    char* script = xrealloc(NULL, cap);
+
+    used = (size_t)snprintf(script, cap, "3\n");
+    for (t = 0; t < n; t++) {
+        used += (size_t)snprintf(script + used, cap - used, "%u\n%u\n", t + 1,
+                                 lp_topic(&lessons, t)->n_sections + 1);
+    }
+    used += (size_t)snprintf(script + used, cap - used, "%u\n", n + 2);
+    *len = used;
+    return script;
+}
+
+static void replay(const char* name, const char* script, size_t script_len, int rows, int cols) {
+    int sessions = 20, pass, s;
+
+    for (pass = 0; pass < 2; pass++) {
+        const char* how = pass ? "damage" : "full";
+        char metric[64];
+        console_t con;
+        double start, elapsed;
+
+        memset(&con, 0, sizeof(con));
+        con.out_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        con.color = 1;
+        con.clear_screen = 1;
+        con.script = script;
+        con.script_len = script_len;
+        con.on_input = flush_on_input;
+        if (pass) con.render = render_new(-1, rows, cols);
+        console_use(&con);
+
+        start = bench_now();
+        for (s = 0; s < sessions; s++) {
+            memset(&sys_config, 0, sizeof(sys_config));
+            con.script_pos = 0;
+            run_session();
+            con_flush();
+        }
+        elapsed = bench_now() - start;
+        console_use(NULL);
+
+        if (pass == 0) {
+            snprintf(metric, sizeof(metric), "%s_screens_per_session", name);
+            bench_report("render", metric, (double)con.screens / sessions, "count");
+        }
+        snprintf(metric, sizeof(metric), "%s_%s_bytes_per_screen", name, how);
+        bench_report("render", metric, (double)con.bytes_written / con.screens, "bytes");
+        snprintf(metric, sizeof(metric), "%s_%s_writes_per_frame", name, how);
+        bench_report("render", metric, (double)con.write_calls / con.frames, "writes");
+        snprintf(metric, sizeof(metric), "%s_%s_time_per_screen", name, how);
+        bench_report("render", metric, elapsed / con.screens * 1e6, "us");
+        if (pass) {
+            render_t* r = con.render;
+
+            snprintf(metric, sizeof(metric), "%s_rows_skipped", name);
+            bench_report("render", metric, 100.0 * r->rows_skipped / (r->rows_skipped + r->rows_sent), "%");
+            snprintf(metric, sizeof(metric), "%s_full_redraws", name);
+            bench_report("render", metric, 100.0 * r->full_redraws / r->screens, "%");
+        }
+        console_free(&con);
+        close(con.out_fd);
+    }
+}
+
+int render_bench(int argc, char** argv) {
+    int rows = argc >= 2 ? atoi(argv[0]) : 40;
+    int cols = argc >= 2 ? atoi(argv[1]) : 120;
+    const char* script_path = "lessons/tour.script";
+    size_t script_len = 0;
+    char* script = read_file(script_path, &script_len);
+
+    if (!script) {
+        fprintf(stderr, "%s: cannot read the tour script\n", script_path);
+        return 1;
+    }
+    if (rows < 4) rows = 4;
+    if (cols < 20) cols = 20;
+    load_lessons(NULL);
+
+    replay("tour", script, script_len, rows, cols);
+    free(script);
+    script = menu_script(&script_len);
+    replay("menus", script, script_len, rows, cols);
+    free(script);
+    lesson_pack_close(&lessons);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Screen updates with damage tracking, for consoles on a terminal.
+//
+// Between two clear-screens the console hands a screen's text to the
+// renderer instead of sending it, and on every flush the renderer works
+// out what the terminal needs. It keeps the text the terminal shows (the
+// last screen sent plus the learner's echoed input). A screen that only
+// grew gets the new text appended. Otherwise both are cut into rows:
+// unchanged rows are skipped, a changed row is rewritten from its first
+// differing column when everything before that is plain ASCII (so the
+// column is known) and from its start otherwise, and whatever the old
+// screen had below the new one is erased; if that would not be smaller
+// than clearing and sending the screen, the screen is sent instead. The
+// update goes out with the rest of the console buffer in one write.
+//
+// Text taller than the terminal has scrolled: the terminal shows its last
+// rows, so that window is what a new screen is diffed against. A new
+// screen that is itself taller than the terminal is sent whole, so that
+// its top reaches the scrollback, as is one with a row too wide to place.
+// Only render_lost() makes the renderer forget what is on screen.
+
+typedef struct {
+    uint32_t start, len;    // text of the row in the frame, without newline
+    uint32_t sgr, sgr_len;  // colour sequence in effect where it starts
+    uint16_t min_width;     // columns it takes, at least
+    uint16_t max_width;     // and at most
+} render_row_t;
+
+typedef struct render {
+    int fd;                 // terminal asked for its size, -1 = fixed size
+    int rows, cols;
+
+    // The screen being collected: everything since the clear
+    char* frame;
+    size_t frame_len, frame_cap;
+    uint32_t frame_rows;    // newlines so far
+    int active;             // collecting (else text passes through)
+    size_t flushed_len;     // frame_len at the last update
+
+    // What the terminal shows from its top-left corner, with the cursor
+    // at the end; valid = 0 when that is not known
+    char* shown;
+    size_t shown_len, shown_cap;
+    int valid;
+
+    // Scratch: both texts cut into rows
+    render_row_t* row;
+    uint32_t row_cap;
+    render_row_t* shown_row;
+    uint32_t shown_row_cap;
+    char* out;
+    size_t out_len, out_cap;
+
+    unsigned long screens, full_redraws, rows_sent, rows_skipped;
+} render_t;
+
+// fd is the terminal (for its size and SIGWINCH); with fd < 0 the size
+// is rows x cols
+render_t* render_new(int fd, int rows, int cols);
+void render_free(render_t* r);
+
+// A clear-screen: start collecting a new screen
+void render_begin(render_t* r);
+
+// Collect screen text. Returns 0 when not collecting: the caller sends
+// the text as it is.
+int render_add(render_t* r, const char* data, size_t len);
+
+// The bytes that bring the terminal up to date with the screen collected
+// so far (valid until the next call)
+const char* render_update(render_t* r, size_t* len);
+
+// The learner typed line: the terminal echoed it after the prompt
+void render_input(render_t* r, const char* line, size_t len);
+
+// Something else is about to use the terminal: stop collecting and draw
+// the next screen in full
+void render_lost(render_t* r);
+
+// --bench render [rows cols]
+int render_bench(int argc, char** argv);
+
+#endif
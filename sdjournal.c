@@ -0,0 +1,1724 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "proc.h"
+#include "systemd.h"
+#include "nss.h"
+#include "perm.h"
+#include "sdjournal.h"
+#include "bench.h"
+#include "util.h"
+
+#define HOSTNAME "debian-server"
+#define BOOT_ID "3f1c6a2e8d4b4c1e9a572b6f0e9d4c11"
+#define USEC 1000000LL
+
+// journald's files grow in 8M steps; an entry with its data and index
+// objects takes about this much besides the message
+#define FILE_STEP (8ull << 20)
+#define ENTRY_OVERHEAD 232
+
+// journalctl -f: how long the learner watches before pressing Ctrl-C
+#define FOLLOW_SECONDS 300
+#define DEFAULT_LINES 10
+#define JUMP_LINES 1000
+
+#define LINE_MAX_LEN 1024
+#define MAX_MINUTE_EVENTS 24
+#define MAX_PENDING 16
+
+static const char* const priority_names[SDJ_PRIORITIES] = {
+    "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug",
+};
+
+static uint32_t hash_string(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t hash_id(uint32_t id) {
+    id ^= id >> 16;
+    id *= 0x7feb352du;
+    id ^= id >> 15;
+    return id;
+}
+
+// ---------------------------------------------------------------------
+// The store
+
+sdj_t* sdj_new(void) {
+    sdj_t* j = calloc(1, sizeof(*j));
+    int p;
+
+    if (!j) {
+        perror("calloc");
+        exit(1);
+    }
+    j->strings_len = 1;     // offset 0 is ""
+    j->strings_cap = 4096;
+    j->strings = xrealloc(NULL, j->strings_cap);
+    j->strings[0] = '\0';
+    for (p = 0; p < SDJ_PRIORITIES; p++) j->by_priority[p] = SDJ_NONE;
+    return j;
+}
+
+void sdj_free(sdj_t* j) {
+    uint32_t i;
+
+    if (!j) return;
+    free(j->usec);
+    free(j->unit);
+    free(j->ident);
+    free(j->message);
+    free(j->pid);
+    free(j->priority);
+    free(j->strings);
+    free(j->values);
+    free(j->value_list);
+    free(j->value_slots);
+    for (i = 0; i < j->n_lists; i++) free(j->lists[i].ids);
+    free(j->lists);
+    free(j->pid_slots);
+    free(j);
+}
+
+const char* sdj_value(const sdj_t* j, uint32_t id) {
+    return id == SDJ_NONE ? "" : j->strings + j->values[id];
+}
+
+static uint32_t* value_slot(const sdj_t* j, const char* s, size_t len, uint32_t h) {
+    uint32_t i = h & j->value_mask;
+
+    while (j->value_slots[i]) {
+        const char* v = j->strings + j->values[j->value_slots[i] - 1];
+
+        if (strncmp(v, s, len) == 0 && v[len] == '\0') break;
+        i = (i + 1) & j->value_mask;
+    }
+    return &j->value_slots[i];
+}
+
+// Id of a value, or SDJ_NONE if no entry has it
+static uint32_t find_value(const sdj_t* j, const char* s) {
+    return j->value_slots ? *value_slot(j, s, strlen(s), hash_string(s, strlen(s))) - 1 : SDJ_NONE;
+}
+
+static void values_reserve(sdj_t* j) {
+    uint32_t size = j->value_slots ? j->value_mask + 1 : 0, i;
+
+    if ((j->n_values + 1) * 2 <= size) return;
+    size = size ? size * 2 : 1024;
+    free(j->value_slots);
+    j->value_slots = calloc(size, sizeof(uint32_t));
+    if (!j->value_slots) {
+        perror("calloc");
+        exit(1);
+    }
+    j->value_mask = size - 1;
+    for (i = 0; i < j->n_values; i++) {
+        const char* v = j->strings + j->values[i];
+        uint32_t k = hash_string(v, strlen(v)) & j->value_mask;
+
+        while (j->value_slots[k]) k = (k + 1) & j->value_mask;
+        j->value_slots[k] = i + 1;
+    }
+}
+
+static uint32_t intern(sdj_t* j, const char* s) {
+    size_t len = strlen(s);
+    uint32_t h = hash_string(s, len), *slot;
+
+    values_reserve(j);
+    slot = value_slot(j, s, len, h);
+    if (*slot) return *slot - 1;
+    if (j->strings_len + len + 1 > j->strings_cap) {
+        while (j->strings_len + len + 1 > j->strings_cap) j->strings_cap *= 2;
+        j->strings = xrealloc(j->strings, j->strings_cap);
+    }
+    if (j->n_values == j->values_cap) {
+        j->values_cap = j->values_cap ? j->values_cap * 2 : 1024;
+        j->values = xrealloc(j->values, j->values_cap * sizeof(uint32_t));
+        j->value_list = xrealloc(j->value_list, j->values_cap * sizeof(uint32_t));
+    }
+    memcpy(j->strings + j->strings_len, s, len + 1);
+    j->values[j->n_values] = (uint32_t)j->strings_len;
+    j->value_list[j->n_values] = SDJ_NONE;
+    j->strings_len += len + 1;
+    *slot = ++j->n_values;
+    return j->n_values - 1;
+}
+
+static uint32_t new_list(sdj_t* j) {
+    if (j->n_lists == j->lists_cap) {
+        j->lists_cap = j->lists_cap ? j->lists_cap * 2 : 64;
+        j->lists = xrealloc(j->lists, j->lists_cap * sizeof(sdj_list_t));
+    }
+    memset(&j->lists[j->n_lists], 0, sizeof(sdj_list_t));
+    return j->n_lists++;
+}
+
+static void list_add(sdj_list_t* l, uint32_t entry) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 16;
+        l->ids = xrealloc(l->ids, l->cap * sizeof(uint32_t));
+    }
+    l->ids[l->n++] = entry;
+}
+
+// A pid's list is found by the pid of its first entry
+static uint32_t* pid_slot(const sdj_t* j, int32_t pid) {
+    uint32_t i = hash_id((uint32_t)pid) & j->pid_mask;
+
+    while (j->pid_slots[i] && j->pid[j->lists[j->pid_slots[i] - 1].ids[0]] != pid) i = (i + 1) & j->pid_mask;
+    return &j->pid_slots[i];
+}
+
+static uint32_t find_pid(const sdj_t* j, int32_t pid) {
+    return j->pid_slots ? *pid_slot(j, pid) - 1 : SDJ_NONE;
+}
+
+static void pids_reserve(sdj_t* j) {
+    uint32_t size = j->pid_slots ? j->pid_mask + 1 : 0, i, *old = j->pid_slots;
+
+    if ((j->n_pids + 1) * 2 <= size) return;
+    j->pid_slots = calloc(size ? size * 2 : 256, sizeof(uint32_t));
+    if (!j->pid_slots) {
+        perror("calloc");
+        exit(1);
+    }
+    j->pid_mask = (size ? size * 2 : 256) - 1;
+    for (i = 0; i < size; i++) {
+        uint32_t k;
+
+        if (!old[i]) continue;
+        k = hash_id((uint32_t)j->pid[j->lists[old[i] - 1].ids[0]]) & j->pid_mask;
+        while (j->pid_slots[k]) k = (k + 1) & j->pid_mask;
+        j->pid_slots[k] = old[i];
+    }
+    free(old);
+}
+
+uint32_t sdj_append(sdj_t* j, int64_t usec, uint8_t priority, const char* unit, const char* ident, int32_t pid,
+                    const char* message) {
+    uint32_t e = j->count, *slot;
+
+    if (j->count == j->cap) {
+        j->cap = j->cap ? j->cap * 2 : 1024;
+        j->usec = xrealloc(j->usec, j->cap * sizeof(int64_t));
+        j->unit = xrealloc(j->unit, j->cap * sizeof(uint32_t));
+        j->ident = xrealloc(j->ident, j->cap * sizeof(uint32_t));
+        j->message = xrealloc(j->message, j->cap * sizeof(uint32_t));
+        j->pid = xrealloc(j->pid, j->cap * sizeof(int32_t));
+        j->priority = xrealloc(j->priority, j->cap);
+    }
+    if (e && usec < j->usec[e - 1]) usec = j->usec[e - 1];
+    if (priority >= SDJ_PRIORITIES) priority = SDJ_DEBUG;
+    j->usec[e] = usec;
+    j->priority[e] = priority;
+    j->pid[e] = pid;
+    j->unit[e] = unit ? intern(j, unit) : SDJ_NONE;
+    j->ident[e] = ident ? intern(j, ident) : SDJ_NONE;
+    j->message[e] = intern(j, message);
+    j->count++;
+    j->bytes += ENTRY_OVERHEAD + strlen(message);
+
+    if (j->unit[e] != SDJ_NONE) {
+        if (j->value_list[j->unit[e]] == SDJ_NONE) j->value_list[j->unit[e]] = new_list(j);
+        list_add(&j->lists[j->value_list[j->unit[e]]], e);
+    }
+    if (j->by_priority[priority] == SDJ_NONE) j->by_priority[priority] = new_list(j);
+    list_add(&j->lists[j->by_priority[priority]], e);
+    if (pid > 0) {
+        pids_reserve(j);
+        slot = pid_slot(j, pid);
+        if (!*slot) {
+            *slot = new_list(j) + 1;
+            j->n_pids++;
+        }
+        list_add(&j->lists[*slot - 1], e);
+    }
+    return e;
+}
+
+// ---------------------------------------------------------------------
+// Queries
+
+void sdj_query_init(sdj_query_t* q) {
+    memset(q, 0, sizeof(*q));
+    q->since = INT64_MIN;
+    q->until = INT64_MAX;
+    q->max_priority = SDJ_DEBUG;
+}
+
+// First entry at or after usec
+static uint32_t lower_bound(const sdj_t* j, int64_t usec) {
+    uint32_t lo = 0, hi = j->count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (j->usec[mid] < usec) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void term_add(sdj_term_t* t, const sdj_list_t* l) {
+    if (t->n_lists == SDJ_MAX_MATCH) return;
+    t->ids[t->n_lists] = l->ids;
+    t->n[t->n_lists] = l->n;
+    t->n_lists++;
+}
+
+void sdj_iter_init(sdj_iter_t* it, const sdj_t* j, const sdj_query_t* q, uint32_t from, int reverse) {
+    sdj_term_t* t;
+    uint32_t i, k;
+    int empty = 0;
+
+    memset(it, 0, sizeof(*it));
+    it->j = j;
+    it->reverse = reverse;
+    it->lo = q->since == INT64_MIN ? 0 : lower_bound(j, q->since);
+    it->hi = q->until == INT64_MAX ? j->count : lower_bound(j, q->until == INT64_MAX ? q->until : q->until + 1);
+    if (it->lo < from) it->lo = from;
+    it->ident = SDJ_NONE;
+    if (q->ident && (it->ident = find_value(j, q->ident)) == SDJ_NONE) empty = 1;
+
+    // Each constraint is the union of its lists; a constraint none of
+    // whose values occur matches nothing
+    if (q->n_units) {
+        t = &it->terms[it->n_terms++];
+        for (i = 0; i < q->n_units; i++) {
+            uint32_t v = find_value(j, q->units[i]);
+
+            if (v != SDJ_NONE && j->value_list[v] != SDJ_NONE) term_add(t, &j->lists[j->value_list[v]]);
+        }
+        empty |= !t->n_lists;
+    }
+    if (q->min_priority > 0 || q->max_priority < SDJ_DEBUG) {
+        t = &it->terms[it->n_terms++];
+        for (i = q->min_priority; i <= q->max_priority && i < SDJ_PRIORITIES; i++) {
+            if (j->by_priority[i] != SDJ_NONE) term_add(t, &j->lists[j->by_priority[i]]);
+        }
+        empty |= !t->n_lists;
+    }
+    if (q->n_pids) {
+        t = &it->terms[it->n_terms++];
+        for (i = 0; i < q->n_pids; i++) {
+            uint32_t l = find_pid(j, q->pids[i]);
+
+            if (l != SDJ_NONE) term_add(t, &j->lists[l]);
+        }
+        empty |= !t->n_lists;
+    }
+    if (empty || it->lo >= it->hi) it->hi = it->lo;
+
+    // Lists start at the range's end they are walked from
+    for (i = 0; i < it->n_terms; i++) {
+        t = &it->terms[i];
+        for (k = 0; k < t->n_lists; k++) {
+            uint32_t lo = 0, hi = t->n[k], target = reverse ? it->hi : it->lo;
+
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+
+                if (t->ids[k][mid] < target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            t->pos[k] = lo;
+        }
+    }
+    it->next = reverse ? it->hi : it->lo;
+}
+
+// Smallest entry >= target in any of the term's lists, galloping from
+// where each list was left
+static uint32_t seek_forward(sdj_term_t* t, uint32_t target) {
+    uint32_t best = SDJ_NONE, k;
+
+    for (k = 0; k < t->n_lists; k++) {
+        const uint32_t* ids = t->ids[k];
+        uint32_t pos = t->pos[k], n = t->n[k], step = 1, lo, hi;
+
+        if (pos < n && ids[pos] < target) {
+            while (pos + step < n && ids[pos + step] < target) step *= 2;
+            lo = pos + step / 2 + 1;
+            hi = pos + step < n ? pos + step : n;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+
+                if (ids[mid] < target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            pos = lo;
+        }
+        t->pos[k] = pos;
+        if (pos < n && ids[pos] < best) best = ids[pos];
+    }
+    return best;
+}
+
+// Largest entry <= target; pos counts the entries at or before it
+static uint32_t seek_backward(sdj_term_t* t, uint32_t target) {
+    uint32_t best = SDJ_NONE, k;
+
+    for (k = 0; k < t->n_lists; k++) {
+        const uint32_t* ids = t->ids[k];
+        uint32_t pos = t->pos[k], step = 1, lo, hi;
+
+        if (pos > 0 && ids[pos - 1] > target) {
+            while (step < pos && ids[pos - 1 - step] > target) step *= 2;
+            lo = step < pos ? pos - step : 0;
+            hi = pos - step / 2 - 1;
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+
+                if (ids[mid] <= target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            pos = lo;
+        }
+        t->pos[k] = pos;
+        if (pos > 0 && (best == SDJ_NONE || ids[pos - 1] > best)) best = ids[pos - 1];
+    }
+    return best;
+}
+
+uint32_t sdj_iter_next(sdj_iter_t* it) {
+    uint32_t i;
+
+    // Leapfrog: move the candidate to each term's next entry until every
+    // term agrees on it
+    if (!it->reverse) {
+        uint32_t cand = it->next;
+
+        while (cand < it->hi) {
+            int moved = 0;
+
+            for (i = 0; i < it->n_terms; i++) {
+                uint32_t v = seek_forward(&it->terms[i], cand);
+
+                if (v == SDJ_NONE || v >= it->hi) {
+                    it->next = it->hi;
+                    return SDJ_NONE;
+                }
+                if (v != cand) {
+                    cand = v;
+                    moved = 1;
+                }
+            }
+            if (moved) continue;
+            if (it->ident == SDJ_NONE || it->j->ident[cand] == it->ident) {
+                it->next = cand + 1;
+                return cand;
+            }
+            cand++;
+        }
+        it->next = it->hi;
+        return SDJ_NONE;
+    }
+    while (it->next > it->lo) {
+        uint32_t cand = it->next - 1;
+        int moved = 0;
+
+        for (i = 0; i < it->n_terms; i++) {
+            uint32_t v = seek_backward(&it->terms[i], cand);
+
+            if (v == SDJ_NONE || v < it->lo) {
+                it->next = it->lo;
+                return SDJ_NONE;
+            }
+            if (v != cand) {
+                cand = v;
+                moved = 1;
+            }
+        }
+        it->next = cand + 1;
+        if (moved) continue;
+        it->next = cand;
+        if (it->ident == SDJ_NONE || it->j->ident[cand] == it->ident) return cand;
+    }
+    return SDJ_NONE;
+}
+
+// ---------------------------------------------------------------------
+// What the seeded machine writes
+
+typedef struct {
+    int64_t usec;
+    uint8_t priority;
+    const char* unit;
+    const char* ident;
+    int32_t pid;
+    char message[240];
+} event_t;
+
+typedef struct {
+    event_t* items;
+    uint32_t n, cap;
+} events_t;
+
+static void __attribute__((format(printf, 7, 8)))
+add_event(events_t* ev, int64_t usec, uint8_t priority, const char* unit, const char* ident, int32_t pid, const char* fmt, ...) {
+    event_t* e;
+    va_list ap;
+
+    if (ev->n == ev->cap) {
+        ev->cap = ev->cap ? ev->cap * 2 : 64;
+        ev->items = xrealloc(ev->items, ev->cap * sizeof(event_t));
+    }
+    e = &ev->items[ev->n++];
+    e->usec = usec;
+    e->priority = priority;
+    e->unit = unit;
+    e->ident = ident;
+    e->pid = pid;
+    va_start(ap, fmt);
+    vsnprintf(e->message, sizeof(e->message), fmt, ap);
+    va_end(ap);
+}
+
+// Time order, keeping the order they were made in within a time
+static void sort_events(events_t* ev) {
+    uint32_t i, k;
+
+    for (i = 1; i < ev->n; i++) {
+        event_t e = ev->items[i];
+
+        for (k = i; k > 0 && ev->items[k - 1].usec > e.usec; k--) ev->items[k] = ev->items[k - 1];
+        ev->items[k] = e;
+    }
+}
+
+// What a daemon says when it starts, stops and reloads; lines separated
+// by '\n'
+static const struct {
+    const char* unit;
+    const char* ident;
+    const char* started;
+    const char* stopping;
+    const char* reloaded;
+} daemons[] = {
+    { "ssh.service", "sshd", "Server listening on 0.0.0.0 port 22.\nServer listening on :: port 22.",
+      "Received signal 15; terminating.",
+      "Received SIGHUP; restarting.\nServer listening on 0.0.0.0 port 22.\nServer listening on :: port 22." },
+    { "cron.service", "cron", "(CRON) INFO (pidfile fd = 3)\n(CRON) INFO (Running @reboot jobs)", NULL, NULL },
+    { "apache2.service", "apachectl",
+      "AH00558: apache2: Could not reliably determine the server's fully qualified domain name, using 127.0.1.1. "
+      "Set the 'ServerName' directive globally to suppress this message", NULL,
+      "AH00558: apache2: Could not reliably determine the server's fully qualified domain name, using 127.0.1.1. "
+      "Set the 'ServerName' directive globally to suppress this message" },
+    { "systemd-resolved.service", "systemd-resolved",
+      "Positive Trust Anchors:\n. IN DS 20326 8 2 e06d44b80b8f1d39a95c0b0d7c65d08458e880409bbc683457104237c7f8ec8d\n"
+      "Using system hostname '" HOSTNAME "'.", NULL, NULL },
+    { "systemd-timesyncd.service", "systemd-timesyncd", "Contacted time server 162.159.200.123:123 (2.debian.pool.ntp.org).",
+      NULL, NULL },
+    { "systemd-logind.service", "systemd-logind", "New seat seat0.\nWatching system buttons on /dev/input/event0 (Power Button)",
+      NULL, NULL },
+};
+
+static void daemon_lines(events_t* ev, int64_t usec, const char* unit, int32_t pid, int which) {
+    size_t i;
+
+    for (i = 0; i < sizeof(daemons) / sizeof(daemons[0]); i++) {
+        const char* lines = which == 0 ? daemons[i].started : which == 1 ? daemons[i].stopping : daemons[i].reloaded;
+
+        if (strcmp(daemons[i].unit, unit) != 0 || !lines) continue;
+        while (*lines) {
+            size_t n = strcspn(lines, "\n");
+
+            add_event(ev, usec++, SDJ_INFO, unit, daemons[i].ident, pid, "%.*s", (int)n, lines);
+            lines += n;
+            if (*lines) lines++;
+        }
+    }
+}
+
+// systemd's lines for a unit, started at start and done at done
+static void unit_lines(events_t* ev, int64_t start, int64_t done, const char* unit, const char* description,
+                       sdj_unit_event_t event, int32_t pid) {
+    const char* dot = strrchr(unit, '.');
+    const char* kind = dot ? dot + 1 : "";
+    char name[256];
+
+    if (description && *description) {
+        snprintf(name, sizeof(name), "%s - %s", unit, description);
+    } else {
+        snprintf(name, sizeof(name), "%s", unit);
+    }
+    switch (event) {
+        case SDJ_UNIT_KILLED:
+            add_event(ev, start, SDJ_NOTICE, unit, "systemd", 1, "%s: Main process exited, code=killed, status=15/TERM", unit);
+            add_event(ev, start + 1, SDJ_WARNING, unit, "systemd", 1, "%s: Failed with result 'signal'.", unit);
+            return;
+        case SDJ_UNIT_RESTART:
+            add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "%s: Scheduled restart job, restart counter is at 1.", unit);
+            add_event(ev, start + 1, SDJ_INFO, unit, "systemd", 1, "Stopped %s.", name);
+            unit_lines(ev, start + 2, done + 2, unit, description, SDJ_UNIT_START, pid);
+            return;
+        case SDJ_UNIT_RELOAD:
+            add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "Reloading %s...", name);
+            daemon_lines(ev, start + 1, unit, pid, 2);
+            add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Reloaded %s.", name);
+            return;
+        case SDJ_UNIT_STOP:
+            if (strcmp(kind, "target") == 0) {
+                add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "Stopped target %s.", name);
+            } else if (strcmp(kind, "socket") == 0) {
+                add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "%s: Deactivated successfully.", unit);
+                add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Closed %s.", name);
+            } else if (strcmp(kind, "mount") == 0) {
+                add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "Unmounting %s...", name);
+                add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Unmounted %s.", name);
+            } else if (strcmp(kind, "slice") == 0) {
+                add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "Removed slice %s.", name);
+            } else {
+                add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "%s %s...", "Stopping", name);
+                daemon_lines(ev, start + 1, unit, pid, 1);
+                add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "%s: Deactivated successfully.", unit);
+                add_event(ev, done + 1, SDJ_INFO, unit, "systemd", 1, "Stopped %s.", name);
+            }
+            return;
+        default:
+            break;
+    }
+    if (strcmp(kind, "target") == 0) {
+        add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Reached target %s.", name);
+    } else if (strcmp(kind, "socket") == 0) {
+        add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Listening on %s.", name);
+    } else if (strcmp(kind, "mount") == 0) {
+        add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "Mounting %s...", name);
+        add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Mounted %s.", name);
+    } else if (strcmp(kind, "slice") == 0) {
+        add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Created slice %s.", name);
+    } else if (strcmp(kind, "service") == 0) {
+        add_event(ev, start, SDJ_INFO, unit, "systemd", 1, "Starting %s...", name);
+        daemon_lines(ev, start + (done - start) / 2, unit, pid, 0);
+        add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Started %s.", name);
+    } else {
+        add_event(ev, done, SDJ_INFO, unit, "systemd", 1, "Started %s.", name);
+    }
+}
+
+static const struct {
+    uint32_t ms;
+    uint8_t priority;
+    const char* message;
+} kernel_lines[] = {
+    { 0, SDJ_NOTICE, "Linux version 6.1.0-13-amd64 (debian-kernel@lists.debian.org) (gcc-12 (Debian 12.2.0-14) 12.2.0, "
+                     "GNU ld (GNU Binutils for Debian) 2.40) #1 SMP PREEMPT_DYNAMIC Debian 6.1.55-1 (2023-09-29)" },
+    { 0, SDJ_INFO, "Command line: BOOT_IMAGE=/boot/vmlinuz-6.1.0-13-amd64 root=UUID=8a2b6f0e-9d4c-4c11-b3f1-c6a2e8d4b4c1 ro quiet" },
+    { 2, SDJ_INFO, "DMI: innotek GmbH VirtualBox/VirtualBox, BIOS VirtualBox 12/01/2006" },
+    { 2, SDJ_INFO, "Hypervisor detected: KVM" },
+    { 61, SDJ_INFO, "Memory: 1969752K/2096696K available (14336K kernel code, 2426K rwdata, 9084K rodata, 2828K init, "
+                    "17444K bss, 126684K reserved, 0K cma-reserved)" },
+    { 812, SDJ_INFO, "e1000 0000:00:03.0 eth0: (PCI:33MHz:32-bit) 08:00:27:4e:66:a1" },
+    { 830, SDJ_INFO, "e1000 0000:00:03.0 enp0s3: renamed from eth0" },
+    { 1104, SDJ_INFO, "EXT4-fs (sda1): mounted filesystem 8a2b6f0e-9d4c-4c11-b3f1-c6a2e8d4b4c1 with ordered data mode. "
+                      "Quota mode: none." },
+    { 1350, SDJ_WARNING, "piix4_smbus 0000:00:07.0: SMBus Host Controller not enabled!" },
+    { 1498, SDJ_ERR, "[drm:vmw_host_printf [vmwgfx]] *ERROR* Failed to send host log message." },
+    { 5233, SDJ_INFO, "e1000: enp0s3 NIC Link is Up 1000 Mbps Full Duplex, Flow Control: RX" },
+};
+
+typedef struct {
+    events_t* ev;
+    int64_t boot;           // microseconds
+    uint32_t first_ms;      // systemd took over from the kernel
+    uint32_t last_ms;
+} boot_ctx_t;
+
+static void boot_unit(void* ctx, const unit_graph_t* g, uint32_t u, uint32_t start_ms, uint32_t done_ms, int32_t main_pid) {
+    boot_ctx_t* b = ctx;
+
+    unit_lines(b->ev, b->boot + start_ms * 1000LL, b->boot + done_ms * 1000LL, unit_str(g, g->units[u].name),
+               unit_str(g, g->units[u].description), SDJ_UNIT_START, main_pid);
+    if (start_ms < b->first_ms) b->first_ms = start_ms;
+    if (done_ms > b->last_ms) b->last_ms = done_ms;
+}
+
+// The boot: the kernel, then systemd's transaction to default.target
+static time_t write_boot(sdj_t* j) {
+    events_t ev = { NULL, 0, 0 };
+    boot_ctx_t b = { &ev, 0, UINT32_MAX, 0 };
+    time_t boot = systemd_session_boot(boot_unit, &b);
+    uint32_t i, kernel_ms;
+
+    // systemd_session_boot() saw the boot time only once it had run
+    b.boot = boot * USEC;
+    for (i = 0; i < ev.n; i++) ev.items[i].usec += b.boot;
+    for (i = 0; i < sizeof(kernel_lines) / sizeof(kernel_lines[0]); i++) {
+        add_event(&ev, b.boot + kernel_lines[i].ms * 1000LL + i, kernel_lines[i].priority, NULL, "kernel", 0, "%s",
+                  kernel_lines[i].message);
+    }
+    kernel_ms = b.first_ms == UINT32_MAX ? 0 : b.first_ms;
+    add_event(&ev, b.boot + kernel_ms * 1000LL - 4, SDJ_INFO, NULL, "systemd", 1,
+              "systemd 252.17-1~deb12u1 running in system mode (+PAM +AUDIT +SELINUX +APPARMOR +IMA +SMACK +SECCOMP "
+              "+GCRYPT -GNUTLS +OPENSSL +ACL +BLKID +CURL +ELFUTILS +FIDO2 +IDN2 -IDN +IPTC +KMOD +LIBCRYPTSETUP "
+              "+LIBFDISK +PCRE2 -PWQUALITY +P11KIT +QRENCODE +TPM2 +BZIP2 +LZ4 +XZ +ZLIB +ZSTD -BPF_FRAMEWORK "
+              "-XKBCOMMON +UTMP +SYSVINIT default-hierarchy=unified)");
+    add_event(&ev, b.boot + kernel_ms * 1000LL - 3, SDJ_INFO, NULL, "systemd", 1, "Detected virtualization oracle.");
+    add_event(&ev, b.boot + kernel_ms * 1000LL - 2, SDJ_INFO, NULL, "systemd", 1, "Detected architecture x86-64.");
+    add_event(&ev, b.boot + kernel_ms * 1000LL - 1, SDJ_INFO, NULL, "systemd", 1, "Hostname set to <" HOSTNAME ">.");
+    if (b.last_ms) {
+        add_event(&ev, b.boot + b.last_ms * 1000LL + 1, SDJ_INFO, NULL, "systemd", 1,
+                  "Startup finished in %u.%03us (kernel) + %u.%03us (userspace) = %u.%03us.", kernel_ms / 1000,
+                  kernel_ms % 1000, (b.last_ms - kernel_ms) / 1000, (b.last_ms - kernel_ms) % 1000, b.last_ms / 1000,
+                  b.last_ms % 1000);
+    }
+    sort_events(&ev);
+    for (i = 0; i < ev.n; i++) {
+        const event_t* e = &ev.items[i];
+
+        sdj_append(j, e->usec, e->priority, e->unit, e->ident, e->pid, e->message);
+    }
+    free(ev.items);
+    return boot + (b.last_ms > kernel_ms ? b.last_ms : kernel_ms) / 1000 + 1;
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Who is running, as the background writers need to know
+typedef struct {
+    int32_t sshd, cron, resolved, logind;
+    time_t login;           // when the learner's ssh session began, 0
+} machine_t;
+
+static int32_t find_process(const proc_table_t* pt, const char* cmd) {
+    size_t len = strlen(cmd);
+    uint32_t i;
+
+    for (i = 0; i < pt->count; i++) {
+        if (strncmp(proc_cmd(pt, (int)i), cmd, len) == 0) return pt->pid[i];
+    }
+    return 0;
+}
+
+static void look_around(machine_t* m) {
+    const proc_table_t* pt = proc_session();
+    int i = proc_find(pt, 1201);
+
+    m->sshd = find_process(pt, "/usr/sbin/sshd");
+    m->cron = find_process(pt, "/usr/sbin/cron");
+    m->resolved = find_process(pt, "/lib/systemd/systemd-resolved");
+    m->logind = find_process(pt, "/lib/systemd/systemd-logind");
+    m->login = i >= 0 && pt->start[i] > pt->boot ? pt->start[i] : 0;
+}
+
+// Short-lived children (cron jobs, sshd's per-connection processes) get
+// pids from the minute they run in
+static int32_t child_pid(uint64_t minute, uint32_t k) {
+    return (int32_t)(2000 + (minute * 7 + k) % 28000);
+}
+
+static const char* const guessed_users[] = {
+    "root", "admin", "test", "ubuntu", "oracle", "postgres", "user", "git", "guest", "ftpuser", "pi", "deploy",
+};
+
+// Everything the machine logs in one minute (seconds since the epoch
+// minute * 60 on), in time order
+static void minute_events(const machine_t* m, uint64_t minute, events_t* ev) {
+    uint64_t h = mix(minute ^ 0x5DEECE66Dull);
+    int64_t at = (int64_t)minute * 60 * USEC;
+    uint32_t roll = (uint32_t)(h % 1000);
+
+    ev->n = 0;
+    if (minute % 60 == 17 && m->cron) {
+        int32_t pid = child_pid(minute, 0);
+
+        add_event(ev, at + 1 * USEC + 14211, SDJ_INFO, "cron.service", "CRON", pid,
+                  "pam_unix(cron:session): session opened for user root(uid=0) by (uid=0)");
+        add_event(ev, at + 1 * USEC + 15030, SDJ_INFO, "cron.service", "CRON", child_pid(minute, 1),
+                  "(root) CMD (cd / && run-parts --report /etc/cron.hourly)");
+        add_event(ev, at + 1 * USEC + 21877, SDJ_INFO, "cron.service", "CRON", pid,
+                  "pam_unix(cron:session): session closed for user root");
+    }
+    if (minute % 1440 == 0) {
+        unit_lines(ev, at + 3112, at + 180455, "logrotate.service", "Rotate log files", SDJ_UNIT_START, 0);
+        // A oneshot finishes rather than starts
+        strcpy(ev->items[ev->n - 1].message, "Finished logrotate.service - Rotate log files.");
+        add_event(ev, at + 180001, SDJ_INFO, "logrotate.service", "systemd", 1, "logrotate.service: Deactivated successfully.");
+    }
+    if (m->sshd && roll < 60) {
+        // Someone guessing passwords: a handful of tries from one address
+        const char* user = guessed_users[(h >> 12) % (sizeof(guessed_users) / sizeof(guessed_users[0]))];
+        uint32_t ip = (uint32_t)(h >> 24), port = 30000 + (uint32_t)((h >> 40) % 35000), tries = 1 + (uint32_t)((h >> 56) % 4), t;
+        int64_t when = at + (int64_t)((h >> 16) % 45) * USEC + (int64_t)(h % 997) * 1000;
+        int32_t pid = child_pid(minute, 2);
+        char addr[16];
+
+        snprintf(addr, sizeof(addr), "%u.%u.%u.%u", 45 + (ip >> 24) % 180, (ip >> 16) & 255, (ip >> 8) & 255, 1 + ip % 254);
+        if (strcmp(user, "root") == 0) {
+            for (t = 0; t < tries + 2; t++) {
+                add_event(ev, when + t * 2 * USEC, SDJ_INFO, "ssh.service", "sshd", pid,
+                          "Failed password for root from %s port %u ssh2", addr, port);
+            }
+            add_event(ev, when + t * 2 * USEC, SDJ_ERR, "ssh.service", "sshd", pid,
+                      "error: maximum authentication attempts exceeded for root from %s port %u ssh2 [preauth]", addr, port);
+            add_event(ev, when + t * 2 * USEC + 310, SDJ_INFO, "ssh.service", "sshd", pid,
+                      "Disconnecting authenticating user root %s port %u: Too many authentication failures [preauth]", addr,
+                      port);
+        } else {
+            add_event(ev, when, SDJ_INFO, "ssh.service", "sshd", pid, "Invalid user %s from %s port %u", user, addr, port);
+            for (t = 0; t < tries; t++) {
+                add_event(ev, when + (t * 2 + 2) * USEC, SDJ_INFO, "ssh.service", "sshd", pid,
+                          "Failed password for invalid user %s from %s port %u ssh2", user, addr, port);
+            }
+            add_event(ev, when + (t * 2 + 3) * USEC, SDJ_INFO, "ssh.service", "sshd", pid,
+                      "Connection closed by invalid user %s %s port %u [preauth]", user, addr, port);
+        }
+    } else if (m->sshd && roll < 80) {
+        // A scanner that connects and hangs up
+        uint32_t ip = (uint32_t)(h >> 20);
+        int64_t when = at + (int64_t)((h >> 8) % 58) * USEC + (int64_t)(h % 991) * 1000;
+        char addr[16];
+
+        snprintf(addr, sizeof(addr), "%u.%u.%u.%u", 60 + (ip >> 24) % 160, (ip >> 16) & 255, (ip >> 8) & 255, 1 + ip % 254);
+        add_event(ev, when, SDJ_ERR, "ssh.service", "sshd", child_pid(minute, 3),
+                  "error: kex_exchange_identification: Connection closed by remote host");
+        add_event(ev, when + 52, SDJ_INFO, "ssh.service", "sshd", child_pid(minute, 3), "Connection closed by %s port %u", addr,
+                  40000 + (uint32_t)(h >> 48) % 20000);
+    } else if (m->resolved && roll < 84) {
+        add_event(ev, at + (int64_t)((h >> 8) % 60) * USEC, SDJ_WARNING, "systemd-resolved.service", "systemd-resolved",
+                  m->resolved, "Using degraded feature set UDP instead of UDP+EDNS0 for DNS server 192.168.1.1.");
+    }
+
+    // The learner's own login, the one the process table still has
+    if (m->login && m->login / 60 == (time_t)minute) {
+        int64_t when = (int64_t)m->login * USEC;
+
+        add_event(ev, when - 600000, SDJ_INFO, "ssh.service", "sshd", 1201,
+                  "Accepted publickey for admin from 192.168.1.50 port 52344 ssh2: ED25519 "
+                  "SHA256:Yx3v0pQm8L7c2TQeZt1w8KfH5nB9sJd4rG6aVuEo2Ck");
+        add_event(ev, when - 590000, SDJ_INFO, "ssh.service", "sshd", 1201,
+                  "pam_unix(sshd:session): session opened for user admin(uid=1000) by (uid=0)");
+        if (m->logind) {
+            add_event(ev, when - 580000, SDJ_INFO, "systemd-logind.service", "systemd-logind", m->logind,
+                      "New session 3 of user admin.");
+        }
+        add_event(ev, when - 570000, SDJ_INFO, "session-3.scope", "systemd", 1, "Started session-3.scope - Session 3 of User admin.");
+    }
+    sort_events(ev);
+}
+
+// Write the machine's background up to (not including) second to
+static void catch_up(sdj_t* j, time_t to) {
+    events_t ev = { NULL, 0, 0 };
+    machine_t m;
+    uint64_t minute;
+    uint32_t i;
+
+    if (to <= j->written) return;
+    look_around(&m);
+    for (minute = (uint64_t)j->written / 60; (time_t)(minute * 60) < to; minute++) {
+        minute_events(&m, minute, &ev);
+        for (i = 0; i < ev.n; i++) {
+            const event_t* e = &ev.items[i];
+
+            if (e->usec < (int64_t)j->written * USEC || e->usec >= (int64_t)to * USEC) continue;
+            sdj_append(j, e->usec, e->priority, e->unit, e->ident, e->pid, e->message);
+        }
+    }
+    free(ev.items);
+    j->written = to;
+}
+
+// Unit events that arrive while the journal is being seeded (systemd
+// noticing a dead service while it reports the boot) wait until the
+// history before them is in
+static __thread struct {
+    char unit[128];
+    char description[128];
+    sdj_unit_event_t event;
+    int32_t pid;
+    time_t at;
+} pending[MAX_PENDING];
+static __thread uint32_t n_pending;
+static __thread int seeding;
+
+static void write_unit_event(sdj_t* j, time_t at, const char* unit, const char* description, sdj_unit_event_t event,
+                             int32_t pid) {
+    events_t ev = { NULL, 0, 0 };
+    int64_t usec = (int64_t)at * USEC + 412000;
+    uint32_t i;
+
+    unit_lines(&ev, usec, usec + 35000, unit, description, event, pid);
+    sort_events(&ev);
+    for (i = 0; i < ev.n; i++) {
+        const event_t* e = &ev.items[i];
+
+        sdj_append(j, e->usec, e->priority, e->unit, e->ident, e->pid, e->message);
+    }
+    free(ev.items);
+}
+
+sdj_t* sdj_session(void) {
+    sim_env_t* env = sim_env();
+    uint32_t i;
+
+    if (!env->logs) {
+        env->logs = sdj_new();
+        seeding = 1;
+        env->logs->written = write_boot(env->logs);
+        catch_up(env->logs, env->clock);
+        seeding = 0;
+        for (i = 0; i < n_pending; i++) {
+            write_unit_event(env->logs, pending[i].at, pending[i].unit, pending[i].description, pending[i].event,
+                             pending[i].pid);
+        }
+        n_pending = 0;
+    }
+    if (!seeding) catch_up(env->logs, env->clock);
+    return env->logs;
+}
+
+void sdj_unit_event(const char* unit, const char* description, sdj_unit_event_t event, int32_t main_pid) {
+    sim_env_t* env = sim_env();
+    sdj_t* j;
+
+    if (seeding) {
+        if (n_pending < MAX_PENDING) {
+            snprintf(pending[n_pending].unit, sizeof(pending[n_pending].unit), "%s", unit);
+            snprintf(pending[n_pending].description, sizeof(pending[n_pending].description), "%s",
+                     description ? description : "");
+            pending[n_pending].event = event;
+            pending[n_pending].pid = main_pid;
+            pending[n_pending].at = env->clock;
+            n_pending++;
+        }
+        return;
+    }
+    j = sdj_session();
+    write_unit_event(j, env->clock, unit, description, event, main_pid);
+}
+
+// ---------------------------------------------------------------------
+// Output
+
+typedef enum {
+    OUT_SHORT,
+    OUT_SHORT_ISO,
+    OUT_SHORT_PRECISE,
+    OUT_CAT,
+    OUT_VERBOSE,
+    OUT_JSON
+} output_t;
+
+typedef struct {
+    output_t output;
+    long lines, limit;
+} printer_t;
+
+static void json_string(char* out, size_t len, size_t* at, const char* s) {
+    *at += (size_t)snprintf(out + *at, *at < len ? len - *at : 0, "\"");
+    for (; *s && *at + 8 < len; s++) {
+        if (*s == '"' || *s == '\\') {
+            out[(*at)++] = '\\';
+            out[(*at)++] = *s;
+        } else if ((unsigned char)*s < 0x20) {
+            *at += (size_t)snprintf(out + *at, len - *at, "\\u%04x", *s);
+        } else {
+            out[(*at)++] = *s;
+        }
+    }
+    *at += (size_t)snprintf(out + *at, *at < len ? len - *at : 0, "\"");
+}
+
+// Print an entry; nonzero once no more lines are wanted
+static int print_entry(printer_t* p, const sdj_t* j, uint32_t e) {
+    char line[LINE_MAX_LEN * 2], when[64];
+    time_t secs = (time_t)(j->usec[e] / USEC);
+    long usec = (long)(j->usec[e] % USEC);
+    const char* ident = sdj_value(j, j->ident[e]);
+    struct tm tm;
+    size_t len = 0;
+
+    gmtime_r(&secs, &tm);
+    switch (p->output) {
+        case OUT_CAT:
+            len = (size_t)snprintf(line, sizeof(line), "%s\n", sdj_value(j, j->message[e]));
+            break;
+        case OUT_VERBOSE:
+            strftime(when, sizeof(when), "%a %Y-%m-%d %H:%M:%S", &tm);
+            len = (size_t)snprintf(line, sizeof(line),
+                                   "%s.%06ld UTC [s=" BOOT_ID ";i=%x;b=" BOOT_ID ";t=%llx]\n    PRIORITY=%u\n", when,
+                                   usec, e + 1, (unsigned long long)j->usec[e], j->priority[e]);
+            if (j->unit[e] != SDJ_NONE) {
+                len += (size_t)snprintf(line + len, sizeof(line) - len, "    %s=%s\n",
+                                        j->pid[e] == 1 ? "UNIT" : "_SYSTEMD_UNIT", sdj_value(j, j->unit[e]));
+            }
+            len += (size_t)snprintf(line + len, sizeof(line) - len, "    SYSLOG_IDENTIFIER=%s\n", ident);
+            if (j->pid[e] > 0) len += (size_t)snprintf(line + len, sizeof(line) - len, "    _PID=%d\n", j->pid[e]);
+            len += (size_t)snprintf(line + len, sizeof(line) - len, "    _HOSTNAME=" HOSTNAME "\n    MESSAGE=%s\n",
+                                    sdj_value(j, j->message[e]));
+            break;
+        case OUT_JSON:
+            len = (size_t)snprintf(line, sizeof(line), "{\"__REALTIME_TIMESTAMP\":\"%lld\",\"_BOOT_ID\":\"" BOOT_ID
+                                   "\",\"PRIORITY\":\"%u\",", (long long)j->usec[e], j->priority[e]);
+            if (j->unit[e] != SDJ_NONE) {
+                len += (size_t)snprintf(line + len, sizeof(line) - len, "\"%s\":",
+                                        j->pid[e] == 1 ? "UNIT" : "_SYSTEMD_UNIT");
+                json_string(line, sizeof(line), &len, sdj_value(j, j->unit[e]));
+                len += (size_t)snprintf(line + len, sizeof(line) - len, ",");
+            }
+            len += (size_t)snprintf(line + len, sizeof(line) - len, "\"SYSLOG_IDENTIFIER\":");
+            json_string(line, sizeof(line), &len, ident);
+            if (j->pid[e] > 0) len += (size_t)snprintf(line + len, sizeof(line) - len, ",\"_PID\":\"%d\"", j->pid[e]);
+            len += (size_t)snprintf(line + len, sizeof(line) - len, ",\"_HOSTNAME\":\"" HOSTNAME "\",\"MESSAGE\":");
+            json_string(line, sizeof(line), &len, sdj_value(j, j->message[e]));
+            len += (size_t)snprintf(line + len, sizeof(line) - len, "}\n");
+            break;
+        default:
+            if (p->output == OUT_SHORT_ISO) {
+                strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S+0000", &tm);
+            } else if (p->output == OUT_SHORT_PRECISE) {
+                strftime(when, sizeof(when), "%b %d %H:%M:%S", &tm);
+                snprintf(when + strlen(when), sizeof(when) - strlen(when), ".%06ld", usec);
+            } else {
+                strftime(when, sizeof(when), "%b %d %H:%M:%S", &tm);
+            }
+            if (j->pid[e] > 0) {
+                len = (size_t)snprintf(line, sizeof(line), "%s " HOSTNAME " %s[%d]: %s\n", when, ident, j->pid[e],
+                                       sdj_value(j, j->message[e]));
+            } else {
+                len = (size_t)snprintf(line, sizeof(line), "%s " HOSTNAME " %s: %s\n", when, ident, sdj_value(j, j->message[e]));
+            }
+            break;
+    }
+    if (len >= sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+    con_write(line, len);
+    p->lines++;
+    return (p->limit >= 0 && p->lines >= p->limit) || con_stopped();
+}
+
+// The last n matches, oldest first; from is where to look from
+static uint32_t print_tail(printer_t* p, const sdj_t* j, const sdj_query_t* q, uint32_t n, const char* grep) {
+    uint32_t* last = xrealloc(NULL, (n ? n : 1) * sizeof(uint32_t)), found = 0, e, i;
+    sdj_iter_t it;
+
+    sdj_iter_init(&it, j, q, 0, 1);
+    while (found < n && (e = sdj_iter_next(&it)) != SDJ_NONE) {
+        if (grep && !strcasestr(sdj_value(j, j->message[e]), grep)) continue;
+        last[found++] = e;
+    }
+    for (i = found; i-- > 0;) {
+        if (print_entry(p, j, last[i])) break;
+    }
+    free(last);
+    return found;
+}
+
+// Whether the user sees the system journal: root, adm, systemd-journal
+static int may_read(sim_env_t* env) {
+    perm_cred_t c;
+    uint32_t gid;
+
+    if (env->euid == 0) return 1;
+    perm_cred_env(env, &c);
+    return (nss_group_id("adm", &gid) == 0 && perm_in_group(&c, gid)) ||
+           (nss_group_id("systemd-journal", &gid) == 0 && perm_in_group(&c, gid));
+}
+
+void sdj_print_unit(const char* unit, uint32_t lines) {
+    const sdj_t* j;
+    printer_t p = { OUT_SHORT, 0, -1 };
+    sdj_query_t q;
+    sdj_iter_t it;
+
+    if (!may_read(sim_env())) return;
+    j = sdj_session();
+    sdj_query_init(&q);
+    q.units[q.n_units++] = unit;
+    sdj_iter_init(&it, j, &q, 0, 1);
+    if (sdj_iter_next(&it) == SDJ_NONE) return;
+    con_printf("\n");
+    print_tail(&p, j, &q, lines, NULL);
+}
+
+// ---------------------------------------------------------------------
+// journalctl
+
+static int parse_priority(const char* s, uint8_t* value) {
+    char* end;
+    long n;
+    int i;
+
+    for (i = 0; i < SDJ_PRIORITIES; i++) {
+        if (strcmp(s, priority_names[i]) == 0) {
+            *value = (uint8_t)i;
+            return 0;
+        }
+    }
+    n = strtol(s, &end, 10);
+    if (*end || end == s || n < 0 || n >= SDJ_PRIORITIES) return -1;
+    *value = (uint8_t)n;
+    return 0;
+}
+
+// "err" is 0..3; "warning..err" and "3..4" are ranges either way round
+static int parse_priorities(const char* s, sdj_query_t* q) {
+    const char* dots = strstr(s, "..");
+    char first[32];
+    uint8_t a, b;
+
+    if (!dots) {
+        if (parse_priority(s, &b) != 0) return -1;
+        q->min_priority = 0;
+        q->max_priority = b;
+        return 0;
+    }
+    if ((size_t)(dots - s) >= sizeof(first)) return -1;
+    memcpy(first, s, (size_t)(dots - s));
+    first[dots - s] = '\0';
+    if (parse_priority(first, &a) != 0 || parse_priority(dots + 2, &b) != 0) return -1;
+    q->min_priority = a < b ? a : b;
+    q->max_priority = a < b ? b : a;
+    return 0;
+}
+
+static int64_t unit_seconds(const char* s, size_t len) {
+    static const struct {
+        const char* name;
+        int64_t seconds;
+    } units[] = {
+        { "s", 1 }, { "sec", 1 }, { "second", 1 }, { "seconds", 1 }, { "m", 60 }, { "min", 60 }, { "minute", 60 },
+        { "minutes", 60 }, { "h", 3600 }, { "hr", 3600 }, { "hour", 3600 }, { "hours", 3600 }, { "d", 86400 },
+        { "day", 86400 }, { "days", 86400 }, { "w", 604800 }, { "week", 604800 }, { "weeks", 604800 },
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+        if (strlen(units[i].name) == len && strncmp(units[i].name, s, len) == 0) return units[i].seconds;
+    }
+    return 0;
+}
+
+// "-1h", "2 hours ago", "+5min", "1h 30min ago": seconds, or -1
+static int parse_span(const char* s, int64_t* out) {
+    int64_t total = 0;
+    int parts = 0;
+
+    while (*s) {
+        char* end;
+        long long n;
+        size_t len;
+        int64_t unit;
+
+        while (*s == ' ') s++;
+        if (!*s) break;
+        n = strtoll(s, &end, 10);
+        if (end == s || n < 0) return -1;
+        s = end;
+        while (*s == ' ') s++;
+        len = strspn(s, "abcdefghijklmnopqrstuvwxyz");
+        unit = len ? unit_seconds(s, len) : 1;
+        if (!unit) return -1;
+        total += n * unit;
+        s += len;
+        parts++;
+    }
+    if (!parts) return -1;
+    *out = total;
+    return 0;
+}
+
+// --since/--until as systemd.time(7) has them, in the machine's UTC
+static int parse_time(const char* s, time_t now, int64_t* usec) {
+    struct tm tm;
+    size_t len = strlen(s);
+    int64_t span;
+    time_t day = now - now % 86400;
+    int y, mo = 1, d = 1, h = 0, mi = 0, sec = 0, n;
+
+    if (strcmp(s, "now") == 0) {
+        *usec = (int64_t)now * USEC;
+        return 0;
+    }
+    if (strcmp(s, "today") == 0 || strcmp(s, "yesterday") == 0 || strcmp(s, "tomorrow") == 0) {
+        *usec = ((int64_t)day + (s[0] == 'y' ? -86400 : s[1] == 'o' && s[2] == 'm' ? 86400 : 0)) * USEC;
+        return 0;
+    }
+    if (len > 4 && strcmp(s + len - 4, " ago") == 0) {
+        char spec[64];
+
+        if (len - 4 >= sizeof(spec)) return -1;
+        memcpy(spec, s, len - 4);
+        spec[len - 4] = '\0';
+        if (parse_span(spec, &span) != 0) return -1;
+        *usec = ((int64_t)now - span) * USEC;
+        return 0;
+    }
+    if (s[0] == '-' || s[0] == '+') {
+        if (parse_span(s + 1, &span) != 0) return -1;
+        *usec = ((int64_t)now + (s[0] == '-' ? -span : span)) * USEC;
+        return 0;
+    }
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s, "%d-%d-%d%n", &y, &mo, &d, &n) == 3 && (s[n] == '\0' || s[n] == ' ' || s[n] == 'T')) {
+        const char* clock = s + n;
+
+        if (*clock && sscanf(clock + 1, "%d:%d%n", &h, &mi, &n) >= 2) {
+            if (clock[1 + n] == ':' && sscanf(clock + 2 + n, "%d", &sec) != 1) return -1;
+        } else if (*clock) {
+            return -1;
+        }
+        tm.tm_year = y - 1900;
+        tm.tm_mon = mo - 1;
+        tm.tm_mday = d;
+    } else if (sscanf(s, "%d:%d%n", &h, &mi, &n) == 2) {
+        if (s[n] == ':' && sscanf(s + n + 1, "%d", &sec) != 1) return -1;
+        gmtime_r(&day, &tm);
+    } else {
+        return -1;
+    }
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h < 0 || h > 23 || mi < 0 || mi > 59 || sec < 0 || sec > 60) return -1;
+    tm.tm_hour = h;
+    tm.tm_min = mi;
+    tm.tm_sec = sec;
+    *usec = (int64_t)timegm(&tm) * USEC;
+    return 0;
+}
+
+// "ssh" is ssh.service; "sshd" is its alias
+static void unit_arg(const char* arg, char* name, size_t len) {
+    const unit_graph_t* g = systemd_shared();
+    uint32_t u;
+
+    snprintf(name, len, strchr(arg, '.') ? "%s" : "%s.service", arg);
+    if (g && (u = systemd_find(g, name, strlen(name))) != UNIT_NONE) snprintf(name, len, "%s", unit_str(g, g->units[u].name));
+}
+
+static void format_size(uint64_t bytes, char* buf, size_t len) {
+    if (bytes < (1ull << 20)) {
+        snprintf(buf, len, "%.1fK", bytes / 1024.0);
+    } else if (bytes < (1ull << 30)) {
+        snprintf(buf, len, "%.1fM", bytes / (1024.0 * 1024.0));
+    } else {
+        snprintf(buf, len, "%.1fG", bytes / (1024.0 * 1024.0 * 1024.0));
+    }
+}
+
+int sdj_cmd_journalctl(int argc, char** argv) {
+    static const struct {
+        const char* name;
+        output_t output;
+    } outputs[] = {
+        { "short", OUT_SHORT }, { "short-iso", OUT_SHORT_ISO }, { "short-precise", OUT_SHORT_PRECISE },
+        { "cat", OUT_CAT }, { "verbose", OUT_VERBOSE }, { "json", OUT_JSON },
+    };
+    sim_env_t* env = sim_env();
+    char units[SDJ_MAX_MATCH][128];
+    const char* since = NULL;
+    const char* until = NULL;
+    const char* grep = NULL;
+    const char* ident = NULL;
+    int follow = 0, reverse = 0, quiet = 0, disk_usage = 0, list_boots = 0, i;
+    long lines = -1;
+    printer_t p = { OUT_SHORT, 0, -1 };
+    uint32_t found = 0, e;
+    sdj_query_t q;
+    sdj_iter_t it;
+    sdj_t* j;
+
+    sdj_query_init(&q);
+    for (i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = NULL;
+        const char* eq;
+        char opt = 0;
+
+        if (strcmp(arg, "--") == 0) return -1;
+        if (strncmp(arg, "--", 2) == 0) {
+            static const struct {
+                const char* name;
+                char opt;
+            } longs[] = {
+                { "unit", 'u' }, { "priority", 'p' }, { "lines", 'n' }, { "follow", 'f' }, { "reverse", 'r' },
+                { "output", 'o' }, { "identifier", 't' }, { "since", 'S' }, { "until", 'U' }, { "grep", 'g' },
+                { "dmesg", 'k' }, { "boot", 'b' }, { "catalog", 'x' }, { "pager-end", 'e' }, { "quiet", 'q' },
+                { "no-pager", 0 }, { "full", 0 }, { "all", 0 }, { "no-hostname", 0 }, { "utc", 0 },
+                { "disk-usage", 'D' }, { "list-boots", 'L' }, { "system", 0 },
+            };
+            size_t k, len;
+
+            eq = strchr(arg, '=');
+            len = eq ? (size_t)(eq - arg - 2) : strlen(arg + 2);
+            for (k = 0; k < sizeof(longs) / sizeof(longs[0]); k++) {
+                if (strlen(longs[k].name) == len && strncmp(longs[k].name, arg + 2, len) == 0) break;
+            }
+            if (k == sizeof(longs) / sizeof(longs[0])) return -1;
+            opt = longs[k].opt;
+            if (!opt) continue;
+            if (opt == 'D') {
+                disk_usage = 1;
+                continue;
+            }
+            if (opt == 'L') {
+                list_boots = 1;
+                continue;
+            }
+            if (strchr("upnotSUg", opt)) {
+                value = eq ? eq + 1 : i + 1 < argc ? argv[++i] : NULL;
+                if (!value && opt != 'n') {
+                    con_printf("journalctl: option '--%.*s' requires an argument\n", (int)len, arg + 2);
+                    return 1;
+                }
+            } else if (eq) {
+                value = eq + 1;
+            }
+            arg = NULL;
+        } else if (arg[0] == '-' && arg[1]) {
+            arg++;
+        } else if ((eq = strchr(arg, '=')) != NULL) {
+            // FIELD=VALUE matches
+            char* end;
+
+            if (strncmp(arg, "_SYSTEMD_UNIT=", 14) == 0 || strncmp(arg, "UNIT=", 5) == 0) {
+                if (q.n_units < SDJ_MAX_MATCH) {
+                    snprintf(units[q.n_units], sizeof(units[0]), "%s", eq + 1);
+                    q.units[q.n_units] = units[q.n_units];
+                    q.n_units++;
+                }
+            } else if (strncmp(arg, "_PID=", 5) == 0) {
+                long pid = strtol(eq + 1, &end, 10);
+
+                if (*end || end == eq + 1) {
+                    con_printf("Failed to add match '%s': Invalid argument\n", arg);
+                    return 1;
+                }
+                if (q.n_pids < SDJ_MAX_MATCH) q.pids[q.n_pids++] = (int32_t)pid;
+            } else if (strncmp(arg, "PRIORITY=", 9) == 0) {
+                uint8_t pr;
+
+                if (parse_priority(eq + 1, &pr) != 0) {
+                    q.min_priority = 1;
+                    q.max_priority = 0;
+                } else {
+                    q.min_priority = q.max_priority = pr;
+                }
+            } else if (strncmp(arg, "SYSLOG_IDENTIFIER=", 18) == 0) {
+                ident = eq + 1;
+            } else {
+                // A field no entry here has
+                q.min_priority = 1;
+                q.max_priority = 0;
+            }
+            continue;
+        } else {
+            con_printf("Failed to add match '%s': Invalid argument\n", arg);
+            return 1;
+        }
+
+        // Short options, clustered ("-xeu ssh"); value options take the
+        // rest of the word or the next one
+        for (; opt || (arg && *arg); arg = arg ? arg + 1 : NULL) {
+            char c = opt ? opt : *arg;
+
+            opt = 0;
+            if (arg && strchr("upnotSUg", c) && !value) {
+                if (arg[1]) {
+                    value = arg + 1;
+                } else if (c == 'n') {
+                    if (i + 1 < argc && (isdigit((unsigned char)argv[i + 1][0]) || strcmp(argv[i + 1], "all") == 0)) {
+                        value = argv[++i];
+                    }
+                } else if (i + 1 < argc) {
+                    value = argv[++i];
+                } else {
+                    con_printf("journalctl: option requires an argument -- '%c'\n", c);
+                    return 1;
+                }
+                arg = NULL;
+            }
+            switch (c) {
+                case 'u':
+                    if (q.n_units < SDJ_MAX_MATCH) {
+                        unit_arg(value, units[q.n_units], sizeof(units[0]));
+                        q.units[q.n_units] = units[q.n_units];
+                        q.n_units++;
+                    }
+                    break;
+                case 'p':
+                    if (parse_priorities(value, &q) != 0) {
+                        con_printf("Unknown log level %s\n", value);
+                        return 1;
+                    }
+                    break;
+                case 'n':
+                    lines = !value ? DEFAULT_LINES : strcmp(value, "all") == 0 ? -1 : atol(value);
+                    if (value && strcmp(value, "all") != 0 && lines < 0) lines = DEFAULT_LINES;
+                    break;
+                case 'o': {
+                    size_t k;
+
+                    for (k = 0; k < sizeof(outputs) / sizeof(outputs[0]); k++) {
+                        if (strcmp(outputs[k].name, value) == 0) break;
+                    }
+                    if (k == sizeof(outputs) / sizeof(outputs[0])) {
+                        con_printf("Unknown output format '%s'.\n", value);
+                        return 1;
+                    }
+                    p.output = outputs[k].output;
+                    break;
+                }
+                case 't':
+                    ident = value;
+                    break;
+                case 'S':
+                    since = value;
+                    break;
+                case 'U':
+                    until = value;
+                    break;
+                case 'g':
+                    grep = value;
+                    break;
+                case 'f':
+                    follow = 1;
+                    break;
+                case 'r':
+                    reverse = 1;
+                    break;
+                case 'k':
+                    ident = "kernel";
+                    break;
+                case 'e':
+                    if (lines < 0) lines = JUMP_LINES;
+                    break;
+                case 'q':
+                    quiet = 1;
+                    break;
+                case 'b':
+                    // One boot: this one, however it is named
+                    if (value || (arg && arg[1])) {
+                        const char* id = value ? value : arg + 1;
+
+                        if (strcmp(id, "0") != 0 && strcmp(id, "-0") != 0 && strcmp(id, BOOT_ID) != 0) {
+                            con_printf("Data from the specified boot (%s) is not available: No such boot ID in journal\n", id);
+                            return 1;
+                        }
+                        arg = NULL;
+                    } else if (i + 1 < argc && (strcmp(argv[i + 1], "0") == 0 || strcmp(argv[i + 1], "-0") == 0)) {
+                        i++;
+                    } else if (i + 1 < argc && argv[i + 1][0] == '-' && isdigit((unsigned char)argv[i + 1][1])) {
+                        con_printf("Data from the specified boot (%s) is not available: No such boot ID in journal\n",
+                                   argv[i + 1]);
+                        return 1;
+                    }
+                    break;
+                case 'x':
+                case 'a':
+                case 'l':
+                    break;
+                default:
+                    return -1;
+            }
+            value = NULL;
+            if (!arg) break;
+        }
+    }
+
+    j = sdj_session();
+    if (disk_usage) {
+        char size[32];
+
+        format_size(j->bytes < FILE_STEP ? FILE_STEP : (j->bytes + FILE_STEP - 1) / FILE_STEP * FILE_STEP, size, sizeof(size));
+        con_printf("Archived and active journals take up %s in the file system.\n", size);
+        return 0;
+    }
+    if (list_boots) {
+        char first[64], last[64];
+        time_t a = j->count ? (time_t)(j->usec[0] / USEC) : env->clock, b = j->count ? (time_t)(j->usec[j->count - 1] / USEC) : env->clock;
+        struct tm tm;
+
+        strftime(first, sizeof(first), "%a %Y-%m-%d %H:%M:%S UTC", gmtime_r(&a, &tm));
+        strftime(last, sizeof(last), "%a %Y-%m-%d %H:%M:%S UTC", gmtime_r(&b, &tm));
+        con_printf("IDX BOOT ID                          FIRST ENTRY                 LAST ENTRY\n");
+        con_printf("  0 " BOOT_ID " %s %s\n", first, last);
+        return 0;
+    }
+    if (since && parse_time(since, env->clock, &q.since) != 0) {
+        con_printf("Failed to parse timestamp: %s\n", since);
+        return 1;
+    }
+    if (until && parse_time(until, env->clock, &q.until) != 0) {
+        con_printf("Failed to parse timestamp: %s\n", until);
+        return 1;
+    }
+    if (since && until && q.since > q.until) {
+        con_printf("--since= must be before --until=.\n");
+        return 1;
+    }
+    q.ident = ident;
+    p.limit = sim_line_limit();
+
+    if (!may_read(env)) {
+        // Only the user's own journal, and the learner's has nothing
+        if (!quiet) {
+            con_printf("Hint: You are currently not seeing messages from other users and the system.\n"
+                       "      Users in groups 'adm', 'systemd-journal' can see all messages.\n"
+                       "      Pass -q to turn off this notice.\n");
+        }
+        if (!follow) con_printf("-- No entries --\n");
+        return 0;
+    }
+
+    if (follow && lines < 0) lines = DEFAULT_LINES;
+    if (lines >= 0 && !reverse) {
+        found = print_tail(&p, j, &q, (uint32_t)lines, grep);
+    } else {
+        sdj_iter_init(&it, j, &q, 0, reverse);
+        while ((lines < 0 || found < (uint32_t)lines) && (e = sdj_iter_next(&it)) != SDJ_NONE) {
+            if (grep && !strcasestr(sdj_value(j, j->message[e]), grep)) continue;
+            found++;
+            if (print_entry(&p, j, e)) return 0;
+        }
+    }
+    if (!follow) {
+        if (!found) con_printf("-- No entries --\n");
+        return 0;
+    }
+
+    // Follow: the clock moves on a second at a time, and whatever the
+    // machine writes in it is shown as it is appended
+    for (i = 0; i < FOLLOW_SECONDS && !con_stopped(); i++) {
+        uint32_t seen = j->count;
+
+        env->clock++;
+        j = sdj_session();
+        sdj_iter_init(&it, j, &q, seen, 0);
+        while ((e = sdj_iter_next(&it)) != SDJ_NONE) {
+            if (grep && !strcasestr(sdj_value(j, j->message[e]), grep)) continue;
+            if (print_entry(&p, j, e)) return 0;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+static uint64_t bench_rng = 0x9E3779B97F4A7C15ull;
+
+#define BENCH_UNITS 400
+#define BENCH_PIDS 20000
+#define BENCH_MESSAGES 4096
+#define BENCH_QUERIES 2000
+
+// What a linear scan finds: how many entries match, and a checksum of
+// which
+static void scan_query(const sdj_t* j, const sdj_query_t* q, uint32_t* count, uint64_t* sum) {
+    uint32_t units[SDJ_MAX_MATCH], i, e, k;
+    int64_t lo = q->since, hi = q->until;
+
+    for (k = 0; k < q->n_units; k++) units[k] = find_value(j, q->units[k]);
+    *count = 0;
+    *sum = 0;
+    for (e = 0; e < j->count; e++) {
+        int ok = j->usec[e] >= lo && j->usec[e] <= hi && j->priority[e] >= q->min_priority &&
+                 j->priority[e] <= q->max_priority;
+
+        if (ok && q->n_units) {
+            for (k = 0; k < q->n_units && units[k] != j->unit[e]; k++) {}
+            ok = k < q->n_units && units[k] != SDJ_NONE;
+        }
+        if (ok && q->n_pids) {
+            for (i = 0; i < q->n_pids && q->pids[i] != j->pid[e]; i++) {}
+            ok = i < q->n_pids;
+        }
+        if (ok) {
+            (*count)++;
+            *sum += mix(e);
+        }
+    }
+}
+
+static void indexed_query(const sdj_t* j, const sdj_query_t* q, int reverse, uint32_t* count, uint64_t* sum) {
+    sdj_iter_t it;
+    uint32_t e;
+
+    sdj_iter_init(&it, j, q, 0, reverse);
+    *count = 0;
+    *sum = 0;
+    while ((e = sdj_iter_next(&it)) != SDJ_NONE) {
+        (*count)++;
+        *sum += mix(e);
+    }
+}
+
+// Unit, priority and time window, as in journalctl -u X -p err --since
+// --until, with a window of about span entries
+static void random_query(const sdj_t* j, char names[][32], sdj_query_t* q, uint32_t span) {
+    uint32_t start = bench_random(&bench_rng, j->count), end = start + span < j->count ? start + span : j->count - 1;
+
+    sdj_query_init(q);
+    q->units[q->n_units++] = names[bench_random(&bench_rng, BENCH_UNITS)];
+    q->max_priority = (uint8_t)(SDJ_ERR + bench_random(&bench_rng, 2));
+    q->since = j->usec[start];
+    q->until = j->usec[end];
+}
+
+int sdj_bench(int argc, char** argv) {
+    long n = argc > 0 ? atol(argv[0]) : 10000000;
+    static char names[BENCH_UNITS][32];
+    char** messages = xrealloc(NULL, BENCH_MESSAGES * sizeof(char*));
+    uint64_t sum_index, sum_scan, matched = 0;
+    uint32_t i, count_index, count_scan, failed = 0;
+    double start, elapsed;
+    int64_t usec = 1696729620LL * USEC;
+    sdj_query_t q;
+    sdj_iter_t it;
+    sdj_t* j;
+    int rc = 0;
+
+    if (n < 10000) n = 10000;
+    for (i = 0; i < BENCH_UNITS; i++) snprintf(names[i], sizeof(names[i]), "bench-%u.service", i);
+    for (i = 0; i < BENCH_MESSAGES; i++) {
+        char text[128];
+
+        snprintf(text, sizeof(text), "request %u from 10.%u.%u.%u took %u ms", i, i % 7, i % 13, i % 251, i * 37 % 5000);
+        messages[i] = strdup(text);
+    }
+
+    // Units and pids skewed as on a real machine: a few services write
+    // most of the lines
+    j = sdj_new();
+    start = bench_now();
+    for (i = 0; i < (uint32_t)n; i++) {
+        uint32_t r = bench_random(&bench_rng, 1000), unit = r < 600 ? bench_random(&bench_rng, 8) : r < 900 ? bench_random(&bench_rng, 64) : bench_random(&bench_rng, BENCH_UNITS);
+        uint32_t pr = bench_random(&bench_rng, 1000);
+        uint8_t priority = pr < 2 ? SDJ_CRIT : pr < 12 ? SDJ_ERR : pr < 52 ? SDJ_WARNING : pr < 150 ? SDJ_NOTICE : pr < 950 ? SDJ_INFO
+                                                                                                              : SDJ_DEBUG;
+
+        usec += bench_random(&bench_rng, 20000);
+        sdj_append(j, usec, priority, names[unit], "bench", (int32_t)(1000 + unit * 50 + bench_random(&bench_rng, 50)),
+                   messages[bench_random(&bench_rng, BENCH_MESSAGES)]);
+    }
+    elapsed = bench_now() - start;
+    bench_report("sdjournal", "entries", j->count, "entries");
+    bench_report("sdjournal", "ingest", n / elapsed / 1e6, "M entries/s");
+    bench_report("sdjournal", "values", j->n_values, "values");
+    bench_report("sdjournal", "lists", j->n_lists, "lists");
+
+    // -u X -p err over a window of a million entries
+    start = bench_now();
+    for (i = 0; i < BENCH_QUERIES; i++) {
+        random_query(j, names, &q, 1000000);
+        indexed_query(j, &q, 0, &count_index, &sum_index);
+        matched += count_index;
+    }
+    elapsed = bench_now() - start;
+    bench_report("sdjournal", "query_window", elapsed / BENCH_QUERIES * 1e6, "us");
+    bench_report("sdjournal", "query_matches", (double)matched / BENCH_QUERIES, "entries");
+
+    // -u X -p err over everything
+    start = bench_now();
+    for (i = 0; i < BENCH_QUERIES / 10; i++) {
+        random_query(j, names, &q, j->count);
+        q.since = INT64_MIN;
+        q.until = INT64_MAX;
+        indexed_query(j, &q, 0, &count_index, &sum_index);
+    }
+    elapsed = bench_now() - start;
+    bench_report("sdjournal", "query_all", elapsed / (BENCH_QUERIES / 10) * 1e6, "us");
+
+    // systemctl status: a unit's last ten lines
+    start = bench_now();
+    for (i = 0; i < BENCH_QUERIES * 10; i++) {
+        uint32_t k;
+
+        sdj_query_init(&q);
+        q.units[q.n_units++] = names[bench_random(&bench_rng, BENCH_UNITS)];
+        sdj_iter_init(&it, j, &q, 0, 1);
+        for (k = 0; k < DEFAULT_LINES && sdj_iter_next(&it) != SDJ_NONE; k++) {}
+    }
+    elapsed = bench_now() - start;
+    bench_report("sdjournal", "unit_tail", elapsed / (BENCH_QUERIES * 10) * 1e6, "us");
+
+    // _PID= and a time range
+    start = bench_now();
+    for (i = 0; i < BENCH_QUERIES; i++) {
+        uint32_t at = bench_random(&bench_rng, j->count);
+
+        sdj_query_init(&q);
+        q.pids[q.n_pids++] = j->pid[at];
+        q.since = j->usec[at];
+        q.until = j->usec[at] + 3600 * USEC;
+        indexed_query(j, &q, 0, &count_index, &sum_index);
+    }
+    elapsed = bench_now() - start;
+    bench_report("sdjournal", "query_pid", elapsed / BENCH_QUERIES * 1e6, "us");
+
+    // The same answers as a scan, forwards and backwards
+    for (i = 0; i < 6; i++) {
+        random_query(j, names, &q, i < 3 ? 1000000 : j->count);
+        if (i == 4) q.pids[q.n_pids++] = 1000 + (int32_t)bench_random(&bench_rng, BENCH_UNITS * 50);
+        if (i == 5) q.units[q.n_units++] = names[bench_random(&bench_rng, 8)];
+        start = bench_now();
+        scan_query(j, &q, &count_scan, &sum_scan);
+        elapsed = bench_now() - start;
+        if (i == 0) bench_report("sdjournal", "scan", elapsed * 1e3, "ms");
+        indexed_query(j, &q, i & 1, &count_index, &sum_index);
+        if (count_index != count_scan || sum_index != sum_scan) failed++;
+    }
+    if (failed) {
+        fprintf(stderr, "sdjournal: %u of 6 queries disagree with a scan\n", failed);
+        rc = 1;
+    }
+
+    // Follow: appends in small batches, each picked up by a waiting query
+    start = bench_now();
+    sdj_query_init(&q);
+    q.units[q.n_units++] = names[0];
+    matched = 0;
+    for (i = 0; i < 100000; i++) {
+        uint32_t seen = j->count, e;
+
+        usec += 1000;
+        sdj_append(j, usec, SDJ_INFO, names[bench_random(&bench_rng, 16)], "bench", 1000, messages[i % BENCH_MESSAGES]);
+        sdj_iter_init(&it, j, &q, seen, 0);
+        while ((e = sdj_iter_next(&it)) != SDJ_NONE) matched++;
+    }
+    elapsed = bench_now() - start;
+    bench_report("sdjournal", "follow", elapsed / 100000 * 1e9, "ns/entry");
+
+    for (i = 0; i < BENCH_MESSAGES; i++) free(messages[i]);
+    free(messages);
+    sdj_free(j);
+    return rc;
+}
@@ -0,0 +1,151 @@
+#ifndef SDJOURNAL_H
+#define SDJOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// The systemd journal of simulation mode: what journalctl reads, and the
+// log lines under systemctl status.
+//
+// Entries are only ever appended, in time order, into a column per field
+// (time, priority, pid, and the unit, identifier and message as value
+// ids), so a --since/--until range is two binary searches. Field values
+// are interned once, as journald keeps each distinct DATA object once.
+// The fields journalctl filters on have inverted indexes: for each unit,
+// each priority and each pid, the ascending list of the entries that
+// carry it. A query is a few constraints, each a union of lists ("-p err"
+// is priorities 0 to 3, two -u are either unit); the entries in all of
+// them are found by leapfrogging the lists with galloping searches inside
+// the time range, so the cost follows the shortest list rather than the
+// journal. systemd's own lines about a unit count as that unit's, since
+// journalctl -u shows them too.
+//
+// A session's journal starts as the seeded machine's week: the kernel and
+// systemd at boot (systemd.h's boot schedule), then cron, sshd turning
+// away password guessers and the learner's login, written minute by
+// minute from a hash of the minute so that the same history comes out
+// however it is caught up. Reading the journal first writes it up to the
+// session's clock; journalctl -f moves the clock a second at a time and
+// shows each second's entries as they are appended.
+
+#define SDJ_NONE UINT32_MAX
+#define SDJ_MAX_MATCH 8
+
+typedef enum {
+    SDJ_EMERG,
+    SDJ_ALERT,
+    SDJ_CRIT,
+    SDJ_ERR,
+    SDJ_WARNING,
+    SDJ_NOTICE,
+    SDJ_INFO,
+    SDJ_DEBUG,
+    SDJ_PRIORITIES
+} sdj_priority_t;
+
+typedef struct {
+    uint32_t* ids;          // entries, ascending
+    uint32_t n, cap;
+} sdj_list_t;
+
+typedef struct sdj_store {
+    // Entries, a column per field
+    int64_t* usec;          // realtime in microseconds, never decreasing
+    uint32_t* unit;         // value ids, SDJ_NONE when absent
+    uint32_t* ident;
+    uint32_t* message;
+    int32_t* pid;           // 0: none (the kernel)
+    uint8_t* priority;
+    uint32_t count, cap;
+
+    // Interned values
+    char* strings;
+    size_t strings_len, strings_cap;
+    uint32_t* values;       // offset of each value in strings
+    uint32_t* value_list;   // a unit value's list, SDJ_NONE
+    uint32_t n_values, values_cap;
+    uint32_t* value_slots;  // value id + 1, 0 = empty
+    uint32_t value_mask;
+
+    // Inverted indexes
+    sdj_list_t* lists;
+    uint32_t n_lists, lists_cap;
+    uint32_t by_priority[SDJ_PRIORITIES];   // list ids
+    uint32_t* pid_slots;    // list id + 1, found by the pid of its entries
+    uint32_t pid_mask, n_pids;
+
+    uint64_t bytes;         // what journald's files would take
+    time_t written;         // the seeded machine's history is in up to here
+} sdj_t;
+
+sdj_t* sdj_new(void);
+void sdj_free(sdj_t* j);
+
+// Append an entry (unit and ident may be NULL). A time before the last
+// entry's is raised to it. Returns the entry's index.
+uint32_t sdj_append(sdj_t* j, int64_t usec, uint8_t priority, const char* unit, const char* ident, int32_t pid,
+                    const char* message);
+// A value's text; "" for SDJ_NONE
+const char* sdj_value(const sdj_t* j, uint32_t id);
+
+typedef struct {
+    int64_t since, until;   // microseconds, both inclusive
+    const char* units[SDJ_MAX_MATCH];
+    uint32_t n_units;
+    int32_t pids[SDJ_MAX_MATCH];
+    uint32_t n_pids;
+    uint8_t min_priority, max_priority;     // "-p err": 0 and 3
+    const char* ident;      // -t, checked per entry; NULL for any
+} sdj_query_t;
+
+// An empty query: every entry
+void sdj_query_init(sdj_query_t* q);
+
+typedef struct {
+    const uint32_t* ids[SDJ_MAX_MATCH];
+    uint32_t n[SDJ_MAX_MATCH];
+    uint32_t pos[SDJ_MAX_MATCH];
+    uint32_t n_lists;
+} sdj_term_t;
+
+typedef struct {
+    const sdj_t* j;
+    uint32_t lo, hi;        // the time range's entries
+    sdj_term_t terms[3];    // units, priorities, pids
+    uint32_t n_terms;
+    uint32_t ident;         // SDJ_NONE: any
+    uint32_t next;          // forward: next candidate; reverse: one past it
+    int reverse;
+} sdj_iter_t;
+
+// Start a query at entry from (entries before it are not looked at),
+// oldest first or, with reverse, newest first
+void sdj_iter_init(sdj_iter_t* it, const sdj_t* j, const sdj_query_t* q, uint32_t from, int reverse);
+// The next matching entry, or SDJ_NONE
+uint32_t sdj_iter_next(sdj_iter_t* it);
+
+// The session's journal (see sim.h), written up to the session's clock
+sdj_t* sdj_session(void);
+
+// What systemd logs when a unit changes state (systemd.c); main_pid is
+// the service's process, 0 if it has none
+typedef enum {
+    SDJ_UNIT_START,
+    SDJ_UNIT_STOP,
+    SDJ_UNIT_RELOAD,
+    SDJ_UNIT_KILLED,        // the main process died behind systemd's back
+    SDJ_UNIT_RESTART        // ... and Restart= brought it back
+} sdj_unit_event_t;
+
+void sdj_unit_event(const char* unit, const char* description, sdj_unit_event_t event, int32_t main_pid);
+// The last lines of a unit's log, for systemctl status
+void sdj_print_unit(const char* unit, uint32_t lines);
+
+// Simulated command (see sim.c)
+int sdj_cmd_journalctl(int argc, char** argv);
+
+// --bench sdjournal [entries]
+int sdj_bench(int argc, char** argv);
+
+#endif
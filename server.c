@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "deb1.h"
+#include "console.h"
+#include "session.h"
+#include "server.h"
+#include "instr.h"
+
+#define MAX_EVENTS 256
+#define MAX_PENDING_OUTPUT (1 << 20)
+#define MIN_WORKERS 16
+
+// Lines are handled on a pool of worker threads, so a learner whose
+// command takes a while (a find over the whole tree, a journal query)
+// holds up one worker instead of every session. The epoll thread accepts,
+// reads and drops connections; one with a complete line leaves the epoll
+// set and goes to the pool, which handles that line, sends the response
+// and queues the connection again behind the others if another line is
+// waiting, or hands it back to the epoll thread. Only one thread ever
+// has a connection at a time.
+
+// One connected learner. The output buffer is only allocated while a
+// response is waiting to be sent, so an idle session costs sizeof(conn_t).
+typedef struct conn {
+    int fd;
+    uint32_t slot;          // index in the connection table
+    uint8_t framed;         // "#script" client: NUL after every response
+    uint8_t closing;        // close once the output has drained
+    uint8_t busy;           // with the pool, out of the epoll set
+    uint16_t in_len;        // bytes read and not yet handled
+    struct conn* next;      // in the work queue or the finished list
+    session_t session;
+    console_t con;
+    char in[MAX_INPUT];
+} conn_t;
+
+typedef struct {
+    conn_t** conns;
+    uint32_t count, cap, peak;
+    unsigned long accepted, finished, lines, bytes_in;
+    unsigned long long bytes_out;
+
+    // The pool takes connections from the queue and puts them on the
+    // finished list, waking the epoll thread through done_fd
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    conn_t *queue_head, *queue_tail, *finished_list;
+    int done_fd;
+    int stopping;
+    pthread_t* workers;
+    int n_workers;
+} server_t;
+
+static volatile sig_atomic_t stop_requested;
+static volatile sig_atomic_t stats_requested;
+
+static void on_stop(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void on_stats(int sig) {
+    (void)sig;
+    stats_requested = 1;
+}
+
+int server_parse_address(const char* address, void* sockaddr_out, unsigned* len_out, int* family_out) {
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un* un = sockaddr_out;
+        memset(un, 0, sizeof(*un));
+        un->sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(un->sun_path)) return -1;
+        strcpy(un->sun_path, address + 5);
+        *len_out = sizeof(*un);
+        *family_out = AF_UNIX;
+        return 0;
+    }
+    if (strncmp(address, "tcp:", 4) == 0) {
+        struct addrinfo hints, *res;
+        char host[256] = "127.0.0.1";
+        const char* port = address + 4;
+        const char* colon = strrchr(port, ':');
+
+        if (colon) {
+            size_t n = (size_t)(colon - port);
+            if (n >= sizeof(host)) return -1;
+            memcpy(host, port, n);
+            host[n] = '\0';
+            port = colon + 1;
+        }
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port, &hints, &res) != 0) return -1;
+        memcpy(sockaddr_out, res->ai_addr, res->ai_addrlen);
+        *len_out = (unsigned)res->ai_addrlen;
+        *family_out = res->ai_family;
+        freeaddrinfo(res);
+        return 0;
+    }
+    return -1;
+}
+
+static int open_listener(const char* address) {
+    struct sockaddr_storage addr;
+    unsigned len;
+    int family, fd, one = 1;
+
+    if (server_parse_address(address, &addr, &len, &family) < 0) {
+        fprintf(stderr, "Bad address '%s' (use unix:/path or tcp:[host:]port)\n", address);
+        return -1;
+    }
+    fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (family == AF_UNIX) {
+        unlink(((struct sockaddr_un*)&addr)->sun_path);
+    } else {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    if (bind(fd, (struct sockaddr*)&addr, len) < 0 || listen(fd, 4096) < 0) {
+        perror(address);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Allow a few thousand sockets without asking the operator to run ulimit
+static void raise_fd_limit(void) {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void print_stats(server_t* srv) {
+    size_t buffered = 0;
+    unsigned long lines;
+    uint32_t i;
+
+    // A connection the pool has is left out
+    for (i = 0; i < srv->count; i++) buffered += srv->conns[i]->busy ? 0 : srv->conns[i]->con.cap;
+    pthread_mutex_lock(&srv->lock);
+    lines = srv->lines;
+    pthread_mutex_unlock(&srv->lock);
+    fprintf(stderr, "sessions: %u active, %u peak, %lu accepted, %lu finished, %d workers\n",
+            srv->count, srv->peak, srv->accepted, srv->finished, srv->n_workers);
+    fprintf(stderr, "traffic: %lu lines, %lu bytes in, %llu bytes out\n",
+            lines, srv->bytes_in, srv->bytes_out);
+    fprintf(stderr, "memory: %zu bytes per idle session, %zu bytes of pending output\n",
+            sizeof(conn_t), buffered);
+}
+
+static void watch(int epfd, conn_t* c, int op) {
+    struct epoll_event ev;
+
+    // A finished session only waits for its output to drain
+    ev.events = (c->closing ? 0 : EPOLLIN) | (c->con.len ? EPOLLOUT : 0);
+    ev.data.ptr = c;
+    epoll_ctl(epfd, op, c->fd, &ev);
+}
+
+static void drop(server_t* srv, conn_t* c) {
+    srv->bytes_out += c->con.bytes_written;
+    if (session_done(&c->session)) srv->finished++;
+    session_free(&c->session);
+    close(c->fd);
+    free(c->con.buf);
+
+    srv->conns[c->slot] = srv->conns[--srv->count];
+    srv->conns[c->slot]->slot = c->slot;
+    free(c);
+}
+
+// Returns 0 if the connection should go
+static int conn_alive(const conn_t* c) {
+    if (c->con.failed || c->con.len > MAX_PENDING_OUTPUT) return 0;
+    return !(c->closing && c->con.len == 0);
+}
+
+// Send what the session produced
+static int flush_conn(conn_t* c) {
+    console_use(&c->con);
+    con_flush();
+    console_use(NULL);
+    return conn_alive(c);
+}
+
+static void accept_all(server_t* srv, int epfd, int listen_fd) {
+    for (;;) {
+        struct epoll_event ev;
+        conn_t* c;
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) return;
+
+        c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->con.out_fd = fd;
+        c->con.color = 1;
+        c->con.clear_screen = 1;
+        c->con.pause = 1;
+        c->con.release_idle = 1;
+
+        if (srv->count == srv->cap) {
+            srv->cap = srv->cap ? srv->cap * 2 : 1024;
+            srv->conns = realloc(srv->conns, srv->cap * sizeof(conn_t*));
+        }
+        c->slot = srv->count;
+        srv->conns[srv->count++] = c;
+        if (srv->count > srv->peak) srv->peak = srv->count;
+        srv->accepted++;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+
+        console_use(&c->con);
+        session_start(&c->session, SESSION_SIMULATE_ONLY);
+        con_flush();
+        console_use(NULL);
+        watch(epfd, c, EPOLL_CTL_MOD);
+    }
+}
+
+// Length of the first line in c->in with its newline, or 0 if it is not
+// complete; a line that fills the buffer is taken as it is
+static size_t line_length(const conn_t* c) {
+    const char* nl = memchr(c->in, '\n', c->in_len);
+
+    if (nl) return (size_t)(nl - c->in) + 1;
+    return c->in_len == MAX_INPUT - 1 ? c->in_len : 0;
+}
+
+// On a worker: handle the first line of c->in
+static void handle_line(conn_t* c) {
+    char line[MAX_INPUT];
+    size_t len = line_length(c), n = len;
+
+    if (n && c->in[n - 1] == '\n') n--;
+    if (n && c->in[n - 1] == '\r') n--;
+    memcpy(line, c->in, n);
+    line[n] = '\0';
+    c->in_len = (uint16_t)(c->in_len - len);
+    memmove(c->in, c->in + len, c->in_len);
+
+    console_use(&c->con);
+    if (strcmp(line, "#script") == 0) {
+        c->framed = 1;
+        c->con.pause = 0;
+        c->con.color = 0;
+        c->con.clear_screen = 0;
+    } else if (!session_done(&c->session)) {
+        session_input(&c->session, line);
+        if (session_done(&c->session)) c->closing = 1;
+    }
+    if (c->framed) con_write("", 1);
+    console_use(NULL);
+}
+
+static void enqueue(server_t* srv, conn_t* c) {
+    c->next = NULL;
+    if (srv->queue_tail) {
+        srv->queue_tail->next = c;
+    } else {
+        srv->queue_head = c;
+    }
+    srv->queue_tail = c;
+    pthread_cond_signal(&srv->work);
+}
+
+static void* worker_main(void* arg) {
+    server_t* srv = arg;
+    uint64_t one = 1;
+
+    pthread_mutex_lock(&srv->lock);
+    for (;;) {
+        conn_t* c;
+        int alive;
+
+        while (!srv->queue_head && !srv->stopping) pthread_cond_wait(&srv->work, &srv->lock);
+        if (srv->stopping) break;
+        c = srv->queue_head;
+        srv->queue_head = c->next;
+        if (!srv->queue_head) srv->queue_tail = NULL;
+        pthread_mutex_unlock(&srv->lock);
+
+        handle_line(c);
+        alive = flush_conn(c);
+
+        pthread_mutex_lock(&srv->lock);
+        srv->lines++;
+        if (alive && !c->closing && line_length(c)) {
+            enqueue(srv, c);
+        } else {
+            c->next = srv->finished_list;
+            srv->finished_list = c;
+            if (!c->next && write(srv->done_fd, &one, sizeof(one)) < 0) perror("eventfd");
+        }
+    }
+    pthread_mutex_unlock(&srv->lock);
+    return NULL;
+}
+
+// Take the connection out of the epoll set and give it to the pool
+static void dispatch(server_t* srv, int epfd, conn_t* c) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    c->busy = 1;
+    pthread_mutex_lock(&srv->lock);
+    enqueue(srv, c);
+    pthread_mutex_unlock(&srv->lock);
+}
+
+// Connections the pool is done with go back into the epoll set, or away
+static void collect_finished(server_t* srv, int epfd) {
+    uint64_t count;
+    conn_t* c;
+
+    if (read(srv->done_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) perror("eventfd");
+    pthread_mutex_lock(&srv->lock);
+    c = srv->finished_list;
+    srv->finished_list = NULL;
+    pthread_mutex_unlock(&srv->lock);
+
+    while (c) {
+        conn_t* next = c->next;
+
+        c->busy = 0;
+        if (conn_alive(c)) {
+            watch(epfd, c, EPOLL_CTL_ADD);
+        } else {
+            drop(srv, c);
+        }
+        c = next;
+    }
+}
+
+// Read what fits in c->in. Returns 0 if the connection should be dropped.
+static int read_input(server_t* srv, conn_t* c) {
+    while (c->in_len < MAX_INPUT - 1) {
+        ssize_t n = read(c->fd, c->in + c->in_len, (size_t)(MAX_INPUT - 1 - c->in_len));
+
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return 0;
+        }
+        srv->bytes_in += (unsigned long)n;
+        c->in_len = (uint16_t)(c->in_len + n);
+    }
+    return 1;
+}
+
+// Workers block every signal, so stop, statistics and metric export
+// requests interrupt the epoll thread, which handles them
+static void start_workers(server_t* srv, int n_workers) {
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    sigset_t all, old;
+
+    if (n_workers <= 0) n_workers = cpus > MIN_WORKERS ? cpus : MIN_WORKERS;
+    pthread_mutex_init(&srv->lock, NULL);
+    pthread_cond_init(&srv->work, NULL);
+    srv->workers = calloc((size_t)n_workers, sizeof(pthread_t));
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (srv->n_workers = 0; srv->workers && srv->n_workers < n_workers; srv->n_workers++) {
+        if (pthread_create(&srv->workers[srv->n_workers], NULL, worker_main, srv) != 0) break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+static void stop_workers(server_t* srv) {
+    int i;
+
+    pthread_mutex_lock(&srv->lock);
+    srv->stopping = 1;
+    pthread_cond_broadcast(&srv->work);
+    pthread_mutex_unlock(&srv->lock);
+    for (i = 0; i < srv->n_workers; i++) pthread_join(srv->workers[i], NULL);
+    free(srv->workers);
+}
+
+int server_run(const char* address, int n_workers) {
+    struct epoll_event events[MAX_EVENTS];
+    struct sigaction sa;
+    server_t srv;
+    int listen_fd, epfd, i;
+
+    raise_fd_limit();
+    listen_fd = open_listener(address);
+    if (listen_fd < 0) return 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = on_stats;
+    sigaction(SIGUSR1, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&srv, 0, sizeof(srv));
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    events[0].events = EPOLLIN;
+    events[0].data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &events[0]);
+    srv.done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    events[0].events = EPOLLIN;
+    events[0].data.ptr = &srv;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, srv.done_fd, &events[0]);
+    start_workers(&srv, n_workers);
+    if (srv.n_workers == 0) {
+        fprintf(stderr, "Cannot start worker threads\n");
+        return 1;
+    }
+
+    fprintf(stderr, "Serving lessons on %s with %d workers (SIGUSR1 prints statistics)\n", address,
+            srv.n_workers);
+
+    while (!stop_requested) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+
+        if (stats_requested) {
+            stats_requested = 0;
+            print_stats(&srv);
+        }
+        instr_poll();
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            conn_t* c = events[i].data.ptr;
+            int keep = 1;
+
+            if (!c) {
+                accept_all(&srv, epfd, listen_fd);
+                continue;
+            }
+            if (events[i].data.ptr == &srv) {
+                collect_finished(&srv, epfd);
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                keep = 0;
+            } else {
+                if (events[i].events & EPOLLIN) keep = read_input(&srv, c);
+                if (keep && (events[i].events & EPOLLOUT)) keep = flush_conn(c);
+            }
+            if (!keep) {
+                drop(&srv, c);
+            } else if (!c->closing && line_length(c)) {
+                dispatch(&srv, epfd, c);
+            } else {
+                watch(epfd, c, EPOLL_CTL_MOD);
+            }
+        }
+    }
+
+    stop_workers(&srv);
+    print_stats(&srv);
+    while (srv.count) drop(&srv, srv.conns[0]);
+    close(srv.done_fd);
+    pthread_cond_destroy(&srv.work);
+    pthread_mutex_destroy(&srv.lock);
+    free(srv.conns);
+    close(epfd);
+    close(listen_fd);
+    if (strncmp(address, "unix:", 5) == 0) unlink(address + 5);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+// Multi-learner server: one epoll loop serving many sessions over a Unix
+// or TCP socket. address is "unix:/path", "tcp:host:port" or "tcp:port".
+// Lines are handled on n_workers threads (0: one per CPU, at least 16).
+//
+// Sessions are always in simulation mode. A client that sends "#script"
+// as its first line is treated as a program: no pauses, colours or
+// clear-screen sequences, and every response is terminated by a NUL byte.
+int server_run(const char* address, int n_workers);
+
+// Load-test client: `clients` concurrent connections, each replaying the
+// batch script `rounds` times, reporting p50/p99 response latency. With
+// think_ms each line waits about that long after the previous response,
+// as a learner reading the screen would; 0 sends it at once.
+int server_loadtest(const char* address, const char* script_path, int clients, int rounds, int think_ms);
+
+// Shared by the server and the load-test client
+int server_parse_address(const char* address, void* sockaddr_out, unsigned* len_out, int* family_out);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include "deb1.h"
+#include "console.h"
+#include "session.h"
+#include "sim.h"
+#include "instr.h"
+#include "shell.h"
+
+static int option_count(const session_t* s) {
+    switch (s->state) {
+        case SESSION_MODE_SELECT:
+            return 4;
+        case SESSION_MAIN_MENU:
+            return (int)lessons.header->n_topics + 2;     // the shell, then Exit
+        case SESSION_LESSON_MENU:
+            return (int)lp_topic(&lessons, s->topic)->n_sections + 1;
+        case SESSION_DEMO:
+            return 3;
+        default:
+            return 0;       // pauses, exercises and the shell accept any input
+    }
+}
+
+// Wait for Enter if the console pauses, otherwise go straight on
+static void pause_or(session_t* s, session_state_t pause_state, void (*next)(session_t*)) {
+    if (console_current()->pause) {
+        press_enter_to_continue();
+        s->state = pause_state;
+    } else {
+        next(s);
+    }
+}
+
+static void enter_main_menu(session_t* s) {
+    show_main_menu();
+    s->state = SESSION_MAIN_MENU;
+}
+
+static void enter_welcome(session_t* s) {
+    display_welcome();
+    pause_or(s, SESSION_WELCOME, enter_main_menu);
+}
+
+// Show steps until one waits for a choice or the section (and then the
+// topic's outro) runs out.
+static void run_steps(session_t* s) {
+    const lp_topic_t* topic = lp_topic(&lessons, s->topic);
+
+    for (;;) {
+        while (s->step < s->step_end) {
+            int wait = show_lesson_step(lp_step(&lessons, s->step));
+
+            if (wait) {
+                s->state = wait == 2 ? SESSION_EXERCISE : SESSION_DEMO;
+                return;
+            }
+            s->step++;
+        }
+        if (s->in_outro) break;
+        s->in_outro = 1;
+        s->step = topic->first_outro;
+        s->step_end = topic->first_outro + topic->n_outro;
+    }
+    pause_or(s, SESSION_LESSON_PAUSE, enter_main_menu);
+}
+
+void session_start(session_t* s, int flags) {
+    memset(s, 0, sizeof(*s));
+    s->flags = (uint8_t)flags;
+    memset(&sys_config, 0, sizeof(sys_config));
+
+    if (flags & SESSION_SIMULATE_ONLY) {
+        sys_config.os_type = OS_SIMULATE_DEBIAN;
+        sys_config.simulate_mode = 1;
+        strcpy(sys_config.os_name, "Debian");
+        strcpy(sys_config.prompt_prefix, "sim-debian");
+        enter_welcome(s);
+    } else {
+        detect_and_configure_system();
+        s->state = SESSION_MODE_SELECT;
+    }
+    s->config = sys_config;
+    if (instr_on) s->shown_at = instr_now();
+}
+
+// The histogram label for time spent on the current screen
+static int screen_topic(const session_t* s) {
+    switch (s->state) {
+        case SESSION_LESSON_MENU:
+        case SESSION_DEMO:
+        case SESSION_EXERCISE:
+        case SESSION_LESSON_PAUSE:
+            return (int)s->topic;
+        default:
+            return INSTR_MENU;
+    }
+}
+
+static void handle_input(session_t* s, const char* line) {
+    const lp_topic_t* topic;
+    const lp_section_t* section;
+    const lp_step_t* step;
+    int max = option_count(s);
+    int choice = 0;
+
+    sys_config = s->config;
+    sim_enter(&s->sim);
+
+    if (max) {
+        choice = line ? parse_user_choice(line, max) : max;
+        // Enter alone at the mode screen takes the mode chosen last time
+        if (!choice && s->state == SESSION_MODE_SELECT && line && !*line) choice = sys_config.last_mode;
+        if (!choice) {
+            show_choice_error(max);
+            goto done;
+        }
+    }
+
+    switch (s->state) {
+        case SESSION_MODE_SELECT:
+            configure_learning_mode(choice);
+            pause_or(s, SESSION_MODE_PAUSE, enter_welcome);
+            break;
+        case SESSION_MODE_PAUSE:
+            enter_welcome(s);
+            break;
+        case SESSION_WELCOME:
+        case SESSION_LESSON_PAUSE:
+            enter_main_menu(s);
+            break;
+        case SESSION_MAIN_MENU:
+            if (choice == max) {
+                con_printf(COLOR_GREEN "\nThanks for learning with us! Keep exploring Linux! 🐧\n" COLOR_RESET);
+                s->state = SESSION_DONE;
+            } else if (choice == max - 1) {
+                shell_welcome();
+                s->state = SESSION_SHELL;
+            } else {
+                s->topic = (uint32_t)choice - 1;
+                show_lesson(lp_topic(&lessons, s->topic));
+                s->state = SESSION_LESSON_MENU;
+            }
+            break;
+        case SESSION_LESSON_MENU:
+            topic = lp_topic(&lessons, s->topic);
+            section = lp_section(&lessons, topic, (uint32_t)choice - 1);
+            if (!section) {
+                enter_main_menu(s);
+                break;
+            }
+            s->in_outro = 0;
+            s->step = section->first_step;
+            s->step_end = section->first_step + section->n_steps;
+            run_steps(s);
+            break;
+        case SESSION_SHELL:
+            if (!line || !shell_input(line)) enter_main_menu(s);
+            break;
+        case SESSION_DEMO:
+            step = lp_step(&lessons, s->step);
+            command_demo_choice(choice, lp_str(&lessons, step->text),
+                                lp_str(&lessons, step->description),
+                                lp_str(&lessons, step->output));
+            s->step++;
+            run_steps(s);
+            break;
+        case SESSION_EXERCISE:
+            if (exercise_answer(s->step, line)) {
+                s->step++;
+                run_steps(s);
+            }
+            break;
+        default:
+            break;
+    }
+
+done:
+    // Leave the thread pointing at no session (server workers move on
+    // to another one)
+    s->config = sys_config;
+    sim_enter(NULL);
+}
+
+void session_input(session_t* s, const char* line) {
+    int topic = screen_topic(s);
+    instr_span_t span = instr_begin();
+
+    instr_topic = topic;
+    if (s->shown_at && span.start) instr_record(INSTR_INPUT_WAIT, topic, span.start - s->shown_at);
+    handle_input(s, line);
+    s->shown_at = instr_end(INSTR_SCREEN, topic, span);
+}
+
+int session_done(const session_t* s) {
+    return s->state == SESSION_DONE;
+}
+
+void session_free(session_t* s) {
+    sim_env_free(s->sim);
+    s->sim = NULL;
+}
+
+void run_session(void) {
+    session_t s;
+    char input[MAX_INPUT];
+
+    session_start(&s, 0);
+    while (!session_done(&s)) {
+        session_input(&s, con_read_line(input, sizeof(input)) ? input : NULL);
+        instr_poll();
+    }
+    session_free(&s);
+}
@@ -0,0 +1,58 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include "deb1.h"
+
+// A learner session as an explicit state machine.
+//
+// session_start() renders the first screen and session_input() consumes
+// one line of input, renders whatever follows and returns as soon as the
+// session needs more input. Nothing blocks, so one thread can drive any
+// number of sessions (see server.c); run_session() drives a single one
+// from the current console.
+
+typedef enum {
+    SESSION_MODE_SELECT,    // choosing Debian / Ubuntu / simulation
+    SESSION_MODE_PAUSE,     // "Press Enter" after the mode was chosen
+    SESSION_WELCOME,        // "Press Enter" on the welcome screen
+    SESSION_MAIN_MENU,
+    SESSION_LESSON_MENU,    // a topic's submenu
+    SESSION_DEMO,           // run / explain / skip for a command step
+    SESSION_EXERCISE,       // the learner's command for an exercise step
+    SESSION_LESSON_PAUSE,   // "Press Enter" at the end of a section
+    SESSION_SHELL,          // the practice shell, a command per line
+    SESSION_DONE
+} session_state_t;
+
+// Skip mode selection and never run real commands (remote learners)
+#define SESSION_SIMULATE_ONLY 0x01
+
+typedef struct {
+    uint8_t state;
+    uint8_t flags;
+    uint8_t in_outro;
+    uint32_t topic;
+    uint32_t step;          // next step of the running section
+    uint32_t step_end;
+    system_config_t config;
+    struct sim_env* sim;    // simulated machine, created on first command
+    uint64_t shown_at;      // when the screen was sent, with --metrics
+} session_t;
+
+void session_start(session_t* s, int flags);
+
+// Feed one line (without newline); NULL means input ended, which picks
+// the last option of the current menu (and leaves the practice shell) so
+// the session always unwinds.
+void session_input(session_t* s, const char* line);
+
+int session_done(const session_t* s);
+
+// Release what the session accumulated (its simulated machine)
+void session_free(session_t* s);
+
+// Run one learner session on the current console (see console.h)
+void run_session(void);
+
+#endif
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "pipeline.h"
+#include "instr.h"
+#include "shell.h"
+
+static void show_prompt(void) {
+    sim_env_t* env = sim_env();
+    char cwd[4096], home[4096];
+    size_t home_len = vfs_path(env->vfs, env->home, home, sizeof(home));
+    const char* shown = cwd;
+
+    vfs_path(env->vfs, env->cwd, cwd, sizeof(cwd));
+    if (strncmp(cwd, home, home_len) == 0 && (cwd[home_len] == '/' || cwd[home_len] == '\0')) {
+        cwd[home_len - 1] = '~';
+        shown = cwd + home_len - 1;
+    }
+    con_printf(COLOR_GREEN "%s@%s" COLOR_RESET ":" COLOR_BLUE "%s" COLOR_RESET "%c ", sim_user_name(env->uid),
+               sys_config.prompt_prefix, shown, env->uid == 0 ? '#' : '$');
+}
+
+static void show_help(void) {
+    const char* name;
+    size_t i;
+
+    con_printf(COLOR_CYAN "Simulated commands:\n " COLOR_RESET);
+    for (i = 0; (name = sim_command_name(i)) != NULL; i++) con_printf(" %s", name);
+    con_printf(COLOR_CYAN "\nAfter a |:\n  " COLOR_RESET "%s\n", pipeline_filters);
+    con_printf(COLOR_CYAN "Also:\n " COLOR_RESET " sudo COMMAND, help, clear, exit\n");
+}
+
+void shell_welcome(void) {
+    con_clear_screen();
+    con_printf(COLOR_YELLOW "💻 Practice shell\n" COLOR_RESET);
+    con_printf("Try anything from the lessons on a simulated %s machine; nothing here\n"
+               "touches your real system. Pipelines work too: ps aux | grep ssh | head -3\n"
+               "Type 'help' for the commands, 'exit' to go back to the menu.\n\n",
+               sys_config.simulate_mode ? sys_config.os_name : "Debian");
+    show_prompt();
+}
+
+int shell_input(const char* line) {
+    char word[32];
+    size_t n;
+
+    while (isspace((unsigned char)*line)) line++;
+    n = strcspn(line, " \t|");
+    snprintf(word, sizeof(word), "%.*s", (int)n, line);
+
+    if (strcmp(word, "exit") == 0 || strcmp(word, "logout") == 0) return 0;
+    if (strcmp(word, "help") == 0) {
+        show_help();
+    } else if (strcmp(word, "clear") == 0) {
+        con_clear_screen();
+    } else if (*line) {
+        instr_span_t span = instr_begin();
+        int status = sim_execute(line);
+
+        instr_end(INSTR_SIMULATION, instr_topic, span);
+        if (status < 0) {
+            // The command, an option or a stage after a pipe
+            con_printf(COLOR_YELLOW "Not available in the practice shell (type 'help' for what is)\n" COLOR_RESET);
+        }
+    }
+    show_prompt();
+    return 1;
+}
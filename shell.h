@@ -0,0 +1,16 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+// The practice shell: free-form command lines against the session's
+// simulated machine (see sim.h), pipelines included, behind a prompt
+// like the lessons' own ("admin@sim-debian:~$"). Nothing typed here
+// reaches the real system, whatever the learning mode.
+
+// Introduce the shell and print the first prompt
+void shell_welcome(void);
+
+// Run one line and print the next prompt. Returns 0 when the learner
+// left the shell ("exit", "logout").
+int shell_input(const char* line);
+
+#endif
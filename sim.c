@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "proc.h"
+#include "apt.h"
+#include "grep.h"
+#include "find.h"
+#include "locate.h"
+#include "pipeline.h"
+#include "systemd.h"
+#include "nss.h"
+#include "perm.h"
+#include "net.h"
+#include "sdjournal.h"
+#include "sysstat.h"
+
+#define MAX_ARGS 64
+
+// 2023-10-15 14:30:00 UTC, the afternoon the lesson examples were taken
+#define SIM_EPOCH 1697380200
+// Simulated time that passes per command
+#define SIM_TICK 20
+
+static const struct {
+    const char* name;
+    sim_command_fn run;
+} commands[] = {
+    { "adduser", nss_cmd_adduser },
+    { "apt", apt_cmd_apt },
+    { "apt-cache", apt_cmd_apt_cache },
+    { "apt-get", apt_cmd_apt_get },
+    { "cd", vfs_cmd_cd },
+    { "chgrp", perm_cmd_chgrp },
+    { "chmod", perm_cmd_chmod },
+    { "chown", perm_cmd_chown },
+    { "cp", vfs_cmd_cp },
+    { "dpkg", apt_cmd_dpkg },
+    { "find", find_cmd },
+    { "free", sysstat_cmd_free },
+    { "getent", nss_cmd_getent },
+    { "getfacl", perm_cmd_getfacl },
+    { "grep", grep_cmd },
+    { "groups", nss_cmd_groups },
+    { "id", nss_cmd_id },
+    { "ip", net_cmd_ip },
+    { "journalctl", sdj_cmd_journalctl },
+    { "jobs", proc_cmd_jobs },
+    { "kill", proc_cmd_kill },
+    { "killall", proc_cmd_killall },
+    { "locate", locate_cmd_locate },
+    { "ls", vfs_cmd_ls },
+    { "mkdir", vfs_cmd_mkdir },
+    { "mv", vfs_cmd_mv },
+    { "namei", perm_cmd_namei },
+    { "netstat", net_cmd_netstat },
+    { "passwd", nss_cmd_passwd },
+    { "pgrep", proc_cmd_pgrep },
+    { "pkill", proc_cmd_pkill },
+    { "ps", proc_cmd_ps },
+    { "pwd", vfs_cmd_pwd },
+    { "rm", vfs_cmd_rm },
+    { "rmdir", vfs_cmd_rmdir },
+    { "setfacl", perm_cmd_setfacl },
+    { "ss", net_cmd_ss },
+    { "stat", vfs_cmd_stat },
+    { "systemctl", systemd_cmd_systemctl },
+    { "systemd-analyze", systemd_cmd_analyze },
+    { "top", proc_cmd_top },
+    { "touch", vfs_cmd_touch },
+    { "umask", vfs_cmd_umask },
+    { "updatedb", locate_cmd_updatedb },
+    { "uptime", sysstat_cmd_uptime },
+    { "usermod", nss_cmd_usermod },
+    { "vmstat", sysstat_cmd_vmstat },
+    { "w", sysstat_cmd_w },
+    { "watch", sysstat_cmd_watch },
+    { "whoami", nss_cmd_whoami },
+};
+
+static __thread sim_env_t** current_slot;
+static __thread sim_env_t* default_env;
+static __thread long line_limit = -1;
+
+sim_env_t** sim_enter(sim_env_t** slot) {
+    sim_env_t** previous = current_slot;
+
+    current_slot = slot;
+    return previous;
+}
+
+sim_env_t* sim_env(void) {
+    sim_env_t** slot = current_slot ? current_slot : &default_env;
+    sim_env_t* env = *slot;
+
+    if (env) return env;
+    env = calloc(1, sizeof(*env));
+    if (!env) {
+        perror("calloc");
+        exit(1);
+    }
+    env->vfs = vfs_new();
+    vfs_seed_debian(env->vfs);
+    if (vfs_resolve(env->vfs, VFS_ROOT, "/home/admin", &env->home) != 0) env->home = VFS_ROOT;
+    env->cwd = env->home;
+    env->uid = env->gid = env->euid = 1000;
+    env->umask = 022;
+    env->clock = SIM_EPOCH;
+    *slot = env;
+    return env;
+}
+
+void sim_env_free(sim_env_t* env) {
+    if (!env) return;
+    vfs_free(env->vfs);
+    proc_free(env->procs);
+    free(env->apt_state);
+    locate_free(env->locate);
+    systemd_state_free(env->units);
+    nss_free(env->accounts);
+    perm_cache_free(env->perms);
+    net_free(env->net);
+    sdj_free(env->logs);
+    free(env);
+}
+
+void sim_error(const char* command, const char* fmt, ...) {
+    char msg[1024];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    con_printf("%s: %s\n", command, msg);
+}
+
+// The session's account database keeps the names (see nss.h)
+const char* sim_user_name(uint32_t uid) {
+    static __thread char buf[33];
+
+    return nss_user_name(uid, buf, sizeof(buf));
+}
+
+const char* sim_group_name(uint32_t gid) {
+    static __thread char buf[33];
+
+    return nss_group_name(gid, buf, sizeof(buf));
+}
+
+int sim_user_id(const char* name, uint32_t* uid) {
+    return nss_user_id(name, uid);
+}
+
+int sim_group_id(const char* name, uint32_t* gid) {
+    return nss_group_id(name, gid);
+}
+
+int sim_getopt(int argc, char** argv, const char* spec, sim_opts_t* o) {
+    int i, out = 1, only_operands = 0;
+
+    memset(o, 0, sizeof(*o));
+    for (i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        const char* p;
+
+        if (only_operands || arg[0] != '-' || arg[1] == '\0') {
+            argv[out++] = arg;
+            continue;
+        }
+        if (strcmp(arg, "--") == 0) {
+            only_operands = 1;
+            continue;
+        }
+        if (arg[1] == '-') {
+            if (o->n_longs < (int)(sizeof(o->longs) / sizeof(o->longs[0]))) o->longs[o->n_longs++] = arg + 2;
+            continue;
+        }
+        for (p = arg + 1; *p; p++) {
+            const char* s = isalnum((unsigned char)*p) ? strchr(spec, *p) : NULL;
+
+            if (!s || *p == ':') {
+                sim_error(argv[0], "invalid option -- '%c'\nTry '%s --help' for more information.", *p, argv[0]);
+                return -1;
+            }
+            o->flags |= SIM_FLAG(*p);
+            if (s[1] == ':') {
+                if (p[1]) {
+                    o->value = p + 1;
+                } else if (i + 1 < argc) {
+                    o->value = argv[++i];
+                } else {
+                    sim_error(argv[0], "option requires an argument -- '%c'\nTry '%s --help' for more information.", *p, argv[0]);
+                    return -1;
+                }
+                break;
+            }
+        }
+    }
+    o->n_operands = out - 1;
+    return 0;
+}
+
+const char* sim_long_opt(const sim_opts_t* o, const char* name) {
+    size_t len = strlen(name);
+    int i;
+
+    for (i = 0; i < o->n_longs; i++) {
+        if (strncmp(o->longs[i], name, len) == 0) {
+            if (o->longs[i][len] == '\0') return "";
+            if (o->longs[i][len] == '=') return o->longs[i] + len + 1;
+        }
+    }
+    return NULL;
+}
+
+int sim_tokenize(const char* line, char* buf, size_t buf_len, char** argv, int max_args, const char* home) {
+    const char* p = line;
+    char* out = buf;
+    char* end = buf + buf_len - 1;
+    int argc = 0;
+
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        if (argc == max_args) return -1;
+        if (*p == '|') {
+            argv[argc++] = NULL;
+            p++;
+            continue;
+        }
+
+        argv[argc++] = out;
+        if (*p == '~' && (p[1] == '/' || p[1] == '\0' || isspace((unsigned char)p[1]) || p[1] == '|')) {
+            size_t n = strlen(home);
+
+            if (out + n >= end) return -1;
+            memcpy(out, home, n);
+            out += n;
+            p++;
+        }
+        while (*p && !isspace((unsigned char)*p) && *p != '|') {
+            char quote = 0;
+
+            // Anything that needs a real shell (redirection, lists,
+            // expansion) is left to the canned output
+            if (strchr(";&<>$`(){}*?[", *p)) return -1;
+            if (*p == '\'' || *p == '"') {
+                quote = *p++;
+                while (*p && *p != quote) {
+                    if (quote == '"' && (*p == '$' || *p == '`')) return -1;
+                    if (quote == '"' && *p == '\\' && p[1] && strchr("\"\\$`", p[1])) p++;
+                    if (out >= end) return -1;
+                    *out++ = *p++;
+                }
+                if (*p != quote) return -1;
+                p++;
+                continue;
+            }
+            if (*p == '\\' && p[1]) p++;
+            if (out >= end) return -1;
+            *out++ = *p++;
+        }
+        if (out > end) return -1;
+        *out++ = '\0';
+    }
+    return argc;
+}
+
+const char* sim_command_name(size_t i) {
+    return i < sizeof(commands) / sizeof(commands[0]) ? commands[i].name : NULL;
+}
+
+sim_command_fn sim_find_command(const char* name) {
+    size_t i;
+
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(commands[i].name, name) == 0) return commands[i].run;
+    }
+    return NULL;
+}
+
+long sim_line_limit(void) {
+    return line_limit;
+}
+
+int sim_execute(const char* command) {
+    char buf[MAX_INPUT * 2], home[4096];
+    char* argv[MAX_ARGS];
+    int stage_start[MAX_ARGS / 2], stage_len[MAX_ARGS / 2];
+    int argc, n_stages = 0, i, status;
+    sim_env_t* env = sim_env();
+    sim_command_fn run;
+    pipeline_t* pipe = NULL;
+
+    vfs_path(env->vfs, env->home, home, sizeof(home));
+    argc = sim_tokenize(command, buf, sizeof(buf), argv, MAX_ARGS - 1, home);
+    if (argc <= 0) return -1;
+
+    // Split into pipeline stages
+    for (i = 0; i <= argc; i++) {
+        if (i == argc || argv[i] == NULL) {
+            int start = n_stages ? stage_start[n_stages - 1] + stage_len[n_stages - 1] + 1 : 0;
+
+            if (i == start) return -1;
+            stage_start[n_stages] = start;
+            stage_len[n_stages++] = i - start;
+            argv[i] = NULL;
+        }
+    }
+
+    // sudo runs the first stage as root, or with -u as another user
+    env->euid = env->uid;
+    if (strcmp(argv[0], "sudo") == 0) {
+        uint32_t euid = 0;
+        int skip = 1;
+
+        if (stage_len[0] >= 3 && strcmp(argv[1], "-u") == 0) {
+            if (sim_user_id(argv[2], &euid) != 0) {
+                env->clock += SIM_TICK;
+                con_printf("sudo: unknown user %s\nsudo: error initializing audit plugin sudoers_audit\n", argv[2]);
+                return 1;
+            }
+            skip = 3;
+        }
+        if (stage_len[0] <= skip || argv[skip][0] == '-') return -1;
+        env->euid = euid;
+        stage_start[0] += skip;
+        stage_len[0] -= skip;
+    }
+    run = sim_find_command(argv[stage_start[0]]);
+    if (!run) return -1;
+    if (n_stages > 1) {
+        pipe = pipeline_new();
+        for (i = 1; i < n_stages; i++) {
+            if (pipeline_add(pipe, stage_len[i], argv + stage_start[i]) < 0) {
+                pipeline_free(pipe);
+                return -1;
+            }
+        }
+    }
+
+    env->clock += SIM_TICK;
+    if (!pipe) {
+        status = run(stage_len[0], argv + stage_start[0]);
+    } else {
+        // Only head's lines can ever be shown, whatever follows it
+        line_limit = pipeline_line_limit(pipe);
+        status = pipeline_run(pipe, run, stage_len[0], argv + stage_start[0]);
+        line_limit = -1;
+        pipeline_free(pipe);
+    }
+    env->euid = env->uid;
+    return status;
+}
@@ -0,0 +1,95 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Simulated commands.
+//
+// In simulation mode execute_or_simulate_command() first offers the
+// command line to sim_execute(). Commands with a simulator (see the table
+// in sim.c) run against per-session simulated state; anything else falls
+// back to the lesson's canned output.
+
+typedef struct vfs vfs_t;
+struct proc_table;
+
+// Everything a learner's simulated machine remembers between commands.
+// Created on first use, so sessions that never run a command pay nothing.
+typedef struct sim_env {
+    vfs_t* vfs;
+    uint32_t cwd;           // inode of the working directory
+    uint32_t home;
+    uint32_t uid, gid;      // the learner ("admin")
+    uint32_t euid;          // 0 while running under sudo, the user under sudo -u
+    uint32_t umask;
+    time_t clock;           // simulated wall clock, advances per command
+    struct proc_table* procs;   // process table, created by the first ps/top/kill
+    uint8_t* apt_state;     // installed state per package of the shared APT index
+    struct locate_db* locate;   // rebuilt by updatedb; until then the seeded machine's
+    struct systemd_state* units;    // unit states, booted with the first systemctl
+    struct nss_db* accounts;    // passwd/group/shadow, unless $DEB1_ACCOUNTS shares one
+    uint8_t private_accounts;   // read the shared accounts, but change a copy (the grader)
+    struct perm_cache* perms;   // the effective user's reachable directories
+    struct net_stack* net;      // interfaces, routes and sockets, from the first ip/ss
+    struct sdj_store* logs;     // the journal, written up to the clock when read
+} sim_env_t;
+
+// Point the calling thread at a session's environment slot; the
+// environment is created there when a simulator first needs it. Returns
+// the slot it pointed at before.
+sim_env_t** sim_enter(sim_env_t** slot);
+sim_env_t* sim_env(void);
+void sim_env_free(sim_env_t* env);
+
+// Run a simulated command line. Returns its exit status, or -1 if the
+// command (or a stage of its pipeline) has no simulator. The stages after
+// a "|" are the filters of pipeline.h.
+int sim_execute(const char* command);
+
+// The simulated commands in name order; NULL past the last
+const char* sim_command_name(size_t i);
+
+// While a pipeline's first stage runs: how many lines of its output the
+// next stage keeps ("| head -3"), or -1 when all of them matter. A
+// simulator may stop producing output after that many.
+long sim_line_limit(void);
+
+// Shell-style word splitting: quotes, backslashes, "~" expansion and "|"
+// as its own word. Words point into buf. Returns the word count or -1.
+int sim_tokenize(const char* line, char* buf, size_t buf_len, char** argv, int max_args, const char* home);
+
+// A simulated command: argv[0] is the command name
+typedef int (*sim_command_fn)(int argc, char** argv);
+// The simulator of a command name, or NULL (watch runs one per refresh)
+sim_command_fn sim_find_command(const char* name);
+
+// Short options as in getopt(3): spec "lhm:" accepts -l, -h and -m VALUE,
+// clusters (-la) and "--". Long options ("--type=service") are collected
+// unparsed for sim_long_opt(). Operands are compacted into argv[1..].
+typedef struct {
+    uint64_t flags;
+    const char* value;          // argument of the option marked ':'
+    int n_operands;
+    const char* longs[8];
+    int n_longs;
+} sim_opts_t;
+
+#define SIM_FLAG(c) (1ULL << ((c) >= 'a' ? (c) - 'a' : (c) >= 'A' ? (c) - 'A' + 26 : (c) - '0' + 52))
+#define SIM_HAS(o, c) (((o)->flags & SIM_FLAG(c)) != 0)
+
+// Returns 0, or -1 after printing the usual "invalid option" message
+int sim_getopt(int argc, char** argv, const char* spec, sim_opts_t* o);
+// Value of --name=value ("" for a bare --name), NULL if absent
+const char* sim_long_opt(const sim_opts_t* o, const char* name);
+
+// Helpers for simulators
+void sim_error(const char* command, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+const char* sim_user_name(uint32_t uid);
+const char* sim_group_name(uint32_t gid);
+// Numeric ids are accepted too; returns -1 for an unknown name
+int sim_user_id(const char* name, uint32_t* uid);
+int sim_group_id(const char* name, uint32_t* gid);
+
+#endif
@@ -0,0 +1,672 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <paths.h>
+#include <signal.h>
+#include <unistd.h>
+#include <utmp.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include "bench.h"
+#include "console.h"
+#include "launch.h"
+#include "sysinfo.h"
+#include "util.h"
+
+void sysinfo_init(sysinfo_t* si) {
+    memset(si, 0, sizeof(*si));
+    si->fd_meminfo = si->fd_loadavg = si->fd_uptime = -1;
+}
+
+void sysinfo_close(sysinfo_t* si) {
+    if (si->fd_meminfo >= 0) close(si->fd_meminfo);
+    if (si->fd_loadavg >= 0) close(si->fd_loadavg);
+    if (si->fd_uptime >= 0) close(si->fd_uptime);
+    free(si->buf);
+    sysinfo_init(si);
+}
+
+// Read a whole file into si->buf, NUL-terminated. With keep_fd the file
+// stays open and is read again from the start next time (a /proc file
+// regenerates its contents on every read). Returns the length or -errno.
+static ssize_t read_into_buf(sysinfo_t* si, const char* path, int* keep_fd) {
+    int fd = keep_fd && *keep_fd >= 0 ? *keep_fd : open(path, O_RDONLY | O_CLOEXEC);
+    size_t len = 0;
+    int err = 0;
+
+    if (fd < 0) return -errno;
+    if (si->cap == 0) {
+        si->cap = 16384;
+        si->buf = xrealloc(si->buf, si->cap);
+    }
+    for (;;) {
+        ssize_t n = pread(fd, si->buf + len, si->cap - 1 - len, (off_t)len);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            err = -errno;
+            break;
+        }
+        if (n == 0) break;
+        len += (size_t)n;
+        if (len == si->cap - 1) {
+            si->cap *= 2;
+            si->buf = xrealloc(si->buf, si->cap);
+        }
+    }
+    if (keep_fd) {
+        *keep_fd = fd;
+    } else {
+        close(fd);
+    }
+    si->buf[len] = '\0';
+    return err ? err : (ssize_t)len;
+}
+
+// First line of a small file into out, trailing whitespace removed
+static int read_line(sysinfo_t* si, const char* path, char* out, size_t len) {
+    ssize_t n = read_into_buf(si, path, NULL);
+    size_t i = 0;
+
+    out[0] = '\0';
+    if (n < 0) return (int)n;
+    while (i + 1 < len && si->buf[i] && si->buf[i] != '\n') {
+        out[i] = si->buf[i];
+        i++;
+    }
+    while (i > 0 && (out[i - 1] == ' ' || out[i - 1] == '\t' || out[i - 1] == '\r')) i--;
+    out[i] = '\0';
+    return 0;
+}
+
+// Copy a fixed-width, possibly unterminated field
+static void copy_field(char* out, size_t out_len, const char* field, size_t field_len) {
+    size_t n = strnlen(field, field_len);
+
+    if (n >= out_len) n = out_len - 1;
+    memcpy(out, field, n);
+    out[n] = '\0';
+}
+
+int sysinfo_read_uname(sysinfo_t* si) {
+    if (si->static_filled) return 0;
+    return uname(&si->uts) < 0 ? -errno : 0;
+}
+
+int sysinfo_read_mem(sysinfo_t* si) {
+    static const struct {
+        const char* key;
+        size_t len;
+        size_t offset;
+    } keys[] = {
+#define MEM_KEY(name, field) { name ":", sizeof(name), offsetof(sysinfo_mem_t, field) }
+        MEM_KEY("MemTotal", total_kb),
+        MEM_KEY("MemFree", free_kb),
+        MEM_KEY("MemAvailable", available_kb),
+        MEM_KEY("Buffers", buffers_kb),
+        MEM_KEY("Cached", cached_kb),
+        MEM_KEY("SReclaimable", reclaimable_kb),
+        MEM_KEY("Shmem", shared_kb),
+        MEM_KEY("SwapTotal", swap_total_kb),
+        MEM_KEY("SwapFree", swap_free_kb),
+#undef MEM_KEY
+    };
+    ssize_t n = read_into_buf(si, "/proc/meminfo", &si->fd_meminfo);
+    const char* p = si->buf;
+    size_t i;
+
+    if (n < 0) return (int)n;
+    memset(&si->mem, 0, sizeof(si->mem));
+    while (*p) {
+        const char* nl = strchr(p, '\n');
+
+        for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if (strncmp(p, keys[i].key, keys[i].len) == 0) {
+                *(uint64_t*)((char*)&si->mem + keys[i].offset) = strtoull(p + keys[i].len, NULL, 10);
+                break;
+            }
+        }
+        if (!nl) break;
+        p = nl + 1;
+    }
+    // Kernels before 3.14 have no MemAvailable
+    if (!si->mem.available_kb) si->mem.available_kb = si->mem.free_kb + si->mem.buffers_kb + si->mem.cached_kb;
+    return 0;
+}
+
+int sysinfo_read_load(sysinfo_t* si) {
+    ssize_t n = read_into_buf(si, "/proc/loadavg", &si->fd_loadavg);
+
+    if (n < 0) return (int)n;
+    memset(&si->load, 0, sizeof(si->load));
+    sscanf(si->buf, "%lf %lf %lf %u/%u", &si->load.load[0], &si->load.load[1], &si->load.load[2],
+           &si->load.running, &si->load.tasks);
+    n = read_into_buf(si, "/proc/uptime", &si->fd_uptime);
+    if (n < 0) return (int)n;
+    si->load.uptime = strtod(si->buf, NULL);
+    si->load.now = time(NULL);
+    return 0;
+}
+
+int sysinfo_read_cpu(sysinfo_t* si) {
+    sysinfo_cpu_t* cpu = &si->cpu;
+    uint8_t socket_seen[32];
+    uint32_t cores = 0, siblings = 0;
+    ssize_t n;
+    char* p;
+
+    if (si->static_filled) return 0;
+    n = read_into_buf(si, "/proc/cpuinfo", NULL);
+    p = si->buf;
+    if (n < 0) return (int)n;
+    memset(cpu, 0, sizeof(*cpu));
+    memset(socket_seen, 0, sizeof(socket_seen));
+    while (*p) {
+        char* nl = strchr(p, '\n');
+        char* colon;
+        char* value;
+        size_t key_len;
+
+        if (nl) *nl = '\0';
+        colon = strchr(p, ':');
+        if (colon) {
+            key_len = (size_t)(colon - p);
+            while (key_len && (p[key_len - 1] == ' ' || p[key_len - 1] == '\t')) key_len--;
+            value = colon + 1;
+            while (*value == ' ') value++;
+#define KEY(name) (key_len == sizeof(name) - 1 && memcmp(p, name, key_len) == 0)
+            if (KEY("processor")) {
+                cpu->cpus++;
+            } else if (KEY("model name") && !cpu->model[0]) {
+                snprintf(cpu->model, sizeof(cpu->model), "%s", value);
+            } else if (KEY("vendor_id") && !cpu->vendor[0]) {
+                snprintf(cpu->vendor, sizeof(cpu->vendor), "%s", value);
+            } else if (KEY("physical id")) {
+                unsigned id = (unsigned)atoi(value) % (sizeof(socket_seen) * 8);
+
+                if (!(socket_seen[id / 8] & (1u << (id % 8)))) {
+                    socket_seen[id / 8] |= (uint8_t)(1u << (id % 8));
+                    cpu->sockets++;
+                }
+            } else if (KEY("cpu cores") && !cores) {
+                cores = (uint32_t)atoi(value);
+            } else if (KEY("siblings") && !siblings) {
+                siblings = (uint32_t)atoi(value);
+            } else if (KEY("bogomips") || KEY("BogoMIPS")) {
+                if (cpu->mhz == 0) cpu->mhz = strtod(value, NULL);
+            }
+#undef KEY
+        }
+        if (!nl) break;
+        *nl = '\n';
+        p = nl + 1;
+    }
+    // Without topology fields (most ARM kernels): one socket, no SMT
+    if (!cpu->sockets) cpu->sockets = 1;
+    cpu->cores_per_socket = cores ? cores : cpu->cpus / cpu->sockets;
+    cpu->threads_per_core = cores && siblings >= cores ? siblings / cores : 1;
+    return 0;
+}
+
+int sysinfo_read_mounts(sysinfo_t* si) {
+    ssize_t n = read_into_buf(si, "/proc/self/mounts", NULL);
+    char* p = si->buf;
+    size_t names = 0;
+    uint32_t i;
+
+    if (n < 0) return (int)n;
+    si->n_mounts = 0;
+    while (*p && si->n_mounts < SYSINFO_MAX_MOUNTS) {
+        char* nl = strchr(p, '\n');
+        char* device = p;
+        char* dir = strchr(p, ' ');
+        char* end;
+        struct statvfs vfs;
+        sysinfo_mount_t* m;
+        size_t device_len, dir_len;
+        int duplicate = 0;
+
+        if (nl) *nl = '\0';
+        if (!dir) break;
+        *dir++ = '\0';
+        end = strchr(dir, ' ');
+        if (end) *end = '\0';
+        device_len = strlen(device);
+        dir_len = strlen(dir);
+
+        // Like df: only filesystems with blocks, each mount point once, and
+        // a device mounted twice under its shortest path
+        if (statvfs(dir, &vfs) == 0 && vfs.f_blocks > 0) {
+            for (i = 0; i < si->n_mounts; i++) {
+                if (strcmp(si->mounts[i].dir, dir) == 0) duplicate = 1;
+                if (device[0] == '/' && strcmp(si->mounts[i].device, device) == 0) duplicate = 1;
+            }
+            if (!duplicate && names + device_len + dir_len + 2 <= sizeof(si->mount_names)) {
+                m = &si->mounts[si->n_mounts++];
+                m->device = memcpy(si->mount_names + names, device, device_len + 1);
+                names += device_len + 1;
+                m->dir = memcpy(si->mount_names + names, dir, dir_len + 1);
+                names += dir_len + 1;
+                m->size = (uint64_t)vfs.f_blocks * vfs.f_frsize;
+                m->used = (uint64_t)(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+                m->avail = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+            }
+        }
+        if (!nl) break;
+        p = nl + 1;
+    }
+    return 0;
+}
+
+int sysinfo_read_users(sysinfo_t* si) {
+    ssize_t n = read_into_buf(si, _PATH_UTMP, NULL);
+    const struct utmp* ut = (const struct utmp*)si->buf;
+    size_t count, i;
+
+    si->n_users = 0;
+    if (n == -ENOENT) return 0;
+    if (n < 0) return (int)n;
+    count = (size_t)n / sizeof(struct utmp);
+    for (i = 0; i < count && si->n_users < SYSINFO_MAX_USERS; i++) {
+        sysinfo_user_t* u;
+
+        // Entries of sessions that ended without cleaning up are skipped
+        if (ut[i].ut_type != USER_PROCESS || !ut[i].ut_user[0]) continue;
+        if (kill(ut[i].ut_pid, 0) < 0 && errno == ESRCH) continue;
+        u = &si->users[si->n_users++];
+        copy_field(u->user, sizeof(u->user), ut[i].ut_user, sizeof(ut[i].ut_user));
+        copy_field(u->line, sizeof(u->line), ut[i].ut_line, sizeof(ut[i].ut_line));
+        copy_field(u->host, sizeof(u->host), ut[i].ut_host, sizeof(ut[i].ut_host));
+        u->login = ut[i].ut_tv.tv_sec;
+        u->pid = ut[i].ut_pid;
+    }
+    return 0;
+}
+
+int sysinfo_read_host(sysinfo_t* si) {
+    sysinfo_host_t* h = &si->host;
+    static const char* chassis[] = {
+        // SMBIOS chassis types
+        [3] = "desktop", [4] = "desktop", [6] = "desktop", [7] = "desktop", [8] = "laptop",
+        [9] = "laptop", [10] = "laptop", [11] = "handset", [13] = "desktop", [14] = "laptop",
+        [17] = "server", [23] = "server", [25] = "server", [28] = "server", [30] = "tablet",
+        [31] = "convertible", [32] = "convertible",
+    };
+    char line[64];
+    const char* p;
+    size_t i, j;
+    int type;
+
+    memset(h, 0, sizeof(*h));
+    if (read_line(si, "/etc/hostname", h->hostname, sizeof(h->hostname)) < 0 || !h->hostname[0]) {
+        gethostname(h->hostname, sizeof(h->hostname) - 1);
+    }
+    read_line(si, "/etc/machine-id", h->machine_id, sizeof(h->machine_id));
+
+    // boot_id has dashes; hostnamectl shows it without
+    read_line(si, "/proc/sys/kernel/random/boot_id", line, sizeof(line));
+    for (i = j = 0; line[i] && j + 1 < sizeof(h->boot_id); i++) {
+        if (line[i] != '-') h->boot_id[j++] = line[i];
+    }
+    h->boot_id[j] = '\0';
+
+    if (read_line(si, "/sys/class/dmi/id/chassis_type", line, sizeof(line)) == 0) {
+        type = atoi(line);
+        if (type > 0 && type < (int)(sizeof(chassis) / sizeof(chassis[0])) && chassis[type]) {
+            snprintf(h->chassis, sizeof(h->chassis), "%s", chassis[type]);
+        }
+    }
+
+    if (read_into_buf(si, "/etc/os-release", NULL) < 0 && read_into_buf(si, "/usr/lib/os-release", NULL) < 0) return 0;
+    for (p = si->buf; p && *p; p = strchr(p, '\n') ? strchr(p, '\n') + 1 : NULL) {
+        if (strncmp(p, "PRETTY_NAME=", 12) == 0) {
+            p += 12;
+            if (*p == '"') p++;
+            for (i = 0; p[i] && p[i] != '"' && p[i] != '\n' && i + 1 < sizeof(h->os_name); i++) {
+                h->os_name[i] = p[i];
+            }
+            h->os_name[i] = '\0';
+            break;
+        }
+    }
+    return 0;
+}
+
+// free -h: binary units with an "i", one decimal below 10
+static const char* free_human(uint64_t kb, char* out, size_t len) {
+    static const char units[] = "KMGTP";
+    double value = (double)kb;
+    int unit = 0;
+
+    if (kb == 0) return "0B";
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    if (value < 9.95) {
+        snprintf(out, len, "%.1f%ci", value, units[unit]);
+    } else {
+        snprintf(out, len, "%.0f%ci", value, units[unit]);
+    }
+    return out;
+}
+
+// df -h: rounded up, one decimal below 10, no "i"
+static const char* df_human(uint64_t bytes, char* out, size_t len) {
+    static const char units[] = "KMGTPE";
+    uint64_t scale = 1024, tenths, whole;
+    int unit = 0;
+
+    if (bytes < 1024) {
+        snprintf(out, len, "%u", (unsigned)bytes);
+        return out;
+    }
+    while (unit < 5 && bytes / scale >= 1024) {
+        scale *= 1024;
+        unit++;
+    }
+    tenths = bytes / scale * 10 + (bytes % scale * 10 + scale - 1) / scale;
+    if (tenths < 100) {
+        snprintf(out, len, "%u.%u%c", (unsigned)(tenths / 10), (unsigned)(tenths % 10), units[unit]);
+        return out;
+    }
+    whole = bytes / scale + (bytes % scale != 0);
+    if (whole >= 1024 && unit < 5) {
+        snprintf(out, len, "1.0%c", units[unit + 1]);
+    } else {
+        snprintf(out, len, "%u%c", (unsigned)whole, units[unit]);
+    }
+    return out;
+}
+
+static int show_uname(sysinfo_t* si) {
+    struct utsname* u = &si->uts;
+
+    if (sysinfo_read_uname(si) < 0) return 1;
+    con_printf("%s %s %s %s %s GNU/Linux\n", u->sysname, u->nodename, u->release, u->version, u->machine);
+    return 0;
+}
+
+static int show_hostnamectl(sysinfo_t* si) {
+    const char* machine = si->uts.machine;
+    const char* arch = machine;
+
+    if (sysinfo_read_uname(si) < 0 || sysinfo_read_host(si) < 0) return 1;
+    if (strcmp(machine, "x86_64") == 0) arch = "x86-64";
+    if (strcmp(machine, "aarch64") == 0) arch = "arm64";
+
+    con_printf(" Static hostname: %s\n", si->host.hostname);
+    if (si->host.chassis[0]) {
+        con_printf("       Icon name: computer-%s\n", si->host.chassis);
+        con_printf("         Chassis: %s\n", si->host.chassis);
+    }
+    if (si->host.machine_id[0]) con_printf("      Machine ID: %s\n", si->host.machine_id);
+    if (si->host.boot_id[0]) con_printf("         Boot ID: %s\n", si->host.boot_id);
+    if (si->host.os_name[0]) con_printf("Operating System: %s\n", si->host.os_name);
+    con_printf("          Kernel: %s %s\n", si->uts.sysname, si->uts.release);
+    con_printf("    Architecture: %s\n", arch);
+    return 0;
+}
+
+static int show_free(sysinfo_t* si) {
+    const sysinfo_mem_t* m = &si->mem;
+    char a[16], b[16], c[16], d[16], e[16], f[16];
+    uint64_t cache, used;
+
+    if (sysinfo_read_mem(si) < 0) return 1;
+    cache = m->buffers_kb + m->cached_kb + m->reclaimable_kb;
+    used = m->total_kb > m->available_kb ? m->total_kb - m->available_kb : 0;
+    con_printf("%-9s%11s %11s %11s %11s %11s %11s\n", "", "total", "used", "free", "shared", "buff/cache", "available");
+    con_printf("%-9s%11s %11s %11s %11s %11s %11s\n", "Mem:", free_human(m->total_kb, a, sizeof(a)),
+               free_human(used, b, sizeof(b)), free_human(m->free_kb, c, sizeof(c)),
+               free_human(m->shared_kb, d, sizeof(d)), free_human(cache, e, sizeof(e)),
+               free_human(m->available_kb, f, sizeof(f)));
+    con_printf("%-9s%11s %11s %11s\n", "Swap:", free_human(m->swap_total_kb, a, sizeof(a)),
+               free_human(m->swap_total_kb - m->swap_free_kb, b, sizeof(b)),
+               free_human(m->swap_free_kb, c, sizeof(c)));
+    return 0;
+}
+
+static int show_df(sysinfo_t* si) {
+    char size[16], used[16], avail[16], pct[8];
+    int width = 14;
+    uint32_t i;
+
+    if (sysinfo_read_mounts(si) < 0) return 1;
+    for (i = 0; i < si->n_mounts; i++) {
+        int len = (int)strlen(si->mounts[i].device);
+        if (len > width) width = len;
+    }
+    con_printf("%-*s %5s %5s %5s %4s %s\n", width, "Filesystem", "Size", "Used", "Avail", "Use%", "Mounted on");
+    for (i = 0; i < si->n_mounts; i++) {
+        const sysinfo_mount_t* m = &si->mounts[i];
+        uint64_t total = m->used + m->avail;
+
+        if (total) {
+            snprintf(pct, sizeof(pct), "%u%%", (unsigned)((m->used * 100 + total - 1) / total));
+        } else {
+            snprintf(pct, sizeof(pct), "-");
+        }
+        con_printf("%-*s %5s %5s %5s %4s %s\n", width, m->device, df_human(m->size, size, sizeof(size)),
+                   df_human(m->used, used, sizeof(used)), df_human(m->avail, avail, sizeof(avail)), pct, m->dir);
+    }
+    return 0;
+}
+
+static int show_lscpu(sysinfo_t* si) {
+    const sysinfo_cpu_t* cpu = &si->cpu;
+    const char* machine = si->uts.machine;
+    char online[64];
+    uint16_t probe = 1;
+
+    if (sysinfo_read_uname(si) < 0 || sysinfo_read_cpu(si) < 0) return 1;
+    read_line(si, "/sys/devices/system/cpu/online", online, sizeof(online));
+
+    con_printf("%-41s%s\n", "Architecture:", machine);
+    if (strcmp(machine, "x86_64") == 0) con_printf("%-41s%s\n", "CPU op-mode(s):", "32-bit, 64-bit");
+    con_printf("%-41s%s\n", "Byte Order:", *(uint8_t*)&probe ? "Little Endian" : "Big Endian");
+    con_printf("%-41s%u\n", "CPU(s):", cpu->cpus);
+    if (online[0]) con_printf("%-41s%s\n", "On-line CPU(s) list:", online);
+    if (cpu->vendor[0]) con_printf("%-41s%s\n", "Vendor ID:", cpu->vendor);
+    if (cpu->model[0]) con_printf("%-41s%s\n", "Model name:", cpu->model);
+    con_printf("%-41s%u\n", "Thread(s) per core:", cpu->threads_per_core);
+    con_printf("%-41s%u\n", "Core(s) per socket:", cpu->cores_per_socket);
+    con_printf("%-41s%u\n", "Socket(s):", cpu->sockets);
+    if (cpu->mhz > 0) con_printf("%-41s%.2f\n", "BogoMIPS:", cpu->mhz);
+    return 0;
+}
+
+// " 14:32:15 up 7 days, 12:45,  3 users,  load average: 0.15, 0.23, 0.18"
+static void print_uptime_line(const sysinfo_t* si) {
+    long up = (long)si->load.uptime;
+    long days = up / 86400, hours = up % 86400 / 3600, minutes = up % 3600 / 60;
+    struct tm tm;
+
+    localtime_r(&si->load.now, &tm);
+    con_printf(" %02d:%02d:%02d up ", tm.tm_hour, tm.tm_min, tm.tm_sec);
+    if (days) con_printf("%ld day%s, ", days, days > 1 ? "s" : "");
+    if (hours) {
+        con_printf("%2ld:%02ld, ", hours, minutes);
+    } else {
+        con_printf("%ld min, ", minutes);
+    }
+    con_printf("%2u user%s,  load average: %.2f, %.2f, %.2f\n", si->n_users, si->n_users > 1 ? "s" : "",
+               si->load.load[0], si->load.load[1], si->load.load[2]);
+}
+
+static int show_uptime(sysinfo_t* si) {
+    if (sysinfo_read_load(si) < 0) return 1;
+    sysinfo_read_users(si);
+    print_uptime_line(si);
+    return 0;
+}
+
+// w's IDLE column: seconds, minutes:seconds, hours:minutes or days
+static void format_idle(long idle, char* out, size_t len) {
+    if (idle < 0) idle = 0;
+    if (idle < 60) {
+        snprintf(out, len, "%ld.00s", idle);
+    } else if (idle < 3600) {
+        snprintf(out, len, "%ld:%02ld", idle / 60, idle % 60);
+    } else if (idle < 86400) {
+        snprintf(out, len, "%ld:%02ldm", idle / 3600, idle % 3600 / 60);
+    } else {
+        snprintf(out, len, "%lddays", idle / 86400);
+    }
+}
+
+// CPU time of a process from /proc/<pid>/stat, in seconds
+static double process_cpu(sysinfo_t* si, int32_t pid) {
+    char path[64];
+    const char* p;
+    unsigned long utime = 0, stime = 0;
+    long hz = sysconf(_SC_CLK_TCK);
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if (read_into_buf(si, path, NULL) < 0) return 0;
+    // Fields after the command name (which may contain spaces)
+    p = strrchr(si->buf, ')');
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) return 0;
+    return (double)(utime + stime) / (hz > 0 ? hz : 100);
+}
+
+static int show_w(sysinfo_t* si) {
+    char idle[32], cpu[32], login[16], path[64];
+    uint32_t i;
+
+    if (sysinfo_read_load(si) < 0) return 1;
+    sysinfo_read_users(si);
+    print_uptime_line(si);
+    con_printf("%-9s%-9s%-17s%-7s%6s %6s %6s %s\n", "USER", "TTY", "FROM", "LOGIN@", "IDLE", "JCPU", "PCPU", "WHAT");
+    for (i = 0; i < si->n_users; i++) {
+        const sysinfo_user_t* u = &si->users[i];
+        struct stat st;
+        struct tm tm;
+        double seconds;
+        ssize_t n, j;
+
+        snprintf(path, sizeof(path), "/dev/%s", u->line);
+        format_idle(stat(path, &st) == 0 ? (long)(si->load.now - st.st_atime) : 0, idle, sizeof(idle));
+        localtime_r(&u->login, &tm);
+        strftime(login, sizeof(login), si->load.now - u->login < 86400 ? "%H:%M" : "%a%H", &tm);
+        seconds = process_cpu(si, u->pid);
+        snprintf(cpu, sizeof(cpu), seconds < 60 ? "%.2fs" : "%.0f:%02.0f", seconds < 60 ? seconds : seconds / 60,
+                 seconds < 60 ? 0.0 : (double)((long)seconds % 60));
+
+        // WHAT: the session's command line, arguments joined by spaces
+        snprintf(path, sizeof(path), "/proc/%d/cmdline", u->pid);
+        n = read_into_buf(si, path, NULL);
+        for (j = 0; j + 1 < n; j++) {
+            if (si->buf[j] == '\0') si->buf[j] = ' ';
+        }
+        con_printf("%-8.8s %-8.8s %-16.16s %-7s%6s %6s %6s %s\n", u->user, u->line, u->host[0] ? u->host : "-",
+                   login, idle, cpu, cpu, n > 0 ? si->buf : "-");
+    }
+    return 0;
+}
+
+static const struct {
+    const char* command;
+    int (*show)(sysinfo_t* si);
+    const char* source;
+} commands[] = {
+    { "uname -a", show_uname, "the uname() system call" },
+    { "hostnamectl", show_hostnamectl, "/etc/hostname, /etc/machine-id, /etc/os-release and /sys/class/dmi" },
+    { "free -h", show_free, "/proc/meminfo" },
+    { "df -h", show_df, "/proc/self/mounts and statvfs()" },
+    { "lscpu", show_lscpu, "/proc/cpuinfo" },
+    { "uptime", show_uptime, "/proc/uptime, /proc/loadavg and " _PATH_UTMP },
+    { "w", show_w, "/proc/uptime, /proc/loadavg, " _PATH_UTMP " and /proc/<pid>" },
+};
+
+int sysinfo_covers(const char* command) {
+    size_t i;
+
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(commands[i].command, command) == 0) return 1;
+    }
+    return 0;
+}
+
+int sysinfo_command(sysinfo_t* si, const char* command, const char** source) {
+    size_t i;
+
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(commands[i].command, command) == 0) {
+            if (source) *source = commands[i].source;
+            return commands[i].show(si);
+        }
+    }
+    return -1;
+}
+
+// Benchmark: each covered command printed from the collectors (into a
+// console that discards output) against running the real program through
+// the live-mode launcher.
+
+static int discard_output(void* ctx, const char* data, size_t len) {
+    (void)ctx;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+int sysinfo_bench(int argc, char** argv) {
+    int runs = argc > 0 ? atoi(argv[0]) : 200;
+    console_t discard, *out = console_current();
+    launch_opts_t opts;
+    sysinfo_t si;
+    char metric[64];
+    size_t i;
+    int r;
+
+    if (runs < 10) runs = 10;
+    memset(&discard, 0, sizeof(discard));
+    discard.out_fd = -1;
+    memset(&opts, 0, sizeof(opts));
+    opts.timeout_ms = 10000;
+    opts.on_output = discard_output;
+    sysinfo_init(&si);
+
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        const char* name = commands[i].command;
+        launch_result_t result;
+        double start, native, spawned;
+
+        // Name the metric after the program
+        snprintf(metric, sizeof(metric), "%s", name);
+        metric[strcspn(metric, " ")] = '\0';
+
+        console_use(&discard);
+        commands[i].show(&si);
+        start = bench_now();
+        for (r = 0; r < runs; r++) commands[i].show(&si);
+        native = (bench_now() - start) / runs;
+        console_use(out);
+
+        if (launch_command(name, &opts, &result) < 0 || result.status == 127) {
+            fprintf(stderr, "%s: not installed, only the native path is timed\n", name);
+            spawned = 0;
+        } else {
+            start = bench_now();
+            for (r = 0; r < runs / 10; r++) launch_command(name, &opts, &result);
+            spawned = (bench_now() - start) / (runs / 10);
+        }
+
+        snprintf(metric + strlen(metric), sizeof(metric) - strlen(metric), "_native");
+        bench_report("sysinfo", metric, native * 1e6, "us");
+        if (spawned > 0) {
+            metric[strlen(metric) - 7] = '\0';
+            snprintf(metric + strlen(metric), sizeof(metric) - strlen(metric), "_process");
+            bench_report("sysinfo", metric, spawned * 1e6, "us");
+            metric[strlen(metric) - 8] = '\0';
+            snprintf(metric + strlen(metric), sizeof(metric) - strlen(metric), "_speedup");
+            bench_report("sysinfo", metric, spawned / native, "x");
+        }
+    }
+    free(discard.buf);
+    sysinfo_close(&si);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#ifndef SYSINFO_H
+#define SYSINFO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/utsname.h>
+
+// Host information read straight from the kernel, for live mode.
+//
+// What uname, free, df, lscpu, uptime, w and hostnamectl print comes
+// from a handful of files under /proc and /sys, statvfs() and the utmp
+// file. The collectors read those into fixed-size snapshots in a
+// sysinfo_t: /proc files are opened once and re-read with pread(), into
+// one buffer that only grows, so after the first call nothing is
+// allocated and no process is started.
+
+#define SYSINFO_MAX_MOUNTS 64
+#define SYSINFO_MAX_USERS 64
+
+typedef struct {
+    uint64_t total_kb, free_kb, available_kb;
+    uint64_t buffers_kb, cached_kb, reclaimable_kb, shared_kb;
+    uint64_t swap_total_kb, swap_free_kb;
+} sysinfo_mem_t;
+
+typedef struct {
+    double load[3];
+    uint32_t running, tasks;
+    double uptime;          // seconds since boot
+    time_t now;
+} sysinfo_load_t;
+
+typedef struct {
+    uint32_t cpus;          // logical CPUs
+    uint32_t sockets, cores_per_socket, threads_per_core;
+    char model[96];
+    char vendor[32];
+    double mhz;
+} sysinfo_cpu_t;
+
+typedef struct {
+    const char* device;     // into mount_names
+    const char* dir;
+    uint64_t size, used, avail;     // bytes
+} sysinfo_mount_t;
+
+typedef struct {
+    char user[32];
+    char line[32];          // tty, without /dev/
+    char host[64];
+    time_t login;
+    int32_t pid;
+} sysinfo_user_t;
+
+typedef struct {
+    char hostname[65];
+    char machine_id[33];
+    char boot_id[33];
+    char os_name[96];       // PRETTY_NAME from os-release
+    char chassis[16];
+} sysinfo_host_t;
+
+typedef struct {
+    struct utsname uts;
+    sysinfo_mem_t mem;
+    sysinfo_load_t load;
+    sysinfo_cpu_t cpu;
+    sysinfo_host_t host;
+
+    sysinfo_mount_t mounts[SYSINFO_MAX_MOUNTS];
+    uint32_t n_mounts;
+    char mount_names[8192];
+
+    sysinfo_user_t users[SYSINFO_MAX_USERS];
+    uint32_t n_users;
+
+    // uts and cpu were filled in from a host profile (hostprof.h) and are
+    // not read again
+    int static_filled;
+
+    // Kept open between reads, -1 until first use
+    int fd_meminfo, fd_loadavg, fd_uptime;
+
+    // Read buffer, reused
+    char* buf;
+    size_t cap;
+} sysinfo_t;
+
+void sysinfo_init(sysinfo_t* si);
+void sysinfo_close(sysinfo_t* si);
+
+// Collectors: fill one snapshot, return 0 or -errno
+int sysinfo_read_uname(sysinfo_t* si);
+int sysinfo_read_mem(sysinfo_t* si);          // /proc/meminfo
+int sysinfo_read_load(sysinfo_t* si);         // /proc/loadavg, /proc/uptime
+int sysinfo_read_cpu(sysinfo_t* si);          // /proc/cpuinfo
+int sysinfo_read_mounts(sysinfo_t* si);       // /proc/self/mounts, statvfs()
+int sysinfo_read_users(sysinfo_t* si);        // utmp
+int sysinfo_read_host(sysinfo_t* si);         // /etc, /proc/sys, /sys/class/dmi
+
+// Print what command would (uname -a, free -h, df -h, lscpu, uptime, w,
+// hostnamectl) from fresh snapshots. Returns -1 for other commands;
+// *source names where the values came from.
+int sysinfo_command(sysinfo_t* si, const char* command, const char** source);
+
+// 1 if sysinfo_command() prints command
+int sysinfo_covers(const char* command);
+
+// --bench sysinfo [runs]
+int sysinfo_bench(int argc, char** argv);
+
+#endif
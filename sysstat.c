@@ -0,0 +1,1209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "proc.h"
+#include "net.h"
+#include "sysstat.h"
+#include "bench.h"
+
+// The seeded machine as the lesson examples show it (free -h: 2.1Gi used,
+// 256Mi shared, 3.2Gi buff/cache)
+#define SEED_USED_KB 2202010
+#define SEED_BUFFERS_KB 181000
+#define SEED_CACHE_KB 3174443
+#define SEED_SHMEM_KB 262144
+#define SEED_DIRTY_KB 600
+
+// The virtual disk, shared by reads, writeback and swap
+#define DISK_KBPS 180000.0
+#define SWAP_KBPS 90000.0
+// vm.dirty_background_ratio and vm.dirty_ratio, of free and file pages,
+// and dirty_expire_centisecs as the time a page stays dirty at most
+#define DIRTY_BACKGROUND 0.10
+#define DIRTY_LIMIT 0.20
+#define DIRTY_EXPIRE 30.0
+// Page cache that reclaim leaves alone: the hot working set
+#define CACHE_FLOOR_KB 65536.0
+// Share of busy CPU time spent in the kernel on a quiet machine
+#define SYS_SHARE 0.3
+
+#define LEAK_CMD "/usr/local/bin/report-worker --queue reports"
+#define LEAK_UID 33
+#define LEAK_KBPS 40960
+#define LEAK_RESPAWN 10
+#define BOMB_CMD "./forkbomb.sh"
+#define BOMB_COMM "forkbomb.sh"
+#define BOMB_LIMIT 4096     // the learner's ulimit -u
+#define CRON_PID 380
+
+static const struct {
+    const char* cmd;
+    float demand;
+    uint32_t rss_kb;
+    double read_kbps, write_kbps;
+} storm_jobs[3] = {
+    { "rsync -a /home/ /mnt/backup/home/", 0.25f, 6200, 70000, 70000 },
+    { "dd if=/dev/zero of=/var/tmp/fill.img bs=1M", 0.35f, 3100, 0, 250000 },
+    { "tar czf /var/backups/www.tar.gz /var/www", 0.7f, 4100, 50000, 12000 },
+};
+
+static const char* const scenario_names[] = { "calm", "leak", "forkbomb", "iostorm" };
+
+// Watch, free -s and vmstat with a delay stop after this much simulated
+// time unless told a count
+#define REPEAT_SECONDS 300
+#define WATCH_SECONDS 30
+#define WATCH_WIDTH 80
+#define HOSTNAME "debian-server"
+
+// A number in [0, 1) for the current second: the same second always
+// gets the same one
+static double noise(const sysstat_t* s, uint32_t salt) {
+    uint64_t x = s->seed ^ (uint64_t)s->now * 0x9E3779B97F4A7C15ull ^ (uint64_t)salt << 56;
+
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return (double)(x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double clamp(double v, double lo, double hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+// What one second of a quiet machine's journald, rsyslog and jbd2 reads
+// and writes
+static double base_read(const sysstat_t* s) {
+    return 1.0 + 6.0 * noise(s, 1);
+}
+
+static double base_write(const sysstat_t* s) {
+    return 6.0 + 20.0 * noise(s, 2) + (s->now % 5 == 0 ? 96.0 : 0.0);
+}
+
+// ---------------------------------------------------------------------
+// Samples
+
+typedef struct {
+    double read_want, write_want;   // what the processes ask of the disk
+    double sys_share;
+    double read, write, flushed;    // what the disk did
+    double util;
+    double swap_in, swap_out;
+} second_t;
+
+// CPU split and event counts from what the processes did
+static void fill_rates(const sysstat_t* s, const proc_table_t* pt, const second_t* sec, uint32_t forks,
+                       sysstat_sample_t* m) {
+    double busy = clamp(pt->cpu_busy / pt->ncpu, 0.0, 1.0);
+    double blocked = clamp((double)pt->n_state[2] / pt->ncpu, 0.0, 1.0);
+    double io = sec->read + sec->flushed + sec->swap_in + sec->swap_out;
+    double us, sy, si, rest, wa;
+
+    us = busy * (1.0 - sec->sys_share);
+    sy = busy * sec->sys_share + 0.002 + 0.003 * noise(s, 3);
+    si = 0.0005 + 0.015 * sec->util;
+    rest = 1.0 - us - sy - si;
+    if (rest < 0) {
+        us /= 1.0 - rest;
+        sy /= 1.0 - rest;
+        si /= 1.0 - rest;
+        rest = 0;
+    }
+    // Time with nothing to run but a process waiting for the disk
+    wa = rest * clamp(blocked * 0.9 + 0.002 + 0.004 * noise(s, 4), 0.0, 1.0);
+
+    memset(m->cpu, 0, sizeof(m->cpu));
+    m->cpu[SYSSTAT_US] = (float)us;
+    m->cpu[SYSSTAT_SY] = (float)sy;
+    m->cpu[SYSSTAT_SI] = (float)si;
+    m->cpu[SYSSTAT_WA] = (float)wa;
+    m->cpu[SYSSTAT_ID] = (float)(rest - wa);
+    m->running = (uint16_t)(pt->n_state[0] < 0xffff ? pt->n_state[0] : 0xffff);
+    m->blocked = (uint16_t)(pt->n_state[2] < 0xffff ? pt->n_state[2] : 0xffff);
+    m->read_kb = (uint32_t)sec->read;
+    m->write_kb = (uint32_t)(sec->flushed + sec->swap_out);
+    m->swap_in_kb = (uint32_t)sec->swap_in;
+    m->swap_out_kb = (uint32_t)sec->swap_out;
+    m->forks = forks;
+    m->interrupts = (uint32_t)(90.0 + 70.0 * noise(s, 5) + busy * pt->ncpu * 250.0 + io / 64.0 + forks * 2.0);
+    m->switches = (uint32_t)(170.0 + 110.0 * noise(s, 6) + busy * pt->ncpu * 900.0 + m->running * 30.0 +
+                             io / 32.0 + forks * 6.0 + m->blocked * 60.0);
+}
+
+static void fill_memory(const sysstat_t* s, sysstat_sample_t* m) {
+    m->free_kb = (uint32_t)(s->free_kb > 0 ? s->free_kb : 0);
+    m->buffers_kb = (uint32_t)s->buffers_kb;
+    m->cache_kb = (uint32_t)s->cache_kb;
+    m->shmem_kb = (uint32_t)s->shmem_kb;
+    m->dirty_kb = (uint32_t)s->dirty_kb;
+    m->swap_used_kb = (uint32_t)s->swap_used_kb;
+}
+
+static void add_totals(sysstat_t* s, const sysstat_sample_t* m, uint32_t ncpu, double seconds) {
+    int k;
+
+    for (k = 0; k < SYSSTAT_CPU_STATES; k++) s->total.cpu[k] += m->cpu[k] * ncpu * seconds;
+    s->total.read_kb += (uint64_t)(m->read_kb * seconds);
+    s->total.write_kb += (uint64_t)(m->write_kb * seconds);
+    s->total.swap_in_kb += (uint64_t)(m->swap_in_kb * seconds);
+    s->total.swap_out_kb += (uint64_t)(m->swap_out_kb * seconds);
+    s->total.interrupts += (uint64_t)(m->interrupts * seconds);
+    s->total.switches += (uint64_t)(m->switches * seconds);
+    s->total.forks += (uint64_t)(m->forks * seconds);
+}
+
+sysstat_t* sysstat_new(const proc_table_t* pt, uint64_t swap_total_kb) {
+    sysstat_t* s = calloc(1, sizeof(sysstat_t));
+    sysstat_sample_t m;
+    second_t sec;
+    uint64_t anon = pt->rss_total_kb;
+
+    if (!s) {
+        perror("calloc");
+        exit(1);
+    }
+    s->seed = (uint64_t)pt->boot * 0x2545F4914F6CDD1Dull ^ 0x5DEECE66Dull;
+    s->now = pt->now;
+    s->last_pid = pt->next_pid;
+    s->mem_total_kb = pt->mem_total_kb;
+    s->swap_total_kb = swap_total_kb;
+    s->kernel_kb = SEED_USED_KB > anon + 65536 ? (double)(SEED_USED_KB - anon) : 65536.0;
+    s->buffers_kb = SEED_BUFFERS_KB;
+    s->cache_kb = SEED_CACHE_KB;
+    s->shmem_kb = SEED_SHMEM_KB;
+    s->dirty_kb = SEED_DIRTY_KB;
+    // Scaled down for smaller machines, so that at least half is free
+    if (s->kernel_kb + anon + s->buffers_kb + s->cache_kb > pt->mem_total_kb / 2.0) {
+        double scale = (pt->mem_total_kb / 2.0 - s->kernel_kb - anon) / (s->buffers_kb + s->cache_kb);
+
+        scale = clamp(scale, 0.05, 1.0);
+        s->buffers_kb *= scale;
+        s->cache_kb *= scale;
+        s->shmem_kb *= scale;
+    }
+    s->free_kb = pt->mem_total_kb - s->kernel_kb - anon - s->buffers_kb - s->cache_kb;
+
+    // Everything since boot at a quiet second's rates
+    memset(&sec, 0, sizeof(sec));
+    sec.sys_share = SYS_SHARE;
+    sec.read = base_read(s);
+    sec.flushed = base_write(s);
+    sec.util = (sec.read + sec.flushed) / DISK_KBPS;
+    fill_rates(s, pt, &sec, 0, &m);
+    fill_memory(s, &m);
+    add_totals(s, &m, pt->ncpu, (double)(pt->now - pt->boot));
+    s->total.forks = (uint64_t)(pt->next_pid > 1 ? pt->next_pid - 1 : 0);
+    s->ring[s->head++] = m;
+    s->filled = 1;
+    return s;
+}
+
+void sysstat_free(sysstat_t* s) {
+    free(s);
+}
+
+// ---------------------------------------------------------------------
+// Scenarios
+
+static int32_t spawn_leak_worker(proc_table_t* pt) {
+    return proc_spawn(pt, 1, LEAK_UID, LEAK_CMD, 0.35f, 153600, 0);
+}
+
+int sysstat_scenario(sysstat_t* s, proc_table_t* pt, const char* name, int32_t shell) {
+    int k;
+
+    s->shell = shell;
+    if (!name || !*name) name = "calm";
+    for (k = 0; k < (int)(sizeof(scenario_names) / sizeof(scenario_names[0])); k++) {
+        if (strcmp(scenario_names[k], name) == 0) break;
+    }
+    if (k == (int)(sizeof(scenario_names) / sizeof(scenario_names[0]))) return -1;
+
+    s->scenario = (sysstat_scenario_t)k;
+    memset(s->workers, 0, sizeof(s->workers));
+    s->respawn = 0;
+    switch (s->scenario) {
+        case SYSSTAT_CALM:
+            break;
+        case SYSSTAT_LEAK:
+            s->workers[0] = spawn_leak_worker(pt);
+            break;
+        case SYSSTAT_FORKBOMB: {
+            int i = proc_find(pt, shell);
+
+            s->workers[0] = proc_spawn(pt, i >= 0 ? shell : 1, i >= 0 ? pt->uid[i] : 0, BOMB_CMD, 1.0f, 1200, 0);
+            s->bomb = 1;
+            break;
+        }
+        case SYSSTAT_IOSTORM:
+            for (k = 0; k < 3; k++) {
+                s->workers[k] = proc_spawn(pt, proc_find(pt, CRON_PID) >= 0 ? CRON_PID : 1, 0, storm_jobs[k].cmd,
+                                           storm_jobs[k].demand, storm_jobs[k].rss_kb, 0);
+            }
+            break;
+    }
+    return 0;
+}
+
+// The workload's second: its processes grow, fork or queue I/O. Returns
+// whether resident memory changed.
+static int scenario_step(sysstat_t* s, proc_table_t* pt, second_t* sec) {
+    uint32_t n, alive, i;
+    int k, i_worker;
+
+    switch (s->scenario) {
+        case SYSSTAT_CALM:
+            return 0;
+
+        case SYSSTAT_LEAK:
+            if (!s->workers[0]) {
+                if (!s->respawn || s->now < s->respawn) return 0;
+                s->workers[0] = spawn_leak_worker(pt);
+                s->respawn = 0;
+                return 1;
+            }
+            i_worker = proc_find(pt, s->workers[0]);
+            if (i_worker < 0) {
+                // Killed by someone other than the OOM killer: fixed
+                s->workers[0] = 0;
+                s->scenario = SYSSTAT_CALM;
+                return 0;
+            }
+            if (pt->state[i_worker] == PROC_STOPPED) return 0;
+            pt->rss_kb[i_worker] += LEAK_KBPS + (uint32_t)(noise(s, 7) * 4096);
+            pt->vsz_kb[i_worker] += LEAK_KBPS + 8192;
+            sec->write_want += 40.0;
+            return 1;
+
+        case SYSSTAT_FORKBOMB:
+            // Every copy forks another, until the user's process limit
+            n = pt->count;
+            alive = 0;
+            for (i = 0; i < n; i++) alive += strcmp(proc_comm(pt, (int)i), BOMB_COMM) == 0;
+            s->bomb = alive;
+            if (alive == 0) {
+                s->workers[0] = 0;
+                s->scenario = SYSSTAT_CALM;
+                return 0;
+            }
+            sec->sys_share = 0.7;
+            for (i = 0; i < n && alive < BOMB_LIMIT; i++) {
+                if (pt->state[i] == PROC_STOPPED || strcmp(proc_comm(pt, (int)i), BOMB_COMM) != 0) continue;
+                proc_spawn(pt, pt->pid[i], pt->uid[i], BOMB_CMD, 1.0f, 1200, 0);
+                alive++;
+            }
+            s->bomb = alive;
+            return 1;
+
+        case SYSSTAT_IOSTORM:
+            alive = 0;
+            for (k = 0; k < 3; k++) {
+                int j;
+
+                if (!s->workers[k]) continue;
+                j = proc_find(pt, s->workers[k]);
+                if (j < 0) {
+                    s->workers[k] = 0;
+                    continue;
+                }
+                alive++;
+                if (pt->state[j] == PROC_STOPPED) continue;
+                pt->state[j] = PROC_DISK;
+                sec->read_want += storm_jobs[k].read_kbps;
+                sec->write_want += storm_jobs[k].write_kbps;
+            }
+            if (alive == 0) {
+                s->scenario = SYSSTAT_CALM;
+                return 0;
+            }
+            sec->sys_share = 0.45;
+            return 0;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Memory
+
+// The process reclaim takes pages from: the leak's worker while there is
+// one, else the largest
+static int largest_process(const sysstat_t* s, const proc_table_t* pt) {
+    int best = -1;
+    uint32_t i;
+
+    if (s->scenario == SYSSTAT_LEAK && s->workers[0]) {
+        best = proc_find(pt, s->workers[0]);
+        if (best >= 0) return best;
+    }
+    for (i = 0; i < pt->count; i++) {
+        if ((pt->flags[i] & PROC_KERNEL) || pt->pid[i] == 1) continue;
+        if (best < 0 || pt->rss_kb[i] > pt->rss_kb[best]) best = (int)i;
+    }
+    return best;
+}
+
+static double swap_out(sysstat_t* s, proc_table_t* pt, int i, double kb) {
+    int k, slot = -1;
+
+    if (kb > pt->rss_kb[i]) kb = pt->rss_kb[i];
+    for (k = 0; k < SYSSTAT_SWAP_OWNERS; k++) {
+        if (s->swapped[k].pid == pt->pid[i]) {
+            slot = k;
+            break;
+        }
+        if (slot < 0 && s->swapped[k].pid == 0) slot = k;
+    }
+    if (slot < 0 || kb <= 0) return 0;
+    s->swapped[slot].pid = pt->pid[i];
+    s->swapped[slot].kb += (uint32_t)kb;
+    pt->rss_kb[i] -= (uint32_t)kb;
+    s->swap_used_kb += (uint32_t)kb;
+    return (double)(uint32_t)kb;
+}
+
+// Swap held by processes that have exited is free again
+static void release_swap(sysstat_t* s, const proc_table_t* pt) {
+    int k;
+
+    for (k = 0; k < SYSSTAT_SWAP_OWNERS; k++) {
+        if (s->swapped[k].pid && proc_find(pt, s->swapped[k].pid) < 0) {
+            s->swap_used_kb -= s->swapped[k].kb;
+            if (s->swap_used_kb < 0) s->swap_used_kb = 0;
+            s->swapped[k].pid = 0;
+            s->swapped[k].kb = 0;
+        }
+    }
+}
+
+static void oom_kill(sysstat_t* s, proc_table_t* pt) {
+    int victim = largest_process(s, pt);
+    int32_t pid;
+
+    if (victim < 0) return;
+    pid = pt->pid[victim];
+    proc_signal(pt, pid, SIGKILL, 0);
+    s->oom_kills++;
+    if (s->scenario == SYSSTAT_LEAK && pid == s->workers[0]) {
+        s->workers[0] = 0;
+        s->respawn = s->now + LEAK_RESPAWN;
+    }
+    release_swap(s, pt);
+}
+
+static uint64_t resident_kb(const proc_table_t* pt) {
+    uint64_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < pt->count; i++) sum += pt->rss_kb[i];
+    return sum;
+}
+
+// The page cache and the disk over one second, then reclaim if free
+// memory fell below the low watermark
+static void memory_step(sysstat_t* s, proc_table_t* pt, second_t* sec, uint64_t anon) {
+    const double total = (double)s->mem_total_kb;
+    const double low = total / 128, high = total / 64, min = total / 256;
+    double file = s->buffers_kb + s->cache_kb - s->shmem_kb;
+    double room = s->free_kb > 0 ? s->free_kb + file : file;
+    double background = room * DIRTY_BACKGROUND, limit = room * DIRTY_LIMIT;
+    double flush_want, demand, scale, written;
+    int k;
+
+    // Writeback runs flat out once dirty pages pass the background
+    // threshold, and otherwise only for pages that have been dirty too long
+    flush_want = s->dirty_kb > background ? s->dirty_kb : s->dirty_kb / DIRTY_EXPIRE;
+    if (flush_want > DISK_KBPS) flush_want = DISK_KBPS;
+    demand = sec->read_want + flush_want;
+    scale = demand > DISK_KBPS ? DISK_KBPS / demand : 1.0;
+    sec->read = sec->read_want * scale;
+    sec->flushed = flush_want * scale;
+    sec->util = clamp(demand / DISK_KBPS, 0.0, 1.0);
+    s->dirty_kb -= sec->flushed;
+
+    // Writers past the dirty limit wait for writeback to make room
+    written = sec->write_want;
+    if (s->dirty_kb + written > limit) written = limit > s->dirty_kb ? limit - s->dirty_kb : 0;
+    sec->write = written;
+    s->dirty_kb += written;
+    s->cache_kb += sec->read + written;
+
+    s->free_kb = total - s->kernel_kb - (double)anon - s->buffers_kb - s->cache_kb;
+
+    // Swapped pages come back while memory is plentiful
+    if (s->free_kb > total / 8 && s->swap_used_kb > 0) {
+        for (k = 0; k < SYSSTAT_SWAP_OWNERS; k++) {
+            int i;
+            double kb;
+
+            if (!s->swapped[k].kb) continue;
+            i = proc_find(pt, s->swapped[k].pid);
+            kb = clamp(64.0 + 448.0 * noise(s, 8), 0.0, s->swapped[k].kb);
+            s->swapped[k].kb -= (uint32_t)kb;
+            s->swap_used_kb -= (uint32_t)kb;
+            if (i >= 0) pt->rss_kb[i] += (uint32_t)kb;
+            anon += (uint32_t)kb;
+            s->free_kb -= (uint32_t)kb;
+            sec->swap_in = (uint32_t)kb;
+            break;
+        }
+    }
+
+    // kswapd: clean cache first, then anonymous pages to swap, up to the
+    // high watermark; below the minimum with swap full, the OOM killer
+    if (s->free_kb < low) {
+        double need = high - s->free_kb;
+        double clean = s->cache_kb - s->dirty_kb - s->shmem_kb - CACHE_FLOOR_KB;
+        double take = clamp(need, 0.0, clean > 0 ? clean : 0.0);
+
+        s->cache_kb -= take;
+        s->free_kb += take;
+        need -= take;
+        if (need > 0 && s->swap_used_kb < s->swap_total_kb) {
+            int victim = largest_process(s, pt);
+
+            if (victim >= 0) {
+                double kb = clamp(need, 0.0, s->swap_total_kb - s->swap_used_kb);
+
+                kb = swap_out(s, pt, victim, kb < SWAP_KBPS ? kb : SWAP_KBPS);
+                anon -= (uint64_t)kb;
+                s->free_kb += kb;
+                sec->swap_out = kb;
+            }
+        }
+        if (s->free_kb < min) {
+            oom_kill(s, pt);
+            anon = resident_kb(pt);
+            s->free_kb = total - s->kernel_kb - (double)anon - s->buffers_kb - s->cache_kb;
+        }
+    }
+    pt->rss_total_kb = anon;
+}
+
+// ---------------------------------------------------------------------
+// The tick
+
+void sysstat_tick(sysstat_t* s, proc_table_t* pt) {
+    sysstat_sample_t m;
+    second_t sec;
+    uint64_t anon;
+    uint32_t forks;
+
+    if (pt->now <= s->now) return;
+    // Seconds the table skipped (proc_advance() keeps only the last ten
+    // minutes) count at the rates of the last one
+    if (pt->now - s->now > 1 && s->filled) {
+        const sysstat_sample_t* last = &s->ring[(s->head + SYSSTAT_HISTORY - 1) % SYSSTAT_HISTORY];
+
+        add_totals(s, last, pt->ncpu, (double)(pt->now - s->now - 1));
+    }
+    s->now = pt->now;
+
+    memset(&sec, 0, sizeof(sec));
+    sec.sys_share = SYS_SHARE;
+    sec.read_want = base_read(s);
+    sec.write_want = base_write(s);
+    release_swap(s, pt);
+    anon = scenario_step(s, pt, &sec) ? resident_kb(pt) : pt->rss_total_kb;
+    memory_step(s, pt, &sec, anon);
+
+    forks = (uint32_t)(pt->next_pid - s->last_pid);
+    s->last_pid = pt->next_pid;
+    fill_rates(s, pt, &sec, forks, &m);
+    fill_memory(s, &m);
+    add_totals(s, &m, pt->ncpu, 1.0);
+    s->ring[s->head] = m;
+    s->head = (s->head + 1) % SYSSTAT_HISTORY;
+    if (s->filled < SYSSTAT_HISTORY) s->filled++;
+}
+
+void sysstat_average(const sysstat_t* s, uint32_t seconds, sysstat_sample_t* out) {
+    double cpu[SYSSTAT_CPU_STATES] = { 0 }, read = 0, write = 0, si = 0, so = 0, in = 0, cs = 0, forks = 0;
+    uint32_t i, n = seconds < s->filled ? seconds : s->filled;
+    int k;
+
+    if (n == 0) n = 1;
+    if (s->filled == 0) {
+        memset(out, 0, sizeof(*out));
+        for (k = 0; k < SYSSTAT_CPU_STATES; k++) out->cpu[k] = k == SYSSTAT_ID ? 1.0f : 0.0f;
+        fill_memory(s, out);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        const sysstat_sample_t* m = &s->ring[(s->head + SYSSTAT_HISTORY - 1 - i) % SYSSTAT_HISTORY];
+
+        for (k = 0; k < SYSSTAT_CPU_STATES; k++) cpu[k] += m->cpu[k];
+        read += m->read_kb;
+        write += m->write_kb;
+        si += m->swap_in_kb;
+        so += m->swap_out_kb;
+        in += m->interrupts;
+        cs += m->switches;
+        forks += m->forks;
+    }
+    *out = s->ring[(s->head + SYSSTAT_HISTORY - 1) % SYSSTAT_HISTORY];
+    for (k = 0; k < SYSSTAT_CPU_STATES; k++) out->cpu[k] = (float)(cpu[k] / n);
+    out->read_kb = (uint32_t)(read / n + 0.5);
+    out->write_kb = (uint32_t)(write / n + 0.5);
+    out->swap_in_kb = (uint32_t)(si / n + 0.5);
+    out->swap_out_kb = (uint32_t)(so / n + 0.5);
+    out->interrupts = (uint32_t)(in / n + 0.5);
+    out->switches = (uint32_t)(cs / n + 0.5);
+    out->forks = (uint32_t)(forks / n + 0.5);
+}
+
+void sysstat_since_boot(const sysstat_t* s, const proc_table_t* pt, sysstat_sample_t* out) {
+    double up = (double)(pt->now > pt->boot ? pt->now - pt->boot : 1), cpu_total = 0;
+    int k;
+
+    sysstat_average(s, 1, out);
+    for (k = 0; k < SYSSTAT_CPU_STATES; k++) cpu_total += s->total.cpu[k];
+    for (k = 0; k < SYSSTAT_CPU_STATES; k++) out->cpu[k] = cpu_total > 0 ? (float)(s->total.cpu[k] / cpu_total) : 0.0f;
+    out->read_kb = (uint32_t)(s->total.read_kb / up);
+    out->write_kb = (uint32_t)(s->total.write_kb / up);
+    out->swap_in_kb = (uint32_t)(s->total.swap_in_kb / up);
+    out->swap_out_kb = (uint32_t)(s->total.swap_out_kb / up);
+    out->interrupts = (uint32_t)(s->total.interrupts / up);
+    out->switches = (uint32_t)(s->total.switches / up);
+    out->forks = (uint32_t)(s->total.forks / up);
+}
+
+uint64_t sysstat_used_kb(const sysstat_t* s, const sysstat_sample_t* m) {
+    uint64_t other = (uint64_t)m->free_kb + m->buffers_kb + m->cache_kb;
+
+    return s->mem_total_kb > other ? s->mem_total_kb - other : 0;
+}
+
+// MemAvailable: free memory and the page cache that could be dropped,
+// less the watermarks the kernel keeps for itself
+uint64_t sysstat_available_kb(const sysstat_t* s, const sysstat_sample_t* m) {
+    double low = (double)s->mem_total_kb / 128;
+    double file = (double)m->buffers_kb + m->cache_kb - m->shmem_kb - m->dirty_kb;
+    double avail = m->free_kb - low + file - (file / 2 < low ? file / 2 : low);
+
+    return avail > 0 ? (uint64_t)avail : 0;
+}
+
+// ---------------------------------------------------------------------
+// uptime and w
+
+uint32_t sysstat_users(const proc_table_t* pt) {
+    uint32_t i, users = 0;
+
+    for (i = 0; i < pt->count; i++) users += pt->tty[i] >= 2 && (pt->flags[i] & PROC_SESSION_LEADER);
+    return users;
+}
+
+void sysstat_print_uptime(const proc_table_t* pt, const char* prefix) {
+    time_t now = pt->now;
+    long up = (long)(now - pt->boot);
+    long days = up / 86400, hours = up % 86400 / 3600, minutes = up % 3600 / 60;
+    uint32_t users = sysstat_users(pt);
+    struct tm tm;
+
+    gmtime_r(&now, &tm);
+    con_printf("%s%02d:%02d:%02d up ", prefix, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    if (days) con_printf("%ld day%s, ", days, days > 1 ? "s" : "");
+    if (hours) {
+        con_printf("%2ld:%02ld, ", hours, minutes);
+    } else {
+        con_printf("%ld min, ", minutes);
+    }
+    con_printf("%2u user%s,  load average: %.2f, %.2f, %.2f\n", users, users == 1 ? "" : "s", pt->load[0],
+               pt->load[1], pt->load[2]);
+}
+
+int sysstat_cmd_uptime(int argc, char** argv) {
+    proc_table_t* pt = proc_session();
+    sim_opts_t o;
+
+    if (sim_getopt(argc, argv, "ps", &o) < 0) return 1;
+    if (SIM_HAS(&o, 's')) {
+        char buf[32];
+        struct tm tm;
+
+        gmtime_r(&pt->boot, &tm);
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+        con_printf("%s\n", buf);
+    } else if (SIM_HAS(&o, 'p')) {
+        static const char* const units[] = { "week", "day", "hour", "minute" };
+        const long sizes[] = { 7 * 86400, 86400, 3600, 60 };
+        long up = (long)(pt->now - pt->boot);
+        int k, shown = 0;
+
+        con_printf("up");
+        for (k = 0; k < 4; k++) {
+            long n = up / sizes[k];
+
+            up %= sizes[k];
+            if (n == 0 && (k < 3 || shown)) continue;
+            con_printf("%s %ld %s%s", shown++ ? "," : "", n, units[k], n == 1 ? "" : "s");
+        }
+        con_printf("\n");
+    } else {
+        sysstat_print_uptime(pt, " ");
+    }
+    return 0;
+}
+
+// CPU time as w shows it: seconds with hundredths, then minutes:seconds
+static void format_cpu(uint64_t ms, char* out, size_t len) {
+    if (ms < 60000) {
+        snprintf(out, len, "%.2fs", ms / 1000.0);
+    } else {
+        snprintf(out, len, "%u:%02u", (unsigned)(ms / 60000), (unsigned)(ms / 1000 % 60));
+    }
+}
+
+static void format_idle(long idle, char* out, size_t len) {
+    if (idle < 0) idle = 0;
+    if (idle < 60) {
+        snprintf(out, len, "%ld.00s", idle);
+    } else if (idle < 3600) {
+        snprintf(out, len, "%ld:%02ld", idle / 60, idle % 60);
+    } else if (idle < 86400) {
+        snprintf(out, len, "%ld:%02ldm", idle / 3600, idle % 3600 / 60);
+    } else {
+        snprintf(out, len, "%lddays", idle / 86400);
+    }
+}
+
+// Where a session came from: the peer of its sshd's connection
+static void format_from(int32_t sshd, char* out, size_t len) {
+    net_stack_t* n = net_session();
+    uint32_t k;
+
+    snprintf(out, len, "-");
+    for (k = net_pid_sockets(n, sshd); k != NET_NONE; k = n->sockets[k].next_of_pid) {
+        const net_socket_t* sk = &n->sockets[k];
+
+        if (sk->proto == NET_TCP && sk->state == NET_ESTABLISHED) {
+            snprintf(out, len, "%u.%u.%u.%u", sk->raddr >> 24, sk->raddr >> 16 & 0xff, sk->raddr >> 8 & 0xff,
+                     sk->raddr & 0xff);
+            return;
+        }
+    }
+}
+
+int sysstat_cmd_w(int argc, char** argv) {
+    proc_table_t* pt = proc_session();
+    sysstat_t* s = pt->stats;
+    sim_opts_t o;
+    const char* only = NULL;
+    char self[256];
+    int no_header, brief, from_column, k;
+    size_t len = 0;
+    uint32_t i, j;
+
+    // The learner's terminal is running this very command
+    self[0] = '\0';
+    for (k = 0; k < argc && len < sizeof(self) - 1; k++) {
+        len += (size_t)snprintf(self + len, sizeof(self) - len, "%s%s", k ? " " : "", argv[k]);
+    }
+    if (sim_getopt(argc, argv, "hsf", &o) < 0) return 1;
+    no_header = SIM_HAS(&o, 'h');
+    brief = SIM_HAS(&o, 's');
+    from_column = !SIM_HAS(&o, 'f');
+    if (o.n_operands) only = argv[1];
+
+    if (!no_header) {
+        sysstat_print_uptime(pt, " ");
+        con_printf("%-9s%-9s", "USER", "TTY");
+        if (from_column) con_printf("%-17s", "FROM");
+        if (!brief) con_printf("%-7s", "LOGIN@");
+        con_printf("%6s ", "IDLE");
+        if (!brief) con_printf("%6s %6s ", "JCPU", "PCPU");
+        con_printf("WHAT\n");
+    }
+    for (i = 0; i < pt->count; i++) {
+        const char* user = sim_user_name(pt->uid[i]);
+        char tty[16], from[32], login[16], idle[32], jcpu[32], pcpu[32];
+        int mine = pt->pid[i] == s->shell;
+        uint64_t session_ms = 0;
+        struct tm tm;
+        time_t start = (time_t)pt->start[i];
+
+        if (pt->tty[i] < 2 || !(pt->flags[i] & PROC_SESSION_LEADER)) continue;
+        if (only && strcmp(only, user) != 0) continue;
+        for (j = 0; j < pt->count; j++) {
+            if (pt->tty[j] == pt->tty[i]) session_ms += pt->cpu_ms[j];
+        }
+        snprintf(tty, sizeof(tty), "pts/%u", pt->tty[i] - 2u);
+        format_from(pt->ppid[i], from, sizeof(from));
+        gmtime_r(&start, &tm);
+        strftime(login, sizeof(login), pt->now - start < 86400 ? "%H:%M" : "%a%H", &tm);
+        format_idle(mine ? 0 : (long)(pt->now - start), idle, sizeof(idle));
+        format_cpu(session_ms, jcpu, sizeof(jcpu));
+        format_cpu(mine ? 0 : pt->cpu_ms[i], pcpu, sizeof(pcpu));
+
+        con_printf("%-8.8s %-8.8s ", user, tty);
+        if (from_column) con_printf("%-16.16s ", from);
+        if (!brief) con_printf("%-7s", login);
+        con_printf("%6s ", idle);
+        if (!brief) con_printf("%6s %6s ", jcpu, pcpu);
+        con_printf("%s\n", mine ? self : proc_cmd(pt, (int)i));
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// free
+
+typedef struct {
+    int human, si, wide, totals;
+    uint64_t unit;          // bytes per unit printed, 0 for -h
+} free_opts_t;
+
+static const char* format_size(uint64_t kb, const free_opts_t* f, char* out, size_t len) {
+    static const char units[] = "KMGTP";
+    uint64_t bytes = kb * 1024;
+    double base = f->si ? 1000.0 : 1024.0, value = (double)bytes;
+    int unit = -1;
+
+    if (!f->human) {
+        snprintf(out, len, "%llu", (unsigned long long)(bytes / f->unit));
+        return out;
+    }
+    if (bytes < base) {
+        snprintf(out, len, "%lluB", (unsigned long long)bytes);
+        return out;
+    }
+    while (value >= base && unit < 4) {
+        value /= base;
+        unit++;
+    }
+    snprintf(out, len, value < 9.95 ? "%.1f%c%s" : "%.0f%c%s", value, units[unit], f->si ? "" : "i");
+    return out;
+}
+
+static void print_free(const sysstat_t* s, const free_opts_t* f) {
+    sysstat_sample_t m;
+    char a[24], b[24], c[24], d[24], e[24], g[24], h[24];
+    uint64_t used, swap_free;
+
+    sysstat_average(s, 1, &m);
+    used = sysstat_used_kb(s, &m);
+    swap_free = s->swap_total_kb > m.swap_used_kb ? s->swap_total_kb - m.swap_used_kb : 0;
+    if (f->wide) {
+        con_printf("%-9s%11s %11s %11s %11s %11s %11s %11s\n", "", "total", "used", "free", "shared", "buffers",
+                   "cache", "available");
+        con_printf("%-9s%11s %11s %11s %11s %11s %11s %11s\n", "Mem:", format_size(s->mem_total_kb, f, a, sizeof(a)),
+                   format_size(used, f, b, sizeof(b)), format_size(m.free_kb, f, c, sizeof(c)),
+                   format_size(m.shmem_kb, f, d, sizeof(d)), format_size(m.buffers_kb, f, e, sizeof(e)),
+                   format_size(m.cache_kb, f, g, sizeof(g)), format_size(sysstat_available_kb(s, &m), f, h, sizeof(h)));
+    } else {
+        con_printf("%-9s%11s %11s %11s %11s %11s %11s\n", "", "total", "used", "free", "shared", "buff/cache",
+                   "available");
+        con_printf("%-9s%11s %11s %11s %11s %11s %11s\n", "Mem:", format_size(s->mem_total_kb, f, a, sizeof(a)),
+                   format_size(used, f, b, sizeof(b)), format_size(m.free_kb, f, c, sizeof(c)),
+                   format_size(m.shmem_kb, f, d, sizeof(d)),
+                   format_size((uint64_t)m.buffers_kb + m.cache_kb, f, e, sizeof(e)),
+                   format_size(sysstat_available_kb(s, &m), f, g, sizeof(g)));
+    }
+    con_printf("%-9s%11s %11s %11s\n", "Swap:", format_size(s->swap_total_kb, f, a, sizeof(a)),
+               format_size(m.swap_used_kb, f, b, sizeof(b)), format_size(swap_free, f, c, sizeof(c)));
+    if (f->totals) {
+        con_printf("%-9s%11s %11s %11s\n", "Total:", format_size(s->mem_total_kb + s->swap_total_kb, f, a, sizeof(a)),
+                   format_size(used + m.swap_used_kb, f, b, sizeof(b)),
+                   format_size((uint64_t)m.free_kb + swap_free, f, c, sizeof(c)));
+    }
+}
+
+// Delays may have a fraction ("0.5"); returns -1 unless a positive number
+static int parse_delay(const char* text, double* out) {
+    char* end;
+    double v = strtod(text, &end);
+
+    if (end == text || *end || !(v > 0) || v > 86400) return -1;
+    *out = v;
+    return 0;
+}
+
+// Move the session's clock on by a fractional delay, carried in *elapsed
+static proc_table_t* wait_for(double delay, double* elapsed) {
+    sim_env_t* env = sim_env();
+    time_t before = (time_t)*elapsed;
+
+    *elapsed += delay;
+    env->clock += (time_t)*elapsed - before;
+    return proc_session();
+}
+
+// One of free's flags; value is the argument of -s and -c. Returns 0, or
+// -1 after the error message.
+static int free_flag(free_opts_t* f, char flag, const char* value, double* delay, long* count, int* decimal) {
+    switch (flag) {
+        case 'b': f->unit = 1; break;
+        case 'k': f->unit = 1024; break;
+        case 'm': f->unit = 1048576; break;
+        case 'g': f->unit = 1073741824; break;
+        case 'K': f->unit = 1000; *decimal = 1; break;
+        case 'M': f->unit = 1000000; *decimal = 1; break;
+        case 'G': f->unit = 1000000000; *decimal = 1; break;
+        case 'S': f->si = 1; break;
+        case 'h': f->human = 1; break;
+        case 'w': f->wide = 1; break;
+        case 't': f->totals = 1; break;
+        case 's':
+            if (parse_delay(value, delay) < 0) {
+                sim_error("free", "seconds argument '%s' is not positive number", value);
+                return -1;
+            }
+            break;
+        case 'c':
+            if ((*count = atol(value)) < 1) {
+                sim_error("free", "failed to parse count argument: '%s'", value);
+                return -1;
+            }
+            break;
+        default:
+            sim_error("free", "invalid option -- '%c'\nTry 'free --help' for more information.", flag);
+            return -1;
+    }
+    return 0;
+}
+
+int sysstat_cmd_free(int argc, char** argv) {
+    static const struct {
+        const char* name;
+        char flag;
+    } longs[] = {
+        { "bytes", 'b' }, { "kibi", 'k' }, { "mebi", 'm' }, { "gibi", 'g' }, { "kilo", 'K' }, { "mega", 'M' },
+        { "giga", 'G' }, { "si", 'S' }, { "human", 'h' }, { "wide", 'w' }, { "total", 't' }, { "seconds", 's' },
+        { "count", 'c' },
+    };
+    proc_table_t* pt = proc_session();
+    free_opts_t f = { 0, 0, 0, 0, 1024 };
+    double delay = 0, elapsed = 0;
+    long count = -1, frame, lines = 0, limit = sim_line_limit();
+    int i, decimal = 0;
+
+    for (i = 1; i < argc; i++) {
+        const char* p = argv[i];
+
+        if (p[0] != '-' || !p[1]) {
+            sim_error("free", "extra operand '%s'\nTry 'free --help' for more information.", p);
+            return 1;
+        }
+        if (p[1] == '-') {
+            const char* eq = strchr(p + 2, '=');
+            size_t name_len = eq ? (size_t)(eq - p - 2) : strlen(p + 2), k;
+            const char* value = NULL;
+
+            for (k = 0; k < sizeof(longs) / sizeof(longs[0]); k++) {
+                if (strlen(longs[k].name) == name_len && strncmp(p + 2, longs[k].name, name_len) == 0) break;
+            }
+            if (k == sizeof(longs) / sizeof(longs[0])) {
+                sim_error("free", "unrecognized option '%s'\nTry 'free --help' for more information.", p);
+                return 1;
+            }
+            if (longs[k].flag == 's' || longs[k].flag == 'c') {
+                value = eq ? eq + 1 : i + 1 < argc ? argv[++i] : NULL;
+                if (!value) {
+                    sim_error("free", "option '--%s' requires an argument", longs[k].name);
+                    return 1;
+                }
+            }
+            if (free_flag(&f, longs[k].flag, value, &delay, &count, &decimal) < 0) return 1;
+            continue;
+        }
+        for (p++; *p; p++) {
+            const char* value = NULL;
+
+            if (*p == 's' || *p == 'c') {
+                value = p[1] ? p + 1 : i + 1 < argc ? argv[++i] : NULL;
+                if (!value) {
+                    sim_error("free", "option requires an argument -- '%c'", *p);
+                    return 1;
+                }
+            }
+            if (free_flag(&f, *p, value, &delay, &count, &decimal) < 0) return 1;
+            if (value) break;
+        }
+    }
+    // --si turns -k, -m and -g into powers of 1000
+    if (f.si && !decimal) {
+        if (f.unit == 1024) f.unit = 1000;
+        if (f.unit == 1048576) f.unit = 1000000;
+        if (f.unit == 1073741824) f.unit = 1000000000;
+    }
+
+    if (count > 0 && delay == 0) delay = 1;
+    if (delay == 0) {
+        print_free(pt->stats, &f);
+        return 0;
+    }
+    if (count < 0) count = (long)(REPEAT_SECONDS / delay) + 1;
+    for (frame = 0; frame < count && !con_stopped() && (limit < 0 || lines < limit); frame++) {
+        if (frame) pt = wait_for(delay, &elapsed);
+        print_free(pt->stats, &f);
+        con_printf("\n");
+        lines += f.totals ? 5 : 4;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// vmstat
+
+static unsigned percent(float share) {
+    return (unsigned)(share * 100.0f + 0.5f);
+}
+
+static void print_vmstat_line(const sysstat_t* s, const sysstat_sample_t* m, int wide, uint64_t unit_bytes,
+                              int timestamp) {
+    uint64_t swpd = (uint64_t)m->swap_used_kb * 1024 / unit_bytes, free = (uint64_t)m->free_kb * 1024 / unit_bytes;
+    uint64_t buff = (uint64_t)m->buffers_kb * 1024 / unit_bytes, cache = (uint64_t)m->cache_kb * 1024 / unit_bytes;
+
+    con_printf(wide ? "%4u %4u %12llu %12llu %12llu %12llu %4u %4u %5u %5u %4u %4u %3u %3u %3u %3u %3u"
+                    : "%2u %2u %6llu %6llu %6llu %6llu %4u %4u %5u %5u %4u %4u %2u %2u %2u %2u %2u",
+               m->running, m->blocked, (unsigned long long)swpd, (unsigned long long)free, (unsigned long long)buff,
+               (unsigned long long)cache, m->swap_in_kb, m->swap_out_kb, m->read_kb, m->write_kb, m->interrupts,
+               m->switches, percent(m->cpu[SYSSTAT_US] + m->cpu[SYSSTAT_NI]),
+               percent(m->cpu[SYSSTAT_SY] + m->cpu[SYSSTAT_HI] + m->cpu[SYSSTAT_SI]), percent(m->cpu[SYSSTAT_ID]),
+               percent(m->cpu[SYSSTAT_WA]), percent(m->cpu[SYSSTAT_ST]));
+    if (timestamp) {
+        char buf[32];
+        struct tm tm;
+
+        gmtime_r(&s->now, &tm);
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+        con_printf(" %s", buf);
+    }
+    con_printf("\n");
+}
+
+int sysstat_cmd_vmstat(int argc, char** argv) {
+    proc_table_t* pt = proc_session();
+    sysstat_sample_t m;
+    sim_opts_t o;
+    uint64_t unit_bytes = 1024;
+    long delay = 0, count = 1, frame, lines, limit = sim_line_limit();
+    int wide, timestamp;
+    double elapsed = 0;
+
+    if (sim_getopt(argc, argv, "wtS:", &o) < 0) return 1;
+    wide = SIM_HAS(&o, 'w');
+    timestamp = SIM_HAS(&o, 't');
+    if (SIM_HAS(&o, 'S')) {
+        if (strcmp(o.value, "k") == 0) {
+            unit_bytes = 1000;
+        } else if (strcmp(o.value, "K") == 0) {
+            unit_bytes = 1024;
+        } else if (strcmp(o.value, "m") == 0) {
+            unit_bytes = 1000000;
+        } else if (strcmp(o.value, "M") == 0) {
+            unit_bytes = 1048576;
+        } else {
+            sim_error("vmstat", "-S requires k, K, m or M (default is KiB)");
+            return 1;
+        }
+    }
+    if (o.n_operands >= 1) {
+        char* end;
+
+        delay = strtol(argv[1], &end, 10);
+        if (*end || delay < 1) {
+            sim_error("vmstat", "failed to parse argument: '%s'", argv[1]);
+            return 1;
+        }
+        count = REPEAT_SECONDS / delay + 1;
+    }
+    if (o.n_operands >= 2) {
+        char* end;
+
+        count = strtol(argv[2], &end, 10);
+        if (*end || count < 1) {
+            sim_error("vmstat", "failed to parse argument: '%s'", argv[2]);
+            return 1;
+        }
+    }
+
+    if (wide) {
+        con_printf("--procs-- -----------------------memory---------------------- ---swap-- -----io---- -system-- "
+                   "--------cpu--------%s\n", timestamp ? " -----timestamp-----" : "");
+        con_printf("   r    b         swpd         free         buff        cache   si   so    bi    bo   in   cs  us  "
+                   "sy  id  wa  st%s\n", timestamp ? "                 UTC" : "");
+    } else {
+        con_printf("procs -----------memory---------- ---swap-- -----io---- -system-- ------cpu-----%s\n",
+                   timestamp ? " -----timestamp-----" : "");
+        con_printf(" r  b   swpd   free   buff  cache   si   so    bi    bo   in   cs us sy id wa st%s\n",
+                   timestamp ? "                 UTC" : "");
+    }
+
+    // The first line is averaged since boot, the others over the delay
+    sysstat_since_boot(pt->stats, pt, &m);
+    print_vmstat_line(pt->stats, &m, wide, unit_bytes, timestamp);
+    for (frame = 1, lines = 3; frame < count && !con_stopped() && (limit < 0 || lines < limit); frame++, lines++) {
+        pt = wait_for((double)delay, &elapsed);
+        sysstat_average(pt->stats, (uint32_t)delay, &m);
+        print_vmstat_line(pt->stats, &m, wide, unit_bytes, timestamp);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// watch
+
+int sysstat_cmd_watch(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    double interval = 2.0, elapsed = 0;
+    int title = 1, first = 1, i, frames, frame, inner_argc;
+    char line[1024], buf[2048], home[4096];
+    char* inner[64];
+    size_t len = 0;
+    sim_command_fn run;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        const char* p = argv[i];
+
+        if (strcmp(p, "--") == 0) {
+            i++;
+            break;
+        }
+        if (strncmp(p, "--interval", 10) == 0 || strncmp(p, "-n", 2) == 0) {
+            const char* value = p[1] == '-' ? (p[10] == '=' ? p + 11 : NULL) : p[2] ? p + 2 : NULL;
+
+            if (!value) value = i + 1 < argc ? argv[++i] : NULL;
+            if (!value || parse_delay(value, &interval) < 0) {
+                sim_error("watch", "failed to parse argument: '%s'", value ? value : "");
+                return 1;
+            }
+            if (interval < 0.1) interval = 0.1;
+        } else if (strcmp(p, "-t") == 0 || strcmp(p, "--no-title") == 0) {
+            title = 0;
+        } else if (strcmp(p, "-d") == 0 || strcmp(p, "--differences") == 0) {
+            // Highlighting is left to the terminal's eye
+        } else {
+            sim_error("watch", "invalid option -- '%s'\nTry 'watch --help' for more information.", p + 1);
+            return 1;
+        }
+    }
+    if (i == argc) {
+        sim_error("watch", "no command given\nTry 'watch --help' for more information.");
+        return 1;
+    }
+
+    // watch hands its arguments to sh -c as one line
+    line[0] = '\0';
+    for (; i < argc && len < sizeof(line) - 1; i++) {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, "%s%s", first ? "" : " ", argv[i]);
+        first = 0;
+    }
+    vfs_path(env->vfs, env->home, home, sizeof(home));
+    inner_argc = sim_tokenize(line, buf, sizeof(buf), inner, 63, home);
+    if (inner_argc <= 0) return -1;
+    for (i = 0; i < inner_argc; i++) {
+        if (!inner[i]) return -1;
+    }
+    inner[inner_argc] = NULL;
+    run = sim_find_command(inner[0]);
+    if (!run || run == sysstat_cmd_watch) return -1;
+
+    // Each frame is a screen of its own; the clock moves on by the
+    // interval between them
+    frames = (int)(WATCH_SECONDS / interval);
+    if (frames < 1) frames = 1;
+    for (frame = 0; frame < frames && !con_stopped(); frame++) {
+        if (frame) wait_for(interval, &elapsed);
+        con_clear_screen();
+        if (title) {
+            char left[sizeof(line) + 32], right[64], date[32];
+            time_t now = env->clock;
+            struct tm tm;
+            int room;
+
+            gmtime_r(&now, &tm);
+            strftime(date, sizeof(date), "%a %b %e %H:%M:%S %Y", &tm);
+            snprintf(right, sizeof(right), "%s: %s", HOSTNAME, date);
+            snprintf(left, sizeof(left), "Every %.1fs: %s", interval, line);
+            room = WATCH_WIDTH - (int)strlen(right) - 1;
+            if (room < 0) room = 0;
+            con_printf("%-*.*s %s\n\n", room, room, left, right);
+        }
+        // The command's words are tokenized again since a simulator may
+        // compact them
+        inner_argc = sim_tokenize(line, buf, sizeof(buf), inner, 63, home);
+        inner[inner_argc] = NULL;
+        run(inner_argc, inner);
+        con_flush();
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: each scenario fast-forwarded for simulated days, then watch
+// refreshing free -h into a console that discards its output
+
+int sysstat_bench(int argc, char** argv) {
+    long days = argc > 0 ? atol(argv[0]) : 1, seconds;
+    console_t discard, *out = console_current();
+    sim_env_t* env = NULL;
+    proc_table_t* pt;
+    double start, elapsed;
+    size_t strings_before;
+    uint32_t cap_before;
+    int k, runs = 20, failed = 0;
+    char metric[64];
+
+    if (days < 1) days = 1;
+    seconds = days * 86400;
+    for (k = 0; k < (int)(sizeof(scenario_names) / sizeof(scenario_names[0])); k++) {
+        uint32_t peak_procs = 0;
+        long t;
+
+        pt = proc_new(2, 16307916, 1696729620);
+        pt->now = pt->boot + 7 * 86400;
+        proc_seed_debian(pt);
+        pt->stats = sysstat_new(pt, 2097148);
+        sysstat_scenario(pt->stats, pt, scenario_names[k], 1222);
+
+        start = bench_now();
+        for (t = 0; t < seconds; t++) {
+            proc_tick(pt);
+            if (pt->count > peak_procs) peak_procs = pt->count;
+        }
+        elapsed = bench_now() - start;
+        snprintf(metric, sizeof(metric), "%s_rate", scenario_names[k]);
+        bench_report("sysstat", metric, seconds / elapsed, "sim-s/s");
+        snprintf(metric, sizeof(metric), "%s_tick", scenario_names[k]);
+        bench_report("sysstat", metric, elapsed / seconds * 1e9, "ns");
+        snprintf(metric, sizeof(metric), "%s_peak_procs", scenario_names[k]);
+        bench_report("sysstat", metric, peak_procs, "count");
+        snprintf(metric, sizeof(metric), "%s_oom_kills", scenario_names[k]);
+        bench_report("sysstat", metric, pt->stats->oom_kills, "count");
+        proc_free(pt);
+    }
+    bench_report("sysstat", "history", sizeof(sysstat_t), "bytes");
+
+    // watch in a session of its own; the frames must not grow anything
+    memset(&discard, 0, sizeof(discard));
+    discard.out_fd = -1;
+    sim_enter(&env);
+    console_use(&discard);
+    sim_execute("free -h");
+    pt = env->procs;
+    cap_before = pt->cap;
+    strings_before = pt->strings_len;
+    start = bench_now();
+    for (k = 0; k < runs; k++) sim_execute("watch -n 0.5 free -h");
+    elapsed = bench_now() - start;
+    console_use(out);
+    bench_report("sysstat", "watch_frame", elapsed / (runs * (WATCH_SECONDS / 0.5)) * 1e6, "us");
+    if (pt->cap != cap_before || pt->strings_len != strings_before) {
+        fprintf(stderr, "sysstat: watch grew the process table (%u -> %u slots, %zu -> %zu string bytes)\n",
+                cap_before, pt->cap, strings_before, pt->strings_len);
+        failed = 1;
+    }
+    free(discard.buf);
+    sim_env_free(env);
+    sim_enter(NULL);
+    return failed;
+}
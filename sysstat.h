@@ -0,0 +1,138 @@
+#ifndef SYSSTAT_H
+#define SYSSTAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// Machine-wide statistics for simulation mode: what uptime, w, free,
+// vmstat and top's summary area read from /proc/stat, /proc/meminfo and
+// /proc/vmstat.
+//
+// The process table (proc.h) drives them. After each one-second tick the
+// kernel's side of that second is worked out from what the processes did:
+// their CPU time split into user, system, iowait and softirq; reads that
+// fill the page cache and writes that dirty it, written back at the
+// disk's pace; and, once resident sets outgrow memory, clean cache
+// reclaimed, pages swapped out, and at last the OOM killer. The second is
+// recorded as a sample in a ring of the last SYSSTAT_HISTORY seconds, so
+// an interval average (vmstat 5, top's CPU line) is a walk back over the
+// ring, and the statistics take the same memory however long a session
+// runs. Totals since boot give vmstat's first line. The noise in a sample
+// is a hash of the machine's seed and the second, so a given second has
+// the same numbers however the clock got there.
+//
+// A scenario adds a misbehaving workload to the seeded machine; sessions
+// pick one with $DEB1_SCENARIO. "leak" is a worker whose memory grows
+// until the OOM killer takes it (and its parent starts another), until
+// someone kills it first. "forkbomb" is a script of the learner's that
+// doubles every second up to the process limit. "iostorm" is a backup
+// run from cron whose reads and writes saturate the disk.
+
+#define SYSSTAT_HISTORY 900
+#define SYSSTAT_SWAP_OWNERS 8
+
+typedef enum {
+    SYSSTAT_US,
+    SYSSTAT_SY,
+    SYSSTAT_NI,
+    SYSSTAT_ID,
+    SYSSTAT_WA,
+    SYSSTAT_HI,
+    SYSSTAT_SI,
+    SYSSTAT_ST,
+    SYSSTAT_CPU_STATES
+} sysstat_cpu_t;
+
+typedef enum {
+    SYSSTAT_CALM,
+    SYSSTAT_LEAK,
+    SYSSTAT_FORKBOMB,
+    SYSSTAT_IOSTORM
+} sysstat_scenario_t;
+
+// One second of the machine. Rates are per second; memory is as the
+// second ended.
+typedef struct {
+    float cpu[SYSSTAT_CPU_STATES];  // shares of all CPUs' time
+    uint16_t running, blocked;      // vmstat r and b
+    uint32_t free_kb, buffers_kb, cache_kb, shmem_kb, dirty_kb, swap_used_kb;
+    uint32_t read_kb, write_kb;     // blocks in and out
+    uint32_t swap_in_kb, swap_out_kb;
+    uint32_t interrupts, switches, forks;
+} sysstat_sample_t;
+
+typedef struct {
+    double cpu[SYSSTAT_CPU_STATES]; // CPU-seconds
+    uint64_t read_kb, write_kb, swap_in_kb, swap_out_kb;
+    uint64_t interrupts, switches, forks;
+} sysstat_totals_t;
+
+typedef struct sysstat {
+    sysstat_sample_t ring[SYSSTAT_HISTORY];
+    uint32_t head;          // where the next sample goes
+    uint32_t filled;
+    sysstat_totals_t total; // since boot
+    time_t now;             // the last second sampled
+    uint64_t seed;
+    int32_t last_pid;       // the table's next pid then: forks in between
+
+    // Memory, in kB
+    uint64_t mem_total_kb, swap_total_kb;
+    double free_kb, buffers_kb, cache_kb, shmem_kb, dirty_kb, swap_used_kb;
+    double kernel_kb;       // slab, page tables and the like: not reclaimed
+    struct {
+        int32_t pid;
+        uint32_t kb;
+    } swapped[SYSSTAT_SWAP_OWNERS];     // whose pages are in swap
+
+    sysstat_scenario_t scenario;
+    int32_t workers[3];     // the scenario's processes, 0 for none
+    int32_t shell;          // the learner's login shell
+    time_t respawn;         // when the leak's worker comes back, 0: not due
+    uint32_t bomb;          // forkbomb processes alive
+    uint32_t oom_kills;
+} sysstat_t;
+
+struct proc_table;
+
+// Statistics for a seeded table, as if it had run since its boot
+sysstat_t* sysstat_new(const struct proc_table* pt, uint64_t swap_total_kb);
+void sysstat_free(sysstat_t* s);
+
+// Start a scenario by name ("leak", "forkbomb", "iostorm"; "" or "calm"
+// for none); shell is the learner's login shell. Returns -1 for an
+// unknown name.
+int sysstat_scenario(sysstat_t* s, struct proc_table* pt, const char* name, int32_t shell);
+
+// Record the second the table has just run (proc_tick() calls this)
+void sysstat_tick(sysstat_t* s, struct proc_table* pt);
+
+// Rates and CPU shares averaged over the last seconds samples (fewer if
+// the ring holds fewer; since boot when it holds none), memory and run
+// queue as of the last one
+void sysstat_average(const sysstat_t* s, uint32_t seconds, sysstat_sample_t* out);
+// The same since boot
+void sysstat_since_boot(const sysstat_t* s, const struct proc_table* pt, sysstat_sample_t* out);
+
+// free's "used" and "available" for a sample
+uint64_t sysstat_used_kb(const sysstat_t* s, const sysstat_sample_t* m);
+uint64_t sysstat_available_kb(const sysstat_t* s, const sysstat_sample_t* m);
+
+// Login sessions: the session leaders on a terminal
+uint32_t sysstat_users(const struct proc_table* pt);
+// " 14:32:15 up 7 days, 12:45,  1 user,  load average: 0.15, 0.23, 0.18"
+// after prefix (top's first line is "top - " and the rest of it)
+void sysstat_print_uptime(const struct proc_table* pt, const char* prefix);
+
+// Simulated commands (see sim.c)
+int sysstat_cmd_uptime(int argc, char** argv);
+int sysstat_cmd_w(int argc, char** argv);
+int sysstat_cmd_free(int argc, char** argv);
+int sysstat_cmd_vmstat(int argc, char** argv);
+int sysstat_cmd_watch(int argc, char** argv);
+
+// --bench sysstat [days]
+int sysstat_bench(int argc, char** argv);
+
+#endif
@@ -0,0 +1,2128 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "proc.h"
+#include "systemd.h"
+#include "sdjournal.h"
+#include "bench.h"
+#include "util.h"
+
+#define MAX_PATH 4096
+// What the kernel takes before systemd starts: "(kernel)" in systemd-analyze
+#define KERNEL_MS 1742
+#define TASKS_LIMIT 4915
+
+// The bundled units, laid out like a Debian system's
+static const char* const bundled_dirs[] = { "lessons/units/etc", "lessons/units/lib" };
+static const char* const bundled_shown[] = { "/etc/systemd/system", "/lib/systemd/system" };
+
+static const char* const kind_suffix[UNIT_KINDS - 1] = {
+    ".service", ".socket", ".target", ".timer", ".path", ".mount", ".slice",
+};
+static const char* const other_suffix[] = { ".scope", ".swap", ".automount", ".device" };
+
+static const char* const type_names[] = { "simple", "exec", "forking", "oneshot", "notify", "dbus", "idle" };
+
+// ---------------------------------------------------------------------
+// Names
+
+static uint32_t hash_name(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) h = (h ^ (uint8_t)s[i]) * 16777619u;
+    return h;
+}
+
+// The unit kind a name's suffix says, or -1 for a name that is no unit
+static int kind_of(const char* name, size_t len) {
+    const char* dot = memrchr(name, '.', len);
+    size_t n, i;
+
+    if (!dot || dot == name) return -1;
+    n = (size_t)(name + len - dot);
+    for (i = 0; i < sizeof(kind_suffix) / sizeof(kind_suffix[0]); i++) {
+        if (strlen(kind_suffix[i]) == n && memcmp(dot, kind_suffix[i], n) == 0) return (int)i;
+    }
+    for (i = 0; i < sizeof(other_suffix) / sizeof(other_suffix[0]); i++) {
+        if (strlen(other_suffix[i]) == n && memcmp(dot, other_suffix[i], n) == 0) return UNIT_OTHER;
+    }
+    return -1;
+}
+
+static uint32_t add_string(unit_graph_t* g, const char* s, size_t len) {
+    uint32_t off;
+
+    if (!len) return 0;
+    if (g->strings_len + len + 1 > g->strings_cap) {
+        g->strings_cap = (g->strings_len + len + 1) * 2;
+        g->strings = xrealloc(g->strings, g->strings_cap);
+    }
+    off = (uint32_t)g->strings_len;
+    memcpy(g->strings + off, s, len);
+    g->strings[off + len] = '\0';
+    g->strings_len += len + 1;
+    return off;
+}
+
+// The slot holding name, or the empty slot where it would go
+static uint32_t* unit_slot(const unit_graph_t* g, const char* name, size_t len) {
+    uint32_t i = hash_name(name, len) & g->hash_mask;
+
+    while (g->hash[i]) {
+        const char* s = unit_str(g, g->units[g->hash[i] - 1].name);
+
+        if (strncmp(s, name, len) == 0 && s[len] == '\0') break;
+        i = (i + 1) & g->hash_mask;
+    }
+    return &g->hash[i];
+}
+
+static void grow_hash(unit_graph_t* g) {
+    uint32_t size = g->hash ? (g->hash_mask + 1) * 2 : 1024, i;
+
+    free(g->hash);
+    g->hash = xcalloc(size, sizeof(uint32_t));
+    g->hash_mask = size - 1;
+    for (i = 0; i < g->n_units; i++) {
+        const char* s = unit_str(g, g->units[i].name);
+
+        *unit_slot(g, s, strlen(s)) = i + 1;
+    }
+}
+
+// Follow aliases to the unit a name stands for
+static uint32_t resolve(const unit_graph_t* g, uint32_t u) {
+    int hops;
+
+    for (hops = 0; hops < 8 && u != UNIT_NONE && g->units[u].alias_of != UNIT_NONE; hops++) u = g->units[u].alias_of;
+    return u;
+}
+
+uint32_t systemd_find(const unit_graph_t* g, const char* name, size_t len) {
+    uint32_t slot;
+
+    if (!g->hash) return UNIT_NONE;
+    slot = *unit_slot(g, name, len);
+    return slot ? resolve(g, slot - 1) : UNIT_NONE;
+}
+
+static const char* unit_name(const unit_graph_t* g, uint32_t u) {
+    return unit_str(g, g->units[u].name);
+}
+
+// ---------------------------------------------------------------------
+// Loading
+
+typedef struct {
+    uint32_t from, to;
+    uint8_t kind;
+} raw_edge_t;
+
+typedef struct {
+    unit_graph_t* g;
+    uint32_t units_cap;
+    raw_edge_t* edges;      // as parsed, before grouping
+    uint32_t n_edges, edges_cap;
+    uint32_t* aliases;      // (alias, unit) pairs from symlinks and Alias=
+    uint32_t n_aliases, aliases_cap;
+} loader_t;
+
+static uint32_t intern(loader_t* l, const char* name, size_t len) {
+    unit_graph_t* g = l->g;
+    uint32_t* slot;
+    const char* at;
+    unit_t* u;
+    int kind;
+
+    if ((g->n_units + 1) * 2 > g->hash_mask + 1) grow_hash(g);
+    slot = unit_slot(g, name, len);
+    if (*slot) return *slot - 1;
+    if (g->n_units == l->units_cap) {
+        l->units_cap = l->units_cap ? l->units_cap * 2 : 256;
+        g->units = xrealloc(g->units, l->units_cap * sizeof(unit_t));
+    }
+    u = &g->units[g->n_units];
+    memset(u, 0, sizeof(*u));
+    kind = kind_of(name, len);
+    at = memchr(name, '@', len);
+    u->kind = kind < 0 ? UNIT_OTHER : (uint8_t)kind;
+    u->alias_of = UNIT_NONE;
+    u->default_deps = 1;
+    u->is_template = at && at[1] == '.';
+    *slot = g->n_units + 1;
+    u->name = add_string(g, name, len);
+    return g->n_units++;
+}
+
+static void add_edge(loader_t* l, uint32_t from, uint32_t to, uint8_t kind) {
+    if (l->n_edges == l->edges_cap) {
+        l->edges_cap = l->edges_cap ? l->edges_cap * 2 : 1024;
+        l->edges = xrealloc(l->edges, l->edges_cap * sizeof(raw_edge_t));
+    }
+    l->edges[l->n_edges++] = (raw_edge_t){ from, to, kind };
+}
+
+static void add_alias(loader_t* l, uint32_t alias, uint32_t u) {
+    if (l->n_aliases + 2 > l->aliases_cap) {
+        l->aliases_cap = l->aliases_cap ? l->aliases_cap * 2 : 64;
+        l->aliases = xrealloc(l->aliases, l->aliases_cap * sizeof(uint32_t));
+    }
+    l->aliases[l->n_aliases++] = alias;
+    l->aliases[l->n_aliases++] = u;
+}
+
+// Edges between u and each unit name of a space-separated list; reversed
+// makes them point at u (Before=, WantedBy=)
+static void add_edges(loader_t* l, uint32_t u, const char* list, uint8_t kind, int reversed) {
+    const char* p = list;
+
+    while (*p) {
+        size_t n;
+
+        while (*p == ' ' || *p == '\t') p++;
+        n = strcspn(p, " \t");
+        // Names with specifiers (%i) only mean something in an instance
+        if (n && !memchr(p, '%', n) && kind_of(p, n) >= 0) {
+            uint32_t v = intern(l, p, n);
+
+            if (reversed) {
+                add_edge(l, v, u, kind);
+            } else {
+                add_edge(l, u, v, kind);
+            }
+        }
+        p += n;
+    }
+}
+
+// Documentation= and Alias= may be repeated; keep one space-separated list
+static void append_words(unit_graph_t* g, uint32_t* field, const char* value) {
+    char buf[2048];
+
+    if (!*field) {
+        *field = add_string(g, value, strlen(value));
+        return;
+    }
+    snprintf(buf, sizeof(buf), "%s %s", unit_str(g, *field), value);
+    *field = add_string(g, buf, strlen(buf));
+}
+
+static int parse_bool(const char* v) {
+    return strcasecmp(v, "yes") == 0 || strcasecmp(v, "true") == 0 || strcasecmp(v, "on") == 0 || strcmp(v, "1") == 0;
+}
+
+static char* trim(char* s) {
+    char* end;
+
+    while (*s == ' ' || *s == '\t') s++;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    *end = '\0';
+    return s;
+}
+
+// "getty@.service" with instance "tty1": "getty@tty1.service"
+static size_t instance_name(const char* template_name, const char* instance, char* out, size_t len) {
+    const char* at = strchr(template_name, '@');
+
+    return (size_t)snprintf(out, len, "%.*s%s%s", (int)(at - template_name + 1), template_name, instance, at + 1);
+}
+
+static void parse_unit(loader_t* l, uint32_t u, char* text) {
+    enum { SEC_NONE, SEC_UNIT, SEC_SERVICE, SEC_INSTALL, SEC_OTHER } section = SEC_NONE;
+    unit_graph_t* g = l->g;
+    char* install[2] = { NULL, NULL };      // WantedBy=, RequiredBy= values
+    char default_instance[64] = "";
+    char* line = text;
+
+    while (line && *line) {
+        char* next = strchr(line, '\n');
+        char *key, *value, *eq;
+
+        if (next) *next++ = '\0';
+        line = trim(line);
+        if (*line == '[') {
+            section = strcmp(line, "[Unit]") == 0      ? SEC_UNIT
+                      : strcmp(line, "[Service]") == 0 ? SEC_SERVICE
+                      : strcmp(line, "[Install]") == 0 ? SEC_INSTALL
+                                                       : SEC_OTHER;
+        } else if (*line && *line != '#' && *line != ';' && (eq = strchr(line, '=')) != NULL) {
+            *eq = '\0';
+            key = trim(line);
+            value = trim(eq + 1);
+            if (section == SEC_UNIT) {
+                if (strcmp(key, "Description") == 0) {
+                    g->units[u].description = add_string(g, value, strlen(value));
+                } else if (strcmp(key, "Documentation") == 0) {
+                    append_words(g, &g->units[u].docs, value);
+                } else if (strcmp(key, "Requires") == 0 || strcmp(key, "BindsTo") == 0 || strcmp(key, "Requisite") == 0) {
+                    add_edges(l, u, value, UNIT_DEP_REQUIRES, 0);
+                } else if (strcmp(key, "Wants") == 0) {
+                    add_edges(l, u, value, UNIT_DEP_WANTS, 0);
+                } else if (strcmp(key, "After") == 0) {
+                    add_edges(l, u, value, UNIT_DEP_AFTER, 0);
+                } else if (strcmp(key, "Before") == 0) {
+                    add_edges(l, u, value, UNIT_DEP_AFTER, 1);
+                } else if (strcmp(key, "Conflicts") == 0) {
+                    add_edges(l, u, value, UNIT_DEP_CONFLICTS, 0);
+                    add_edges(l, u, value, UNIT_DEP_CONFLICTS, 1);
+                } else if (strcmp(key, "DefaultDependencies") == 0) {
+                    g->units[u].default_deps = (uint8_t)parse_bool(value);
+                } else if (strcmp(key, "RefuseManualStart") == 0) {
+                    g->units[u].refuse_start = (uint8_t)parse_bool(value);
+                } else if (strcmp(key, "RefuseManualStop") == 0) {
+                    g->units[u].refuse_stop = (uint8_t)parse_bool(value);
+                }
+            } else if (section == SEC_SERVICE) {
+                if (strcmp(key, "Type") == 0) {
+                    size_t i;
+
+                    for (i = 0; i < sizeof(type_names) / sizeof(type_names[0]); i++) {
+                        if (strcmp(value, type_names[i]) == 0) g->units[u].type = (uint8_t)i;
+                    }
+                } else if (strcmp(key, "ExecStart") == 0 && !g->units[u].exec) {
+                    value += strspn(value, "-@+!:");
+                    g->units[u].exec = add_string(g, value, strlen(value));
+                } else if (strcmp(key, "ExecReload") == 0) {
+                    g->units[u].reloadable = 1;
+                } else if (strcmp(key, "RemainAfterExit") == 0) {
+                    g->units[u].remain = (uint8_t)parse_bool(value);
+                } else if (strcmp(key, "Restart") == 0) {
+                    g->units[u].restart_always = strcmp(value, "always") == 0;
+                } else if (strcmp(key, "User") == 0) {
+                    g->units[u].user = add_string(g, value, strlen(value));
+                }
+            } else if (section == SEC_INSTALL) {
+                if (strcmp(key, "WantedBy") == 0 || strcmp(key, "RequiredBy") == 0) {
+                    g->units[u].installable = 1;
+                    install[key[0] == 'R'] = value;
+                } else if (strcmp(key, "Alias") == 0) {
+                    const char* p = value;
+
+                    g->units[u].installable = 1;
+                    append_words(g, &g->units[u].aliases, value);
+                    while (*p) {
+                        size_t n;
+
+                        while (*p == ' ') p++;
+                        n = strcspn(p, " ");
+                        if (n && kind_of(p, n) >= 0) add_alias(l, intern(l, p, n), u);
+                        p += n;
+                    }
+                } else if (strcmp(key, "Also") == 0) {
+                    g->units[u].installable = 1;
+                } else if (strcmp(key, "DefaultInstance") == 0) {
+                    snprintf(default_instance, sizeof(default_instance), "%s", value);
+                }
+            }
+        }
+        line = next;
+    }
+
+    // Enabling a template enables its default instance
+    if (install[0] || install[1]) {
+        uint32_t target = u;
+
+        if (g->units[u].is_template) {
+            char name[256];
+
+            if (!*default_instance) return;
+            target = intern(l, name, instance_name(unit_name(g, u), default_instance, name, sizeof(name)));
+        }
+        if (install[0]) add_edges(l, target, install[0], UNIT_DEP_WANTS | UNIT_DEP_INSTALLED, 1);
+        if (install[1]) add_edges(l, target, install[1], UNIT_DEP_REQUIRES | UNIT_DEP_INSTALLED, 1);
+    }
+}
+
+static void load_file(loader_t* l, const char* path, const char* shown, uint32_t u) {
+    unit_graph_t* g = l->g;
+    char shown_path[MAX_PATH];
+    char* text;
+    int n;
+
+    if (g->units[u].loaded) return;     // an earlier directory has it
+    text = read_file(path, NULL);
+    if (!text) return;
+    g->units[u].loaded = 1;
+    g->units[u].file = add_string(g, path, strlen(path));
+    n = snprintf(shown_path, sizeof(shown_path), "%s/%s", shown, unit_name(g, u));
+    g->units[u].shown = add_string(g, shown_path, (size_t)n);
+    parse_unit(l, u, text);
+    free(text);
+    g->n_files++;
+}
+
+// NAME.wants/ and NAME.requires/: each entry is a dependency of NAME.
+// In the first directory they are what "systemctl enable" created.
+static void load_links(loader_t* l, const char* path, const char* name, int config) {
+    size_t len = strlen(name), owner_len;
+    uint8_t kind;
+    uint32_t owner;
+    struct dirent* e;
+    DIR* d;
+
+    if (len > 6 && strcmp(name + len - 6, ".wants") == 0) {
+        kind = UNIT_DEP_WANTS;
+        owner_len = len - 6;
+    } else if (len > 9 && strcmp(name + len - 9, ".requires") == 0) {
+        kind = UNIT_DEP_REQUIRES;
+        owner_len = len - 9;
+    } else {
+        return;
+    }
+    if (kind_of(name, owner_len) < 0 || (d = opendir(path)) == NULL) return;
+    owner = intern(l, name, owner_len);
+    if (config) kind |= UNIT_DEP_INSTALLED;
+    while ((e = readdir(d)) != NULL) {
+        size_t n = strlen(e->d_name);
+        uint32_t v;
+
+        if (kind_of(e->d_name, n) < 0) continue;
+        v = intern(l, e->d_name, n);
+        add_edge(l, owner, v, kind);
+        if (config) l->g->units[v].enabled = 1;
+    }
+    closedir(d);
+}
+
+static int load_dir(loader_t* l, const char* dir, const char* shown, int config) {
+    unit_graph_t* g = l->g;
+    char path[MAX_PATH], target[MAX_PATH];
+    struct dirent* e;
+    DIR* d = opendir(dir);
+
+    if (!d) return errno == ENOENT ? 0 : -errno;
+    while ((e = readdir(d)) != NULL) {
+        const char* name = e->d_name;
+        size_t len = strlen(name);
+        struct stat st;
+
+        if (name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (lstat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            load_links(l, path, name, config);
+            continue;
+        }
+        if (kind_of(name, len) < 0) continue;
+        if (S_ISLNK(st.st_mode)) {
+            ssize_t n = readlink(path, target, sizeof(target) - 1);
+            const char* base;
+            uint32_t u;
+
+            if (n <= 0) continue;
+            target[n] = '\0';
+            u = intern(l, name, len);
+            if (strcmp(target, "/dev/null") == 0) {
+                if (!g->units[u].loaded) g->units[u].masked = 1;
+                continue;
+            }
+            // A link under another name is an alias; under the same name
+            // it is the unit file itself, kept elsewhere
+            base = strrchr(target, '/');
+            base = base ? base + 1 : target;
+            if (strcmp(base, name) != 0) {
+                if (kind_of(base, strlen(base)) >= 0) add_alias(l, u, intern(l, base, strlen(base)));
+                continue;
+            }
+            if (stat(path, &st) != 0) continue;
+        }
+        if (S_ISREG(st.st_mode)) load_file(l, path, shown, intern(l, name, len));
+    }
+    closedir(d);
+    return 0;
+}
+
+// "getty@tty1.service" from "getty@.service": the template's settings
+// and dependencies, with %i/%I in the description filled in
+static void instantiate(loader_t* l, uint32_t u) {
+    unit_graph_t* g = l->g;
+    const char* name = unit_name(g, u);
+    const char* at = strchr(name, '@');
+    const char* dot = strrchr(name, '.');
+    char template_name[256], instance[128], desc[512];
+    const char* p;
+    uint32_t t, n_edges = l->n_edges, i;
+    unit_t* unit;
+    size_t len = 0;
+
+    if (!at || !dot || dot < at) return;
+    snprintf(template_name, sizeof(template_name), "%.*s%s", (int)(at - name + 1), name, dot);
+    snprintf(instance, sizeof(instance), "%.*s", (int)(dot - at - 1), at + 1);
+    t = systemd_find(g, template_name, strlen(template_name));
+    if (t == UNIT_NONE || !g->units[t].loaded) return;
+
+    unit = &g->units[u];
+    *unit = (unit_t){
+        .name = unit->name,
+        .docs = g->units[t].docs,
+        .aliases = 0,
+        .exec = g->units[t].exec,
+        .user = g->units[t].user,
+        .file = g->units[t].file,
+        .shown = g->units[t].shown,
+        .alias_of = UNIT_NONE,
+        .kind = g->units[t].kind,
+        .loaded = 1,
+        .type = g->units[t].type,
+        .remain = g->units[t].remain,
+        .restart_always = g->units[t].restart_always,
+        .reloadable = g->units[t].reloadable,
+        .installable = g->units[t].installable,
+        .enabled = unit->enabled,
+        .masked = unit->masked,
+        .default_deps = g->units[t].default_deps,
+        .refuse_start = g->units[t].refuse_start,
+        .refuse_stop = g->units[t].refuse_stop,
+    };
+    if (unit->enabled) g->units[t].enabled = 1;
+    for (p = unit_str(g, g->units[t].description); *p && len < sizeof(desc) - 1; p++) {
+        if (p[0] == '%' && (p[1] == 'i' || p[1] == 'I')) {
+            len += (size_t)snprintf(desc + len, sizeof(desc) - len, "%s", instance);
+            if (len >= sizeof(desc)) len = sizeof(desc) - 1;
+            p++;
+        } else {
+            desc[len++] = *p;
+        }
+    }
+    unit->description = add_string(g, desc, len);
+
+    for (i = 0; i < n_edges; i++) {
+        raw_edge_t e = l->edges[i];
+
+        if (e.from == t && !(e.kind & UNIT_DEP_INSTALLED)) {
+            add_edge(l, u, e.to, e.kind);
+        } else if (e.to == t && (e.kind == UNIT_DEP_AFTER || e.kind == UNIT_DEP_CONFLICTS)) {
+            add_edge(l, e.from, u, e.kind);
+        }
+    }
+}
+
+static int compare_edges(const void* a, const void* b) {
+    const raw_edge_t* x = a;
+    const raw_edge_t* y = b;
+
+    if (x->from != y->from) return x->from < y->from ? -1 : 1;
+    if (x->kind != y->kind) return x->kind < y->kind ? -1 : 1;
+    if (x->to != y->to) return x->to < y->to ? -1 : 1;
+    return 0;
+}
+
+static int has_edge(const loader_t* l, uint32_t from, uint32_t to, uint8_t kind) {
+    raw_edge_t key = { from, to, kind };
+
+    return bsearch(&key, l->edges, l->n_edges, sizeof(raw_edge_t), compare_edges) != NULL;
+}
+
+static void sort_edges(loader_t* l) {
+    uint32_t i, out = 0;
+
+    qsort(l->edges, l->n_edges, sizeof(raw_edge_t), compare_edges);
+    for (i = 0; i < l->n_edges; i++) {
+        raw_edge_t e = l->edges[i];
+
+        if (e.from == e.to) continue;
+        if (out && compare_edges(&l->edges[out - 1], &e) == 0) continue;
+        l->edges[out++] = e;
+    }
+    l->n_edges = out;
+}
+
+// The dependencies systemd adds unless a unit says DefaultDependencies=no
+static void add_default_deps(loader_t* l) {
+    unit_graph_t* g = l->g;
+    uint32_t sysinit = UNIT_NONE, basic = UNIT_NONE, shutdown = UNIT_NONE;
+    uint32_t sockets = UNIT_NONE, timers = UNIT_NONE;
+    uint32_t n = g->n_units, n_edges, u, i;
+
+#define TARGET(var, name) (var == UNIT_NONE ? (var = intern(l, name, strlen(name))) : var)
+    for (u = 0; u < n; u++) {
+        const unit_t* unit = &g->units[u];
+        uint8_t kind = unit->kind;
+
+        if (!unit->loaded || !unit->default_deps || unit->alias_of != UNIT_NONE) continue;
+        if (kind == UNIT_SERVICE || kind == UNIT_SOCKET || kind == UNIT_TIMER) {
+            add_edge(l, u, TARGET(sysinit, "sysinit.target"), UNIT_DEP_REQUIRES);
+            add_edge(l, u, sysinit, UNIT_DEP_AFTER);
+            if (kind == UNIT_SERVICE) add_edge(l, u, TARGET(basic, "basic.target"), UNIT_DEP_AFTER);
+            if (kind == UNIT_SOCKET) add_edge(l, TARGET(sockets, "sockets.target"), u, UNIT_DEP_AFTER);
+            if (kind == UNIT_TIMER) add_edge(l, TARGET(timers, "timers.target"), u, UNIT_DEP_AFTER);
+        }
+        if (kind == UNIT_SERVICE || kind == UNIT_SOCKET || kind == UNIT_TIMER || kind == UNIT_TARGET) {
+            add_edge(l, TARGET(shutdown, "shutdown.target"), u, UNIT_DEP_AFTER);
+            add_edge(l, u, shutdown, UNIT_DEP_CONFLICTS);
+            add_edge(l, shutdown, u, UNIT_DEP_CONFLICTS);
+        }
+    }
+#undef TARGET
+
+    // A target is reached after what it pulls in, unless that would
+    // order the two both ways
+    sort_edges(l);
+    n_edges = l->n_edges;
+    for (i = 0; i < n_edges; i++) {
+        raw_edge_t e = l->edges[i];
+        const unit_t* from = &g->units[e.from];
+        uint8_t kind = e.kind & 0x7f;
+
+        if ((kind == UNIT_DEP_REQUIRES || kind == UNIT_DEP_WANTS) && from->kind == UNIT_TARGET && from->loaded &&
+            from->default_deps && !has_edge(l, e.to, e.from, UNIT_DEP_AFTER)) {
+            add_edge(l, e.from, e.to, UNIT_DEP_AFTER);
+        }
+    }
+}
+
+static uint32_t activation_cost(const unit_graph_t* g, const unit_t* u) {
+    uint32_t h = hash_name(unit_str(g, u->name), strlen(unit_str(g, u->name)));
+
+    if (!u->loaded) return 0;
+    switch (u->kind) {
+        case UNIT_SERVICE:
+            return u->type == UNIT_TYPE_ONESHOT ? 4 + h % 160 : 12 + h % 380;
+        case UNIT_MOUNT:
+            return 3 + h % 40;
+        default:
+            return 0;
+    }
+}
+
+static void finish(loader_t* l) {
+    unit_graph_t* g = l->g;
+    uint32_t i, n, pos;
+
+    for (i = 0; i < l->n_aliases; i += 2) {
+        unit_t* a = &g->units[l->aliases[i]];
+
+        if (l->aliases[i] != l->aliases[i + 1] && !a->loaded && a->alias_of == UNIT_NONE) a->alias_of = l->aliases[i + 1];
+    }
+    for (i = 0; i < g->n_units; i++) {
+        uint32_t r = resolve(g, i);
+
+        if (r != i) {
+            g->units[r].enabled |= g->units[i].enabled;
+            g->units[r].masked |= g->units[i].masked;
+        }
+    }
+    for (i = 0; i < l->n_edges; i++) {
+        l->edges[i].from = resolve(g, l->edges[i].from);
+        l->edges[i].to = resolve(g, l->edges[i].to);
+    }
+    n = g->n_units;
+    for (i = 0; i < n; i++) {
+        const unit_t* u = &g->units[i];
+
+        if (!u->loaded && u->alias_of == UNIT_NONE && !u->is_template && strchr(unit_name(g, i), '@')) instantiate(l, i);
+    }
+    add_default_deps(l);
+    sort_edges(l);
+
+    // Forward edges are the sorted array; reverse ones the same regrouped
+    g->n_deps = l->n_edges;
+    g->deps = xcalloc(g->n_deps, sizeof(unit_dep_t));
+    g->rdeps = xcalloc(g->n_deps, sizeof(unit_dep_t));
+    for (i = 0; i < g->n_units; i++) {
+        g->units[i].first_dep = g->units[i].n_deps = 0;
+        g->units[i].first_rdep = g->units[i].n_rdeps = 0;
+    }
+    for (i = 0; i < g->n_deps; i++) {
+        raw_edge_t e = l->edges[i];
+
+        if (g->units[e.from].n_deps++ == 0) g->units[e.from].first_dep = i;
+        g->deps[i] = (unit_dep_t){ e.to, e.kind };
+        g->units[e.to].n_rdeps++;
+    }
+    for (i = 0, pos = 0; i < g->n_units; i++) {
+        g->units[i].first_rdep = pos;
+        pos += g->units[i].n_rdeps;
+        g->units[i].n_rdeps = 0;
+    }
+    for (i = 0; i < g->n_deps; i++) {
+        raw_edge_t e = l->edges[i];
+        unit_t* to = &g->units[e.to];
+
+        g->rdeps[to->first_rdep + to->n_rdeps++] = (unit_dep_t){ e.from, e.kind };
+    }
+
+    for (i = 0; i < g->n_units; i++) g->units[i].cost_ms = activation_cost(g, &g->units[i]);
+    g->default_target = systemd_find(g, "default.target", 14);
+    if (g->default_target == UNIT_NONE || !g->units[g->default_target].loaded) {
+        g->default_target = systemd_find(g, "multi-user.target", 17);
+    }
+}
+
+unit_graph_t* systemd_load(const char* const* dirs, const char* const* shown, uint32_t n_dirs, char* err, size_t err_len) {
+    loader_t l;
+    uint32_t i;
+    int rc;
+
+    memset(&l, 0, sizeof(l));
+    l.g = xcalloc(1, sizeof(unit_graph_t));
+    l.g->strings_cap = 4096;
+    l.g->strings = xrealloc(NULL, l.g->strings_cap);
+    l.g->strings[0] = '\0';
+    l.g->strings_len = 1;
+    grow_hash(l.g);
+
+    for (i = 0; i < n_dirs; i++) {
+        if ((rc = load_dir(&l, dirs[i], shown ? shown[i] : dirs[i], i == 0)) < 0) {
+            set_error(err, err_len, "%s: %s", dirs[i], strerror(-rc));
+            break;
+        }
+    }
+    if (i == n_dirs && !l.g->n_files) set_error(err, err_len, "%s: no unit files", n_dirs > 1 ? dirs[1] : dirs[0]);
+    if (i < n_dirs || !l.g->n_files) {
+        free(l.edges);
+        free(l.aliases);
+        systemd_free(l.g);
+        return NULL;
+    }
+    l.g->config_dir = add_string(l.g, shown ? shown[0] : dirs[0], strlen(shown ? shown[0] : dirs[0]));
+    finish(&l);
+    free(l.edges);
+    free(l.aliases);
+    return l.g;
+}
+
+void systemd_free(unit_graph_t* g) {
+    if (!g) return;
+    free(g->units);
+    free(g->deps);
+    free(g->rdeps);
+    free(g->strings);
+    free(g->hash);
+    free(g);
+}
+
+static unit_graph_t* shared_graph;
+static pthread_once_t shared_once = PTHREAD_ONCE_INIT;
+
+static void open_shared(void) {
+    const char* env_path = getenv("DEB1_UNIT_PATH");
+    char err[256];
+
+    if (env_path && *env_path) {
+        char paths[MAX_PATH];
+        const char* dirs[16];
+        uint32_t n = 0;
+        char* p;
+
+        snprintf(paths, sizeof(paths), "%s", env_path);
+        for (p = strtok(paths, ":"); p && n < 16; p = strtok(NULL, ":")) dirs[n++] = p;
+        if (n) shared_graph = systemd_load(dirs, NULL, n, err, sizeof(err));
+        if (!shared_graph) fprintf(stderr, "%s\n", n ? err : "DEB1_UNIT_PATH: no directories");
+        return;
+    }
+    if (access(bundled_dirs[1], R_OK) == 0) {
+        shared_graph = systemd_load(bundled_dirs, bundled_shown, 2, err, sizeof(err));
+    }
+}
+
+unit_graph_t* systemd_shared(void) {
+    pthread_once(&shared_once, open_shared);
+    return shared_graph;
+}
+
+// ---------------------------------------------------------------------
+// Transactions
+
+enum { UNIT_INACTIVE, UNIT_ACTIVE, UNIT_FAILED };
+enum { JOB_NONE, JOB_START, JOB_NOOP, JOB_FAILED, JOB_DEPENDENCY };
+
+#define FILE_ENABLED 0x01
+#define FILE_MASKED 0x02
+
+typedef struct {
+    uint8_t* job;           // per unit: JOB_*
+    uint32_t* at;           // per unit: ms into the transaction its job started
+    uint32_t* done;         // ... and finished
+    uint32_t* after;        // the job it waited for last, UNIT_NONE for none
+    uint32_t* pending;      // scratch: ordering predecessors not done yet
+    uint32_t* order;        // the jobs, in the order they were scheduled
+    uint32_t* queue;        // scratch
+    uint32_t n_jobs;
+    uint32_t total_ms;      // until the last job finished
+    uint32_t broken;        // ordering cycles broken
+} unit_plan_t;
+
+struct systemd_state {
+    uint8_t* active;        // UNIT_INACTIVE, UNIT_ACTIVE, UNIT_FAILED
+    uint8_t* file;          // FILE_ENABLED, FILE_MASKED
+    int32_t* main_pid;      // negative: the main process died
+    time_t* since;          // last change of the active state, 0 = never
+    unit_plan_t boot;       // the boot transaction, for systemd-analyze
+    time_t boot_time;       // kernel start
+};
+
+static void plan_init(unit_plan_t* p, uint32_t n) {
+    memset(p, 0, sizeof(*p));
+    p->job = xcalloc(n, sizeof(uint8_t));
+    p->at = xcalloc(n, sizeof(uint32_t));
+    p->done = xcalloc(n, sizeof(uint32_t));
+    p->after = xcalloc(n, sizeof(uint32_t));
+    p->pending = xcalloc(n, sizeof(uint32_t));
+    p->order = xcalloc(n, sizeof(uint32_t));
+    p->queue = xcalloc(n, sizeof(uint32_t));
+}
+
+static void plan_free(unit_plan_t* p) {
+    free(p->job);
+    free(p->at);
+    free(p->done);
+    free(p->after);
+    free(p->pending);
+    free(p->order);
+    free(p->queue);
+}
+
+static void plan_clear(unit_plan_t* p) {
+    uint32_t i;
+
+    for (i = 0; i < p->n_jobs; i++) p->job[p->order[i]] = JOB_NONE;
+    p->n_jobs = p->total_ms = p->broken = 0;
+}
+
+// Installed edges hold while the unit they lead to is enabled
+static int edge_holds(const struct systemd_state* s, const unit_dep_t* d) {
+    return !(d->kind & UNIT_DEP_INSTALLED) || (s->file[d->unit] & FILE_ENABLED);
+}
+
+static int startable(const unit_graph_t* g, const struct systemd_state* s, uint32_t u) {
+    return g->units[u].loaded && !g->units[u].is_template && !(s->file[u] & FILE_MASKED);
+}
+
+static void add_job(unit_plan_t* p, uint32_t u, uint8_t job) {
+    p->job[u] = job;
+    p->order[p->n_jobs++] = u;
+}
+
+// Active units get a job that does nothing, so that what they pull in
+// is still part of the transaction
+static uint8_t job_for(const unit_graph_t* g, const struct systemd_state* s, uint32_t u) {
+    if (s->active[u] == UNIT_ACTIVE) return JOB_NOOP;
+    return startable(g, s, u) ? JOB_START : JOB_FAILED;
+}
+
+// Start roots and what they pull in, as a schedule of parallel jobs.
+// Jobs of units that cannot start fail, and so do the jobs that require
+// them. The order is Kahn's: a job is scheduled once every job it is
+// ordered after is, and starts when the last of those finishes.
+static void plan_start(const unit_graph_t* g, const struct systemd_state* s, const uint32_t* roots, uint32_t n_roots,
+                       unit_plan_t* p) {
+    uint32_t i, j, head = 0, tail = 0, scheduled = 0, cursor = 0;
+
+    plan_clear(p);
+    for (i = 0; i < n_roots; i++) {
+        if (p->job[roots[i]] == JOB_NONE) add_job(p, roots[i], job_for(g, s, roots[i]));
+    }
+    for (i = 0; i < p->n_jobs; i++) {
+        uint32_t u = p->order[i];
+        const unit_t* unit = &g->units[u];
+
+        if (p->job[u] == JOB_FAILED) continue;
+        for (j = 0; j < unit->n_deps; j++) {
+            const unit_dep_t* d = &g->deps[unit->first_dep + j];
+            uint8_t kind = UNIT_DEP_KIND(d), job;
+
+            if ((kind != UNIT_DEP_REQUIRES && kind != UNIT_DEP_WANTS) || p->job[d->unit] != JOB_NONE || !edge_holds(s, d)) {
+                continue;
+            }
+            job = job_for(g, s, d->unit);
+            if (job != JOB_FAILED || kind == UNIT_DEP_REQUIRES) add_job(p, d->unit, job);
+        }
+    }
+
+    // Failures travel back along Requires=
+    for (i = 0; i < p->n_jobs; i++) {
+        if (p->job[p->order[i]] == JOB_FAILED) p->queue[tail++] = p->order[i];
+    }
+    while (head < tail) {
+        const unit_t* unit = &g->units[p->queue[head++]];
+
+        for (j = 0; j < unit->n_rdeps; j++) {
+            const unit_dep_t* d = &g->rdeps[unit->first_rdep + j];
+
+            if (UNIT_DEP_KIND(d) == UNIT_DEP_REQUIRES && p->job[d->unit] == JOB_START && edge_holds(s, d)) {
+                p->job[d->unit] = JOB_DEPENDENCY;
+                p->queue[tail++] = d->unit;
+            }
+        }
+    }
+
+    head = tail = 0;
+    for (i = 0; i < p->n_jobs; i++) {
+        uint32_t u = p->order[i];
+        const unit_t* unit = &g->units[u];
+
+        p->at[u] = 0;
+        p->after[u] = UNIT_NONE;
+        p->pending[u] = 0;
+        for (j = 0; j < unit->n_deps; j++) {
+            const unit_dep_t* d = &g->deps[unit->first_dep + j];
+
+            if (UNIT_DEP_KIND(d) == UNIT_DEP_AFTER && p->job[d->unit] != JOB_NONE) p->pending[u]++;
+        }
+        if (!p->pending[u]) p->queue[tail++] = u;
+    }
+    while (scheduled < p->n_jobs) {
+        uint32_t u;
+        const unit_t* unit;
+
+        if (head == tail) {
+            // An ordering cycle: systemd drops a job from it, this starts
+            // the first one waiting without its remaining predecessors
+            while (!p->pending[p->order[cursor]]) cursor++;
+            p->pending[p->order[cursor]] = 0;
+            p->queue[tail++] = p->order[cursor];
+            p->broken++;
+        }
+        u = p->queue[head++];
+        unit = &g->units[u];
+        scheduled++;
+        p->done[u] = p->at[u] + (p->job[u] == JOB_START ? unit->cost_ms : 0);
+        if (p->done[u] > p->total_ms) p->total_ms = p->done[u];
+        for (j = 0; j < unit->n_rdeps; j++) {
+            const unit_dep_t* d = &g->rdeps[unit->first_rdep + j];
+            uint32_t v = d->unit;
+
+            if (UNIT_DEP_KIND(d) != UNIT_DEP_AFTER || p->job[v] == JOB_NONE || !p->pending[v]) continue;
+            if (p->after[v] == UNIT_NONE || p->done[u] >= p->at[v]) {
+                p->at[v] = p->done[u];
+                p->after[v] = u;
+            }
+            if (--p->pending[v] == 0) p->queue[tail++] = v;
+        }
+    }
+    memcpy(p->order, p->queue, p->n_jobs * sizeof(uint32_t));
+}
+
+// What stopping u takes down with it: the active units that require it
+static uint32_t plan_stop(const unit_graph_t* g, const struct systemd_state* s, uint32_t u, unit_plan_t* p) {
+    uint32_t i, j;
+
+    plan_clear(p);
+    add_job(p, u, JOB_START);
+    for (i = 0; i < p->n_jobs; i++) {
+        const unit_t* unit = &g->units[p->order[i]];
+
+        for (j = 0; j < unit->n_rdeps; j++) {
+            const unit_dep_t* d = &g->rdeps[unit->first_rdep + j];
+
+            if (UNIT_DEP_KIND(d) == UNIT_DEP_REQUIRES && p->job[d->unit] == JOB_NONE && s->active[d->unit] != UNIT_INACTIVE &&
+                edge_holds(s, d)) {
+                add_job(p, d->unit, JOB_START);
+            }
+        }
+    }
+    return p->n_jobs;
+}
+
+// ---------------------------------------------------------------------
+// Unit states and processes
+
+static int word_is(const char* s, const char* word, size_t len) {
+    return strncmp(s, word, len) == 0 && (s[len] == ' ' || s[len] == '\0');
+}
+
+// The running process a unit stands for: started by init, with the
+// unit's program as command (or as its interpreter's script), or named
+// like the unit
+static int32_t find_main_process(const unit_graph_t* g, uint32_t u, const proc_table_t* pt) {
+    const char* exec = unit_str(g, g->units[u].exec);
+    const char* name = unit_name(g, u);
+    size_t exec_len = strcspn(exec, " "), stem_len = strcspn(name, "@.");
+    uint32_t i;
+
+    for (i = 0; i < pt->count; i++) {
+        const char* cmd = proc_cmd(pt, (int)i);
+        const char* second = cmd + strcspn(cmd, " ");
+
+        if (pt->ppid[i] != 1) continue;
+        if (*second) second++;
+        if ((exec_len && (word_is(cmd, exec, exec_len) || word_is(second, exec, exec_len))) ||
+            (strncmp(proc_comm(pt, (int)i), name, stem_len) == 0 && proc_comm(pt, (int)i)[stem_len] == '\0')) {
+            return pt->pid[i];
+        }
+    }
+    return 0;
+}
+
+static int has_main_process(const unit_t* u) {
+    return u->kind == UNIT_SERVICE && u->exec && u->type != UNIT_TYPE_ONESHOT;
+}
+
+// Processes of a unit's control group: the main one and its children,
+// except login sessions (sshd's), which have their own scope
+static uint32_t cgroup_members(const proc_table_t* pt, int32_t main_pid, int* out, uint32_t max) {
+    uint32_t i, n = 0;
+
+    for (i = 0; i < pt->count && n < max; i++) {
+        if (pt->pid[i] == main_pid || (pt->ppid[i] == main_pid && !(pt->flags[i] & PROC_SESSION_LEADER))) {
+            out[n++] = (int)i;
+        }
+    }
+    return n;
+}
+
+static void spawn_main(const unit_graph_t* g, struct systemd_state* s, proc_table_t* pt, uint32_t u) {
+    const unit_t* unit = &g->units[u];
+    const char* p = unit_str(g, unit->exec);
+    char cmd[256];
+    uint32_t uid = 0;
+    size_t len = 0;
+
+    // The command line as ps shows it: no unset $VARIABLES, no quotes
+    while (*p && len < sizeof(cmd) - 1) {
+        size_t n;
+
+        while (*p == ' ') p++;
+        n = strcspn(p, " ");
+        if (n && *p != '$') {
+            size_t i;
+
+            if (len) cmd[len++] = ' ';
+            for (i = 0; i < n && len < sizeof(cmd) - 1; i++) {
+                if (p[i] != '\'' && p[i] != '"' && !(p[i] == '\\' && p[i + 1] == '\\')) cmd[len++] = p[i];
+            }
+        }
+        p += n;
+    }
+    cmd[len] = '\0';
+    if (unit->user) sim_user_id(unit_str(g, unit->user), &uid);
+    s->main_pid[u] = proc_spawn(pt, 1, uid, cmd, 0.0001f, 4096, PROC_SESSION_LEADER);
+}
+
+static void activate(const unit_graph_t* g, struct systemd_state* s, proc_table_t* pt, uint32_t u, time_t now) {
+    const unit_t* unit = &g->units[u];
+
+    s->since[u] = now;
+    if (unit->kind == UNIT_SERVICE && unit->type == UNIT_TYPE_ONESHOT && !unit->remain) {
+        // Ran and exited
+        s->active[u] = UNIT_INACTIVE;
+        return;
+    }
+    s->active[u] = UNIT_ACTIVE;
+    if (pt && has_main_process(unit)) spawn_main(g, s, pt, u);
+}
+
+static void deactivate(struct systemd_state* s, proc_table_t* pt, uint32_t u, time_t now) {
+    if (pt && s->main_pid[u] > 0) {
+        int members[64];
+        uint32_t n = cgroup_members(pt, s->main_pid[u], members, 64), i;
+        int32_t pids[64];
+
+        // Children first, so that they are not handed to init
+        for (i = 0; i < n; i++) pids[i] = pt->pid[members[i]];
+        for (i = n; i-- > 0;) proc_signal(pt, pids[i], SIGTERM, 0);
+    }
+    s->main_pid[u] = 0;
+    s->active[u] = UNIT_INACTIVE;
+    s->since[u] = now;
+}
+
+// The session's machine as booted: default.target's transaction with the
+// units' shipped enablement, main processes matched in the process table
+static struct systemd_state* state_boot(const unit_graph_t* g, proc_table_t* pt, time_t boot_time) {
+    struct systemd_state* s = xcalloc(1, sizeof(*s));
+    uint32_t i;
+
+    s->active = xcalloc(g->n_units, sizeof(uint8_t));
+    s->file = xcalloc(g->n_units, sizeof(uint8_t));
+    s->main_pid = xcalloc(g->n_units, sizeof(int32_t));
+    s->since = xcalloc(g->n_units, sizeof(time_t));
+    s->boot_time = boot_time;
+    for (i = 0; i < g->n_units; i++) {
+        s->file[i] = (g->units[i].enabled ? FILE_ENABLED : 0) | (g->units[i].masked ? FILE_MASKED : 0);
+    }
+    plan_init(&s->boot, g->n_units);
+    if (g->default_target == UNIT_NONE) return s;
+    plan_start(g, s, &g->default_target, 1, &s->boot);
+    for (i = 0; i < s->boot.n_jobs; i++) {
+        uint32_t u = s->boot.order[i];
+        const unit_t* unit = &g->units[u];
+        int j;
+
+        if (s->boot.job[u] != JOB_START) continue;
+        s->since[u] = boot_time + (KERNEL_MS + s->boot.done[u]) / 1000;
+        s->active[u] = unit->kind == UNIT_SERVICE && unit->type == UNIT_TYPE_ONESHOT && !unit->remain ? UNIT_INACTIVE
+                                                                                                  : UNIT_ACTIVE;
+        if (pt && has_main_process(unit) && (s->main_pid[u] = find_main_process(g, u, pt)) != 0 &&
+            (j = proc_find(pt, s->main_pid[u])) >= 0) {
+            s->since[u] = pt->start[j];
+        }
+    }
+    return s;
+}
+
+void systemd_state_free(struct systemd_state* s) {
+    if (!s) return;
+    free(s->active);
+    free(s->file);
+    free(s->main_pid);
+    free(s->since);
+    plan_free(&s->boot);
+    free(s);
+}
+
+// What systemd writes to the journal about a unit changing state
+static void log_unit(const unit_graph_t* g, const struct systemd_state* s, uint32_t u, sdj_unit_event_t event) {
+    sdj_unit_event(unit_name(g, u), unit_str(g, g->units[u].description), event, s->main_pid[u] > 0 ? s->main_pid[u] : 0);
+}
+
+// Catch up with processes killed behind systemd's back: Restart=always
+// brings them back, anything else leaves the unit failed
+static void refresh(const unit_graph_t* g, struct systemd_state* s, proc_table_t* pt, time_t now) {
+    uint32_t i;
+
+    for (i = 0; i < g->n_units; i++) {
+        if (s->main_pid[i] <= 0 || proc_find(pt, s->main_pid[i]) >= 0) continue;
+        log_unit(g, s, i, SDJ_UNIT_KILLED);
+        if (g->units[i].restart_always) {
+            spawn_main(g, s, pt, i);
+            s->since[i] = now;
+            log_unit(g, s, i, SDJ_UNIT_RESTART);
+        } else {
+            s->main_pid[i] = -s->main_pid[i];
+            s->active[i] = UNIT_FAILED;
+            s->since[i] = now;
+        }
+    }
+}
+
+static struct systemd_state* session_units(const unit_graph_t* g, proc_table_t* pt) {
+    sim_env_t* env = sim_env();
+
+    if (!env->units) {
+        env->units = state_boot(g, pt, pt->boot);
+    } else {
+        refresh(g, env->units, pt, env->clock);
+    }
+    return env->units;
+}
+
+time_t systemd_session_boot(systemd_boot_fn fn, void* ctx) {
+    const unit_graph_t* g = systemd_shared();
+    proc_table_t* pt = proc_session();
+    const struct systemd_state* s;
+    uint32_t i;
+
+    if (!g) return pt->boot;
+    s = session_units(g, pt);
+    for (i = 0; i < s->boot.n_jobs; i++) {
+        uint32_t u = s->boot.order[i];
+
+        if (s->boot.job[u] != JOB_START) continue;
+        fn(ctx, g, u, KERNEL_MS + s->boot.at[u], KERNEL_MS + s->boot.done[u], s->main_pid[u] > 0 ? s->main_pid[u] : 0);
+    }
+    return s->boot_time;
+}
+
+// ---------------------------------------------------------------------
+// Formatting
+
+static const char* active_word(const struct systemd_state* s, uint32_t u) {
+    static const char* const words[] = { "inactive", "active", "failed" };
+
+    return words[s->active[u]];
+}
+
+static const char* sub_word(const unit_graph_t* g, const struct systemd_state* s, uint32_t u) {
+    const unit_t* unit = &g->units[u];
+
+    if (s->active[u] == UNIT_FAILED) return "failed";
+    if (s->active[u] == UNIT_INACTIVE) return "dead";
+    switch (unit->kind) {
+        case UNIT_SERVICE:
+            return unit->type == UNIT_TYPE_ONESHOT || !unit->exec ? "exited" : "running";
+        case UNIT_SOCKET:
+            return "listening";
+        case UNIT_TIMER:
+        case UNIT_PATH:
+            return "waiting";
+        case UNIT_MOUNT:
+            return "mounted";
+        default:
+            return "active";
+    }
+}
+
+static const char* load_word(const unit_graph_t* g, const struct systemd_state* s, uint32_t u) {
+    if (s->file[u] & FILE_MASKED) return "masked";
+    return g->units[u].loaded ? "loaded" : "not-found";
+}
+
+static const char* file_word(const unit_graph_t* g, const struct systemd_state* s, uint32_t u) {
+    if (s->file[u] & FILE_MASKED) return "masked";
+    if (g->units[u].alias_of != UNIT_NONE) return "alias";
+    if (!g->units[u].installable) return "static";
+    return s->file[u] & FILE_ENABLED ? "enabled" : "disabled";
+}
+
+// Like systemd's timespans: "153ms", "2.39s", "1min 4.2s"
+static void format_span(uint64_t ms, char* buf, size_t len) {
+    size_t n = 0;
+
+    if (ms >= 60000) {
+        n = (size_t)snprintf(buf, len, "%llumin%s", (unsigned long long)(ms / 60000), ms % 60000 ? " " : "");
+        ms %= 60000;
+        if (!ms) return;
+    }
+    if (ms >= 1000) {
+        char frac[8];
+        int digits = 3;
+
+        snprintf(frac, sizeof(frac), "%03u", (unsigned)(ms % 1000));
+        while (digits > 0 && frac[digits - 1] == '0') frac[--digits] = '\0';
+        snprintf(buf + n, len - n, "%u%s%ss", (unsigned)(ms / 1000), digits ? "." : "", frac);
+    } else {
+        snprintf(buf + n, len - n, ms || !n ? "%ums" : "", (unsigned)ms);
+        if (!ms && !n) snprintf(buf, len, "0");
+    }
+}
+
+static void format_ago(time_t d, char* buf, size_t len) {
+    long w, days;
+
+    if (d >= 2629800) {
+        long months = (long)(d / 2629800);
+
+        days = (long)((d % 2629800) / 86400);
+        snprintf(buf, len, "%ld month%s %ld day%s ago", months, months == 1 ? "" : "s", days, days == 1 ? "" : "s");
+    } else if (d >= 604800) {
+        w = (long)(d / 604800);
+        days = (long)((d % 604800) / 86400);
+        snprintf(buf, len, "%ld week%s %ld day%s ago", w, w == 1 ? "" : "s", days, days == 1 ? "" : "s");
+    } else if (d >= 2 * 86400) {
+        snprintf(buf, len, "%ld days ago", (long)(d / 86400));
+    } else if (d >= 25 * 3600) {
+        snprintf(buf, len, "1 day %ldh ago", (long)((d - 86400) / 3600));
+    } else if (d >= 3600) {
+        snprintf(buf, len, "%ldh %ldmin ago", (long)(d / 3600), (long)(d % 3600 / 60));
+    } else if (d >= 300) {
+        snprintf(buf, len, "%ldmin ago", (long)(d / 60));
+    } else if (d >= 60) {
+        snprintf(buf, len, "%ldmin %lds ago", (long)(d / 60), (long)(d % 60));
+    } else if (d > 0) {
+        snprintf(buf, len, "%lds ago", (long)d);
+    } else {
+        snprintf(buf, len, "now");
+    }
+}
+
+static void format_since(time_t t, time_t now, char* buf, size_t len) {
+    struct tm tm;
+    char when[32], ago[48];
+
+    gmtime_r(&t, &tm);
+    strftime(when, sizeof(when), "%a %Y-%m-%d %H:%M:%S UTC", &tm);
+    format_ago(now - t, ago, sizeof(ago));
+    snprintf(buf, len, " since %s; %s", when, ago);
+}
+
+static void format_bytes(uint64_t kb, char* buf, size_t len) {
+    if (kb < 1024) {
+        snprintf(buf, len, "%lluK", (unsigned long long)kb);
+    } else if (kb < 1024 * 1024) {
+        snprintf(buf, len, "%.1fM", kb / 1024.0);
+    } else {
+        snprintf(buf, len, "%.1fG", kb / (1024.0 * 1024.0));
+    }
+}
+
+// "ssh" means ssh.service, as in systemctl; aliases are followed
+static uint32_t lookup_arg(const unit_graph_t* g, const char* arg, char* name, size_t len) {
+    uint32_t u;
+
+    snprintf(name, len, kind_of(arg, strlen(arg)) < 0 ? "%s.service" : "%s", arg);
+    u = systemd_find(g, name, strlen(name));
+    if (u != UNIT_NONE) snprintf(name, len, "%s", unit_name(g, u));
+    return u;
+}
+
+static int compare_names(const void* a, const void* b, void* ctx) {
+    const unit_graph_t* g = ctx;
+
+    return strcmp(unit_name(g, *(const uint32_t*)a), unit_name(g, *(const uint32_t*)b));
+}
+
+// Every unit but aliases, in name order
+static uint32_t* sorted_units(const unit_graph_t* g, uint32_t* n) {
+    uint32_t* order = xcalloc(g->n_units, sizeof(uint32_t));
+    uint32_t i;
+
+    *n = 0;
+    for (i = 0; i < g->n_units; i++) {
+        if (g->units[i].alias_of == UNIT_NONE) order[(*n)++] = i;
+    }
+    qsort_r(order, *n, sizeof(uint32_t), compare_names, (void*)g);
+    return order;
+}
+
+// A comma-separated --type= or --state= list; NULL matches anything
+static int list_has(const char* list, const char* word) {
+    size_t len = strlen(word);
+
+    if (!list) return 1;
+    while (*list) {
+        size_t n = strcspn(list, ",");
+
+        if (n == len && strncmp(list, word, n) == 0) return 1;
+        list += n;
+        if (*list) list++;
+    }
+    return 0;
+}
+
+static int type_matches(const unit_graph_t* g, uint32_t u, const char* types) {
+    const char* dot = strrchr(unit_name(g, u), '.');
+
+    return !types || (dot && list_has(types, dot + 1));
+}
+
+// ---------------------------------------------------------------------
+// systemctl
+
+typedef struct {
+    const unit_graph_t* g;
+    struct systemd_state* s;
+    proc_table_t* pt;
+    sim_env_t* env;
+    sim_opts_t o;
+} ctl_t;
+
+static void print_status(const ctl_t* c, uint32_t u) {
+    const unit_graph_t* g = c->g;
+    const struct systemd_state* s = c->s;
+    const unit_t* unit = &g->units[u];
+    const char* docs = unit_str(g, unit->docs);
+    const char* sub = sub_word(g, s, u);
+    char since[128] = "", buf[64];
+    int32_t main_pid = s->main_pid[u];
+
+    con_printf("● %s%s%s\n", unit_name(g, u), unit->description ? " - " : "", unit_str(g, unit->description));
+    if (s->file[u] & FILE_MASKED) {
+        con_printf("%9s: masked (Reason: Unit %s is masked.)\n", "Loaded", unit_name(g, u));
+    } else if (!unit->loaded) {
+        con_printf("%9s: not-found (Reason: Unit %s not found.)\n", "Loaded", unit_name(g, u));
+    } else if (unit->installable) {
+        con_printf("%9s: loaded (%s; %s; vendor preset: enabled)\n", "Loaded", unit_str(g, unit->shown), file_word(g, s, u));
+    } else {
+        con_printf("%9s: loaded (%s; static)\n", "Loaded", unit_str(g, unit->shown));
+    }
+    if (s->since[u]) format_since(s->since[u], c->env->clock, since, sizeof(since));
+    if (s->active[u] == UNIT_FAILED) {
+        con_printf("%9s: failed (Result: signal)%s\n", "Active", since);
+    } else if (strcmp(sub, active_word(s, u)) == 0) {
+        con_printf("%9s: %s%s\n", "Active", sub, since);
+    } else {
+        con_printf("%9s: %s (%s)%s\n", "Active", active_word(s, u), sub, since);
+    }
+    if (*docs) {
+        const char* label = "Docs";
+
+        while (*docs) {
+            size_t n = strcspn(docs, " ");
+
+            con_printf("%9s%c %.*s\n", label, *label ? ':' : ' ', (int)n, docs);
+            label = "";
+            docs += n;
+            while (*docs == ' ') docs++;
+        }
+    }
+    if (main_pid < 0) {
+        con_printf("%9s: %d (code=killed, signal=TERM)\n", "Main PID", -main_pid);
+    } else if (main_pid > 0 && c->pt && proc_find(c->pt, main_pid) >= 0) {
+        const proc_table_t* pt = c->pt;
+        int members[64];
+        uint32_t n = cgroup_members(pt, main_pid, members, 64), i;
+        uint64_t rss = 0, cpu = 0;
+        const char* at = strchr(unit_name(g, u), '@');
+
+        for (i = 0; i < n; i++) {
+            rss += pt->rss_kb[members[i]];
+            cpu += pt->cpu_ms[members[i]];
+        }
+        con_printf("%9s: %d (%s)\n", "Main PID", main_pid, proc_comm(pt, proc_find(pt, main_pid)));
+        con_printf("%9s: %u (limit: %u)\n", "Tasks", n, TASKS_LIMIT);
+        format_bytes(rss, buf, sizeof(buf));
+        con_printf("%9s: %s\n", "Memory", buf);
+        if (cpu) {
+            format_span(cpu, buf, sizeof(buf));
+            con_printf("%9s: %s\n", "CPU", buf);
+        }
+        if (at) {
+            con_printf("%9s: /system.slice/system-%.*s.slice/%s\n", "CGroup", (int)(at - unit_name(g, u)), unit_name(g, u),
+                       unit_name(g, u));
+        } else {
+            con_printf("%9s: /system.slice/%s\n", "CGroup", unit_name(g, u));
+        }
+        for (i = 0; i < n; i++) {
+            con_printf("           %s─%d %s\n", i + 1 < n ? "├" : "└", pt->pid[members[i]], proc_cmd(pt, members[i]));
+        }
+    }
+    sdj_print_unit(unit_name(g, u), 10);
+}
+
+static int ctl_status(ctl_t* c, int argc, char** argv) {
+    const unit_graph_t* g = c->g;
+    char name[256], since[128];
+    int status = 0, i;
+
+    if (argc < 2) {
+        uint32_t failed = 0, loaded = 0, u;
+
+        for (u = 0; u < g->n_units; u++) {
+            failed += c->s->active[u] == UNIT_FAILED;
+            loaded += g->units[u].loaded;
+        }
+        format_since(c->s->boot_time, c->env->clock, since, sizeof(since));
+        con_printf("● %s\n", sys_config.prompt_prefix);
+        con_printf("    State: %s\n", failed ? "degraded" : "running");
+        con_printf("    Units: %u loaded (incl. loaded aliases)\n", loaded);
+        con_printf("     Jobs: 0 queued\n");
+        con_printf("   Failed: %u units\n", failed);
+        con_printf("   %s\n", since + 1);
+        con_printf("   CGroup: /\n");
+        return 0;
+    }
+    for (i = 1; i < argc; i++) {
+        uint32_t u = lookup_arg(g, argv[i], name, sizeof(name));
+
+        if (u == UNIT_NONE) {
+            con_printf("Unit %s could not be found.\n", name);
+            status = 4;
+            continue;
+        }
+        if (i > 1) con_printf("\n");
+        print_status(c, u);
+        if (c->s->active[u] != UNIT_ACTIVE && status == 0) status = 3;
+    }
+    return status;
+}
+
+static int ctl_list_units(ctl_t* c) {
+    const unit_graph_t* g = c->g;
+    const struct systemd_state* s = c->s;
+    const char* types = sim_long_opt(&c->o, "type");
+    const char* states = sim_long_opt(&c->o, "state");
+    int all = SIM_HAS(&c->o, 'a') || sim_long_opt(&c->o, "all");
+    int legend_off = sim_long_opt(&c->o, "no-legend") != NULL;
+    uint32_t n, i, rows = 0;
+    uint32_t* order = sorted_units(g, &n);
+    int w_unit = 4, w_load = 4, w_active = 6, w_sub = 3;
+
+    if (SIM_HAS(&c->o, 't')) types = c->o.value;
+    // Keep the rows in place at the front of order
+    for (i = 0; i < n; i++) {
+        uint32_t u = order[i];
+
+        if (g->units[u].is_template || !type_matches(g, u, types)) continue;
+        if (states) {
+            if (!list_has(states, load_word(g, s, u)) && !list_has(states, active_word(s, u)) &&
+                !list_has(states, sub_word(g, s, u))) {
+                continue;
+            }
+        } else if (!all && s->active[u] == UNIT_INACTIVE) {
+            continue;
+        }
+        order[rows++] = u;
+        if ((int)strlen(unit_name(g, u)) > w_unit) w_unit = (int)strlen(unit_name(g, u));
+        if ((int)strlen(load_word(g, s, u)) > w_load) w_load = (int)strlen(load_word(g, s, u));
+        if ((int)strlen(active_word(s, u)) > w_active) w_active = (int)strlen(active_word(s, u));
+        if ((int)strlen(sub_word(g, s, u)) > w_sub) w_sub = (int)strlen(sub_word(g, s, u));
+    }
+    if (rows && !legend_off) con_printf("%-*s %-*s %-*s %-*s %s\n", w_unit, "UNIT", w_load, "LOAD", w_active, "ACTIVE", w_sub, "SUB", "DESCRIPTION");
+    for (i = 0; i < rows && !con_stopped(); i++) {
+        uint32_t u = order[i];
+
+        con_printf("%-*s %-*s %-*s %-*s %s\n", w_unit, unit_name(g, u), w_load, load_word(g, s, u), w_active, active_word(s, u),
+                   w_sub, sub_word(g, s, u), unit_str(g, g->units[u].description));
+    }
+    free(order);
+    if (legend_off) return 0;
+    if (rows) {
+        con_printf("\nLOAD   = Reflects whether the unit definition was properly loaded.\n"
+                   "ACTIVE = The high-level unit activation state, i.e. generalization of SUB.\n"
+                   "SUB    = The low-level unit activation state, values depend on unit type.\n");
+    }
+    con_printf("%u loaded units listed.%s\n", rows, all ? "" : " Pass --all to see loaded but inactive units, too.");
+    con_printf("To show all installed unit files use 'systemctl list-unit-files'.\n");
+    return 0;
+}
+
+static int ctl_list_unit_files(ctl_t* c) {
+    const unit_graph_t* g = c->g;
+    const char* types = SIM_HAS(&c->o, 't') ? c->o.value : sim_long_opt(&c->o, "type");
+    const char* states = sim_long_opt(&c->o, "state");
+    uint32_t n, i, rows = 0, u;
+    uint32_t* order = xcalloc(g->n_units, sizeof(uint32_t));
+    int w_unit = 9;
+
+    // Unit files and alias links; instances and missing units have neither
+    for (u = 0; u < g->n_units; u++) {
+        const unit_t* unit = &g->units[u];
+        const char* at = strchr(unit_name(g, u), '@');
+
+        if ((unit->alias_of == UNIT_NONE && !unit->loaded && !(c->s->file[u] & FILE_MASKED)) || (at && at[1] != '.')) continue;
+        if (!type_matches(g, u, types) || !list_has(states, file_word(g, c->s, u))) continue;
+        order[rows++] = u;
+        if ((int)strlen(unit_name(g, u)) > w_unit) w_unit = (int)strlen(unit_name(g, u));
+    }
+    n = rows;
+    qsort_r(order, n, sizeof(uint32_t), compare_names, (void*)g);
+    if (rows) con_printf("%-*s %-15s %s\n", w_unit, "UNIT FILE", "STATE", "VENDOR PRESET");
+    for (i = 0; i < rows && !con_stopped(); i++) {
+        const char* state;
+
+        u = order[i];
+        state = file_word(g, c->s, u);
+        con_printf("%-*s %-15s %s\n", w_unit, unit_name(g, u), state,
+                   strcmp(state, "static") == 0 || strcmp(state, "alias") == 0 ? "-" : "enabled");
+    }
+    free(order);
+    con_printf("\n%u unit files listed.\n", rows);
+    return 0;
+}
+
+// The tree of what a unit pulls in; below the first level only targets
+// are expanded, unless --all
+static void print_dependencies(const ctl_t* c, uint32_t u, uint8_t* on_path, char* prefix, size_t depth, int all) {
+    const unit_graph_t* g = c->g;
+    const unit_t* unit = &g->units[u];
+    uint32_t* kids = xcalloc(unit->n_deps, sizeof(uint32_t));
+    uint32_t n = 0, i;
+
+    for (i = 0; i < unit->n_deps; i++) {
+        const unit_dep_t* d = &g->deps[unit->first_dep + i];
+        uint8_t kind = UNIT_DEP_KIND(d);
+
+        if ((kind == UNIT_DEP_REQUIRES || kind == UNIT_DEP_WANTS) && edge_holds(c->s, d) && (!n || kids[n - 1] != d->unit)) {
+            kids[n++] = d->unit;
+        }
+    }
+    qsort_r(kids, n, sizeof(uint32_t), compare_names, (void*)g);
+    for (i = 0; i < n && !con_stopped(); i++) {
+        uint32_t v = kids[i];
+
+        // Wants= and Requires= of the same unit sort next to each other
+        if (i && kids[i - 1] == v) continue;
+        con_printf("%s %s%s─%s\n", c->s->active[v] == UNIT_ACTIVE ? "●" : "○", prefix, i + 1 < n ? "├" : "└",
+                   unit_name(g, v));
+        if (!on_path[v] && depth < 30 && (all || g->units[v].kind == UNIT_TARGET)) {
+            size_t len = strlen(prefix);
+
+            on_path[v] = 1;
+            strcpy(prefix + len, i + 1 < n ? "│ " : "  ");
+            print_dependencies(c, v, on_path, prefix, depth + 1, all);
+            prefix[len] = '\0';
+            on_path[v] = 0;
+        }
+    }
+    free(kids);
+}
+
+static int ctl_list_dependencies(ctl_t* c, int argc, char** argv) {
+    char name[256], prefix[256] = "";
+    uint32_t u = argc > 1 ? lookup_arg(c->g, argv[1], name, sizeof(name)) : c->g->default_target;
+    uint8_t* on_path;
+
+    if (u == UNIT_NONE) {
+        con_printf("%s\n", argc > 1 ? name : "default.target");
+        return 0;
+    }
+    on_path = xcalloc(c->g->n_units, sizeof(uint8_t));
+    on_path[u] = 1;
+    con_printf("%s\n", unit_name(c->g, u));
+    print_dependencies(c, u, on_path, prefix, 0, SIM_HAS(&c->o, 'a') || sim_long_opt(&c->o, "all"));
+    free(on_path);
+    return 0;
+}
+
+static int denied(const char* verb, const char* name) {
+    if (name) {
+        con_printf("Failed to %s %s: Interactive authentication required.\n"
+                   "See system logs and 'systemctl status %s' for details.\n", verb, name, name);
+    } else {
+        con_printf("Failed to %s unit: Interactive authentication required.\n", verb);
+    }
+    return 1;
+}
+
+static int ctl_start(ctl_t* c, uint32_t u, const char* name) {
+    const unit_graph_t* g = c->g;
+    struct systemd_state* s = c->s;
+    unit_plan_t plan;
+    uint32_t i, j;
+
+    if (u == UNIT_NONE || !g->units[u].loaded) {
+        con_printf("Failed to start %s: Unit %s not found.\n", name, name);
+        return 5;
+    }
+    if (g->units[u].is_template) {
+        con_printf("Failed to start %s: Unit name %s is missing the instance name.\n"
+                   "See system logs and 'systemctl status %s' for details.\n", name, name, name);
+        return 1;
+    }
+    if (s->file[u] & FILE_MASKED) {
+        con_printf("Failed to start %s: Unit %s is masked.\n", name, name);
+        return 1;
+    }
+    if (g->units[u].refuse_start) {
+        con_printf("Failed to start %s: Operation refused, unit %s may be requested by dependency only "
+                   "(it is configured to refuse manual start/stop).\n"
+                   "See system logs and 'systemctl status %s' for details.\n", name, name, name);
+        return 1;
+    }
+    plan_init(&plan, g->n_units);
+    plan_start(g, s, &u, 1, &plan);
+    for (i = 0; i < plan.n_jobs; i++) {
+        uint32_t v = plan.order[i];
+        const unit_t* unit = &g->units[v];
+
+        if (plan.job[v] != JOB_START) continue;
+        for (j = 0; j < unit->n_deps; j++) {
+            const unit_dep_t* d = &g->deps[unit->first_dep + j];
+
+            if (UNIT_DEP_KIND(d) == UNIT_DEP_CONFLICTS && s->active[d->unit] != UNIT_INACTIVE) {
+                log_unit(g, s, d->unit, SDJ_UNIT_STOP);
+                deactivate(s, c->pt, d->unit, c->env->clock);
+            }
+        }
+        activate(g, s, c->pt, v, c->env->clock);
+        log_unit(g, s, v, SDJ_UNIT_START);
+    }
+    i = plan.job[u];
+    plan_free(&plan);
+    if (i == JOB_DEPENDENCY) {
+        con_printf("A dependency job for %s failed. See 'journalctl -xe' for details.\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+static int ctl_stop(ctl_t* c, uint32_t u, const char* name) {
+    const unit_graph_t* g = c->g;
+    unit_plan_t plan;
+    uint32_t i;
+
+    if (u == UNIT_NONE) {
+        con_printf("Failed to stop %s: Unit %s not loaded.\n", name, name);
+        return 5;
+    }
+    if (g->units[u].refuse_stop) {
+        con_printf("Failed to stop %s: Operation refused, unit %s may be requested by dependency only "
+                   "(it is configured to refuse manual start/stop).\n"
+                   "See system logs and 'systemctl status %s' for details.\n", name, name, name);
+        return 1;
+    }
+    if (c->s->active[u] == UNIT_INACTIVE) return 0;
+    plan_init(&plan, g->n_units);
+    plan_stop(g, c->s, u, &plan);
+    for (i = 0; i < plan.n_jobs; i++) {
+        log_unit(g, c->s, plan.order[i], SDJ_UNIT_STOP);
+        deactivate(c->s, c->pt, plan.order[i], c->env->clock);
+    }
+    plan_free(&plan);
+    return 0;
+}
+
+// The links "systemctl enable" makes: NAME.wants/UNIT for WantedBy=,
+// and one per Alias=
+static void print_links(const ctl_t* c, uint32_t u, int enable) {
+    const unit_graph_t* g = c->g;
+    const unit_t* unit = &g->units[u];
+    const char* dir = unit_str(g, g->config_dir);
+    const char* aliases = unit_str(g, unit->aliases);
+    char link[MAX_PATH];
+    uint32_t i;
+
+    for (i = 0; i < unit->n_rdeps; i++) {
+        const unit_dep_t* d = &g->rdeps[unit->first_rdep + i];
+
+        if (!(d->kind & UNIT_DEP_INSTALLED) || UNIT_DEP_KIND(d) > UNIT_DEP_WANTS) continue;
+        snprintf(link, sizeof(link), "%s/%s.%s/%s", dir, unit_name(g, d->unit),
+                 UNIT_DEP_KIND(d) == UNIT_DEP_WANTS ? "wants" : "requires", unit_name(g, u));
+        if (enable) {
+            con_printf("Created symlink %s → %s.\n", link, unit_str(g, unit->shown));
+        } else {
+            con_printf("Removed \"%s\".\n", link);
+        }
+    }
+    while (*aliases) {
+        size_t n = strcspn(aliases, " ");
+
+        snprintf(link, sizeof(link), "%s/%.*s", dir, (int)n, aliases);
+        if (enable) {
+            con_printf("Created symlink %s → %s.\n", link, unit_str(g, unit->shown));
+        } else {
+            con_printf("Removed \"%s\".\n", link);
+        }
+        aliases += n;
+        while (*aliases == ' ') aliases++;
+    }
+}
+
+static int ctl_enable(ctl_t* c, uint32_t u, const char* name, int enable) {
+    const unit_graph_t* g = c->g;
+    struct systemd_state* s = c->s;
+
+    if (u == UNIT_NONE || !g->units[u].loaded) {
+        con_printf("Failed to %s unit: Unit file %s does not exist.\n", enable ? "enable" : "disable", name);
+        return 1;
+    }
+    if (s->file[u] & FILE_MASKED) {
+        con_printf("Failed to %s unit: Unit file %s/%s is masked.\n", enable ? "enable" : "disable",
+                   unit_str(g, g->config_dir), name);
+        return 1;
+    }
+    if (!g->units[u].installable) {
+        con_printf("The unit files have no installation config (WantedBy=, RequiredBy=, Also=,\n"
+                   "Alias= settings in the [Install] section, and DefaultInstance= for template\n"
+                   "units). This means they are not meant to be enabled or disabled using systemctl.\n");
+    } else if (((s->file[u] & FILE_ENABLED) != 0) != enable) {
+        print_links(c, u, enable);
+        s->file[u] ^= FILE_ENABLED;
+    }
+    if (sim_long_opt(&c->o, "now")) return enable ? ctl_start(c, u, name) : ctl_stop(c, u, name);
+    return 0;
+}
+
+static int ctl_mask(ctl_t* c, uint32_t u, const char* name, int mask) {
+    const char* dir = unit_str(c->g, c->g->config_dir);
+
+    if (u == UNIT_NONE) {
+        con_printf("Failed to %s unit: Unit file %s does not exist.\n", mask ? "mask" : "unmask", name);
+        return 1;
+    }
+    if (((c->s->file[u] & FILE_MASKED) != 0) != mask) {
+        if (mask) {
+            con_printf("Created symlink %s/%s → /dev/null.\n", dir, name);
+        } else {
+            con_printf("Removed \"%s/%s\".\n", dir, name);
+        }
+        c->s->file[u] ^= FILE_MASKED;
+    }
+    return 0;
+}
+
+static int ctl_cat(ctl_t* c, uint32_t u, const char* name) {
+    const unit_t* unit;
+    char* text;
+
+    if (u == UNIT_NONE || !c->g->units[u].loaded) {
+        con_printf("No files found for %s.\n", name);
+        return 1;
+    }
+    unit = &c->g->units[u];
+    if (c->s->file[u] & FILE_MASKED) {
+        con_printf("# Unit %s is masked.\n", name);
+        return 1;
+    }
+    text = read_file(unit_str(c->g, unit->file), NULL);
+    if (!text) {
+        con_printf("No files found for %s.\n", name);
+        return 1;
+    }
+    con_printf("# %s\n", unit_str(c->g, unit->shown));
+    con_write(text, strlen(text));
+    free(text);
+    return 0;
+}
+
+int systemd_cmd_systemctl(int argc, char** argv) {
+    static const char* const unit_verbs[] = {
+        "start", "stop", "restart", "reload", "enable", "disable", "mask", "unmask",
+        "is-active", "is-enabled", "is-failed", "cat",
+    };
+    const unit_graph_t* g = systemd_shared();
+    const char* verb;
+    char name[256];
+    int status = 0, found = 0, i;
+    size_t k;
+    ctl_t c;
+
+    if (!g) return -1;
+    c.g = g;
+    if (sim_getopt(argc, argv, "aqt:", &c.o) < 0) return 1;
+    argc = c.o.n_operands + 1;
+    verb = argc > 1 ? argv[1] : "list-units";
+    c.env = sim_env();
+    c.pt = proc_session();
+    c.s = session_units(g, c.pt);
+
+    if (strcmp(verb, "list-units") == 0) return ctl_list_units(&c);
+    if (strcmp(verb, "list-unit-files") == 0) return ctl_list_unit_files(&c);
+    if (strcmp(verb, "list-dependencies") == 0) return ctl_list_dependencies(&c, argc - 1, argv + 1);
+    if (strcmp(verb, "status") == 0) return ctl_status(&c, argc - 1, argv + 1);
+    if (strcmp(verb, "daemon-reload") == 0) {
+        if (c.env->euid != 0) {
+            con_printf("Failed to reload daemon: Interactive authentication required.\n");
+            return 1;
+        }
+        return 0;
+    }
+    for (k = 0; k < sizeof(unit_verbs) / sizeof(unit_verbs[0]) && strcmp(verb, unit_verbs[k]) != 0; k++) {}
+    if (k == sizeof(unit_verbs) / sizeof(unit_verbs[0])) return -1;
+    if (argc < 3) {
+        con_printf("Too few arguments.\n");
+        return 1;
+    }
+
+    for (i = 2; i < argc; i++) {
+        uint32_t u = lookup_arg(g, argv[i], name, sizeof(name));
+        int rc = 0;
+
+        if (strncmp(verb, "is-", 3) == 0) {
+            const char* word;
+
+            if (strcmp(verb, "is-enabled") == 0) {
+                if (u == UNIT_NONE || (!g->units[u].loaded && !(c.s->file[u] & FILE_MASKED))) {
+                    con_printf("Failed to get unit file state for %s: No such file or directory\n", name);
+                    status = 1;
+                    continue;
+                }
+                word = file_word(g, c.s, u);
+                found |= strcmp(word, "disabled") != 0 && strcmp(word, "masked") != 0;
+            } else {
+                word = u == UNIT_NONE ? "inactive" : active_word(c.s, u);
+                found |= strcmp(word, verb + 3) == 0;
+            }
+            if (!SIM_HAS(&c.o, 'q') && !sim_long_opt(&c.o, "quiet")) con_printf("%s\n", word);
+            continue;
+        }
+        if (strcmp(verb, "cat") == 0) {
+            if (i > 2) con_printf("\n");
+            rc = ctl_cat(&c, u, name);
+        } else if (c.env->euid != 0) {
+            rc = strstr("start stop restart reload", verb) ? denied(verb, name) : denied(verb, NULL);
+        } else if (strcmp(verb, "start") == 0) {
+            rc = ctl_start(&c, u, name);
+        } else if (strcmp(verb, "stop") == 0) {
+            rc = ctl_stop(&c, u, name);
+        } else if (strcmp(verb, "restart") == 0) {
+            if ((rc = ctl_stop(&c, u, name)) == 0) rc = ctl_start(&c, u, name);
+        } else if (strcmp(verb, "reload") == 0) {
+            if (u == UNIT_NONE || !g->units[u].loaded) {
+                con_printf("Failed to reload %s: Unit %s not found.\n", name, name);
+                rc = 5;
+            } else if (!g->units[u].reloadable) {
+                con_printf("Failed to reload %s: Job type reload is not applicable for unit %s.\n", name, name);
+                rc = 1;
+            } else if (c.s->active[u] != UNIT_ACTIVE) {
+                con_printf("%s is not active, cannot reload.\n", name);
+                rc = 1;
+            } else {
+                log_unit(g, c.s, u, SDJ_UNIT_RELOAD);
+                if (c.s->main_pid[u] > 0) proc_signal(c.pt, c.s->main_pid[u], SIGHUP, 0);
+            }
+        } else if (strcmp(verb, "enable") == 0 || strcmp(verb, "disable") == 0) {
+            rc = ctl_enable(&c, u, name, verb[0] == 'e');
+        } else {
+            rc = ctl_mask(&c, u, name, verb[0] == 'm');
+        }
+        if (rc && !status) status = rc;
+    }
+    if (strncmp(verb, "is-", 3) == 0) return status ? status : found ? 0 : strcmp(verb, "is-enabled") == 0 ? 1 : 3;
+    return status;
+}
+
+// ---------------------------------------------------------------------
+// systemd-analyze
+
+static void print_chain(const unit_graph_t* g, const unit_plan_t* p, uint32_t u) {
+    char at[32], cost[32];
+    size_t depth = 0;
+
+    con_printf("The time when unit became active or started is printed after the \"@\" character.\n"
+               "The time the unit took to start is printed after the \"+\" character.\n\n");
+    while (u != UNIT_NONE && !con_stopped()) {
+        con_printf("%*s%s%s", (int)(depth ? 2 * (depth - 1) : 0), "", depth ? "└─" : "", unit_name(g, u));
+        if (p->job[u] == JOB_NONE) {
+            con_printf("\n");
+            break;
+        }
+        if (p->done[u] > p->at[u]) {
+            format_span(p->at[u], at, sizeof(at));
+            format_span(p->done[u] - p->at[u], cost, sizeof(cost));
+            con_printf(" @%s +%s\n", at, cost);
+        } else {
+            format_span(p->done[u], at, sizeof(at));
+            con_printf(" @%s\n", at);
+        }
+        u = p->after[u];
+        depth++;
+    }
+}
+
+static int compare_cost(const void* a, const void* b, void* ctx) {
+    const unit_graph_t* g = ctx;
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+    if (g->units[x].cost_ms != g->units[y].cost_ms) return g->units[x].cost_ms > g->units[y].cost_ms ? -1 : 1;
+    return strcmp(unit_name(g, x), unit_name(g, y));
+}
+
+int systemd_cmd_analyze(int argc, char** argv) {
+    const unit_graph_t* g = systemd_shared();
+    const struct systemd_state* s;
+    const unit_plan_t* boot;
+    const char* verb = argc > 1 ? argv[1] : "time";
+    char a[32], b[32], total[32], name[256];
+    int i;
+
+    if (!g) return -1;
+    s = session_units(g, proc_session());
+    boot = &s->boot;
+    if (g->default_target == UNIT_NONE) {
+        con_printf("Bootup is not yet finished. Please try again later.\n");
+        return 1;
+    }
+    if (strcmp(verb, "time") == 0) {
+        format_span(KERNEL_MS, a, sizeof(a));
+        format_span(boot->total_ms, b, sizeof(b));
+        format_span(KERNEL_MS + boot->total_ms, total, sizeof(total));
+        con_printf("Startup finished in %s (kernel) + %s (userspace) = %s\n", a, b, total);
+        format_span(boot->done[g->default_target], b, sizeof(b));
+        con_printf("%s reached after %s in userspace.\n", unit_name(g, g->default_target), b);
+        return 0;
+    }
+    if (strcmp(verb, "critical-chain") == 0) {
+        if (argc < 3) {
+            print_chain(g, boot, g->default_target);
+            return 0;
+        }
+        for (i = 2; i < argc; i++) {
+            uint32_t u = lookup_arg(g, argv[i], name, sizeof(name));
+
+            if (u == UNIT_NONE) {
+                con_printf("Failed to get ID: Unit %s not loaded.\n", name);
+                return 1;
+            }
+            print_chain(g, boot, u);
+        }
+        return 0;
+    }
+    if (strcmp(verb, "blame") == 0) {
+        uint32_t* order = xcalloc(boot->n_jobs, sizeof(uint32_t));
+        uint32_t n = 0, j;
+        int width = 0;
+
+        for (j = 0; j < boot->n_jobs; j++) {
+            uint32_t u = boot->order[j];
+
+            if (boot->job[u] == JOB_START && g->units[u].cost_ms) order[n++] = u;
+        }
+        qsort_r(order, n, sizeof(uint32_t), compare_cost, (void*)g);
+        for (j = 0; j < n; j++) {
+            format_span(g->units[order[j]].cost_ms, a, sizeof(a));
+            if ((int)strlen(a) > width) width = (int)strlen(a);
+        }
+        for (j = 0; j < n && !con_stopped(); j++) {
+            format_span(g->units[order[j]].cost_ms, a, sizeof(a));
+            con_printf("%*s %s\n", width, a, unit_name(g, order[j]));
+        }
+        free(order);
+        return 0;
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark
+
+static uint64_t bench_rng = 0x2545F4914F6CDD1Dull;
+
+static int write_unit(const char* dir, const char* name, const char* text) {
+    char path[MAX_PATH];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (!(f = fopen(path, "w"))) return -1;
+    fputs(text, f);
+    return fclose(f);
+}
+
+// A Debian-shaped unit tree: the standard targets, one group target per
+// hundred services each wanted by multi-user.target, and services that
+// require, want and are ordered after earlier ones; most are enabled
+static int write_fixture(const char* root, uint32_t n) {
+    static const char* const targets[][2] = {
+        { "sysinit.target", "[Unit]\nDescription=System Initialization\n" },
+        { "basic.target", "[Unit]\nDescription=Basic System\nRequires=sysinit.target\nWants=sockets.target timers.target\n"
+                          "After=sysinit.target sockets.target timers.target\n" },
+        { "sockets.target", "[Unit]\nDescription=Sockets\n" },
+        { "timers.target", "[Unit]\nDescription=Timers\nDefaultDependencies=no\n" },
+        { "shutdown.target", "[Unit]\nDescription=System Shutdown\nDefaultDependencies=no\n" },
+        { "multi-user.target", "[Unit]\nDescription=Multi-User System\nRequires=basic.target\nAfter=basic.target\n" },
+    };
+    char lib[64], etc[64], wants[128], path[MAX_PATH], link[MAX_PATH];
+    char text[1024], name[64], dep[64];
+    uint32_t groups = n / 100 + 1, i, k;
+    size_t t;
+
+    snprintf(lib, sizeof(lib), "%s/lib", root);
+    snprintf(etc, sizeof(etc), "%s/etc", root);
+    if (mkdir(lib, 0755) != 0 || mkdir(etc, 0755) != 0) return -1;
+    for (t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        if (write_unit(lib, targets[t][0], targets[t][1]) != 0) return -1;
+    }
+    snprintf(path, sizeof(path), "%s/default.target", lib);
+    if (symlink("multi-user.target", path) != 0) return -1;
+    snprintf(wants, sizeof(wants), "%s/multi-user.target.wants", etc);
+    mkdir(wants, 0755);
+    for (i = 0; i < groups; i++) {
+        snprintf(name, sizeof(name), "group%03u.target", i);
+        snprintf(text, sizeof(text), "[Unit]\nDescription=Group %u\n\n[Install]\nWantedBy=multi-user.target\n", i);
+        if (write_unit(lib, name, text) != 0) return -1;
+        snprintf(link, sizeof(link), "%s/%s", wants, name);
+        snprintf(path, sizeof(path), "/lib/systemd/system/%s", name);
+        if (symlink(path, link) != 0) return -1;
+        snprintf(link, sizeof(link), "%s/%s.wants", etc, name);
+        mkdir(link, 0755);
+    }
+    for (i = 0; i < n; i++) {
+        size_t len;
+        uint32_t group = bench_random(&bench_rng, groups);
+
+        snprintf(name, sizeof(name), "svc%05u.service", i);
+        len = (size_t)snprintf(text, sizeof(text), "[Unit]\nDescription=Synthetic service %u\n", i);
+        // Requirements lean towards the first services, the way much of a
+        // real system needs a few basic ones
+        if (i && bench_random(&bench_rng, 10) < 3) {
+            snprintf(dep, sizeof(dep), "svc%05u.service", bench_random(&bench_rng, bench_random(&bench_rng, i) + 1));
+            len += (size_t)snprintf(text + len, sizeof(text) - len, "Requires=%s\nAfter=%s\n", dep, dep);
+        }
+        for (k = i ? bench_random(&bench_rng, 3) : 0; k > 0; k--) {
+            snprintf(dep, sizeof(dep), "svc%05u.service", bench_random(&bench_rng, i));
+            len += (size_t)snprintf(text + len, sizeof(text) - len, "Wants=%s\nAfter=%s\n", dep, dep);
+        }
+        if (i && bench_random(&bench_rng, 2)) {
+            len += (size_t)snprintf(text + len, sizeof(text) - len, "After=svc%05u.service\n", bench_random(&bench_rng, i));
+        }
+        len += (size_t)snprintf(text + len, sizeof(text) - len, "Before=group%03u.target\n\n[Service]\n", group);
+        if (bench_random(&bench_rng, 5) == 0) {
+            len += (size_t)snprintf(text + len, sizeof(text) - len, "Type=oneshot\nRemainAfterExit=yes\n");
+        }
+        snprintf(text + len, sizeof(text) - len, "ExecStart=/usr/bin/svc%05u\n\n[Install]\nWantedBy=group%03u.target\n", i, group);
+        if (write_unit(lib, name, text) != 0) return -1;
+        if (bench_random(&bench_rng, 100) < 85) {
+            snprintf(link, sizeof(link), "%s/group%03u.target.wants/%s", etc, group, name);
+            snprintf(path, sizeof(path), "/lib/systemd/system/%s", name);
+            if (symlink(path, link) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int systemd_bench(int argc, char** argv) {
+    long n = argc > 0 ? atol(argv[0]) : 5000;
+    char root[] = "/tmp/deb1-units-XXXXXX";
+    char lib[64], etc[64], err[256];
+    const char* dirs[2] = { etc, lib };
+    struct systemd_state* s;
+    unit_graph_t* g;
+    unit_plan_t plan;
+    double start, elapsed;
+    uint32_t u, rounds, target, stopped = 0, restarted;
+    int rc = 0;
+
+    if (n < 100) n = 100;
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(lib, sizeof(lib), "%s/lib", root);
+    snprintf(etc, sizeof(etc), "%s/etc", root);
+    if (write_fixture(root, (uint32_t)n) != 0) {
+        perror(root);
+        nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return 1;
+    }
+
+    start = bench_now();
+    g = systemd_load(dirs, NULL, 2, err, sizeof(err));
+    elapsed = bench_now() - start;
+    if (!g) {
+        fprintf(stderr, "%s\n", err);
+        nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+        return 1;
+    }
+    bench_report("systemd", "units", g->n_units, "units");
+    bench_report("systemd", "edges", g->n_deps, "edges");
+    bench_report("systemd", "load", elapsed * 1e3, "ms");
+    bench_report("systemd", "load_rate", g->n_files / elapsed, "files/s");
+
+    // Booting: the transaction of default.target, from nothing active
+    s = state_boot(g, NULL, 0);
+    rounds = 0;
+    start = bench_now();
+    do {
+        memset(s->active, UNIT_INACTIVE, g->n_units);
+        plan_start(g, s, &g->default_target, 1, &s->boot);
+        rounds++;
+    } while (bench_now() - start < 0.3);
+    bench_report("systemd", "boot_plan", (bench_now() - start) / rounds * 1e3, "ms");
+    bench_report("systemd", "boot_jobs", s->boot.n_jobs, "jobs");
+    bench_report("systemd", "boot_userspace", s->boot.total_ms / 1000.0, "s simulated");
+    if (s->boot.broken) {
+        fprintf(stderr, "systemd: %u ordering cycles in an acyclic fixture\n", s->boot.broken);
+        rc = 1;
+    }
+    for (u = 0, elapsed = 0; u < s->boot.n_jobs; u++) {
+        uint32_t v = s->boot.order[u];
+
+        if (s->boot.job[v] == JOB_START) {
+            elapsed += g->units[v].cost_ms;
+            activate(g, s, NULL, v, 1);
+        }
+    }
+    bench_report("systemd", "boot_parallelism", elapsed / (s->boot.total_ms ? s->boot.total_ms : 1), "x");
+
+    // Stopping the first service takes down what requires it; starting
+    // default.target again brings back just those
+    target = systemd_find(g, "svc00000.service", 16);
+    plan_init(&plan, g->n_units);
+    rounds = 0;
+    start = bench_now();
+    do {
+        uint32_t i;
+
+        stopped = plan_stop(g, s, target, &plan);
+        for (i = 0; i < plan.n_jobs; i++) deactivate(s, NULL, plan.order[i], 2);
+        plan_start(g, s, &g->default_target, 1, &plan);
+        for (i = 0; i < plan.n_jobs; i++) {
+            if (plan.job[plan.order[i]] == JOB_START) activate(g, s, NULL, plan.order[i], 3);
+        }
+        rounds++;
+    } while (bench_now() - start < 0.3);
+    bench_report("systemd", "stop_start", (bench_now() - start) / rounds * 1e6, "us");
+    bench_report("systemd", "stop_jobs", stopped, "jobs");
+    for (u = 0, restarted = 0; u < plan.n_jobs; u++) restarted += plan.job[plan.order[u]] == JOB_START;
+    bench_report("systemd", "restart_jobs", restarted, "jobs");
+    plan_free(&plan);
+
+    systemd_state_free(s);
+    systemd_free(g);
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return rc;
+}
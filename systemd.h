@@ -0,0 +1,150 @@
+#ifndef SYSTEMD_H
+#define SYSTEMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// systemd units for simulation mode.
+//
+// Unit files are read from a list of directories, earlier ones taking
+// precedence the way /etc/systemd/system overrides /lib/systemd/system:
+// $DEB1_UNIT_PATH (colon-separated, like $SYSTEMD_UNIT_PATH) or the
+// bundled lessons/units/etc and lessons/units/lib. Names are interned
+// through an open-addressing hash, and every name a file mentions gets a
+// unit, "not-found" when no file has it; aliases (symlinks and Alias=)
+// stand for the unit they name. Dependencies are one flat edge array
+// grouped by unit, with Before= turned around into the other unit's
+// After= and systemd's default dependencies added; the reverse edges are
+// the same edges regrouped by target, as in apt.h. WantedBy= and the
+// links in the first directory's .wants/ make edges marked as installed,
+// which only count while the session has the unit enabled.
+//
+// Starting a unit is a transaction: the units it pulls in through
+// Requires= and Wants= that are not active yet, run as a parallel job
+// schedule in After= order, each job starting when the last job it is
+// ordered after has finished. Booting is the start of default.target;
+// its schedule is what systemd-analyze reports. The graph is shared by
+// every session; unit states live in the session's simulated machine.
+
+#define UNIT_NONE UINT32_MAX
+
+typedef enum {
+    UNIT_SERVICE,
+    UNIT_SOCKET,
+    UNIT_TARGET,
+    UNIT_TIMER,
+    UNIT_PATH,
+    UNIT_MOUNT,
+    UNIT_SLICE,
+    UNIT_OTHER,
+    UNIT_KINDS
+} unit_kind_t;
+
+typedef enum {
+    UNIT_DEP_REQUIRES,      // Requires=, BindsTo=, Requisite=, .requires/
+    UNIT_DEP_WANTS,         // Wants=, .wants/
+    UNIT_DEP_AFTER,         // After=, and Before= of the other unit
+    UNIT_DEP_CONFLICTS,     // both ways
+    UNIT_DEP_KINDS
+} unit_dep_kind_t;
+
+// Set on Requires/Wants edges that come from [Install] or from links in
+// the first directory: they hold while the target unit is enabled
+#define UNIT_DEP_INSTALLED 0x80
+#define UNIT_DEP_KIND(d) ((d)->kind & 0x7f)
+
+typedef struct {
+    uint32_t unit;          // the other end: target in deps, source in rdeps
+    uint8_t kind;
+} unit_dep_t;
+
+typedef enum {
+    UNIT_TYPE_SIMPLE,
+    UNIT_TYPE_EXEC,
+    UNIT_TYPE_FORKING,
+    UNIT_TYPE_ONESHOT,
+    UNIT_TYPE_NOTIFY,
+    UNIT_TYPE_DBUS,
+    UNIT_TYPE_IDLE
+} unit_service_type_t;
+
+typedef struct {
+    uint32_t name;          // offsets into strings; 0 is ""
+    uint32_t description;
+    uint32_t docs;          // Documentation=, space-separated
+    uint32_t aliases;       // Alias=, space-separated
+    uint32_t exec;          // first ExecStart=, without its "-", "!!" prefixes
+    uint32_t user;          // User=
+    uint32_t file;          // where it was read
+    uint32_t shown;         // the path systemctl shows
+    uint32_t alias_of;      // the unit this name stands for, or UNIT_NONE
+    uint32_t first_dep, n_deps;
+    uint32_t first_rdep, n_rdeps;
+    uint32_t cost_ms;       // simulated time from activating to active
+    uint8_t kind;
+    uint8_t loaded;
+    uint8_t type;           // unit_service_type_t
+    uint8_t remain;         // RemainAfterExit=yes
+    uint8_t restart_always; // Restart=always
+    uint8_t reloadable;     // has ExecReload=
+    uint8_t installable;    // has WantedBy=, RequiredBy= or Alias=
+    uint8_t enabled;        // linked from the first directory
+    uint8_t masked;         // linked to /dev/null
+    uint8_t default_deps;
+    uint8_t refuse_start, refuse_stop;
+    uint8_t is_template;    // "getty@.service"
+} unit_t;
+
+typedef struct unit_graph {
+    unit_t* units;
+    uint32_t n_units;
+    unit_dep_t* deps;
+    uint32_t n_deps;
+    unit_dep_t* rdeps;
+
+    char* strings;
+    size_t strings_len, strings_cap;
+
+    uint32_t* hash;         // unit index + 1, 0 = empty
+    uint32_t hash_mask;
+    uint32_t default_target;
+    uint32_t config_dir;    // the first directory, as shown: where enable links go
+    uint32_t n_files;
+} unit_graph_t;
+
+// Load the units of dirs; shown[i] is how paths in dirs[i] are printed
+// (NULL: as they are). Returns NULL after writing err.
+unit_graph_t* systemd_load(const char* const* dirs, const char* const* shown, uint32_t n_dirs, char* err, size_t err_len);
+void systemd_free(unit_graph_t* g);
+
+// $DEB1_UNIT_PATH or the bundled units, loaded once per process
+unit_graph_t* systemd_shared(void);
+
+// Index of a unit name (aliases resolved), or UNIT_NONE
+uint32_t systemd_find(const unit_graph_t* g, const char* name, size_t len);
+
+static inline const char* unit_str(const unit_graph_t* g, uint32_t off) {
+    return g->strings + off;
+}
+
+// Per-session unit states (see sim.h)
+struct systemd_state;
+void systemd_state_free(struct systemd_state* s);
+
+// The session's boot as systemd logged it: fn gets each unit the boot
+// started, in schedule order, with the milliseconds after the kernel
+// started that its job began and finished, and its main process (0 for
+// none). Returns the boot time.
+typedef void (*systemd_boot_fn)(void* ctx, const unit_graph_t* g, uint32_t u, uint32_t start_ms, uint32_t done_ms,
+                                int32_t main_pid);
+time_t systemd_session_boot(systemd_boot_fn fn, void* ctx);
+
+// Simulated commands (see sim.c)
+int systemd_cmd_systemctl(int argc, char** argv);
+int systemd_cmd_analyze(int argc, char** argv);
+
+// --bench systemd [units]
+int systemd_bench(int argc, char** argv);
+
+#endif
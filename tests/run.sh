@@ -0,0 +1,85 @@
+#!/bin/sh
+# Golden-output checks, run by `make check` from the top of the tree:
+#
+#   NAME.script        replayed with --batch; the transcript must match NAME.out
+#   NAME.submissions   graded with --grade; the verdicts must match NAME.out
+#   cli.cases          one command line each; output and exit status must
+#                      match cli.out
+#
+# With --update the .out files are rewritten from what the tutor does now;
+# review the diff before committing it.
+#
+# usage: tests/run.sh DEB1 [--update]
+
+deb1=${1:?usage: tests/run.sh DEB1 [--update]}
+update=${2:-}
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/deb1-check.XXXXXX") || exit 1
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+# The simulated machine, whatever the host has: the bundled APT index and
+# units, seeded accounts, no scenario
+unset DEB1_ACCOUNTS DEB1_LOCATE_DB DEB1_UNIT_PATH DEB1_SCENARIO DEB1_LESSON_PACK DEB1_BENCH_JSON
+DEB1_APT_INDEX=lessons/Packages
+export DEB1_APT_INDEX
+
+# The pack from the source in the tree, not one installed elsewhere
+if ! "$deb1" --compile-pack lessons/debian.lessons "$tmp/debian.pack" >/dev/null; then
+    echo "FAIL: lessons/debian.lessons does not compile"
+    exit 1
+fi
+
+# The one line that depends on the host: what system detection found
+strip_host() {
+    grep -v -e '^🎯 Detected: ' -e '^🔎 Detected: ' "$1" > "$1.stripped"
+}
+
+compare() {
+    name=$1 actual=$2 expected=$3
+
+    if [ "$update" = --update ]; then
+        cp "$actual" "$expected"
+    elif ! diff -u "$expected" "$actual" > "$tmp/diff"; then
+        echo "FAIL: $name"
+        cat "$tmp/diff"
+        failed=$((failed + 1))
+        return
+    fi
+    echo "ok:   $name"
+}
+
+for script in tests/*.script; do
+    name=${script%.script}
+    "$deb1" --pack "$tmp/debian.pack" --batch "$script" --batch-output "$tmp/out" > /dev/null
+    status=$?
+    if [ "$status" -ne 0 ]; then
+        echo "FAIL: $script: exit status $status"
+        failed=$((failed + 1))
+        continue
+    fi
+    strip_host "$tmp/out"
+    compare "$script" "$tmp/out.stripped" "$name.out"
+done
+
+for submissions in tests/*.submissions; do
+    name=${submissions%.submissions}
+    "$deb1" --pack "$tmp/debian.pack" --grade "$submissions" --threads 2 --grade-output "$tmp/out" > /dev/null
+    status=$?
+    if [ "$status" -ne 0 ]; then
+        echo "FAIL: $submissions: exit status $status"
+        failed=$((failed + 1))
+        continue
+    fi
+    compare "$submissions" "$tmp/out" "$name.out"
+done
+
+grep -v -e '^#' -e '^$' tests/cli.cases | while IFS= read -r args; do
+    echo "\$ deb1 $args"
+    # Word-split on purpose: each line is a command line
+    # shellcheck disable=SC2086
+    "$deb1" $args < /dev/null 2>&1
+    echo "[exit $?]"
+done > "$tmp/cli"
+compare tests/cli.cases "$tmp/cli" tests/cli.out
+
+[ "$failed" -eq 0 ] || { echo "$failed check(s) failed"; exit 1; }
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include "util.h"
+
+void* xrealloc(void* p, size_t n) {
+    p = realloc(p, n);
+    if (!p && n) {
+        perror("realloc");
+        exit(1);
+    }
+    return p;
+}
+
+void* xcalloc(size_t n, size_t size) {
+    void* p = calloc(n ? n : 1, size ? size : 1);
+
+    if (!p) {
+        perror("calloc");
+        exit(1);
+    }
+    return p;
+}
+
+int set_error(char* err, size_t err_len, const char* fmt, ...) {
+    va_list ap;
+
+    if (err && err_len) {
+        va_start(ap, fmt);
+        vsnprintf(err, err_len, fmt, ap);
+        va_end(ap);
+    }
+    return -1;
+}
+
+// Read in growing chunks rather than trusting a size from fseek(), so
+// /proc files and pipes work too
+char* read_file(const char* path, size_t* len) {
+    FILE* fp = fopen(path, "rb");
+    char* data = NULL;
+    size_t used = 0, cap = 0, n;
+    int error;
+
+    if (!fp) return NULL;
+    do {
+        if (cap - used < 4096) {
+            cap = cap ? cap * 2 : 8192;
+            data = xrealloc(data, cap);
+        }
+        n = fread(data + used, 1, cap - used - 1, fp);
+        used += n;
+    } while (n > 0);
+    error = ferror(fp) ? (errno ? errno : EIO) : 0;
+    fclose(fp);
+    if (error) {
+        free(data);
+        errno = error;
+        return NULL;
+    }
+    data[used] = '\0';
+    if (len) *len = used;
+    return data;
+}
+
+int write_all(int fd, const void* data, size_t len) {
+    const char* p = data;
+
+    while (len) {
+        ssize_t n = write(fd, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,28 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stddef.h>
+
+// Small helpers every module used to carry its own copy of.
+
+// realloc() and calloc() that exit on failure: none of the callers has
+// anything better to do without the memory. A zero size is not a failure.
+void* xrealloc(void* p, size_t n);
+void* xcalloc(size_t n, size_t size);
+
+// Format a message into err (when there is room for one) and return -1,
+// for loaders that report why they failed: return set_error(err, ...)
+int set_error(char* err, size_t err_len, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// A whole file, NUL-terminated, in a buffer the caller frees; its length
+// (not counting the NUL) goes in *len if len is not NULL. NULL if the file
+// cannot be opened or read, with errno set.
+char* read_file(const char* path, size_t* len);
+
+// write() until all of data is out, through EINTR. 0 or -errno.
+int write_all(int fd, const void* data, size_t len);
+
+// qsort() order for doubles, smallest first
+int compare_double(const void* a, const void* b);
+
+#endif
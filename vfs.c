@@ -0,0 +1,1770 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "deb1.h"
+#include "console.h"
+#include "sim.h"
+#include "vfs.h"
+#include "perm.h"
+#include "bench.h"
+#include "util.h"
+
+#define NAME_MAX_LEN 255
+#define FIRST_CHUNK 2048          // small trees (one per learner) stay small
+#define MAX_CHUNK (256 * 1024)
+#define CLASS_COUNT 32
+#define POOLED_CLASSES 12       // up to 8192 entries; bigger arrays use malloc
+
+struct vfs {
+    vfs_inode_t* inodes;
+    uint32_t n_inodes, cap_inodes;
+    uint32_t* free_inodes;
+    uint32_t n_free, cap_free;
+
+    // Interned names: id = offset into names
+    char* names;
+    size_t names_len, names_cap;
+    uint64_t* name_table;       // open addressing: hash << 32 | (id + 1), 0 = empty
+    uint32_t table_cap, n_names;
+
+    // Child arrays
+    char** chunks;
+    size_t n_chunks, chunk_used, chunk_size, chunk_bytes;
+    vfs_dirent_t* free_blocks[CLASS_COUNT];
+    size_t big_bytes;           // arrays too large for the chunks
+
+    // Extended ACLs: runs of entries; a replaced run is not reused
+    vfs_acl_entry_t* acl_entries;
+    uint32_t n_acl_entries, cap_acl_entries;
+    uint32_t* acl_runs;         // first entry, then count, per run
+    uint32_t n_acl_runs, cap_acl_runs;
+
+    uint64_t generation;
+};
+
+// ---------------------------------------------------------------------
+// Name interning
+
+static uint32_t hash_name(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+// Slots keep the full hash so probing past other names never has to
+// touch the name strings (each of which would be a cache miss)
+static uint32_t find_name(const vfs_t* fs, const char* s, size_t len) {
+    uint32_t mask = fs->table_cap - 1;
+    uint32_t hash = hash_name(s, len);
+    uint32_t i = hash & mask;
+
+    for (;; i = (i + 1) & mask) {
+        uint64_t slot = fs->name_table[i];
+        const char* name;
+
+        if (slot == 0) return VFS_NONE;
+        if ((uint32_t)(slot >> 32) != hash) continue;
+        name = fs->names + (uint32_t)slot - 1;
+        if (strncmp(name, s, len) == 0 && name[len] == '\0') return (uint32_t)slot - 1;
+    }
+}
+
+static void grow_table(vfs_t* fs) {
+    uint32_t old_cap = fs->table_cap;
+    uint64_t* old = fs->name_table;
+    uint32_t i;
+
+    fs->table_cap = old_cap ? old_cap * 2 : 256;
+    fs->name_table = calloc(fs->table_cap, sizeof(uint64_t));
+    if (!fs->name_table) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = 0; i < old_cap; i++) {
+        if (old[i]) {
+            uint32_t j = (uint32_t)(old[i] >> 32) & (fs->table_cap - 1);
+
+            while (fs->name_table[j]) j = (j + 1) & (fs->table_cap - 1);
+            fs->name_table[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+static uint32_t intern_name(vfs_t* fs, const char* s, size_t len) {
+    uint32_t id = find_name(fs, s, len);
+    uint32_t hash, i;
+
+    if (id != VFS_NONE) return id;
+    if ((fs->n_names + 1) * 4 >= fs->table_cap * 3) grow_table(fs);
+
+    if (fs->names_len + len + 1 > fs->names_cap) {
+        while (fs->names_len + len + 1 > fs->names_cap) fs->names_cap *= 2;
+        fs->names = xrealloc(fs->names, fs->names_cap);
+    }
+    id = (uint32_t)fs->names_len;
+    memcpy(fs->names + id, s, len);
+    fs->names[id + len] = '\0';
+    fs->names_len += len + 1;
+
+    hash = hash_name(s, len);
+    i = hash & (fs->table_cap - 1);
+    while (fs->name_table[i]) i = (i + 1) & (fs->table_cap - 1);
+    fs->name_table[i] = (uint64_t)hash << 32 | (id + 1);
+    fs->n_names++;
+    return id;
+}
+
+// ---------------------------------------------------------------------
+// Child arrays: class k holds 4 << k entries
+
+static vfs_dirent_t* alloc_children(vfs_t* fs, uint32_t cls) {
+    size_t bytes = (size_t)(4u << cls) * sizeof(vfs_dirent_t);
+    vfs_dirent_t* block;
+
+    if (cls >= POOLED_CLASSES) {
+        fs->big_bytes += bytes;
+        return xrealloc(NULL, bytes);
+    }
+
+    block = fs->free_blocks[cls];
+    if (block) {
+        memcpy(&fs->free_blocks[cls], block, sizeof(block));
+        return block;
+    }
+    if (fs->n_chunks == 0 || fs->chunk_used + bytes > fs->chunk_size) {
+        fs->chunk_size = fs->chunk_size ? fs->chunk_size * 2 : FIRST_CHUNK;
+        if (fs->chunk_size > MAX_CHUNK) fs->chunk_size = MAX_CHUNK;
+        if (fs->chunk_size < bytes) fs->chunk_size = bytes;
+        fs->chunks = xrealloc(fs->chunks, (fs->n_chunks + 1) * sizeof(char*));
+        fs->chunks[fs->n_chunks++] = xrealloc(NULL, fs->chunk_size);
+        fs->chunk_bytes += fs->chunk_size;
+        fs->chunk_used = 0;
+    }
+    block = (vfs_dirent_t*)(fs->chunks[fs->n_chunks - 1] + fs->chunk_used);
+    fs->chunk_used += bytes;
+    return block;
+}
+
+static void free_children(vfs_t* fs, vfs_dirent_t* block, uint32_t cls) {
+    if (!block) return;
+    if (cls >= POOLED_CLASSES) {
+        fs->big_bytes -= (size_t)(4u << cls) * sizeof(vfs_dirent_t);
+        free(block);
+        return;
+    }
+    memcpy(block, &fs->free_blocks[cls], sizeof(block));
+    fs->free_blocks[cls] = block;
+}
+
+// Binary search by name id; returns the position it is (or would be) at
+static uint32_t child_position(const vfs_inode_t* dir, uint32_t name, int* found) {
+    uint32_t lo = 0, hi = dir->n_children;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (dir->children[mid].name < name) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = lo < dir->n_children && dir->children[lo].name == name;
+    return lo;
+}
+
+static void insert_child(vfs_t* fs, uint32_t dir_ino, uint32_t pos, uint32_t name, uint32_t ino) {
+    vfs_inode_t* dir = &fs->inodes[dir_ino];
+
+    if (!dir->children || dir->n_children == (4u << dir->children_class)) {
+        uint32_t cls = dir->children ? dir->children_class + 1 : 0;
+        vfs_dirent_t* grown = alloc_children(fs, cls);
+
+        dir = &fs->inodes[dir_ino];
+        if (dir->children) {
+            memcpy(grown, dir->children, dir->n_children * sizeof(vfs_dirent_t));
+            free_children(fs, dir->children, dir->children_class);
+        }
+        dir->children = grown;
+        dir->children_class = cls;
+    }
+    memmove(dir->children + pos + 1, dir->children + pos, (dir->n_children - pos) * sizeof(vfs_dirent_t));
+    dir->children[pos].name = name;
+    dir->children[pos].ino = ino;
+    dir->n_children++;
+}
+
+static void remove_child(vfs_inode_t* dir, uint32_t pos) {
+    dir->n_children--;
+    memmove(dir->children + pos, dir->children + pos + 1, (dir->n_children - pos) * sizeof(vfs_dirent_t));
+}
+
+// ---------------------------------------------------------------------
+// Inodes
+
+static uint32_t new_inode(vfs_t* fs) {
+    uint32_t ino;
+
+    if (fs->n_free) {
+        ino = fs->free_inodes[--fs->n_free];
+    } else {
+        if (fs->n_inodes == fs->cap_inodes) {
+            fs->cap_inodes = fs->cap_inodes ? fs->cap_inodes * 2 : 128;
+            fs->inodes = xrealloc(fs->inodes, fs->cap_inodes * sizeof(vfs_inode_t));
+        }
+        ino = fs->n_inodes++;
+    }
+    memset(&fs->inodes[ino], 0, sizeof(vfs_inode_t));
+    return ino;
+}
+
+static void release_inode(vfs_t* fs, uint32_t ino) {
+    vfs_inode_t* node = &fs->inodes[ino];
+
+    free_children(fs, node->children, node->children_class);
+    memset(node, 0, sizeof(*node));
+    node->parent = VFS_NONE;
+    if (fs->n_free == fs->cap_free) {
+        fs->cap_free = fs->cap_free ? fs->cap_free * 2 : 64;
+        fs->free_inodes = xrealloc(fs->free_inodes, fs->cap_free * sizeof(uint32_t));
+    }
+    fs->free_inodes[fs->n_free++] = ino;
+}
+
+vfs_t* vfs_new(void) {
+    vfs_t* fs = calloc(1, sizeof(vfs_t));
+    vfs_inode_t* root;
+
+    if (!fs) {
+        perror("calloc");
+        exit(1);
+    }
+    fs->names_cap = 1024;
+    fs->names = xrealloc(NULL, fs->names_cap);
+    grow_table(fs);
+
+    new_inode(fs);
+    root = &fs->inodes[VFS_ROOT];
+    root->mode = S_IFDIR | 0755;
+    root->nlink = 2;
+    root->size = 4096;
+    root->parent = VFS_ROOT;
+    root->name = intern_name(fs, "", 0);
+    return fs;
+}
+
+void vfs_free(vfs_t* fs) {
+    size_t i;
+    uint32_t ino;
+
+    if (!fs) return;
+    for (ino = 0; ino < fs->n_inodes; ino++) {
+        if (fs->inodes[ino].children_class >= POOLED_CLASSES) free(fs->inodes[ino].children);
+    }
+    for (i = 0; i < fs->n_chunks; i++) free(fs->chunks[i]);
+    free(fs->chunks);
+    free(fs->inodes);
+    free(fs->free_inodes);
+    free(fs->names);
+    free(fs->name_table);
+    free(fs->acl_entries);
+    free(fs->acl_runs);
+    free(fs);
+}
+
+const vfs_inode_t* vfs_inode(const vfs_t* fs, uint32_t ino) {
+    return &fs->inodes[ino];
+}
+
+const char* vfs_name(const vfs_t* fs, uint32_t name) {
+    return fs->names + name;
+}
+
+uint32_t vfs_inode_count(const vfs_t* fs) {
+    return fs->n_inodes - fs->n_free;
+}
+
+size_t vfs_memory_used(const vfs_t* fs) {
+    return fs->cap_inodes * sizeof(vfs_inode_t) + fs->cap_free * sizeof(uint32_t) +
+           fs->names_cap + fs->table_cap * sizeof(uint64_t) +
+           fs->chunk_bytes + fs->big_bytes + fs->cap_acl_entries * sizeof(vfs_acl_entry_t) +
+           fs->cap_acl_runs * 2 * sizeof(uint32_t);
+}
+
+// ---------------------------------------------------------------------
+// Lookup
+
+static uint32_t lookup_len(const vfs_t* fs, uint32_t dir, const char* name, size_t len) {
+    const vfs_inode_t* d = &fs->inodes[dir];
+    uint32_t id, pos;
+    int found;
+
+    if (len == 1 && name[0] == '.') return dir;
+    if (len == 2 && name[0] == '.' && name[1] == '.') return d->parent;
+    id = find_name(fs, name, len);
+    if (id == VFS_NONE) return VFS_NONE;
+    pos = child_position(d, id, &found);
+    return found ? d->children[pos].ino : VFS_NONE;
+}
+
+uint32_t vfs_lookup(const vfs_t* fs, uint32_t dir, const char* name) {
+    return lookup_len(fs, dir, name, strlen(name));
+}
+
+static int walk(const vfs_t* fs, uint32_t cwd, const char* path, const char* end, uint32_t* ino_out) {
+    uint32_t cur = *path == '/' ? VFS_ROOT : cwd;
+    const char* p = path;
+
+    while (p < end) {
+        const char* slash;
+        size_t len;
+
+        while (p < end && *p == '/') p++;
+        if (p == end) break;
+        slash = memchr(p, '/', (size_t)(end - p));
+        len = slash ? (size_t)(slash - p) : (size_t)(end - p);
+        if (len > NAME_MAX_LEN) return -ENAMETOOLONG;
+        if (!S_ISDIR(fs->inodes[cur].mode)) return -ENOTDIR;
+        cur = lookup_len(fs, cur, p, len);
+        if (cur == VFS_NONE) return -ENOENT;
+        p += len;
+    }
+    *ino_out = cur;
+    return 0;
+}
+
+int vfs_resolve(const vfs_t* fs, uint32_t cwd, const char* path, uint32_t* ino_out) {
+    size_t len = strlen(path);
+    uint32_t ino;
+    int err;
+
+    if (len == 0) return -ENOENT;
+    err = walk(fs, cwd, path, path + len, &ino);
+    if (err) return err;
+    // "file/" names a directory that is not there
+    if (path[len - 1] == '/' && !S_ISDIR(fs->inodes[ino].mode)) return -ENOTDIR;
+    *ino_out = ino;
+    return 0;
+}
+
+int vfs_resolve_parent(const vfs_t* fs, uint32_t cwd, const char* path,
+                       uint32_t* dir_out, char* name_buf, size_t name_len) {
+    const char* end = path + strlen(path);
+    const char* name;
+    uint32_t dir;
+    int err;
+
+    if (path == end) return -ENOENT;
+    while (end > path + 1 && end[-1] == '/') end--;
+    name = end;
+    while (name > path && name[-1] != '/') name--;
+    if ((size_t)(end - name) >= name_len || end - name > NAME_MAX_LEN) return -ENAMETOOLONG;
+
+    err = walk(fs, cwd, path, name, &dir);
+    if (err) return err;
+    if (!S_ISDIR(fs->inodes[dir].mode)) return -ENOTDIR;
+    memcpy(name_buf, name, (size_t)(end - name));
+    name_buf[end - name] = '\0';
+    *dir_out = dir;
+    return 0;
+}
+
+size_t vfs_path(const vfs_t* fs, uint32_t dir, char* buf, size_t len) {
+    uint32_t chain[256];
+    size_t n = 0, out = 0;
+    int depth = 0;
+
+    while (dir != VFS_ROOT && depth < 256) {
+        chain[depth++] = dir;
+        dir = fs->inodes[dir].parent;
+    }
+    if (depth == 0) {
+        if (len > 1) buf[out++] = '/';
+    }
+    while (depth-- > 0) {
+        const char* name = fs->names + fs->inodes[chain[depth]].name;
+
+        n = strlen(name);
+        if (out + n + 2 > len) break;
+        buf[out++] = '/';
+        memcpy(buf + out, name, n);
+        out += n;
+    }
+    if (len) buf[out < len ? out : len - 1] = '\0';
+    return out;
+}
+
+uint32_t vfs_children(const vfs_t* fs, uint32_t dir, const vfs_dirent_t** out) {
+    *out = fs->inodes[dir].children;
+    return fs->inodes[dir].n_children;
+}
+
+static int compare_by_name(const void* a, const void* b, void* ctx) {
+    const vfs_t* fs = ctx;
+
+    return strcmp(fs->names + ((const vfs_dirent_t*)a)->name, fs->names + ((const vfs_dirent_t*)b)->name);
+}
+
+void vfs_sorted_children(const vfs_t* fs, uint32_t dir, vfs_dirent_t* out) {
+    const vfs_inode_t* d = &fs->inodes[dir];
+
+    if (!d->n_children) return;
+    memcpy(out, d->children, d->n_children * sizeof(vfs_dirent_t));
+    qsort_r(out, d->n_children, sizeof(vfs_dirent_t), compare_by_name, (void*)fs);
+}
+
+// ---------------------------------------------------------------------
+// Mutations
+
+static int is_dot(const char* name) {
+    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
+int vfs_create(vfs_t* fs, uint32_t dir, const char* name, uint32_t mode,
+               uint32_t uid, uint32_t gid, time_t now, uint32_t* ino_out) {
+    size_t len = strlen(name);
+    uint32_t id, pos, ino;
+    vfs_inode_t* node;
+    int found;
+
+    if (!S_ISDIR(fs->inodes[dir].mode)) return -ENOTDIR;
+    if (len == 0 || is_dot(name)) return -EEXIST;
+    if (len > NAME_MAX_LEN || memchr(name, '/', len)) return -ENAMETOOLONG;
+
+    id = intern_name(fs, name, len);
+    pos = child_position(&fs->inodes[dir], id, &found);
+    if (found) return -EEXIST;
+
+    ino = new_inode(fs);
+    node = &fs->inodes[ino];
+    node->mode = mode;
+    node->uid = uid;
+    node->gid = gid;
+    node->atime = node->mtime = node->ctime = now;
+    if (S_ISDIR(mode)) {
+        node->nlink = 2;
+        node->size = 4096;
+        node->parent = dir;
+        node->name = id;
+        fs->inodes[dir].nlink++;
+    } else {
+        node->nlink = 1;
+        node->parent = VFS_NONE;
+    }
+    insert_child(fs, dir, pos, id, ino);
+    fs->inodes[dir].mtime = fs->inodes[dir].ctime = now;
+    if (ino_out) *ino_out = ino;
+    return 0;
+}
+
+// Detach an entry; the caller has checked it may go
+static void detach(vfs_t* fs, uint32_t dir, uint32_t pos, time_t now) {
+    vfs_inode_t* d = &fs->inodes[dir];
+    uint32_t ino = d->children[pos].ino;
+
+    remove_child(d, pos);
+    d->mtime = d->ctime = now;
+    if (S_ISDIR(fs->inodes[ino].mode)) {
+        fs->generation++;
+        d->nlink--;
+        release_inode(fs, ino);
+    } else if (--fs->inodes[ino].nlink == 0) {
+        release_inode(fs, ino);
+    } else {
+        fs->inodes[ino].ctime = now;
+    }
+}
+
+static int find_child(const vfs_t* fs, uint32_t dir, const char* name, uint32_t* pos_out) {
+    uint32_t id;
+    int found;
+
+    if (!S_ISDIR(fs->inodes[dir].mode)) return -ENOTDIR;
+    id = find_name(fs, name, strlen(name));
+    if (id == VFS_NONE) return -ENOENT;
+    *pos_out = child_position(&fs->inodes[dir], id, &found);
+    return found ? 0 : -ENOENT;
+}
+
+int vfs_unlink(vfs_t* fs, uint32_t dir, const char* name, time_t now) {
+    uint32_t pos;
+    const vfs_inode_t* node;
+    int err;
+
+    if (is_dot(name)) return -EINVAL;
+    err = find_child(fs, dir, name, &pos);
+    if (err) return err;
+    node = &fs->inodes[fs->inodes[dir].children[pos].ino];
+    if (S_ISDIR(node->mode) && node->n_children) return -ENOTEMPTY;
+    detach(fs, dir, pos, now);
+    return 0;
+}
+
+static void empty_dir(vfs_t* fs, uint32_t dir, time_t now) {
+    while (fs->inodes[dir].n_children) {
+        uint32_t pos = fs->inodes[dir].n_children - 1;
+        uint32_t ino = fs->inodes[dir].children[pos].ino;
+
+        if (S_ISDIR(fs->inodes[ino].mode)) empty_dir(fs, ino, now);
+        detach(fs, dir, pos, now);
+    }
+}
+
+int vfs_remove_tree(vfs_t* fs, uint32_t dir, const char* name, time_t now) {
+    uint32_t pos, ino;
+    int err;
+
+    if (is_dot(name)) return -EINVAL;
+    err = find_child(fs, dir, name, &pos);
+    if (err) return err;
+    ino = fs->inodes[dir].children[pos].ino;
+    if (S_ISDIR(fs->inodes[ino].mode)) empty_dir(fs, ino, now);
+    detach(fs, dir, pos, now);
+    return 0;
+}
+
+int vfs_rename(vfs_t* fs, uint32_t from_dir, const char* from, uint32_t to_dir, const char* to, time_t now) {
+    uint32_t pos, to_pos, ino, id, up;
+    int found, err, is_dir;
+
+    if (is_dot(from) || is_dot(to)) return -EINVAL;
+    err = find_child(fs, from_dir, from, &pos);
+    if (err) return err;
+    if (!S_ISDIR(fs->inodes[to_dir].mode)) return -ENOTDIR;
+    if (strlen(to) == 0 || strlen(to) > NAME_MAX_LEN || strchr(to, '/')) return -ENAMETOOLONG;
+    ino = fs->inodes[from_dir].children[pos].ino;
+    is_dir = S_ISDIR(fs->inodes[ino].mode);
+
+    // A directory cannot move below itself
+    if (is_dir) {
+        for (up = to_dir;; up = fs->inodes[up].parent) {
+            if (up == ino) return -EINVAL;
+            if (up == VFS_ROOT) break;
+        }
+    }
+
+    id = intern_name(fs, to, strlen(to));
+    to_pos = child_position(&fs->inodes[to_dir], id, &found);
+    if (found) {
+        uint32_t target = fs->inodes[to_dir].children[to_pos].ino;
+        const vfs_inode_t* t = &fs->inodes[target];
+
+        if (target == ino) return 0;
+        if (S_ISDIR(t->mode) && !is_dir) return -EISDIR;
+        if (!S_ISDIR(t->mode) && is_dir) return -ENOTDIR;
+        if (S_ISDIR(t->mode) && t->n_children) return -ENOTEMPTY;
+        detach(fs, to_dir, to_pos, now);
+    }
+
+    // Positions may have shifted if the target lived in the same directory
+    find_child(fs, from_dir, from, &pos);
+    remove_child(&fs->inodes[from_dir], pos);
+    to_pos = child_position(&fs->inodes[to_dir], id, &found);
+    insert_child(fs, to_dir, to_pos, id, ino);
+    if (is_dir) {
+        fs->generation++;
+        fs->inodes[from_dir].nlink--;
+        fs->inodes[to_dir].nlink++;
+        fs->inodes[ino].parent = to_dir;
+        fs->inodes[ino].name = id;
+    }
+    fs->inodes[ino].ctime = now;
+    fs->inodes[from_dir].mtime = fs->inodes[from_dir].ctime = now;
+    fs->inodes[to_dir].mtime = fs->inodes[to_dir].ctime = now;
+    return 0;
+}
+
+void vfs_touch(vfs_t* fs, uint32_t ino, time_t now) {
+    fs->inodes[ino].atime = fs->inodes[ino].mtime = fs->inodes[ino].ctime = now;
+}
+
+void vfs_set_size(vfs_t* fs, uint32_t ino, uint64_t size, time_t now) {
+    fs->inodes[ino].size = size;
+    fs->inodes[ino].mtime = fs->inodes[ino].ctime = now;
+}
+
+void vfs_set_times(vfs_t* fs, uint32_t ino, time_t atime, time_t mtime, time_t ctime) {
+    fs->inodes[ino].atime = atime;
+    fs->inodes[ino].mtime = mtime;
+    fs->inodes[ino].ctime = ctime;
+}
+
+static vfs_acl_entry_t* acl_mask(vfs_t* fs, uint32_t ino) {
+    uint32_t run = fs->inodes[ino].acl, i;
+
+    if (!run) return NULL;
+    for (i = 0; i < fs->acl_runs[(run - 1) * 2 + 1]; i++) {
+        vfs_acl_entry_t* e = &fs->acl_entries[fs->acl_runs[(run - 1) * 2] + i];
+
+        if (e->tag == VFS_ACL_MASK) return e;
+    }
+    return NULL;
+}
+
+void vfs_chmod(vfs_t* fs, uint32_t ino, uint32_t mode, time_t now) {
+    vfs_inode_t* node = &fs->inodes[ino];
+    vfs_acl_entry_t* mask = acl_mask(fs, ino);
+
+    node->mode = (node->mode & ~07777u) | (mode & 07777);
+    if (mask) mask->perm = (mode >> 3) & 7;
+    node->ctime = now;
+    if (S_ISDIR(node->mode)) fs->generation++;
+}
+
+void vfs_chown(vfs_t* fs, uint32_t ino, uint32_t uid, uint32_t gid, time_t now) {
+    vfs_inode_t* node = &fs->inodes[ino];
+
+    node->uid = uid;
+    node->gid = gid;
+    node->ctime = now;
+    if (S_ISDIR(node->mode)) fs->generation++;
+}
+
+uint32_t vfs_acl(const vfs_t* fs, uint32_t ino, const vfs_acl_entry_t** out) {
+    uint32_t run = fs->inodes[ino].acl;
+
+    if (!run) return 0;
+    *out = &fs->acl_entries[fs->acl_runs[(run - 1) * 2]];
+    return fs->acl_runs[(run - 1) * 2 + 1];
+}
+
+void vfs_set_acl(vfs_t* fs, uint32_t ino, const vfs_acl_entry_t* entries, uint32_t n, time_t now) {
+    vfs_inode_t* node = &fs->inodes[ino];
+
+    node->acl = 0;
+    if (n) {
+        if (fs->n_acl_entries + n > fs->cap_acl_entries) {
+            while (fs->n_acl_entries + n > fs->cap_acl_entries) {
+                fs->cap_acl_entries = fs->cap_acl_entries ? fs->cap_acl_entries * 2 : 64;
+            }
+            fs->acl_entries = xrealloc(fs->acl_entries, fs->cap_acl_entries * sizeof(vfs_acl_entry_t));
+        }
+        if (fs->n_acl_runs == fs->cap_acl_runs) {
+            fs->cap_acl_runs = fs->cap_acl_runs ? fs->cap_acl_runs * 2 : 16;
+            fs->acl_runs = xrealloc(fs->acl_runs, fs->cap_acl_runs * 2 * sizeof(uint32_t));
+        }
+        memcpy(&fs->acl_entries[fs->n_acl_entries], entries, n * sizeof(vfs_acl_entry_t));
+        fs->acl_runs[fs->n_acl_runs * 2] = fs->n_acl_entries;
+        fs->acl_runs[fs->n_acl_runs * 2 + 1] = n;
+        fs->n_acl_entries += n;
+        node->acl = ++fs->n_acl_runs;
+    }
+    node->ctime = now;
+    if (S_ISDIR(node->mode)) fs->generation++;
+}
+
+uint64_t vfs_generation(const vfs_t* fs) {
+    return fs->generation;
+}
+
+// ---------------------------------------------------------------------
+// The simulated Debian system
+
+#define UID_ROOT 0
+#define GID_ADM 4
+#define GID_SHADOW 42
+#define UID_WWW_DATA 33
+#define UID_ADMIN 1000
+
+typedef struct {
+    const char* path;
+    uint32_t mode;
+    uint32_t uid, gid;
+    uint32_t size;
+    const char* mtime;      // UTC
+} seed_entry_t;
+
+#define D(m) (S_IFDIR | (m))
+#define F(m) (S_IFREG | (m))
+
+// Parents come before their children. Sizes and dates follow the
+// examples in lessons/debian.lessons.
+static const seed_entry_t debian_tree[] = {
+    { "/bin", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/boot", D(0755), 0, 0, 4096, "2023-10-10 09:12:40" },
+    { "/dev", D(0755), 0, 0, 3260, "2023-10-15 08:01:12" },
+    { "/etc", D(0755), 0, 0, 4096, "2023-10-15 10:30:00" },
+    { "/etc/adduser.conf", F(0644), 0, 0, 3040, "2023-01-26 18:10:03" },
+    { "/etc/alternatives", D(0755), 0, 0, 4096, "2023-10-10 09:20:11" },
+    { "/etc/apt", D(0755), 0, 0, 4096, "2023-10-10 09:14:30" },
+    { "/etc/apt/apt.conf.d", D(0755), 0, 0, 4096, "2023-10-10 09:14:30" },
+    { "/etc/apt/sources.list", F(0644), 0, 0, 211, "2023-10-10 09:14:30" },
+    { "/etc/apt/sources.list.d", D(0755), 0, 0, 4096, "2023-10-10 09:14:30" },
+    { "/etc/bash.bashrc", F(0644), 0, 0, 2969, "2023-10-10 09:15:00" },
+    { "/etc/bindresvport.blacklist", F(0644), 0, 0, 367, "2023-01-27 11:02:44" },
+    { "/etc/cron.d", D(0755), 0, 0, 4096, "2023-10-15 10:30:00" },
+    { "/etc/cron.daily", D(0755), 0, 0, 4096, "2023-10-15 10:30:00" },
+    { "/etc/debconf.conf", F(0644), 0, 0, 2969, "2023-01-26 20:15:33" },
+    { "/etc/default", D(0755), 0, 0, 4096, "2023-10-10 09:20:11" },
+    { "/etc/deluser.conf", F(0644), 0, 0, 604, "2023-07-02 06:41:25" },
+    { "/etc/fstab", F(0644), 0, 0, 664, "2023-10-10 09:12:40" },
+    { "/etc/fuse.conf", F(0644), 0, 0, 694, "2023-03-18 14:01:59" },
+    { "/etc/group", F(0644), 0, 0, 789, "2023-10-10 09:20:45" },
+    { "/etc/gshadow", F(0640), 0, GID_SHADOW, 656, "2023-10-10 09:20:45" },
+    { "/etc/host.conf", F(0644), 0, 0, 9, "2023-08-07 19:30:21" },
+    { "/etc/hostname", F(0644), 0, 0, 14, "2023-10-10 09:12:40" },
+    { "/etc/hosts", F(0644), 0, 0, 186, "2023-10-10 09:12:40" },
+    { "/etc/issue", F(0644), 0, 0, 27, "2023-09-23 10:11:12" },
+    { "/etc/logrotate.conf", F(0644), 0, 0, 533, "2023-02-22 13:40:07" },
+    { "/etc/motd", F(0644), 0, 0, 286, "2023-09-23 10:11:12" },
+    { "/etc/os-release", F(0644), 0, 0, 267, "2023-09-23 10:11:12" },
+    { "/etc/passwd", F(0644), 0, 0, 2847, "2023-10-10 09:20:45" },
+    { "/etc/profile", F(0644), 0, 0, 769, "2023-03-27 08:44:05" },
+    { "/etc/resolv.conf", F(0644), 0, 0, 45, "2023-10-15 08:01:20" },
+    { "/etc/shadow", F(0640), 0, GID_SHADOW, 1342, "2023-10-10 09:20:45" },
+    { "/etc/shells", F(0644), 0, 0, 116, "2023-10-10 09:15:00" },
+    { "/etc/ssh", D(0755), 0, 0, 4096, "2023-10-10 09:18:02" },
+    { "/etc/ssh/moduli", F(0644), 0, 0, 577388, "2023-09-21 20:18:44" },
+    { "/etc/ssh/ssh_config", F(0644), 0, 0, 1650, "2023-09-21 20:18:44" },
+    { "/etc/ssh/sshd_config", F(0644), 0, 0, 3223, "2023-10-10 09:18:02" },
+    { "/etc/sudoers", F(0440), 0, 0, 1042, "2023-10-10 09:20:45" },
+    { "/etc/sudoers.d", D(0750), 0, 0, 4096, "2023-10-10 09:20:45" },
+    { "/etc/systemd", D(0755), 0, 0, 4096, "2023-10-10 09:16:30" },
+    { "/home", D(0755), 0, 0, 4096, "2023-10-10 09:15:00" },
+    { "/home/admin", D(0755), UID_ADMIN, UID_ADMIN, 4096, "2023-10-15 14:30:00" },
+    { "/home/admin/.bash_logout", F(0644), UID_ADMIN, UID_ADMIN, 220, "2023-10-10 09:15:00" },
+    { "/home/admin/.bashrc", F(0644), UID_ADMIN, UID_ADMIN, 3526, "2023-10-10 09:15:00" },
+    { "/home/admin/.profile", F(0644), UID_ADMIN, UID_ADMIN, 807, "2023-10-10 09:15:00" },
+    { "/home/admin/.ssh", D(0700), UID_ADMIN, UID_ADMIN, 4096, "2023-10-15 14:25:00" },
+    { "/home/admin/.ssh/authorized_keys", F(0600), UID_ADMIN, UID_ADMIN, 95, "2023-10-15 14:25:00" },
+    { "/home/admin/Documents", D(0755), UID_ADMIN, UID_ADMIN, 4096, "2023-10-15 12:30:00" },
+    { "/home/admin/Documents/notes.txt", F(0644), UID_ADMIN, UID_ADMIN, 1214, "2023-10-15 12:30:00" },
+    { "/lib", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/lib/systemd", D(0755), 0, 0, 4096, "2023-10-10 09:16:30" },
+    { "/lib/systemd/system", D(0755), 0, 0, 12288, "2023-10-10 09:16:30" },
+    { "/media", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/mnt", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/opt", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/proc", D(0555), 0, 0, 0, "2023-10-15 08:01:10" },
+    { "/root", D(0700), 0, 0, 4096, "2023-10-10 09:21:40" },
+    { "/root/.bashrc", F(0644), 0, 0, 571, "2023-10-10 09:10:02" },
+    { "/root/.profile", F(0644), 0, 0, 161, "2023-10-10 09:10:02" },
+    { "/run", D(0755), 0, 0, 620, "2023-10-15 08:01:14" },
+    { "/sbin", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/srv", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/sys", D(0555), 0, 0, 0, "2023-10-15 08:01:10" },
+    { "/tmp", D(01777), 0, 0, 4096, "2023-10-15 14:00:00" },
+    { "/usr", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/usr/bin", D(0755), 0, 0, 20480, "2023-10-15 10:30:00" },
+    { "/usr/lib", D(0755), 0, 0, 4096, "2023-10-10 09:16:30" },
+    { "/usr/local", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/usr/sbin", D(0755), 0, 0, 12288, "2023-10-15 10:30:00" },
+    { "/usr/share", D(0755), 0, 0, 4096, "2023-10-10 09:16:30" },
+    { "/var", D(0755), 0, 0, 4096, "2023-10-10 09:10:02" },
+    { "/var/cache", D(0755), 0, 0, 4096, "2023-10-10 09:14:30" },
+    { "/var/lib", D(0755), 0, 0, 4096, "2023-10-10 09:16:30" },
+    { "/var/log", D(0755), 0, 0, 4096, "2023-10-15 08:01:20" },
+    { "/var/log/apt", D(0755), 0, 0, 4096, "2023-10-15 10:30:00" },
+    { "/var/log/auth.log", F(0640), 0, GID_ADM, 48213, "2023-10-15 14:28:51" },
+    { "/var/log/daemon.log", F(0640), 0, GID_ADM, 20390, "2023-10-15 14:10:02" },
+    { "/var/log/dpkg.log", F(0644), 0, 0, 91322, "2023-10-15 10:30:00" },
+    { "/var/log/kern.log", F(0640), 0, GID_ADM, 63011, "2023-10-15 13:45:22" },
+    { "/var/log/nginx", D(0755), 0, GID_ADM, 4096, "2023-10-15 00:00:01" },
+    { "/var/log/nginx/access.log", F(0640), UID_WWW_DATA, GID_ADM, 301553, "2023-10-15 14:29:58" },
+    { "/var/log/nginx/error.log", F(0640), UID_WWW_DATA, GID_ADM, 40210, "2023-10-15 14:27:40" },
+    { "/var/log/syslog", F(0640), 0, GID_ADM, 184406, "2023-10-15 14:29:59" },
+    { "/var/tmp", D(01777), 0, 0, 4096, "2023-10-10 09:10:02" },
+};
+
+#undef D
+#undef F
+
+static time_t parse_utc(const char* s) {
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    sscanf(s, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return timegm(&tm);
+}
+
+void vfs_seed_debian(vfs_t* fs) {
+    time_t installed = parse_utc("2023-10-10 09:10:02");
+    size_t i;
+
+    vfs_set_times(fs, VFS_ROOT, installed, installed, installed);
+    for (i = 0; i < sizeof(debian_tree) / sizeof(debian_tree[0]); i++) {
+        const seed_entry_t* e = &debian_tree[i];
+        time_t t = parse_utc(e->mtime);
+        char name[NAME_MAX_LEN + 1];
+        uint32_t dir, ino;
+
+        if (vfs_resolve_parent(fs, VFS_ROOT, e->path, &dir, name, sizeof(name)) != 0) continue;
+        if (vfs_create(fs, dir, name, e->mode, e->uid, e->gid, t, &ino) != 0) continue;
+        fs->inodes[ino].size = e->size;
+    }
+    // Creating children stamped the parents; put the listed dates back
+    for (i = 0; i < sizeof(debian_tree) / sizeof(debian_tree[0]); i++) {
+        uint32_t ino;
+        time_t t = parse_utc(debian_tree[i].mtime);
+
+        if (vfs_resolve(fs, VFS_ROOT, debian_tree[i].path, &ino) == 0) vfs_set_times(fs, ino, t, t, t);
+    }
+}
+
+// ---------------------------------------------------------------------
+// Commands
+
+#define SIX_MONTHS (183 * 24 * 3600)
+
+// Group of a new entry in dir: a setgid directory's, else the creator's
+static uint32_t new_gid(sim_env_t* env, uint32_t dir) {
+    const vfs_inode_t* d = vfs_inode(env->vfs, dir);
+
+    return (d->mode & S_ISGID) ? d->gid : perm_session_cred(env)->gid;
+}
+
+// New directories in a setgid directory are setgid too
+static uint32_t new_dir_mode(const sim_env_t* env, uint32_t dir, uint32_t mode) {
+    return S_IFDIR | mode | (vfs_inode(env->vfs, dir)->mode & S_ISGID);
+}
+
+// A removal may have taken the working directory with it
+static void check_cwd(sim_env_t* env) {
+    if (!S_ISDIR(vfs_inode(env->vfs, env->home)->mode)) env->home = VFS_ROOT;
+    if (!S_ISDIR(vfs_inode(env->vfs, env->cwd)->mode)) env->cwd = env->home;
+}
+
+static const char* base_name(const char* path) {
+    const char* end = path + strlen(path);
+    const char* p;
+
+    while (end > path + 1 && end[-1] == '/') end--;
+    for (p = end; p > path && p[-1] != '/'; p--) {
+    }
+    return p;
+}
+
+static void mode_string(uint32_t mode, char* out) {
+    static const char rwx[] = "rwxrwxrwx";
+    int i;
+
+    out[0] = S_ISDIR(mode) ? 'd' : '-';
+    for (i = 0; i < 9; i++) out[i + 1] = (mode & (0400u >> i)) ? rwx[i] : '-';
+    if (mode & S_ISUID) out[3] = (mode & 0100) ? 's' : 'S';
+    if (mode & S_ISGID) out[6] = (mode & 0010) ? 's' : 'S';
+    if (mode & S_ISVTX) out[9] = (mode & 0001) ? 't' : 'T';
+    out[10] = '\0';
+}
+
+static void ls_time(time_t t, time_t now, char* buf, size_t len) {
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    if (t > now - SIX_MONTHS && t <= now + 3600) {
+        strftime(buf, len, "%b %e %H:%M", &tm);
+    } else {
+        strftime(buf, len, "%b %e  %Y", &tm);
+    }
+}
+
+// ls -h: powers of 1024, rounded up, one decimal below 10
+static void human_size(uint64_t bytes, char* buf, size_t len) {
+    static const char units[] = "KMGTPE";
+    uint64_t scale = 1024, tenths, whole;
+    int u = 0;
+
+    if (bytes < 1024) {
+        snprintf(buf, len, "%llu", (unsigned long long)bytes);
+        return;
+    }
+    while (bytes / scale >= 1024 && u < 5) {
+        scale *= 1024;
+        u++;
+    }
+    tenths = (bytes * 10 + scale - 1) / scale;
+    if (tenths < 100) {
+        snprintf(buf, len, "%llu.%llu%c", (unsigned long long)(tenths / 10), (unsigned long long)(tenths % 10), units[u]);
+        return;
+    }
+    whole = (bytes + scale - 1) / scale;
+    if (whole >= 1024 && u < 5) {
+        snprintf(buf, len, "1.0%c", units[u + 1]);
+    } else {
+        snprintf(buf, len, "%llu%c", (unsigned long long)whole, units[u]);
+    }
+}
+
+static uint64_t blocks_1k(const vfs_inode_t* node) {
+    return (node->size + 4095) / 4096 * 4;
+}
+
+typedef struct {
+    const char* name;
+    uint32_t ino;
+} ls_row_t;
+
+typedef struct {
+    const vfs_t* fs;
+    uint64_t flags;
+} ls_order_t;
+
+static int compare_rows(const void* a, const void* b, void* ctx) {
+    const ls_order_t* order = ctx;
+    const ls_row_t* x = a;
+    const ls_row_t* y = b;
+    const vfs_inode_t* nx = vfs_inode(order->fs, x->ino);
+    const vfs_inode_t* ny = vfs_inode(order->fs, y->ino);
+    int c = 0;
+
+    if (order->flags & SIM_FLAG('S')) {
+        c = (nx->size < ny->size) - (nx->size > ny->size);
+    } else if (order->flags & SIM_FLAG('t')) {
+        c = (nx->mtime < ny->mtime) - (nx->mtime > ny->mtime);
+    }
+    if (c == 0) c = strcmp(x->name, y->name);
+    return (order->flags & SIM_FLAG('r')) ? -c : c;
+}
+
+static int digits(uint64_t v) {
+    int n = 1;
+
+    while (v >= 10) {
+        v /= 10;
+        n++;
+    }
+    return n;
+}
+
+static void print_rows(sim_env_t* env, ls_row_t* rows, size_t n, const sim_opts_t* o, int show_total) {
+    ls_order_t order = { env->vfs, o->flags };
+    int w_links = 1, w_user = 1, w_group = 1, w_size = 1, any_acl = 0;
+    uint64_t total = 0;
+    char size[32];
+    size_t i;
+
+    qsort_r(rows, n, sizeof(ls_row_t), compare_rows, &order);
+
+    if (!SIM_HAS(o, 'l')) {
+        int one_per_line = SIM_HAS(o, '1') || console_current()->capture;
+
+        for (i = 0; i < n; i++) {
+            con_printf("%s%s", rows[i].name, one_per_line || i + 1 == n ? "\n" : "  ");
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        const vfs_inode_t* node = vfs_inode(env->vfs, rows[i].ino);
+        int w;
+
+        total += blocks_1k(node);
+        any_acl |= node->acl != 0;
+        if ((w = digits(node->nlink)) > w_links) w_links = w;
+        if ((w = (int)strlen(sim_user_name(node->uid))) > w_user) w_user = w;
+        if ((w = (int)strlen(sim_group_name(node->gid))) > w_group) w_group = w;
+        if (SIM_HAS(o, 'h')) {
+            human_size(node->size, size, sizeof(size));
+            w = (int)strlen(size);
+        } else {
+            w = digits(node->size);
+        }
+        if (w > w_size) w_size = w;
+    }
+    if (show_total) {
+        if (SIM_HAS(o, 'h')) {
+            human_size(total * 1024, size, sizeof(size));
+            con_printf("total %s\n", size);
+        } else {
+            con_printf("total %llu\n", (unsigned long long)total);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        const vfs_inode_t* node = vfs_inode(env->vfs, rows[i].ino);
+        char mode[12], when[32];
+
+        mode_string(node->mode, mode);
+        // An ACL shows as a '+', and then everything else gets a column
+        if (any_acl) {
+            mode[10] = node->acl ? '+' : ' ';
+            mode[11] = '\0';
+        }
+        ls_time((time_t)node->mtime, env->clock, when, sizeof(when));
+        if (SIM_HAS(o, 'h')) {
+            human_size(node->size, size, sizeof(size));
+        } else {
+            snprintf(size, sizeof(size), "%llu", (unsigned long long)node->size);
+        }
+        con_printf("%s %*u %-*s %-*s %*s %s %s\n", mode, w_links, node->nlink,
+                   w_user, sim_user_name(node->uid), w_group, sim_group_name(node->gid),
+                   w_size, size, when, rows[i].name);
+    }
+}
+
+static int list_directory(sim_env_t* env, uint32_t dir, const char* path, const sim_opts_t* o) {
+    const vfs_inode_t* d = vfs_inode(env->vfs, dir);
+    ls_row_t* rows;
+    size_t n = 0;
+    uint32_t i;
+
+    if (!perm_may(env, dir, 4)) {
+        sim_error("ls", "cannot open directory '%s': %s", path, strerror(EACCES));
+        return 2;
+    }
+    rows = malloc((d->n_children + 2) * sizeof(ls_row_t));
+    if (!rows) return 2;
+    if (SIM_HAS(o, 'a')) {
+        rows[n].name = ".";
+        rows[n++].ino = dir;
+        rows[n].name = "..";
+        rows[n++].ino = d->parent;
+    }
+    for (i = 0; i < d->n_children; i++) {
+        const char* name = vfs_name(env->vfs, d->children[i].name);
+
+        if (name[0] == '.' && !SIM_HAS(o, 'a') && !SIM_HAS(o, 'A')) continue;
+        rows[n].name = name;
+        rows[n++].ino = d->children[i].ino;
+    }
+    print_rows(env, rows, n, o, 1);
+    free(rows);
+    return 0;
+}
+
+int vfs_cmd_ls(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    static char dot[] = ".";
+    char* here[1] = { dot };
+    char** operands = argv + 1;
+    ls_row_t* files;
+    uint32_t* dirs;
+    size_t n_files = 0, n_dirs = 0, i;
+    sim_opts_t o;
+    int status = 0;
+
+    if (sim_getopt(argc, argv, "aAlhd1rtS", &o) < 0) return 2;
+    if (o.n_operands == 0) {
+        operands = here;
+        o.n_operands = 1;
+    }
+    files = malloc((size_t)o.n_operands * sizeof(ls_row_t));
+    dirs = malloc((size_t)o.n_operands * sizeof(uint32_t));
+
+    // Files first, then each directory, as ls does
+    for (i = 0; i < (size_t)o.n_operands; i++) {
+        uint32_t ino;
+        int err = perm_resolve(env, operands[i], &ino);
+
+        if (err) {
+            sim_error("ls", "cannot access '%s': %s", operands[i], strerror(-err));
+            status = 2;
+        } else if (S_ISDIR(vfs_inode(env->vfs, ino)->mode) && !SIM_HAS(&o, 'd')) {
+            dirs[n_dirs++] = (uint32_t)i;
+        } else {
+            files[n_files].name = operands[i];
+            files[n_files++].ino = ino;
+        }
+    }
+    if (n_files) print_rows(env, files, n_files, &o, 0);
+    for (i = 0; i < n_dirs; i++) {
+        uint32_t ino;
+
+        perm_resolve(env, operands[dirs[i]], &ino);
+        if (n_files || i > 0) con_printf("\n");
+        if (n_files || n_dirs > 1 || status) con_printf("%s:\n", operands[dirs[i]]);
+        if (list_directory(env, ino, operands[dirs[i]], &o)) status = 2;
+    }
+    free(files);
+    free(dirs);
+    return status;
+}
+
+int vfs_cmd_pwd(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    char path[4096];
+
+    (void)argc;
+    (void)argv;
+    vfs_path(env->vfs, env->cwd, path, sizeof(path));
+    con_printf("%s\n", path);
+    return 0;
+}
+
+int vfs_cmd_cd(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    uint32_t ino = env->home;
+    int err = 0;
+
+    if (argc > 2) {
+        con_printf("bash: cd: too many arguments\n");
+        return 1;
+    }
+    if (argc == 2) {
+        err = perm_resolve(env, argv[1], &ino);
+        if (!err && !S_ISDIR(vfs_inode(env->vfs, ino)->mode)) err = -ENOTDIR;
+        if (!err && !perm_may(env, ino, 1)) err = -EACCES;
+    }
+    if (err) {
+        con_printf("bash: cd: %s: %s\n", argv[1], strerror(-err));
+        return 1;
+    }
+    env->cwd = ino;
+    return 0;
+}
+
+static int make_path(sim_env_t* env, const char* path, uint32_t mode, int verbose) {
+    uint32_t cur = path[0] == '/' ? VFS_ROOT : env->cwd;
+    const char* p = path;
+    char prefix[4096];
+
+    while (*p) {
+        const char* end;
+        char name[NAME_MAX_LEN + 1];
+        size_t len;
+        uint32_t next;
+        int err;
+
+        while (*p == '/') p++;
+        if (!*p) break;
+        end = strchr(p, '/');
+        len = end ? (size_t)(end - p) : strlen(p);
+        if (len > NAME_MAX_LEN || (size_t)(p - path) + len >= sizeof(prefix)) {
+            sim_error("mkdir", "cannot create directory '%s': %s", path, strerror(ENAMETOOLONG));
+            return 1;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+        memcpy(prefix, path, (size_t)(p - path) + len);
+        prefix[(p - path) + len] = '\0';
+        p += len;
+
+        next = vfs_lookup(env->vfs, cur, name);
+        if (next != VFS_NONE) {
+            if (!S_ISDIR(vfs_inode(env->vfs, next)->mode)) {
+                sim_error("mkdir", "cannot create directory '%s': %s", prefix, strerror(ENOTDIR));
+                return 1;
+            }
+            cur = next;
+            continue;
+        }
+        err = perm_may(env, cur, 3) ? 0 : -EACCES;
+        if (!err) err = vfs_create(env->vfs, cur, name, new_dir_mode(env, cur, mode), env->euid, new_gid(env, cur), env->clock, &next);
+        if (err) {
+            sim_error("mkdir", "cannot create directory '%s': %s", prefix, strerror(-err));
+            return 1;
+        }
+        if (verbose) con_printf("mkdir: created directory '%s'\n", prefix);
+        cur = next;
+    }
+    return 0;
+}
+
+int vfs_cmd_mkdir(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    uint32_t mode = 0777 & ~env->umask;
+    sim_opts_t o;
+    int i, status = 0;
+
+    if (sim_getopt(argc, argv, "pvm:", &o) < 0) return 1;
+    if (o.value) {
+        char* end;
+        unsigned long m = strtoul(o.value, &end, 8);
+
+        if (*end || m > 07777) {
+            sim_error("mkdir", "invalid mode '%s'", o.value);
+            return 1;
+        }
+        mode = (uint32_t)m;
+    }
+    if (o.n_operands == 0) {
+        sim_error("mkdir", "missing operand\nTry 'mkdir --help' for more information.");
+        return 1;
+    }
+    for (i = 1; i <= o.n_operands; i++) {
+        char name[NAME_MAX_LEN + 1];
+        uint32_t dir;
+        int err;
+
+        if (SIM_HAS(&o, 'p')) {
+            status |= make_path(env, argv[i], mode, SIM_HAS(&o, 'v'));
+            continue;
+        }
+        err = perm_resolve_parent(env, argv[i], &dir, name, sizeof(name));
+        if (!err && vfs_lookup(env->vfs, dir, name) == VFS_NONE && !perm_may(env, dir, 3)) err = -EACCES;
+        if (!err) err = vfs_create(env->vfs, dir, name, new_dir_mode(env, dir, mode), env->euid, new_gid(env, dir), env->clock, NULL);
+        if (err) {
+            sim_error("mkdir", "cannot create directory '%s': %s", argv[i], strerror(-err));
+            status = 1;
+        } else if (SIM_HAS(&o, 'v')) {
+            con_printf("mkdir: created directory '%s'\n", argv[i]);
+        }
+    }
+    return status;
+}
+
+int vfs_cmd_rmdir(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    sim_opts_t o;
+    int i, status = 0;
+
+    if (sim_getopt(argc, argv, "v", &o) < 0) return 1;
+    if (o.n_operands == 0) {
+        sim_error("rmdir", "missing operand\nTry 'rmdir --help' for more information.");
+        return 1;
+    }
+    for (i = 1; i <= o.n_operands; i++) {
+        char name[NAME_MAX_LEN + 1];
+        uint32_t dir, ino = VFS_NONE;
+        int err = perm_resolve_parent(env, argv[i], &dir, name, sizeof(name));
+
+        if (!err) ino = vfs_lookup(env->vfs, dir, name);
+        if (!err && ino == VFS_NONE) err = -ENOENT;
+        if (!err && !S_ISDIR(vfs_inode(env->vfs, ino)->mode)) err = -ENOTDIR;
+        if (!err && !perm_may_unlink(env, dir, ino)) err = -EACCES;
+        if (!err) err = vfs_unlink(env->vfs, dir, name, env->clock);
+        if (err) {
+            sim_error("rmdir", "failed to remove '%s': %s", argv[i], strerror(-err));
+            status = 1;
+        } else if (SIM_HAS(&o, 'v')) {
+            con_printf("rmdir: removing directory, '%s'\n", argv[i]);
+        }
+    }
+    check_cwd(env);
+    return status;
+}
+
+int vfs_cmd_touch(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    sim_opts_t o;
+    int i, status = 0;
+
+    if (sim_getopt(argc, argv, "acm", &o) < 0) return 1;
+    if (o.n_operands == 0) {
+        sim_error("touch", "missing file operand\nTry 'touch --help' for more information.");
+        return 1;
+    }
+    for (i = 1; i <= o.n_operands; i++) {
+        char name[NAME_MAX_LEN + 1];
+        uint32_t dir, ino;
+        int err = perm_resolve(env, argv[i], &ino);
+
+        if (err == 0) {
+            const vfs_inode_t* node = vfs_inode(env->vfs, ino);
+
+            if (env->euid != 0 && node->uid != env->euid && !perm_may(env, ino, 2)) {
+                err = -EACCES;
+            } else {
+                vfs_touch(env->vfs, ino, env->clock);
+            }
+        } else if (err == -ENOENT && !SIM_HAS(&o, 'c')) {
+            err = perm_resolve_parent(env, argv[i], &dir, name, sizeof(name));
+            if (!err && !perm_may(env, dir, 3)) err = -EACCES;
+            if (!err) err = vfs_create(env->vfs, dir, name, S_IFREG | (0666 & ~env->umask),
+                                       env->euid, new_gid(env, dir), env->clock, NULL);
+        } else if (err == -ENOENT) {
+            err = 0;
+        }
+        if (err) {
+            sim_error("touch", "cannot touch '%s': %s", argv[i], strerror(-err));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+// Is ino the directory anc or somewhere below it?
+static int is_within(const vfs_t* fs, uint32_t ino, uint32_t anc) {
+    for (;;) {
+        if (ino == anc) return 1;
+        if (ino == VFS_ROOT) return 0;
+        ino = vfs_inode(fs, ino)->parent;
+    }
+}
+
+typedef struct {
+    sim_env_t* env;
+    int preserve, verbose;
+} copy_t;
+
+static int copy_entry(copy_t* cp, uint32_t src, uint32_t dir, const char* name, const char* from, const char* to) {
+    vfs_t* fs = cp->env->vfs;
+    vfs_inode_t node = *vfs_inode(fs, src);
+    uint32_t mode = node.mode & (cp->preserve ? 07777 : ~cp->env->umask & 0777);
+    uint32_t uid = cp->env->euid, gid = new_gid(cp->env, dir);
+    uint32_t target = vfs_lookup(fs, dir, name);
+    int status = 0, err;
+
+    if (cp->preserve && cp->env->euid == 0) {
+        uid = node.uid;
+        gid = node.gid;
+    }
+    if (target == VFS_NONE && !perm_may(cp->env, dir, 3)) {
+        sim_error("cp", "cannot create %s '%s': %s", S_ISDIR(node.mode) ? "directory" : "regular file",
+                  to, strerror(EACCES));
+        return 1;
+    }
+    if (!perm_may(cp->env, src, 4)) {
+        sim_error("cp", "cannot open '%s' for reading: %s", from, strerror(EACCES));
+        return 1;
+    }
+
+    if (S_ISDIR(node.mode)) {
+        uint32_t i;
+
+        if (is_within(fs, dir, src)) {
+            sim_error("cp", "cannot copy a directory, '%s', into itself, '%s'", from, to);
+            return 1;
+        }
+        if (target != VFS_NONE && !S_ISDIR(vfs_inode(fs, target)->mode)) {
+            sim_error("cp", "cannot overwrite non-directory '%s' with directory '%s'", to, from);
+            return 1;
+        }
+        if (target == VFS_NONE) {
+            err = vfs_create(fs, dir, name, S_IFDIR | mode, uid, gid, cp->env->clock, &target);
+            if (err) {
+                sim_error("cp", "cannot create directory '%s': %s", to, strerror(-err));
+                return 1;
+            }
+        }
+        if (cp->verbose) con_printf("'%s' -> '%s'\n", from, to);
+
+        // The source cannot change underneath us: the copy is not inside it
+        for (i = 0; i < vfs_inode(fs, src)->n_children; i++) {
+            vfs_dirent_t e = vfs_inode(fs, src)->children[i];
+            const char* child = vfs_name(fs, e.name);
+            size_t child_len = strlen(child);
+            char* child_from = malloc(strlen(from) + child_len + 2);
+            char* child_to = malloc(strlen(to) + child_len + 2);
+
+            sprintf(child_from, "%s%s%s", from, from[strlen(from) - 1] == '/' ? "" : "/", child);
+            sprintf(child_to, "%s%s%s", to, to[strlen(to) - 1] == '/' ? "" : "/", child);
+            // child points into the name arena, which creating entries may
+            // move, so pass the copy at the end of child_from instead
+            status |= copy_entry(cp, e.ino, target, child_from + strlen(child_from) - child_len, child_from, child_to);
+            free(child_from);
+            free(child_to);
+        }
+    } else {
+        if (target == src) {
+            sim_error("cp", "'%s' and '%s' are the same file", from, to);
+            return 1;
+        }
+        if (target != VFS_NONE && S_ISDIR(vfs_inode(fs, target)->mode)) {
+            sim_error("cp", "cannot overwrite directory '%s' with non-directory", to);
+            return 1;
+        }
+        if (target != VFS_NONE && !perm_may(cp->env, target, 2)) {
+            sim_error("cp", "cannot create regular file '%s': %s", to, strerror(EACCES));
+            return 1;
+        }
+        if (target == VFS_NONE) {
+            err = vfs_create(fs, dir, name, S_IFREG | mode, uid, gid, cp->env->clock, &target);
+            if (err) {
+                sim_error("cp", "cannot create regular file '%s': %s", to, strerror(-err));
+                return 1;
+            }
+        }
+        vfs_set_size(fs, target, node.size, cp->env->clock);
+        if (cp->verbose) con_printf("'%s' -> '%s'\n", from, to);
+    }
+    if (cp->preserve) vfs_set_times(fs, target, (time_t)node.atime, (time_t)node.mtime, cp->env->clock);
+    return status;
+}
+
+// Where "cp/mv SRC DEST" puts SRC: inside DEST if it is a directory
+static int destination(sim_env_t* env, const char* src, const char* dest, int dest_is_dir, uint32_t dest_ino,
+                       uint32_t* dir, char* name, char* display, size_t display_len) {
+    if (dest_is_dir) {
+        const char* base = base_name(src);
+        size_t n = strcspn(base, "/");
+
+        if (n > NAME_MAX_LEN) return -ENAMETOOLONG;
+        memcpy(name, base, n);
+        name[n] = '\0';
+        *dir = dest_ino;
+        snprintf(display, display_len, "%s%s%s", dest, dest[strlen(dest) - 1] == '/' ? "" : "/", name);
+        return 0;
+    }
+    snprintf(display, display_len, "%s", dest);
+    return perm_resolve_parent(env, dest, dir, name, NAME_MAX_LEN + 1);
+}
+
+int vfs_cmd_cp(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    copy_t cp = { env, 0, 0 };
+    const char* dest;
+    uint32_t dest_ino = VFS_NONE;
+    int dest_is_dir, i, status = 0;
+    sim_opts_t o;
+
+    if (sim_getopt(argc, argv, "rRapvfi", &o) < 0) return 1;
+    if (o.n_operands < 2) {
+        if (o.n_operands == 0) {
+            sim_error("cp", "missing file operand\nTry 'cp --help' for more information.");
+        } else {
+            sim_error("cp", "missing destination file operand after '%s'\nTry 'cp --help' for more information.", argv[1]);
+        }
+        return 1;
+    }
+    cp.preserve = SIM_HAS(&o, 'p') || SIM_HAS(&o, 'a');
+    cp.verbose = SIM_HAS(&o, 'v');
+    dest = argv[o.n_operands];
+    dest_is_dir = perm_resolve(env, dest, &dest_ino) == 0 && S_ISDIR(vfs_inode(env->vfs, dest_ino)->mode);
+    if (o.n_operands > 2 && !dest_is_dir) {
+        sim_error("cp", "target '%s' is not a directory", dest);
+        return 1;
+    }
+
+    for (i = 1; i < o.n_operands; i++) {
+        char name[NAME_MAX_LEN + 1], to[4096];
+        uint32_t src, dir;
+        int err = perm_resolve(env, argv[i], &src);
+
+        if (err) {
+            sim_error("cp", "cannot stat '%s': %s", argv[i], strerror(-err));
+            status = 1;
+            continue;
+        }
+        if (S_ISDIR(vfs_inode(env->vfs, src)->mode) && !SIM_HAS(&o, 'r') && !SIM_HAS(&o, 'R') && !SIM_HAS(&o, 'a')) {
+            sim_error("cp", "-r not specified; omitting directory '%s'", argv[i]);
+            status = 1;
+            continue;
+        }
+        err = destination(env, argv[i], dest, dest_is_dir, dest_ino, &dir, name, to, sizeof(to));
+        if (err) {
+            sim_error("cp", "cannot create regular file '%s': %s", dest, strerror(-err));
+            status = 1;
+            continue;
+        }
+        status |= copy_entry(&cp, src, dir, name, argv[i], to);
+    }
+    return status;
+}
+
+int vfs_cmd_mv(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    const char* dest;
+    uint32_t dest_ino = VFS_NONE;
+    int dest_is_dir, i, status = 0;
+    sim_opts_t o;
+
+    if (sim_getopt(argc, argv, "fivn", &o) < 0) return 1;
+    if (o.n_operands < 2) {
+        if (o.n_operands == 0) {
+            sim_error("mv", "missing file operand\nTry 'mv --help' for more information.");
+        } else {
+            sim_error("mv", "missing destination file operand after '%s'\nTry 'mv --help' for more information.", argv[1]);
+        }
+        return 1;
+    }
+    dest = argv[o.n_operands];
+    dest_is_dir = perm_resolve(env, dest, &dest_ino) == 0 && S_ISDIR(vfs_inode(env->vfs, dest_ino)->mode);
+    if (o.n_operands > 2 && !dest_is_dir) {
+        sim_error("mv", "target '%s' is not a directory", dest);
+        return 1;
+    }
+
+    for (i = 1; i < o.n_operands; i++) {
+        char from_name[NAME_MAX_LEN + 1], name[NAME_MAX_LEN + 1], to[4096];
+        uint32_t from_dir, dir, ino = VFS_NONE, target;
+        int err = perm_resolve_parent(env, argv[i], &from_dir, from_name, sizeof(from_name));
+
+        if (!err) ino = vfs_lookup(env->vfs, from_dir, from_name);
+        if (!err && ino == VFS_NONE) err = -ENOENT;
+        if (err) {
+            sim_error("mv", "cannot stat '%s': %s", argv[i], strerror(-err));
+            status = 1;
+            continue;
+        }
+        err = destination(env, argv[i], dest, dest_is_dir, dest_ino, &dir, name, to, sizeof(to));
+        if (!err && SIM_HAS(&o, 'n') && vfs_lookup(env->vfs, dir, name) != VFS_NONE) continue;
+        target = err ? VFS_NONE : vfs_lookup(env->vfs, dir, name);
+        if (!err && (!perm_may_unlink(env, from_dir, ino) || !perm_may(env, dir, 3))) err = -EACCES;
+        if (!err && target != VFS_NONE && target != ino && !perm_may_unlink(env, dir, target)) err = -EACCES;
+        if (!err) err = vfs_rename(env->vfs, from_dir, from_name, dir, name, env->clock);
+        if (err == -EINVAL) {
+            sim_error("mv", "cannot move '%s' to a subdirectory of itself, '%s'", argv[i], to);
+        } else if (err == -EISDIR) {
+            sim_error("mv", "cannot overwrite directory '%s' with non-directory", to);
+        } else if (err == -ENOTDIR && vfs_lookup(env->vfs, dir, name) != VFS_NONE) {
+            sim_error("mv", "cannot overwrite non-directory '%s' with directory '%s'", to, argv[i]);
+        } else if (err) {
+            sim_error("mv", "cannot move '%s' to '%s': %s", argv[i], to, strerror(-err));
+        } else if (SIM_HAS(&o, 'v')) {
+            con_printf("renamed '%s' -> '%s'\n", argv[i], to);
+        }
+        if (err) status = 1;
+    }
+    return status;
+}
+
+int vfs_cmd_rm(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    int recursive, force, i, status = 0;
+    sim_opts_t o;
+
+    if (sim_getopt(argc, argv, "rRfidv", &o) < 0) return 1;
+    recursive = SIM_HAS(&o, 'r') || SIM_HAS(&o, 'R');
+    force = SIM_HAS(&o, 'f');
+    if (o.n_operands == 0) {
+        if (force) return 0;
+        sim_error("rm", "missing operand\nTry 'rm --help' for more information.");
+        return 1;
+    }
+    for (i = 1; i <= o.n_operands; i++) {
+        char name[NAME_MAX_LEN + 1];
+        uint32_t dir, ino = VFS_NONE;
+        const vfs_inode_t* node;
+        int err = perm_resolve_parent(env, argv[i], &dir, name, sizeof(name));
+
+        if (!err && name[0] == '\0') {
+            if (recursive) {
+                sim_error("rm", "it is dangerous to operate recursively on '/'");
+                sim_error("rm", "use --no-preserve-root to override this failsafe");
+            } else {
+                sim_error("rm", "cannot remove '%s': %s", argv[i], strerror(EISDIR));
+            }
+            status = 1;
+            continue;
+        }
+        if (!err && (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)) {
+            sim_error("rm", "refusing to remove '.' or '..' directory: skipping '%s'", argv[i]);
+            status = 1;
+            continue;
+        }
+        if (!err) ino = vfs_lookup(env->vfs, dir, name);
+        if (!err && ino == VFS_NONE) err = -ENOENT;
+        if (err) {
+            if (!(force && err == -ENOENT)) {
+                sim_error("rm", "cannot remove '%s': %s", argv[i], strerror(-err));
+                status = 1;
+            }
+            continue;
+        }
+        node = vfs_inode(env->vfs, ino);
+        if (S_ISDIR(node->mode) && !recursive && !(SIM_HAS(&o, 'd') && node->n_children == 0)) {
+            sim_error("rm", "cannot remove '%s': %s", argv[i], strerror(EISDIR));
+            status = 1;
+            continue;
+        }
+        if (!perm_may_unlink(env, dir, ino)) {
+            sim_error("rm", "cannot remove '%s': %s", argv[i], strerror(EACCES));
+            status = 1;
+            continue;
+        }
+        if (SIM_HAS(&o, 'v')) con_printf("removed %s'%s'\n", S_ISDIR(node->mode) ? "directory " : "", argv[i]);
+        vfs_remove_tree(env->vfs, dir, name, env->clock);
+    }
+    check_cwd(env);
+    return status;
+}
+
+static void stat_time(const char* label, int64_t t) {
+    struct tm tm;
+    time_t tt = (time_t)t;
+    char buf[64];
+
+    gmtime_r(&tt, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    con_printf("%s: %s.000000000 +0000\n", label, buf);
+}
+
+int vfs_cmd_stat(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    sim_opts_t o;
+    int i, status = 0;
+
+    if (sim_getopt(argc, argv, "L", &o) < 0) return 1;
+    if (o.n_operands == 0) {
+        sim_error("stat", "missing operand\nTry 'stat --help' for more information.");
+        return 1;
+    }
+    for (i = 1; i <= o.n_operands; i++) {
+        const vfs_inode_t* node;
+        char mode[11], size[32];
+        uint32_t ino;
+        int err = perm_resolve(env, argv[i], &ino);
+
+        if (err) {
+            sim_error("stat", "cannot statx '%s': %s", argv[i], strerror(-err));
+            status = 1;
+            continue;
+        }
+        node = vfs_inode(env->vfs, ino);
+        mode_string(node->mode, mode);
+        snprintf(size, sizeof(size), "%llu", (unsigned long long)node->size);
+        con_printf("  File: %s\n", argv[i]);
+        con_printf("  Size: %-10s\tBlocks: %-10llu IO Block: 4096   %s\n", size,
+                   (unsigned long long)blocks_1k(node) * 2,
+                   S_ISDIR(node->mode) ? "directory" : node->size ? "regular file" : "regular empty file");
+        con_printf("Device: 801h/2049d\tInode: %-11u Links: %u\n", 131072 + ino, node->nlink);
+        con_printf("Access: (%04o/%s)  Uid: (%5u/%8s)   Gid: (%5u/%8s)\n", node->mode & 07777, mode,
+                   node->uid, sim_user_name(node->uid), node->gid, sim_group_name(node->gid));
+        stat_time("Access", node->atime);
+        stat_time("Modify", node->mtime);
+        stat_time("Change", node->ctime);
+        con_printf(" Birth: -\n");
+    }
+    return status;
+}
+
+int vfs_cmd_umask(int argc, char** argv) {
+    sim_env_t* env = sim_env();
+    sim_opts_t o;
+
+    if (sim_getopt(argc, argv, "S", &o) < 0) return 2;
+    if (o.n_operands > 0) {
+        char* end;
+        unsigned long mask = strtoul(argv[1], &end, 8);
+
+        if (*end || mask > 0777) {
+            con_printf("bash: umask: %s: octal number out of range\n", argv[1]);
+            return 1;
+        }
+        env->umask = (uint32_t)mask;
+        return 0;
+    }
+    if (SIM_HAS(&o, 'S')) {
+        uint32_t allowed = ~env->umask & 0777;
+        static const char* who[] = { "u", "g", "o" };
+        int k;
+
+        for (k = 0; k < 3; k++) {
+            uint32_t bits = (allowed >> (6 - 3 * k)) & 7;
+
+            con_printf("%s=%s%s%s%s", who[k], (bits & 4) ? "r" : "", (bits & 2) ? "w" : "",
+                       (bits & 1) ? "x" : "", k < 2 ? "," : "\n");
+        }
+    } else {
+        con_printf("%04o\n", env->umask);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------
+// Benchmark: --bench vfs [entries]
+
+static uint64_t bench_rng = 88172645463325252ull;
+
+int vfs_bench(int argc, char** argv) {
+    long entries = argc > 0 ? atol(argv[0]) : 1000000;
+    uint32_t fanout, wide_count, i, j, k, created = 0;
+    uint32_t* leaves;
+    uint32_t wide;
+    vfs_dirent_t* listing;
+    char** paths;
+    char name[64];
+    double start, elapsed;
+    size_t n_paths = 65536, lookups = 2000000, listed = 0;
+    volatile uint32_t sink = 0;
+    vfs_t* fs;
+
+    if (entries < 1000) entries = 1000;
+    for (fanout = 1; (long)fanout * fanout * fanout < entries; fanout++) {
+    }
+    wide_count = entries / 10 < 100000 ? (uint32_t)(entries / 10) : 100000;
+    leaves = malloc((size_t)fanout * fanout * sizeof(uint32_t));
+    listing = malloc((wide_count > fanout ? wide_count : fanout) * sizeof(vfs_dirent_t));
+    paths = malloc(n_paths * sizeof(char*));
+    fs = vfs_new();
+
+    // Build /dI/dJ/fNNNNNNN with distinct file names, plus one wide directory
+    start = bench_now();
+    for (i = 0; i < fanout && created < entries; i++) {
+        uint32_t top;
+
+        snprintf(name, sizeof(name), "d%u", i);
+        vfs_create(fs, VFS_ROOT, name, S_IFDIR | 0755, 0, 0, 0, &top);
+        created++;
+        for (j = 0; j < fanout && created < entries; j++) {
+            uint32_t leaf;
+
+            snprintf(name, sizeof(name), "d%u", j);
+            vfs_create(fs, top, name, S_IFDIR | 0755, 0, 0, 0, &leaf);
+            leaves[i * fanout + j] = leaf;
+            created++;
+            for (k = 0; k < fanout && created < entries; k++) {
+                snprintf(name, sizeof(name), "f%07u", created);
+                vfs_create(fs, leaf, name, S_IFREG | 0644, 0, 0, 0, NULL);
+                created++;
+            }
+        }
+    }
+    vfs_create(fs, VFS_ROOT, "wide", S_IFDIR | 0755, 0, 0, 0, &wide);
+    for (i = 0; i < wide_count; i++) {
+        snprintf(name, sizeof(name), "w%06u", i);
+        vfs_create(fs, wide, name, S_IFREG | 0644, 0, 0, 0, NULL);
+    }
+    elapsed = bench_now() - start;
+    bench_report("vfs", "entries", vfs_inode_count(fs), "count");
+    bench_report("vfs", "build_rate", vfs_inode_count(fs) / elapsed, "entries/s");
+    bench_report("vfs", "memory_per_entry", (double)vfs_memory_used(fs) / vfs_inode_count(fs), "bytes");
+
+    // Random full-depth lookups of existing files
+    for (i = 0; i < n_paths; i++) {
+        const vfs_dirent_t* children;
+        uint32_t d1 = bench_random(&bench_rng, fanout), d2 = bench_random(&bench_rng, fanout);
+        uint32_t n = vfs_children(fs, leaves[d1 * fanout + d2], &children);
+
+        paths[i] = malloc(64);
+        snprintf(paths[i], 64, "/d%u/d%u/%s", d1, d2, n ? vfs_name(fs, children[bench_random(&bench_rng, n)].name) : "none");
+    }
+    start = bench_now();
+    for (i = 0; i < lookups; i++) {
+        uint32_t ino = VFS_NONE;
+
+        vfs_resolve(fs, VFS_ROOT, paths[i & (n_paths - 1)], &ino);
+        sink += ino;
+    }
+    elapsed = bench_now() - start;
+    bench_report("vfs", "lookup_hit", elapsed / lookups * 1e9, "ns");
+
+    // Misses: names that exist elsewhere in the tree, so the hash probe
+    // succeeds and the directory search has to fail
+    for (i = 0; i < n_paths; i++) {
+        char* last = strrchr(paths[i], '/');
+
+        snprintf(paths[i], 64, "/d%u/d%u%s", bench_random(&bench_rng, fanout), bench_random(&bench_rng, fanout), last);
+    }
+    start = bench_now();
+    for (i = 0; i < lookups; i++) {
+        uint32_t ino = VFS_NONE;
+
+        vfs_resolve(fs, VFS_ROOT, paths[i & (n_paths - 1)], &ino);
+        sink += ino;
+    }
+    elapsed = bench_now() - start;
+    bench_report("vfs", "lookup_miss", elapsed / lookups * 1e9, "ns");
+
+    // Sorted listings, as ls prints them
+    start = bench_now();
+    for (i = 0; i < 20000; i++) {
+        uint32_t dir = leaves[bench_random(&bench_rng, fanout * fanout)];
+
+        vfs_sorted_children(fs, dir, listing);
+        listed += vfs_inode(fs, dir)->n_children;
+    }
+    elapsed = bench_now() - start;
+    bench_report("vfs", "list_small_dir", elapsed / 20000 * 1e6, "us");
+    bench_report("vfs", "list_rate", listed / elapsed, "entries/s");
+
+    start = bench_now();
+    for (i = 0; i < 10; i++) vfs_sorted_children(fs, wide, listing);
+    elapsed = bench_now() - start;
+    bench_report("vfs", "list_wide_dir", elapsed / 10 * 1e3, "ms");
+
+    // rm -r of the whole tree
+    created = vfs_inode_count(fs) - 1;
+    start = bench_now();
+    for (i = 0; i < fanout; i++) {
+        snprintf(name, sizeof(name), "d%u", i);
+        vfs_remove_tree(fs, VFS_ROOT, name, 0);
+    }
+    vfs_remove_tree(fs, VFS_ROOT, "wide", 0);
+    elapsed = bench_now() - start;
+    bench_report("vfs", "remove_rate", created / elapsed, "entries/s");
+
+    for (i = 0; i < n_paths; i++) free(paths[i]);
+    free(paths);
+    free(listing);
+    free(leaves);
+    vfs_free(fs);
+    return sink == 1 ? 1 : 0;
+}
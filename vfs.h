@@ -0,0 +1,125 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// In-memory filesystem for simulation mode.
+//
+// Inodes live in one growable array and are named by index, so a tree of
+// a million entries is a few large allocations rather than a million
+// small ones. Path components are interned: every distinct name is
+// stored once and identified by a 32-bit id, and a directory's children
+// are a contiguous array of (name id, inode) pairs sorted by id. Looking
+// up a component is one hash probe to find its id (a name that was never
+// interned cannot exist anywhere) followed by a binary search over 8-byte
+// entries that never touches the name strings. Child arrays come from
+// power-of-two size classes carved out of shared chunks and are recycled
+// through per-class free lists. Extended ACLs are runs of entries in one
+// array, and an inode with one refers to its run.
+
+#define VFS_ROOT 0
+#define VFS_NONE UINT32_MAX
+
+typedef struct {
+    uint32_t name;          // interned name id
+    uint32_t ino;
+} vfs_dirent_t;
+
+// POSIX ACL entries beyond the owner and other classes, which stay in
+// the mode. With a mask entry, the mode's group bits are the mask.
+typedef enum {
+    VFS_ACL_USER,           // named user
+    VFS_ACL_GROUP_OBJ,      // the owning group
+    VFS_ACL_GROUP,          // named group
+    VFS_ACL_MASK
+} vfs_acl_tag_t;
+
+typedef struct {
+    uint32_t id;            // uid or gid of a named entry
+    uint8_t tag;
+    uint8_t perm;           // 4 read, 2 write, 1 execute
+} vfs_acl_entry_t;
+
+typedef struct {
+    uint32_t mode;          // S_IFDIR / S_IFREG | permission bits
+    uint32_t uid, gid;
+    uint32_t nlink;
+    uint64_t size;
+    int64_t atime, mtime, ctime;
+    uint32_t parent;        // directories: ".."; VFS_NONE once freed
+    uint32_t name;          // directories: name in parent (for paths)
+    uint32_t n_children;
+    uint32_t children_class;
+    uint32_t acl;           // extended ACL: run + 1, 0 for none
+    vfs_dirent_t* children;
+} vfs_inode_t;
+
+typedef struct vfs vfs_t;
+
+vfs_t* vfs_new(void);
+void vfs_free(vfs_t* fs);
+
+// The small Debian system the lessons talk about (/etc, /home/admin, ...)
+void vfs_seed_debian(vfs_t* fs);
+
+const vfs_inode_t* vfs_inode(const vfs_t* fs, uint32_t ino);
+const char* vfs_name(const vfs_t* fs, uint32_t name);
+uint32_t vfs_inode_count(const vfs_t* fs);
+size_t vfs_memory_used(const vfs_t* fs);
+
+// Path resolution relative to cwd. Returns 0 and the inode, or -errno.
+int vfs_resolve(const vfs_t* fs, uint32_t cwd, const char* path, uint32_t* ino_out);
+// Resolve everything but the last component: the parent directory and
+// a pointer to the final name (trailing slashes stripped into name_buf).
+int vfs_resolve_parent(const vfs_t* fs, uint32_t cwd, const char* path,
+                       uint32_t* dir_out, char* name_buf, size_t name_len);
+uint32_t vfs_lookup(const vfs_t* fs, uint32_t dir, const char* name);
+// Absolute path of a directory (or "/"); returns its length
+size_t vfs_path(const vfs_t* fs, uint32_t dir, char* buf, size_t len);
+
+// Mutations; all return 0 or -errno and leave the tree unchanged on error
+int vfs_create(vfs_t* fs, uint32_t dir, const char* name, uint32_t mode,
+               uint32_t uid, uint32_t gid, time_t now, uint32_t* ino_out);
+int vfs_unlink(vfs_t* fs, uint32_t dir, const char* name, time_t now);
+// Unlink an entry and, if it is a directory, everything below it
+int vfs_remove_tree(vfs_t* fs, uint32_t dir, const char* name, time_t now);
+int vfs_rename(vfs_t* fs, uint32_t from_dir, const char* from, uint32_t to_dir, const char* to, time_t now);
+void vfs_touch(vfs_t* fs, uint32_t ino, time_t now);
+void vfs_set_size(vfs_t* fs, uint32_t ino, uint64_t size, time_t now);
+void vfs_set_times(vfs_t* fs, uint32_t ino, time_t atime, time_t mtime, time_t ctime);
+// Permission bits (07777), owner and group; a mask entry follows chmod's
+// group bits
+void vfs_chmod(vfs_t* fs, uint32_t ino, uint32_t mode, time_t now);
+void vfs_chown(vfs_t* fs, uint32_t ino, uint32_t uid, uint32_t gid, time_t now);
+// An inode's extended ACL entries (none: 0); setting none removes it
+uint32_t vfs_acl(const vfs_t* fs, uint32_t ino, const vfs_acl_entry_t** out);
+void vfs_set_acl(vfs_t* fs, uint32_t ino, const vfs_acl_entry_t* entries, uint32_t n, time_t now);
+// Counts the changes that can change whether a directory can be searched
+// or reached: a directory's mode, owner or ACL changing, or a directory
+// moving or going away (and its inode being reused)
+uint64_t vfs_generation(const vfs_t* fs);
+
+// Children of a directory, sorted by name id (not alphabetically)
+uint32_t vfs_children(const vfs_t* fs, uint32_t dir, const vfs_dirent_t** out);
+// The same entries sorted by name into out (which must hold n_children)
+void vfs_sorted_children(const vfs_t* fs, uint32_t dir, vfs_dirent_t* out);
+
+// Simulated commands (see sim.c)
+int vfs_cmd_pwd(int argc, char** argv);
+int vfs_cmd_cd(int argc, char** argv);
+int vfs_cmd_ls(int argc, char** argv);
+int vfs_cmd_mkdir(int argc, char** argv);
+int vfs_cmd_rmdir(int argc, char** argv);
+int vfs_cmd_touch(int argc, char** argv);
+int vfs_cmd_cp(int argc, char** argv);
+int vfs_cmd_mv(int argc, char** argv);
+int vfs_cmd_rm(int argc, char** argv);
+int vfs_cmd_stat(int argc, char** argv);
+int vfs_cmd_umask(int argc, char** argv);
+
+// --bench vfs [entries]
+int vfs_bench(int argc, char** argv);
+
+#endif